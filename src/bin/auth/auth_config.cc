@@ -24,11 +24,13 @@
 #include <auth/common.h>
 
 #include <server_common/portconfig.h>
+#include <server_common/query_capture.h>
 
 #include <boost/foreach.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -137,6 +139,93 @@ private:
     size_t timeout_;
 };
 
+/// \brief Configuration for measuring the latency of the requests
+class LatencyStatisticsConfig : public AuthConfigParser {
+public:
+    LatencyStatisticsConfig(AuthSrv& server) : server_(server),
+                                               enabled_(false)
+    {}
+
+    virtual void build(ConstElementPtr config) {
+        enabled_ = config->boolValue();
+    }
+
+    virtual void commit() {
+        server_.setLatencyStatistics(enabled_);
+    }
+private:
+    AuthSrv& server_;
+    bool enabled_;
+};
+
+/// \brief Configuration for exporting the statistics in shared memory
+class StatisticsSegmentConfig : public AuthConfigParser {
+public:
+    StatisticsSegmentConfig(AuthSrv& server) : server_(server)
+    {}
+
+    virtual void build(ConstElementPtr config) {
+        // The segment is created here, so as the failure to create it is
+        // reported as a configuration error.
+        server_.setStatisticsSegment(config->stringValue());
+    }
+
+    virtual void commit() {}
+private:
+    AuthSrv& server_;
+};
+
+/// \brief Configuration for the interval of updating the statistics
+/// segment
+class StatisticsSegmentIntervalConfig : public AuthConfigParser {
+public:
+    StatisticsSegmentIntervalConfig(AuthSrv& server) : server_(server),
+                                                       interval_(0)
+    {}
+
+    virtual void build(ConstElementPtr config) {
+        if (config->intValue() > 0) {
+            interval_ = config->intValue();
+        } else {
+            bundy_throw(AuthConfigError,
+                        "statistics_segment_interval must be positive");
+        }
+    }
+
+    virtual void commit() {
+        server_.setStatisticsSegmentInterval(interval_);
+    }
+private:
+    AuthSrv& server_;
+    long interval_;
+};
+
+/// \brief Configuration for capturing the queries
+class QueryCaptureConfig : public AuthConfigParser {
+public:
+    QueryCaptureConfig(AuthSrv& server) : server_(server)
+    {}
+
+    virtual void build(ConstElementPtr config) {
+        // The output is opened here, so as the failure is reported as a
+        // configuration error, but the stream only starts on commit.
+        capture_.reset(bundy::server_common::createQueryCapture(config));
+    }
+
+    virtual void commit() {
+        // The current capture may write to the same output, so it's
+        // stopped before the new one starts its stream.
+        server_.setQueryCapture(NULL);
+        if (capture_.get() != NULL) {
+            capture_->start();
+        }
+        server_.setQueryCapture(capture_.release());
+    }
+private:
+    AuthSrv& server_;
+    std::auto_ptr<bundy::server_common::QueryCapture> capture_;
+};
+
 } // end of unnamed namespace
 
 AuthConfigParser*
@@ -170,6 +259,14 @@ createAuthConfigParser(AuthSrv& server, const std::string& config_id) {
         return (new VersionConfig());
     } else if (config_id == "tcp_recv_timeout") {
         return (new TCPRecvTimeoutConfig(server));
+    } else if (config_id == "latency_statistics") {
+        return (new LatencyStatisticsConfig(server));
+    } else if (config_id == "statistics_segment") {
+        return (new StatisticsSegmentConfig(server));
+    } else if (config_id == "statistics_segment_interval") {
+        return (new StatisticsSegmentIntervalConfig(server));
+    } else if (config_id == "query_capture") {
+        return (new QueryCaptureConfig(server));
     } else {
         bundy_throw(AuthConfigError, "Unknown configuration identifier: " <<
                   config_id);
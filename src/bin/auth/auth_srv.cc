@@ -17,6 +17,7 @@
 #include <util/io/socketsession.h>
 
 #include <asiolink/asiolink.h>
+#include <asiolink/interval_timer.h>
 #include <asiolink/io_endpoint.h>
 
 #include <config/ccsession.h>
@@ -85,7 +86,16 @@ using namespace bundy::asiolink;
 using namespace bundy::asiodns;
 using namespace bundy::server_common::portconfig;
 using bundy::auth::statistics::Counters;
+using bundy::auth::statistics::CountersExporter;
 using bundy::auth::statistics::MessageAttributes;
+using bundy::auth::statistics::LatencyTimer;
+using bundy::auth::statistics::getMonotonicTime;
+using bundy::auth::statistics::LATENCY_PARSE_HEADER;
+using bundy::auth::statistics::LATENCY_FROM_WIRE;
+using bundy::auth::statistics::LATENCY_TSIG_VERIFY;
+using bundy::auth::statistics::LATENCY_PROCESS;
+using bundy::auth::statistics::LATENCY_TO_WIRE;
+using bundy::server_common::QueryCapture;
 
 namespace {
 // A helper class for cleaning up message renderer.
@@ -271,6 +281,29 @@ public:
     /// Query counters for statistics
     Counters counters_;
 
+    /// Export of the counters in shared memory, NULL if not configured
+    boost::scoped_ptr<CountersExporter> counters_exporter_;
+
+    /// Timer of updating the exported counters
+    IntervalTimer statistics_timer_;
+
+    /// Interval of updating the exported counters, in milliseconds
+    long statistics_interval_;
+
+    /// Capture of the requests, NULL if not configured
+    boost::scoped_ptr<QueryCapture> capture_;
+
+    /// When the request being processed was received, if it's captured
+    QueryCapture::Timestamp capture_query_time_;
+
+    /// The zone which answered the request being processed, NULL if none
+    const Name* capture_zone_;
+
+    /// \brief Write the counters in the statistics segment
+    ///
+    /// This is called by \c statistics_timer_.
+    void updateStatisticsSegment();
+
     /// Addresses we listen on
     AddressList listen_addresses_;
 
@@ -291,18 +324,23 @@ public:
     /// \brief Resume the server
     ///
     /// This is a wrapper call for DNSServer::resume(done). Query/Response
-    /// statistics counters are incremented in this method.
+    /// statistics counters are incremented and the request is captured
+    /// in this method.
     ///
     /// This method is expected to be called by processMessage()
     ///
     /// \param server The DNSServer as passed to processMessage()
+    /// \param io_message The request as passed to processMessage()
     /// \param message The response as constructed by processMessage()
+    /// \param buffer The rendered response as passed to processMessage()
     /// \param stats_attrs Object to store message attributes in for use
     ///                    with statistics
     /// \param done If true, it indicates there is a response.
     ///             this value will be passed to server->resume(bool)
     void resumeServer(bundy::asiodns::DNSServer* server,
+                      const IOMessage& io_message,
                       bundy::dns::Message& message,
+                      const OutputBuffer& buffer,
                       MessageAttributes& stats_attrs,
                       const bool done);
 
@@ -320,6 +358,9 @@ AuthSrvImpl::AuthSrvImpl(AbstractXfroutClient& xfrout_client,
     config_session_(NULL),
     xfrin_session_(NULL),
     counters_(),
+    statistics_timer_(io_service_),
+    statistics_interval_(1000),
+    capture_zone_(NULL),
     keyring_(NULL),
     datasrc_clients_mgr_(io_service_),
     ddns_base_forwarder_(ddns_forwarder),
@@ -336,6 +377,16 @@ AuthSrvImpl::~AuthSrvImpl() {
     }
 }
 
+void
+AuthSrvImpl::updateStatisticsSegment() {
+    try {
+        counters_exporter_->update();
+    } catch (const bundy::Exception& ex) {
+        LOG_ERROR(auth_logger, AUTH_STATISTICS_SEGMENT_UPDATE_FAILED)
+            .arg(counters_exporter_->getFileName()).arg(ex.what());
+    }
+}
+
 // This is a derived class of \c DNSLookup, to serve as a
 // callback in the asiolink module.  It calls
 // AuthSrv::processMessage() on a single DNS message.
@@ -442,7 +493,10 @@ makeErrorMessage(MessageRenderer& renderer, Message& message,
     message.setRcode(rcode);
 
     RendererHolder holder(renderer, &buffer, stats_attrs);
-    message.toWire(renderer, tsig_context.get());
+    {
+        LatencyTimer timer(stats_attrs, LATENCY_TO_WIRE);
+        message.toWire(renderer, tsig_context.get());
+    }
     stats_attrs.setResponseTSIG(tsig_context.get() != NULL);
 
     LOG_DEBUG(auth_logger, DBG_AUTH_MESSAGES, AUTH_SEND_ERROR_RESPONSE)
@@ -481,6 +535,14 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
 {
     InputBuffer request_buffer(io_message.getData(), io_message.getDataSize());
     MessageAttributes stats_attrs;
+    if (impl_->counters_.isLatencyEnabled()) {
+        stats_attrs.startLatency(getMonotonicTime());
+    }
+
+    impl_->capture_zone_ = NULL;
+    if (impl_->capture_ && impl_->capture_->isSampled(io_message)) {
+        impl_->capture_query_time_ = QueryCapture::getTime();
+    }
 
     stats_attrs.setRequestIPVersion(
         io_message.getRemoteEndpoint().getFamily());
@@ -490,18 +552,23 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
     // First, check the header part.  If we fail even for the base header,
     // just drop the message.
     try {
-        message.parseHeader(request_buffer);
+        {
+            LatencyTimer timer(stats_attrs, LATENCY_PARSE_HEADER);
+            message.parseHeader(request_buffer);
+        }
 
         // Ignore all responses.
         if (message.getHeaderFlag(Message::HEADERFLAG_QR)) {
             LOG_DEBUG(auth_logger, DBG_AUTH_DETAIL, AUTH_RESPONSE_RECEIVED);
-            impl_->resumeServer(server, message, stats_attrs, false);
+            impl_->resumeServer(server, io_message, message, buffer,
+                                stats_attrs, false);
             return;
         }
     } catch (const bundy::Exception& ex) {
         LOG_DEBUG(auth_logger, DBG_AUTH_DETAIL, AUTH_HEADER_PARSE_FAIL)
                   .arg(ex.what());
-        impl_->resumeServer(server, message, stats_attrs, false);
+        impl_->resumeServer(server, io_message, message, buffer,
+                            stats_attrs, false);
         return;
     }
 
@@ -514,20 +581,23 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
 
     try {
         // Parse the message.
+        LatencyTimer timer(stats_attrs, LATENCY_FROM_WIRE);
         message.fromWire(request_buffer);
     } catch (const DNSProtocolError& error) {
         LOG_DEBUG(auth_logger, DBG_AUTH_DETAIL, AUTH_PACKET_PROTOCOL_FAILURE)
                   .arg(error.getRcode().toText()).arg(error.what());
         makeErrorMessage(impl_->renderer_, message, buffer, error.getRcode(),
                          stats_attrs);
-        impl_->resumeServer(server, message, stats_attrs, true);
+        impl_->resumeServer(server, io_message, message, buffer,
+                            stats_attrs, true);
         return;
     } catch (const bundy::Exception& ex) {
         LOG_DEBUG(auth_logger, DBG_AUTH_DETAIL, AUTH_PACKET_PARSE_FAILED)
                   .arg(ex.what());
         makeErrorMessage(impl_->renderer_, message, buffer, Rcode::SERVFAIL(),
                          stats_attrs);
-        impl_->resumeServer(server, message, stats_attrs, true);
+        impl_->resumeServer(server, io_message, message, buffer,
+                            stats_attrs, true);
         return;
     } // other exceptions will be handled at a higher layer.
 
@@ -548,6 +618,7 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
                                            tsig_record->getRdata().
                                                 getAlgorithm(),
                                            **impl_->keyring_));
+        LatencyTimer timer(stats_attrs, LATENCY_TSIG_VERIFY);
         tsig_error = tsig_context->verify(tsig_record, io_message.getData(),
                                           io_message.getDataSize());
         stats_attrs.setRequestTSIG(true, tsig_error != TSIGError::NOERROR());
@@ -556,7 +627,8 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
     if (tsig_error != TSIGError::NOERROR()) {
         makeErrorMessage(impl_->renderer_, message, buffer,
                          tsig_error.toRcode(), stats_attrs, tsig_context);
-        impl_->resumeServer(server, message, stats_attrs, true);
+        impl_->resumeServer(server, io_message, message, buffer,
+                            stats_attrs, true);
         return;
     }
 
@@ -592,6 +664,7 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
         } else {
             ConstQuestionPtr question = *message.beginQuestion();
             const RRType& qtype = question->getType();
+            stats_attrs.setRequestQType(qtype);
             if (qtype == RRType::AXFR()) {
                 send_answer = impl_->processXfrQuery(io_message, message,
                                                      buffer, tsig_context,
@@ -617,7 +690,8 @@ AuthSrv::processMessage(const IOMessage& io_message, Message& message,
         makeErrorMessage(impl_->renderer_, message, buffer, Rcode::SERVFAIL(),
                          stats_attrs);
     }
-    impl_->resumeServer(server, message, stats_attrs, send_answer);
+    impl_->resumeServer(server, io_message, message, buffer,
+                        stats_attrs, send_answer);
 }
 
 bool
@@ -654,7 +728,15 @@ AuthSrvImpl::processNormalQuery(const IOMessage& io_message,
         if (list) {
             const RRType& qtype = question->getType();
             const Name& qname = question->getName();
-            query_.process(*list, qname, qtype, message, dnssec_ok);
+            {
+                LatencyTimer timer(stats_attrs, LATENCY_PROCESS);
+                query_.process(*list, qname, qtype, message, dnssec_ok);
+            }
+            const boost::optional<Name>& zone = query_.getZone();
+            if (zone) {
+                stats_attrs.setZoneIndex(counters_.getZoneIndex(*zone));
+                capture_zone_ = &*zone;
+            }
         } else {
             makeErrorMessage(renderer_, message, buffer, Rcode::REFUSED(),
                              stats_attrs);
@@ -671,7 +753,10 @@ AuthSrvImpl::processNormalQuery(const IOMessage& io_message,
     const bool udp_buffer =
         (io_message.getSocket().getProtocol() == IPPROTO_UDP);
     renderer_.setLengthLimit(udp_buffer ? remote_bufsize : 65535);
-    message.toWire(renderer_, tsig_context.get());
+    {
+        LatencyTimer timer(stats_attrs, LATENCY_TO_WIRE);
+        message.toWire(renderer_, tsig_context.get());
+    }
     stats_attrs.setResponseTSIG(tsig_context.get() != NULL);
 
     LOG_DEBUG(auth_logger, DBG_AUTH_MESSAGES, AUTH_SEND_NORMAL_RESPONSE)
@@ -846,10 +931,16 @@ AuthSrvImpl::processUpdate(const IOMessage& io_message)
 }
 
 void
-AuthSrvImpl::resumeServer(DNSServer* server, Message& message,
+AuthSrvImpl::resumeServer(DNSServer* server, const IOMessage& io_message,
+                          Message& message, const OutputBuffer& buffer,
                           MessageAttributes& stats_attrs,
                           const bool done) {
     counters_.inc(stats_attrs, message, done);
+    if (capture_ && capture_->isSampled(io_message)) {
+        capture_->capture(QueryCapture::AUTH_RESPONSE, io_message,
+                          done ? &buffer : NULL, capture_zone_,
+                          &capture_query_time_);
+    }
     server->resume(done);
 }
 
@@ -916,6 +1007,64 @@ AuthSrv::setTCPRecvTimeout(size_t timeout) {
     dnss_->setTCPRecvTimeout(timeout);
 }
 
+void
+AuthSrv::setLatencyStatistics(bool enabled) {
+    impl_->counters_.setLatencyEnabled(enabled);
+}
+
+bool
+AuthSrv::getLatencyStatistics() const {
+    return (impl_->counters_.isLatencyEnabled());
+}
+
+void
+AuthSrv::setStatisticsSegment(const std::string& file_name) {
+    if (impl_->counters_exporter_ &&
+        impl_->counters_exporter_->getFileName() == file_name) {
+        return;
+    }
+    impl_->statistics_timer_.cancel();
+    impl_->counters_exporter_.reset();
+    if (file_name.empty()) {
+        return;
+    }
+    impl_->counters_exporter_.reset(new CountersExporter(impl_->counters_,
+                                                         file_name));
+    impl_->statistics_timer_.setup(
+        boost::bind(&AuthSrvImpl::updateStatisticsSegment, impl_),
+        impl_->statistics_interval_);
+}
+
+std::string
+AuthSrv::getStatisticsSegment() const {
+    return (impl_->counters_exporter_ ?
+            impl_->counters_exporter_->getFileName() : std::string());
+}
+
+void
+AuthSrv::setStatisticsSegmentInterval(long interval) {
+    if (interval <= 0) {
+        bundy_throw(InvalidParameter, "statistics segment interval must be "
+                    "positive: " << interval);
+    }
+    impl_->statistics_interval_ = interval;
+    if (impl_->counters_exporter_) {
+        impl_->statistics_timer_.setup(
+            boost::bind(&AuthSrvImpl::updateStatisticsSegment, impl_),
+            interval);
+    }
+}
+
+void
+AuthSrv::setQueryCapture(QueryCapture* capture) {
+    impl_->capture_.reset(capture);
+}
+
+const QueryCapture*
+AuthSrv::getQueryCapture() const {
+    return (impl_->capture_.get());
+}
+
 namespace {
 
 bool
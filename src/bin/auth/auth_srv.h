@@ -35,6 +35,7 @@
 
 #include <asiolink/asiolink.h>
 #include <server_common/portconfig.h>
+#include <server_common/query_capture.h>
 
 #include <auth/statistics.h>
 #include <auth/datasrc_clients_mgr.h>
@@ -272,6 +273,54 @@ public:
     /// open forever.
     void setTCPRecvTimeout(size_t timeout);
 
+    /// \brief Enable or disable measuring the latency of the requests
+    ///
+    /// If enabled, the latency of the stages of processing each request
+    /// is counted in the histograms returned by \c getStatistics().
+    ///
+    /// \param enabled true to measure the latency
+    void setLatencyStatistics(bool enabled);
+
+    /// \brief Return whether the latency of the requests is measured
+    bool getLatencyStatistics() const;
+
+    /// \brief Set the shared memory segment the statistics are exported in
+    ///
+    /// The values of the statistics counters are written periodically in
+    /// the segment (see \c bundy::statistics::SharedCounters), so the
+    /// other processes can read them without asking the server.
+    ///
+    /// \param file_name name of the file of the segment; if empty, the
+    ///        statistics are not exported
+    /// \throw bundy::statistics::SharedCountersError the segment can't be
+    ///        created
+    void setStatisticsSegment(const std::string& file_name);
+
+    /// \brief Return the name of the file of the statistics segment
+    ///
+    /// \return the file name, or an empty string if the statistics are
+    ///         not exported
+    std::string getStatisticsSegment() const;
+
+    /// \brief Set the interval of updating the statistics segment
+    ///
+    /// \param interval the interval in milliseconds; must be positive
+    /// \throw bundy::InvalidParameter the interval is not positive
+    void setStatisticsSegmentInterval(long interval);
+
+    /// \brief Set the capture of the queries and the responses
+    ///
+    /// The requests are captured with their responses as
+    /// \c bundy::server_common::QueryCapture::AUTH_RESPONSE records, with
+    /// the zone answering the query if any.
+    ///
+    /// \param capture the capture, the server takes its ownership; if NULL,
+    ///        the requests are not captured
+    void setQueryCapture(bundy::server_common::QueryCapture* capture);
+
+    /// \brief Return the capture of the queries, NULL if there's none
+    const bundy::server_common::QueryCapture* getQueryCapture() const;
+
     /// \brief Notify the authoritative server that the client lists were
     ///     reconfigured.
     ///
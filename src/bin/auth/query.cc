@@ -391,6 +391,7 @@ Query::process(datasrc::ClientList& client_list,
     }
 
     ZoneFinder& zfinder = *result.finder_;
+    zone_ = zfinder.getOrigin();
 
     // We have authority for a zone that contain the query name (possibly
     // indirectly via delegation).  Look into the zone.
@@ -554,6 +555,7 @@ Query::initialize(datasrc::ClientList& client_list,
     dnssec_ = dnssec;
     dnssec_opt_ = (dnssec ? bundy::datasrc::ZoneFinder::FIND_DNSSEC :
                    bundy::datasrc::ZoneFinder::FIND_DEFAULT);
+    zone_ = boost::none;
 }
 
 void
@@ -585,6 +587,7 @@ Query::processDSAtChild() {
     // The important point in this case is to return SOA so that the resolver
     // that happens to contact us can hunt for the appropriate parent zone
     // by seeing the SOA.
+    zone_ = zresult.finder_->getOrigin();
     response_->setHeaderFlag(Message::HEADERFLAG_AA);
     response_->setRcode(Rcode::NOERROR());
     addSOA(*zresult.finder_);
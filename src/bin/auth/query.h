@@ -19,6 +19,7 @@
 #include <datasrc/zone.h>
 
 #include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
 
 #include <functional>
 #include <vector>
@@ -330,6 +331,16 @@ public:
                  const bundy::dns::Name& qname, const bundy::dns::RRType& qtype,
                  bundy::dns::Message& response, bool dnssec = false);
 
+    /// \brief Return the origin of the zone the last query was answered
+    /// from.
+    ///
+    /// \return origin of the zone wrapped with boost::optional; it's
+    ///         converted to false if no authoritative zone has been found
+    ///         for the query.
+    const boost::optional<bundy::dns::Name>& getZone() const {
+        return (zone_);
+    }
+
     /// \short Bad zone data encountered.
     ///
     /// This is thrown when a process encounters a misconfigured zone in a
@@ -491,6 +502,8 @@ private:
     std::vector<bundy::dns::ConstRRsetPtr> answers_;
     std::vector<bundy::dns::ConstRRsetPtr> authorities_;
     std::vector<bundy::dns::ConstRRsetPtr> additionals_;
+    // Kept after process() returns, for statistics.
+    boost::optional<bundy::dns::Name> zone_;
 
 private:
     /// \brief Returns a reference to a pre-initialized vector (see the
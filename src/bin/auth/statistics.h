@@ -18,14 +18,27 @@
 #include <cc/data.h>
 
 #include <dns/message.h>
+#include <dns/name.h>
 #include <dns/opcode.h>
+#include <dns/rrtype.h>
 
 #include <statistics/counter.h>
+#include <statistics/shared_counters.h>
 
+#include <util/threads/sync.h>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/optional.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <bitset>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
 
 #include <stdint.h>
 
@@ -39,6 +52,26 @@ namespace bundy {
 namespace auth {
 namespace statistics {
 
+/// \brief Stages of processing a request whose latency is measured.
+///
+/// The names of the stages in the statistics are "parse_header",
+/// "from_wire", "tsig_verify", "process", "to_wire" and "total".
+enum LatencyStage {
+    LATENCY_PARSE_HEADER,           ///< Parsing the header of the request
+    LATENCY_FROM_WIRE,              ///< Parsing the rest of the request
+    LATENCY_TSIG_VERIFY,            ///< Verifying the TSIG of the request
+    LATENCY_PROCESS,                ///< Looking up the answer
+    LATENCY_TO_WIRE,                ///< Rendering the response
+    LATENCY_TOTAL,                  ///< Processing the request as a whole
+    LATENCY_STAGES                  ///< The number of the stages
+};
+
+/// \brief Return the current time of the monotonic clock.
+///
+/// \return time in nanoseconds from an unspecified point in the past
+/// \throw None
+uint64_t getMonotonicTime();
+
 /// \brief DNS Message attributes for statistics.
 ///
 /// This class holds some attributes related to a DNS message
@@ -63,6 +96,12 @@ private:
     int req_address_family_;        // IP version
     int req_transport_protocol_;    // Transport layer protocol
     boost::optional<bundy::dns::Opcode> req_opcode_;  // OpCode
+    boost::optional<bundy::dns::RRType> req_qtype_;   // Query type
+    size_t zone_index_;             // Index of the zone counters
+    bool measure_latency_;          // Whether the latency is measured
+    uint64_t start_time_;           // When the processing started
+    uint64_t latencies_[LATENCY_STAGES];  // Latency of each stage
+    std::bitset<LATENCY_STAGES> latency_set_;  // Stages measured
     enum BitAttributes {
         REQ_WITH_EDNS_0,            // request with EDNS ver.0
         REQ_WITH_DNSSEC_OK,         // DNSSEC OK (DO) bit is set in request
@@ -79,7 +118,9 @@ public:
     /// \brief The constructor.
     ///
     /// \throw None
-    MessageAttributes() : req_address_family_(0), req_transport_protocol_(0)
+    MessageAttributes() : req_address_family_(0), req_transport_protocol_(0),
+                          zone_index_(0), measure_latency_(false),
+                          start_time_(0)
     {}
 
     /// \brief Return opcode of the request.
@@ -99,6 +140,98 @@ public:
         req_opcode_ = opcode;
     }
 
+    /// \brief Return the query type of the request.
+    ///
+    /// \return query type of the request wrapped with boost::optional; it's
+    ///         converted to false if the query type hasn't been set.
+    /// \throw None
+    const boost::optional<bundy::dns::RRType>& getRequestQType() const {
+        return (req_qtype_);
+    }
+
+    /// \brief Set the query type of the request.
+    ///
+    /// \param qtype RR type of the question of the request
+    /// \throw None
+    void setRequestQType(const bundy::dns::RRType& qtype) {
+        req_qtype_ = qtype;
+    }
+
+    /// \brief Return the index of the counters of the zone the request was
+    /// answered from.
+    ///
+    /// \return index returned by \c Counters::getZoneIndex(), or 0 if the
+    ///         request has not been answered from a zone.
+    /// \throw None
+    size_t getZoneIndex() const {
+        return (zone_index_);
+    }
+
+    /// \brief Set the index of the counters of the zone the request was
+    /// answered from.
+    ///
+    /// \param zone_index index returned by \c Counters::getZoneIndex()
+    /// \throw None
+    void setZoneIndex(const size_t zone_index) {
+        zone_index_ = zone_index;
+    }
+
+    /// \brief Start measuring the latency of processing the request.
+    ///
+    /// Unless this is called, \c LatencyTimer measures nothing.
+    ///
+    /// \param start_time time the processing started, as returned by
+    ///                   \c getMonotonicTime()
+    /// \throw None
+    void startLatency(const uint64_t start_time) {
+        measure_latency_ = true;
+        start_time_ = start_time;
+    }
+
+    /// \brief Return whether the latency is measured.
+    ///
+    /// \return true if \c startLatency() has been called
+    /// \throw None
+    bool measuresLatency() const {
+        return (measure_latency_);
+    }
+
+    /// \brief Return the time the processing started.
+    ///
+    /// \return time passed to \c startLatency()
+    /// \throw None
+    uint64_t getStartTime() const {
+        return (start_time_);
+    }
+
+    /// \brief Return whether the latency of the stage has been measured.
+    ///
+    /// \param stage stage of processing the request
+    /// \return true if \c setLatency() has been called for the stage
+    /// \throw None
+    bool hasLatency(const LatencyStage stage) const {
+        return (latency_set_[stage]);
+    }
+
+    /// \brief Return the latency of the stage.
+    ///
+    /// \param stage stage of processing the request
+    /// \return latency in nanoseconds, valid if \c hasLatency() is true
+    /// \throw None
+    uint64_t getLatency(const LatencyStage stage) const {
+        return (latencies_[stage]);
+    }
+
+    /// \brief Set the latency of the stage.
+    ///
+    /// \param stage stage of processing the request
+    /// \param latency latency in nanoseconds
+    /// \throw None
+    void setLatency(const LatencyStage stage, const uint64_t latency) {
+        latencies_[stage] = latency;
+        latency_set_[stage] = true;
+    }
+
     /// \brief Get IP version carrying a request.
     ///
     /// \return IP address family carrying a request (AF_INET or AF_INET6)
@@ -253,6 +386,38 @@ public:
     }
 };
 
+/// \brief Measure the latency of a stage of processing a request.
+///
+/// The latency is measured from the construction to the destruction of
+/// the object and set in the \c MessageAttributes, if the latency of the
+/// request is measured at all. Otherwise it costs a single check.
+class LatencyTimer : boost::noncopyable {
+public:
+    /// \brief The constructor.
+    ///
+    /// \param msgattrs attributes of the request being processed
+    /// \param stage stage of processing the request
+    /// \throw None
+    LatencyTimer(MessageAttributes& msgattrs, const LatencyStage stage) :
+        msgattrs_(msgattrs), stage_(stage),
+        start_(msgattrs.measuresLatency() ? getMonotonicTime() : 0)
+    {}
+
+    /// \brief The destructor.
+    ///
+    /// Sets the latency of the stage in the \c MessageAttributes.
+    ~LatencyTimer() {
+        if (msgattrs_.measuresLatency()) {
+            msgattrs_.setLatency(stage_, getMonotonicTime() - start_);
+        }
+    }
+
+private:
+    MessageAttributes& msgattrs_;
+    const LatencyStage stage_;
+    const uint64_t start_;
+};
+
 /// \brief Set of DNS message counters.
 ///
 /// \c Counters is a set of DNS message counters class. It holds DNS message
@@ -267,17 +432,88 @@ public:
 /// not counters (such as concurrent TCP connections), or seperate generic
 /// part to src/lib to share with the other modules.
 ///
+/// Besides the server-wide counters, the same set of counters is kept for
+/// each zone the requests are answered from. The zone is identified by
+/// the index returned by \c getZoneIndex(), which is passed to \c inc()
+/// in the \c MessageAttributes.
+///
+/// Each thread calling \c inc() increments its own copy of the counters,
+/// held in memory aligned to the cache lines, so the threads neither take
+/// a lock nor share a cache line to count a message. The copies are summed
+/// up by \c get().
+///
+/// If enabled by \c setLatencyEnabled(), histograms of the latencies of
+/// the stages of processing the requests (see \c LatencyStage) are kept
+/// too, in the same per-thread manner. The latencies are counted in
+/// logarithmic buckets, each power of two split into 8 linear ones, so
+/// the error of a bucket is within 12.5%.
+///
 /// This class is constructed on startup of the server, so
 /// construction overhead of this approach should be acceptable.
-///
-/// \todo Consider overhead of \c Counters::inc()
 class Counters : boost::noncopyable {
+public:
+    /// \brief Maximum number of zones which have their own counters.
+    ///
+    /// The messages answered from the zones beyond this number are only
+    /// counted in the server-wide counters.
+    static const size_t MAX_ZONES = 16383;
+
 private:
-    // counter for DNS message attributes
-    bundy::statistics::Counter server_msg_counter_;
-    void incRequest(const MessageAttributes& msgattrs);
+    /// \brief Counters of a single thread.
+    class ThreadCounters;
+
+    /// \brief Zone index of a zone name.
+    struct ZoneIndex {
+        ZoneIndex(const bundy::dns::Name& name, const size_t index) :
+            name_(name), index_(index)
+        {}
+        bundy::dns::Name name_;
+        size_t index_;
+    };
+
+    /// \brief Hash function of the zone names.
+    ///
+    /// It is case insensitive, as the comparison of the names is.
+    struct NameHash {
+        size_t operator()(const bundy::dns::Name& name) const;
+    };
+
+    /// \brief Zone indexes hashed by the zone name.
+    typedef boost::multi_index_container<
+        ZoneIndex,
+        boost::multi_index::indexed_by<
+            boost::multi_index::hashed_unique<
+                boost::multi_index::member<ZoneIndex, bundy::dns::Name,
+                                           &ZoneIndex::name_>,
+                NameHash
+            >
+        >
+    > ZoneIndexMap;
+
+    /// \brief Returns the counters of the calling thread.
+    ///
+    /// They are created on the first call from the thread.
+    ThreadCounters& getThreadCounters();
+
+    void incRequest(const MessageAttributes& msgattrs,
+                    bundy::statistics::Counter::Value* counters);
     void incResponse(const MessageAttributes& msgattrs,
-                     const bundy::dns::Message& response);
+                     const bundy::dns::Message& response,
+                     bundy::statistics::Counter::Value* counters);
+
+    // key of the counters of the calling thread
+    pthread_key_t thread_key_;
+    // protects thread_counters_, zone_names_ and zone_indexes_
+    mutable bundy::util::thread::Mutex mutex_;
+    // counters of all threads which have called inc()
+    std::vector<ThreadCounters*> thread_counters_;
+    // zone names by zone index; the index 0 stands for the server
+    std::vector<bundy::dns::Name> zone_names_;
+    // zone indexes by zone name
+    ZoneIndexMap zone_indexes_;
+    // whether the latency of the requests is measured
+    bool latency_enabled_;
+
 public:
     /// \brief A type of statistics item tree in bundy::data::MapElement.
     /// \verbatim
@@ -299,8 +535,49 @@ public:
     /// a standard exception if memory allocation fails inside the method.
     Counters();
 
+    /// \brief The destructor.
+    ~Counters();
+
+    /// \brief Return the index of the counters of the zone.
+    ///
+    /// The zone is given its index when it's first asked for. The result
+    /// is cached in the calling thread, so asking for the known zone takes
+    /// no lock.
+    ///
+    /// \param zone_name origin of the zone
+    /// \return index to be set in the \c MessageAttributes, or 0 if there
+    ///         are too many zones to have their own counters.
+    /// \throw std::bad_alloc Internal resource allocation fails
+    size_t getZoneIndex(const bundy::dns::Name& zone_name);
+
+    /// \brief Enable or disable measuring the latency of the requests.
+    ///
+    /// \param enabled true to measure the latency
+    /// \throw None
+    void setLatencyEnabled(const bool enabled) {
+        latency_enabled_ = enabled;
+    }
+
+    /// \brief Return whether the latency of the requests is measured.
+    ///
+    /// The caller is expected to call \c MessageAttributes::startLatency()
+    /// for each request if it is.
+    ///
+    /// \return true if the latency is measured
+    /// \throw None
+    bool isLatencyEnabled() const {
+        return (latency_enabled_);
+    }
+
     /// \brief Increment counters according to the parameters.
     ///
+    /// The server-wide counters are incremented, and the counters of the
+    /// zone too if \c msgattrs has the zone index set.
+    ///
+    /// If the latency of the request is measured, the latencies of the
+    /// stages are counted in the histograms. The total latency is taken
+    /// as the time from \c MessageAttributes::startLatency() until now.
+    ///
     /// \param msgattrs DNS message attributes.
     /// \param response DNS response message.
     /// \param done DNS response was sent to the client.
@@ -310,12 +587,93 @@ public:
 
     /// \brief Get statistics counters.
     ///
+    /// The counters of all threads are summed up. The counters of each zone
+    /// are stored under the zone name, the server-wide ones under
+    /// '_SERVER_'.
+    ///
+    /// The latency histograms are stored under 'latency', by the name of
+    /// the stage. Each has the number of the measured requests ('count'),
+    /// the sum of their latencies ('sum'), the 50th, 90th and 99th
+    /// percentiles ('p50', 'p90', 'p99'; the upper bounds of the buckets
+    /// they fall in) and the non-empty buckets ('histogram', by the lower
+    /// bound of the bucket). All latencies are in nanoseconds.
+    ///
     /// This method is mostly exception free. But it may still throw a
     /// standard exception if memory allocation fails inside the method.
     ///
     /// \return statistics data
     /// \throw std::bad_alloc Internal resource allocation fails
     ConstItemTreePtr get() const;
+
+    /// \brief Get the values of all statistics counters.
+    ///
+    /// The counters of all threads are summed up like by \c get(), but
+    /// stored flat in \c values, in the order of the names returned by
+    /// \c getItemNames(): the counters of the server, then of each zone,
+    /// indexed by the counter type, then for each latency stage its
+    /// count, sum and all buckets of the histogram.
+    ///
+    /// \param values vector to store the values in; it's resized as needed
+    /// \return number of the zones whose counters are stored
+    /// \throw std::bad_alloc Internal resource allocation fails
+    size_t getValues(std::vector<bundy::statistics::Counter::Value>& values)
+        const;
+
+    /// \brief Get the names of the values returned by \c getValues().
+    ///
+    /// The names are the paths of the statistics items as returned by
+    /// \c get(), separated by '/', e.g. 'zones/_SERVER_/request/v4' or
+    /// 'latency/total/histogram/1024'.
+    ///
+    /// \param zone_count number of the zones, as returned by \c getValues()
+    /// \param names vector to store the names in
+    /// \throw std::bad_alloc Internal resource allocation fails
+    void getItemNames(const size_t zone_count,
+                      std::vector<std::string>& names) const;
+};
+
+/// \brief Export of the statistics counters in shared memory.
+///
+/// This class publishes the values of the \c Counters in a
+/// \c bundy::statistics::SharedCounters segment, so the other processes
+/// can read them at any time without asking the server. The values are
+/// written on each call to \c update(), which is expected to be called
+/// periodically from the event loop of the server.
+///
+/// When the first message is counted for a new zone, the layout of the
+/// values changes and the segment is replaced by a new one, marking the
+/// old one stale.
+class CountersExporter : boost::noncopyable {
+public:
+    /// \brief Constructor.
+    ///
+    /// The segment is created with the current values.
+    ///
+    /// \param counters the counters to export
+    /// \param file_name name of the file of the segment
+    /// \throw bundy::statistics::SharedCountersError the segment can't be
+    ///        created
+    CountersExporter(const Counters& counters, const std::string& file_name);
+
+    /// \brief Write the current values of the counters in the segment.
+    ///
+    /// \throw bundy::statistics::SharedCountersError the segment can't be
+    ///        replaced
+    void update();
+
+    /// \brief Return the name of the file of the segment.
+    const std::string& getFileName() const {
+        return (file_name_);
+    }
+
+private:
+    const Counters& counters_;
+    const std::string file_name_;
+    // number of the zones in the layout of the segment
+    size_t zone_count_;
+    boost::scoped_ptr<bundy::statistics::SharedCounters> segment_;
+    // buffer of the values, kept to avoid allocating it for each update
+    std::vector<bundy::statistics::Counter::Value> values_;
 };
 
 } // namespace statistics
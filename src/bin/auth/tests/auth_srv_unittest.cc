@@ -30,6 +30,7 @@
 
 #include <server_common/portconfig.h>
 #include <server_common/keyring.h>
+#include <server_common/query_capture.h>
 
 #include <datasrc/client_list.h>
 #include <auth/auth_srv.h>
@@ -60,11 +61,15 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/foreach.hpp>
 
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <vector>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace bundy::cc;
@@ -324,6 +329,7 @@ TEST_F(AuthSrvTest, noClientList) {
     expect["request.v4"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.txt"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["authqryrej"] = 1;
@@ -441,6 +447,7 @@ TEST_F(AuthSrvTest, AXFRSuccess) {
     expect["request.v4"] = 1;
     expect["request.tcp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.axfr"] = 1;
     checkStatisticsCounters(stats_after, expect);
 }
 
@@ -1043,6 +1050,7 @@ TEST_F(AuthSrvTest, TSIGSigned) {
     expect["request.tsig"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.txt"] = 1;
     expect["responses"] = 1;
     expect["response.tsig"] = 1;
     expect["qrysuccess"] = 1;
@@ -1163,6 +1171,7 @@ TEST_F(AuthSrvTest, datasourceFail) {
     expect["request.v4"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.aaaa"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["rcode.servfail"] = 1;
@@ -1239,6 +1248,7 @@ TEST_F(AuthSrvTest, emptyZone) {
     expect["request.v4"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.a"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["rcode.servfail"] = 1;
@@ -1316,6 +1326,7 @@ TEST_F(AuthSrvTest, queryCounterTruncTest) {
     expect["request.v4"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.txt"] = 1;
     expect["responses"] = 1;
     expect["response.truncated"] = 1;
     expect["qrysuccess"] = 1;
@@ -1339,6 +1350,7 @@ TEST_F(AuthSrvTest, queryCounterUDPNormal) {
     expect["request.v4"] = 1;
     expect["request.udp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.ns"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["authqryrej"] = 1;
@@ -1364,6 +1376,7 @@ TEST_F(AuthSrvTest, queryCounterUDPNormalWithDNSSEC) {
     expect["request.udp"] = 1;
     expect["request.dnssec_ok"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.ns"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["authqryrej"] = 1;
@@ -1390,6 +1403,7 @@ TEST_F(AuthSrvTest, queryCounterTCPNormal) {
     expect["request.v4"] = 1;
     expect["request.tcp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.ns"] = 1;
     expect["responses"] = 1;
     expect["qrynoauthans"] = 1;
     expect["authqryrej"] = 1;
@@ -1414,6 +1428,7 @@ TEST_F(AuthSrvTest, queryCounterTCPAXFR) {
     expect["request.v4"] = 1;
     expect["request.tcp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.axfr"] = 1;
     checkStatisticsCounters(stats_after, expect);
 }
 
@@ -1434,9 +1449,82 @@ TEST_F(AuthSrvTest, queryCounterTCPIXFR) {
     expect["request.v4"] = 1;
     expect["request.tcp"] = 1;
     expect["opcode.query"] = 1;
+    expect["qtype.ixfr"] = 1;
     checkStatisticsCounters(stats_after, expect);
 }
 
+// Check the latency of the stages is measured only if enabled
+TEST_F(AuthSrvTest, queryLatency) {
+    updateBuiltin(server);
+    UnitTestUtil::createRequestMessage(request_message, Opcode::QUERY(),
+                                       default_qid, Name("version.bind"),
+                                       RRClass::CH(), RRType::TXT());
+    createRequestPacket(request_message, IPPROTO_UDP);
+
+    // Not measured by default.
+    server.processMessage(*io_message, *parse_message, *response_obuffer,
+                          &dnsserv);
+    EXPECT_TRUE(dnsserv.hasAnswer());
+    EXPECT_EQ(0, server.getStatistics()->get("latency")->get("total")->
+              get("count")->intValue());
+
+    server.setLatencyStatistics(true);
+    parse_message->clear(Message::PARSE);
+    server.processMessage(*io_message, *parse_message, *response_obuffer,
+                          &dnsserv);
+    EXPECT_TRUE(dnsserv.hasAnswer());
+
+    ConstElementPtr latency = server.getStatistics()->get("latency");
+    EXPECT_EQ(1, latency->get("parse_header")->get("count")->intValue());
+    EXPECT_EQ(1, latency->get("from_wire")->get("count")->intValue());
+    EXPECT_EQ(0, latency->get("tsig_verify")->get("count")->intValue());
+    EXPECT_EQ(1, latency->get("process")->get("count")->intValue());
+    EXPECT_EQ(1, latency->get("to_wire")->get("count")->intValue());
+    EXPECT_EQ(1, latency->get("total")->get("count")->intValue());
+    EXPECT_GE(latency->get("total")->get("sum")->intValue(),
+              latency->get("process")->get("sum")->intValue());
+}
+
+// Check the requests are captured with their responses when configured
+TEST_F(AuthSrvTest, queryCapture) {
+    const char* const capture_file = "auth_srv_test.cap";
+    updateBuiltin(server);
+    UnitTestUtil::createRequestMessage(request_message, Opcode::QUERY(),
+                                       default_qid, Name("version.bind"),
+                                       RRClass::CH(), RRType::TXT());
+    createRequestPacket(request_message, IPPROTO_UDP);
+
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+    server.setQueryCapture(new bundy::server_common::QueryCapture(
+                               new bundy::server_common::FileCaptureSink(
+                                   capture_file)));
+    EXPECT_TRUE(server.getQueryCapture() != NULL);
+    server.processMessage(*io_message, *parse_message, *response_obuffer,
+                          &dnsserv);
+    EXPECT_TRUE(dnsserv.hasAnswer());
+    // Stopping the capture writes the records.
+    server.setQueryCapture(NULL);
+
+    std::ifstream file(capture_file, std::ios::binary);
+    const std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)),
+                                      std::istreambuf_iterator<char>());
+    unlink(capture_file);
+
+    // Skip the START frame, which holds the content type.
+    const size_t start_length =
+        20 + std::strlen(bundy::server_common::QueryCapture::CONTENT_TYPE);
+    ASSERT_LT(start_length + 4 +
+              bundy::server_common::QueryCapture::HEADER_SIZE, stream.size());
+    const uint8_t* record = &stream[start_length + 4];
+    EXPECT_EQ(bundy::server_common::QueryCapture::AUTH_RESPONSE, record[1]);
+    EXPECT_EQ(IPPROTO_UDP, record[3]);
+    // The lengths of the query and the response.
+    EXPECT_EQ(io_message->getDataSize(),
+              static_cast<size_t>((record[24] << 8) | record[25]));
+    EXPECT_EQ(response_obuffer->getLength(),
+              static_cast<size_t>((record[26] << 8) | record[27]));
+}
+
 TEST_F(AuthSrvTest, queryCounterOpcodes) {
     int other_expected = 0;
     for (int i = 0; i < bundy::auth::statistics::num_opcode_to_msgcounter; ++i) {
@@ -38,6 +38,8 @@
 
 #include <sstream>
 
+#include <unistd.h>
+
 using namespace std;
 using namespace bundy::dns;
 using namespace bundy::data;
@@ -155,4 +157,70 @@ TEST_F(AuthConfigTest, tcpRecvTimeoutConfig) {
                  AuthConfigError);
 }
 
+// Try enabling the latency statistics through config
+TEST_F(AuthConfigTest, latencyStatisticsConfig) {
+    EXPECT_FALSE(server.getLatencyStatistics());
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"latency_statistics\": true }"));
+    EXPECT_TRUE(server.getLatencyStatistics());
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"latency_statistics\": false }"));
+    EXPECT_FALSE(server.getLatencyStatistics());
+}
+
+// Try exporting the statistics in shared memory through config
+TEST_F(AuthConfigTest, statisticsSegmentConfig) {
+    const char* const segment_file = "auth_config_test.seg";
+    EXPECT_EQ("", server.getStatisticsSegment());
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"statistics_segment\": \"auth_config_test.seg\","
+    "  \"statistics_segment_interval\": 100 }"));
+    EXPECT_EQ(segment_file, server.getStatisticsSegment());
+    EXPECT_EQ(0, access(segment_file, F_OK));
+
+    // The segment is removed when the export is disabled.
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"statistics_segment\": \"\" }"));
+    EXPECT_EQ("", server.getStatisticsSegment());
+    EXPECT_NE(0, access(segment_file, F_OK));
+
+    EXPECT_THROW(configureAuthServer(server, Element::fromJSON(
+                    "{ \"statistics_segment\": "
+                    "  \"/no/such/directory/auth.seg\" }")),
+                 AuthConfigError);
+    EXPECT_EQ("", server.getStatisticsSegment());
+    EXPECT_THROW(configureAuthServer(server, Element::fromJSON(
+                    "{ \"statistics_segment_interval\": 0 }")),
+                 AuthConfigError);
+}
+
+// Try capturing the queries through config
+TEST_F(AuthConfigTest, queryCaptureConfig) {
+    const char* const capture_file = "auth_config_test.cap";
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"query_capture\": { \"output\": \"auth_config_test.cap\","
+    "                      \"sample_rate\": 10 } }"));
+    ASSERT_TRUE(server.getQueryCapture() != NULL);
+    EXPECT_EQ(capture_file, server.getQueryCapture()->getSink().getName());
+    EXPECT_EQ(0, access(capture_file, F_OK));
+
+    configureAuthServer(server, Element::fromJSON(
+    "{ \"query_capture\": { \"output\": \"\" } }"));
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+    unlink(capture_file);
+
+    EXPECT_THROW(configureAuthServer(server, Element::fromJSON(
+                    "{ \"query_capture\": "
+                    "  { \"output\": \"/no/such/directory/auth.cap\" } }")),
+                 AuthConfigError);
+    EXPECT_THROW(configureAuthServer(server, Element::fromJSON(
+                    "{ \"query_capture\": "
+                    "  { \"output\": \"auth_config_test.cap\","
+                    "    \"drop_policy\": \"sometimes\" } }")),
+                 AuthConfigError);
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+    unlink(capture_file);
+}
+
 }
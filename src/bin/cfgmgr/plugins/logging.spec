@@ -34,6 +34,11 @@
                      "item_optional": false,
                      "item_default": false
                   },
+                  {  "item_name": "async",
+                     "item_type": "boolean",
+                     "item_optional": false,
+                     "item_default": false
+                  },
                   { "item_name": "output_options",
                     "item_type": "list",
                     "item_optional": false,
@@ -64,6 +64,7 @@ D2CfgMgr::D2CfgMgr() : DCfgMgrBase(DCfgContextBasePtr(new D2CfgContext())) {
     addToParseOrder("interface");
     addToParseOrder("ip_address");
     addToParseOrder("port");
+    addToParseOrder("ncr_format");
     addToParseOrder("tsig_keys");
     addToParseOrder("forward_ddns");
     addToParseOrder("reverse_ddns");
@@ -199,6 +200,8 @@ D2CfgMgr::createConfigParser(const std::string& config_id) {
         (config_id == "ip_address")) {
         parser = new bundy::dhcp::StringParser(config_id,
                                              context->getStringStorage());
+    } else if (config_id == "ncr_format") {
+        parser = new NcrFormatParser(config_id, context->getStringStorage());
     } else if (config_id == "port") {
         parser = new bundy::dhcp::Uint32Parser(config_id,
                                              context->getUint32Storage());
@@ -235,8 +235,9 @@ protected:
     ///     1. interface
     ///     2. ip_address
     ///     3. port
-    ///     4. forward_ddns
-    ///     5. reverse_ddns
+    ///     4. ncr_format
+    ///     5. forward_ddns
+    ///     6. reverse_ddns
     ///
     /// @param element_id is the string name of the element as it will appear
     /// in the configuration set.
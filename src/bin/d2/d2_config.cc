@@ -15,6 +15,7 @@
 #include <d2/d2_log.h>
 #include <d2/d2_cfg_mgr.h>
 #include <dhcpsrv/dhcp_parsers.h>
+#include <dhcp_ddns/ncr_msg.h>
 #include <exceptions/exceptions.h>
 #include <asiolink/io_error.h>
 
@@ -173,6 +174,24 @@ DdnsDomainListMgr::matchDomain(const std::string& fqdn, DdnsDomainPtr& domain) {
 
 // *************************** PARSERS ***********************************
 
+// *********************** NcrFormatParser  *************************
+
+NcrFormatParser::NcrFormatParser(const std::string& param_name,
+                                 bundy::dhcp::StringStoragePtr storage)
+    : bundy::dhcp::StringParser(param_name, storage) {
+}
+
+void
+NcrFormatParser::build(bundy::data::ConstElementPtr value) {
+    bundy::dhcp::StringParser::build(value);
+    try {
+        dhcp_ddns::stringToNcrFormat(value->stringValue());
+    } catch (const bundy::BadValue&) {
+        bundy_throw(D2CfgError, "Invalid ncr_format: "
+                  << value->stringValue());
+    }
+}
+
 // *********************** TSIGKeyInfoParser  *************************
 
 TSIGKeyInfoParser::TSIGKeyInfoParser(const std::string& entry_name,
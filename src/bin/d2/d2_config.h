@@ -87,6 +87,7 @@ namespace d2 {
 ///  "interface" : "eth1" ,
 ///  "ip_address" : "192.168.1.33" ,
 ///  "port" : 88 ,
+///  "ncr_format" : "JSON" ,
 ///  "tsig_keys":
 //// [
 ///    {
@@ -520,6 +521,29 @@ private:
 /// @brief Defines a pointer for DScalarContext instances.
 typedef boost::shared_ptr<DScalarContext> DScalarContextPtr;
 
+/// @brief Parser for the "ncr_format" element
+///
+/// This is a string parser which rejects the values that are not a valid
+/// NameChangeRequest format, so as an invalid format is reported as a
+/// configuration error rather than when the listener is created.
+class NcrFormatParser : public bundy::dhcp::StringParser {
+public:
+    /// @brief Constructor
+    ///
+    /// @param param_name name of the parsed parameter
+    /// @param storage is a pointer to the storage to which the parser
+    /// should commit the value.
+    NcrFormatParser(const std::string& param_name,
+                    bundy::dhcp::StringStoragePtr storage);
+
+    /// @brief Parses and validates the format.
+    ///
+    /// @param value is the "ncr_format" configuration to parse
+    ///
+    /// @throw D2CfgError if the value is not a valid format.
+    virtual void build(bundy::data::ConstElementPtr value);
+};
+
 /// @brief Parser for  TSIGKeyInfo
 ///
 /// This class parses the configuration element "tsig_key" defined in
@@ -325,9 +325,10 @@ D2Process::reconfigureQueueMgr() {
         queue_mgr_->removeListener();
 
         // Get the configuration parameters that affect Queue Manager.
-        // @todo Need to add parameters for listener TYPE, FORMAT, address reuse
+        // @todo Need to add parameters for listener TYPE, address reuse
         std::string ip_address;
         uint32_t port;
+        std::string ncr_format;
         getCfgMgr()->getContext()->getParam("ip_address", ip_address);
 
         // Warn the user if the server address is not the loopback.
@@ -337,10 +338,13 @@ D2Process::reconfigureQueueMgr() {
         }
 
         getCfgMgr()->getContext()->getParam("port", port);
+        getCfgMgr()->getContext()->getParam("ncr_format", ncr_format);
         bundy::asiolink::IOAddress addr(ip_address);
 
         // Instantiate the listener.
-        queue_mgr_->initUDPListener(addr, port, dhcp_ddns::FMT_JSON, true);
+        queue_mgr_->initUDPListener(addr, port,
+                                    dhcp_ddns::stringToNcrFormat(ncr_format),
+                                    true);
 
         // Now start it. This assumes that starting is a synchronous,
         // blocking call that executes quickly.  @todo Should that change then
@@ -14,8 +14,11 @@
 
 #include <d2/d2_update_mgr.h>
 #include <d2/nc_add.h>
+#include <d2/nc_add_batch.h>
 #include <d2/nc_remove.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <sstream>
 #include <iostream>
 #include <vector>
@@ -23,11 +26,40 @@
 namespace bundy {
 namespace d2 {
 
+namespace {
+
+/// @brief Checks if a name may be matched to the given domain.
+///
+/// @param name the FQDN or reverse address to check
+/// @param domain the domain to check against
+///
+/// @return True if the domain is the wild card domain or if the name is,
+/// or ends with a label boundary followed by, the domain's name.
+bool
+withinDomain(const std::string& name, const DdnsDomainPtr& domain) {
+    const std::string domain_name = domain->getName();
+    if (domain_name == DdnsDomainListMgr::wildcard_domain_name_) {
+        return (true);
+    }
+
+    if (name.size() < domain_name.size()) {
+        return (false);
+    }
+
+    size_t offset = name.size() - domain_name.size();
+    return (((offset == 0) || (name[offset - 1] == '.')) &&
+            boost::iequals(name.substr(offset), domain_name));
+}
+
+}
+
 const size_t D2UpdateMgr::MAX_TRANSACTIONS_DEFAULT;
+const size_t D2UpdateMgr::MAX_BATCH_SIZE_DEFAULT;
 
 D2UpdateMgr::D2UpdateMgr(D2QueueMgrPtr& queue_mgr, D2CfgMgrPtr& cfg_mgr,
                          IOServicePtr& io_service,
-                         const size_t max_transactions)
+                         const size_t max_transactions,
+                         const size_t max_batch_size)
     :queue_mgr_(queue_mgr), cfg_mgr_(cfg_mgr), io_service_(io_service) {
     if (!queue_mgr_) {
         bundy_throw(D2UpdateMgrError, "D2UpdateMgr queue manager cannot be null");
@@ -42,8 +74,9 @@ D2UpdateMgr::D2UpdateMgr(D2QueueMgrPtr& queue_mgr, D2CfgMgrPtr& cfg_mgr,
         bundy_throw(D2UpdateMgrError, "IOServicePtr cannot be null");
     }
 
-    // Use setter to do validation.
+    // Use setters to do validation.
     setMaxTransactions(max_transactions);
+    setMaxBatchSize(max_batch_size);
 }
 
 D2UpdateMgr::~D2UpdateMgr() {
@@ -84,10 +117,22 @@ D2UpdateMgr::checkFinishedTransactions() {
     // to erase.  This replaces the old iterator which becomes invalid by the
     // erase with a the next valid iterator.  Prefix incrementing will not
     // work.
+    dhcp_ddns::NameChangeRequestList fallbacks;
     TransactionList::iterator it = transaction_list_.begin();
     while (it != transaction_list_.end()) {
         NameChangeTransactionPtr trans = (*it).second;
         if (trans->isModelDone()) {
+            // A batch is listed under the DHCID of each of its requests.
+            // Collect its requests for retrial only once, from the entry
+            // of the request leading it.
+            NameAddBatchTransactionPtr batch =
+                boost::dynamic_pointer_cast<NameAddBatchTransaction>(trans);
+            if (batch && batch->needsFallback() &&
+                (batch->getTransactionKey() == (*it).first)) {
+                fallbacks.insert(fallbacks.end(), batch->getNcrs().begin(),
+                                 batch->getNcrs().end());
+            }
+
             // @todo  Addtional actions based on NCR status could be
             // performed here.
             transaction_list_.erase(it++);
@@ -95,6 +140,13 @@ D2UpdateMgr::checkFinishedTransactions() {
             ++it;
         }
     }
+
+    // Carry out the requests of failed batches individually.  They take
+    // the places their batch held in the list, so the maximum number of
+    // transactions is honored.
+    for (size_t i = 0; i < fallbacks.size(); ++i) {
+        makeTransaction(fallbacks[i]);
+    }
 }
 
 void D2UpdateMgr::pickNextJob() {
@@ -109,7 +161,13 @@ void D2UpdateMgr::pickNextJob() {
         dhcp_ddns::NameChangeRequestPtr found_ncr = queue_mgr_->peekAt(index);
         if (!hasTransaction(found_ncr->getDhcid())) {
             queue_mgr_->dequeueAt(index);
-            makeTransaction(found_ncr);
+            if ((max_batch_size_ > 1) &&
+                (found_ncr->getChangeType() == dhcp_ddns::CHG_ADD)) {
+                makeBatchTransaction(found_ncr);
+            } else {
+                makeTransaction(found_ncr);
+            }
+
             return;
         }
     }
@@ -132,24 +190,175 @@ D2UpdateMgr::makeTransaction(dhcp_ddns::NameChangeRequestPtr& next_ncr) {
             << key.toStr());
     }
 
+    // Match the request to its servers. If that fails, the request falls on
+    // the floor.
+    DdnsDomainPtr forward_domain;
+    DdnsDomainPtr reverse_domain;
+    if (!matchDomains(next_ncr, forward_domain, reverse_domain)) {
+        return;
+    }
+
+    startSingleTransaction(next_ncr, forward_domain, reverse_domain);
+}
+
+void
+D2UpdateMgr::makeBatchTransaction(dhcp_ddns::NameChangeRequestPtr& next_ncr) {
+    // As with makeTransaction, guard against an existing transaction.
+    const TransactionKey& key = next_ncr->getDhcid();
+    if (findTransaction(key) != transactionListEnd()) {
+        // This is programmatic error.  Caller(s) should be checking this.
+        bundy_throw(D2UpdateMgrError, "Transaction already in progress for: "
+            << key.toStr());
+    }
+
+    DdnsDomainPtr forward_domain;
+    DdnsDomainPtr reverse_domain;
+    if (!matchDomains(next_ncr, forward_domain, reverse_domain)) {
+        return;
+    }
+
+    // Each request of the batch takes an entry in the transaction list, so
+    // the batch may not exceed the room left in it.
+    size_t max_size = max_batch_size_;
+    if (getTransactionCount() + max_size > max_transactions_) {
+        max_size = (getTransactionCount() < max_transactions_ ?
+                    max_transactions_ - getTransactionCount() : 1);
+    }
+
+    // Scan the queue for requests that can join the batch. Note the index
+    // only advances when a request is left in the queue.
+    dhcp_ddns::NameChangeRequestList batch;
+    batch.push_back(next_ncr);
+    size_t index = 0;
+    while ((batch.size() < max_size) && (index < getQueueCount())) {
+        dhcp_ddns::NameChangeRequestPtr ncr = queue_mgr_->peekAt(index);
+        if (!canJoinBatch(ncr, batch, forward_domain, reverse_domain)) {
+            ++index;
+            continue;
+        }
+
+        // Its domains matched, so it need only be stripped of any disabled
+        // direction, as matchDomains() would have done.
+        queue_mgr_->dequeueAt(index);
+        if (ncr->isForwardChange() && !forward_domain) {
+            ncr->setForwardChange(false);
+            LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL_DATA,
+                      DHCP_DDNS_FWD_REQUEST_IGNORED).arg(ncr->toText());
+        }
+
+        if (ncr->isReverseChange() && !reverse_domain) {
+            ncr->setReverseChange(false);
+            LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL_DATA,
+                      DHCP_DDNS_REV_REQUEST_IGNORED).arg(ncr->toText());
+        }
+
+        batch.push_back(ncr);
+    }
+
+    // Nothing to batch it with, so it gets an ordinary transaction.
+    if (batch.size() == 1) {
+        startSingleTransaction(next_ncr, forward_domain, reverse_domain);
+        return;
+    }
+
+    LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL, DHCP_DDNS_BATCH_STARTED)
+              .arg(batch.size()).arg(next_ncr->toText());
+
+    NameChangeTransactionPtr trans(new NameAddBatchTransaction(io_service_,
+                                                               batch,
+                                                               forward_domain,
+                                                               reverse_domain));
+
+    // List the batch under each of its requests' DHCIDs, so no other
+    // transaction is started for any of them until it is done.
+    for (size_t i = 0; i < batch.size(); ++i) {
+        transaction_list_[batch[i]->getDhcid()] = trans;
+    }
+
+    // Start it.
+    trans->startTransaction();
+}
+
+bool
+D2UpdateMgr::canJoinBatch(const dhcp_ddns::NameChangeRequestPtr& ncr,
+                          const dhcp_ddns::NameChangeRequestList& batch,
+                          const DdnsDomainPtr& forward_domain,
+                          const DdnsDomainPtr& reverse_domain) {
+    if ((ncr->getChangeType() != dhcp_ddns::CHG_ADD) ||
+        hasTransaction(ncr->getDhcid())) {
+        return (false);
+    }
+
+    // It must update exactly the directions the batch updates, once those
+    // which are disabled are left out.
+    bool forward = (ncr->isForwardChange() &&
+                    cfg_mgr_->forwardUpdatesEnabled());
+    bool reverse = (ncr->isReverseChange() &&
+                    cfg_mgr_->reverseUpdatesEnabled());
+    if ((forward != static_cast<bool>(forward_domain)) ||
+        (reverse != static_cast<bool>(reverse_domain))) {
+        return (false);
+    }
+
+    // The batch must not update the same names more than once, as the
+    // prerequisites would not protect the requests from one another.
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if ((batch[i]->getFqdn() == ncr->getFqdn()) ||
+            (batch[i]->getIpAddress() == ncr->getIpAddress()) ||
+            (batch[i]->getDhcid() == ncr->getDhcid())) {
+            return (false);
+        }
+    }
+
+    // Lastly, it must fall within the same zones.  Names outside of the
+    // batch's domains are ruled out first, so the configuration manager does
+    // not log them as unmatched; the longest match may still be another
+    // domain.  Domains are shared by reference, so comparing the pointers
+    // suffices.
+    try {
+        DdnsDomainPtr domain;
+        if (forward && (!withinDomain(ncr->getFqdn(), forward_domain) ||
+                        !cfg_mgr_->matchForward(ncr->getFqdn(), domain) ||
+                        (domain != forward_domain))) {
+            return (false);
+        }
+
+        if (reverse &&
+            (!withinDomain(D2CfgMgr::reverseIpAddress(ncr->getIpAddress()),
+                           reverse_domain) ||
+             !cfg_mgr_->matchReverse(ncr->getIpAddress(), domain) ||
+             (domain != reverse_domain))) {
+            return (false);
+        }
+    } catch (const std::exception&) {
+        // The request is invalid, leave it to fail on its own.
+        return (false);
+    }
+
+    return (true);
+}
+
+bool
+D2UpdateMgr::matchDomains(dhcp_ddns::NameChangeRequestPtr& ncr,
+                          DdnsDomainPtr& forward_domain,
+                          DdnsDomainPtr& reverse_domain) {
     int direction_count = 0;
     // If forward change is enabled, match to forward servers.
-    DdnsDomainPtr forward_domain;
-    if (next_ncr->isForwardChange()) {
+    if (ncr->isForwardChange()) {
         if (!cfg_mgr_->forwardUpdatesEnabled()) {
-            next_ncr->setForwardChange(false);
+            ncr->setForwardChange(false);
             LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL_DATA,
-                      DHCP_DDNS_FWD_REQUEST_IGNORED).arg(next_ncr->toText());
+                      DHCP_DDNS_FWD_REQUEST_IGNORED).arg(ncr->toText());
         } else {
-            bool matched = cfg_mgr_->matchForward(next_ncr->getFqdn(),
+            bool matched = cfg_mgr_->matchForward(ncr->getFqdn(),
                                                   forward_domain);
             // Could not find a match for forward DNS server. Log it and get
             // out. This has the net affect of dropping the request on the
             // floor.
             if (!matched) {
                 LOG_ERROR(dctl_logger, DHCP_DDNS_NO_FWD_MATCH_ERROR)
-                          .arg(next_ncr->toText());
-                return;
+                          .arg(ncr->toText());
+                return (false);
             }
 
             ++direction_count;
@@ -157,22 +366,21 @@ D2UpdateMgr::makeTransaction(dhcp_ddns::NameChangeRequestPtr& next_ncr) {
     }
 
     // If reverse change is enabled, match to reverse servers.
-    DdnsDomainPtr reverse_domain;
-    if (next_ncr->isReverseChange()) {
+    if (ncr->isReverseChange()) {
         if (!cfg_mgr_->reverseUpdatesEnabled()) {
-            next_ncr->setReverseChange(false);
+            ncr->setReverseChange(false);
             LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL_DATA,
-                      DHCP_DDNS_REV_REQUEST_IGNORED).arg(next_ncr->toText());
+                      DHCP_DDNS_REV_REQUEST_IGNORED).arg(ncr->toText());
         } else {
-            bool matched = cfg_mgr_->matchReverse(next_ncr->getIpAddress(),
+            bool matched = cfg_mgr_->matchReverse(ncr->getIpAddress(),
                                                   reverse_domain);
             // Could not find a match for reverse DNS server. Log it and get
             // out. This has the net affect of dropping the request on the
             // floor.
             if (!matched) {
                 LOG_ERROR(dctl_logger, DHCP_DDNS_NO_REV_MATCH_ERROR)
-                          .arg(next_ncr->toText());
-                return;
+                          .arg(ncr->toText());
+                return (false);
             }
 
             ++direction_count;
@@ -183,26 +391,33 @@ D2UpdateMgr::makeTransaction(dhcp_ddns::NameChangeRequestPtr& next_ncr) {
     // Should we log this?
     if (!direction_count) {
         LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL_DATA,
-                  DHCP_DDNS_REQUEST_DROPPED).arg(next_ncr->toText());
-        return;
+                  DHCP_DDNS_REQUEST_DROPPED).arg(ncr->toText());
+        return (false);
     }
 
+    return (true);
+}
+
+void
+D2UpdateMgr::startSingleTransaction(dhcp_ddns::NameChangeRequestPtr& ncr,
+                                    DdnsDomainPtr& forward_domain,
+                                    DdnsDomainPtr& reverse_domain) {
     // We matched to the required servers, so construct the transaction.
     // @todo If multi-threading is implemented, one would pass in an
     // empty IOServicePtr, rather than our instance value.  This would cause
     // the transaction to instantiate its own, separate IOService to handle
     // the transaction's IO.
     NameChangeTransactionPtr trans;
-    if (next_ncr->getChangeType() == dhcp_ddns::CHG_ADD) {
-        trans.reset(new NameAddTransaction(io_service_, next_ncr,
+    if (ncr->getChangeType() == dhcp_ddns::CHG_ADD) {
+        trans.reset(new NameAddTransaction(io_service_, ncr,
                                            forward_domain, reverse_domain));
     } else {
-        trans.reset(new NameRemoveTransaction(io_service_, next_ncr,
+        trans.reset(new NameRemoveTransaction(io_service_, ncr,
                                               forward_domain, reverse_domain));
     }
 
     // Add the new transaction to the list.
-    transaction_list_[key] = trans;
+    transaction_list_[ncr->getDhcid()] = trans;
 
     // Start it.
     trans->startTransaction();
@@ -261,6 +476,17 @@ D2UpdateMgr::setMaxTransactions(const size_t new_trans_max) {
     max_transactions_ = new_trans_max;
 }
 
+void
+D2UpdateMgr::setMaxBatchSize(const size_t new_batch_max) {
+    // A batch holds at least the request leading it.
+    if (new_batch_max < 1) {
+        bundy_throw(D2UpdateMgrError, "D2UpdateMgr"
+                  " maximum batch size must be greater than zero");
+    }
+
+    max_batch_size_ = new_batch_max;
+}
+
 size_t
 D2UpdateMgr::getQueueCount() const {
     return (queue_mgr_->getQueueSize());
@@ -65,6 +65,15 @@ typedef std::map<TransactionKey, NameChangeTransactionPtr> TransactionList;
 /// transactions complete,  D2UpdateMgr removes them from the transaction list,
 /// replacing them with new transactions.
 ///
+/// To reduce the number of packet exchanges during bursts of requests,
+/// D2UpdateMgr coalesces queued add requests whose mappings belong to the
+/// same forward and reverse zones into a single NameAddBatchTransaction,
+/// which sends one multi-RR update per zone.  Should a batch fail, its
+/// requests are each given their own transaction.  Every request in a batch
+/// still has its own entry (keyed by its DHCID) in the transaction list,
+/// so the maximum number of transactions remains a limit on the number of
+/// requests in progress.
+///
 /// D2UpdateMgr carries out each of the above steps, from with a method called
 /// sweep().  This method is intended to be called as IO events complete.
 /// The upper layer(s) are responsible for calling sweep in a timely and cyclic
@@ -77,6 +86,11 @@ public:
     /// implementation.
     static const size_t MAX_TRANSACTIONS_DEFAULT = 32;
 
+    /// @brief Maximum number of requests coalesced into one transaction
+    /// NOTE that 8 keeps a batched update comfortably within a single
+    /// Ethernet frame.
+    static const size_t MAX_BATCH_SIZE_DEFAULT = 8;
+
     // @todo This structure is not yet used. It is here in anticipation of
     // enabled statistics capture.
     struct Stats {
@@ -96,12 +110,16 @@ public:
     /// @param io_service IO service used by the upper layer(s) to manage
     /// IO events
     /// @param max_transactions the maximum number of concurrent transactions
+    /// @param max_batch_size the maximum number of requests carried out by
+    /// a single batch transaction. A value of one disables batching.
     ///
     /// @throw D2UpdateMgrError if either the queue manager or configuration
-    /// managers are NULL, or max transactions is less than one.
+    /// managers are NULL, or max transactions or max batch size is less than
+    /// one.
     D2UpdateMgr(D2QueueMgrPtr& queue_mgr, D2CfgMgrPtr& cfg_mgr,
                 IOServicePtr& io_service,
-                const size_t max_transactions = MAX_TRANSACTIONS_DEFAULT);
+                const size_t max_transactions = MAX_TRANSACTIONS_DEFAULT,
+                const size_t max_batch_size = MAX_BATCH_SIZE_DEFAULT);
 
     /// @brief Destructor
     virtual ~D2UpdateMgr();
@@ -118,16 +136,19 @@ public:
     /// in the transaction list has not reached maximum allowed, then select
     /// a request from the queue.
     ///
-    /// - If a request was selected, start a new transaction for it and
-    /// add the transaction to the list of transactions.
+    /// - If a request was selected, start a new transaction for it, or for
+    /// it and the queued requests which can be batched with it, and add the
+    /// transaction to the list of transactions.
     void sweep();
 
 protected:
     /// @brief Performs post-completion cleanup on completed transactions.
     ///
     /// Iterates through the list of transactions and removes any that have
-    /// reached completion.  This method may expand in complexity or even
-    /// disappear altogether as the implementation matures.
+    /// reached completion.  The requests of a batch transaction which ended
+    /// without fulfilling them are each given a new, single transaction.
+    /// This method may expand in complexity or even disappear altogether as
+    /// the implementation matures.
     void checkFinishedTransactions();
 
     /// @brief Starts a transaction for the next eligible request in the queue.
@@ -138,7 +159,9 @@ protected:
     /// transaction in progress.
     ///
     /// If a request is selected, it is removed from the queue and transaction
-    /// is constructed for it.
+    /// is constructed for it.  If the request is an add and batching is
+    /// enabled, makeBatchTransaction() is used so that queued requests for
+    /// the same zones may join it.
     ///
     /// It is possible that no such request exists, though this is likely to be
     /// rather rare unless a system is frequently seeing requests for the same
@@ -169,6 +192,67 @@ protected:
     /// exists. Note this would be programmatic error.
     void makeTransaction(bundy::dhcp_ddns::NameChangeRequestPtr& ncr);
 
+    /// @brief Create a new transaction for the given add request and the
+    /// queued requests which can be batched with it.
+    ///
+    /// The request is matched to DNS servers as with makeTransaction(). The
+    /// queue is then scanned for requests which can join it, see
+    /// canJoinBatch(), up to the maximum batch size and the room left in the
+    /// transaction list.  Those are removed from the queue.  If any were
+    /// found, a NameAddBatchTransaction is instantiated for all of them,
+    /// added to the transaction list under each of their DHCIDs and started.
+    /// Otherwise this behaves as makeTransaction().
+    ///
+    /// @param ncr the NameChangeRequest (CHG_ADD) which leads the batch.
+    ///
+    /// @throw D2UpdateMgrError if a transaction for this DHCID already
+    /// exists. Note this would be programmatic error.
+    void makeBatchTransaction(bundy::dhcp_ddns::NameChangeRequestPtr& ncr);
+
+    /// @brief Determines if a queued request can join a batch.
+    ///
+    /// A request can join a batch if it is a CHG_ADD, has no transaction in
+    /// progress, matches the batch's forward and reverse domains for the
+    /// directions which are enabled, and shares neither its FQDN, lease
+    /// address nor DHCID with any request already in the batch.
+    ///
+    /// @param ncr the queued request to check
+    /// @param batch the requests already in the batch
+    /// @param forward_domain the batch's forward domain (empty if none)
+    /// @param reverse_domain the batch's reverse domain (empty if none)
+    ///
+    /// @return True if the request can join the batch.
+    bool canJoinBatch(const dhcp_ddns::NameChangeRequestPtr& ncr,
+                      const dhcp_ddns::NameChangeRequestList& batch,
+                      const DdnsDomainPtr& forward_domain,
+                      const DdnsDomainPtr& reverse_domain);
+
+    /// @brief Matches a request to the forward and reverse DNS servers.
+    ///
+    /// Requests for updates in a disabled direction are modified so as to
+    /// no longer ask for them.
+    ///
+    /// @param ncr the request to match
+    /// @param forward_domain set to the matching forward domain, if any
+    /// @param reverse_domain set to the matching reverse domain, if any
+    ///
+    /// @return True if the request has at least one direction to update and
+    /// every requested direction matched a domain.  Otherwise the request is
+    /// to be dropped; the reason has been logged.
+    bool matchDomains(dhcp_ddns::NameChangeRequestPtr& ncr,
+                      DdnsDomainPtr& forward_domain,
+                      DdnsDomainPtr& reverse_domain);
+
+    /// @brief Creates a single request transaction, adds it to the list and
+    /// starts it.
+    ///
+    /// @param ncr the request for which to create the transaction
+    /// @param forward_domain the domain to use for forward DNS updates
+    /// @param reverse_domain the domain to use for reverse DNS updates
+    void startSingleTransaction(dhcp_ddns::NameChangeRequestPtr& ncr,
+                                DdnsDomainPtr& forward_domain,
+                                DdnsDomainPtr& reverse_domain);
+
 public:
     /// @brief Gets the D2UpdateMgr's IOService.
     ///
@@ -191,6 +275,19 @@ public:
     /// queue.
     void setMaxTransactions(const size_t max_transactions);
 
+    /// @brief Returns the maximum number of requests in a batch transaction.
+    size_t getMaxBatchSize() const {
+        return (max_batch_size_);
+    }
+
+    /// @brief Sets the maximum number of requests in a batch transaction.
+    ///
+    /// @param max_batch_size is the new maximum batch size. A value of one
+    /// disables batching.
+    ///
+    /// @throw Throws D2UpdateMgrError if the new value is less than one.
+    void setMaxBatchSize(const size_t max_batch_size);
+
     /// @brief Search the transaction list for the given key.
     ///
     /// @param key the transaction key value for which to search.
@@ -251,6 +348,9 @@ private:
     /// @brief Maximum number of concurrent transactions.
     size_t max_transactions_;
 
+    /// @brief Maximum number of requests in a batch transaction.
+    size_t max_batch_size_;
+
     /// @brief List of transactions.
     TransactionList transaction_list_;
 };
@@ -24,6 +24,12 @@
         "item_optional": true,
         "item_default": 53001 
     },
+    {
+        "item_name": "ncr_format",
+        "item_type": "string",
+        "item_optional": false,
+        "item_default": "JSON"
+    },
     {
         "item_name": "tsig_keys",
         "item_type": "list",
@@ -58,6 +58,9 @@ public:
 /// This class derives from NameChangeTransaction from which it inherits
 /// states, events, and methods common to NameChangeRequest processing.
 class NameAddTransaction : public NameChangeTransaction {
+// NameAddBatchTransaction uses the request builders of its (never started)
+// member transactions to assemble the content of its batched updates.
+friend class NameAddBatchTransaction;
 public:
 
     //@{  Additional states needed for NameAdd state model.
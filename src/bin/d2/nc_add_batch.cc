@@ -0,0 +1,503 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <d2/d2_log.h>
+#include <d2/nc_add_batch.h>
+
+#include <boost/bind.hpp>
+
+namespace bundy {
+namespace d2 {
+
+// NameAddBatchTransaction states
+const int NameAddBatchTransaction::ADDING_FWD_ADDRS_ST;
+const int NameAddBatchTransaction::REPLACING_REV_PTRS_ST;
+
+namespace {
+
+/// @brief Returns the first request of a batch, which leads the transaction.
+///
+/// @throw NameAddBatchTransactionError if the list is empty.
+dhcp_ddns::NameChangeRequestPtr&
+leadRequest(dhcp_ddns::NameChangeRequestList& ncrs) {
+    if (ncrs.empty()) {
+        bundy_throw(NameAddBatchTransactionError,
+                    "NameAddBatchTransaction, request list cannot be empty");
+    }
+
+    return (ncrs.front());
+}
+
+}
+
+NameAddBatchTransaction::
+NameAddBatchTransaction(IOServicePtr& io_service,
+                        dhcp_ddns::NameChangeRequestList& ncrs,
+                        DdnsDomainPtr& forward_domain,
+                        DdnsDomainPtr& reverse_domain)
+    : NameChangeTransaction(io_service, leadRequest(ncrs), forward_domain,
+                            reverse_domain),
+      ncrs_(ncrs), members_(), fallback_(false) {
+    const dhcp_ddns::NameChangeRequestPtr& lead = getNcr();
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        dhcp_ddns::NameChangeRequestPtr& ncr = ncrs_[i];
+        if (!ncr) {
+            bundy_throw(NameAddBatchTransactionError,
+                        "NameAddBatchTransaction, request cannot be null");
+        }
+
+        // The domains given apply to every request, so they must all
+        // update in the same directions.
+        if ((ncr->isForwardChange() != lead->isForwardChange()) ||
+            (ncr->isReverseChange() != lead->isReverseChange())) {
+            bundy_throw(NameAddBatchTransactionError,
+                        "NameAddBatchTransaction, requests must all ask for"
+                        " the same update directions: " << ncr->toText());
+        }
+
+        // Prerequisites guard each request only against the current zone
+        // content, not against the other updates in the same message.
+        for (size_t j = 0; j < i; ++j) {
+            if ((ncrs_[j]->getFqdn() == ncr->getFqdn()) ||
+                (ncrs_[j]->getIpAddress() == ncr->getIpAddress()) ||
+                (ncrs_[j]->getDhcid() == ncr->getDhcid())) {
+                bundy_throw(NameAddBatchTransactionError,
+                            "NameAddBatchTransaction, requests cannot share"
+                            " an FQDN, lease address or DHCID: "
+                            << ncr->toText());
+            }
+        }
+
+        // NameAddTransaction verifies the change type for us.
+        try {
+            members_.push_back(NameAddTransactionPtr(
+                               new NameAddTransaction(io_service, ncr,
+                                                      forward_domain,
+                                                      reverse_domain)));
+        } catch (const NameAddTransactionError& ex) {
+            bundy_throw(NameAddBatchTransactionError, ex.what());
+        }
+    }
+}
+
+NameAddBatchTransaction::~NameAddBatchTransaction(){
+}
+
+void
+NameAddBatchTransaction::defineStates() {
+    // Call superclass impl first.
+    NameChangeTransaction::defineStates();
+
+    // Define NameAddBatchTransaction states.
+    defineState(READY_ST, "READY_ST",
+             boost::bind(&NameAddBatchTransaction::readyHandler, this));
+
+    defineState(SELECTING_FWD_SERVER_ST, "SELECTING_FWD_SERVER_ST",
+             boost::bind(&NameAddBatchTransaction::selectingFwdServerHandler,
+                         this));
+
+    defineState(SELECTING_REV_SERVER_ST, "SELECTING_REV_SERVER_ST",
+             boost::bind(&NameAddBatchTransaction::selectingRevServerHandler,
+                         this));
+
+    defineState(ADDING_FWD_ADDRS_ST, "ADDING_FWD_ADDRS_ST",
+             boost::bind(&NameAddBatchTransaction::addingFwdAddrsHandler,
+                         this));
+
+    defineState(REPLACING_REV_PTRS_ST, "REPLACING_REV_PTRS_ST",
+             boost::bind(&NameAddBatchTransaction::replacingRevPtrsHandler,
+                         this));
+
+    defineState(PROCESS_TRANS_OK_ST, "PROCESS_TRANS_OK_ST",
+             boost::bind(&NameAddBatchTransaction::processAddOkHandler, this));
+
+    defineState(PROCESS_TRANS_FAILED_ST, "PROCESS_TRANS_FAILED_ST",
+             boost::bind(&NameAddBatchTransaction::processAddFailedHandler,
+                         this));
+}
+
+void
+NameAddBatchTransaction::verifyStates() {
+    // Call superclass implementation first to verify its states. These are
+    // states common to all transactions, and they must be defined.
+    NameChangeTransaction::verifyStates();
+
+    // Verify NameAddBatchTransaction states by attempting to fetch them.
+    getState(ADDING_FWD_ADDRS_ST);
+    getState(REPLACING_REV_PTRS_ST);
+}
+
+void
+NameAddBatchTransaction::onModelFailure(const std::string& explanation) {
+    // Unlike a single transaction, the requests get another chance.
+    fallback_ = true;
+    LOG_ERROR(dctl_logger, DHCP_DDNS_STATE_MODEL_UNEXPECTED_ERROR)
+              .arg(explanation);
+}
+
+void
+NameAddBatchTransaction::readyHandler() {
+    switch(getNextEvent()) {
+    case START_EVT:
+        // startTransaction() only marks the lead request as pending.
+        for (size_t i = 0; i < ncrs_.size(); ++i) {
+            ncrs_[i]->setStatus(dhcp_ddns::ST_PENDING);
+        }
+
+        if (getForwardDomain()) {
+            // Requests include a forward change, do that first.
+            transition(SELECTING_FWD_SERVER_ST, SELECT_SERVER_EVT);
+        } else {
+            // Reverse change only, transition accordingly.
+            transition(SELECTING_REV_SERVER_ST, SELECT_SERVER_EVT);
+        }
+
+        break;
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+}
+
+void
+NameAddBatchTransaction::selectingFwdServerHandler() {
+    switch(getNextEvent()) {
+    case SELECT_SERVER_EVT:
+        // First time through for this transaction, so initialize server
+        // selection.
+        initServerSelection(getForwardDomain());
+        break;
+    case SERVER_IO_ERROR_EVT:
+        // We failed to communicate with current server. Attempt to select
+        // another one below.
+        break;
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+
+    // Select the next server from the list of forward servers.
+    if (selectNextServer()) {
+        // We have a server to try.
+        transition(ADDING_FWD_ADDRS_ST, SERVER_SELECTED_EVT);
+    }
+    else {
+        // Server list is exhausted, so fail the transaction.
+        transition(PROCESS_TRANS_FAILED_ST, NO_MORE_SERVERS_EVT);
+    }
+}
+
+void
+NameAddBatchTransaction::addingFwdAddrsHandler() {
+    if (doOnEntry()) {
+        // Clear the request on initial transition. This allows us to reuse
+        // the request on retries if necessary.
+        clearDnsUpdateRequest();
+    }
+
+    switch(getNextEvent()) {
+    case SERVER_SELECTED_EVT:
+        if (!getDnsUpdateRequest()) {
+            // Request hasn't been constructed yet, so build it.
+            try {
+                buildAddFwdAddressRequest();
+            } catch (const std::exception& ex) {
+                // One of the requests holds invalid data.  Falling back
+                // lets the others be carried out on their own.
+                LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_BUILD_FAILURE)
+                          .arg(getBatchSize())
+                          .arg(ex.what());
+                transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+                break;
+            }
+        }
+
+        // Call sendUpdate() to initiate the async send. Note it also sets
+        // next event to NOP_EVT.
+        sendUpdate("Batch Forward Add");
+        break;
+
+    case IO_COMPLETED_EVT: {
+        switch (getDnsUpdateStatus()) {
+        case DNSClient::SUCCESS: {
+            // We successfully received a response packet from the server.
+            const dns::Rcode& rcode = getDnsUpdateResponse()->getRcode();
+            if (rcode == dns::Rcode::NOERROR()) {
+                // Every forward mapping was added. Mark it as done.
+                setForwardChangeCompleted(true);
+
+                // If requests call for reverse update then do that next,
+                // otherwise we can process ok.
+                if (getReverseDomain()) {
+                    transition(SELECTING_REV_SERVER_ST, SELECT_SERVER_EVT);
+                } else {
+                    transition(PROCESS_TRANS_OK_ST, UPDATE_OK_EVT);
+                }
+            } else {
+                // Typically YXDOMAIN, as at least one of the FQDNs is in
+                // use.  Nothing was applied, so let each request be
+                // carried out on its own.
+                LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL,
+                          DHCP_DDNS_BATCH_REJECTED)
+                          .arg(getCurrentServer()->toText())
+                          .arg(getBatchSize())
+                          .arg(rcode.getCode());
+                transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+            }
+
+            break;
+        }
+
+        case DNSClient::TIMEOUT:
+        case DNSClient::OTHER:
+        case DNSClient::INVALID_RESPONSE:
+            // We couldn't complete the exchange with the current server, log
+            // it and set up to retry or select the next server.
+            LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_IO_ERROR)
+                      .arg(getBatchSize())
+                      .arg(getCurrentServer()->toText())
+                      .arg(responseString());
+
+            retryTransition(SELECTING_FWD_SERVER_ST);
+            break;
+
+        default:
+            // Any other value and we will fail this transaction, something
+            // bigger is wrong.
+            LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_IO_ERROR)
+                      .arg(getBatchSize())
+                      .arg(getCurrentServer()->toText())
+                      .arg(responseString());
+
+            transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+            break;
+        } // end switch on dns_status
+
+        break;
+    } // end case IO_COMPLETE_EVT
+
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+}
+
+void
+NameAddBatchTransaction::selectingRevServerHandler() {
+    switch(getNextEvent()) {
+    case SELECT_SERVER_EVT:
+        // First time through for this transaction, so initialize server
+        // selection.
+        initServerSelection(getReverseDomain());
+        break;
+    case SERVER_IO_ERROR_EVT:
+        // We failed to communicate with current server. Attempt to select
+        // another one below.
+        break;
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+
+    // Select the next server from the list of reverse servers.
+    if (selectNextServer()) {
+        // We have a server to try.
+        transition(REPLACING_REV_PTRS_ST, SERVER_SELECTED_EVT);
+    }
+    else {
+        // Server list is exhausted, so fail the transaction.
+        transition(PROCESS_TRANS_FAILED_ST, NO_MORE_SERVERS_EVT);
+    }
+}
+
+void
+NameAddBatchTransaction::replacingRevPtrsHandler() {
+    if (doOnEntry()) {
+        // Clear the request on initial transition. This allows us to reuse
+        // the request on retries if necessary.
+        clearDnsUpdateRequest();
+    }
+
+    switch(getNextEvent()) {
+    case SERVER_SELECTED_EVT:
+        if (!getDnsUpdateRequest()) {
+            // Request hasn't been constructed yet, so build it.
+            try {
+                buildReplaceRevPtrsRequest();
+            } catch (const std::exception& ex) {
+                LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_BUILD_FAILURE)
+                          .arg(getBatchSize())
+                          .arg(ex.what());
+                transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+                break;
+            }
+        }
+
+        // Call sendUpdate() to initiate the async send. Note it also sets
+        // next event to NOP_EVT.
+        sendUpdate("Batch Reverse Replace");
+        break;
+
+    case IO_COMPLETED_EVT: {
+        switch (getDnsUpdateStatus()) {
+        case DNSClient::SUCCESS: {
+            // We successfully received a response packet from the server.
+            const dns::Rcode& rcode = getDnsUpdateResponse()->getRcode();
+            if (rcode == dns::Rcode::NOERROR()) {
+                // Every reverse mapping was updated. Mark it as done.
+                setReverseChangeCompleted(true);
+                transition(PROCESS_TRANS_OK_ST, UPDATE_OK_EVT);
+            } else {
+                LOG_DEBUG(dctl_logger, DBGLVL_TRACE_DETAIL,
+                          DHCP_DDNS_BATCH_REJECTED)
+                          .arg(getCurrentServer()->toText())
+                          .arg(getBatchSize())
+                          .arg(rcode.getCode());
+                transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+            }
+
+            break;
+        }
+
+        case DNSClient::TIMEOUT:
+        case DNSClient::OTHER:
+        case DNSClient::INVALID_RESPONSE:
+            // We couldn't complete the exchange with the current server, log
+            // it and set up to retry or select the next server.
+            LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_IO_ERROR)
+                      .arg(getBatchSize())
+                      .arg(getCurrentServer()->toText())
+                      .arg(responseString());
+
+            retryTransition(SELECTING_REV_SERVER_ST);
+            break;
+
+        default:
+            // Any other value and we will fail this transaction, something
+            // bigger is wrong.
+            LOG_ERROR(dctl_logger, DHCP_DDNS_BATCH_IO_ERROR)
+                      .arg(getBatchSize())
+                      .arg(getCurrentServer()->toText())
+                      .arg(responseString());
+
+            transition(PROCESS_TRANS_FAILED_ST, UPDATE_FAILED_EVT);
+            break;
+        } // end switch on dns_status
+
+        break;
+    } // end case IO_COMPLETE_EVT
+
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+}
+
+void
+NameAddBatchTransaction::processAddOkHandler() {
+    switch(getNextEvent()) {
+    case UPDATE_OK_EVT:
+        // Log each request as a single transaction would, so the outcome of
+        // a given lease can be traced regardless of how it was carried out.
+        for (size_t i = 0; i < ncrs_.size(); ++i) {
+            LOG_INFO(dctl_logger, DHCP_DDNS_ADD_SUCCEEDED)
+                     .arg(ncrs_[i]->toText());
+            ncrs_[i]->setStatus(dhcp_ddns::ST_COMPLETED);
+        }
+
+        endModel();
+        break;
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+}
+
+void
+NameAddBatchTransaction::processAddFailedHandler() {
+    switch(getNextEvent()) {
+    case UPDATE_FAILED_EVT:
+    case NO_MORE_SERVERS_EVT:
+        // The request statuses are left pending, the individual
+        // transactions will settle them.
+        fallback_ = true;
+        LOG_WARN(dctl_logger, DHCP_DDNS_BATCH_ADD_FAILED)
+                 .arg(getBatchSize())
+                 .arg(getEventLabel(getNextEvent()));
+        endModel();
+        break;
+    default:
+        // Event is invalid.
+        bundy_throw(NameAddBatchTransactionError,
+                  "Wrong event for context: " << getContextStr());
+    }
+}
+
+void
+NameAddBatchTransaction::buildAddFwdAddressRequest() {
+    // Construct an empty request.
+    D2UpdateMessagePtr request = prepNewRequest(getForwardDomain());
+
+    // Each member builds its own RFC 4703, section 5.3.1 content, which
+    // is then appended to the batch request.
+    for (size_t i = 0; i < members_.size(); ++i) {
+        members_[i]->buildAddFwdAddressRequest();
+        addMemberRRsets(request, members_[i]->getDnsUpdateRequest());
+    }
+
+    // Set the transaction's update request to the new request.
+    setDnsUpdateRequest(request);
+}
+
+void
+NameAddBatchTransaction::buildReplaceRevPtrsRequest() {
+    // Construct an empty request.
+    D2UpdateMessagePtr request = prepNewRequest(getReverseDomain());
+
+    // Each member builds its own RFC 4703, section 5.4 content, which
+    // is then appended to the batch request.
+    for (size_t i = 0; i < members_.size(); ++i) {
+        members_[i]->buildReplaceRevPtrsRequest();
+        addMemberRRsets(request, members_[i]->getDnsUpdateRequest());
+    }
+
+    // Set the transaction's update request to the new request.
+    setDnsUpdateRequest(request);
+}
+
+void
+NameAddBatchTransaction::addMemberRRsets(D2UpdateMessagePtr& request,
+                                         const D2UpdateMessagePtr&
+                                         member_request) {
+    static const D2UpdateMessage::UpdateMsgSection sections[] = {
+        D2UpdateMessage::SECTION_PREREQUISITE,
+        D2UpdateMessage::SECTION_UPDATE
+    };
+
+    for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); ++i) {
+        dns::RRsetIterator rrset = member_request->beginSection(sections[i]);
+        for (; rrset != member_request->endSection(sections[i]); ++rrset) {
+            request->addRRset(sections[i], *rrset);
+        }
+    }
+}
+
+} // namespace bundy::d2
+} // namespace bundy
@@ -0,0 +1,322 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef NC_ADD_BATCH_H
+#define NC_ADD_BATCH_H
+
+/// @file nc_add_batch.h This file defines the class NameAddBatchTransaction.
+
+#include <d2/nc_add.h>
+
+#include <vector>
+
+namespace bundy {
+namespace d2 {
+
+/// @brief Thrown if the NameAddBatchTransaction encounters a general error.
+class NameAddBatchTransactionError : public bundy::Exception {
+public:
+    NameAddBatchTransactionError(const char* file, size_t line,
+                                 const char* what) :
+        bundy::Exception(file, line, what) { };
+};
+
+/// @brief Carries out the DDNS Add updates of several requests at once.
+///
+/// NameAddBatchTransaction coalesces the NameChangeRequests of several lease
+/// clients whose mappings belong to the same forward and reverse zones into
+/// a single, multi-RR DNS update per zone.  This reduces the number of packet
+/// exchanges with the DNS servers when a burst of leases is granted, such as
+/// after a DHCP server restart.
+///
+/// The batch carries out the first pass of the RFC 4703 processing performed
+/// by NameAddTransaction, in which each FQDN is expected not to be in use:
+///
+/// @code
+///
+/// If the requests include forward changes:
+///     Select a forward server
+///     Send the server a request to add the forward entries of all requests
+///
+///     If the forward update is unsuccessful:
+///         abandon the batch
+///
+/// If the requests include reverse changes:
+///     Select a reverse server
+///     Send a server a request to delete and then add the reverse entries
+///     of all requests
+///
+/// @endcode
+///
+/// The forward request carries the "FQDN is not in use" prerequisite of each
+/// request.  Per RFC 2136, section 3.2, a server evaluates all of the
+/// prerequisites of a message before applying any of its updates, so either
+/// every request in the batch is added or none is.  A single FQDN already in
+/// use therefore fails the whole batch.  When the batch fails for any reason
+/// it ends without setting the status of its requests and needsFallback()
+/// returns true, telling the owner to carry out each request in its own
+/// NameAddTransaction.  This is safe even when the forward update succeeded
+/// and only the reverse update failed: the individual transaction finds the
+/// FQDN in use and replaces it, as its DHCID matches.
+///
+/// The requests of a batch must all be CHG_ADD requests for the same update
+/// directions and must not share an FQDN or a lease address, otherwise their
+/// prerequisites would not guard against each other's updates.
+class NameAddBatchTransaction : public NameChangeTransaction {
+public:
+
+    //@{  Additional states needed for NameAddBatch state model.
+    /// @brief State that attempts to add forward address records.
+    static const int ADDING_FWD_ADDRS_ST = NCT_DERIVED_STATE_MIN + 1;
+
+    /// @brief State that attempts to replace reverse PTR records
+    static const int REPLACING_REV_PTRS_ST = NCT_DERIVED_STATE_MIN + 2;
+    //@}
+
+    /// @brief Constructor
+    ///
+    /// Instantiates a batch Add transaction that is ready to be started.
+    /// The first request of the list serves as the transaction's request.
+    ///
+    /// @param io_service IO service to be used for IO processing
+    /// @param ncrs is the list of NameChangeRequests to fulfill
+    /// @param forward_domain is the domain to use for forward DNS updates
+    /// @param reverse_domain is the domain to use for reverse DNS updates
+    ///
+    /// @throw NameAddBatchTransactionError if the list is empty, if any of
+    /// the requests is not a CHG_ADD, does not ask for the same update
+    /// directions as the first request, or shares an FQDN, a lease address
+    /// or a DHCID with another request.  NameChangeTransactionError for base
+    /// class construction errors.
+    NameAddBatchTransaction(IOServicePtr& io_service,
+                            dhcp_ddns::NameChangeRequestList& ncrs,
+                            DdnsDomainPtr& forward_domain,
+                            DdnsDomainPtr& reverse_domain);
+
+    /// @brief Destructor
+    virtual ~NameAddBatchTransaction();
+
+    /// @brief Fetches the requests carried out by the batch.
+    ///
+    /// @return A const reference to the list of requests.
+    const dhcp_ddns::NameChangeRequestList& getNcrs() const {
+        return (ncrs_);
+    }
+
+    /// @brief Returns the number of requests in the batch.
+    size_t getBatchSize() const {
+        return (ncrs_.size());
+    }
+
+    /// @brief Indicates if the requests must be carried out individually.
+    ///
+    /// @return True if the batch has ended without fulfilling its requests.
+    bool needsFallback() const {
+        return (fallback_);
+    }
+
+protected:
+    /// @brief Adds states defined by NameAddBatchTransaction to the state set.
+    ///
+    /// Invokes NameChangeTransaction's implementation and then defines the
+    /// states unique to batch Add transaction processing.
+    ///
+    /// @throw StateModelError if an state definition is invalid or a duplicate.
+    virtual void defineStates();
+
+    /// @brief Validates the contents of the set of states.
+    ///
+    /// Invokes NameChangeTransaction's implementation and then verifies the
+    /// batch Add transaction's states. This tests that the needed states are
+    /// in the state dictionary.
+    ///
+    /// @throw StateModelError if an event value is undefined.
+    virtual void verifyStates();
+
+    /// @brief Handler for fatal model execution errors.
+    ///
+    /// Rather than failing the transaction's request, it ends the batch and
+    /// flags its requests for individual processing.
+    ///
+    /// @param explanation text detailing the error
+    virtual void onModelFailure(const std::string& explanation);
+
+    /// @brief State handler for READY_ST.
+    ///
+    /// Entered from:
+    /// - INIT_ST with next event of START_EVT
+    ///
+    /// Marks every request of the batch as pending, then transitions to
+    /// SELECTING_FWD_SERVER_ST if the requests include a forward change,
+    /// otherwise to SELECTING_REV_SERVER_ST.
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// START_EVT.
+    void readyHandler();
+
+    /// @brief State handler for SELECTING_FWD_SERVER_ST.
+    ///
+    /// Entered from:
+    /// - READY_ST with next event of SELECT_SERVER_EVT
+    /// - ADDING_FWD_ADDRS_ST with next event of SERVER_IO_ERROR_EVT
+    ///
+    /// Selects the server to be used from the forward domain for the forward
+    /// DNS update.  If next event is SELECT_SERVER_EVT the handler initializes
+    /// the forward domain's server selection mechanism and then attempts to
+    /// select the next server. If next event is SERVER_IO_ERROR_EVT then the
+    /// handler simply attempts to select the next server.
+    ///
+    /// Transitions to:
+    /// - ADDING_FWD_ADDRS_ST with next event of SERVER_SELECTED upon
+    /// successful server selection
+    ///
+    /// - PROCESS_TRANS_FAILED with next event of NO_MORE_SERVERS_EVT upon
+    /// failure to select a server
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// SELECT_SERVER_EVT or SERVER_IO_ERROR_EVT.
+    void selectingFwdServerHandler();
+
+    /// @brief State handler for ADDING_FWD_ADDRS_ST.
+    ///
+    /// Entered from:
+    /// - SELECTING_FWD_SERVER with next event of SERVER_SELECTED_EVT
+    ///
+    /// Attempts to add the forward DNS entries of all requests.  On the first
+    /// entry it builds the combined update request and schedules its
+    /// asynchronous send; upon IO completion it examines the outcome.
+    ///
+    /// Transitions to:
+    /// - SELECTING_REV_SERVER_ST or PROCESS_TRANS_OK_ST with next event of
+    /// SELECT_SERVER_EVT or UPDATE_OK_EVT when the server accepts the update
+    ///
+    /// - PROCESS_TRANS_FAILED_ST with next event of UPDATE_FAILED_EVT if the
+    /// request cannot be built or sent, or the server rejects it for any
+    /// reason, including an FQDN already in use
+    ///
+    /// - SELECTING_FWD_SERVER_ST with next event of SERVER_IO_ERROR_EVT upon
+    /// an IO error once the retries for the current server are exhausted
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// SERVER_SELECTED_EVT or IO_COMPLETED_EVT.
+    void addingFwdAddrsHandler();
+
+    /// @brief State handler for SELECTING_REV_SERVER_ST.
+    ///
+    /// Entered from:
+    /// - READY_ST with next event of SELECT_SERVER_EVT
+    /// - ADDING_FWD_ADDRS_ST with next event of SELECT_SERVER_EVT
+    /// - REPLACING_REV_PTRS_ST with next event of SERVER_IO_ERROR_EVT
+    ///
+    /// Selects the server to be used from the reverse domain for the reverse
+    /// DNS update in the same manner as selectingFwdServerHandler().
+    ///
+    /// Transitions to:
+    /// - REPLACING_REV_PTRS_ST with next event of SERVER_SELECTED upon
+    /// successful server selection
+    ///
+    /// - PROCESS_TRANS_FAILED with next event of NO_MORE_SERVERS_EVT upon
+    /// failure to select a server
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// SELECT_SERVER_EVT or SERVER_IO_ERROR_EVT.
+    void selectingRevServerHandler();
+
+    /// @brief State handler for REPLACING_REV_PTRS_ST.
+    ///
+    /// Entered from:
+    /// - SELECTING_REV_SERVER_ST with next event of SERVER_SELECTED_EVT
+    ///
+    /// Attempts to replace the reverse DNS entries of all requests, in the
+    /// same manner as addingFwdAddrsHandler().
+    ///
+    /// Transitions to:
+    /// - PROCESS_TRANS_OK_ST with next event of UPDATE_OK_EVT when the server
+    /// accepts the update
+    ///
+    /// - PROCESS_TRANS_FAILED_ST with next event of UPDATE_FAILED_EVT if the
+    /// request cannot be built or sent, or the server rejects it
+    ///
+    /// - SELECTING_REV_SERVER_ST with next event of SERVER_IO_ERROR_EVT upon
+    /// an IO error once the retries for the current server are exhausted
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// SERVER_SELECTED_EVT or IO_COMPLETED_EVT.
+    void replacingRevPtrsHandler();
+
+    /// @brief State handler for PROCESS_TRANS_OK_ST.
+    ///
+    /// Sets the status of every request in the batch to ST_COMPLETED and
+    /// ends the model.
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// UPDATE_OK_EVT.
+    void processAddOkHandler();
+
+    /// @brief State handler for PROCESS_TRANS_FAILED_ST.
+    ///
+    /// Flags the requests of the batch for individual processing and ends
+    /// the model.
+    ///
+    /// @throw NameAddBatchTransactionError if upon entry next event is not
+    /// UPDATE_FAILED_EVT or NO_MORE_SERVERS_EVT.
+    void processAddFailedHandler();
+
+    /// @brief Builds a DNS request to add the forward entries of the batch.
+    ///
+    /// The request holds, for each request of the batch, the prerequisite
+    /// and update RRsets built by NameAddTransaction for an add of a forward
+    /// DNS mapping (RFC 4703 section 5.3.1).  Once constructed, the request
+    /// is stored as the transaction's DNS update request.
+    ///
+    /// @throw This method does not throw but underlying methods may.
+    void buildAddFwdAddressRequest();
+
+    /// @brief Builds a DNS request to replace the reverse entries of the batch.
+    ///
+    /// The request holds, for each request of the batch, the update RRsets
+    /// built by NameAddTransaction for a replacement of a reverse DNS mapping
+    /// (RFC 4703 section 5.4).  Once constructed, the request is stored as
+    /// the transaction's DNS update request.
+    ///
+    /// @throw This method does not throw but underlying methods may.
+    void buildReplaceRevPtrsRequest();
+
+private:
+    /// @brief Appends the prerequisite and update RRsets of one request.
+    ///
+    /// @param request update request to which the RRsets are added
+    /// @param member_request update request built for a single request
+    void addMemberRRsets(D2UpdateMessagePtr& request,
+                         const D2UpdateMessagePtr& member_request);
+
+    /// @brief The requests carried out by the batch.
+    dhcp_ddns::NameChangeRequestList ncrs_;
+
+    /// @brief Single request transactions used to build the update content.
+    ///
+    /// These are never started; they serve to build the RRsets for their
+    /// request exactly as an individual transaction would.
+    std::vector<NameAddTransactionPtr> members_;
+
+    /// @brief True if the batch ended without fulfilling its requests.
+    bool fallback_;
+};
+
+/// @brief Defines a pointer to a NameAddBatchTransaction.
+typedef boost::shared_ptr<NameAddBatchTransaction> NameAddBatchTransactionPtr;
+
+} // namespace bundy::d2
+} // namespace bundy
+#endif
@@ -893,6 +893,7 @@ TEST_F(D2CfgMgrTest, fullConfig) {
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"192.168.1.33\" , "
                         "\"port\" : 88 , "
+                        "\"ncr_format\" : \"BINARY\", "
                         "\"tsig_keys\": ["
                         "{"
                         "  \"name\": \"d2_key.tmark.org\" , "
@@ -964,6 +965,10 @@ TEST_F(D2CfgMgrTest, fullConfig) {
     EXPECT_NO_THROW (context->getParam("port", port));
     EXPECT_EQ(88, port);
 
+    std::string ncr_format;
+    EXPECT_NO_THROW (context->getParam("ncr_format", ncr_format));
+    EXPECT_EQ("BINARY", ncr_format);
+
     // Verify that the forward manager can be retrieved.
     DdnsDomainListMgrPtr mgr = context->getForwardMgr();
     ASSERT_TRUE(mgr);
@@ -1018,6 +1023,37 @@ TEST_F(D2CfgMgrTest, fullConfig) {
     ASSERT_TRUE(checkAnswer(0));
 }
 
+/// @brief Tests that an invalid ncr_format is rejected when the
+/// configuration is parsed.
+TEST_F(D2CfgMgrTest, invalidNcrFormat) {
+    std::string config = "{ "
+                        "\"interface\" : \"eth1\" , "
+                        "\"ip_address\" : \"192.168.1.33\" , "
+                        "\"port\" : 88 , "
+                        "\"ncr_format\" : \"XML\", "
+                        "\"tsig_keys\": [] ,"
+                        "\"forward_ddns\" : {}, "
+                        "\"reverse_ddns\" : {} }";
+    ASSERT_TRUE(fromJSON(config));
+
+    answer_ = cfg_mgr_->parseConfig(config_set_);
+    EXPECT_TRUE(checkAnswer(1));
+
+    // The format is not case sensitive.
+    config = "{ "
+             "\"interface\" : \"eth1\" , "
+             "\"ip_address\" : \"192.168.1.33\" , "
+             "\"port\" : 88 , "
+             "\"ncr_format\" : \"binary\", "
+             "\"tsig_keys\": [] ,"
+             "\"forward_ddns\" : {}, "
+             "\"reverse_ddns\" : {} }";
+    ASSERT_TRUE(fromJSON(config));
+
+    answer_ = cfg_mgr_->parseConfig(config_set_);
+    EXPECT_TRUE(checkAnswer(0));
+}
+
 /// @brief Tests the basics of the D2CfgMgr FQDN-domain matching
 /// This test uses a valid configuration to exercise the D2CfgMgr
 /// forward FQDN-to-domain matching.
@@ -1034,6 +1070,7 @@ TEST_F(D2CfgMgrTest, forwardMatch) {
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"192.168.1.33\" , "
                         "\"port\" : 88 , "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [] ,"
                         "\"forward_ddns\" : {"
                         "\"ddns_domains\": [ "
@@ -1108,6 +1145,7 @@ TEST_F(D2CfgMgrTest, matchNoWildcard) {
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"192.168.1.33\" , "
                         "\"port\" : 88 , "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [] ,"
                         "\"forward_ddns\" : {"
                         "\"ddns_domains\": [ "
@@ -1156,6 +1194,7 @@ TEST_F(D2CfgMgrTest, matchAll) {
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"192.168.1.33\" , "
                         "\"port\" : 88 , "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [] ,"
                         "\"forward_ddns\" : {"
                         "\"ddns_domains\": [ "
@@ -1203,6 +1242,7 @@ TEST_F(D2CfgMgrTest, matchReverse) {
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"192.168.1.33\" , "
                         "\"port\" : 88 , "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [] ,"
                         "\"forward_ddns\" : {}, "
                         "\"reverse_ddns\" : {"
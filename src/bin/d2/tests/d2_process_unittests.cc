@@ -38,6 +38,7 @@ const char* bad_ip_d2_config = "{ "
                         "\"interface\" : \"eth1\" , "
                         "\"ip_address\" : \"1.1.1.1\" , "
                         "\"port\" : 5031, "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": ["
                         "{ \"name\": \"d2_key.tmark.org\" , "
                         "   \"algorithm\": \"md5\" ,"
@@ -610,6 +611,7 @@ TEST_F(D2ProcessTest, notLoopbackTest) {
                         "\"interface\" : \"\" , "
                         "\"ip_address\" : \"0.0.0.0\" , "
                         "\"port\" : 53001, "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [],"
                         "\"forward_ddns\" : {},"
                         "\"reverse_ddns\" : {}"
@@ -629,6 +631,7 @@ TEST_F(D2ProcessTest, v4LoopbackTest) {
                         "\"interface\" : \"\" , "
                         "\"ip_address\" : \"127.0.0.1\" , "
                         "\"port\" : 53001, "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [],"
                         "\"forward_ddns\" : {},"
                         "\"reverse_ddns\" : {}"
@@ -643,6 +646,7 @@ TEST_F(D2ProcessTest, v6LoopbackTest) {
                         "\"interface\" : \"\" , "
                         "\"ip_address\" : \"::1\" , "
                         "\"port\" : 53001, "
+                        "\"ncr_format\" : \"JSON\", "
                         "\"tsig_keys\": [],"
                         "\"forward_ddns\" : {},"
                         "\"reverse_ddns\" : {}"
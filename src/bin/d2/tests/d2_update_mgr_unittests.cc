@@ -14,6 +14,7 @@
 
 #include <d2/d2_asio.h>
 #include <d2/d2_update_mgr.h>
+#include <d2/nc_add_batch.h>
 #include <util/time_utilities.h>
 #include <d_test_stubs.h>
 #include <nc_test_utils.h>
@@ -23,6 +24,7 @@
 #include <gtest/gtest.h>
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <sstream>
 #include <vector>
 
 using namespace std;
@@ -116,6 +118,34 @@ public:
         }
     }
 
+    /// @brief Creates a list of add requests which can be batched together.
+    ///
+    /// Each request asks for both forward and reverse changes, within the
+    /// "example.com." and "1.168.192.in-addr.arpa." domains, for a distinct
+    /// FQDN, lease address and DHCID.
+    ///
+    /// @param count number of requests to create (at most ten)
+    std::vector<NameChangeRequestPtr> makeBatchNcrs(size_t count) {
+        std::vector<NameChangeRequestPtr> ncrs;
+        for (size_t i = 0; i < count; ++i) {
+            NameChangeRequestPtr ncr(new NameChangeRequest(*canned_ncrs_[0]));
+            std::ostringstream fqdn;
+            fqdn << "host" << i << ".example.com.";
+            ncr->setFqdn(fqdn.str());
+            std::ostringstream address;
+            address << "192.168.1." << (i + 10);
+            ncr->setIpAddress(address.str());
+            std::ostringstream dhcid;
+            dhcid << "0a0b0c0" << i;
+            ncr->setDhcid(dhcid.str());
+            ncr->setChangeType(dhcp_ddns::CHG_ADD);
+            ncr->setReverseChange(true);
+            ncrs.push_back(ncr);
+        }
+
+        return (ncrs);
+    }
+
     /// @brief Seeds configuration manager with a valid DHCP_DDNS configuration.
     void makeCannedConfig() {
         std::string canned_config_ =
@@ -123,6 +153,7 @@ public:
                   "\"interface\" : \"eth1\" , "
                   "\"ip_address\" : \"192.168.1.33\" , "
                   "\"port\" : 88 , "
+                  "\"ncr_format\" : \"JSON\", "
                   "\"tsig_keys\": [] ,"
                   "\"forward_ddns\" : {"
                   "\"ddns_domains\": [ "
@@ -257,6 +288,8 @@ public:
 /// 3. Construction with max transactions of zero is not allowed
 /// 4. Default construction works and max transactions is defaulted properly
 /// 5. Construction with custom max transactions works properly
+/// 6. Construction with max batch size of zero is not allowed
+/// 7. Max batch size defaults properly and may be customized
 TEST(D2UpdateMgr, construction) {
     IOServicePtr io_service(new bundy::asiolink::IOService());
     D2QueueMgrPtr queue_mgr;
@@ -301,6 +334,24 @@ TEST(D2UpdateMgr, construction) {
 
     // Verify that max transactions is correct.
     EXPECT_EQ(100, update_mgr->getMaxTransactions());
+
+    // Verify that max batch size cannot be zero.
+    EXPECT_THROW(D2UpdateMgr(queue_mgr, cfg_mgr, io_service, 100, 0),
+                 D2UpdateMgrError);
+
+    // Verify that max batch size defaults properly.
+    EXPECT_EQ(D2UpdateMgr::MAX_BATCH_SIZE_DEFAULT,
+              update_mgr->getMaxBatchSize());
+
+    // Verify that constructor permits custom max batch size.
+    ASSERT_NO_THROW(update_mgr.reset(new D2UpdateMgr(queue_mgr, cfg_mgr,
+                                                     io_service, 100, 4)));
+    EXPECT_EQ(4, update_mgr->getMaxBatchSize());
+
+    // Verify that the setter validates as well.
+    EXPECT_THROW(update_mgr->setMaxBatchSize(0), D2UpdateMgrError);
+    EXPECT_NO_THROW(update_mgr->setMaxBatchSize(1));
+    EXPECT_EQ(1, update_mgr->getMaxBatchSize());
 }
 
 /// @brief Tests the D2UpdateManager's transaction list services
@@ -872,4 +923,166 @@ TEST_F(D2UpdateMgrTest, multiTransactionTimeout) {
     }
 }
 
+/// @brief Tests that pickNextJob batches add requests for the same zones.
+/// This test verifies that:
+/// 1. Queued add requests for the same forward and reverse domains are
+/// coalesced into a single NameAddBatchTransaction, listed under each of
+/// their DHCIDs.
+/// 2. Requests for another domain, or removals, are left in the queue and
+/// later given their own transactions.
+TEST_F(D2UpdateMgrTest, batchPickNextJob) {
+    std::vector<NameChangeRequestPtr> ncrs = makeBatchNcrs(3);
+
+    // A removal within the same domains.
+    NameChangeRequestPtr remove_ncr(new NameChangeRequest(*canned_ncrs_[1]));
+    remove_ncr->setIpAddress("192.168.1.50");
+
+    // An add within another forward domain.
+    NameChangeRequestPtr org_ncr(new NameChangeRequest(*ncrs[0]));
+    org_ncr->setFqdn("host.example.org.");
+    org_ncr->setIpAddress("192.168.1.60");
+    org_ncr->setDhcid("0f0f0f");
+
+    ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[0]));
+    ASSERT_NO_THROW(queue_mgr_->enqueue(remove_ncr));
+    ASSERT_NO_THROW(queue_mgr_->enqueue(org_ncr));
+    ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[1]));
+    ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[2]));
+
+    // The first pick should take the three batchable adds.
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_EQ(3, update_mgr_->getTransactionCount());
+    EXPECT_EQ(2, update_mgr_->getQueueCount());
+
+    TransactionList::iterator pos =
+        update_mgr_->findTransaction(ncrs[0]->getDhcid());
+    ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+    NameAddBatchTransactionPtr batch =
+        boost::dynamic_pointer_cast<NameAddBatchTransaction>((*pos).second);
+    ASSERT_TRUE(batch);
+    EXPECT_EQ(3, batch->getBatchSize());
+
+    for (size_t i = 1; i < ncrs.size(); ++i) {
+        pos = update_mgr_->findTransaction(ncrs[i]->getDhcid());
+        ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+        EXPECT_EQ(batch, (*pos).second);
+    }
+
+    // The next picks should make a single transaction of each of the others.
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_EQ(5, update_mgr_->getTransactionCount());
+    EXPECT_EQ(0, update_mgr_->getQueueCount());
+
+    pos = update_mgr_->findTransaction(org_ncr->getDhcid());
+    ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+    EXPECT_FALSE(boost::dynamic_pointer_cast<NameAddBatchTransaction>
+                 ((*pos).second));
+}
+
+/// @brief Tests the limits placed on the size of a batch.
+/// This test verifies that a batch holds no more than the maximum batch size
+/// nor the room left in the transaction list, and that a lone request is
+/// given a single transaction.
+TEST_F(D2UpdateMgrTest, batchLimits) {
+    std::vector<NameChangeRequestPtr> ncrs = makeBatchNcrs(6);
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[i]));
+    }
+
+    // Batch size limits the first pick.
+    update_mgr_->setMaxBatchSize(2);
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_EQ(2, update_mgr_->getTransactionCount());
+    EXPECT_EQ(4, update_mgr_->getQueueCount());
+
+    // Room in the transaction list limits the second.
+    update_mgr_->setMaxBatchSize(D2UpdateMgr::MAX_BATCH_SIZE_DEFAULT);
+    update_mgr_->setMaxTransactions(5);
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_EQ(5, update_mgr_->getTransactionCount());
+    EXPECT_EQ(1, update_mgr_->getQueueCount());
+
+    // The last request has nothing to batch with.
+    update_mgr_->setMaxTransactions(6);
+    EXPECT_NO_THROW(update_mgr_->pickNextJob());
+    EXPECT_EQ(6, update_mgr_->getTransactionCount());
+    EXPECT_EQ(0, update_mgr_->getQueueCount());
+
+    TransactionList::iterator pos =
+        update_mgr_->findTransaction(ncrs[5]->getDhcid());
+    ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+    EXPECT_FALSE(boost::dynamic_pointer_cast<NameAddBatchTransaction>
+                 ((*pos).second));
+}
+
+/// @brief Tests processing of a batch from start to finish.
+/// This test verifies that a batch of add requests is carried out with a
+/// fake server which responds to all requests with NOERROR.
+TEST_F(D2UpdateMgrTest, batchTransaction) {
+    std::vector<NameChangeRequestPtr> ncrs = makeBatchNcrs(4);
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[i]));
+    }
+
+    asiolink::IOAddress server_ip("127.0.0.1");
+    FauxServer server(*io_service_, server_ip, 5301);
+    server.receive(FauxServer::USE_RCODE, dns::Rcode::NOERROR());
+
+    // Run sweep and IO until everything is done.
+    processAll();
+
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        EXPECT_EQ(dhcp_ddns::ST_COMPLETED, ncrs[i]->getStatus());
+    }
+}
+
+/// @brief Tests the fallback of a rejected batch to single transactions.
+/// This test verifies that when the server rejects a batch (here with
+/// YXDOMAIN, as if a name were in use), each of its requests is given its
+/// own transaction, which then carries out the RFC 4703 logic on its own.
+TEST_F(D2UpdateMgrTest, batchFallback) {
+    std::vector<NameChangeRequestPtr> ncrs = makeBatchNcrs(3);
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        ASSERT_NO_THROW(queue_mgr_->enqueue(ncrs[i]));
+    }
+
+    asiolink::IOAddress server_ip("127.0.0.1");
+    FauxServer server(*io_service_, server_ip, 5301);
+    server.receive(FauxServer::USE_RCODE, dns::Rcode::YXDOMAIN());
+
+    // Make and start the batch.
+    ASSERT_NO_THROW(update_mgr_->pickNextJob());
+    TransactionList::iterator pos = update_mgr_->transactionListBegin();
+    ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+    NameAddBatchTransactionPtr batch =
+        boost::dynamic_pointer_cast<NameAddBatchTransaction>((*pos).second);
+    ASSERT_TRUE(batch);
+
+    // Run IO until the server has rejected the batch.
+    for (int passes = 0; !batch->isModelDone() && passes < 10; ++passes) {
+        ASSERT_TRUE(runTimedIO(NameChangeTransaction::
+                               DNS_UPDATE_DEFAULT_TIMEOUT + 100));
+    }
+
+    ASSERT_TRUE(batch->isModelDone());
+    EXPECT_TRUE(batch->needsFallback());
+
+    // Cleaning up the batch should replace it with single transactions.
+    ASSERT_NO_THROW(update_mgr_->checkFinishedTransactions());
+    EXPECT_EQ(3, update_mgr_->getTransactionCount());
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        pos = update_mgr_->findTransaction(ncrs[i]->getDhcid());
+        ASSERT_TRUE(pos != update_mgr_->transactionListEnd());
+        EXPECT_TRUE(boost::dynamic_pointer_cast<NameAddTransaction>
+                    ((*pos).second));
+    }
+
+    // As the server keeps answering YXDOMAIN, the replacements fail too.
+    processAll();
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        EXPECT_EQ(dhcp_ddns::ST_FAILED, ncrs[i]->getStatus());
+    }
+}
+
 }
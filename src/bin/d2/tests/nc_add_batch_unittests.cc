@@ -0,0 +1,423 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <d2/nc_add_batch.h>
+#include <nc_test_utils.h>
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace std;
+using namespace bundy;
+using namespace bundy::d2;
+
+namespace {
+
+/// @brief Test class derived from NameAddBatchTransaction to provide
+/// visibility to protected methods.
+class NameAddBatchStub : public NameAddBatchTransaction {
+public:
+    NameAddBatchStub(IOServicePtr& io_service,
+                     dhcp_ddns::NameChangeRequestList& ncrs,
+                     DdnsDomainPtr& forward_domain,
+                     DdnsDomainPtr& reverse_domain)
+        : NameAddBatchTransaction(io_service, ncrs, forward_domain,
+                                  reverse_domain) {
+    }
+
+    virtual ~NameAddBatchStub() {
+    }
+
+    /// @brief Simulates sending update requests to the DNS server
+    ///
+    /// Increments the update attempt count and posts a next event of
+    /// NOP_EVT, without actually sending anything.
+    ///
+    /// @param comment Parameter is unused, but present in base class method.
+    /// @param use_tsig_ Parameter is unused, but present in base class method.
+    virtual void sendUpdate(const std::string& /*comment*/,
+                            bool /* use_tsig_ = false */) {
+        setUpdateAttempts(getUpdateAttempts() + 1);
+        postNextEvent(StateModel::NOP_EVT);
+    }
+
+    /// @brief Simulates receiving a response
+    ///
+    /// Sets the DNS update status and a response with the given rcode, then
+    /// posts a next event of IO_COMPLETED_EVT.
+    ///
+    /// @param status simulated DNSClient status
+    /// @param rcode  simulated server response code
+    void fakeResponse(const DNSClient::Status& status,
+                      const dns::Rcode& rcode) {
+        setDnsUpdateStatus(status);
+        D2UpdateMessagePtr msg(new D2UpdateMessage(D2UpdateMessage::OUTBOUND));
+        msg->setRcode(rcode);
+        setDnsUpdateResponse(msg);
+        postNextEvent(NameChangeTransaction::IO_COMPLETED_EVT);
+    }
+
+    /// @brief Selects the first server of the given domain.
+    ///
+    /// Handlers which send require a server to have been selected.
+    bool selectServer(const DdnsDomainPtr& domain) {
+        initServerSelection(domain);
+        selectNextServer();
+        return (getCurrentServer());
+    }
+
+    using StateModel::postNextEvent;
+    using StateModel::setState;
+    using StateModel::initDictionaries;
+    using NameAddBatchTransaction::defineEvents;
+    using NameAddBatchTransaction::verifyEvents;
+    using NameAddBatchTransaction::defineStates;
+    using NameAddBatchTransaction::verifyStates;
+    using NameAddBatchTransaction::readyHandler;
+    using NameAddBatchTransaction::addingFwdAddrsHandler;
+    using NameAddBatchTransaction::replacingRevPtrsHandler;
+    using NameAddBatchTransaction::processAddOkHandler;
+    using NameAddBatchTransaction::processAddFailedHandler;
+    using NameAddBatchTransaction::buildAddFwdAddressRequest;
+    using NameAddBatchTransaction::buildReplaceRevPtrsRequest;
+    using NameAddBatchTransaction::getDnsUpdateRequest;
+};
+
+typedef boost::shared_ptr<NameAddBatchStub> NameAddBatchStubPtr;
+
+/// @brief Test fixture for testing NameAddBatchTransaction
+class NameAddBatchTransactionTest : public TransactionTest {
+public:
+    dhcp_ddns::NameChangeRequestList ncrs_;
+
+    NameAddBatchTransactionTest() {
+    }
+
+    virtual ~NameAddBatchTransactionTest() {
+    }
+
+    /// @brief Creates the list of requests for a batch.
+    ///
+    /// The first request is the canned IPv4 request of TransactionTest, the
+    /// others are copies of it with their own FQDN, address and DHCID.
+    ///
+    /// @param change_mask determines which change directions are requested
+    /// @param count number of requests to create (at most ten)
+    void makeNcrs(int change_mask, size_t count) {
+        setupForIPv4Transaction(dhcp_ddns::CHG_ADD, change_mask);
+        ncrs_.clear();
+        ncrs_.push_back(ncr_);
+        for (size_t i = 1; i < count; ++i) {
+            dhcp_ddns::NameChangeRequestPtr
+                ncr(new dhcp_ddns::NameChangeRequest(*ncr_));
+            std::ostringstream fqdn;
+            fqdn << "host" << i << ".forward.example.com.";
+            ncr->setFqdn(fqdn.str());
+            std::ostringstream address;
+            address << "192.168.2." << (i + 1);
+            ncr->setIpAddress(address.str());
+            std::ostringstream dhcid;
+            dhcid << "010203040506070" << i;
+            ncr->setDhcid(dhcid.str());
+            ncrs_.push_back(ncr);
+        }
+    }
+
+    /// @brief Creates a batch transaction for a list of IPv4 requests.
+    ///
+    /// @param change_mask determines which change directions are requested
+    /// @param count number of requests in the batch
+    NameAddBatchStubPtr makeBatch(int change_mask = FWD_AND_REV_CHG,
+                                  size_t count = 3) {
+        makeNcrs(change_mask, count);
+        return (NameAddBatchStubPtr(new NameAddBatchStub(io_service_, ncrs_,
+                                                         forward_domain_,
+                                                         reverse_domain_)));
+    }
+
+    /// @brief Creates a batch at a known point in its state model.
+    ///
+    /// @param state value to set as the current state
+    /// @param event value to post as the next event
+    /// @param change_mask determines which change directions are requested
+    NameAddBatchStubPtr prepHandlerTest(unsigned int state, unsigned int event,
+                                        unsigned int change_mask =
+                                        FWD_AND_REV_CHG) {
+        NameAddBatchStubPtr batch = makeBatch(change_mask);
+        batch->initDictionaries();
+        batch->postNextEvent(event);
+        batch->setState(state);
+        return (batch);
+    }
+};
+
+/// @brief Tests NameAddBatchTransaction construction.
+/// This test verifies that:
+/// 1. An empty list of requests is not allowed
+/// 2. Requests other than CHG_ADD are not allowed
+/// 3. Requests for differing update directions are not allowed
+/// 4. Requests sharing an FQDN, lease address or DHCID are not allowed
+/// 5. Valid construction functions properly
+TEST_F(NameAddBatchTransactionTest, construction) {
+    dhcp_ddns::NameChangeRequestList empty;
+    setupForIPv4Transaction(dhcp_ddns::CHG_ADD, FWD_AND_REV_CHG);
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, empty, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    ncrs_[2]->setChangeType(dhcp_ddns::CHG_REMOVE);
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, ncrs_, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    ncrs_[1]->setReverseChange(false);
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, ncrs_, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    ncrs_[2]->setFqdn(ncrs_[0]->getFqdn());
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, ncrs_, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    ncrs_[2]->setIpAddress(ncrs_[1]->getIpAddress());
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, ncrs_, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    ncrs_[1]->setDhcid(ncrs_[0]->getDhcid().toStr());
+    EXPECT_THROW(NameAddBatchTransaction(io_service_, ncrs_, forward_domain_,
+                                         reverse_domain_),
+                 NameAddBatchTransactionError);
+
+    makeNcrs(FWD_AND_REV_CHG, 3);
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch.reset(new NameAddBatchStub(io_service_, ncrs_,
+                                                     forward_domain_,
+                                                     reverse_domain_)));
+    EXPECT_EQ(3, batch->getBatchSize());
+    EXPECT_EQ(ncrs_[0], batch->getNcr());
+    EXPECT_FALSE(batch->needsFallback());
+}
+
+/// @brief Tests event and state dictionary construction and verification.
+TEST_F(NameAddBatchTransactionTest, dictionaryCheck) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch = makeBatch());
+
+    // Verify that the event and state dictionary validation fails prior
+    // dictionary construction.
+    ASSERT_THROW(batch->verifyEvents(), StateModelError);
+    ASSERT_THROW(batch->verifyStates(), StateModelError);
+
+    // Construct both dictionaries.
+    ASSERT_NO_THROW(batch->defineEvents());
+    ASSERT_NO_THROW(batch->defineStates());
+
+    // Verify both event and state dictionaries.
+    ASSERT_NO_THROW(batch->verifyEvents());
+    ASSERT_NO_THROW(batch->verifyStates());
+}
+
+/// @brief Tests construction of a batched forward add request.
+/// The request must hold the prerequisite and updates of every request.
+TEST_F(NameAddBatchTransactionTest, buildForwardAdd) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch = makeBatch(FWD_AND_REV_CHG, 3));
+    ASSERT_NO_THROW(batch->buildAddFwdAddressRequest());
+
+    const D2UpdateMessagePtr& request = batch->getDnsUpdateRequest();
+    ASSERT_TRUE(request);
+    checkZone(request, forward_domain_->getName());
+
+    // One "FQDN is not in use" prerequisite per request.
+    checkRRCount(request, D2UpdateMessage::SECTION_PREREQUISITE, 3);
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        dns::RRsetPtr rrset;
+        ASSERT_TRUE(rrset = getRRFromSection(request, D2UpdateMessage::
+                                             SECTION_PREREQUISITE, i));
+        checkRR(rrset, ncrs_[i]->getFqdn(), dns::RRClass::NONE(),
+                dns::RRType::ANY(), 0, ncrs_[i]);
+    }
+
+    // An address and a DHCID addition per request.
+    checkRRCount(request, D2UpdateMessage::SECTION_UPDATE, 6);
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        dns::RRsetPtr rrset;
+        ASSERT_TRUE(rrset = getRRFromSection(request, D2UpdateMessage::
+                                             SECTION_UPDATE, i * 2));
+        checkRR(rrset, ncrs_[i]->getFqdn(), dns::RRClass::IN(),
+                dns::RRType::A(), ncrs_[i]->getLeaseLength(), ncrs_[i]);
+    }
+}
+
+/// @brief Tests construction of a batched reverse replacement request.
+TEST_F(NameAddBatchTransactionTest, buildReplaceRevPtrsRequest) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch = makeBatch(REVERSE_CHG, 4));
+    ASSERT_NO_THROW(batch->buildReplaceRevPtrsRequest());
+
+    const D2UpdateMessagePtr& request = batch->getDnsUpdateRequest();
+    ASSERT_TRUE(request);
+    checkZone(request, reverse_domain_->getName());
+
+    // There are no prerequisites, and two deletes and two adds per request.
+    checkRRCount(request, D2UpdateMessage::SECTION_PREREQUISITE, 0);
+    checkRRCount(request, D2UpdateMessage::SECTION_UPDATE, 16);
+}
+
+/// @brief Tests readyHandler marks every request pending and selects the
+/// first direction to update.
+TEST_F(NameAddBatchTransactionTest, readyHandler) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch = prepHandlerTest(NameChangeTransaction::READY_ST,
+                                            StateModel::START_EVT));
+    EXPECT_NO_THROW(batch->readyHandler());
+    EXPECT_EQ(NameChangeTransaction::SELECTING_FWD_SERVER_ST,
+              batch->getCurrState());
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        EXPECT_EQ(dhcp_ddns::ST_PENDING, ncrs_[i]->getStatus());
+    }
+
+    ASSERT_NO_THROW(batch = prepHandlerTest(NameChangeTransaction::READY_ST,
+                                            StateModel::START_EVT,
+                                            REVERSE_CHG));
+    EXPECT_NO_THROW(batch->readyHandler());
+    EXPECT_EQ(NameChangeTransaction::SELECTING_REV_SERVER_ST,
+              batch->getCurrState());
+}
+
+/// @brief Tests addingFwdAddrsHandler when the server accepts the batch.
+/// The batch should move on to the reverse updates.
+TEST_F(NameAddBatchTransactionTest, addingFwdAddrsHandler_AddOK) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch =
+                    prepHandlerTest(NameAddBatchTransaction::ADDING_FWD_ADDRS_ST,
+                                    NameChangeTransaction::
+                                    SERVER_SELECTED_EVT));
+    ASSERT_TRUE(batch->selectServer(forward_domain_));
+
+    // Run the handler to construct and "send" the request.
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+    ASSERT_TRUE(batch->getDnsUpdateRequest());
+    EXPECT_EQ(NameChangeTransaction::NOP_EVT, batch->getNextEvent());
+
+    // Simulate a successful response and run the handler again.
+    batch->fakeResponse(DNSClient::SUCCESS, dns::Rcode::NOERROR());
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+
+    EXPECT_TRUE(batch->getForwardChangeCompleted());
+    EXPECT_FALSE(batch->getReverseChangeCompleted());
+    EXPECT_EQ(NameChangeTransaction::SELECTING_REV_SERVER_ST,
+              batch->getCurrState());
+    EXPECT_EQ(NameChangeTransaction::SELECT_SERVER_EVT,
+              batch->getNextEvent());
+}
+
+/// @brief Tests addingFwdAddrsHandler when one of the FQDNs is in use.
+/// Unlike a single transaction, the batch does not attempt a replacement,
+/// it fails and flags its requests for individual processing.
+TEST_F(NameAddBatchTransactionTest, addingFwdAddrsHandler_FqdnInUse) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch =
+                    prepHandlerTest(NameAddBatchTransaction::ADDING_FWD_ADDRS_ST,
+                                    NameChangeTransaction::
+                                    SERVER_SELECTED_EVT));
+    ASSERT_TRUE(batch->selectServer(forward_domain_));
+
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+    batch->fakeResponse(DNSClient::SUCCESS, dns::Rcode::YXDOMAIN());
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+
+    EXPECT_FALSE(batch->getForwardChangeCompleted());
+    EXPECT_EQ(NameChangeTransaction::PROCESS_TRANS_FAILED_ST,
+              batch->getCurrState());
+    EXPECT_EQ(NameChangeTransaction::UPDATE_FAILED_EVT,
+              batch->getNextEvent());
+
+    // Concluding the batch flags it for fallback and leaves the requests
+    // to be settled by their own transactions.
+    EXPECT_NO_THROW(batch->processAddFailedHandler());
+    EXPECT_TRUE(batch->isModelDone());
+    EXPECT_TRUE(batch->needsFallback());
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        EXPECT_NE(dhcp_ddns::ST_FAILED, ncrs_[i]->getStatus());
+        EXPECT_NE(dhcp_ddns::ST_COMPLETED, ncrs_[i]->getStatus());
+    }
+}
+
+/// @brief Tests addingFwdAddrsHandler retries the same server upon a
+/// timeout.
+TEST_F(NameAddBatchTransactionTest, addingFwdAddrsHandler_Timeout) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch =
+                    prepHandlerTest(NameAddBatchTransaction::ADDING_FWD_ADDRS_ST,
+                                    NameChangeTransaction::
+                                    SERVER_SELECTED_EVT));
+    ASSERT_TRUE(batch->selectServer(forward_domain_));
+
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+    batch->fakeResponse(DNSClient::TIMEOUT, dns::Rcode::NOERROR());
+    EXPECT_NO_THROW(batch->addingFwdAddrsHandler());
+
+    EXPECT_EQ(NameAddBatchTransaction::ADDING_FWD_ADDRS_ST,
+              batch->getCurrState());
+    EXPECT_EQ(NameChangeTransaction::SERVER_SELECTED_EVT,
+              batch->getNextEvent());
+    EXPECT_FALSE(batch->needsFallback());
+}
+
+/// @brief Tests replacingRevPtrsHandler when the server accepts the batch.
+TEST_F(NameAddBatchTransactionTest, replacingRevPtrsHandler_ReplaceOK) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch =
+                    prepHandlerTest(NameAddBatchTransaction::
+                                    REPLACING_REV_PTRS_ST,
+                                    NameChangeTransaction::
+                                    SERVER_SELECTED_EVT, REVERSE_CHG));
+    ASSERT_TRUE(batch->selectServer(reverse_domain_));
+
+    EXPECT_NO_THROW(batch->replacingRevPtrsHandler());
+    batch->fakeResponse(DNSClient::SUCCESS, dns::Rcode::NOERROR());
+    EXPECT_NO_THROW(batch->replacingRevPtrsHandler());
+
+    EXPECT_TRUE(batch->getReverseChangeCompleted());
+    EXPECT_EQ(NameChangeTransaction::PROCESS_TRANS_OK_ST,
+              batch->getCurrState());
+    EXPECT_EQ(NameChangeTransaction::UPDATE_OK_EVT,
+              batch->getNextEvent());
+}
+
+/// @brief Tests processAddOkHandler completes every request of the batch.
+TEST_F(NameAddBatchTransactionTest, processAddOkHandler) {
+    NameAddBatchStubPtr batch;
+    ASSERT_NO_THROW(batch =
+                    prepHandlerTest(NameChangeTransaction::PROCESS_TRANS_OK_ST,
+                                    NameChangeTransaction::UPDATE_OK_EVT));
+    EXPECT_NO_THROW(batch->processAddOkHandler());
+
+    EXPECT_TRUE(batch->isModelDone());
+    EXPECT_FALSE(batch->needsFallback());
+    for (size_t i = 0; i < ncrs_.size(); ++i) {
+        EXPECT_EQ(dhcp_ddns::ST_COMPLETED, ncrs_[i]->getStatus());
+    }
+}
+
+}
@@ -104,6 +104,10 @@ ControlledDhcpv4Srv::dhcp4ConfigHandler(ConstElementPtr new_config) {
             .arg(full_config->str());
     }
 
+    // The workers must not process packets while the configuration is
+    // being changed.
+    server_->waitForWorkers();
+
     // Configure the server.
     ConstElementPtr answer = configureDhcp4Server(*server_, merged_config);
 
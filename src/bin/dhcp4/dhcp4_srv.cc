@@ -39,7 +39,9 @@
 #include <util/strutil.h>
 
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 
 #include <iomanip>
 
@@ -49,6 +51,7 @@ using namespace bundy::dhcp;
 using namespace bundy::dhcp_ddns;
 using namespace bundy::hooks;
 using namespace bundy::log;
+using namespace bundy::util::thread;
 using namespace std;
 
 /// Structure that holds registered hook indexes
@@ -85,7 +88,9 @@ const std::string Dhcpv4Srv::VENDOR_CLASS_PREFIX("VENDOR_CLASS_");
 Dhcpv4Srv::Dhcpv4Srv(uint16_t port, const char* dbconfig, const bool use_bcast,
                      const bool direct_response_desired)
 : shutdown_(true), alloc_engine_(), port_(port),
-    use_bcast_(use_bcast), hook_index_pkt4_receive_(-1),
+    use_bcast_(use_bcast), batch_start_(), batch_delay_(0),
+    pending_responses_(), client_mutexes_(new Mutex[CLIENT_MUTEXES]),
+    use_workers_(false), hook_index_pkt4_receive_(-1),
     hook_index_subnet4_select_(-1), hook_index_pkt4_send_(-1) {
 
     LOG_DEBUG(dhcp4_logger, DBG_DHCP4_START, DHCP4_OPEN_SOCKET).arg(port);
@@ -139,6 +144,8 @@ Dhcpv4Srv::Dhcpv4Srv(uint16_t port, const char* dbconfig, const bool use_bcast,
 }
 
 Dhcpv4Srv::~Dhcpv4Srv() {
+    // Stop the workers before anything they may use is destroyed.
+    worker_pool_.reset();
     IfaceMgr::instance().closeSockets();
 }
 
@@ -150,7 +157,23 @@ Dhcpv4Srv::shutdown() {
 
 Pkt4Ptr
 Dhcpv4Srv::receivePacket(int timeout) {
-    return (IfaceMgr::instance().receive4(timeout));
+    if (received_.empty()) {
+        std::vector<Pkt4Ptr> pkts;
+        IfaceMgr::instance().receiveBatch4(
+            pkts, timeout, 0,
+            boost::bind(&Dhcpv4Srv::ifaceMgrReceive4ErrorHandler, _1));
+        for (std::vector<Pkt4Ptr>::const_iterator pkt = pkts.begin();
+             pkt != pkts.end(); ++pkt) {
+            received_.push(*pkt);
+        }
+        if (received_.empty()) {
+            // Timeout, signal or data on the external socket.
+            return (Pkt4Ptr());
+        }
+    }
+    Pkt4Ptr pkt = received_.front();
+    received_.pop();
+    return (pkt);
 }
 
 void
@@ -158,16 +181,124 @@ Dhcpv4Srv::sendPacket(const Pkt4Ptr& packet) {
     IfaceMgr::instance().send(packet);
 }
 
+void
+Dhcpv4Srv::setWorkerThreads(const size_t threads) {
+    // Let the current workers finish before they are replaced.
+    worker_pool_.reset();
+    use_workers_ = false;
+    if (threads > 0) {
+        // The definitions of the standard options are created when they
+        // are first used. Make sure it doesn't happen in the workers.
+        LibDHCP::getOptionDefs(Option::V4);
+        worker_pool_.reset(new ThreadPool(threads));
+    }
+    LOG_INFO(dhcp4_logger, DHCP4_WORKER_THREADS).arg(threads);
+}
+
+void
+Dhcpv4Srv::waitForWorkers() {
+    if (worker_pool_) {
+        worker_pool_->wait();
+    }
+}
+
+Mutex&
+Dhcpv4Srv::getClientMutex(const Pkt4Ptr& query) {
+    OptionPtr client_id = query->getOption(DHO_DHCP_CLIENT_IDENTIFIER);
+    size_t hash = 0;
+    if (client_id) {
+        const OptionBuffer& data = client_id->getData();
+        hash = boost::hash_range(data.begin(), data.end());
+    } else if (query->getHWAddr()) {
+        const std::vector<uint8_t>& hwaddr = query->getHWAddr()->hwaddr_;
+        hash = boost::hash_range(hwaddr.begin(), hwaddr.end());
+    }
+    return (client_mutexes_[hash % CLIENT_MUTEXES]);
+}
+
+void
+Dhcpv4Srv::beginCommitBatch() {
+    Mutex::Locker lock(response_mutex_);
+    if (!batch_start_.is_not_a_date_time()) {
+        return;
+    }
+    batch_delay_ = LeaseMgrFactory::instance().getMaxCommitDelay();
+    if (batch_delay_ > 0) {
+        batch_start_ = boost::posix_time::microsec_clock::universal_time();
+    }
+}
+
+void
+Dhcpv4Srv::queueResponse(const Pkt4Ptr& rsp) {
+    // The responses are sent with the mutex held, because the interface
+    // manager doesn't expect to be used by many threads.
+    Mutex::Locker lock(response_mutex_);
+    if (!batch_start_.is_not_a_date_time()) {
+        pending_responses_.push_back(rsp);
+    } else {
+        sendPacket(rsp);
+    }
+}
+
+bool
+Dhcpv4Srv::batchExpired() const {
+    Mutex::Locker lock(response_mutex_);
+    return (!batch_start_.is_not_a_date_time() &&
+            (boost::posix_time::microsec_clock::universal_time() - batch_start_
+             >= boost::posix_time::milliseconds(batch_delay_)));
+}
+
+void
+Dhcpv4Srv::commitBatch() {
+    std::vector<Pkt4Ptr> responses;
+    {
+        Mutex::Locker lock(response_mutex_);
+        if (batch_start_.is_not_a_date_time()) {
+            return;
+        }
+        batch_start_ = boost::posix_time::ptime();
+        responses.swap(pending_responses_);
+    }
+
+    try {
+        LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL, DHCP4_LEASE_COMMIT)
+            .arg(responses.size());
+        LeaseMgrFactory::instance().commit();
+    } catch (const std::exception& e) {
+        LOG_ERROR(dhcp4_logger, DHCP4_LEASE_COMMIT_FAIL)
+            .arg(responses.size()).arg(e.what());
+        return;
+    }
+
+    for (std::vector<Pkt4Ptr>::const_iterator rsp = responses.begin();
+         rsp != responses.end(); ++rsp) {
+        try {
+            sendPacket(*rsp);
+        } catch (const std::exception& e) {
+            LOG_ERROR(dhcp4_logger, DHCP4_PACKET_SEND_FAIL)
+                .arg(e.what());
+        }
+    }
+}
+
 bool
 Dhcpv4Srv::run() {
     while (!shutdown_) {
+        // Commit the current batch if it has been collected for the maximum
+        // time, so as the clients don't wait too long for the responses.
+        if (batchExpired()) {
+            waitForWorkers();
+            commitBatch();
+        }
+
+        // If the responses are held until the batch is committed, only pick
+        // packets which are already waiting to be read.
         /// @todo: calculate actual timeout once we have lease database
         //cppcheck-suppress variableScope This is temporary anyway
-        const int timeout = 1000;
+        const int timeout = (batchInProgress() ? 0 : 1000);
 
-        // client's message and server's response
+        // client's message
         Pkt4Ptr query;
-        Pkt4Ptr rsp;
 
         try {
             query = receivePacket(timeout);
@@ -176,71 +307,123 @@ Dhcpv4Srv::run() {
         }
 
         // Timeout may be reached or signal received, which breaks select()
-        // with no reception ocurred
+        // with no reception ocurred. There are no more packets in this
+        // burst, so commit the leases and send the held responses.
         if (!query) {
+            waitForWorkers();
+            commitBatch();
             continue;
         }
 
-        // In order to parse the DHCP options, the server needs to use some
-        // configuration information such as: existing option spaces, option
-        // definitions etc. This is the kind of information which is not
-        // available in the libdhcp, so we need to supply our own implementation
-        // of the option parsing function here, which would rely on the
-        // configuration data.
-        query->setCallback(boost::bind(&Dhcpv4Srv::unpackOptions, this,
-                                       _1, _2, _3));
+        // The workers are used if enabled and nothing prevents the packets
+        // from being processed concurrently. The decision may only change
+        // when the workers are idle, i.e. after the configuration has
+        // changed.
+        const bool use_workers = worker_pool_ &&
+            LeaseMgrFactory::instance().isThreadSafe() &&
+            HooksManager::getLibraryNames().empty();
+        if (use_workers != use_workers_) {
+            waitForWorkers();
+            use_workers_ = use_workers;
+            if (use_workers_) {
+                LOG_INFO(dhcp4_logger, DHCP4_WORKERS_ENABLED)
+                    .arg(worker_pool_->size());
+            } else {
+                LOG_INFO(dhcp4_logger, DHCP4_WORKERS_DISABLED);
+            }
+        }
 
-        bool skip_unpack = false;
+        // The batch is started here rather than by the worker, so as the
+        // next receive only picks the packets which are already waiting
+        // while the response to this one is held.
+        beginCommitBatch();
 
-        // The packet has just been received so contains the uninterpreted wire
-        // data; execute callouts registered for buffer4_receive.
-        if (HooksManager::calloutsPresent(Hooks.hook_index_buffer4_receive_)) {
-            CalloutHandlePtr callout_handle = getCalloutHandle(query);
+        if (use_workers_) {
+            worker_pool_->add(boost::bind(&Dhcpv4Srv::processPacket, this,
+                                          query));
+        } else {
+            processPacket(query);
+        }
+    }
 
-            // Delete previously set arguments
-            callout_handle->deleteAllArguments();
+    // Don't leave the responses behind when shutting down.
+    waitForWorkers();
+    commitBatch();
 
-            // Pass incoming packet as argument
-            callout_handle->setArgument("query4", query);
+    return (true);
+}
 
-            // Call callouts
-            HooksManager::callCallouts(Hooks.hook_index_buffer4_receive_,
-                                       *callout_handle);
+void
+Dhcpv4Srv::processPacket(Pkt4Ptr query) {
+    // server's response
+    Pkt4Ptr rsp;
+
+    // In order to parse the DHCP options, the server needs to use some
+    // configuration information such as: existing option spaces, option
+    // definitions etc. This is the kind of information which is not
+    // available in the libdhcp, so we need to supply our own implementation
+    // of the option parsing function here, which would rely on the
+    // configuration data.
+    query->setCallback(boost::bind(&Dhcpv4Srv::unpackOptions, this,
+                                   _1, _2, _3));
+
+    bool skip_unpack = false;
+
+    // The packet has just been received so contains the uninterpreted wire
+    // data; execute callouts registered for buffer4_receive.
+    if (HooksManager::calloutsPresent(Hooks.hook_index_buffer4_receive_)) {
+        CalloutHandlePtr callout_handle = getCalloutHandle(query);
+
+        // Delete previously set arguments
+        callout_handle->deleteAllArguments();
 
-            // Callouts decided to skip the next processing step. The next
-            // processing step would to parse the packet, so skip at this
-            // stage means that callouts did the parsing already, so server
-            // should skip parsing.
-            if (callout_handle->getSkip()) {
-                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_BUFFER_RCVD_SKIP);
-                skip_unpack = true;
-            }
+        // Pass incoming packet as argument
+        callout_handle->setArgument("query4", query);
+
+        // Call callouts
+        HooksManager::callCallouts(Hooks.hook_index_buffer4_receive_,
+                                   *callout_handle);
 
-            callout_handle->getArgument("query4", query);
+        // Callouts decided to skip the next processing step. The next
+        // processing step would to parse the packet, so skip at this
+        // stage means that callouts did the parsing already, so server
+        // should skip parsing.
+        if (callout_handle->getSkip()) {
+            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_BUFFER_RCVD_SKIP);
+            skip_unpack = true;
         }
 
-        // Unpack the packet information unless the buffer4_receive callouts
-        // indicated they did it
-        if (!skip_unpack) {
-            try {
-                query->unpack();
-            } catch (const std::exception& e) {
-                // Failed to parse the packet.
-                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL,
-                          DHCP4_PACKET_PARSE_FAIL).arg(e.what());
-                continue;
-            }
+        callout_handle->getArgument("query4", query);
+    }
+
+    // Unpack the packet information unless the buffer4_receive callouts
+    // indicated they did it. The options are unpacked when they are used,
+    // so as the options the server doesn't use are not unpacked at all.
+    if (!skip_unpack) {
+        try {
+            query->setLazyUnpack(true);
+            query->unpack();
+        } catch (const std::exception& e) {
+            // Failed to parse the packet.
+            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL,
+                      DHCP4_PACKET_PARSE_FAIL).arg(e.what());
+            return;
         }
+    }
 
+    // The malformed options are found when they are unpacked, i.e. when
+    // they are first used, so the parsing errors may be reported below.
+    try {
         // Assign this packet to one or more classes if needed. We need to do
         // this before calling accept(), because getSubnet4() may need client
         // class information.
         classifyPacket(query);
 
-        // Check whether the message should be further processed or discarded.
-        // There is no need to log anything here. This function logs by itself.
+        // Check whether the message should be further processed or
+        // discarded. There is no need to log anything here. This function
+        // logs by itself.
         if (!accept(query)) {
-            continue;
+            return;
         }
 
         // We have sanity checked (in accept() that the Message Type option
@@ -253,180 +436,192 @@ Dhcpv4Srv::run() {
         LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL_DATA, DHCP4_QUERY_DATA)
             .arg(type)
             .arg(query->toText());
+    } catch (const std::exception& e) {
+        // Failed to parse the packet.
+        LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL,
+                  DHCP4_PACKET_PARSE_FAIL).arg(e.what());
+        return;
+    }
 
-        // Let's execute all callouts registered for pkt4_receive
-        if (HooksManager::calloutsPresent(hook_index_pkt4_receive_)) {
-            CalloutHandlePtr callout_handle = getCalloutHandle(query);
-
-            // Delete previously set arguments
-            callout_handle->deleteAllArguments();
+    // Let's execute all callouts registered for pkt4_receive
+    if (HooksManager::calloutsPresent(hook_index_pkt4_receive_)) {
+        CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-            // Pass incoming packet as argument
-            callout_handle->setArgument("query4", query);
+        // Delete previously set arguments
+        callout_handle->deleteAllArguments();
 
-            // Call callouts
-            HooksManager::callCallouts(hook_index_pkt4_receive_,
-                                       *callout_handle);
+        // Pass incoming packet as argument
+        callout_handle->setArgument("query4", query);
 
-            // Callouts decided to skip the next processing step. The next
-            // processing step would to process the packet, so skip at this
-            // stage means drop.
-            if (callout_handle->getSkip()) {
-                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_PACKET_RCVD_SKIP);
-                continue;
-            }
+        // Call callouts
+        HooksManager::callCallouts(hook_index_pkt4_receive_,
+                                   *callout_handle);
 
-            callout_handle->getArgument("query4", query);
+        // Callouts decided to skip the next processing step. The next
+        // processing step would to process the packet, so skip at this
+        // stage means drop.
+        if (callout_handle->getSkip()) {
+            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_PACKET_RCVD_SKIP);
+            return;
         }
 
-        try {
-            switch (query->getType()) {
-            case DHCPDISCOVER:
-                rsp = processDiscover(query);
-                break;
-
-            case DHCPREQUEST:
-                // Note that REQUEST is used for many things in DHCPv4: for
-                // requesting new leases, renewing existing ones and even
-                // for rebinding.
-                rsp = processRequest(query);
-                break;
-
-            case DHCPRELEASE:
-                processRelease(query);
-                break;
-
-            case DHCPDECLINE:
-                processDecline(query);
-                break;
-
-            case DHCPINFORM:
-                processInform(query);
-                break;
-
-            default:
-                // Only action is to output a message if debug is enabled,
-                // and that is covered by the debug statement before the
-                // "switch" statement.
-                ;
-            }
-        } catch (const bundy::Exception& e) {
-
-            // Catch-all exception (at least for ones based on the isc
-            // Exception class, which covers more or less all that
-            // are explicitly raised in the BUNDY code).  Just log
-            // the problem and ignore the packet. (The problem is logged
-            // as a debug message because debug is disabled by default -
-            // it prevents a DDOS attack based on the sending of problem
-            // packets.)
-            if (dhcp4_logger.isDebugEnabled(DBG_DHCP4_BASIC)) {
-                std::string source = "unknown";
-                HWAddrPtr hwptr = query->getHWAddr();
-                if (hwptr) {
-                    source = hwptr->toText();
-                }
-                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_BASIC,
-                          DHCP4_PACKET_PROCESS_FAIL)
-                    .arg(source).arg(e.what());
+        callout_handle->getArgument("query4", query);
+    }
+
+    // The workers may be processing another packet from the same client,
+    // e.g. a retransmission. Don't let them allocate two leases for it.
+    Mutex::Locker client_lock(getClientMutex(query));
+
+    // The leases updated while processing this packet will be committed
+    // together with those updated for the rest of the burst (run() has
+    // normally started the batch already).
+    beginCommitBatch();
+
+    try {
+        switch (query->getType()) {
+        case DHCPDISCOVER:
+            rsp = processDiscover(query);
+            break;
+
+        case DHCPREQUEST:
+            // Note that REQUEST is used for many things in DHCPv4: for
+            // requesting new leases, renewing existing ones and even
+            // for rebinding.
+            rsp = processRequest(query);
+            break;
+
+        case DHCPRELEASE:
+            processRelease(query);
+            break;
+
+        case DHCPDECLINE:
+            processDecline(query);
+            break;
+
+        case DHCPINFORM:
+            processInform(query);
+            break;
+
+        default:
+            // Only action is to output a message if debug is enabled,
+            // and that is covered by the debug statement before the
+            // "switch" statement.
+            ;
+        }
+    } catch (const bundy::Exception& e) {
+
+        // Catch-all exception (at least for ones based on the isc
+        // Exception class, which covers more or less all that
+        // are explicitly raised in the BUNDY code).  Just log
+        // the problem and ignore the packet. (The problem is logged
+        // as a debug message because debug is disabled by default -
+        // it prevents a DDOS attack based on the sending of problem
+        // packets.)
+        if (dhcp4_logger.isDebugEnabled(DBG_DHCP4_BASIC)) {
+            std::string source = "unknown";
+            HWAddrPtr hwptr = query->getHWAddr();
+            if (hwptr) {
+                source = hwptr->toText();
             }
+            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_BASIC,
+                      DHCP4_PACKET_PROCESS_FAIL)
+                .arg(source).arg(e.what());
         }
+    }
 
-        if (!rsp) {
-            continue;
-        }
+    if (!rsp) {
+        return;
+    }
 
-        // Let's do class specific processing. This is done before
-        // pkt4_send.
-        //
-        /// @todo: decide whether we want to add a new hook point for
-        /// doing class specific processing.
-        if (!classSpecificProcessing(query, rsp)) {
-            /// @todo add more verbosity here
-            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_BASIC, DHCP4_CLASS_PROCESSING_FAILED);
+    // Let's do class specific processing. This is done before
+    // pkt4_send.
+    //
+    /// @todo: decide whether we want to add a new hook point for
+    /// doing class specific processing.
+    if (!classSpecificProcessing(query, rsp)) {
+        /// @todo add more verbosity here
+        LOG_DEBUG(dhcp4_logger, DBG_DHCP4_BASIC, DHCP4_CLASS_PROCESSING_FAILED);
 
-            continue;
+        return;
+    }
+
+    // Specifies if server should do the packing
+    bool skip_pack = false;
+
+    // Execute all callouts registered for pkt4_send
+    if (HooksManager::calloutsPresent(hook_index_pkt4_send_)) {
+        CalloutHandlePtr callout_handle = getCalloutHandle(query);
+
+        // Delete all previous arguments
+        callout_handle->deleteAllArguments();
+
+        // Clear skip flag if it was set in previous callouts
+        callout_handle->setSkip(false);
+
+        // Set our response
+        callout_handle->setArgument("response4", rsp);
+
+        // Call all installed callouts
+        HooksManager::callCallouts(hook_index_pkt4_send_,
+                                   *callout_handle);
+
+        // Callouts decided to skip the next processing step. The next
+        // processing step would to send the packet, so skip at this
+        // stage means "drop response".
+        if (callout_handle->getSkip()) {
+            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_PACKET_SEND_SKIP);
+            skip_pack = true;
         }
+    }
 
-        // Specifies if server should do the packing
-        bool skip_pack = false;
+    if (!skip_pack) {
+        try {
+            rsp->pack();
+        } catch (const std::exception& e) {
+            LOG_ERROR(dhcp4_logger, DHCP4_PACKET_SEND_FAIL)
+                .arg(e.what());
+        }
+    }
 
-        // Execute all callouts registered for pkt4_send
-        if (HooksManager::calloutsPresent(hook_index_pkt4_send_)) {
+    try {
+        // Now all fields and options are constructed into output wire buffer.
+        // Option objects modification does not make sense anymore. Hooks
+        // can only manipulate wire buffer at this stage.
+        // Let's execute all callouts registered for buffer4_send
+        if (HooksManager::calloutsPresent(Hooks.hook_index_buffer4_send_)) {
             CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-            // Delete all previous arguments
+            // Delete previously set arguments
             callout_handle->deleteAllArguments();
 
-            // Clear skip flag if it was set in previous callouts
-            callout_handle->setSkip(false);
-
-            // Set our response
+            // Pass incoming packet as argument
             callout_handle->setArgument("response4", rsp);
 
-            // Call all installed callouts
-            HooksManager::callCallouts(hook_index_pkt4_send_,
+            // Call callouts
+            HooksManager::callCallouts(Hooks.hook_index_buffer4_send_,
                                        *callout_handle);
 
             // Callouts decided to skip the next processing step. The next
-            // processing step would to send the packet, so skip at this
-            // stage means "drop response".
+            // processing step would to parse the packet, so skip at this
+            // stage means drop.
             if (callout_handle->getSkip()) {
-                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS, DHCP4_HOOK_PACKET_SEND_SKIP);
-                skip_pack = true;
+                LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS,
+                          DHCP4_HOOK_BUFFER_SEND_SKIP);
+                return;
             }
-        }
 
-        if (!skip_pack) {
-            try {
-                rsp->pack();
-            } catch (const std::exception& e) {
-                LOG_ERROR(dhcp4_logger, DHCP4_PACKET_SEND_FAIL)
-                    .arg(e.what());
-            }
+            callout_handle->getArgument("response4", rsp);
         }
 
-        try {
-            // Now all fields and options are constructed into output wire buffer.
-            // Option objects modification does not make sense anymore. Hooks
-            // can only manipulate wire buffer at this stage.
-            // Let's execute all callouts registered for buffer4_send
-            if (HooksManager::calloutsPresent(Hooks.hook_index_buffer4_send_)) {
-                CalloutHandlePtr callout_handle = getCalloutHandle(query);
-
-                // Delete previously set arguments
-                callout_handle->deleteAllArguments();
-
-                // Pass incoming packet as argument
-                callout_handle->setArgument("response4", rsp);
-
-                // Call callouts
-                HooksManager::callCallouts(Hooks.hook_index_buffer4_send_,
-                                           *callout_handle);
-
-                // Callouts decided to skip the next processing step. The next
-                // processing step would to parse the packet, so skip at this
-                // stage means drop.
-                if (callout_handle->getSkip()) {
-                    LOG_DEBUG(dhcp4_logger, DBG_DHCP4_HOOKS,
-                              DHCP4_HOOK_BUFFER_SEND_SKIP);
-                    continue;
-                }
-
-                callout_handle->getArgument("response4", rsp);
-            }
-
-            LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL_DATA,
-                      DHCP4_RESPONSE_DATA)
-                .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
+        LOG_DEBUG(dhcp4_logger, DBG_DHCP4_DETAIL_DATA,
+                  DHCP4_RESPONSE_DATA)
+            .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
 
-            sendPacket(rsp);
-        } catch (const std::exception& e) {
-            LOG_ERROR(dhcp4_logger, DHCP4_PACKET_SEND_FAIL)
-                .arg(e.what());
-        }
+        queueResponse(rsp);
+    } catch (const std::exception& e) {
+        LOG_ERROR(dhcp4_logger, DHCP4_PACKET_SEND_FAIL)
+            .arg(e.what());
     }
-
-    return (true);
 }
 
 string
@@ -956,7 +1151,12 @@ Dhcpv4Srv::assignLease(const Pkt4Ptr& question, Pkt4Ptr& answer) {
     // allocation.
     bool fake_allocation = (question->getType() == DHCPDISCOVER);
 
-    CalloutHandlePtr callout_handle = getCalloutHandle(question);
+    // The workers can't use the callout handle, which is shared by the
+    // packets. They only process the packets when there are no callouts.
+    CalloutHandlePtr callout_handle;
+    if (!use_workers_) {
+        callout_handle = getCalloutHandle(question);
+    }
 
     std::string hostname;
     bool fqdn_fwd = false;
@@ -1271,6 +1471,11 @@ Dhcpv4Srv::processRelease(Pkt4Ptr& release) {
     }
 
     try {
+        // The lease may be reused for another client by a concurrent
+        // allocation, so it must not change until it is deleted.
+        Mutex::Locker address_lock(alloc_engine_->
+                                   getAddressMutex(release->getCiaddr()));
+
         // Do we have a lease for that particular address?
         Lease4Ptr lease = LeaseMgrFactory::instance().getLease4(release->getCiaddr());
 
@@ -1346,6 +1551,15 @@ Dhcpv4Srv::processRelease(Pkt4Ptr& release) {
                     .arg(client_id ? client_id->toText() : "(no client-id)")
                     .arg(release->getHWAddr()->toText());
 
+                // Let the allocation engine know the address is free again.
+                Subnet4Ptr subnet =
+                    CfgMgr::instance().getSubnet4(lease->addr_,
+                                                  release->classes_);
+                if (subnet) {
+                    AllocEngine::updateAddressBitmap(subnet, lease->addr_,
+                                                     false);
+                }
+
                 if (CfgMgr::instance().ddnsEnabled()) {
                     // Remove existing DNS entries for the lease, if any.
                     queueNameChangeRequest(bundy::dhcp_ddns::CHG_REMOVE, lease);
@@ -1369,7 +1583,10 @@ Dhcpv4Srv::processRelease(Pkt4Ptr& release) {
 
 void
 Dhcpv4Srv::processDecline(Pkt4Ptr& /* decline */) {
-    /// @todo Implement this (also see ticket #3116)
+    /// @todo Implement this (also see ticket #3116). As for releases, the
+    /// address mutex of the allocation engine must be held while the lease
+    /// is handled, and if the lease is removed, the address must be marked
+    /// as free with AllocEngine::updateAddressBitmap.
 }
 
 Pkt4Ptr
@@ -1798,6 +2015,12 @@ Dhcpv4Srv::ifaceMgrSocket4ErrorHandler(const std::string& errmsg) {
     LOG_WARN(dhcp4_logger, DHCP4_OPEN_SOCKET_FAIL).arg(errmsg);
 }
 
+void
+Dhcpv4Srv::ifaceMgrReceive4ErrorHandler(const std::string& errmsg) {
+    // Log the reason for receive failure and return.
+    LOG_ERROR(dhcp4_logger, DHCP4_PACKET_RECEIVE_FAIL).arg(errmsg);
+}
+
 void Dhcpv4Srv::classifyPacket(const Pkt4Ptr& pkt) {
     boost::shared_ptr<OptionString> vendor_class =
         boost::dynamic_pointer_cast<OptionString>(pkt->getOption(DHO_VENDOR_CLASS_IDENTIFIER));
@@ -26,11 +26,17 @@
 #include <dhcpsrv/subnet.h>
 #include <dhcpsrv/alloc_engine.h>
 #include <hooks/callout_handle.h>
+#include <util/threads/sync.h>
+#include <util/threads/thread_pool.h>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <iostream>
 #include <queue>
+#include <vector>
 
 namespace bundy {
 namespace dhcp {
@@ -101,10 +107,47 @@ public:
     /// their correctness, generates appropriate answer (if needed) and
     /// transmits respones.
     ///
+    /// If the lease database commits the leases in groups (see
+    /// @c LeaseMgr::getMaxCommitDelay), the responses are held until the
+    /// server has processed all packets available for reading, or until
+    /// the maximum commit delay elapses. The lease database is then
+    /// committed once for all of them and the responses are sent.
+    ///
+    /// If worker threads have been enabled (see
+    /// @c Dhcpv4Srv::setWorkerThreads), the packets are received by this
+    /// thread and processed by the workers. The workers are waited for
+    /// before the lease database is committed.
+    ///
     /// @return true, if being shut down gracefully, fail if experienced
     ///         critical error.
     bool run();
 
+    /// @brief Sets the number of worker threads processing the packets.
+    ///
+    /// The packets from different clients are processed concurrently by
+    /// the workers, while the packets from the same client are processed
+    /// one at a time. The workers are only used if the lease database
+    /// backend may be used concurrently (see @c LeaseMgr::isThreadSafe)
+    /// and no hooks libraries are loaded, as the callouts aren't required
+    /// to be thread safe. Otherwise, the packets are processed by the
+    /// thread running @c Dhcpv4Srv::run.
+    ///
+    /// @param threads Number of worker threads. If it is 0, the packets
+    /// are processed by the thread running @c Dhcpv4Srv::run.
+    void setWorkerThreads(const size_t threads);
+
+    /// @brief Returns the number of worker threads.
+    size_t getWorkerThreads() const {
+        return (worker_pool_ ? worker_pool_->size() : 0);
+    }
+
+    /// @brief Waits until the workers have processed the packets passed
+    /// to them.
+    ///
+    /// The configuration of the server must not be changed while the
+    /// workers are processing packets.
+    void waitForWorkers();
+
     /// @brief Instructs the server to shut down.
     void shutdown();
 
@@ -636,7 +679,10 @@ protected:
     /// initiate server shutdown procedure.
     volatile bool shutdown_;
 
-    /// @brief dummy wrapper around IfaceMgr::receive4
+    /// @brief dummy wrapper around IfaceMgr::receiveBatch4
+    ///
+    /// All packets ready to be read are received at once and then returned
+    /// one by one, without waiting until they have all been returned.
     ///
     /// This method is useful for testing purposes, where its replacement
     /// simulates reception of a packet. For that purpose it is protected.
@@ -648,6 +694,53 @@ protected:
     /// simulates transmission of a packet. For that purpose it is protected.
     virtual void sendPacket(const Pkt4Ptr& pkt);
 
+    /// @brief Processes the received packet and sends the response.
+    ///
+    /// This method is called by the worker threads or by the thread
+    /// running @c Dhcpv4Srv::run.
+    ///
+    /// @param query Received packet.
+    void processPacket(Pkt4Ptr query);
+
+    /// @brief Returns the mutex to be held while the client's packet is
+    /// processed.
+    ///
+    /// The client is identified by the client identifier or, if the
+    /// packet doesn't carry it, by the hardware address. The clients
+    /// share a fixed number of mutexes.
+    ///
+    /// @param query Packet sent by the client.
+    ///
+    /// @return The mutex for the client.
+    bundy::util::thread::Mutex& getClientMutex(const Pkt4Ptr& query);
+
+    /// @brief Starts a new group commit batch if none is in progress.
+    ///
+    /// The batch is only started if the lease database commits the leases
+    /// in groups.
+    void beginCommitBatch();
+
+    /// @brief Sends the response or holds it until the batch is committed.
+    ///
+    /// @param rsp Server's response.
+    void queueResponse(const Pkt4Ptr& rsp);
+
+    /// @brief Commits the lease database and sends held responses.
+    ///
+    /// If the commit fails, the responses are dropped. This is a no-op
+    /// when no batch is in progress.
+    void commitBatch();
+
+    /// @brief Checks if the group commit batch is in progress.
+    bool batchInProgress() const {
+        bundy::util::thread::Mutex::Locker lock(response_mutex_);
+        return (!batch_start_.is_not_a_date_time());
+    }
+
+    /// @brief Checks if the batch has been collected for the maximum
+    /// commit delay.
+    bool batchExpired() const;
+
     /// @brief Implements a callback function to parse options in the message.
     ///
     /// @param buf a A buffer holding options in on-wire format.
@@ -696,6 +789,16 @@ private:
     /// @param errmsg An error message containing a cause of the failure.
     static void ifaceMgrSocket4ErrorHandler(const std::string& errmsg);
 
+    /// @brief Implements the error handler for packet receive failure.
+    ///
+    /// This callback function is installed on the @c bundy::dhcp::IfaceMgr
+    /// when IPv4 packets are being received. When a socket fails to
+    /// receive, this function is called and the packets received on the
+    /// other sockets are processed. It simply logs the error message.
+    ///
+    /// @param errmsg An error message containing a cause of the failure.
+    static void ifaceMgrReceive4ErrorHandler(const std::string& errmsg);
+
     /// @brief Allocation Engine.
     /// Pointer to the allocation engine that we are currently using
     /// It must be a pointer, because we will support changing engines
@@ -705,6 +808,43 @@ private:
     uint16_t port_;  ///< UDP port number on which server listens.
     bool use_bcast_; ///< Should broadcast be enabled on sockets (if true).
 
+    /// @brief Time when the current group commit batch has been started.
+    ///
+    /// It is set to not_a_date_time when there is no batch in progress.
+    boost::posix_time::ptime batch_start_;
+
+    /// @brief Maximum commit delay of the current batch in milliseconds.
+    uint32_t batch_delay_;
+
+    /// @brief Responses held until the current batch is committed.
+    std::vector<Pkt4Ptr> pending_responses_;
+
+    /// @brief Protects the group commit batch and the sending of the
+    /// responses by the worker threads.
+    mutable bundy::util::thread::Mutex response_mutex_;
+
+    /// @brief Number of mutexes serializing the processing of the packets
+    /// from the same client.
+    static const size_t CLIENT_MUTEXES = 64;
+
+    /// @brief Mutexes serializing the processing of the packets from the
+    /// same client.
+    boost::scoped_array<bundy::util::thread::Mutex> client_mutexes_;
+
+    /// @brief Indicates whether the received packets are passed to the
+    /// workers.
+    ///
+    /// It is only changed while no packets are being processed by the
+    /// workers.
+    bool use_workers_;
+
+    /// @brief Worker threads processing the packets (if enabled).
+    boost::scoped_ptr<bundy::util::thread::ThreadPool> worker_pool_;
+
+    /// @brief Packets received by the last call to
+    /// @c IfaceMgr::receiveBatch4, which haven't been processed yet.
+    std::queue<Pkt4Ptr> received_;
+
     /// Indexes for registered hook points
     int hook_index_pkt4_receive_;
     int hook_index_subnet4_select_;
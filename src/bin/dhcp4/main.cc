@@ -41,11 +41,14 @@ const char* const DHCP4_NAME = "bundy-dhcp4";
 
 void
 usage() {
-    cerr << "Usage: " << DHCP4_NAME << " [-v] [-s] [-p number]" << endl;
+    cerr << "Usage: " << DHCP4_NAME << " [-v] [-s] [-p number] [-t number]"
+         << endl;
     cerr << "  -v: verbose output" << endl;
     cerr << "  -s: stand-alone mode (don't connect to BUNDY)" << endl;
     cerr << "  -p number: specify non-standard port number 1-65535 "
          << "(useful for testing only)" << endl;
+    cerr << "  -t number: specify the number of worker threads processing "
+         << "packets (0 means none)" << endl;
     exit(EXIT_FAILURE);
 }
 } // end of anonymous namespace
@@ -57,8 +60,9 @@ main(int argc, char* argv[]) {
                                          // useful for testing only.
     bool stand_alone = false;  // Should be connect to BUNDY msgq?
     bool verbose_mode = false; // Should server be verbose?
+    int worker_threads = 0;    // Number of threads processing packets.
 
-    while ((ch = getopt(argc, argv, "vsp:")) != -1) {
+    while ((ch = getopt(argc, argv, "vsp:t:")) != -1) {
         switch (ch) {
         case 'v':
             verbose_mode = true;
@@ -83,6 +87,21 @@ main(int argc, char* argv[]) {
             }
             break;
 
+        case 't':
+            try {
+                worker_threads = boost::lexical_cast<int>(optarg);
+            } catch (const boost::bad_lexical_cast &) {
+                cerr << "Failed to parse number of worker threads: ["
+                     << optarg << "], 0-1024 allowed." << endl;
+                usage();
+            }
+            if (worker_threads < 0 || worker_threads > 1024) {
+                cerr << "Failed to parse number of worker threads: ["
+                     << optarg << "], 0-1024 allowed." << endl;
+                usage();
+            }
+            break;
+
         default:
             usage();
         }
@@ -107,6 +126,7 @@ main(int argc, char* argv[]) {
     int ret = EXIT_SUCCESS;
     try {
         ControlledDhcpv4Srv server(port_number);
+        server.setWorkerThreads(worker_threads);
         if (!stand_alone) {
             try {
                 server.establishSession();
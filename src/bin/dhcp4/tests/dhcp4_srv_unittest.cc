@@ -37,6 +37,7 @@
 #include <dhcpsrv/cfgmgr.h>
 #include <dhcpsrv/lease_mgr.h>
 #include <dhcpsrv/lease_mgr_factory.h>
+#include <dhcpsrv/memfile_lease_mgr.h>
 #include <dhcpsrv/utils.h>
 #include <gtest/gtest.h>
 #include <hooks/server_hooks.h>
@@ -46,6 +47,7 @@
 #include <boost/scoped_ptr.hpp>
 
 #include <iostream>
+#include <set>
 
 #include <arpa/inet.h>
 
@@ -954,6 +956,124 @@ TEST_F(Dhcpv4SrvTest, ManyRequests) {
     cout << "Offered address to client3=" << addr3 << endl;
 }
 
+/// @brief Server which records the number of lease records awaiting the
+/// commit at the time when each response is sent.
+class GroupCommitDhcpv4Srv : public NakedDhcpv4Srv {
+public:
+    GroupCommitDhcpv4Srv()
+        : NakedDhcpv4Srv(0) {
+    }
+
+    virtual void sendPacket(const Pkt4Ptr& pkt) {
+        const Memfile_LeaseMgr& lease_mgr =
+            dynamic_cast<const Memfile_LeaseMgr&>(LeaseMgrFactory::instance());
+        pending_commits_.push_back(lease_mgr.getPendingCommits());
+        NakedDhcpv4Srv::sendPacket(pkt);
+    }
+
+    /// @brief Number of pending lease records for each sent response.
+    std::vector<size_t> pending_commits_;
+};
+
+// Checks that with the group commit enabled in the lease database, the
+// responses to a burst of packets are sent after the leases allocated for
+// them have been committed.
+TEST_F(Dhcpv4SrvTest, groupCommit) {
+    IfaceMgrTestConfig test_config(true);
+    IfaceMgr::instance().openSockets4();
+
+    GroupCommitDhcpv4Srv srv;
+
+    // Replace the lease database created by the server with the one which
+    // commits leases in groups. The long delay guarantees that the server
+    // commits the leases when it runs out of packets to process.
+    const std::string lease_file = std::string(TEST_DATA_BUILDDIR) +
+        "/group-commit-leases4.csv";
+    static_cast<void>(remove(lease_file.c_str()));
+    LeaseMgrFactory::destroy();
+    LeaseMgrFactory::create("type=memfile universe=4 group-commit-delay=100000"
+                            " name=" + lease_file);
+
+    for (int i = 0; i < 3; ++i) {
+        Pkt4Ptr req(new Pkt4(DHCPREQUEST, 1234 + i));
+        req->setHWAddr(generateHWAddr(6));
+        req->addOption(generateClientId(4 + i));
+        const uint32_t hint = static_cast<uint32_t>(IOAddress("192.0.2.105"));
+        req->setYiaddr(IOAddress(hint + i));
+        req->pack();
+
+        // The server parses the packets it receives, so they have to be
+        // passed in the wire format.
+        Pkt4Ptr received(new Pkt4(static_cast<const uint8_t*>
+                                  (req->getBuffer().getData()),
+                                  req->getBuffer().getLength()));
+        received->setRemoteAddr(IOAddress("192.0.2.1"));
+        received->setIface("eth1");
+        srv.fakeReceive(received);
+    }
+
+    srv.run();
+
+    // All responses should have been sent and none of them before the
+    // lease records were committed.
+    ASSERT_EQ(3, srv.fake_sent_.size());
+    ASSERT_EQ(3, srv.pending_commits_.size());
+    for (int i = 0; i < srv.pending_commits_.size(); ++i) {
+        EXPECT_EQ(0, srv.pending_commits_[i]);
+    }
+    for (std::list<Pkt4Ptr>::const_iterator rsp = srv.fake_sent_.begin();
+         rsp != srv.fake_sent_.end(); ++rsp) {
+        EXPECT_EQ(DHCPACK, (*rsp)->getType());
+    }
+
+    LeaseMgrFactory::destroy();
+    static_cast<void>(remove(lease_file.c_str()));
+}
+
+// Checks that the packets processed by the worker threads get responses
+// and the clients get different addresses.
+TEST_F(Dhcpv4SrvTest, workerThreads) {
+    IfaceMgrTestConfig test_config(true);
+    IfaceMgr::instance().openSockets4();
+
+    NakedDhcpv4Srv srv(0);
+    srv.setWorkerThreads(4);
+    EXPECT_EQ(4, srv.getWorkerThreads());
+
+    // The pool has 11 addresses.
+    const int clients = 10;
+    for (int i = 0; i < clients; ++i) {
+        Pkt4Ptr req(new Pkt4(DHCPREQUEST, 1234 + i));
+        req->setHWAddr(generateHWAddr(6 + i));
+        req->addOption(generateClientId(4 + i));
+        req->pack();
+
+        // The server parses the packets it receives, so they have to be
+        // passed in the wire format.
+        Pkt4Ptr received(new Pkt4(static_cast<const uint8_t*>
+                                  (req->getBuffer().getData()),
+                                  req->getBuffer().getLength()));
+        received->setRemoteAddr(IOAddress("192.0.2.1"));
+        received->setIface("eth1");
+        srv.fakeReceive(received);
+    }
+
+    srv.run();
+
+    // Each client should have got its own address.
+    ASSERT_EQ(clients, srv.fake_sent_.size());
+    std::set<IOAddress> addresses;
+    for (std::list<Pkt4Ptr>::const_iterator rsp = srv.fake_sent_.begin();
+         rsp != srv.fake_sent_.end(); ++rsp) {
+        EXPECT_EQ(DHCPACK, (*rsp)->getType());
+        addresses.insert((*rsp)->getYiaddr());
+    }
+    EXPECT_EQ(clients, addresses.size());
+
+    srv.setWorkerThreads(0);
+    EXPECT_EQ(0, srv.getWorkerThreads());
+}
+
 // Checks whether echoing back client-id is controllable
 TEST_F(Dhcpv4SrvTest, requestEchoClientId) {
     IfaceMgrTestConfig test_config(true);
@@ -104,6 +104,10 @@ ControlledDhcpv6Srv::dhcp6ConfigHandler(ConstElementPtr new_config) {
             .arg(merged_config->str());
     }
 
+    // The workers must not process packets while the configuration is
+    // being changed.
+    server_->waitForWorkers();
+
     // Configure the server.
     ConstElementPtr answer = configureDhcp6Server(*server_, merged_config);
 
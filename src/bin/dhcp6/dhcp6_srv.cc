@@ -47,7 +47,9 @@
 #include <util/range_utilities.h>
 
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/erase.hpp>
 
@@ -63,6 +65,7 @@ using namespace bundy::dhcp_ddns;
 using namespace bundy::dhcp;
 using namespace bundy::hooks;
 using namespace bundy::util;
+using namespace bundy::util::thread;
 using namespace std;
 
 namespace {
@@ -115,7 +118,9 @@ const std::string Dhcpv6Srv::VENDOR_CLASS_PREFIX("VENDOR_CLASS_");
 static const char* SERVER_DUID_FILE = "bundy-dhcp6-serverid";
 
 Dhcpv6Srv::Dhcpv6Srv(uint16_t port)
-:alloc_engine_(), serverid_(), port_(port), shutdown_(true)
+:alloc_engine_(), serverid_(), port_(port), batch_start_(), batch_delay_(0),
+ pending_responses_(), client_mutexes_(new Mutex[CLIENT_MUTEXES]),
+ use_workers_(false), shutdown_(true)
 {
 
     LOG_DEBUG(dhcp6_logger, DBG_DHCP6_START, DHCP6_OPEN_SOCKET).arg(port);
@@ -171,6 +176,8 @@ Dhcpv6Srv::Dhcpv6Srv(uint16_t port)
 }
 
 Dhcpv6Srv::~Dhcpv6Srv() {
+    // Stop the workers before anything they may use is destroyed.
+    worker_pool_.reset();
     IfaceMgr::instance().closeSockets();
 
     LeaseMgrFactory::destroy();
@@ -182,13 +189,126 @@ void Dhcpv6Srv::shutdown() {
 }
 
 Pkt6Ptr Dhcpv6Srv::receivePacket(int timeout) {
-    return (IfaceMgr::instance().receive6(timeout));
+    if (received_.empty()) {
+        std::vector<Pkt6Ptr> pkts;
+        IfaceMgr::instance().receiveBatch6(
+            pkts, timeout, 0,
+            boost::bind(&Dhcpv6Srv::ifaceMgrReceive6ErrorHandler, _1));
+        for (std::vector<Pkt6Ptr>::const_iterator pkt = pkts.begin();
+             pkt != pkts.end(); ++pkt) {
+            received_.push(*pkt);
+        }
+        if (received_.empty()) {
+            // Timeout, signal or data on the external socket.
+            return (Pkt6Ptr());
+        }
+    }
+    Pkt6Ptr pkt = received_.front();
+    received_.pop();
+    return (pkt);
 }
 
 void Dhcpv6Srv::sendPacket(const Pkt6Ptr& packet) {
     IfaceMgr::instance().send(packet);
 }
 
+void
+Dhcpv6Srv::setWorkerThreads(const size_t threads) {
+    // Let the current workers finish before they are replaced.
+    worker_pool_.reset();
+    use_workers_ = false;
+    if (threads > 0) {
+        // The definitions of the standard options are created when they
+        // are first used. Make sure it doesn't happen in the workers.
+        LibDHCP::getOptionDefs(Option::V6);
+        worker_pool_.reset(new ThreadPool(threads));
+    }
+    LOG_INFO(dhcp6_logger, DHCP6_WORKER_THREADS).arg(threads);
+}
+
+void
+Dhcpv6Srv::waitForWorkers() {
+    if (worker_pool_) {
+        worker_pool_->wait();
+    }
+}
+
+Mutex&
+Dhcpv6Srv::getClientMutex(const Pkt6Ptr& query) {
+    OptionPtr client_id = query->getOption(D6O_CLIENTID);
+    size_t hash = 0;
+    if (client_id) {
+        const OptionBuffer& data = client_id->getData();
+        hash = boost::hash_range(data.begin(), data.end());
+    }
+    return (client_mutexes_[hash % CLIENT_MUTEXES]);
+}
+
+void
+Dhcpv6Srv::beginCommitBatch() {
+    Mutex::Locker lock(response_mutex_);
+    if (!batch_start_.is_not_a_date_time()) {
+        return;
+    }
+    batch_delay_ = LeaseMgrFactory::instance().getMaxCommitDelay();
+    if (batch_delay_ > 0) {
+        batch_start_ = boost::posix_time::microsec_clock::universal_time();
+    }
+}
+
+void
+Dhcpv6Srv::queueResponse(const Pkt6Ptr& rsp) {
+    // The responses are sent with the mutex held, because the interface
+    // manager doesn't expect to be used by many threads.
+    Mutex::Locker lock(response_mutex_);
+    if (!batch_start_.is_not_a_date_time()) {
+        pending_responses_.push_back(rsp);
+    } else {
+        sendPacket(rsp);
+    }
+}
+
+bool
+Dhcpv6Srv::batchExpired() const {
+    Mutex::Locker lock(response_mutex_);
+    return (!batch_start_.is_not_a_date_time() &&
+            (boost::posix_time::microsec_clock::universal_time() - batch_start_
+             >= boost::posix_time::milliseconds(batch_delay_)));
+}
+
+void
+Dhcpv6Srv::commitBatch() {
+    std::vector<Pkt6Ptr> responses;
+    {
+        Mutex::Locker lock(response_mutex_);
+        if (batch_start_.is_not_a_date_time()) {
+            return;
+        }
+        batch_start_ = boost::posix_time::ptime();
+        responses.swap(pending_responses_);
+    }
+
+    try {
+        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL, DHCP6_LEASE_COMMIT)
+            .arg(responses.size());
+        LeaseMgrFactory::instance().commit();
+    } catch (const std::exception& e) {
+        LOG_ERROR(dhcp6_logger, DHCP6_LEASE_COMMIT_FAIL)
+            .arg(responses.size()).arg(e.what());
+        return;
+    }
+
+    for (std::vector<Pkt6Ptr>::const_iterator rsp = responses.begin();
+         rsp != responses.end(); ++rsp) {
+        try {
+            sendPacket(*rsp);
+        } catch (const std::exception& e) {
+            LOG_ERROR(dhcp6_logger, DHCP6_PACKET_SEND_FAIL)
+                .arg(e.what());
+        }
+    }
+}
+
 bool
 Dhcpv6Srv::testServerID(const Pkt6Ptr& pkt) {
     /// @todo Currently we always check server identifier regardless if
@@ -236,18 +356,26 @@ Dhcpv6Srv::testUnicast(const Pkt6Ptr& pkt) const {
 
 bool Dhcpv6Srv::run() {
     while (!shutdown_) {
+        // Commit the current batch if it has been collected for the maximum
+        // time, so as the clients don't wait too long for the responses.
+        if (batchExpired()) {
+            waitForWorkers();
+            commitBatch();
+        }
+
         /// @todo Calculate actual timeout to the next event (e.g. lease
         /// expiration) once we have lease database. The idea here is that
         /// it is possible to do everything in a single process/thread.
         /// For now, we are just calling select for 1000 seconds. There
         /// were some issues reported on some systems when calling select()
         /// with too large values. Unfortunately, I don't recall the details.
+        /// If the responses are held until the batch is committed, only pick
+        /// packets which are already waiting to be read.
         //cppcheck-suppress variableScope This is temporary anyway
-        const int timeout = 1000;
+        const int timeout = (batchInProgress() ? 0 : 1000);
 
-        // client's message and server's response
+        // client's message
         Pkt6Ptr query;
-        Pkt6Ptr rsp;
 
         try {
             query = receivePacket(timeout);
@@ -256,276 +384,328 @@ bool Dhcpv6Srv::run() {
         }
 
         // Timeout may be reached or signal received, which breaks select()
-        // with no packet received
+        // with no packet received. There are no more packets in this burst,
+        // so commit the leases and send the held responses.
         if (!query) {
+            waitForWorkers();
+            commitBatch();
             continue;
         }
 
-        // In order to parse the DHCP options, the server needs to use some
-        // configuration information such as: existing option spaces, option
-        // definitions etc. This is the kind of information which is not
-        // available in the libdhcp, so we need to supply our own implementation
-        // of the option parsing function here, which would rely on the
-        // configuration data.
-        query->setCallback(boost::bind(&Dhcpv6Srv::unpackOptions, this, _1, _2,
-                                       _3, _4, _5));
+        // The workers are used if enabled and nothing prevents the packets
+        // from being processed concurrently. The decision may only change
+        // when the workers are idle, i.e. after the configuration has
+        // changed.
+        const bool use_workers = worker_pool_ &&
+            LeaseMgrFactory::instance().isThreadSafe() &&
+            HooksManager::getLibraryNames().empty();
+        if (use_workers != use_workers_) {
+            waitForWorkers();
+            use_workers_ = use_workers;
+            if (use_workers_) {
+                LOG_INFO(dhcp6_logger, DHCP6_WORKERS_ENABLED)
+                    .arg(worker_pool_->size());
+            } else {
+                LOG_INFO(dhcp6_logger, DHCP6_WORKERS_DISABLED);
+            }
+        }
 
-        bool skip_unpack = false;
+        // The batch is started here rather than by the worker, so as the
+        // next receive only picks the packets which are already waiting
+        // while the response to this one is held.
+        beginCommitBatch();
 
-        // The packet has just been received so contains the uninterpreted wire
-        // data; execute callouts registered for buffer6_receive.
-        if (HooksManager::calloutsPresent(Hooks.hook_index_buffer6_receive_)) {
-            CalloutHandlePtr callout_handle = getCalloutHandle(query);
+        if (use_workers_) {
+            worker_pool_->add(boost::bind(&Dhcpv6Srv::processPacket, this,
+                                          query));
+        } else {
+            processPacket(query);
+        }
+    }
 
-            // Delete previously set arguments
-            callout_handle->deleteAllArguments();
+    // Don't leave the responses behind when shutting down.
+    waitForWorkers();
+    commitBatch();
 
-            // Pass incoming packet as argument
-            callout_handle->setArgument("query6", query);
+    return (true);
+}
 
-            // Call callouts
-            HooksManager::callCallouts(Hooks.hook_index_buffer6_receive_, *callout_handle);
+void
+Dhcpv6Srv::processPacket(Pkt6Ptr query) {
+    // server's response
+    Pkt6Ptr rsp;
+
+    // In order to parse the DHCP options, the server needs to use some
+    // configuration information such as: existing option spaces, option
+    // definitions etc. This is the kind of information which is not
+    // available in the libdhcp, so we need to supply our own implementation
+    // of the option parsing function here, which would rely on the
+    // configuration data.
+    query->setCallback(boost::bind(&Dhcpv6Srv::unpackOptions, this, _1, _2,
+                                   _3, _4, _5));
+
+    bool skip_unpack = false;
+
+    // The packet has just been received so contains the uninterpreted wire
+    // data; execute callouts registered for buffer6_receive.
+    if (HooksManager::calloutsPresent(Hooks.hook_index_buffer6_receive_)) {
+        CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-            // Callouts decided to skip the next processing step. The next
-            // processing step would to parse the packet, so skip at this
-            // stage means that callouts did the parsing already, so server
-            // should skip parsing.
-            if (callout_handle->getSkip()) {
-                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_BUFFER_RCVD_SKIP);
-                skip_unpack = true;
-            }
+        // Delete previously set arguments
+        callout_handle->deleteAllArguments();
 
-            callout_handle->getArgument("query6", query);
-        }
+        // Pass incoming packet as argument
+        callout_handle->setArgument("query6", query);
 
-        // Unpack the packet information unless the buffer6_receive callouts
-        // indicated they did it
-        if (!skip_unpack) {
-            if (!query->unpack()) {
-                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL,
-                          DHCP6_PACKET_PARSE_FAIL);
-                continue;
-            }
-        }
-        // Check if received query carries server identifier matching
-        // server identifier being used by the server.
-        if (!testServerID(query)) {
-            continue;
+        // Call callouts
+        HooksManager::callCallouts(Hooks.hook_index_buffer6_receive_, *callout_handle);
+
+        // Callouts decided to skip the next processing step. The next
+        // processing step would to parse the packet, so skip at this
+        // stage means that callouts did the parsing already, so server
+        // should skip parsing.
+        if (callout_handle->getSkip()) {
+            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_BUFFER_RCVD_SKIP);
+            skip_unpack = true;
         }
 
-        // Check if the received query has been sent to unicast or multicast.
-        // The Solicit, Confirm, Rebind and Information Request will be
-        // discarded if sent to unicast address.
-        if (!testUnicast(query)) {
-            continue;
+        callout_handle->getArgument("query6", query);
+    }
+
+    // Unpack the packet information unless the buffer6_receive callouts
+    // indicated they did it
+    if (!skip_unpack) {
+        if (!query->unpack()) {
+            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL,
+                      DHCP6_PACKET_PARSE_FAIL);
+            return;
         }
+    }
+    // Check if received query carries server identifier matching
+    // server identifier being used by the server.
+    if (!testServerID(query)) {
+        return;
+    }
 
-        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL, DHCP6_PACKET_RECEIVED)
-            .arg(query->getName());
-        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA, DHCP6_QUERY_DATA)
-            .arg(static_cast<int>(query->getType()))
-            .arg(query->getBuffer().getLength())
-            .arg(query->toText());
-
-        // At this point the information in the packet has been unpacked into
-        // the various packet fields and option objects has been cretated.
-        // Execute callouts registered for packet6_receive.
-        if (HooksManager::calloutsPresent(Hooks.hook_index_pkt6_receive_)) {
-            CalloutHandlePtr callout_handle = getCalloutHandle(query);
+    // Check if the received query has been sent to unicast or multicast.
+    // The Solicit, Confirm, Rebind and Information Request will be
+    // discarded if sent to unicast address.
+    if (!testUnicast(query)) {
+        return;
+    }
 
-            // Delete previously set arguments
-            callout_handle->deleteAllArguments();
+    LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL, DHCP6_PACKET_RECEIVED)
+        .arg(query->getName());
+    LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA, DHCP6_QUERY_DATA)
+        .arg(static_cast<int>(query->getType()))
+        .arg(query->getBuffer().getLength())
+        .arg(query->toText());
 
-            // Pass incoming packet as argument
-            callout_handle->setArgument("query6", query);
+    // At this point the information in the packet has been unpacked into
+    // the various packet fields and option objects has been cretated.
+    // Execute callouts registered for packet6_receive.
+    if (HooksManager::calloutsPresent(Hooks.hook_index_pkt6_receive_)) {
+        CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-            // Call callouts
-            HooksManager::callCallouts(Hooks.hook_index_pkt6_receive_, *callout_handle);
+        // Delete previously set arguments
+        callout_handle->deleteAllArguments();
 
-            // Callouts decided to skip the next processing step. The next
-            // processing step would to process the packet, so skip at this
-            // stage means drop.
-            if (callout_handle->getSkip()) {
-                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_PACKET_RCVD_SKIP);
-                continue;
-            }
+        // Pass incoming packet as argument
+        callout_handle->setArgument("query6", query);
 
-            callout_handle->getArgument("query6", query);
+        // Call callouts
+        HooksManager::callCallouts(Hooks.hook_index_pkt6_receive_, *callout_handle);
+
+        // Callouts decided to skip the next processing step. The next
+        // processing step would to process the packet, so skip at this
+        // stage means drop.
+        if (callout_handle->getSkip()) {
+            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_PACKET_RCVD_SKIP);
+            return;
         }
 
-        // Assign this packet to a class, if possible
-        classifyPacket(query);
+        callout_handle->getArgument("query6", query);
+    }
 
-        try {
-                NameChangeRequestPtr ncr;
-            switch (query->getType()) {
-            case DHCPV6_SOLICIT:
-                rsp = processSolicit(query);
-                    break;
-
-            case DHCPV6_REQUEST:
-                rsp = processRequest(query);
-                break;
+    // Assign this packet to a class, if possible
+    classifyPacket(query);
 
-            case DHCPV6_RENEW:
-                rsp = processRenew(query);
-                break;
+    // The workers may be processing another packet from the same client,
+    // e.g. a retransmission. Don't let them allocate two leases for it.
+    Mutex::Locker client_lock(getClientMutex(query));
 
-            case DHCPV6_REBIND:
-                rsp = processRebind(query);
-                break;
+    // The leases updated while processing this packet will be committed
+    // together with those updated for the rest of the burst (run() has
+    // normally started the batch already).
+    beginCommitBatch();
 
-            case DHCPV6_CONFIRM:
-                rsp = processConfirm(query);
+    try {
+            NameChangeRequestPtr ncr;
+        switch (query->getType()) {
+        case DHCPV6_SOLICIT:
+            rsp = processSolicit(query);
                 break;
 
-            case DHCPV6_RELEASE:
-                rsp = processRelease(query);
-                break;
+        case DHCPV6_REQUEST:
+            rsp = processRequest(query);
+            break;
 
-            case DHCPV6_DECLINE:
-                rsp = processDecline(query);
-                break;
+        case DHCPV6_RENEW:
+            rsp = processRenew(query);
+            break;
 
-            case DHCPV6_INFORMATION_REQUEST:
-                rsp = processInfRequest(query);
-                break;
+        case DHCPV6_REBIND:
+            rsp = processRebind(query);
+            break;
 
-            default:
-                // We received a packet type that we do not recognize.
-                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_UNKNOWN_MSG_RECEIVED)
-                    .arg(static_cast<int>(query->getType()))
-                    .arg(query->getIface());
-                // Only action is to output a message if debug is enabled,
-                // and that will be covered by the debug statement before
-                // the "switch" statement.
-                ;
-            }
+        case DHCPV6_CONFIRM:
+            rsp = processConfirm(query);
+            break;
 
-        } catch (const RFCViolation& e) {
-            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_REQUIRED_OPTIONS_CHECK_FAIL)
-                .arg(query->getName())
-                .arg(query->getRemoteAddr().toText())
-                .arg(e.what());
+        case DHCPV6_RELEASE:
+            rsp = processRelease(query);
+            break;
 
-        } catch (const bundy::Exception& e) {
+        case DHCPV6_DECLINE:
+            rsp = processDecline(query);
+            break;
 
-            // Catch-all exception (at least for ones based on the isc
-            // Exception class, which covers more or less all that
-            // are explicitly raised in the BUNDY code).  Just log
-            // the problem and ignore the packet. (The problem is logged
-            // as a debug message because debug is disabled by default -
-            // it prevents a DDOS attack based on the sending of problem
-            // packets.)
-            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_PACKET_PROCESS_FAIL)
-                .arg(query->getName())
-                .arg(query->getRemoteAddr().toText())
-                .arg(e.what());
+        case DHCPV6_INFORMATION_REQUEST:
+            rsp = processInfRequest(query);
+            break;
+
+        default:
+            // We received a packet type that we do not recognize.
+            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_UNKNOWN_MSG_RECEIVED)
+                .arg(static_cast<int>(query->getType()))
+                .arg(query->getIface());
+            // Only action is to output a message if debug is enabled,
+            // and that will be covered by the debug statement before
+            // the "switch" statement.
+            ;
         }
 
-        if (rsp) {
-            rsp->setRemoteAddr(query->getRemoteAddr());
-            rsp->setLocalAddr(query->getLocalAddr());
+    } catch (const RFCViolation& e) {
+        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_REQUIRED_OPTIONS_CHECK_FAIL)
+            .arg(query->getName())
+            .arg(query->getRemoteAddr().toText())
+            .arg(e.what());
+
+    } catch (const bundy::Exception& e) {
+
+        // Catch-all exception (at least for ones based on the isc
+        // Exception class, which covers more or less all that
+        // are explicitly raised in the BUNDY code).  Just log
+        // the problem and ignore the packet. (The problem is logged
+        // as a debug message because debug is disabled by default -
+        // it prevents a DDOS attack based on the sending of problem
+        // packets.)
+        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_BASIC, DHCP6_PACKET_PROCESS_FAIL)
+            .arg(query->getName())
+            .arg(query->getRemoteAddr().toText())
+            .arg(e.what());
+    }
 
-            if (rsp->relay_info_.empty()) {
-                // Direct traffic, send back to the client directly
-                rsp->setRemotePort(DHCP6_CLIENT_PORT);
-            } else {
-                // Relayed traffic, send back to the relay agent
-                rsp->setRemotePort(DHCP6_SERVER_PORT);
-            }
+    if (rsp) {
+        rsp->setRemoteAddr(query->getRemoteAddr());
+        rsp->setLocalAddr(query->getLocalAddr());
 
-            rsp->setLocalPort(DHCP6_SERVER_PORT);
-            rsp->setIndex(query->getIndex());
-            rsp->setIface(query->getIface());
+        if (rsp->relay_info_.empty()) {
+            // Direct traffic, send back to the client directly
+            rsp->setRemotePort(DHCP6_CLIENT_PORT);
+        } else {
+            // Relayed traffic, send back to the relay agent
+            rsp->setRemotePort(DHCP6_SERVER_PORT);
+        }
 
-            // Specifies if server should do the packing
-            bool skip_pack = false;
+        rsp->setLocalPort(DHCP6_SERVER_PORT);
+        rsp->setIndex(query->getIndex());
+        rsp->setIface(query->getIface());
 
-            // Server's reply packet now has all options and fields set.
-            // Options are represented by individual objects, but the
-            // output wire data has not been prepared yet.
-            // Execute all callouts registered for packet6_send
-            if (HooksManager::calloutsPresent(Hooks.hook_index_pkt6_send_)) {
-                CalloutHandlePtr callout_handle = getCalloutHandle(query);
+        // Specifies if server should do the packing
+        bool skip_pack = false;
 
-                // Delete all previous arguments
-                callout_handle->deleteAllArguments();
+        // Server's reply packet now has all options and fields set.
+        // Options are represented by individual objects, but the
+        // output wire data has not been prepared yet.
+        // Execute all callouts registered for packet6_send
+        if (HooksManager::calloutsPresent(Hooks.hook_index_pkt6_send_)) {
+            CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-                // Set our response
-                callout_handle->setArgument("response6", rsp);
+            // Delete all previous arguments
+            callout_handle->deleteAllArguments();
 
-                // Call all installed callouts
-                HooksManager::callCallouts(Hooks.hook_index_pkt6_send_, *callout_handle);
+            // Set our response
+            callout_handle->setArgument("response6", rsp);
 
-                // Callouts decided to skip the next processing step. The next
-                // processing step would to pack the packet (create wire data).
-                // That step will be skipped if any callout sets skip flag.
-                // It essentially means that the callout already did packing,
-                // so the server does not have to do it again.
-                if (callout_handle->getSkip()) {
-                    LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_PACKET_SEND_SKIP);
-                    skip_pack = true;
-                }
-            }
+            // Call all installed callouts
+            HooksManager::callCallouts(Hooks.hook_index_pkt6_send_, *callout_handle);
 
-            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA,
-                      DHCP6_RESPONSE_DATA)
-                .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
+            // Callouts decided to skip the next processing step. The next
+            // processing step would to pack the packet (create wire data).
+            // That step will be skipped if any callout sets skip flag.
+            // It essentially means that the callout already did packing,
+            // so the server does not have to do it again.
+            if (callout_handle->getSkip()) {
+                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_PACKET_SEND_SKIP);
+                skip_pack = true;
+            }
+        }
 
-            if (!skip_pack) {
-                try {
-                    rsp->pack();
-                } catch (const std::exception& e) {
-                    LOG_ERROR(dhcp6_logger, DHCP6_PACK_FAIL)
-                        .arg(e.what());
-                    continue;
-                }
+        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA,
+                  DHCP6_RESPONSE_DATA)
+            .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
 
+        if (!skip_pack) {
+            try {
+                rsp->pack();
+            } catch (const std::exception& e) {
+                LOG_ERROR(dhcp6_logger, DHCP6_PACK_FAIL)
+                    .arg(e.what());
+                return;
             }
 
-            try {
+        }
 
-                // Now all fields and options are constructed into output wire buffer.
-                // Option objects modification does not make sense anymore. Hooks
-                // can only manipulate wire buffer at this stage.
-                // Let's execute all callouts registered for buffer6_send
-                if (HooksManager::calloutsPresent(Hooks.hook_index_buffer6_send_)) {
-                    CalloutHandlePtr callout_handle = getCalloutHandle(query);
+        try {
 
-                    // Delete previously set arguments
-                    callout_handle->deleteAllArguments();
+            // Now all fields and options are constructed into output wire buffer.
+            // Option objects modification does not make sense anymore. Hooks
+            // can only manipulate wire buffer at this stage.
+            // Let's execute all callouts registered for buffer6_send
+            if (HooksManager::calloutsPresent(Hooks.hook_index_buffer6_send_)) {
+                CalloutHandlePtr callout_handle = getCalloutHandle(query);
 
-                    // Pass incoming packet as argument
-                    callout_handle->setArgument("response6", rsp);
+                // Delete previously set arguments
+                callout_handle->deleteAllArguments();
 
-                    // Call callouts
-                    HooksManager::callCallouts(Hooks.hook_index_buffer6_send_, *callout_handle);
+                // Pass incoming packet as argument
+                callout_handle->setArgument("response6", rsp);
 
-                    // Callouts decided to skip the next processing step. The next
-                    // processing step would to parse the packet, so skip at this
-                    // stage means drop.
-                    if (callout_handle->getSkip()) {
-                        LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_BUFFER_SEND_SKIP);
-                        continue;
-                    }
+                // Call callouts
+                HooksManager::callCallouts(Hooks.hook_index_buffer6_send_, *callout_handle);
 
-                    callout_handle->getArgument("response6", rsp);
+                // Callouts decided to skip the next processing step. The next
+                // processing step would to parse the packet, so skip at this
+                // stage means drop.
+                if (callout_handle->getSkip()) {
+                    LOG_DEBUG(dhcp6_logger, DBG_DHCP6_HOOKS, DHCP6_HOOK_BUFFER_SEND_SKIP);
+                    return;
                 }
 
-                LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA,
-                          DHCP6_RESPONSE_DATA)
-                    .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
-
-                sendPacket(rsp);
-            } catch (const std::exception& e) {
-                LOG_ERROR(dhcp6_logger, DHCP6_PACKET_SEND_FAIL)
-                    .arg(e.what());
+                callout_handle->getArgument("response6", rsp);
             }
+
+            LOG_DEBUG(dhcp6_logger, DBG_DHCP6_DETAIL_DATA,
+                      DHCP6_RESPONSE_DATA)
+                .arg(static_cast<int>(rsp->getType())).arg(rsp->toText());
+
+            queueResponse(rsp);
+        } catch (const std::exception& e) {
+            LOG_ERROR(dhcp6_logger, DHCP6_PACKET_SEND_FAIL)
+                .arg(e.what());
         }
     }
-
-    return (true);
 }
 
 bool Dhcpv6Srv::loadServerID(const std::string& file_name) {
@@ -1235,7 +1415,12 @@ Dhcpv6Srv::assignIA_NA(const Subnet6Ptr& subnet, const DuidPtr& duid,
         fake_allocation = true;
     }
 
-    CalloutHandlePtr callout_handle = getCalloutHandle(query);
+    // The workers can't use the callout handle, which is shared by the
+    // packets. They only process the packets when there are no callouts.
+    CalloutHandlePtr callout_handle;
+    if (!use_workers_) {
+        callout_handle = getCalloutHandle(query);
+    }
 
     // At this point, we have to make make some decisions with respect to the
     // FQDN option that we have generated as a result of receiving client's
@@ -1384,7 +1569,12 @@ Dhcpv6Srv::assignIA_PD(const Subnet6Ptr& subnet, const DuidPtr& duid,
     // allocation.
     bool fake_allocation = (query->getType() == DHCPV6_SOLICIT);
 
-    CalloutHandlePtr callout_handle = getCalloutHandle(query);
+    // The workers can't use the callout handle, which is shared by the
+    // packets. They only process the packets when there are no callouts.
+    CalloutHandlePtr callout_handle;
+    if (!use_workers_) {
+        callout_handle = getCalloutHandle(query);
+    }
 
     // Use allocation engine to pick a lease for this client. Allocation engine
     // will try to honour the hint, but it is just a hint - some other address
@@ -1961,6 +2151,11 @@ Dhcpv6Srv::releaseIA_NA(const DuidPtr& duid, const Pkt6Ptr& query,
         return (ia_rsp);
     }
 
+    // The lease may be reused for another client by a concurrent
+    // allocation, so it must not change until it is deleted.
+    Mutex::Locker address_lock(alloc_engine_->
+                               getAddressMutex(release_addr->getAddress()));
+
     Lease6Ptr lease = LeaseMgrFactory::instance().getLease6(Lease::TYPE_NA,
                                                             release_addr->getAddress());
 
@@ -2113,6 +2308,10 @@ Dhcpv6Srv::releaseIA_PD(const DuidPtr& duid, const Pkt6Ptr& query,
         return (ia_rsp);
     }
 
+    // As in releaseIA_NA(), the lease must not change until it is deleted.
+    Mutex::Locker address_lock(alloc_engine_->
+                               getAddressMutex(release_prefix->getAddress()));
+
     Lease6Ptr lease = LeaseMgrFactory::instance().getLease6(Lease::TYPE_PD,
                                                             release_prefix->getAddress());
 
@@ -2503,6 +2702,12 @@ Dhcpv6Srv::ifaceMgrSocket6ErrorHandler(const std::string& errmsg) {
     LOG_WARN(dhcp6_logger, DHCP6_OPEN_SOCKET_FAIL).arg(errmsg);
 }
 
+void
+Dhcpv6Srv::ifaceMgrReceive6ErrorHandler(const std::string& errmsg) {
+    // Log the reason for receive failure and return.
+    LOG_ERROR(dhcp6_logger, DHCP6_PACKET_RECEIVE_FAIL).arg(errmsg);
+}
+
 void Dhcpv6Srv::classifyPacket(const Pkt6Ptr& pkt) {
     OptionVendorClassPtr vclass = boost::dynamic_pointer_cast<
         OptionVendorClass>(pkt->getOption(D6O_VENDOR_CLASS));
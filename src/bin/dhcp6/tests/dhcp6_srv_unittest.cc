@@ -33,6 +33,7 @@
 #include <dhcpsrv/cfgmgr.h>
 #include <dhcpsrv/lease_mgr.h>
 #include <dhcpsrv/lease_mgr_factory.h>
+#include <dhcpsrv/memfile_lease_mgr.h>
 #include <dhcpsrv/utils.h>
 #include <util/buffer.h>
 #include <util/range_utilities.h>
@@ -45,6 +46,7 @@
 #include <unistd.h>
 #include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
 
 using namespace bundy;
@@ -874,6 +876,120 @@ TEST_F(Dhcpv6SrvTest, ManyRequests) {
     cout << "Assigned address to client3=" << addr3->getAddress() << endl;
 }
 
+/// @brief Server which records the number of lease records awaiting the
+/// commit at the time when each response is sent.
+class GroupCommitDhcpv6Srv : public NakedDhcpv6Srv {
+public:
+    GroupCommitDhcpv6Srv()
+        : NakedDhcpv6Srv(0) {
+    }
+
+    virtual void sendPacket(const Pkt6Ptr& pkt) {
+        const Memfile_LeaseMgr& lease_mgr =
+            dynamic_cast<const Memfile_LeaseMgr&>(LeaseMgrFactory::instance());
+        pending_commits_.push_back(lease_mgr.getPendingCommits());
+        NakedDhcpv6Srv::sendPacket(pkt);
+    }
+
+    /// @brief Number of pending lease records for each sent response.
+    std::vector<size_t> pending_commits_;
+};
+
+// Checks that with the group commit enabled in the lease database, the
+// responses to a burst of packets are sent after the leases allocated for
+// them have been committed.
+TEST_F(Dhcpv6SrvTest, groupCommit) {
+    GroupCommitDhcpv6Srv srv;
+
+    // Replace the lease database created by the server with the one which
+    // commits leases in groups. The long delay guarantees that the server
+    // commits the leases when it runs out of packets to process.
+    const std::string lease_file = CfgMgr::instance().getDataDir() +
+        "/group-commit-leases6.csv";
+    static_cast<void>(remove(lease_file.c_str()));
+    LeaseMgrFactory::destroy();
+    LeaseMgrFactory::create("type=memfile universe=6 group-commit-delay=100000"
+                            " name=" + lease_file);
+
+    for (int i = 0; i < 3; ++i) {
+        Pkt6Ptr req(new Pkt6(DHCPV6_REQUEST, 1234 + i));
+        req->addOption(generateIA(D6O_IA_NA, 234 + i, 1500, 3000));
+        req->addOption(generateClientId(8 + i));
+        req->addOption(srv.getServerID());
+        req->pack();
+
+        // The server parses the packets it receives, so they have to be
+        // passed in the wire format.
+        Pkt6Ptr received(new Pkt6(static_cast<const uint8_t*>
+                                  (req->getBuffer().getData()),
+                                  req->getBuffer().getLength()));
+        received->setRemoteAddr(IOAddress("fe80::abcd"));
+        received->setIface("eth0");
+        srv.fakeReceive(received);
+    }
+
+    srv.run();
+
+    // All responses should have been sent and none of them before the
+    // lease records were committed.
+    ASSERT_EQ(3, srv.fake_sent_.size());
+    ASSERT_EQ(3, srv.pending_commits_.size());
+    for (int i = 0; i < srv.pending_commits_.size(); ++i) {
+        EXPECT_EQ(0, srv.pending_commits_[i]);
+    }
+    for (std::list<Pkt6Ptr>::const_iterator rsp = srv.fake_sent_.begin();
+         rsp != srv.fake_sent_.end(); ++rsp) {
+        EXPECT_EQ(DHCPV6_REPLY, (*rsp)->getType());
+    }
+
+    LeaseMgrFactory::destroy();
+    static_cast<void>(remove(lease_file.c_str()));
+}
+
+// Checks that the packets processed by the worker threads get responses
+// and the clients get different addresses.
+TEST_F(Dhcpv6SrvTest, workerThreads) {
+    NakedDhcpv6Srv srv(0);
+    srv.setWorkerThreads(4);
+    EXPECT_EQ(4, srv.getWorkerThreads());
+
+    const int clients = 50;
+    for (int i = 0; i < clients; ++i) {
+        Pkt6Ptr req(new Pkt6(DHCPV6_REQUEST, 1234 + i));
+        req->addOption(generateIA(D6O_IA_NA, 234, 1500, 3000));
+        req->addOption(generateClientId(8 + i));
+        req->addOption(srv.getServerID());
+        req->pack();
+
+        // The server parses the packets it receives, so they have to be
+        // passed in the wire format.
+        Pkt6Ptr received(new Pkt6(static_cast<const uint8_t*>
+                                  (req->getBuffer().getData()),
+                                  req->getBuffer().getLength()));
+        received->setRemoteAddr(IOAddress("fe80::abcd"));
+        received->setIface("eth0");
+        srv.fakeReceive(received);
+    }
+
+    srv.run();
+
+    // Each client should have got its own address.
+    ASSERT_EQ(clients, srv.fake_sent_.size());
+    std::set<IOAddress> addresses;
+    for (std::list<Pkt6Ptr>::const_iterator rsp = srv.fake_sent_.begin();
+         rsp != srv.fake_sent_.end(); ++rsp) {
+        EXPECT_EQ(DHCPV6_REPLY, (*rsp)->getType());
+        boost::shared_ptr<Option6IAAddr> addr =
+            checkIA_NA(*rsp, 234, subnet_->getT1(), subnet_->getT2());
+        ASSERT_TRUE(addr);
+        addresses.insert(addr->getAddress());
+    }
+    EXPECT_EQ(clients, addresses.size());
+
+    srv.setWorkerThreads(0);
+    EXPECT_EQ(0, srv.getWorkerThreads());
+}
+
 // This test verifies that incoming (positive) RENEW can be handled properly, that a
 // REPLY is generated, that the response has an address and that address
 // really belongs to the configured pool and that lease is actually renewed.
@@ -459,6 +459,105 @@ class MsgQTest(unittest.TestCase):
         self.__msgq.process_command_send(sender, routing, data)
         check_delivered(rcpt_socket=another_recipiet)
 
+    def test_getlname_encodings(self):
+        """
+        Test the getlname command negotiates the binary wire format.
+        """
+        sent = []
+        self.__msgq.send_prepared_msg = \
+            lambda socket, msg: sent.append((socket, msg))
+        self.__msgq.lnames["binary"] = 1
+        self.__msgq.lnames["json"] = 2
+
+        # The client understanding the binary format is told it may use it
+        self.__msgq.process_command_getlname(1, {
+            'type': 'getlname',
+            'encodings': ['something', 'binary']
+        }, None)
+        self.assertEqual((1, ({'type': 'getlname', 'encodings': ['binary']},
+                              {'lname': 'binary'})),
+                         (sent[0][0], self.parse_msg(sent[0][1])))
+        self.assertEqual(set([1]), self.__msgq.binary_sockets)
+
+        # The old client isn't
+        self.__msgq.process_command_getlname(2, {'type': 'getlname'}, None)
+        self.assertEqual((2, ({'type': 'getlname'}, {'lname': 'json'})),
+                         (sent[1][0], self.parse_msg(sent[1][1])))
+        self.assertEqual(set([1]), self.__msgq.binary_sockets)
+
+    def test_send_binary(self):
+        """
+        Test the message body in the binary wire format is passed as it is
+        to the clients understanding it and converted to JSON for the rest.
+        """
+        sent = []
+        def fake_send_prepared_msg(socket, msg):
+            sent.append((socket, msg))
+            return True
+        self.__msgq.send_prepared_msg = fake_send_prepared_msg
+        class Sock:
+            def fileno(self):
+                return 42
+        sender = Sock()
+        self.__msgq.binary_sockets = set([2, 4])
+        self.__msgq.subs.find = lambda group, instance: [1, 2, 3, 4]
+        routing = {
+            'to': '*',
+            'from': 'sender',
+            'group': 'group',
+            'instance': '*',
+            'seq': 42
+        }
+        data = {'data': ['Just some data', 1, 2.5, True, None]}
+        binary = bundy.cc.message.to_wire_binary(data)
+
+        def parse(msg):
+            (length, header_len) = struct.unpack('>IH', msg[:6])
+            return (json.loads(msg[6:6 + header_len].decode('utf-8')),
+                    msg[6 + header_len:])
+
+        self.__msgq.process_command_send(sender, routing, binary)
+        self.assertEqual([1, 2, 3, 4], [socket for (socket, msg) in sent])
+        for (socket, msg) in sent:
+            header, body = parse(msg)
+            self.assertEqual(routing, header)
+            if socket in [2, 4]:
+                self.assertEqual(binary, body)
+            else:
+                self.assertEqual(data, json.loads(body.decode('utf-8')))
+        # The message is converted only once
+        self.assertIs(sent[0][1], sent[2][1])
+
+        # JSON is passed to everybody as it is.
+        sent = []
+        json_data = bundy.cc.message.to_wire(data)
+        self.__msgq.process_command_send(sender, routing, json_data)
+        self.assertEqual(4, len(sent))
+        for (socket, msg) in sent:
+            self.assertEqual((routing, json_data), parse(msg))
+
+        # A broken binary body is delivered to the clients understanding
+        # the binary format only (they'll find it's broken).
+        sent = []
+        self.__msgq.process_command_send(sender, routing, binary[:-1])
+        self.assertEqual([2, 4], [socket for (socket, msg) in sent])
+
+    def test_kill_socket_binary(self):
+        """
+        Test the killed socket is forgotten to understand the binary format.
+        """
+        class Sock:
+            def close(self):
+                pass
+        sock = Sock()
+        self.__msgq.sockets[42] = sock
+        self.__msgq.lnames['lname'] = sock
+        self.__msgq.fd_to_lname[42] = 'lname'
+        self.__msgq.binary_sockets.add(sock)
+        self.__msgq.members_notify = lambda event, params: None
+        self.__msgq.kill_socket(42, sock)
+        self.assertEqual(set(), self.__msgq.binary_sockets)
+
 class DummySocket:
     """
     Dummy socket class.
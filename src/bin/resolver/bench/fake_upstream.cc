@@ -0,0 +1,132 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <resolver/bench/fake_upstream.h>
+
+#include <asiolink/io_address.h>
+
+#include <algorithm>
+#include <stdlib.h> // not cstdlib, which doesn't officially have random()
+
+namespace bundy {
+namespace resolver {
+namespace bench {
+
+namespace {
+
+// Uniform random number from [0, 1]
+double
+uniform() {
+    return ((1.0 * random()) / RAND_MAX);
+}
+
+}
+
+FakeUpstream::FakeUpstream(TimeoutPolicy policy, uint32_t query_timeout,
+                           unsigned retries) :
+    policy_(policy),
+    query_timeout_(query_timeout),
+    retries_(retries),
+    failed_(0)
+{}
+
+void
+FakeUpstream::addServer(const std::string& address, uint32_t latency,
+                        double loss)
+{
+    // Small random initial RTT, as the NameserverEntry does.
+    servers_.push_back(Server(nsas::AddressEntry(asiolink::IOAddress(address),
+                                                 1 + random() % 10),
+                              latency, loss));
+}
+
+FakeUpstream::Server&
+FakeUpstream::selectServer() {
+    // The same weights as in ZoneEntry
+    std::vector<double> weights;
+    double sum = 0;
+    for (std::vector<Server>::iterator it = servers_.begin();
+         it != servers_.end(); ++it) {
+        const uint32_t rtt = it->entry_.getRTT();
+        const double weight = (rtt == nsas::AddressEntry::UNREACHABLE) ? 0 :
+            1.0 / (1.0 * rtt * rtt);
+        weights.push_back(weight);
+        sum += weight;
+    }
+    if (sum == 0) {
+        return (servers_[random() % servers_.size()]);
+    }
+    double point = uniform() * sum;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        if (point < weights[i]) {
+            return (servers_[i]);
+        }
+        point -= weights[i];
+    }
+    return (servers_.back());
+}
+
+uint32_t
+FakeUpstream::query() {
+    uint32_t elapsed = 0;
+    // As in the resolver, the queries timing out before the query timeout
+    // are resent within what is left of it without using up a retry.
+    uint32_t budget = query_timeout_;
+    unsigned retries = retries_;
+    while (true) {
+        Server& server(selectServer());
+        const uint32_t timeout = (policy_ == AdaptiveTimeout) ?
+            std::min(server.entry_.getRetransmitTimeout(query_timeout_),
+                     budget) :
+            query_timeout_;
+        const uint32_t rtt = static_cast<uint32_t>(server.latency_ *
+                                                   (0.8 + 0.4 * uniform()));
+        if (uniform() >= server.loss_ && rtt <= timeout) {
+            server.entry_.addSample(rtt);
+            elapsed += rtt;
+            latencies_.push_back(elapsed);
+            return (elapsed);
+        }
+        server.entry_.addTimeout();
+        elapsed += timeout;
+        budget -= std::min(timeout, budget);
+        if (budget == 0) {
+            if (retries == 0) {
+                break;
+            }
+            --retries;
+            budget = query_timeout_;
+        }
+    }
+    ++failed_;
+    latencies_.push_back(elapsed);
+    return (elapsed);
+}
+
+uint32_t
+FakeUpstream::getPercentile(double percentile) const {
+    if (latencies_.empty()) {
+        return (0);
+    }
+    std::vector<uint32_t> sorted(latencies_);
+    std::sort(sorted.begin(), sorted.end());
+    const size_t index = std::min(sorted.size() - 1,
+                                  static_cast<size_t>(sorted.size() *
+                                                      percentile / 100));
+    return (sorted[index]);
+}
+
+}
+}
+}
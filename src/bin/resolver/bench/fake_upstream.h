@@ -0,0 +1,107 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef FAKE_UPSTREAM_H
+#define FAKE_UPSTREAM_H
+
+#include <nsas/address_entry.h>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace bundy {
+namespace resolver {
+namespace bench {
+
+/// \brief Imitation of the authoritative servers of a zone.
+///
+/// This simulates the upstream part of the resolution (the Upstream task
+/// of FakeQuery) in virtual time, so the effect of server selection and
+/// retransmit timeouts on the latency of upstream queries can be examined
+/// without waiting for real timeouts.
+///
+/// Each server has a base latency and a probability that a query to it is
+/// lost. Servers are selected the same way the NSAS does it (randomly, with
+/// weight 1/RTT^2) using the RTTs kept in nsas::AddressEntry objects, which
+/// are updated with the simulated answers and timeouts.
+class FakeUpstream {
+public:
+    /// \brief How long to wait for an answer before retrying.
+    enum TimeoutPolicy {
+        /// \brief Always wait for the full query timeout.
+        FixedTimeout,
+        /// \brief Use the per-server timeout based on its smoothed RTT.
+        AdaptiveTimeout
+    };
+
+    /// \brief Constructor
+    ///
+    /// \param policy The timeout policy to simulate.
+    /// \param query_timeout The (maximum) timeout of a single query, in ms.
+    /// \param retries How many times a query is retried before giving up.
+    FakeUpstream(TimeoutPolicy policy, uint32_t query_timeout,
+                 unsigned retries);
+
+    /// \brief Add a server.
+    ///
+    /// \param address Address of the server (used for the AddressEntry only)
+    /// \param latency Average round-trip time of the server, in ms. The
+    ///     actual one varies by +-20%.
+    /// \param loss Probability a query or its answer is lost (0 to 1).
+    void addServer(const std::string& address, uint32_t latency, double loss);
+
+    /// \brief Simulate one upstream query.
+    ///
+    /// Selects a server, "sends" the query and waits for the answer or the
+    /// timeout, retrying with another selection on timeouts.
+    ///
+    /// \return The time (in ms) it took to get the answer, or to give up.
+    uint32_t query();
+
+    /// \brief Return the number of queries that were given up.
+    size_t getFailed() const {
+        return (failed_);
+    }
+
+    /// \brief Return a percentile of the latencies of the queries so far.
+    ///
+    /// \param percentile The percentile, 0 to 100.
+    uint32_t getPercentile(double percentile) const;
+
+private:
+    struct Server {
+        Server(const nsas::AddressEntry& entry, uint32_t latency,
+               double loss) :
+            entry_(entry), latency_(latency), loss_(loss)
+        {}
+        nsas::AddressEntry entry_;
+        uint32_t latency_;
+        double loss_;
+    };
+    Server& selectServer();
+
+    const TimeoutPolicy policy_;
+    const uint32_t query_timeout_;
+    const unsigned retries_;
+    std::vector<Server> servers_;
+    std::vector<uint32_t> latencies_;
+    size_t failed_;
+};
+
+}
+}
+}
+
+#endif
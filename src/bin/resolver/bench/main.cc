@@ -13,15 +13,63 @@
 // PERFORMANCE OF THIS SOFTWARE.
 
 #include <resolver/bench/naive_resolver.h>
+#include <resolver/bench/worker_resolver.h>
+#include <resolver/bench/fake_upstream.h>
 
 #include <bench/benchmark.h>
 
+#include <iostream>
+
+using bundy::resolver::bench::FakeUpstream;
+using bundy::resolver::bench::WorkerResolver;
+
 const size_t count = 1000; // TODO: We may want to read this from argv.
+// Number of simulated upstream queries per timeout policy
+const size_t upstream_count = 100000;
+// Largest number of workers to try in the scaling benchmark
+const size_t max_workers = 8;
+
+namespace {
+
+// Simulate upstream queries to a zone with a fast but lossy server, and
+// two slower reliable ones, and report the latency percentiles.
+void
+simulateUpstream(FakeUpstream::TimeoutPolicy policy, const char* name) {
+    FakeUpstream upstream(policy, 2000, 3);
+    upstream.addServer("192.0.2.1", 20, 0.05);
+    upstream.addServer("192.0.2.2", 60, 0.01);
+    upstream.addServer("192.0.2.3", 150, 0);
+    for (size_t i = 0; i < upstream_count; ++i) {
+        upstream.query();
+    }
+    std::cout << "Upstream latency with " << name << " timeout: " <<
+        "p50 " << upstream.getPercentile(50) << " ms, " <<
+        "p90 " << upstream.getPercentile(90) << " ms, " <<
+        "p99 " << upstream.getPercentile(99) << " ms, " <<
+        "p99.9 " << upstream.getPercentile(99.9) << " ms, " <<
+        upstream.getFailed() << " failed" << std::endl;
+}
+
+}
 
 int main(int, const char**) {
     // Run the naive implementation
     bundy::resolver::bench::NaiveResolver naive_resolver(count);
     bundy::bench::BenchMark<bundy::resolver::bench::NaiveResolver>
         (1, naive_resolver, true);
+
+    // The workers with their own event loops, sharing the cache.  The same
+    // number of queries with more workers should take less time, until we
+    // run out of cores.
+    for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+        std::cout << "Resolver with " << workers << " worker(s):" <<
+            std::endl;
+        WorkerResolver worker_resolver(count * 10, workers);
+        bundy::bench::BenchMark<WorkerResolver>(1, worker_resolver, true);
+    }
+
+    // Server selection and retransmit timeouts, in simulated time
+    simulateUpstream(FakeUpstream::FixedTimeout, "fixed");
+    simulateUpstream(FakeUpstream::AdaptiveTimeout, "adaptive");
     return 0;
 }
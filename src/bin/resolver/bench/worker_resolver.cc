@@ -0,0 +1,138 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <resolver/bench/worker_resolver.h>
+
+#include <util/threads/thread.h>
+
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+using bundy::util::thread::Thread;
+using namespace bundy::util::locks;
+
+namespace bundy {
+namespace resolver {
+namespace bench {
+
+class WorkerResolver::Worker : boost::noncopyable {
+public:
+    Worker(size_t query_count, upgradable_mutex& cache_mutex) :
+        interface_(query_count),
+        cache_mutex_(cache_mutex),
+        outstanding_(0),
+        count_(0)
+    {}
+
+    // Event loop of the worker. Accepts all the queries and handles the
+    // upstream answers as they come, many queries are in progress at once.
+    void run() {
+        FakeQueryPtr query;
+        while ((query = interface_.receiveQuery())) {
+            ++outstanding_;
+            step(query);
+        }
+        while (outstanding_ > 0) {
+            interface_.processEvents();
+        }
+    }
+
+    size_t getCount() const {
+        return (count_);
+    }
+private:
+    // Perform the tasks of the query until it needs to wait for upstream.
+    // Called again from the upstream answer.
+    void step(FakeQueryPtr query) {
+        while (!query->done()) {
+            bool done = false;
+            switch (query->nextTask()) {
+                case CacheRead: {
+                    sharable_lock<upgradable_mutex> lock(cache_mutex_);
+                    query->performTask(boost::bind(&Worker::stepDone, &done));
+                    break;
+                }
+                case CacheWrite: {
+                    scoped_lock<upgradable_mutex> lock(cache_mutex_);
+                    query->performTask(boost::bind(&Worker::stepDone, &done));
+                    break;
+                }
+                case Upstream:
+                    // Continue when the answer comes
+                    query->performTask(boost::bind(&Worker::step, this,
+                                                   query));
+                    return;
+                default:
+                    // Compute and Send use only what belongs to this worker
+                    query->performTask(boost::bind(&Worker::stepDone, &done));
+                    break;
+            }
+            assert(done);
+        }
+        --outstanding_;
+        ++count_;
+    }
+
+    static void stepDone(bool* flag) {
+        *flag = true;
+    }
+
+    FakeInterface interface_;
+    upgradable_mutex& cache_mutex_;
+    size_t outstanding_;
+    size_t count_;
+};
+
+WorkerResolver::WorkerResolver(size_t query_count, size_t worker_count) :
+    processed_(false)
+{
+    assert(worker_count > 0);
+    // The interfaces need to be created from a single thread
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(new Worker(query_count / worker_count +
+                                      (i < query_count % worker_count ?
+                                       1 : 0), cache_mutex_));
+    }
+}
+
+WorkerResolver::~WorkerResolver() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        delete workers_[i];
+    }
+}
+
+size_t
+WorkerResolver::run() {
+    assert(!processed_);
+    // The first worker runs in this thread, like the main IOService of
+    // the resolver.
+    std::vector<boost::shared_ptr<Thread> > threads;
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        threads.push_back(boost::shared_ptr<Thread>(
+            new Thread(boost::bind(&Worker::run, workers_[i]))));
+    }
+    workers_[0]->run();
+    size_t count = workers_[0]->getCount();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->wait();
+        count += workers_[i + 1]->getCount();
+    }
+    processed_ = true;
+    return (count);
+}
+
+}
+}
+}
@@ -0,0 +1,65 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef RESOLVER_BENCH_WORKER_H
+#define RESOLVER_BENCH_WORKER_H
+
+#include <resolver/bench/fake_resolution.h>
+
+#include <util/locks.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+namespace bundy {
+namespace resolver {
+namespace bench {
+
+/// \brief Resolver with several workers, each with its own event loop
+///
+/// This mimics the structure of the multi-threaded bundy-resolver. Each
+/// worker runs in its own thread, with its own interface (its own sockets
+/// and IOService), and keeps many queries in progress at once. The only
+/// thing shared between the workers is the cache, protected by a read-write
+/// lock (the same way the NSAS hash table slots are).
+///
+/// Running it with different numbers of workers shows how the design
+/// scales with the number of cores.
+class WorkerResolver : boost::noncopyable {
+public:
+    /// \brief Constructor. Initializes the data.
+    ///
+    /// \param query_count Total number of queries, they are split evenly
+    ///     between the workers.
+    /// \param worker_count Number of the worker threads.
+    WorkerResolver(size_t query_count, size_t worker_count);
+
+    /// \brief Destructor.
+    ~WorkerResolver();
+
+    /// \brief Run the resolution.
+    size_t run();
+private:
+    class Worker;
+    std::vector<Worker*> workers_;
+    bundy::util::locks::upgradable_mutex cache_mutex_;
+    bool processed_;
+};
+
+}
+}
+}
+
+#endif
@@ -16,6 +16,7 @@
 
 #include <resolver/spec_config.h>
 #include <resolver/resolver.h>
+#include <resolver/worker_pool.h>
 #include "resolver_log.h"
 #include "common.h"
 
@@ -216,8 +217,11 @@ main(int argc, char* argv[]) {
         cache.update(root_a_rrset);
         cache.update(root_aaaa_rrset);
 
-        DNSService dns_service(io_service, lookup, answer);
-        resolver->setDNSService(dns_service);
+        // The worker pool is the DNS service, it distributes the sockets
+        // between the workers (the first of them is io_service).
+        WorkerPool workers(io_service, lookup, answer);
+        resolver->setDNSService(workers);
+        resolver->setWorkerPool(workers);
         LOG_DEBUG(resolver_logger, RESOLVER_DBG_INIT, RESOLVER_SERVICE_CREATED);
 
         cc_session = new Session(io_service.get_io_service());
@@ -244,7 +248,9 @@ main(int argc, char* argv[]) {
         config_session->start();
 
         LOG_INFO(resolver_logger, RESOLVER_STARTED);
+        workers.start();
         io_service.run();
+        workers.stop();
     } catch (const std::exception& ex) {
         LOG_FATAL(resolver_logger, RESOLVER_FAILED).arg(ex.what());
         ret = 1;
@@ -19,10 +19,12 @@
 #include <netinet/in.h>
 
 #include <algorithm>
+#include <memory>
 #include <vector>
 #include <cassert>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/foreach.hpp>
 
 #include <exceptions/exceptions.h>
@@ -51,6 +53,7 @@
 
 #include <server_common/client.h>
 #include <server_common/portconfig.h>
+#include <server_common/query_capture.h>
 
 #include <resolve/recursive_query.h>
 
@@ -82,10 +85,12 @@ public:
         client_timeout_(4000),
         lookup_timeout_(30000),
         retries_(3),
+        workers_(NULL),
+        worker_count_(1),
+        steering_(WorkerPool::SHARED),
         // we apply "reject all" (implicit default of the loader) ACL by
         // default:
-        query_acl_(acl::dns::getRequestLoader().load(Element::fromJSON("[]"))),
-        rec_query_(NULL)
+        query_acl_(acl::dns::getRequestLoader().load(Element::fromJSON("[]")))
     {}
 
     ~ResolverImpl() {
@@ -96,30 +101,58 @@ public:
                     bundy::nsas::NameserverAddressStore& nsas,
                     bundy::cache::ResolverCache& cache)
     {
-        assert(!rec_query_); // queryShutdown must be called first
+        assert(rec_queries_.empty()); // queryShutdown must be called first
         LOG_DEBUG(resolver_logger, RESOLVER_DBG_INIT, RESOLVER_QUERY_SETUP);
-        rec_query_ = new RecursiveQuery(dnss, 
-                                        nsas, cache,
-                                        upstream_,
-                                        upstream_root_,
-                                        query_timeout_,
-                                        client_timeout_,
-                                        lookup_timeout_,
-                                        retries_);
+        // Each worker has its own RecursiveQuery, using its own sockets
+        // and IOService.  Without workers, there's just the one on dnss.
+        const size_t count = workers_ ? workers_->getWorkerCount() : 1;
+        for (size_t i = 0; i < count; ++i) {
+            rec_queries_.push_back(new RecursiveQuery(
+                                       workers_ ?
+                                       workers_->getWorkerService(i) : dnss,
+                                       nsas, cache,
+                                       upstream_,
+                                       upstream_root_,
+                                       query_timeout_,
+                                       client_timeout_,
+                                       lookup_timeout_,
+                                       retries_));
+        }
     }
 
     void queryShutdown() {
         // only shut down if we have actually called querySetup before
         // (this is not a safety check, just to prevent logging of
         // actions that are not performed
-        if (rec_query_) {
+        if (!rec_queries_.empty()) {
             LOG_DEBUG(resolver_logger, RESOLVER_DBG_INIT,
                       RESOLVER_QUERY_SHUTDOWN);
-            delete rec_query_;
-            rec_query_ = NULL;
+            BOOST_FOREACH(RecursiveQuery* rec_query, rec_queries_) {
+                delete rec_query;
+            }
+            rec_queries_.clear();
+        }
+    }
+
+    /// Abandons the queries in progress in the workers from the given index
+    /// on (see RecursiveQuery::abandonQueries()).
+    void abandonQueries(size_t first) {
+        for (size_t i = first; i < rec_queries_.size(); ++i) {
+            rec_queries_[i]->abandonQueries();
         }
     }
 
+    bool hasQueries() const {
+        return (!rec_queries_.empty());
+    }
+
+    /// Returns the RecursiveQuery of the worker running the calling thread.
+    RecursiveQuery& currentQuery() {
+        const size_t index = workers_ ? workers_->getCurrentWorker() : 0;
+        assert(index < rec_queries_.size());
+        return (*rec_queries_[index]);
+    }
+
     void setForwardAddresses(const AddressList& upstream,
                              DNSServiceBase* dnss)
     {
@@ -192,12 +225,21 @@ public:
     /// Number of retries after timeout
     unsigned retries_;
 
+    /// The worker threads, if any
+    WorkerPool* workers_;
+    /// Configured number of workers (applied to workers_ when set)
+    size_t worker_count_;
+    /// Configured query steering policy
+    WorkerPool::SteeringPolicy steering_;
+    /// Capture of the queries, NULL if not configured
+    boost::scoped_ptr<QueryCapture> capture_;
+
 private:
     /// ACL on incoming queries
     boost::shared_ptr<const RequestACL> query_acl_;
 
-    /// Object to handle upstream queries
-    RecursiveQuery* rec_query_;
+    /// Objects to handle upstream queries, one per worker
+    std::vector<RecursiveQuery*> rec_queries_;
 };
 
 /*
@@ -285,6 +327,8 @@ private:
 // into a wire-format response.
 class MessageAnswer : public DNSAnswer {
 public:
+    MessageAnswer(const ResolverImpl& impl) : impl_(impl) {}
+
     virtual void operator()(const IOMessage& io_message,
                             MessagePtr query_message,
                             MessagePtr answer_message,
@@ -335,14 +379,21 @@ public:
         LOG_DEBUG(resolver_logger, RESOLVER_DBG_DETAIL,
                   RESOLVER_DNS_MESSAGE_SENT)
                   .arg(renderer.getLength()).arg(*answer_message);
+
+        if (impl_.capture_ && impl_.capture_->isSampled(io_message)) {
+            impl_.capture_->capture(QueryCapture::CLIENT_RESPONSE,
+                                    io_message, buffer.get());
+        }
     }
+private:
+    const ResolverImpl& impl_;
 };
 
 Resolver::Resolver() :
     impl_(new ResolverImpl()),
     dnss_(NULL),
     dns_lookup_(NULL),
-    dns_answer_(new MessageAnswer),
+    dns_answer_(new MessageAnswer(*impl_)),
     nsas_(NULL),
     cache_(NULL)
 {
@@ -376,6 +427,11 @@ Resolver::setCache(bundy::cache::ResolverCache& cache)
 }
 
 
+void
+Resolver::setWorkerPool(WorkerPool& workers) {
+    impl_->workers_ = &workers;
+}
+
 void
 Resolver::setConfigSession(ModuleCCSession* config_session) {
     impl_->config_session_ = config_session;
@@ -401,6 +457,10 @@ Resolver::processMessage(const IOMessage& io_message,
                          OutputBufferPtr buffer,
                          DNSServer* server)
 {
+    if (impl_->capture_ && impl_->capture_->isSampled(io_message)) {
+        impl_->capture_->capture(QueryCapture::CLIENT_QUERY, io_message);
+    }
+
     InputBuffer request_buffer(io_message.getData(), io_message.getDataSize());
     // First, check the header part.  If we fail even for the base header,
     // just drop the message.
@@ -494,7 +554,7 @@ void
 ResolverImpl::resolve(const QuestionPtr& question,
     const bundy::resolve::ResolverInterface::CallbackPtr& callback)
 {
-    rec_query_->resolve(question, callback);
+    currentQuery().resolve(question, callback);
 }
 
 ResolverImpl::NormalQueryResult
@@ -563,16 +623,66 @@ ResolverImpl::processNormalQuery(const IOMessage& io_message,
     if (upstream_.empty()) {
         // Processing normal query
         LOG_DEBUG(resolver_logger, RESOLVER_DBG_IO, RESOLVER_NORMAL_QUERY);
-        rec_query_->resolve(*question, answer_message, buffer, server);
+        ConstEDNSPtr edns(query_message->getEDNS());
+        const bool dnssec_ok = edns && edns->getDNSSECAwareness();
+        currentQuery().resolve(*question, answer_message, buffer, server,
+                               dnssec_ok);
     } else {
         // Processing forward query
         LOG_DEBUG(resolver_logger, RESOLVER_DBG_IO, RESOLVER_FORWARD_QUERY);
-        rec_query_->forward(query_message, answer_message, buffer, server);
+        currentQuery().forward(query_message, answer_message, buffer, server);
     }
 
     return (RECURSION);
 }
 
+namespace {
+// Stops the worker threads for the life of the object, so the objects
+// they share with the main thread can be changed.  They are started
+// again only if they were running before.
+class WorkerPause {
+public:
+    WorkerPause(WorkerPool* workers) :
+        workers_(workers && workers->isRunning() ? workers : NULL)
+    {
+        if (workers_ != NULL) {
+            workers_->stop();
+        }
+    }
+    ~WorkerPause() {
+        if (workers_ != NULL) {
+            workers_->start();
+        }
+    }
+private:
+    WorkerPool* const workers_;
+};
+
+// Sets the query objects up again if the configuration update removed
+// them and failed before creating the new ones.  It must go before the
+// WorkerPause, the workers need the query objects.
+class QueryRestore {
+public:
+    QueryRestore(ResolverImpl& impl, DNSServiceBase* dnss,
+                 bundy::nsas::NameserverAddressStore* nsas,
+                 bundy::cache::ResolverCache* cache) :
+        impl_(impl), dnss_(dnss), nsas_(nsas), cache_(cache),
+        had_queries_(impl.hasQueries())
+    {}
+    ~QueryRestore() {
+        if (had_queries_ && !impl_.hasQueries()) {
+            impl_.querySetup(*dnss_, *nsas_, *cache_);
+        }
+    }
+private:
+    ResolverImpl& impl_;
+    DNSServiceBase* const dnss_;
+    bundy::nsas::NameserverAddressStore* const nsas_;
+    bundy::cache::ResolverCache* const cache_;
+    const bool had_queries_;
+};
+}
+
 ConstElementPtr
 Resolver::updateConfig(ConstElementPtr config, bool startup) {
     LOG_DEBUG(resolver_logger, RESOLVER_DBG_CONFIG, RESOLVER_CONFIG_UPDATED)
@@ -602,6 +712,11 @@ Resolver::updateConfig(ConstElementPtr config, bool startup) {
                         ctimeoutE(config->get("timeout_client")),
                         ltimeoutE(config->get("timeout_lookup")),
                         retriesE(config->get("retries"));
+        const ConstElementPtr workersE(config->get("worker_threads"));
+        const ConstElementPtr steeringE(config->get("query_steering"));
+        const ConstElementPtr captureE(config->get("query_capture"));
+        size_t worker_count = impl_->worker_count_;
+        WorkerPool::SteeringPolicy steering = impl_->steering_;
         if (qtimeoutE) {
             // It should be safe to just get it, the config manager should
             // check for us
@@ -643,14 +758,64 @@ Resolver::updateConfig(ConstElementPtr config, bool startup) {
             retries = retriesE->intValue();
             set_timeouts = true;
         }
+        if (workersE) {
+            if (workersE->intValue() < 1) {
+                LOG_ERROR(resolver_logger, RESOLVER_BAD_WORKER_COUNT)
+                          .arg(workersE->intValue());
+                bundy_throw(BadValue, "Number of worker threads must be "
+                            "positive");
+            }
+            worker_count = workersE->intValue();
+        }
+        if (steeringE) {
+            steering =
+                WorkerPool::steeringPolicyFromText(steeringE->stringValue());
+        }
+        // The new capture can fail to open its output, so it's created
+        // before anything is changed.  It's installed once the rest has
+        // succeeded.
+        std::auto_ptr<QueryCapture> capture;
+        if (captureE) {
+            capture.reset(createQueryCapture(captureE));
+        }
         // Everything OK, so commit the changes
-        // listenAddresses can fail to bind, so try them first
+        // The worker threads use what is changed below, so we stop them
+        // for the time of the update.
+        const WorkerPause pause(impl_->workers_);
+        const QueryRestore restore(*impl_, dnss_, nsas_, cache_);
         bool need_query_restart = false;
-        
+
+        // listenAddresses can fail to bind, so try them first
         if (!startup && listenAddressesE) {
             setListenAddresses(listenAddresses);
             need_query_restart = true;
         }
+
+        if (worker_count != impl_->worker_count_ ||
+            steering != impl_->steering_) {
+            if (impl_->workers_ != NULL) {
+                // The workers that are removed take their IOService with
+                // them, so what they are still resolving is answered now,
+                // while their sockets are open.
+                impl_->abandonQueries(worker_count);
+                if (worker_count < impl_->workers_->getWorkerCount()) {
+                    impl_->workers_->poll(worker_count);
+                }
+                // The query objects live in the workers, they need to go
+                // first.
+                impl_->queryShutdown();
+                impl_->workers_->setSteeringPolicy(steering);
+                impl_->workers_->setWorkerCount(worker_count);
+                need_query_restart = true;
+            }
+            impl_->worker_count_ = worker_count;
+            impl_->steering_ = steering;
+            // The sockets need to be distributed again (on startup, new
+            // listen addresses are installed below).
+            if (impl_->workers_ != NULL && !(startup && listenAddressesE)) {
+                setListenAddresses(impl_->listen_);
+            }
+        }
         if (forwardAddressesE) {
             setForwardAddresses(forwardAddresses);
             need_query_restart = true;
@@ -675,6 +840,16 @@ Resolver::updateConfig(ConstElementPtr config, bool startup) {
             impl_->queryShutdown();
             impl_->querySetup(*dnss_, *nsas_, *cache_);
         }
+
+        // The current capture may write to the same output, so it's
+        // stopped before the new one starts its stream.
+        if (captureE) {
+            setQueryCapture(NULL);
+            if (capture.get() != NULL) {
+                capture->start();
+            }
+            setQueryCapture(capture.release());
+        }
         return (bundy::config::createAnswer());
 
     } catch (const bundy::Exception& error) {
@@ -750,6 +925,16 @@ Resolver::getRetries() const {
     return impl_->retries_;
 }
 
+size_t
+Resolver::getWorkerCount() const {
+    return (impl_->worker_count_);
+}
+
+WorkerPool::SteeringPolicy
+Resolver::getQuerySteering() const {
+    return (impl_->steering_);
+}
+
 AddressList
 Resolver::getListenAddresses() const {
     return (impl_->listen_);
@@ -769,3 +954,15 @@ Resolver::setQueryACL(boost::shared_ptr<const RequestACL> new_acl) {
     LOG_INFO(resolver_logger, RESOLVER_SET_QUERY_ACL);
     impl_->setQueryACL(new_acl);
 }
+
+void
+Resolver::setQueryCapture(QueryCapture* capture) {
+    // The workers may be capturing.
+    const WorkerPause pause(impl_->workers_);
+    impl_->capture_.reset(capture);
+}
+
+const QueryCapture*
+Resolver::getQueryCapture() const {
+    return (impl_->capture_.get());
+}
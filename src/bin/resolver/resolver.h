@@ -40,6 +40,10 @@
 
 #include <resolve/resolver_interface.h>
 
+#include <resolver/worker_pool.h>
+
+#include <server_common/query_capture.h>
+
 class ResolverImpl;
 
 /**
@@ -112,6 +116,18 @@ public:
     /// \brief Assign a cache to this Resolver object
     void setCache(bundy::cache::ResolverCache& cache);
 
+    /// \brief Assign a pool of worker threads to this Resolver object
+    ///
+    /// With a worker pool, each worker gets its own object handling the
+    /// upstream queries and the queries are processed by the worker that
+    /// received them.  The pool should also be set as the DNS service
+    /// (see \c setDNSService()), so the listen sockets get distributed
+    /// between the workers.
+    ///
+    /// The "worker_threads" and "query_steering" configuration is applied
+    /// to the pool.  Without a pool, it is only remembered.
+    void setWorkerPool(WorkerPool& workers);
+
     /// \brief Return this object's ASIO IO Service queue
     bundy::asiodns::DNSServiceBase& getDNSService() const { return (*dnss_); }
 
@@ -234,6 +250,12 @@ public:
      */
     int getRetries() const;
 
+    /// \brief Get the configured number of workers (including the main one)
+    size_t getWorkerCount() const;
+
+    /// \brief Get the configured query steering policy
+    WorkerPool::SteeringPolicy getQuerySteering() const;
+
     /// Get the query ACL.
     ///
     /// \exception None
@@ -253,6 +275,21 @@ public:
     void setQueryACL(boost::shared_ptr<const bundy::acl::dns::RequestACL>
                      new_acl);
 
+    /// \brief Set the capture of the queries and the responses
+    ///
+    /// The queries are captured as they are received, as
+    /// \c bundy::server_common::QueryCapture::CLIENT_QUERY records, and
+    /// again with the responses as they are sent, as \c CLIENT_RESPONSE
+    /// records. The worker threads are stopped while the capture is
+    /// replaced.
+    ///
+    /// \param capture the capture, the resolver takes its ownership; if
+    ///        NULL, the queries are not captured
+    void setQueryCapture(bundy::server_common::QueryCapture* capture);
+
+    /// \brief Return the capture of the queries, NULL if there's none
+    const bundy::server_common::QueryCapture* getQueryCapture() const;
+
 private:
     ResolverImpl* impl_;
     bundy::asiodns::DNSServiceBase* dnss_;
@@ -18,6 +18,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <unistd.h>
 
 #include <cerrno>
 #include <cstring>
@@ -43,6 +44,7 @@
 #include <acl/acl.h>
 
 #include <server_common/client.h>
+#include <server_common/query_capture.h>
 
 #include <resolver/resolver.h>
 
@@ -78,12 +80,16 @@ public:
 class ResolverConfig : public ::testing::Test {
 protected:
     MockDNSService dnss;
+    // Only used by the tests that set it, but it must outlive the server
+    IOService workers_service;
+    WorkerPool workers;
     Resolver server;
     scoped_ptr<const IOEndpoint> endpoint;
     scoped_ptr<const IOMessage> query_message;
     scoped_ptr<const Client> client;
     scoped_ptr<const RequestContext> request;
     ResolverConfig() :
+        workers(workers_service, NULL, NULL),
         // The empty string is expected value of the parameter of
         // requestSocket, not the app_name (there's no fallback, it checks
         // the empty string is passed).
@@ -546,4 +552,111 @@ TEST_F(ResolverConfig, badQueryACL) {
                                         "    \"from\": \"1922.0.2.1\"}]}"))));
 }
 
+
+TEST_F(ResolverConfig, workersConfig) {
+    // Defaults: just the main thread, sockets shared
+    EXPECT_EQ(1, server.getWorkerCount());
+    EXPECT_EQ(WorkerPool::SHARED, server.getQuerySteering());
+
+    // Without a worker pool the values are only remembered
+    EXPECT_EQ(0, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"worker_threads\": 4,"
+                                       " \"query_steering\": "
+                                       "\"per-socket\"}"))));
+    EXPECT_EQ(4, server.getWorkerCount());
+    EXPECT_EQ(WorkerPool::PER_SOCKET, server.getQuerySteering());
+}
+
+TEST_F(ResolverConfig, badWorkersConfig) {
+    EXPECT_EQ(1, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"worker_threads\": 0}"))));
+    EXPECT_EQ(1, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"query_steering\": "
+                                       "\"random\"}"))));
+    // Nothing changed
+    EXPECT_EQ(1, server.getWorkerCount());
+    EXPECT_EQ(WorkerPool::SHARED, server.getQuerySteering());
+}
+
+// The worker change is applied only once the listen addresses are
+// installed, so a failure leaves the workers alone.
+TEST_F(ResolverConfig, workersAndListenOnConfig) {
+    server.setWorkerPool(workers);
+    // Create and bind a socket that would make the listen_on fail
+    ScopedSocket sock(createSocket(TEST_ADDRESS, TEST_PORT));
+
+    EXPECT_EQ(1, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"worker_threads\": 2,"
+                                       " \"listen_on\": ["
+                                       " {\"address\": \"" +
+                                       string(TEST_ADDRESS_FAIL) + "\","
+                                       "  \"port\": " +
+                                       string(TEST_PORT) + "}]}"))));
+    EXPECT_EQ(1, server.getWorkerCount());
+    EXPECT_EQ(1, workers.getWorkerCount());
+
+    EXPECT_EQ(0, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"worker_threads\": 2}"))));
+    EXPECT_EQ(2, server.getWorkerCount());
+    EXPECT_EQ(2, workers.getWorkerCount());
+
+    // Shrinking (and so abandoning the queries of the removed worker)
+    EXPECT_EQ(0, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"worker_threads\": 1}"))));
+    EXPECT_EQ(1, server.getWorkerCount());
+    EXPECT_EQ(1, workers.getWorkerCount());
+}
+
+TEST_F(ResolverConfig, queryCaptureConfig) {
+    const char* const capture_file = "resolver_test.cap";
+    // No capture by default
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+
+    EXPECT_EQ(0, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"query_capture\": {"
+                                       " \"output\": \"resolver_test.cap\","
+                                       " \"sample_rate\": 4}}"))));
+    ASSERT_TRUE(server.getQueryCapture() != NULL);
+    EXPECT_EQ(capture_file, server.getQueryCapture()->getSink().getName());
+    EXPECT_EQ(0, access(capture_file, F_OK));
+
+    const QueryCapture* const capture = server.getQueryCapture();
+
+    // Bad values are rejected and keep the current capture
+    EXPECT_EQ(1, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"query_capture\": {"
+                                       " \"output\": \"resolver_test.cap\","
+                                       " \"output_type\": \"pipe\"}}"))));
+    EXPECT_EQ(capture, server.getQueryCapture());
+
+    // So does a failure of the rest of the configuration
+    ScopedSocket sock(createSocket(TEST_ADDRESS, TEST_PORT));
+    EXPECT_EQ(1, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"query_capture\": {"
+                                       " \"output\": \"resolver_test.cap\"},"
+                                       " \"listen_on\": ["
+                                       " {\"address\": \"" +
+                                       string(TEST_ADDRESS_FAIL) + "\","
+                                       "  \"port\": " +
+                                       string(TEST_PORT) + "}]}"))));
+    EXPECT_EQ(capture, server.getQueryCapture());
+
+    // An empty output disables it
+    EXPECT_EQ(0, getResultCode(server.updateConfig(
+                                   Element::fromJSON(
+                                       "{\"query_capture\": {"
+                                       " \"output\": \"\"}}"))));
+    EXPECT_TRUE(server.getQueryCapture() == NULL);
+    unlink(capture_file);
+}
+
 }
@@ -0,0 +1,175 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <resolver/worker_pool.h>
+
+#include <asiolink/io_service.h>
+#include <util/threads/sync.h>
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+using namespace bundy::asiolink;
+using namespace bundy::util::thread;
+
+namespace {
+
+class WorkerPoolTest : public ::testing::Test {
+protected:
+    WorkerPoolTest() :
+        pool_(service_, NULL, NULL),
+        seen_(0),
+        done_(false)
+    {}
+
+public:
+    // Run inside a worker, records which worker it thinks it is.
+    void record() {
+        Mutex::Locker locker(mutex_);
+        seen_ = pool_.getCurrentWorker();
+        done_ = true;
+        cond_.signal();
+    }
+
+    void waitDone() {
+        Mutex::Locker locker(mutex_);
+        while (!done_) {
+            cond_.wait(mutex_);
+        }
+        done_ = false;
+    }
+
+protected:
+    IOService service_;
+    WorkerPool pool_;
+    Mutex mutex_;
+    CondVar cond_;
+    size_t seen_;
+    bool done_;
+};
+
+TEST_F(WorkerPoolTest, defaults) {
+    EXPECT_EQ(1, pool_.getWorkerCount());
+    EXPECT_EQ(WorkerPool::SHARED, pool_.getSteeringPolicy());
+    EXPECT_FALSE(pool_.isRunning());
+    // The main worker uses the main service
+    EXPECT_EQ(&service_, &pool_.getIOService());
+    EXPECT_EQ(&service_, &pool_.getWorkerService(0).getIOService());
+    // The main thread is worker 0
+    EXPECT_EQ(0, pool_.getCurrentWorker());
+    EXPECT_THROW(pool_.getWorkerService(1), bundy::OutOfRange);
+}
+
+TEST_F(WorkerPoolTest, steeringFromText) {
+    EXPECT_EQ(WorkerPool::SHARED,
+              WorkerPool::steeringPolicyFromText("shared"));
+    EXPECT_EQ(WorkerPool::PER_SOCKET,
+              WorkerPool::steeringPolicyFromText("per-socket"));
+    EXPECT_THROW(WorkerPool::steeringPolicyFromText("random"),
+                 bundy::BadValue);
+}
+
+TEST_F(WorkerPoolTest, workerCount) {
+    EXPECT_THROW(pool_.setWorkerCount(0), bundy::BadValue);
+    pool_.setWorkerCount(3);
+    EXPECT_EQ(3, pool_.getWorkerCount());
+    // Each worker has its own service
+    EXPECT_NE(&pool_.getWorkerService(1).getIOService(),
+              &pool_.getWorkerService(2).getIOService());
+    EXPECT_NE(&service_, &pool_.getWorkerService(1).getIOService());
+
+    pool_.start();
+    EXPECT_TRUE(pool_.isRunning());
+    // Can't change the running workers
+    EXPECT_THROW(pool_.setWorkerCount(2), bundy::InvalidOperation);
+    pool_.stop();
+    EXPECT_FALSE(pool_.isRunning());
+
+    pool_.setWorkerCount(1);
+    EXPECT_EQ(1, pool_.getWorkerCount());
+}
+
+// The events of a worker are handled in its own thread, which knows which
+// worker it is.
+TEST_F(WorkerPoolTest, currentWorker) {
+    pool_.setWorkerCount(3);
+    pool_.start();
+    for (size_t i = 1; i < 3; ++i) {
+        pool_.getWorkerService(i).getIOService().post(
+            boost::bind(&WorkerPoolTest::record, this));
+        waitDone();
+        EXPECT_EQ(i, seen_);
+    }
+
+    // Events posted while the workers are stopped are handled after
+    // they are started again.
+    pool_.stop();
+    pool_.getWorkerService(2).getIOService().post(
+        boost::bind(&WorkerPoolTest::record, this));
+    pool_.start();
+    waitDone();
+    EXPECT_EQ(2, seen_);
+}
+
+// The handlers of stopped workers can be run by the caller, still as the
+// worker they belong to.
+TEST_F(WorkerPoolTest, poll) {
+    pool_.setWorkerCount(3);
+    EXPECT_THROW(pool_.poll(0), bundy::BadValue);
+    pool_.start();
+    EXPECT_THROW(pool_.poll(1), bundy::InvalidOperation);
+    pool_.stop();
+
+    pool_.getWorkerService(2).getIOService().post(
+        boost::bind(&WorkerPoolTest::record, this));
+    pool_.poll(1);
+    EXPECT_TRUE(done_);
+    EXPECT_EQ(2, seen_);
+    // Back to the main worker
+    EXPECT_EQ(0, pool_.getCurrentWorker());
+    done_ = false;
+
+    // Nothing is left for the threads once they are started
+    pool_.start();
+    pool_.stop();
+    EXPECT_FALSE(done_);
+}
+
+TEST_F(WorkerPoolTest, addServers) {
+    pool_.setWorkerCount(2);
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(-1, fd);
+    // Sockets can be added only to stopped workers
+    pool_.start();
+    EXPECT_THROW(pool_.addServerUDPFromFD(fd, AF_INET),
+                 bundy::InvalidOperation);
+    pool_.stop();
+    // Both policies accept the socket (the pool takes the ownership)
+    EXPECT_NO_THROW(pool_.addServerUDPFromFD(fd, AF_INET));
+    pool_.setSteeringPolicy(WorkerPool::PER_SOCKET);
+    const int fd2 = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(-1, fd2);
+    EXPECT_NO_THROW(pool_.addServerUDPFromFD(fd2, AF_INET));
+    EXPECT_NO_THROW(pool_.clearServers());
+}
+
+}
@@ -0,0 +1,324 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <resolver/worker_pool.h>
+#include "resolver_log.h"
+
+#include <util/threads/thread.h>
+
+#include <asio.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <cstring>
+
+using namespace bundy::asiolink;
+using namespace bundy::asiodns;
+using bundy::util::thread::Thread;
+
+/// \brief One worker of the pool
+///
+/// Holds the IOService, the DNSService with the servers of this worker and
+/// the thread running them.  The main worker uses the IOService of the
+/// program and has no thread.
+class WorkerPool::Worker : boost::noncopyable {
+public:
+    // The main worker
+    Worker(IOService& service, DNSLookup* lookup, DNSAnswer* answer) :
+        index_(0), service_(service),
+        dns_service_(service, lookup, answer)
+    {}
+
+    // A threaded worker
+    Worker(size_t index, DNSLookup* lookup, DNSAnswer* answer) :
+        index_(index), own_service_(new IOService),
+        service_(*own_service_),
+        dns_service_(service_, lookup, answer)
+    {}
+
+    ~Worker() {
+        stop();
+        // The servers must go before the IOService they use
+        dns_service_.clearServers();
+        if (own_service_) {
+            // Deliver the cancellations, so the objects waiting for them
+            // can go away before the IOService.
+            pollReady();
+        }
+    }
+
+    void start(pthread_key_t key) {
+        if (index_ == 0 || thread_) {
+            return;
+        }
+        service_.get_io_service().reset();
+        work_.reset(new asio::io_service::work(service_.get_io_service()));
+        thread_.reset(new Thread(boost::bind(&Worker::run, this, key)));
+    }
+
+    void stop() {
+        if (!thread_) {
+            return;
+        }
+        work_.reset();
+        service_.stop();
+        thread_->wait();
+        thread_.reset();
+    }
+
+    // Run the ready handlers in the calling thread, with the thread stopped
+    void poll(pthread_key_t key) {
+        pthread_setspecific(key, reinterpret_cast<void*>(
+                                     static_cast<uintptr_t>(index_ + 1)));
+        pollReady();
+        pthread_setspecific(key, NULL);
+    }
+
+    DNSService& getDNSService() {
+        return (dns_service_);
+    }
+
+private:
+    void run(pthread_key_t key) {
+        // The index is stored shifted by one, so an unset key (NULL)
+        // means the main worker.
+        pthread_setspecific(key, reinterpret_cast<void*>(
+                                     static_cast<uintptr_t>(index_ + 1)));
+        LOG_DEBUG(resolver_logger, RESOLVER_DBG_INIT,
+                  RESOLVER_WORKER_STARTED).arg(index_);
+        for (;;) {
+            try {
+                service_.run();
+                break;
+            } catch (const std::exception& ex) {
+                // Same as in the main loop, but we don't want to lose
+                // the worker, so we just log and continue.
+                LOG_ERROR(resolver_logger, RESOLVER_WORKER_FAILED).
+                    arg(index_).arg(ex.what());
+            }
+        }
+        LOG_DEBUG(resolver_logger, RESOLVER_DBG_INIT,
+                  RESOLVER_WORKER_STOPPED).arg(index_);
+    }
+
+    void pollReady() {
+        service_.get_io_service().reset();
+        try {
+            service_.get_io_service().poll();
+        } catch (const std::exception& ex) {
+            LOG_ERROR(resolver_logger, RESOLVER_WORKER_FAILED).
+                arg(index_).arg(ex.what());
+        }
+    }
+
+    const size_t index_;
+    boost::scoped_ptr<IOService> own_service_;
+    IOService& service_;
+    DNSService dns_service_;
+    boost::scoped_ptr<asio::io_service::work> work_;
+    boost::scoped_ptr<Thread> thread_;
+};
+
+WorkerPool::WorkerPool(IOService& main_service, DNSLookup* lookup,
+                       DNSAnswer* answer) :
+    main_service_(main_service),
+    lookup_(lookup),
+    answer_(answer),
+    policy_(SHARED),
+    next_worker_(0),
+    tcp_recv_timeout_(5000),
+    running_(false)
+{
+    const int result = pthread_key_create(&current_key_, NULL);
+    if (result != 0) {
+        bundy_throw(bundy::Unexpected, "Failed to create thread key: " <<
+                    std::strerror(result));
+    }
+    workers_.push_back(new Worker(main_service_, lookup_, answer_));
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+    // Destroy in the reverse order, the main one last
+    while (!workers_.empty()) {
+        delete workers_.back();
+        workers_.pop_back();
+    }
+    pthread_key_delete(current_key_);
+}
+
+void
+WorkerPool::setWorkerCount(size_t count) {
+    if (count == 0) {
+        bundy_throw(bundy::BadValue, "At least one worker is needed");
+    }
+    if (running_) {
+        bundy_throw(bundy::InvalidOperation,
+                    "Can't change the number of running workers");
+    }
+    LOG_DEBUG(resolver_logger, RESOLVER_DBG_CONFIG, RESOLVER_SET_WORKERS).
+        arg(count);
+    clearServers();
+    while (workers_.size() > count) {
+        delete workers_.back();
+        workers_.pop_back();
+    }
+    while (workers_.size() < count) {
+        Worker* worker(new Worker(workers_.size(), lookup_, answer_));
+        workers_.push_back(worker);
+        worker->getDNSService().setTCPRecvTimeout(tcp_recv_timeout_);
+    }
+}
+
+WorkerPool::SteeringPolicy
+WorkerPool::steeringPolicyFromText(const std::string& text) {
+    if (text == "shared") {
+        return (SHARED);
+    } else if (text == "per-socket") {
+        return (PER_SOCKET);
+    }
+    bundy_throw(bundy::BadValue, "Unknown query steering policy: " << text);
+}
+
+DNSServiceBase&
+WorkerPool::getWorkerService(size_t index) {
+    if (index >= workers_.size()) {
+        bundy_throw(bundy::OutOfRange, "Worker index out of range: " <<
+                    index);
+    }
+    return (workers_[index]->getDNSService());
+}
+
+size_t
+WorkerPool::getCurrentWorker() const {
+    const void* value(pthread_getspecific(current_key_));
+    if (value == NULL) {
+        return (0);
+    }
+    return (static_cast<size_t>(reinterpret_cast<uintptr_t>(value)) - 1);
+}
+
+void
+WorkerPool::start() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->start(current_key_);
+    }
+    running_ = true;
+}
+
+void
+WorkerPool::poll(size_t first) {
+    if (first == 0) {
+        bundy_throw(bundy::BadValue, "The main worker can't be polled");
+    }
+    if (running_) {
+        bundy_throw(bundy::InvalidOperation,
+                    "Can't poll running workers");
+    }
+    for (size_t i = first; i < workers_.size(); ++i) {
+        workers_[i]->poll(current_key_);
+    }
+}
+
+void
+WorkerPool::stop() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->stop();
+    }
+    running_ = false;
+}
+
+std::vector<size_t>
+WorkerPool::selectWorkers() {
+    std::vector<size_t> result;
+    if (policy_ == SHARED) {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            result.push_back(i);
+        }
+    } else {
+        result.push_back(next_worker_ % workers_.size());
+        ++next_worker_;
+    }
+    return (result);
+}
+
+int
+WorkerPool::workerFD(int fd, size_t index) {
+    if (index == 0) {
+        return (fd);
+    }
+    const int result = dup(fd);
+    if (result == -1) {
+        bundy_throw(bundy::Unexpected, "Failed to duplicate socket: " <<
+                    std::strerror(errno));
+    }
+    return (result);
+}
+
+// The servers of the other workers are manipulated from the main thread,
+// which is safe only with the workers stopped.  The asio sockets are not
+// thread safe.
+
+void
+WorkerPool::addServerTCPFromFD(int fd, int af) {
+    if (running_) {
+        bundy_throw(bundy::InvalidOperation,
+                    "Can't add servers to running workers");
+    }
+    const std::vector<size_t> selected(selectWorkers());
+    for (size_t i = 0; i < selected.size(); ++i) {
+        workers_[selected[i]]->getDNSService().
+            addServerTCPFromFD(workerFD(fd, i), af);
+    }
+}
+
+void
+WorkerPool::addServerUDPFromFD(int fd, int af, ServerFlag options) {
+    if (running_) {
+        bundy_throw(bundy::InvalidOperation,
+                    "Can't add servers to running workers");
+    }
+    const std::vector<size_t> selected(selectWorkers());
+    for (size_t i = 0; i < selected.size(); ++i) {
+        workers_[selected[i]]->getDNSService().
+            addServerUDPFromFD(workerFD(fd, i), af, options);
+    }
+}
+
+void
+WorkerPool::clearServers() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->getDNSService().clearServers();
+    }
+    next_worker_ = 0;
+}
+
+void
+WorkerPool::setTCPRecvTimeout(size_t timeout) {
+    tcp_recv_timeout_ = timeout;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->getDNSService().setTCPRecvTimeout(timeout);
+    }
+}
+
+IOService&
+WorkerPool::getIOService() {
+    return (main_service_);
+}
@@ -0,0 +1,195 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef RESOLVER_WORKER_POOL_H
+#define RESOLVER_WORKER_POOL_H 1
+
+#include <asiodns/dns_service.h>
+#include <asiodns/dns_lookup.h>
+#include <asiodns/dns_answer.h>
+#include <asiolink/io_service.h>
+#include <exceptions/exceptions.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+/// \brief A set of threads serving DNS queries
+///
+/// The resolver can run several worker threads, each of them with its own
+/// IOService and its own set of listening sockets, so the recursion does
+/// not top out at a single core.  The first worker (index 0) is not a real
+/// thread, it is the main IOService of the program, which also runs the
+/// configuration session.  The other workers run in their own threads.
+///
+/// The pool behaves as a \c DNSServiceBase, so it can be passed to the
+/// code installing the listen addresses.  The sockets it gets are
+/// distributed between the workers according to the steering policy:
+/// - \c SHARED Every worker gets every socket (the additional ones get
+///   a dup()ed descriptor) and the kernel picks the worker that receives
+///   each query.
+/// - \c PER_SOCKET Each socket is served by exactly one worker, sockets
+///   are assigned round robin.  This needs at least as many listen
+///   addresses as workers to keep all of them busy, but avoids waking up
+///   several threads for a single query.
+///
+/// The data structures shared between the workers (the cache, the NSAS)
+/// must be thread safe, everything else (the recursive queries themselves)
+/// lives in a single worker.  Reconfiguration must be done from the main
+/// thread with the other workers stopped (see \c stop() and \c start()).
+class WorkerPool : public bundy::asiodns::DNSServiceBase,
+    private boost::noncopyable {
+public:
+    /// \brief The way queries are steered to the workers
+    enum SteeringPolicy {
+        SHARED,        ///< All workers listen on all sockets
+        PER_SOCKET     ///< Each socket belongs to one worker
+    };
+
+    /// \brief Constructor
+    ///
+    /// Creates a pool with a single worker, running on the given service.
+    ///
+    /// \param main_service The IOService of the main thread.
+    /// \param lookup The lookup provider for the DNS servers.
+    /// \param answer The answer provider for the DNS servers.
+    WorkerPool(bundy::asiolink::IOService& main_service,
+               bundy::asiodns::DNSLookup* lookup,
+               bundy::asiodns::DNSAnswer* answer);
+
+    /// \brief Destructor
+    ///
+    /// Stops all the worker threads.
+    virtual ~WorkerPool();
+
+    /// \brief Change the number of workers
+    ///
+    /// All the servers are removed, the caller must install the listen
+    /// addresses again.  Must be called with the workers stopped.
+    ///
+    /// Whatever is pending in the removed workers when their servers are
+    /// closed is cancelled and delivered, but nothing more; the caller
+    /// should have their queries answered and \c poll()ed before.
+    ///
+    /// \throw bundy::BadValue if count is 0.
+    /// \throw bundy::InvalidOperation if the workers are running.
+    void setWorkerCount(size_t count);
+
+    /// \brief Number of workers, including the main one
+    size_t getWorkerCount() const {
+        return (workers_.size());
+    }
+
+    /// \brief Change the steering policy
+    ///
+    /// As with \c setWorkerCount(), the change takes effect for the sockets
+    /// added afterwards.
+    void setSteeringPolicy(SteeringPolicy policy) {
+        policy_ = policy;
+    }
+
+    /// \brief Current steering policy
+    SteeringPolicy getSteeringPolicy() const {
+        return (policy_);
+    }
+
+    /// \brief Convert the textual form of the policy, as used in the
+    ///     configuration.
+    ///
+    /// \throw bundy::BadValue for unknown policy name.
+    static SteeringPolicy steeringPolicyFromText(const std::string& text);
+
+    /// \brief The DNS service of the given worker
+    ///
+    /// This is what per-worker objects (like the RecursiveQuery) should use.
+    bundy::asiodns::DNSServiceBase& getWorkerService(size_t index);
+
+    /// \brief The index of the worker running the calling thread
+    ///
+    /// Any thread not belonging to the pool (including the main one) is
+    /// considered to be worker 0.
+    size_t getCurrentWorker() const;
+
+    /// \brief Start the worker threads
+    ///
+    /// The main worker is not started, the caller runs its IOService.
+    /// Starting already running workers is a no-op.
+    void start();
+
+    /// \brief Stop the worker threads and wait for them to terminate
+    ///
+    /// The pending events stay in the IOServices and are handled once
+    /// the workers are started again.  Stopping the stopped workers is
+    /// a no-op.
+    void stop();
+
+    /// \brief Run the ready handlers of the stopped workers
+    ///
+    /// The handlers of the workers from the given index on are run in the
+    /// calling thread, as if they ran in the thread of their worker (see
+    /// \c getCurrentWorker()).  This is used to deliver what is pending
+    /// (like answers to the clients) before the workers are removed.
+    ///
+    /// \param first The index of the first worker, must not be 0 (the main
+    ///     worker's IOService is run by the caller).
+    /// \throw bundy::InvalidOperation if the workers are running.
+    /// \throw bundy::BadValue if first is 0.
+    void poll(size_t first);
+
+    /// \brief Are the worker threads running?
+    bool isRunning() const {
+        return (running_);
+    }
+
+    /// \name DNSServiceBase interface
+    //@{
+    virtual void addServerTCPFromFD(int fd, int af);
+    virtual void addServerUDPFromFD(int fd, int af,
+                                    ServerFlag options = SERVER_DEFAULT);
+    virtual void clearServers();
+    virtual void setTCPRecvTimeout(size_t timeout);
+    /// Returns the IOService of the main worker.
+    virtual bundy::asiolink::IOService& getIOService();
+    //@}
+
+private:
+    class Worker;
+
+    // Returns the indices of the workers that should serve the next
+    // socket, according to the steering policy.
+    std::vector<size_t> selectWorkers();
+
+    // Returns a descriptor for the index-th of the selected workers,
+    // the first one gets the original.
+    static int workerFD(int fd, size_t index);
+
+    bundy::asiolink::IOService& main_service_;
+    bundy::asiodns::DNSLookup* lookup_;
+    bundy::asiodns::DNSAnswer* answer_;
+    std::vector<Worker*> workers_;
+    SteeringPolicy policy_;
+    size_t next_worker_;
+    size_t tcp_recv_timeout_;
+    bool running_;
+    pthread_key_t current_key_;
+};
+
+#endif // RESOLVER_WORKER_POOL_H
+
+// Local Variables:
+// mode: c++
+// End:
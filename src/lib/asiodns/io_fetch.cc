@@ -40,6 +40,8 @@
 #include <dns/rcode.h>
 
 #include <asiodns/io_fetch.h>
+#include <asiodns/udp_socket_pool.h>
+#include <asiodns/tcp_connection_pool.h>
 
 #include <util/buffer.h>
 #include <util/random/qid_gen.h>
@@ -101,6 +103,11 @@ struct IOFetchData {
     uint8_t                     staging[IOFetch::STAGING_LENGTH];
                                             ///< Temporary array for received data
     bundy::dns::qid_t             qid;         ///< The QID set in the query
+    boost::shared_ptr<UDPSocketPool> pool;   ///< Where the socket came from
+    UDPSocketPool::EntryPtr     pooled;      ///< The socket from the pool
+    boost::shared_ptr<TCPConnectionPool> connections;
+                                     ///< Where to send TCP queries through
+    TCPConnectionPool::RequestPtr request; ///< The query sent through it
 
     /// \brief Constructor
     ///
@@ -153,6 +160,16 @@ struct IOFetchData {
         qid(QidGenerator::getInstance().generateQid())
     {}
 
+    // All the copies of the IOFetch are gone, so there's no outstanding
+    // I/O on the socket any more and it can be reused.
+    ~IOFetchData() {
+        if (pooled) {
+            // The wrapper refers to the pooled socket, get rid of it first
+            socket.reset();
+            pool->release(pooled);
+        }
+    }
+
     // Checks if the response we received was ok;
     // - data contains the buffer we read, as well as the address
     // we sent to and the address we received from.
@@ -239,6 +256,32 @@ IOFetch::getProtocol() const {
     return (data_->protocol);
 }
 
+void
+IOFetch::setSocketPool(const boost::shared_ptr<UDPSocketPool>& pool) {
+    if (data_->protocol != UDP || data_->pooled) {
+        return;
+    }
+    try {
+        data_->pooled = pool->acquire(data_->remote_snd->getFamily());
+    } catch (const asio::system_error& ex) {
+        // Keep the own socket, it'll report the problem when opened
+        LOG_DEBUG(logger, DBG_IMPORTANT, ASIODNS_SOCKET_POOL_FAIL).
+            arg(data_->remote_snd->getAddress().toText()).
+            arg(data_->remote_snd->getPort()).arg(ex.what());
+        return;
+    }
+    data_->pool = pool;
+    data_->socket.reset(new UDPSocket<IOFetch>(data_->pooled->socket));
+}
+
+void
+IOFetch::setConnectionPool(const boost::shared_ptr<TCPConnectionPool>& pool)
+{
+    if (data_->protocol == TCP) {
+        data_->connections = pool;
+    }
+}
+
 /// The function operator is implemented with the "stackless coroutine"
 /// pattern; see internal/coroutine.h for details.
 
@@ -275,6 +318,19 @@ IOFetch::operator()(asio::error_code ec, size_t length) {
                 TIME_OUT));
         }
 
+        if (data_->connections) {
+            // The pool takes care of the connection and of matching the
+            // answer to the query, so once it calls back, we're done.
+            data_->origin = ASIODNS_SEND_DATA;
+            CORO_YIELD data_->request = data_->connections->send(
+                data_->remote_snd->getAddress(), data_->remote_snd->getPort(),
+                data_->msgbuf, data_->received, *this);
+            data_->cumulative = length;
+            data_->origin = ASIODNS_UNKNOWN_ORIGIN;
+            stop(SUCCESS);
+            return;
+        }
+
         // Open a connection to the target system.  For speed, if the operation
         // is synchronous (i.e. UDP operation) we bypass the yield.
         data_->origin = ASIODNS_OPEN_SOCKET;
@@ -310,18 +366,26 @@ IOFetch::operator()(asio::error_code ec, size_t length) {
             // received all the data before copying it back to the user's buffer.
             // And we want to minimise the amount of copying...
     
-            data_->origin = ASIODNS_READ_DATA;
-            data_->cumulative = 0;          // No data yet received
-            data_->offset = 0;              // First data into start of buffer
-            data_->received->clear();       // Clear the receive buffer
+            //
+            // A UDP datagram that doesn't match the query (a late answer to
+            // an earlier query that used the same socket, or a spoofing
+            // attempt) is dropped and we keep waiting for the real answer
+            // until the timer fires.  Sending the query again would only
+            // produce duplicate upstream queries.
             do {
-                CORO_YIELD data_->socket->asyncReceive(data_->staging,
-                                                       static_cast<size_t>(STAGING_LENGTH),
-                                                       data_->offset,
-                                                       data_->remote_rcv.get(), *this);
-            } while (!data_->socket->processReceivedData(data_->staging, length,
-                                                         data_->cumulative, data_->offset,
-                                                         data_->expected, data_->received));
+                data_->origin = ASIODNS_READ_DATA;
+                data_->cumulative = 0;      // No data yet received
+                data_->offset = 0;          // First data into start of buffer
+                data_->received->clear();   // Clear the receive buffer
+                do {
+                    CORO_YIELD data_->socket->asyncReceive(data_->staging,
+                                                           static_cast<size_t>(STAGING_LENGTH),
+                                                           data_->offset,
+                                                           data_->remote_rcv.get(), *this);
+                } while (!data_->socket->processReceivedData(data_->staging, length,
+                                                             data_->cumulative, data_->offset,
+                                                             data_->expected, data_->received));
+            } while (data_->protocol == UDP && !data_->responseOK());
         } while (!data_->responseOK());
 
         // Finished with this socket, so close it.  This will not generate an
@@ -390,6 +454,9 @@ IOFetch::stop(Result result) {
         // and cancel the timer.
         data_->socket->cancel();
         data_->socket->close();
+        if (data_->request) {
+            data_->connections->cancel(data_->request);
+        }
 
         data_->timer.cancel();
 
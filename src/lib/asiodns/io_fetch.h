@@ -36,6 +36,8 @@ namespace asiodns {
 
 // Forward declarations
 struct IOFetchData;
+class UDPSocketPool;
+class TCPConnectionPool;
 
 /// \brief Upstream Fetch Processing
 ///
@@ -184,6 +186,29 @@ public:
     /// \return Protocol associated with this IOFetch object.
     Protocol getProtocol() const;
 
+    /// \brief Use a socket from the pool
+    ///
+    /// By default a UDP fetch opens its own socket and closes it when done.
+    /// With a pool, it takes an already opened one and returns it to the
+    /// pool once the fetch is over.  This must be called before the fetch
+    /// is started.  It has no effect on TCP fetches.
+    ///
+    /// \param pool The pool to take the socket from.  The fetch holds the
+    ///     pool until it is destroyed.
+    void setSocketPool(const boost::shared_ptr<UDPSocketPool>& pool);
+
+    /// \brief Use a pooled connection
+    ///
+    /// By default a TCP fetch opens its own connection and closes it when
+    /// done.  With a pool, the query is sent over one of the connections
+    /// the pool keeps open to the server, possibly together with other
+    /// queries.  This must be called before the fetch is started.  It has
+    /// no effect on UDP fetches.
+    ///
+    /// \param pool The pool to send the query through.  The fetch holds the
+    ///     pool until it is destroyed.
+    void setConnectionPool(const boost::shared_ptr<TCPConnectionPool>& pool);
+
     /// \brief Coroutine entry point
     ///
     /// The operator() method is the method in which the coroutine code enters
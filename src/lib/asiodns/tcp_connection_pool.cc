@@ -0,0 +1,488 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <asiodns/tcp_connection_pool.h>
+#include <asiodns/logger.h>
+#include <util/io_utilities.h>
+
+#include <asio.hpp>
+#include <asio/deadline_timer.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+using namespace bundy::asiolink;
+using namespace bundy::util;
+
+namespace bundy {
+namespace asiodns {
+
+namespace {
+// Debug level of the pool messages
+const int DBG_POOL = DBGLVL_TRACE_BASIC;
+}
+
+const size_t TCPConnectionPool::DEFAULT_MAX_CONNECTIONS;
+const size_t TCPConnectionPool::DEFAULT_MAX_PIPELINE;
+const int TCPConnectionPool::DEFAULT_IDLE_TIMEOUT;
+
+struct TCPConnectionPool::Request {
+    Request(const IOAddress& addr, uint16_t server_port,
+            const OutputBufferPtr& query_data,
+            const OutputBufferPtr& answer_data,
+            const TCPConnectionPool::Handler& callback) :
+        address(addr), port(server_port), query(query_data),
+        answer(answer_data), handler(callback), done(false), resent(false)
+    {
+        // The ID is the first two octets of the query
+        qid = query->getLength() >= 2 ?
+            readUint16(query->getData(), query->getLength()) : 0;
+        length[0] = (query->getLength() >> 8) & 0xff;
+        length[1] = query->getLength() & 0xff;
+    }
+
+    // Call the handler (if it wasn't called yet).  The handler is released
+    // here, as it usually refers to the object holding this request.
+    void complete(const asio::error_code& error, size_t size) {
+        if (!done) {
+            done = true;
+            TCPConnectionPool::Handler callback;
+            callback.swap(handler);
+            callback(error, size);
+        }
+    }
+
+    const IOAddress address;
+    const uint16_t port;
+    const OutputBufferPtr query;
+    const OutputBufferPtr answer;
+    TCPConnectionPool::Handler handler;
+    uint16_t qid;
+    uint8_t length[2];          // The TCP length prefix of the query
+    bool done;                  // Answered, failed or cancelled
+    bool resent;                // Already sent over a new connection
+    boost::weak_ptr<TCPConnection> connection;
+};
+
+/// \brief One connection of the pool
+///
+/// Requests are written one after another as they come and an answer is
+/// read whenever one arrives.  Every asynchronous operation holds a shared
+/// pointer to the connection, so it lives until the last of them is done.
+class TCPConnection : public boost::enable_shared_from_this<TCPConnection>,
+                      boost::noncopyable
+{
+public:
+    TCPConnection(TCPConnectionPool& pool, IOService& service,
+                  const IOAddress& address, uint16_t port) :
+        pool_(&pool),
+        socket_(service.get_io_service()),
+        timer_(service.get_io_service()),
+        address_(address.toText()),
+        endpoint_(asio::ip::address::from_string(address_), port),
+        connected_(false),
+        writing_(false),
+        closed_(false)
+    {}
+
+    // Start connecting.  Requests can be added right away, they're sent
+    // once connected.
+    void start() {
+        armTimer();
+        socket_.async_connect(endpoint_,
+                              boost::bind(&TCPConnection::connected,
+                                          shared_from_this(), _1));
+    }
+
+    bool has(uint16_t qid) const {
+        return (pending_.count(qid) != 0);
+    }
+
+    size_t outstanding() const {
+        return (pending_.size());
+    }
+
+    void add(const TCPConnectionPool::RequestPtr& request) {
+        pending_[request->qid] = request;
+        request->connection = shared_from_this();
+        writes_.push_back(request);
+        if (connected_) {
+            // Not idle any more
+            timer_.cancel();
+            write();
+        }
+    }
+
+    // The request was cancelled, no need to wait for its answer
+    void forget(const TCPConnectionPool::RequestPtr& request) {
+        const std::map<uint16_t, TCPConnectionPool::RequestPtr>::iterator
+            it = pending_.find(request->qid);
+        if (it != pending_.end() && it->second == request) {
+            pending_.erase(it);
+            if (pending_.empty() && connected_) {
+                armTimer();
+            }
+            pool_->released(this);
+        }
+    }
+
+    // The pool is going away
+    void detach() {
+        pool_ = NULL;
+        fail(asio::error::operation_aborted);
+    }
+
+    const std::string& getAddress() const {
+        return (address_);
+    }
+
+    uint16_t getPort() const {
+        return (endpoint_.port());
+    }
+
+private:
+    void connected(const asio::error_code& error) {
+        if (error) {
+            fail(error);
+            return;
+        }
+        connected_ = true;
+        timer_.cancel();
+        // Queries are often written while an earlier one is still not
+        // acknowledged, don't let them wait for that.
+        asio::error_code ignored;
+        socket_.set_option(asio::ip::tcp::no_delay(true), ignored);
+        readLength();
+        if (pending_.empty()) {
+            armTimer();
+        }
+        write();
+    }
+
+    // Write the next queued request, unless a write is in progress
+    void write() {
+        while (!writing_ && !closed_ && !writes_.empty()) {
+            const TCPConnectionPool::RequestPtr request(writes_.front());
+            if (request->done) {
+                writes_.pop_front();
+                continue;
+            }
+            std::vector<asio::const_buffer> buffers;
+            buffers.push_back(asio::buffer(request->length,
+                                           sizeof(request->length)));
+            buffers.push_back(asio::buffer(request->query->getData(),
+                                           request->query->getLength()));
+            writing_ = true;
+            asio::async_write(socket_, buffers,
+                              boost::bind(&TCPConnection::written,
+                                          shared_from_this(), _1));
+        }
+    }
+
+    void written(const asio::error_code& error) {
+        writing_ = false;
+        if (error) {
+            fail(error);
+            return;
+        }
+        writes_.pop_front();
+        write();
+    }
+
+    void readLength() {
+        asio::async_read(socket_, asio::buffer(length_, sizeof(length_)),
+                         boost::bind(&TCPConnection::lengthRead,
+                                     shared_from_this(), _1));
+    }
+
+    void lengthRead(const asio::error_code& error) {
+        if (error) {
+            fail(error);
+            return;
+        }
+        body_.resize((length_[0] << 8) | length_[1]);
+        if (body_.empty()) {
+            // Not a DNS message, but nothing to read either
+            readLength();
+            return;
+        }
+        asio::async_read(socket_, asio::buffer(&body_[0], body_.size()),
+                         boost::bind(&TCPConnection::bodyRead,
+                                     shared_from_this(), _1));
+    }
+
+    void bodyRead(const asio::error_code& error) {
+        if (error) {
+            fail(error);
+            return;
+        }
+        if (body_.size() >= 2) {
+            const uint16_t qid = (body_[0] << 8) | body_[1];
+            const std::map<uint16_t, TCPConnectionPool::RequestPtr>::iterator
+                it = pending_.find(qid);
+            // Anything else is an answer to a cancelled query, drop it
+            if (it != pending_.end()) {
+                const TCPConnectionPool::RequestPtr request(it->second);
+                pending_.erase(it);
+                request->answer->clear();
+                request->answer->writeData(&body_[0], body_.size());
+                request->complete(asio::error_code(), body_.size());
+            }
+        }
+        if (closed_) {
+            // The handler above may have destroyed the pool
+            return;
+        }
+        if (pending_.empty()) {
+            armTimer();
+        }
+        readLength();
+        // A query waiting for this ID may go now
+        pool_->released(this);
+    }
+
+    void armTimer() {
+        if (pool_ == NULL) {
+            return;
+        }
+        timer_.expires_from_now(
+            boost::posix_time::milliseconds(pool_->getIdleTimeout()));
+        timer_.async_wait(boost::bind(&TCPConnection::timeout,
+                                      shared_from_this(), _1));
+    }
+
+    void timeout(const asio::error_code& error) {
+        // Cancelled, or re-armed after this one was queued
+        if (error || closed_ ||
+            timer_.expires_at() > asio::deadline_timer::traits_type::now()) {
+            return;
+        }
+        // Either idle for too long or we failed to connect in time
+        if (!connected_ || pending_.empty()) {
+            fail(asio::error::timed_out);
+        }
+    }
+
+    // Close the connection and give the unanswered requests back
+    void fail(const asio::error_code& error) {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        asio::error_code ignored;
+        socket_.close(ignored);
+        timer_.cancel();
+
+        std::vector<TCPConnectionPool::RequestPtr> unanswered;
+        for (std::map<uint16_t, TCPConnectionPool::RequestPtr>::
+             const_iterator it = pending_.begin(); it != pending_.end();
+             ++it) {
+            unanswered.push_back(it->second);
+        }
+        pending_.clear();
+        writes_.clear();
+
+        if (pool_ != NULL) {
+            // Only requests sent over a working connection are worth
+            // sending again, the server may have just closed it as idle.
+            pool_->closed(this, unanswered, error,
+                          connected_ && error != asio::error::timed_out);
+        } else {
+            for (size_t i = 0; i < unanswered.size(); ++i) {
+                unanswered[i]->complete(error, 0);
+            }
+        }
+    }
+
+    TCPConnectionPool* pool_;
+    asio::ip::tcp::socket socket_;
+    asio::deadline_timer timer_;
+    const std::string address_;
+    const asio::ip::tcp::endpoint endpoint_;
+    bool connected_;
+    bool writing_;
+    bool closed_;
+    std::map<uint16_t, TCPConnectionPool::RequestPtr> pending_;
+    std::deque<TCPConnectionPool::RequestPtr> writes_;
+    uint8_t length_[2];
+    std::vector<uint8_t> body_;
+};
+
+TCPConnectionPool::TCPConnectionPool(IOService& service,
+                                     size_t max_connections,
+                                     size_t max_pipeline, int idle_timeout) :
+    service_(service),
+    max_connections_(max_connections),
+    max_pipeline_(max_pipeline),
+    idle_timeout_(idle_timeout),
+    connects_(0),
+    queries_(0)
+{}
+
+TCPConnectionPool::~TCPConnectionPool() {
+    // Detaching removes nothing from the map any more, so iterate over a
+    // copy for clarity.
+    const ConnectionMap connections(connections_);
+    connections_.clear();
+    const WaitingMap waiting(waiting_);
+    waiting_.clear();
+    for (ConnectionMap::const_iterator it = connections.begin();
+         it != connections.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            it->second[i]->detach();
+        }
+    }
+    for (WaitingMap::const_iterator it = waiting.begin();
+         it != waiting.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            it->second[i]->complete(asio::error::operation_aborted, 0);
+        }
+    }
+}
+
+TCPConnectionPool::RequestPtr
+TCPConnectionPool::send(const IOAddress& address, uint16_t port,
+                        const OutputBufferPtr& query,
+                        const OutputBufferPtr& answer,
+                        const Handler& handler)
+{
+    const RequestPtr request(new Request(address, port, query, answer,
+                                         handler));
+    ++queries_;
+    dispatch(request);
+    return (request);
+}
+
+void
+TCPConnectionPool::dispatch(const RequestPtr& request) {
+    std::vector<TCPConnectionPtr>& connections =
+        connections_[Key(request->address.toText(), request->port)];
+
+    // The least busy connection that doesn't wait for an answer with the
+    // same ID already (the answers would be indistinguishable).
+    TCPConnectionPtr best;
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (!connections[i]->has(request->qid) &&
+            (!best || connections[i]->outstanding() < best->outstanding())) {
+            best = connections[i];
+        }
+    }
+    if (!best && connections.size() >= max_connections_) {
+        // Every connection waits for an answer with this ID and we may
+        // not open another one.  Wait until one of them gets the answer.
+        waiting_[Key(request->address.toText(), request->port)].
+            push_back(request);
+        return;
+    }
+    if (!best || (best->outstanding() >= max_pipeline_ &&
+                  connections.size() < max_connections_)) {
+        best.reset(new TCPConnection(*this, service_, request->address,
+                                     request->port));
+        connections.push_back(best);
+        ++connects_;
+        best->start();
+    }
+    best->add(request);
+}
+
+void
+TCPConnectionPool::cancel(const RequestPtr& request) {
+    if (request->done) {
+        return;
+    }
+    request->done = true;
+    request->handler.clear();
+    const TCPConnectionPtr connection(request->connection.lock());
+    if (connection) {
+        connection->forget(request);
+    }
+}
+
+void
+TCPConnectionPool::released(TCPConnection* connection) {
+    dispatchWaiting(Key(connection->getAddress(), connection->getPort()));
+}
+
+void
+TCPConnectionPool::dispatchWaiting(const Key& key) {
+    const WaitingMap::iterator it = waiting_.find(key);
+    if (it == waiting_.end()) {
+        return;
+    }
+    // Those that still can't go are put back by dispatch(), in the same
+    // order.
+    std::deque<RequestPtr> waiting;
+    waiting.swap(it->second);
+    waiting_.erase(it);
+    for (size_t i = 0; i < waiting.size(); ++i) {
+        // Cancelled ones are simply dropped
+        if (!waiting[i]->done) {
+            dispatch(waiting[i]);
+        }
+    }
+}
+
+size_t
+TCPConnectionPool::getConnectionCount() const {
+    size_t count = 0;
+    for (ConnectionMap::const_iterator it = connections_.begin();
+         it != connections_.end(); ++it) {
+        count += it->second.size();
+    }
+    return (count);
+}
+
+void
+TCPConnectionPool::closed(TCPConnection* connection,
+                          const std::vector<RequestPtr>& unanswered,
+                          const asio::error_code& error, bool resend)
+{
+    LOG_DEBUG(logger, DBG_POOL, ASIODNS_TCP_POOL_CLOSED).
+        arg(connection->getAddress()).arg(connection->getPort()).
+        arg(error.message()).arg(unanswered.size());
+
+    const Key key(connection->getAddress(), connection->getPort());
+    const ConnectionMap::iterator it = connections_.find(key);
+    if (it != connections_.end()) {
+        std::vector<TCPConnectionPtr>& connections = it->second;
+        for (size_t i = 0; i < connections.size(); ++i) {
+            if (connections[i].get() == connection) {
+                connections.erase(connections.begin() + i);
+                break;
+            }
+        }
+        if (connections.empty()) {
+            connections_.erase(it);
+        }
+    }
+    // A new connection may be opened for the waiting requests now.  Do
+    // it before calling back, the handlers may destroy the pool.
+    dispatchWaiting(key);
+
+    for (size_t i = 0; i < unanswered.size(); ++i) {
+        if (resend && !unanswered[i]->resent) {
+            unanswered[i]->resent = true;
+            dispatch(unanswered[i]);
+        } else {
+            unanswered[i]->complete(error, 0);
+        }
+    }
+}
+
+} // namespace asiodns
+} // namespace bundy
@@ -0,0 +1,184 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef TCP_CONNECTION_POOL_H
+#define TCP_CONNECTION_POOL_H 1
+
+#include <asiolink/io_address.h>
+#include <asiolink/io_service.h>
+#include <util/buffer.h>
+
+#include <asio/error_code.hpp>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bundy {
+namespace asiodns {
+
+class TCPConnection;
+
+/// \brief Pool of persistent TCP connections to upstream servers
+///
+/// Opening a new TCP connection for every query costs a full round trip
+/// (and more when the server is far away) before the query can even be
+/// sent.  This pool keeps the connections to each upstream server open and
+/// sends several queries over each of them at once, matching the answers
+/// to the queries by their ID.
+///
+/// For each server there are at most \c getMaxConnections() connections.
+/// A query goes to the connection with the fewest outstanding queries;
+/// a new connection is opened only when all of them have
+/// \c getMaxPipeline() queries outstanding.  A connection nobody used for
+/// \c getIdleTimeout() milliseconds is closed.  Queries with the same ID
+/// can't share a connection (the answers would be indistinguishable); if
+/// every connection already waits for an answer with the ID of a new query
+/// and no other connection can be opened, the query waits until one of
+/// them gets that answer.
+///
+/// If the server closes a connection with queries still outstanding (as
+/// servers do with connections they consider idle), those queries are
+/// sent once more over a new connection.
+///
+/// The pool is not thread safe, it is meant to be owned by one
+/// RecursiveQuery and used from the thread running its IOService.
+class TCPConnectionPool : boost::noncopyable {
+public:
+    /// \brief Called when a query is answered or failed
+    ///
+    /// The size_t argument is the length of the answer.
+    typedef boost::function<void(asio::error_code, size_t)> Handler;
+
+    /// \brief An outstanding query
+    struct Request;
+    typedef boost::shared_ptr<Request> RequestPtr;
+
+    /// \brief Constructor
+    ///
+    /// \param service The IOService the connections use.
+    /// \param max_connections Connections to one server.
+    /// \param max_pipeline Outstanding queries on one connection before
+    ///     another one is opened.
+    /// \param idle_timeout After how many milliseconds an unused connection
+    ///     is closed.
+    TCPConnectionPool(bundy::asiolink::IOService& service,
+                      size_t max_connections = DEFAULT_MAX_CONNECTIONS,
+                      size_t max_pipeline = DEFAULT_MAX_PIPELINE,
+                      int idle_timeout = DEFAULT_IDLE_TIMEOUT);
+
+    /// \brief Destructor
+    ///
+    /// Closes all the connections.  Queries still outstanding (or waiting
+    /// for a connection) fail with \c asio::error::operation_aborted.
+    ~TCPConnectionPool();
+
+    /// \brief Send a query
+    ///
+    /// \param address Address of the server.
+    /// \param port Port of the server.
+    /// \param query The query in wire format (without the TCP length
+    ///     prefix).  It must not change until the handler is called.
+    /// \param answer The answer is stored here.
+    /// \param handler Called once the answer is received or the query
+    ///     fails.  It is never called from within this method.
+    /// \return The request, to be passed to cancel().
+    RequestPtr send(const bundy::asiolink::IOAddress& address, uint16_t port,
+                    const bundy::util::OutputBufferPtr& query,
+                    const bundy::util::OutputBufferPtr& answer,
+                    const Handler& handler);
+
+    /// \brief Give up a query
+    ///
+    /// The handler of the request will not be called.  Cancelling a request
+    /// that is already finished does nothing.
+    void cancel(const RequestPtr& request);
+
+    /// \brief Number of connections opened so far
+    uint64_t getConnectCount() const {
+        return (connects_);
+    }
+
+    /// \brief Number of queries sent so far
+    uint64_t getQueryCount() const {
+        return (queries_);
+    }
+
+    /// \brief Number of connections currently open (or being opened)
+    size_t getConnectionCount() const;
+
+    /// \brief Maximum number of connections to one server
+    size_t getMaxConnections() const {
+        return (max_connections_);
+    }
+
+    /// \brief Outstanding queries on a connection before opening another
+    size_t getMaxPipeline() const {
+        return (max_pipeline_);
+    }
+
+    /// \brief Milliseconds after which an unused connection is closed
+    int getIdleTimeout() const {
+        return (idle_timeout_);
+    }
+
+    /// Default number of connections to one server
+    static const size_t DEFAULT_MAX_CONNECTIONS = 2;
+    /// Default number of outstanding queries on a connection
+    static const size_t DEFAULT_MAX_PIPELINE = 32;
+    /// Default idle timeout in milliseconds
+    static const int DEFAULT_IDLE_TIMEOUT = 10000;
+
+private:
+    friend class TCPConnection;
+    typedef boost::shared_ptr<TCPConnection> TCPConnectionPtr;
+    typedef std::pair<std::string, uint16_t> Key;
+    typedef std::map<Key, std::vector<TCPConnectionPtr> > ConnectionMap;
+    typedef std::map<Key, std::deque<RequestPtr> > WaitingMap;
+
+    // Put the request on a suitable connection, opening one if needed.
+    // If there's none and no more can be opened, the request waits.
+    void dispatch(const RequestPtr& request);
+    // Called by a connection when it no longer waits for some answer.
+    // The requests waiting for the server are dispatched once more.
+    void released(TCPConnection* connection);
+    // Dispatch the requests waiting for the given server.
+    void dispatchWaiting(const Key& key);
+    // Called by a connection when it's closed.  The requests it didn't
+    // answer are given back, to be sent again if resend is true.
+    void closed(TCPConnection* connection,
+                const std::vector<RequestPtr>& unanswered,
+                const asio::error_code& error, bool resend);
+
+    bundy::asiolink::IOService& service_;
+    const size_t max_connections_;
+    const size_t max_pipeline_;
+    const int idle_timeout_;
+    ConnectionMap connections_;
+    WaitingMap waiting_;
+    uint64_t connects_;
+    uint64_t queries_;
+};
+
+} // namespace asiodns
+} // namespace bundy
+
+#endif // TCP_CONNECTION_POOL_H
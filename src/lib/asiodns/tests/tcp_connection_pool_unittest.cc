@@ -0,0 +1,423 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <asiodns/tcp_connection_pool.h>
+#include <asiodns/io_fetch.h>
+#include <asiolink/io_address.h>
+#include <asiolink/io_service.h>
+
+#include <dns/name.h>
+#include <dns/question.h>
+#include <dns/rrclass.h>
+#include <dns/rrtype.h>
+#include <util/buffer.h>
+#include <util/io_utilities.h>
+
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <asio.hpp>
+
+#include <vector>
+
+using namespace bundy::asiodns;
+using namespace bundy::asiolink;
+using namespace bundy::dns;
+using namespace bundy::util;
+using namespace asio::ip;
+
+namespace {
+
+const char* const TEST_HOST = "127.0.0.1";
+const uint16_t TEST_PORT = 5303;
+
+/// A TCP server answering queries by sending them back with the QR bit set.
+///
+/// It collects the queries until it has \c batch of them and answers them
+/// in reverse order, so the answers come in a different order than the
+/// queries were sent.
+class TestServer {
+public:
+    struct Connection {
+        Connection(asio::io_service& service) : socket(service) {}
+        tcp::socket socket;
+        uint8_t length[2];
+        std::vector<uint8_t> data;
+    };
+    typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+    TestServer(IOService& service) :
+        service_(service.get_io_service()),
+        acceptor_(service_),
+        accepted_(0),
+        batch_(1),
+        drop_(false)
+    {
+        const tcp::endpoint endpoint(address::from_string(TEST_HOST),
+                                     TEST_PORT);
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+        accept();
+    }
+
+    void accept() {
+        const ConnectionPtr connection(new Connection(service_));
+        acceptor_.async_accept(connection->socket,
+                               boost::bind(&TestServer::accepted, this,
+                                           connection, _1));
+    }
+
+    void accepted(ConnectionPtr connection, asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        ++accepted_;
+        connection->socket.set_option(tcp::no_delay(true));
+        connections_.push_back(connection);
+        readLength(connection);
+        accept();
+    }
+
+    void readLength(ConnectionPtr connection) {
+        asio::async_read(connection->socket,
+                         asio::buffer(connection->length, 2),
+                         boost::bind(&TestServer::lengthRead, this,
+                                     connection, _1));
+    }
+
+    void lengthRead(ConnectionPtr connection, asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        connection->data.resize((connection->length[0] << 8) |
+                                connection->length[1]);
+        asio::async_read(connection->socket,
+                         asio::buffer(connection->data),
+                         boost::bind(&TestServer::dataRead, this,
+                                     connection, _1));
+    }
+
+    void dataRead(ConnectionPtr connection, asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        if (drop_) {
+            // Pretend we closed the connection as idle just when the
+            // query arrived.
+            drop_ = false;
+            connection->socket.close();
+            return;
+        }
+        queries_.push_back(std::make_pair(connection, connection->data));
+        if (queries_.size() >= batch_) {
+            while (!queries_.empty()) {
+                std::vector<uint8_t> answer(queries_.back().second);
+                answer[2] |= 0x80;
+                const uint8_t length[2] = {
+                    static_cast<uint8_t>(answer.size() >> 8),
+                    static_cast<uint8_t>(answer.size() & 0xff) };
+                asio::write(queries_.back().first->socket,
+                            asio::buffer(length, 2));
+                asio::write(queries_.back().first->socket,
+                            asio::buffer(answer));
+                queries_.pop_back();
+            }
+        }
+        readLength(connection);
+    }
+
+    asio::io_service& service_;
+    tcp::acceptor acceptor_;
+    std::vector<ConnectionPtr> connections_;
+    std::vector<std::pair<ConnectionPtr, std::vector<uint8_t> > > queries_;
+    size_t accepted_;
+    size_t batch_;          // Answer once this many queries arrived
+    bool drop_;             // Close the connection on the next query
+};
+
+class TCPConnectionPoolTest : public ::testing::Test {
+protected:
+    TCPConnectionPoolTest() :
+        server_(service_),
+        pool_(new TCPConnectionPool(service_)),
+        done_(0),
+        expected_(1)
+    {}
+
+    // A minimal query with the given ID
+    OutputBufferPtr query(uint16_t qid) {
+        OutputBufferPtr buffer(new OutputBuffer(12));
+        buffer->writeUint16(qid);
+        for (size_t i = 0; i < 10; ++i) {
+            buffer->writeUint8(0);
+        }
+        return (buffer);
+    }
+
+    // The ID of an answer
+    static uint16_t qidOf(const OutputBufferPtr& answer) {
+        return (readUint16(answer->getData(), answer->getLength()));
+    }
+
+    TCPConnectionPool::RequestPtr send(uint16_t qid,
+                                       uint16_t port = TEST_PORT)
+    {
+        answers_.push_back(OutputBufferPtr(new OutputBuffer(0)));
+        return (pool_->send(IOAddress(TEST_HOST), port, query(qid),
+                            answers_.back(),
+                            boost::bind(&TCPConnectionPoolTest::answered,
+                                        this, _1, _2)));
+    }
+
+    void answered(asio::error_code ec, size_t length) {
+        errors_.push_back(ec);
+        lengths_.push_back(length);
+        if (++done_ == expected_) {
+            service_.stop();
+        }
+    }
+
+    IOService service_;
+    TestServer server_;
+    boost::shared_ptr<TCPConnectionPool> pool_;
+    std::vector<OutputBufferPtr> answers_;
+    std::vector<asio::error_code> errors_;
+    std::vector<size_t> lengths_;
+    size_t done_;
+    size_t expected_;
+};
+
+TEST_F(TCPConnectionPoolTest, defaults) {
+    EXPECT_EQ(TCPConnectionPool::DEFAULT_MAX_CONNECTIONS,
+              pool_->getMaxConnections());
+    EXPECT_EQ(TCPConnectionPool::DEFAULT_MAX_PIPELINE,
+              pool_->getMaxPipeline());
+    EXPECT_EQ(TCPConnectionPool::DEFAULT_IDLE_TIMEOUT,
+              pool_->getIdleTimeout());
+    EXPECT_EQ(0, pool_->getConnectionCount());
+}
+
+// Several queries are sent over one connection at once and the answers,
+// coming in the opposite order, are matched by ID.
+TEST_F(TCPConnectionPoolTest, pipeline) {
+    expected_ = server_.batch_ = 5;
+    for (uint16_t qid = 1; qid <= 5; ++qid) {
+        send(qid);
+    }
+    // Nothing is called back before it's answered
+    EXPECT_EQ(0, done_);
+    EXPECT_EQ(1, pool_->getConnectionCount());
+    service_.run();
+
+    ASSERT_EQ(5, done_);
+    for (size_t i = 0; i < 5; ++i) {
+        EXPECT_FALSE(errors_[i]);
+        EXPECT_EQ(12, lengths_[i]);
+        ASSERT_EQ(12, answers_[i]->getLength());
+        // The answer to our query, with QR set
+        EXPECT_EQ(i + 1, qidOf(answers_[i]));
+        EXPECT_EQ(0x80, (*answers_[i])[2]);
+    }
+    EXPECT_EQ(1, server_.accepted_);
+    EXPECT_EQ(1, pool_->getConnectCount());
+    EXPECT_EQ(5, pool_->getQueryCount());
+}
+
+// The connection stays open for the following queries
+TEST_F(TCPConnectionPoolTest, reuse) {
+    send(1);
+    service_.run();
+    expected_ = 2;
+    service_.get_io_service().reset();
+    send(2);
+    service_.run();
+
+    EXPECT_EQ(2, done_);
+    EXPECT_EQ(1, server_.accepted_);
+    EXPECT_EQ(1, pool_->getConnectCount());
+    EXPECT_EQ(1, pool_->getConnectionCount());
+}
+
+// Another connection is opened when the first one is busy
+TEST_F(TCPConnectionPoolTest, busy) {
+    pool_.reset(new TCPConnectionPool(service_, 2, 2));
+    expected_ = server_.batch_ = 5;
+    for (uint16_t qid = 1; qid <= 5; ++qid) {
+        send(qid);
+    }
+    // Two connections at most, the rest is queued on them
+    EXPECT_EQ(2, pool_->getConnectionCount());
+    service_.run();
+
+    EXPECT_EQ(5, done_);
+    EXPECT_EQ(2, server_.accepted_);
+}
+
+// Queries with the same ID can't share a connection
+TEST_F(TCPConnectionPoolTest, sameID) {
+    expected_ = server_.batch_ = 2;
+    send(1);
+    send(1);
+    EXPECT_EQ(2, pool_->getConnectionCount());
+    service_.run();
+
+    EXPECT_EQ(2, done_);
+    EXPECT_FALSE(errors_[0]);
+    EXPECT_FALSE(errors_[1]);
+}
+
+// When all the connections wait for an answer with the ID, the query
+// waits for one of them instead of opening yet another connection
+TEST_F(TCPConnectionPoolTest, sameIDLimit) {
+    pool_.reset(new TCPConnectionPool(service_, 2));
+    expected_ = 3;
+    send(1);
+    send(1);
+    send(1);
+    EXPECT_EQ(2, pool_->getConnectionCount());
+    service_.run();
+
+    ASSERT_EQ(3, done_);
+    for (size_t i = 0; i < 3; ++i) {
+        EXPECT_FALSE(errors_[i]);
+        EXPECT_EQ(1, qidOf(answers_[i]));
+    }
+    EXPECT_EQ(2, server_.accepted_);
+    EXPECT_EQ(2, pool_->getConnectCount());
+}
+
+// A waiting query can be cancelled and fails when the pool is destroyed
+TEST_F(TCPConnectionPoolTest, sameIDWaiting) {
+    pool_.reset(new TCPConnectionPool(service_, 1));
+    server_.batch_ = 2;
+    send(1);
+    pool_->cancel(send(1));
+    send(1);
+    EXPECT_EQ(1, pool_->getConnectionCount());
+    pool_.reset();
+
+    // Only the first and the last one are called back
+    ASSERT_EQ(2, done_);
+    EXPECT_EQ(asio::error::operation_aborted, errors_[0]);
+    EXPECT_EQ(asio::error::operation_aborted, errors_[1]);
+}
+
+// A cancelled query isn't called back (nor sent, if it wasn't sent yet)
+TEST_F(TCPConnectionPoolTest, cancel) {
+    pool_->cancel(send(1));
+    send(2);
+    service_.run();
+
+    ASSERT_EQ(1, done_);
+    EXPECT_EQ(2, qidOf(answers_[1]));
+    EXPECT_EQ(0, answers_[0]->getLength());
+}
+
+// A query unanswered when the server closes the connection is sent again
+TEST_F(TCPConnectionPoolTest, resend) {
+    send(1);
+    service_.run();
+    service_.get_io_service().reset();
+
+    server_.drop_ = true;
+    expected_ = 2;
+    send(2);
+    service_.run();
+
+    ASSERT_EQ(2, done_);
+    EXPECT_FALSE(errors_[1]);
+    EXPECT_EQ(2, qidOf(answers_[1]));
+    EXPECT_EQ(2, server_.accepted_);
+    EXPECT_EQ(2, pool_->getConnectCount());
+}
+
+// Failure to connect is reported
+TEST_F(TCPConnectionPoolTest, connectFail) {
+    send(1, TEST_PORT + 1);
+    service_.run();
+
+    ASSERT_EQ(1, done_);
+    EXPECT_TRUE(errors_[0]);
+    EXPECT_EQ(0, pool_->getConnectionCount());
+}
+
+// Unused connections get closed
+TEST_F(TCPConnectionPoolTest, idle) {
+    pool_.reset(new TCPConnectionPool(service_, 2, 32, 10));
+    send(1);
+    service_.run();
+    EXPECT_EQ(1, pool_->getConnectionCount());
+
+    // Let the idle timer expire
+    service_.get_io_service().reset();
+    asio::deadline_timer timer(service_.get_io_service());
+    timer.expires_from_now(boost::posix_time::milliseconds(50));
+    timer.wait();
+    service_.get_io_service().poll();
+    EXPECT_EQ(0, pool_->getConnectionCount());
+}
+
+// Destroying the pool fails the outstanding queries
+TEST_F(TCPConnectionPoolTest, destroy) {
+    server_.batch_ = 2;
+    send(1);
+    pool_.reset();
+
+    ASSERT_EQ(1, done_);
+    EXPECT_EQ(asio::error::operation_aborted, errors_[0]);
+}
+
+// IOFetch sends TCP queries through the pool
+class PoolIOFetchTest : public TCPConnectionPoolTest,
+                        public IOFetch::Callback
+{
+protected:
+    PoolIOFetchTest() :
+        question_(Name("example.org"), RRClass::IN(), RRType::A()),
+        result_(new OutputBuffer(0))
+    {}
+
+    virtual void operator()(IOFetch::Result result) {
+        results_.push_back(result);
+        if (++done_ == expected_) {
+            service_.stop();
+        }
+    }
+
+    Question question_;
+    OutputBufferPtr result_;
+    std::vector<IOFetch::Result> results_;
+};
+
+TEST_F(PoolIOFetchTest, fetch) {
+    expected_ = server_.batch_ = 3;
+    for (size_t i = 0; i < 3; ++i) {
+        IOFetch fetch(IOFetch::TCP, service_, question_, IOAddress(TEST_HOST),
+                      TEST_PORT, result_, this, 1000);
+        fetch.setConnectionPool(pool_);
+        service_.post(fetch);
+    }
+    service_.run();
+
+    ASSERT_EQ(3, results_.size());
+    for (size_t i = 0; i < 3; ++i) {
+        EXPECT_EQ(IOFetch::SUCCESS, results_[i]);
+    }
+    EXPECT_EQ(1, server_.accepted_);
+    EXPECT_EQ(3, pool_->getQueryCount());
+}
+
+}
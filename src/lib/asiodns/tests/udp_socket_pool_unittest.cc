@@ -0,0 +1,316 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <asiodns/udp_socket_pool.h>
+#include <asiodns/io_fetch.h>
+#include <asiolink/io_address.h>
+#include <asiolink/io_service.h>
+
+#include <dns/message.h>
+#include <dns/messagerenderer.h>
+#include <dns/name.h>
+#include <dns/opcode.h>
+#include <dns/question.h>
+#include <dns/rcode.h>
+#include <util/buffer.h>
+
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <asio.hpp>
+
+#include <set>
+#include <sys/socket.h>
+
+using namespace bundy::asiodns;
+using namespace bundy::asiolink;
+using namespace bundy::dns;
+using namespace bundy::util;
+using namespace asio::ip;
+
+namespace {
+
+const char* const TEST_HOST = "127.0.0.1";
+const uint16_t TEST_PORT = 5302;
+
+// A returned socket is handed out again instead of opening a new one
+TEST(UDPSocketPoolTest, reuse) {
+    IOService service;
+    UDPSocketPool pool(service);
+
+    UDPSocketPool::EntryPtr entry(pool.acquire(AF_INET));
+    ASSERT_TRUE(entry);
+    EXPECT_TRUE(entry->socket.is_open());
+    EXPECT_EQ(1, entry->uses);
+    EXPECT_EQ(1, pool.getOpenedCount());
+    EXPECT_EQ(0, pool.getIdleCount(AF_INET));
+
+    const uint16_t port = entry->socket.local_endpoint().port();
+    EXPECT_NE(0, port);
+    pool.release(entry);
+    EXPECT_EQ(1, pool.getIdleCount(AF_INET));
+
+    UDPSocketPool::EntryPtr again(pool.acquire(AF_INET));
+    EXPECT_EQ(entry, again);
+    EXPECT_EQ(port, again->socket.local_endpoint().port());
+    EXPECT_EQ(2, again->uses);
+    EXPECT_EQ(1, pool.getOpenedCount());
+    EXPECT_EQ(2, pool.getAcquiredCount());
+}
+
+// Sockets in use at the same time are distinct
+TEST(UDPSocketPoolTest, concurrent) {
+    IOService service;
+    UDPSocketPool pool(service);
+
+    std::set<uint16_t> ports;
+    std::vector<UDPSocketPool::EntryPtr> entries;
+    for (size_t i = 0; i < 10; ++i) {
+        entries.push_back(pool.acquire(AF_INET));
+        ports.insert(entries.back()->socket.local_endpoint().port());
+    }
+    EXPECT_EQ(10, pool.getOpenedCount());
+    // Randomly chosen ports, they all differ (and nothing is sequential
+    // enough to be guessed; we don't test for that, though).
+    EXPECT_EQ(10, ports.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pool.release(entries[i]);
+    }
+    EXPECT_EQ(10, pool.getIdleCount(AF_INET));
+}
+
+// The socket is replaced after the configured number of uses
+TEST(UDPSocketPoolTest, retire) {
+    IOService service;
+    UDPSocketPool pool(service, UDPSocketPool::DEFAULT_MAX_IDLE, 3);
+    EXPECT_EQ(3, pool.getMaxUses());
+
+    UDPSocketPool::EntryPtr first(pool.acquire(AF_INET));
+    pool.release(first);
+    pool.release(pool.acquire(AF_INET));
+    UDPSocketPool::EntryPtr last(pool.acquire(AF_INET));
+    EXPECT_EQ(first, last);
+    EXPECT_EQ(3, last->uses);
+    pool.release(last);
+    // Worn out, closed and dropped
+    EXPECT_FALSE(last->socket.is_open());
+    EXPECT_EQ(0, pool.getIdleCount(AF_INET));
+
+    UDPSocketPool::EntryPtr fresh(pool.acquire(AF_INET));
+    EXPECT_NE(first, fresh);
+    EXPECT_EQ(2, pool.getOpenedCount());
+}
+
+// No more than max_idle sockets are kept
+TEST(UDPSocketPoolTest, maxIdle) {
+    IOService service;
+    UDPSocketPool pool(service, 2);
+
+    UDPSocketPool::EntryPtr e1(pool.acquire(AF_INET));
+    UDPSocketPool::EntryPtr e2(pool.acquire(AF_INET));
+    UDPSocketPool::EntryPtr e3(pool.acquire(AF_INET));
+    pool.release(e1);
+    pool.release(e2);
+    pool.release(e3);
+    EXPECT_EQ(2, pool.getIdleCount(AF_INET));
+    EXPECT_FALSE(e3->socket.is_open());
+}
+
+// Families are kept apart
+TEST(UDPSocketPoolTest, families) {
+    IOService service;
+    UDPSocketPool pool(service);
+
+    UDPSocketPool::EntryPtr entry(pool.acquire(AF_INET));
+    pool.release(entry);
+    EXPECT_EQ(1, pool.getIdleCount(AF_INET));
+    EXPECT_EQ(0, pool.getIdleCount(AF_INET6));
+    try {
+        UDPSocketPool::EntryPtr entry6(pool.acquire(AF_INET6));
+        EXPECT_TRUE(entry6->socket.local_endpoint().address().is_v6());
+        EXPECT_NE(entry, entry6);
+    } catch (const asio::system_error&) {
+        // No IPv6 on this system, nothing to check
+    }
+}
+
+// Datagrams left over from the previous query are thrown away
+TEST(UDPSocketPoolTest, drain) {
+    IOService service;
+    UDPSocketPool pool(service);
+
+    UDPSocketPool::EntryPtr entry(pool.acquire(AF_INET));
+    udp::socket sender(service.get_io_service(), udp::v4());
+    const uint8_t data[] = { 1, 2, 3, 4 };
+    sender.send_to(asio::buffer(data, sizeof(data)),
+                   udp::endpoint(address::from_string(TEST_HOST),
+                                 entry->socket.local_endpoint().port()));
+    // Make sure it has arrived
+    while (entry->socket.available() == 0) {
+        ;
+    }
+    pool.release(entry);
+    EXPECT_EQ(0, entry->socket.available());
+    EXPECT_EQ(1, pool.getIdleCount(AF_INET));
+}
+
+// Datagrams that arrive while the socket is idle are thrown away too
+TEST(UDPSocketPoolTest, drainIdle) {
+    IOService service;
+    UDPSocketPool pool(service);
+
+    UDPSocketPool::EntryPtr entry(pool.acquire(AF_INET));
+    pool.release(entry);
+    udp::socket sender(service.get_io_service(), udp::v4());
+    const uint8_t data[] = { 1, 2, 3, 4 };
+    sender.send_to(asio::buffer(data, sizeof(data)),
+                   udp::endpoint(address::from_string(TEST_HOST),
+                                 entry->socket.local_endpoint().port()));
+    while (entry->socket.available() == 0) {
+        ;
+    }
+    EXPECT_EQ(entry, pool.acquire(AF_INET));
+    EXPECT_EQ(0, entry->socket.available());
+}
+
+/// Answers every query and counts the fetches done
+class PoolFetchTest : public ::testing::Test, public IOFetch::Callback {
+protected:
+    PoolFetchTest() :
+        server_(service_.get_io_service(), udp::v4()),
+        pool_(new UDPSocketPool(service_)),
+        result_(new OutputBuffer(512)),
+        done_(0),
+        queries_(0),
+        mismatch_(false)
+    {
+        server_.set_option(asio::socket_base::reuse_address(true));
+        server_.bind(udp::endpoint(address::from_string(TEST_HOST),
+                                   TEST_PORT));
+        receive();
+    }
+
+    void receive() {
+        server_.async_receive_from(asio::buffer(buffer_, sizeof(buffer_)),
+                                   remote_,
+                                   boost::bind(&PoolFetchTest::answer, this,
+                                               _1, _2));
+    }
+
+    void answer(asio::error_code ec, size_t length) {
+        if (ec) {
+            return;
+        }
+        ++queries_;
+        InputBuffer ibuffer(buffer_, length);
+        Message query(Message::PARSE);
+        query.fromWire(ibuffer);
+        if (mismatch_) {
+            // Something looking like a late answer to an earlier query
+            // comes first.
+            respond(query, query.getQid() + 1);
+        }
+        respond(query, query.getQid());
+        receive();
+    }
+
+    void respond(const Message& query, qid_t qid) {
+        Message response(Message::RENDER);
+        response.setQid(qid);
+        response.setHeaderFlag(Message::HEADERFLAG_QR);
+        response.setOpcode(Opcode::QUERY());
+        response.setRcode(Rcode::NOERROR());
+        response.addQuestion(*query.beginQuestion());
+        MessageRenderer renderer;
+        response.toWire(renderer);
+        server_.send_to(asio::buffer(renderer.getData(),
+                                     renderer.getLength()), remote_);
+    }
+
+    // Send the next query, or stop when we're done
+    virtual void operator()(IOFetch::Result result) {
+        EXPECT_EQ(IOFetch::SUCCESS, result);
+        if (++done_ < fetch_count_) {
+            service_.post(boost::bind(&PoolFetchTest::fetch, this));
+        } else {
+            service_.stop();
+        }
+    }
+
+    void fetch() {
+        IOFetch query(IOFetch::UDP, service_,
+                      Question(Name("example.org"), RRClass::IN(),
+                               RRType::A()),
+                      IOAddress(TEST_HOST), TEST_PORT, result_, this, 1000);
+        query.setSocketPool(pool_);
+        service_.post(query);
+    }
+
+    IOService service_;
+    udp::socket server_;
+    udp::endpoint remote_;
+    uint8_t buffer_[512];
+    boost::shared_ptr<UDPSocketPool> pool_;
+    OutputBufferPtr result_;
+    size_t done_;
+    size_t fetch_count_;
+    size_t queries_;        // Queries the server got
+    bool mismatch_;         // Send a non-matching answer before each answer
+};
+
+// Consecutive fetches share the one socket
+TEST_F(PoolFetchTest, sequential) {
+    fetch_count_ = 10;
+    fetch();
+    service_.run();
+
+    EXPECT_EQ(10, done_);
+    EXPECT_EQ(1, pool_->getOpenedCount());
+    EXPECT_EQ(10, pool_->getAcquiredCount());
+}
+
+// A late answer waiting on an idle socket doesn't disturb the next fetch
+TEST_F(PoolFetchTest, lateDatagram) {
+    UDPSocketPool::EntryPtr entry(pool_->acquire(AF_INET));
+    pool_->release(entry);
+    udp::socket sender(service_.get_io_service(), udp::v4());
+    const uint8_t data[] = { 1, 2, 3, 4 };
+    sender.send_to(asio::buffer(data, sizeof(data)),
+                   udp::endpoint(address::from_string(TEST_HOST),
+                                 entry->socket.local_endpoint().port()));
+    while (entry->socket.available() == 0) {
+        ;
+    }
+
+    fetch_count_ = 1;
+    fetch();
+    service_.run();
+
+    EXPECT_EQ(1, done_);
+    EXPECT_EQ(1, queries_);
+    EXPECT_EQ(1, pool_->getOpenedCount());
+}
+
+// A datagram not matching the query is skipped without sending the query
+// again
+TEST_F(PoolFetchTest, mismatchedAnswer) {
+    mismatch_ = true;
+    fetch_count_ = 3;
+    fetch();
+    service_.run();
+
+    EXPECT_EQ(3, done_);
+    EXPECT_EQ(3, queries_);
+}
+
+}
@@ -0,0 +1,190 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <asiodns/udp_socket_pool.h>
+#include <asiodns/logger.h>
+
+#include <asio.hpp>
+
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace bundy::asiolink;
+
+namespace bundy {
+namespace asiodns {
+
+namespace {
+// Ports below this one are not used as source ports.
+const int MIN_PORT = 1024;
+const int MAX_PORT = 65535;
+// Size of the buffer for draining stale data.
+const size_t DRAIN_SIZE = 4096;
+}
+
+const size_t UDPSocketPool::DEFAULT_MAX_IDLE;
+const size_t UDPSocketPool::DEFAULT_MAX_USES;
+const size_t UDPSocketPool::BIND_ATTEMPTS;
+const int UDPSocketPool::MIN_BUFFER_SIZE;
+
+UDPSocketPool::UDPSocketPool(IOService& service, size_t max_idle,
+                             size_t max_uses) :
+    service_(service),
+    max_idle_(max_idle),
+    max_uses_(max_uses),
+    opened_(0),
+    acquired_(0)
+{
+    // Several pools may be created at the same time (one per resolver
+    // worker), so mix in more than just the time.
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    generator_.seed(static_cast<uint32_t>((tv.tv_sec * 1000000) +
+                                          tv.tv_usec) ^
+                    static_cast<uint32_t>(getpid() << 16) ^
+                    static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)));
+}
+
+int
+UDPSocketPool::random(int min, int max) {
+    boost::uniform_int<> dist(min, max);
+    boost::variate_generator<boost::mt19937&, boost::uniform_int<> >
+        gen(generator_, dist);
+    return (gen());
+}
+
+std::vector<UDPSocketPool::EntryPtr>&
+UDPSocketPool::idleList(int family) {
+    return (family == AF_INET6 ? idle6_ : idle4_);
+}
+
+size_t
+UDPSocketPool::getIdleCount(int family) const {
+    return (family == AF_INET6 ? idle6_.size() : idle4_.size());
+}
+
+UDPSocketPool::EntryPtr
+UDPSocketPool::open(int family) {
+    EntryPtr entry(new Entry(service_.get_io_service()));
+    const asio::ip::udp protocol(family == AF_INET6 ? asio::ip::udp::v6() :
+                                 asio::ip::udp::v4());
+    entry->socket.open(protocol);
+    const asio::ip::address any(family == AF_INET6 ?
+                                asio::ip::address(asio::ip::address_v6::any()) :
+                                asio::ip::address(asio::ip::address_v4::any()));
+    bool bound = false;
+    for (size_t i = 0; i < BIND_ATTEMPTS && !bound; ++i) {
+        asio::error_code ec;
+        entry->socket.bind(asio::ip::udp::endpoint(any,
+                                                   random(MIN_PORT, MAX_PORT)),
+                           ec);
+        bound = !ec;
+    }
+    if (!bound) {
+        // Too many ports in use, let the kernel pick one.
+        LOG_DEBUG(logger, DBGLVL_TRACE_BASIC, ASIODNS_SOCKET_POOL_BIND_ANY);
+        entry->socket.bind(asio::ip::udp::endpoint(any, 0));
+    }
+    // Same as UDPSocket does for its own sockets
+    asio::ip::udp::socket::send_buffer_size snd_size;
+    entry->socket.get_option(snd_size);
+    if (snd_size.value() < MIN_BUFFER_SIZE) {
+        entry->socket.set_option(
+            asio::ip::udp::socket::send_buffer_size(MIN_BUFFER_SIZE));
+    }
+    asio::ip::udp::socket::receive_buffer_size rcv_size;
+    entry->socket.get_option(rcv_size);
+    if (rcv_size.value() < MIN_BUFFER_SIZE) {
+        entry->socket.set_option(
+            asio::ip::udp::socket::receive_buffer_size(MIN_BUFFER_SIZE));
+    }
+    ++opened_;
+    return (entry);
+}
+
+UDPSocketPool::EntryPtr
+UDPSocketPool::acquire(int family) {
+    std::vector<EntryPtr>& idle(idleList(family));
+    EntryPtr entry;
+    while (!entry && !idle.empty()) {
+        // Pick a random one, so the port of the next query can't be
+        // deduced from the previous ones.
+        const size_t index = random(0, idle.size() - 1);
+        entry = idle[index];
+        idle[index] = idle.back();
+        idle.pop_back();
+        // Late answers to the previous query may have come in while the
+        // socket was idle.
+        if (!drain(entry)) {
+            entry.reset();
+        }
+    }
+    if (!entry) {
+        entry = open(family);
+    }
+    ++entry->uses;
+    ++acquired_;
+    return (entry);
+}
+
+void
+UDPSocketPool::release(const EntryPtr& entry) {
+    if (!entry->socket.is_open()) {
+        return;
+    }
+    std::vector<EntryPtr>& idle(idleList(
+        entry->socket.local_endpoint().address().is_v6() ? AF_INET6 :
+        AF_INET));
+    if (entry->uses >= max_uses_ || idle.size() >= max_idle_) {
+        // Retired, the port is replaced by a new random one on demand.
+        asio::error_code ec;
+        entry->socket.close(ec);
+        return;
+    }
+
+    // Drop anything that came for the previous query, so the next one
+    // doesn't have to go through it.
+    if (drain(entry)) {
+        idle.push_back(entry);
+    }
+}
+
+bool
+UDPSocketPool::drain(const EntryPtr& entry) {
+    asio::error_code ec;
+    uint8_t buffer[DRAIN_SIZE];
+    asio::ip::udp::endpoint sender;
+    while (entry->socket.available(ec) > 0 && !ec) {
+        entry->socket.receive_from(asio::buffer(buffer, sizeof(buffer)),
+                                   sender, 0, ec);
+        if (ec) {
+            break;
+        }
+    }
+    if (ec) {
+        // Something is wrong with the socket, don't reuse it.
+        entry->socket.close(ec);
+        return (false);
+    }
+    return (true);
+}
+
+} // namespace asiodns
+} // namespace bundy
@@ -0,0 +1,136 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef UDP_SOCKET_POOL_H
+#define UDP_SOCKET_POOL_H 1
+
+#include <asiolink/io_service.h>
+
+#include <asio/ip/udp.hpp>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+#include <stdint.h>
+#include <vector>
+
+namespace bundy {
+namespace asiodns {
+
+/// \brief Pool of UDP sockets for upstream queries
+///
+/// Opening (and binding) a new socket for every upstream query and closing
+/// it afterwards costs several system calls per query and churns through
+/// the ephemeral ports.  This pool keeps the sockets of finished queries
+/// and hands them to the following ones.
+///
+/// The source port is one of the things a spoofer has to guess, so reuse
+/// must not make it predictable:
+/// - Each new socket is bound to a randomly chosen port.
+/// - A random idle socket is handed out, not the last returned one.
+/// - A socket is used only by one query at a time (so the pair of query
+///   ID and port stays random for every query) and is closed after
+///   \c getMaxUses() queries, to be replaced by a new random port.
+///
+/// Anything that arrived for the previous query (late answers) is dropped
+/// when the socket is returned and again when it is handed out, as answers
+/// to a query that timed out may keep coming while the socket is idle.
+///
+/// The pool is not thread safe, it is meant to be owned by one
+/// RecursiveQuery and used from the thread running its IOService.
+class UDPSocketPool : boost::noncopyable {
+public:
+    /// \brief A socket from the pool
+    struct Entry {
+        Entry(asio::io_service& service) : socket(service), uses(0) {}
+        asio::ip::udp::socket socket;   ///< The socket itself
+        size_t uses;                    ///< Queries it was used for
+    };
+    typedef boost::shared_ptr<Entry> EntryPtr;
+
+    /// \brief Constructor
+    ///
+    /// \param service The IOService the sockets are bound to.
+    /// \param max_idle How many idle sockets of each family to keep.
+    /// \param max_uses After how many queries a socket is replaced.
+    UDPSocketPool(bundy::asiolink::IOService& service,
+                  size_t max_idle = DEFAULT_MAX_IDLE,
+                  size_t max_uses = DEFAULT_MAX_USES);
+
+    /// \brief Get a socket for a query
+    ///
+    /// Returns an idle socket of the family, or opens a new one bound to
+    /// a random port.  Stale datagrams waiting on an idle socket are
+    /// dropped first.
+    ///
+    /// \param family AF_INET or AF_INET6.
+    /// \throw asio::system_error if a new socket can't be opened.
+    EntryPtr acquire(int family);
+
+    /// \brief Return the socket after the query is done
+    ///
+    /// There must be no outstanding I/O on the socket.
+    void release(const EntryPtr& entry);
+
+    /// \brief Number of sockets opened so far
+    uint64_t getOpenedCount() const {
+        return (opened_);
+    }
+
+    /// \brief Number of sockets handed out so far
+    uint64_t getAcquiredCount() const {
+        return (acquired_);
+    }
+
+    /// \brief Number of idle sockets of the family
+    size_t getIdleCount(int family) const;
+
+    /// \brief After how many queries is a socket replaced
+    size_t getMaxUses() const {
+        return (max_uses_);
+    }
+
+    /// Default number of idle sockets kept for each family
+    static const size_t DEFAULT_MAX_IDLE = 64;
+    /// Default number of queries a socket is used for
+    static const size_t DEFAULT_MAX_USES = 100;
+    /// How many random ports we try before leaving the choice to the kernel
+    static const size_t BIND_ATTEMPTS = 8;
+    /// Minimal size of the socket buffers (the same as for UDPSocket)
+    static const int MIN_BUFFER_SIZE = 4096;
+
+private:
+    EntryPtr open(int family);
+    // Read and drop everything waiting on the socket.  Closes the socket
+    // and returns false if it is broken.
+    bool drain(const EntryPtr& entry);
+    std::vector<EntryPtr>& idleList(int family);
+    // Random number in [min, max]
+    int random(int min, int max);
+
+    bundy::asiolink::IOService& service_;
+    const size_t max_idle_;
+    const size_t max_uses_;
+    std::vector<EntryPtr> idle4_;
+    std::vector<EntryPtr> idle6_;
+    boost::mt19937 generator_;
+    uint64_t opened_;
+    uint64_t acquired_;
+};
+
+} // namespace asiodns
+} // namespace bundy
+
+#endif // UDP_SOCKET_POOL_H
@@ -25,6 +25,7 @@
 #include <asiolink/io_address.h>
 #include <asiolink/io_error.h>
 #include <boost/static_assert.hpp>
+#include <boost/functional/hash.hpp>
 
 using namespace asio;
 using asio::ip::udp;
@@ -131,5 +132,15 @@ operator<<(std::ostream& os, const IOAddress& address) {
     return (os);
 }
 
+size_t
+hash_value(const IOAddress& address) {
+    if (address.asio_address_.is_v4()) {
+        return (boost::hash_value(address.asio_address_.to_v4().to_ulong()));
+    }
+    const asio::ip::address_v6::bytes_type bytes =
+        address.asio_address_.to_v6().to_bytes();
+    return (boost::hash_range(bytes.begin(), bytes.end()));
+}
+
 } // namespace asiolink
 } // namespace bundy
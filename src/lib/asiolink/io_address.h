@@ -231,9 +231,21 @@ public:
     operator uint32_t () const;
 
 private:
+    friend size_t hash_value(const IOAddress& address);
+
     asio::ip::address asio_address_;
 };
 
+/// \brief Hash value of the address
+///
+/// This allows IOAddress to be used as a key of hashed containers
+/// (\c boost::hash finds this function).  Equal addresses have equal
+/// hash values; no memory is allocated.
+///
+/// \param address The address to hash.
+/// \return The hash value.
+size_t hash_value(const IOAddress& address);
+
 /// \brief Insert the IOAddress as a string into stream.
 ///
 /// This method converts the \c address into a string and inserts it
@@ -18,6 +18,8 @@
 #include <asiolink/io_error.h>
 #include <asiolink/io_address.h>
 
+#include <boost/functional/hash.hpp>
+
 #include <algorithm>
 #include <cstring>
 #include <vector>
@@ -185,6 +187,20 @@ TEST(IOAddressTest, LeftShiftOperator) {
 
 // Tests address classification methods (which were previously used by accessing
 // underlying asio objects directly)
+TEST(IOAddressTest, hash) {
+    EXPECT_EQ(hash_value(IOAddress("192.0.2.1")),
+              hash_value(IOAddress("192.0.2.1")));
+    EXPECT_NE(hash_value(IOAddress("192.0.2.1")),
+              hash_value(IOAddress("192.0.2.2")));
+    EXPECT_EQ(hash_value(IOAddress("2001:db8::1")),
+              hash_value(IOAddress("2001:db8:0::1")));
+    EXPECT_NE(hash_value(IOAddress("2001:db8::1")),
+              hash_value(IOAddress("2001:db8::2")));
+    // boost::hash finds it
+    EXPECT_EQ(hash_value(IOAddress("2001:db8::1")),
+              boost::hash<IOAddress>()(IOAddress("2001:db8::1")));
+}
+
 TEST(IOAddressTest, accessClassificationMethods) {
     IOAddress addr1("192.0.2.5"); // IPv4
     IOAddress addr2("::");  // IPv6
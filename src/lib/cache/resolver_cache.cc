@@ -184,6 +184,7 @@ ResolverCache::lookup(const bundy::dns::Name& qname,
                       const bundy::dns::RRClass& qclass,
                       bundy::dns::Message& response) const
 {
+    bundy::util::thread::Mutex::Locker locker(mutex_);
     ResolverClassCache* cc = getClassCache(qclass);
     if (cc) {
         return (cc->lookup(qname, qtype, response));
@@ -199,6 +200,7 @@ ResolverCache::lookup(const bundy::dns::Name& qname,
                const bundy::dns::RRType& qtype,
                const bundy::dns::RRClass& qclass) const
 {
+    bundy::util::thread::Mutex::Locker locker(mutex_);
     ResolverClassCache* cc = getClassCache(qclass);
     if (cc) {
         return (cc->lookup(qname, qtype));
@@ -215,6 +217,7 @@ ResolverCache::lookupDeepestNS(const bundy::dns::Name& qname,
 {
     LOG_DEBUG(logger, DBG_TRACE_DATA, CACHE_RESOLVER_DEEPEST).arg(qname).
         arg(qclass);
+    bundy::util::thread::Mutex::Locker locker(mutex_);
     bundy::dns::RRType qtype = RRType::NS();
     ResolverClassCache* cc = getClassCache(qclass);
     if (cc) {
@@ -236,6 +239,7 @@ ResolverCache::lookupDeepestNS(const bundy::dns::Name& qname,
 
 bool
 ResolverCache::update(const bundy::dns::Message& msg) {
+    bundy::util::thread::Mutex::Locker locker(mutex_);
     QuestionIterator iter = msg.beginQuestion();
     ResolverClassCache* cc = getClassCache((*iter)->getClass());
     if (cc) {
@@ -250,6 +254,7 @@ ResolverCache::update(const bundy::dns::Message& msg) {
 
 bool
 ResolverCache::update(const bundy::dns::ConstRRsetPtr& rrset_ptr) {
+    bundy::util::thread::Mutex::Locker locker(mutex_);
     ResolverClassCache* cc = getClassCache(rrset_ptr->getClass());
     if (cc) {
         return (cc->update(rrset_ptr));
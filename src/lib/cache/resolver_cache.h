@@ -21,6 +21,7 @@
 #include <dns/rrclass.h>
 #include <dns/message.h>
 #include <exceptions/exceptions.h>
+#include <util/threads/sync.h>
 #include "message_cache.h"
 #include "rrset_cache.h"
 #include "local_zone_data.h"
@@ -199,6 +200,11 @@ private:
     RRsetCachePtr negative_soa_cache_;
 };
 
+/// \brief The resolver cache
+///
+/// The cache may be shared by several threads (the resolver worker threads,
+/// for example).  All the public methods are serialized by an internal
+/// mutex, so the class-specific caches below it don't have to care.
 class ResolverCache {
 public:
     /// \brief Default Constructor.
@@ -314,6 +320,9 @@ private:
     /// TODO: I think we can optimize for IN, and always have that
     /// one directly available, use the vector for the rest?
     std::vector<ResolverClassCache*> class_caches_;
+
+    /// Protects the class-specific caches against concurrent access.
+    mutable bundy::util::thread::Mutex mutex_;
 };
 
 } // namespace cache
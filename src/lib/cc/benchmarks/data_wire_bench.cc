@@ -0,0 +1,196 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <cc/data.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::bench;
+using namespace bundy::data;
+
+namespace {
+
+// Items of the per-zone statistics of b10-auth, similar to what it sends
+// to the statistics daemon.
+const char* const zone_items[] = {
+    "request.v4", "request.v6", "request.edns0", "request.badednsver",
+    "request.tsig", "request.sig0", "request.badsig", "request.udp",
+    "request.tcp", "request.dnssec_ok", "opcode.query", "opcode.notify",
+    "opcode.update", "rcode.noerror", "rcode.formerr", "rcode.servfail",
+    "rcode.nxdomain", "rcode.refused", "qtype.a", "qtype.ns", "qtype.soa",
+    "qtype.aaaa", "qtype.txt", "qtype.ixfr", "qtype.axfr", "responses",
+    "response.truncated", "response.edns0", "response.tsig",
+    "response.sigzero", "qrysuccess", "qryauthans", "qrynoauthans",
+    "qryreferral", "qrynxrrset", "authqryrej",
+    NULL
+};
+
+// Builds the statistics message for the given number of zones.
+ConstElementPtr
+createStatistics(const size_t zone_count) {
+    ElementPtr zones = Element::createMap();
+    for (size_t i = 0; i <= zone_count; ++i) {
+        ElementPtr zone = Element::createMap();
+        for (size_t j = 0; zone_items[j] != NULL; ++j) {
+            ElementPtr map = zone;
+            string name = zone_items[j];
+            const size_t dot = name.find('.');
+            if (dot != string::npos) {
+                const string group = name.substr(0, dot);
+                if (!zone->contains(group)) {
+                    zone->set(group, Element::createMap());
+                }
+                map = boost::const_pointer_cast<Element>(zone->get(group));
+                name = name.substr(dot + 1);
+            }
+            map->set(name, Element::create(static_cast<long int>(i * j)));
+        }
+        if (i == 0) {
+            zones->set("_SERVER_", zone);
+        } else {
+            ostringstream zone_name;
+            zone_name << "zone" << i << ".example.com.";
+            zones->set(zone_name.str(), zone);
+        }
+    }
+    ElementPtr stats = Element::createMap();
+    stats->set("zones", zones);
+    ElementPtr args = Element::createMap();
+    args->set("owner", Element::create("Auth"));
+    args->set("pid", Element::create(12345));
+    args->set("data", stats);
+    ElementPtr command = Element::createList();
+    command->add(Element::create("set"));
+    command->add(args);
+    ElementPtr msg = Element::createMap();
+    msg->set("command", command);
+    return (msg);
+}
+
+class JSONEncodeBenchMark {
+public:
+    JSONEncodeBenchMark(const ConstElementPtr& msg) : msg_(msg) {}
+    unsigned int run() {
+        const string wire = msg_->toWire();
+        assert(!wire.empty());
+        return (1);
+    }
+private:
+    const ConstElementPtr msg_;
+};
+
+class BinaryEncodeBenchMark {
+public:
+    BinaryEncodeBenchMark(const ConstElementPtr& msg) : msg_(msg) {}
+    unsigned int run() {
+        const string wire = msg_->toBinaryWire();
+        assert(!wire.empty());
+        return (1);
+    }
+private:
+    const ConstElementPtr msg_;
+};
+
+// Decodes the data as Session::recvmsg() does.
+class JSONDecodeBenchMark {
+public:
+    JSONDecodeBenchMark(const string& wire) : wire_(wire) {}
+    unsigned int run() {
+        stringstream wire_stream;
+        wire_stream << wire_;
+        const ConstElementPtr msg = Element::fromWire(wire_stream,
+                                                      wire_.size());
+        assert(msg);
+        return (1);
+    }
+private:
+    const string wire_;
+};
+
+class BinaryDecodeBenchMark {
+public:
+    BinaryDecodeBenchMark(const string& wire) : wire_(wire) {}
+    unsigned int run() {
+        const ConstElementPtr msg = Element::fromBinaryWire(wire_.data(),
+                                                            wire_.size());
+        assert(msg);
+        return (1);
+    }
+private:
+    const string wire_;
+};
+
+void
+usage() {
+    cerr << "Usage: data_wire_bench [-n iterations] [-z zones]" << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 1000;
+    size_t zone_count = 100;
+    while ((ch = getopt(argc, argv, "n:z:")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case 'z':
+            zone_count = atoi(optarg);
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0) {
+        usage();
+    }
+
+    const ConstElementPtr msg = createStatistics(zone_count);
+    const string json_wire = msg->toWire();
+    const string binary_wire = msg->toBinaryWire();
+    assert(*Element::fromBinaryWire(binary_wire.data(),
+                                    binary_wire.size()) == *msg);
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+    cout << "  Zones: " << zone_count << endl;
+    cout << "  JSON size: " << json_wire.size() << endl;
+    cout << "  Binary size: " << binary_wire.size() << endl;
+
+    cout << "Benchmark for encoding to JSON" << endl;
+    BenchMark<JSONEncodeBenchMark>(iteration, JSONEncodeBenchMark(msg));
+    cout << "Benchmark for encoding to the binary wire format" << endl;
+    BenchMark<BinaryEncodeBenchMark>(iteration, BinaryEncodeBenchMark(msg));
+    cout << "Benchmark for decoding JSON" << endl;
+    BenchMark<JSONDecodeBenchMark>(iteration, JSONDecodeBenchMark(json_wire));
+    cout << "Benchmark for decoding the binary wire format" << endl;
+    BenchMark<BinaryDecodeBenchMark>(iteration,
+                                     BinaryDecodeBenchMark(binary_wire));
+
+    return (0);
+}
@@ -0,0 +1,194 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <cc/data.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::bench;
+using namespace bundy::data;
+
+namespace {
+
+// Builds the DHCPv4 configuration with the given number of subnets, each
+// with a pool, some options and host reservations.
+string
+createDhcpConfig(const size_t subnet_count) {
+    ostringstream config;
+    config << "{ \"Dhcp4\": {\n"
+           << "  \"interfaces\": [ \"eth0\", \"eth1\" ],\n"
+           << "  \"renew-timer\": 1000,\n"
+           << "  \"rebind-timer\": 2000,\n"
+           << "  \"valid-lifetime\": 4000,\n"
+           << "  \"lease-database\": { \"type\": \"memfile\","
+           << " \"persist\": true, \"name\": \"/var/lib/dhcp4.leases\" },\n"
+           << "  \"subnet4\": [\n";
+    for (size_t i = 0; i < subnet_count; ++i) {
+        const size_t a = (i >> 8) & 0xff;
+        const size_t b = i & 0xff;
+        config << (i > 0 ? ",\n" : "")
+               << "    { \"subnet\": \"10." << a << "." << b << ".0/24\",\n"
+               << "      \"pool\": [ \"10." << a << "." << b << ".10 - 10."
+               << a << "." << b << ".200\" ],\n"
+               << "      \"relay\": { \"ip-address\": \"10." << a << "."
+               << b << ".1\" },\n"
+               << "      \"valid-lifetime\": 3600,\n"
+               << "      \"option-data\": [\n"
+               << "        { \"name\": \"routers\", \"code\": 3,"
+               << " \"space\": \"dhcp4\", \"csv-format\": true,"
+               << " \"data\": \"10." << a << "." << b << ".1\" },\n"
+               << "        { \"name\": \"domain-name\", \"code\": 15,"
+               << " \"space\": \"dhcp4\", \"csv-format\": true,"
+               << " \"data\": \"subnet" << i << ".example.com\" }\n"
+               << "      ],\n"
+               << "      \"reservations\": [\n";
+        for (size_t j = 0; j < 4; ++j) {
+            config << (j > 0 ? ",\n" : "")
+                   << "        { \"hw-address\": \"0a:00:00:"
+                   << hex << a << ":" << b << ":" << j << dec << "\","
+                   << " \"ip-address\": \"10." << a << "." << b << "."
+                   << (201 + j) << "\","
+                   << " \"hostname\": \"host" << j << "\\tsubnet\\n" << i
+                   << "\" }";
+        }
+        config << "\n      ]\n    }";
+    }
+    config << "\n  ]\n} }\n";
+    return (config.str());
+}
+
+// Builds a statistics reply with the given number of zones, with the
+// counters of each of them.
+string
+createStatistics(const size_t zone_count) {
+    const char* const items[] = {
+        "v4", "v6", "edns0", "tsig", "udp", "tcp", "dnssec_ok", "noerror",
+        "formerr", "servfail", "nxdomain", "refused", "a", "ns", "soa",
+        "aaaa", "txt", "ixfr", "axfr", "responses", "truncated",
+        "qrysuccess", "qryauthans", "qrynoauthans", "qryreferral",
+        "qrynxrrset", "authqryrej",
+        NULL
+    };
+    ostringstream stats;
+    stats << "{\"result\": [0, {\"Auth\": {\"zones\": {";
+    for (size_t i = 0; i < zone_count; ++i) {
+        stats << (i > 0 ? ", " : "") << "\"zone" << i
+              << ".example.com.\": {";
+        for (size_t j = 0; items[j] != NULL; ++j) {
+            stats << (j > 0 ? ", " : "") << "\"" << items[j] << "\": "
+                  << (i * 1000 + j);
+        }
+        stats << "}";
+    }
+    stats << "}, \"latency\": {\"total\": {\"p50\": 0.000012,"
+          << " \"p99\": 0.0021}}}}]}";
+    return (stats.str());
+}
+
+// Parses the data through the istream, as the old fromJSON(string) did.
+class StreamParseBenchMark {
+public:
+    StreamParseBenchMark(const string& data) : data_(data) {}
+    unsigned int run() {
+        istringstream in(data_);
+        const ConstElementPtr element = Element::fromJSON(in);
+        assert(element);
+        return (1);
+    }
+private:
+    const string& data_;
+};
+
+class BufferParseBenchMark {
+public:
+    BufferParseBenchMark(const string& data) : data_(data) {}
+    unsigned int run() {
+        const ConstElementPtr element = Element::fromJSON(data_);
+        assert(element);
+        return (1);
+    }
+private:
+    const string& data_;
+};
+
+void
+usage() {
+    cerr << "Usage: json_parse_bench [-n iterations] [-s subnets] "
+        "[-z zones]" << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 10;
+    size_t subnet_count = 10000;
+    size_t zone_count = 1000;
+    while ((ch = getopt(argc, argv, "n:s:z:")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case 's':
+            subnet_count = atoi(optarg);
+            break;
+        case 'z':
+            zone_count = atoi(optarg);
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0) {
+        usage();
+    }
+
+    const string config = createDhcpConfig(subnet_count);
+    const string stats = createStatistics(zone_count);
+    istringstream config_stream(config);
+    assert(Element::fromJSON(config)->equals(
+               *Element::fromJSON(config_stream)));
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+    cout << "  DHCP configuration: " << subnet_count << " subnets, "
+         << config.size() << " bytes" << endl;
+    cout << "  Statistics: " << zone_count << " zones, " << stats.size()
+         << " bytes" << endl;
+
+    cout << "Benchmark for parsing the DHCP configuration from istream"
+         << endl;
+    BenchMark<StreamParseBenchMark>(iteration, StreamParseBenchMark(config));
+    cout << "Benchmark for parsing the DHCP configuration from buffer"
+         << endl;
+    BenchMark<BufferParseBenchMark>(iteration, BufferParseBenchMark(config));
+    cout << "Benchmark for parsing the statistics from istream" << endl;
+    BenchMark<StreamParseBenchMark>(iteration, StreamParseBenchMark(stats));
+    cout << "Benchmark for parsing the statistics from buffer" << endl;
+    BenchMark<BufferParseBenchMark>(iteration, BufferParseBenchMark(stats));
+
+    return (0);
+}
@@ -21,6 +21,7 @@
 #include <climits>
 #include <map>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -29,6 +30,7 @@
 
 #include <boost/algorithm/string.hpp> // for iequals
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 
 #include <cmath>
 
@@ -36,6 +38,207 @@ using namespace std;
 
 namespace {
 const char* const WHITESPACE = " \b\f\n\r\t";
+
+// Type bytes of the binary wire format
+enum BinaryWireType {
+    BINARY_NULL = 0,
+    BINARY_FALSE = 1,
+    BINARY_TRUE = 2,
+    BINARY_INT = 3,
+    BINARY_REAL = 4,
+    BINARY_STRING = 5,
+    BINARY_LIST = 6,
+    BINARY_MAP = 7
+};
+
+void
+writeUint32(std::string& out, const uint32_t value) {
+    const char data[4] = {
+        static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+        static_cast<char>(value >> 8), static_cast<char>(value)
+    };
+    out.append(data, sizeof(data));
+}
+
+void
+writeUint64(std::string& out, const uint64_t value) {
+    writeUint32(out, static_cast<uint32_t>(value >> 32));
+    writeUint32(out, static_cast<uint32_t>(value));
+}
+
+void
+writeString(std::string& out, const std::string& value) {
+    if (value.size() > 0xffffffff) {
+        bundy_throw(bundy::data::TypeError,
+                    "string too long for the binary wire format");
+    }
+    writeUint32(out, value.size());
+    out.append(value);
+}
+
+void
+writeBinaryWire(std::string& out, const bundy::data::Element* element) {
+    using bundy::data::Element;
+
+    if (element == NULL) {
+        // A map may hold a NULL pointer, it's written as null.
+        out.push_back(BINARY_NULL);
+        return;
+    }
+    switch (element->getType()) {
+    case Element::null:
+        out.push_back(BINARY_NULL);
+        break;
+    case Element::boolean:
+        out.push_back(element->boolValue() ? BINARY_TRUE : BINARY_FALSE);
+        break;
+    case Element::integer:
+        out.push_back(BINARY_INT);
+        writeUint64(out, static_cast<uint64_t>(element->intValue()));
+        break;
+    case Element::real: {
+        const double value = element->doubleValue();
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        out.push_back(BINARY_REAL);
+        writeUint64(out, bits);
+        break;
+    }
+    case Element::string:
+        out.push_back(BINARY_STRING);
+        writeString(out, element->stringValue());
+        break;
+    case Element::list: {
+        const std::vector<bundy::data::ConstElementPtr>& l =
+            element->listValue();
+        out.push_back(BINARY_LIST);
+        writeUint32(out, l.size());
+        for (size_t i = 0; i < l.size(); ++i) {
+            writeBinaryWire(out, l[i].get());
+        }
+        break;
+    }
+    case Element::map: {
+        const std::map<std::string, bundy::data::ConstElementPtr>& m =
+            element->mapValue();
+        out.push_back(BINARY_MAP);
+        writeUint32(out, m.size());
+        for (std::map<std::string, bundy::data::ConstElementPtr>::
+                 const_iterator it = m.begin(); it != m.end(); ++it) {
+            writeString(out, it->first);
+            writeBinaryWire(out, it->second.get());
+        }
+        break;
+    }
+    default:
+        bundy_throw(bundy::data::TypeError, "unknown element type "
+                    << element->getType());
+    }
+}
+
+// Decodes the binary wire format in place.
+class BinaryWireReader {
+public:
+    BinaryWireReader(const uint8_t* data, size_t length) :
+        current_(data), end_(data + length)
+    {}
+
+    bool atEnd() const {
+        return (current_ == end_);
+    }
+
+    bundy::data::ElementPtr readElement() {
+        using bundy::data::Element;
+        using bundy::data::ElementPtr;
+
+        const uint8_t type = *need(1);
+        switch (type) {
+        case BINARY_NULL:
+            return (Element::create());
+        case BINARY_FALSE:
+            return (Element::create(false));
+        case BINARY_TRUE:
+            return (Element::create(true));
+        case BINARY_INT:
+            return (Element::create(static_cast<long long int>(
+                                        static_cast<int64_t>(readUint64()))));
+        case BINARY_REAL: {
+            const uint64_t bits = readUint64();
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return (Element::create(value));
+        }
+        case BINARY_STRING:
+            return (Element::create(readString()));
+        case BINARY_LIST: {
+            const uint32_t count = readCount();
+            ElementPtr list = Element::createList();
+            for (uint32_t i = 0; i < count; ++i) {
+                list->add(readElement());
+            }
+            return (list);
+        }
+        case BINARY_MAP: {
+            const uint32_t count = readCount();
+            ElementPtr map = Element::createMap();
+            for (uint32_t i = 0; i < count; ++i) {
+                const std::string key = readString();
+                map->set(key, readElement());
+            }
+            return (map);
+        }
+        default:
+            bundy_throw(bundy::data::JSONError, "binary wire format: "
+                        "unknown type " << static_cast<int>(type));
+        }
+    }
+
+private:
+    // Returns the next length bytes and skips them.
+    const uint8_t* need(const size_t length) {
+        if (static_cast<size_t>(end_ - current_) < length) {
+            bundy_throw(bundy::data::JSONError,
+                        "binary wire format: truncated data");
+        }
+        const uint8_t* data = current_;
+        current_ += length;
+        return (data);
+    }
+
+    uint32_t readUint32() {
+        const uint8_t* data = need(4);
+        return ((static_cast<uint32_t>(data[0]) << 24) |
+                (static_cast<uint32_t>(data[1]) << 16) |
+                (static_cast<uint32_t>(data[2]) << 8) |
+                static_cast<uint32_t>(data[3]));
+    }
+
+    uint64_t readUint64() {
+        const uint64_t high = readUint32();
+        return ((high << 32) | readUint32());
+    }
+
+    // Number of children of a list or map. Each takes at least one byte,
+    // so a bogus count is caught before it's used.
+    uint32_t readCount() {
+        const uint32_t count = readUint32();
+        if (count > static_cast<size_t>(end_ - current_)) {
+            bundy_throw(bundy::data::JSONError,
+                        "binary wire format: truncated data");
+        }
+        return (count);
+    }
+
+    std::string readString() {
+        const uint32_t length = readUint32();
+        const uint8_t* data = need(length);
+        return (std::string(reinterpret_cast<const char*>(data), length));
+    }
+
+    const uint8_t* current_;
+    const uint8_t* const end_;
+};
+
 } // end anonymous namespace
 
 namespace bundy {
@@ -60,6 +263,41 @@ Element::toWire(std::ostream& ss) const {
     toJSON(ss);
 }
 
+const uint8_t Element::BINARY_WIRE_MAGIC;
+
+std::string
+Element::toBinaryWire() const {
+    std::string out;
+    toBinaryWire(out);
+    return (out);
+}
+
+void
+Element::toBinaryWire(std::string& out) const {
+    out.push_back(static_cast<char>(BINARY_WIRE_MAGIC));
+    writeBinaryWire(out, this);
+}
+
+ElementPtr
+Element::fromBinaryWire(const void* data, size_t length) {
+    if (!isBinaryWire(data, length)) {
+        bundy_throw(JSONError, "binary wire format: no magic byte");
+    }
+    BinaryWireReader reader(static_cast<const uint8_t*>(data) + 1,
+                            length - 1);
+    ElementPtr element = reader.readElement();
+    if (!reader.atEnd()) {
+        bundy_throw(JSONError, "binary wire format: extra data");
+    }
+    return (element);
+}
+
+bool
+Element::isBinaryWire(const void* data, size_t length) {
+    return (length > 0 &&
+            *static_cast<const uint8_t*>(data) == BINARY_WIRE_MAGIC);
+}
+
 bool
 Element::getValue(int64_t&) const {
     return (false);
@@ -210,37 +448,37 @@ bool operator!=(const Element& a, const Element& b) {
 //
 ElementPtr
 Element::create() {
-    return (ElementPtr(new NullElement()));
+    return (boost::make_shared<NullElement>());
 }
 
 ElementPtr
 Element::create(const long long int i) {
-    return (ElementPtr(new IntElement(static_cast<int64_t>(i))));
+    return (boost::make_shared<IntElement>(static_cast<int64_t>(i)));
 }
 
 ElementPtr
 Element::create(const double d) {
-    return (ElementPtr(new DoubleElement(d)));
+    return (boost::make_shared<DoubleElement>(d));
 }
 
 ElementPtr
 Element::create(const std::string& s) {
-    return (ElementPtr(new StringElement(s)));
+    return (boost::make_shared<StringElement>(s));
 }
 
 ElementPtr
 Element::create(const bool b) {
-    return (ElementPtr(new BoolElement(b)));
+    return (boost::make_shared<BoolElement>(b));
 }
 
 ElementPtr
 Element::createList() {
-    return (ElementPtr(new ListElement()));
+    return (boost::make_shared<ListElement>());
 }
 
 ElementPtr
 Element::createMap() {
-    return (ElementPtr(new MapElement()));
+    return (boost::make_shared<MapElement>());
 }
 
 
@@ -502,6 +740,330 @@ fromStringstreamMap(std::istream& in, const std::string& file, int& line,
     }
     return (map);
 }
+
+// The parser of JSON data in a memory buffer. It accepts the same syntax
+// and reports the same errors (with the same positions) as the istream
+// based functions above, but it works on the buffer directly, without
+// the per-character stream calls and the temporary stringstreams, and
+// copies the runs of plain characters in strings at once.
+class BufferParser {
+public:
+    BufferParser(const char* data, size_t length, const std::string& file,
+                 int line, int pos) :
+        current_(data), end_(data + length), file_(file), line_(line),
+        pos_(pos)
+    {}
+
+    // The counterpart of Element::fromJSON(std::istream&, ...)
+    ElementPtr parseElement();
+
+    void skipWhitespace() {
+        while (current_ != end_ && isWhitespace(*current_)) {
+            if (*current_ == '\n') {
+                ++line_;
+                pos_ = 1;
+            } else {
+                ++pos_;
+            }
+            ++current_;
+        }
+    }
+
+    bool atEnd() const {
+        return (current_ == end_);
+    }
+
+    void throwError(const std::string& error) const {
+        throwJSONError(error, file_, line_, pos_);
+    }
+
+private:
+    static bool isWhitespace(const int c) {
+        return (c == ' ' || c == '\b' || c == '\f' || c == '\n' ||
+                c == '\r' || c == '\t');
+    }
+
+    static bool isAlpha(const int c) {
+        return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
+    }
+
+    static bool isNumberChar(const int c) {
+        return ((c >= '0' && c <= '9') || c == '+' || c == '-' ||
+                c == '.' || c == 'e' || c == 'E');
+    }
+
+    int peek() const {
+        return (current_ != end_ ? static_cast<unsigned char>(*current_) :
+                EOF);
+    }
+
+    int get() {
+        return (current_ != end_ ? static_cast<unsigned char>(*current_++) :
+                EOF);
+    }
+
+    // Returns the first occurrence of c in [current_, until), or until.
+    const char* find(const char c, const char* until) const {
+        const void* found = std::memchr(current_, c, until - current_);
+        return (found != NULL ? static_cast<const char*>(found) : until);
+    }
+
+    int skipTo(const char* chars);
+    std::string readString();
+    std::string readWord();
+    ElementPtr parseNumber();
+    ElementPtr parseBool();
+    ElementPtr parseNull();
+    ElementPtr parseList();
+    ElementPtr parseMap();
+
+    const char* current_;
+    const char* const end_;
+    const std::string file_;
+    int line_;
+    int pos_;
+};
+
+// See skipTo() above, the characters to skip are always whitespace.
+int
+BufferParser::skipTo(const char* chars) {
+    int c = get();
+    ++pos_;
+    while (c != EOF) {
+        if (c == '\n') {
+            pos_ = 1;
+            ++line_;
+        }
+        if (isWhitespace(c)) {
+            c = get();
+            ++pos_;
+        } else if (charIn(c, chars)) {
+            skipWhitespace();
+            return (c);
+        } else {
+            throwError(std::string("'") + std::string(1, c) +
+                       "' read, one of \"" + chars + "\" expected");
+        }
+    }
+    throwError(std::string("EOF read, one of \"") + chars + "\" expected");
+    return (c); // shouldn't reach here, but some compilers require it
+}
+
+std::string
+BufferParser::readString() {
+    int c = get();
+    ++pos_;
+    if (c != '"') {
+        throwError("String expected");
+    }
+
+    std::string result;
+    const char* quote = find('"', end_);
+    while (true) {
+        // An escaped quote may have been consumed.
+        if (quote < current_) {
+            quote = find('"', end_);
+        }
+        const char* run_end = find('\\', quote);
+        result.append(current_, run_end);
+        pos_ += run_end - current_;
+        current_ = run_end;
+
+        c = get();
+        ++pos_;
+        if (c == EOF) {
+            throwError("Unterminated string");
+        } else if (c == '"') {
+            return (result);
+        }
+        // c is the backslash, see the spec for allowed escape characters
+        switch (peek()) {
+        case '"':
+            c = '"';
+            break;
+        case '/':
+            c = '/';
+            break;
+        case '\\':
+            c = '\\';
+            break;
+        case 'b':
+            c = '\b';
+            break;
+        case 'f':
+            c = '\f';
+            break;
+        case 'n':
+            c = '\n';
+            break;
+        case 'r':
+            c = '\r';
+            break;
+        case 't':
+            c = '\t';
+            break;
+        default:
+            throwError("Bad escape");
+        }
+        // drop the escaped char
+        ++current_;
+        ++pos_;
+        result.push_back(c);
+    }
+}
+
+std::string
+BufferParser::readWord() {
+    const char* start = current_;
+    while (current_ != end_ && isAlpha(*current_)) {
+        ++current_;
+    }
+    pos_ += current_ - start;
+    return (std::string(start, current_));
+}
+
+ElementPtr
+BufferParser::parseNumber() {
+    const char* start = current_;
+    while (current_ != end_ && isNumberChar(*current_)) {
+        ++current_;
+    }
+    pos_ += current_ - start;
+    const std::string number(start, current_);
+
+    // strtoll() and strtod() are much cheaper than lexical_cast, but
+    // they accept a prefix of the number, so we check they used it all.
+    char* number_end;
+    errno = 0;
+    if (number.find_first_of(".eE") < number.size()) {
+        const double d = std::strtod(number.c_str(), &number_end);
+        if (number_end == number.c_str() + number.size() &&
+            (errno != ERANGE || (d != HUGE_VAL && d != -HUGE_VAL))) {
+            return (Element::create(d));
+        }
+    } else {
+        const long long int i = strtoll(number.c_str(), &number_end, 10);
+        if (!number.empty() &&
+            number_end == number.c_str() + number.size() && errno != ERANGE) {
+            return (Element::create(i));
+        }
+    }
+    bundy_throw(JSONError, std::string("Number overflow: ") + number);
+}
+
+ElementPtr
+BufferParser::parseBool() {
+    const std::string word = readWord();
+    if (boost::iequals(word, "True")) {
+        return (Element::create(true));
+    } else if (boost::iequals(word, "False")) {
+        return (Element::create(false));
+    } else {
+        throwError(std::string("Bad boolean value: ") + word);
+        return (ElementPtr());
+    }
+}
+
+ElementPtr
+BufferParser::parseNull() {
+    const std::string word = readWord();
+    if (boost::iequals(word, "null")) {
+        return (Element::create());
+    } else {
+        throwError(std::string("Bad null value: ") + word);
+        return (ElementPtr());
+    }
+}
+
+ElementPtr
+BufferParser::parseList() {
+    int c = 0;
+    ElementPtr list = Element::createList();
+
+    skipWhitespace();
+    while (c != EOF && c != ']') {
+        if (peek() != ']') {
+            list->add(parseElement());
+            c = skipTo(",]");
+        } else {
+            c = get();
+            ++pos_;
+        }
+    }
+    return (list);
+}
+
+ElementPtr
+BufferParser::parseMap() {
+    ElementPtr map = Element::createMap();
+    skipWhitespace();
+    int c = peek();
+    if (c == EOF) {
+        throwError("Unterminated map, <string> or } expected");
+    } else if (c == '}') {
+        // empty map, skip closing curly
+        ++current_;
+    } else {
+        while (c != EOF && c != '}') {
+            const std::string key = readString();
+            skipTo(":");
+            map->set(key, parseElement());
+            c = skipTo(",}");
+        }
+    }
+    return (map);
+}
+
+ElementPtr
+BufferParser::parseElement() {
+    skipWhitespace();
+    const int c = get();
+    ++pos_;
+    switch (c) {
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    case '0':
+    case '-':
+    case '+':
+    case '.':
+        --current_;
+        --pos_;
+        return (parseNumber());
+    case 't':
+    case 'T':
+    case 'f':
+    case 'F':
+        --current_;
+        --pos_;
+        return (parseBool());
+    case 'n':
+    case 'N':
+        --current_;
+        --pos_;
+        return (parseNull());
+    case '"':
+        --current_;
+        --pos_;
+        return (Element::create(readString()));
+    case '[':
+        return (parseList());
+    case '{':
+        return (parseMap());
+    case EOF:
+        bundy_throw(JSONError, "nothing read");
+    default:
+        throwError(std::string("error: unexpected character ") +
+                   std::string(1, c));
+        return (ElementPtr());
+    }
+}
 } // unnamed namespace
 
 std::string
@@ -643,16 +1205,21 @@ Element::fromJSON(std::istream& in, const std::string& file, int& line,
 
 ElementPtr
 Element::fromJSON(const std::string& in) {
-    std::stringstream ss;
-    ss << in;
-    int line = 1, pos = 1;
-    ElementPtr result(fromJSON(ss, "<string>", line, pos));
-    skipChars(ss, WHITESPACE, line, pos);
-    // ss must now be at end
-    if (ss.peek() != EOF) {
-        throwJSONError("Extra data", "<string>", line, pos);
+    return (fromJSON(in.data(), in.size(), "<string>"));
+}
+
+ElementPtr
+Element::fromJSON(const char* data, size_t length,
+                  const std::string& file_name)
+{
+    BufferParser parser(data, length, file_name, 1, 1);
+    ElementPtr result(parser.parseElement());
+    parser.skipWhitespace();
+    // the buffer must now be at end
+    if (!parser.atEnd()) {
+        parser.throwError("Extra data");
     }
-    return result;
+    return (result);
 }
 
 // to JSON format
@@ -780,10 +1347,13 @@ MapElement::find(const std::string& id) const {
 
 ElementPtr
 Element::fromWire(const std::string& s) {
-    std::stringstream ss;
-    ss << s;
-    int line = 0, pos = 0;
-    return (fromJSON(ss, "<wire>", line, pos));
+    return (fromWire(s.data(), s.size()));
+}
+
+ElementPtr
+Element::fromWire(const char* data, size_t length) {
+    BufferParser parser(data, length, "<wire>", 0, 0);
+    return (parser.parseElement());
 }
 
 ElementPtr
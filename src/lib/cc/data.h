@@ -107,6 +107,32 @@ public:
     std::string toWire() const;
     void toWire(std::ostream& out) const;
 
+    /// Returns the binary wireformat for the Element and all its child
+    /// elements.
+    ///
+    /// The binary wireformat is a compact alternative to the JSON one,
+    /// which is much cheaper to encode and decode. It starts with the
+    /// byte \c BINARY_WIRE_MAGIC, which can't start a JSON text, followed
+    /// by the element. Each element is a type byte followed by the value:
+    /// nothing for null and booleans (the type tells the value), 8 bytes
+    /// in network byte order for integers and reals (IEEE 754 double),
+    /// and a 4-byte length (the number of children for lists and maps)
+    /// for the rest. A string is followed by its bytes, a list by its
+    /// elements, and a map by its keys (with a 4-byte length each) and
+    /// values in turn.
+    ///
+    /// \return std::string containing the element in binary wire format
+    std::string toBinaryWire() const;
+
+    /// Appends the binary wireformat of the Element and all its child
+    /// elements to the given string.
+    ///
+    /// \param out The string to append to
+    void toBinaryWire(std::string& out) const;
+
+    /// The first byte of the data in binary wireformat.
+    static const uint8_t BINARY_WIRE_MAGIC = 0xb1;
+
     /// \name pure virtuals, every derived class must implement these
 
     /// \return true if the other ElementPtr has the same type and value
@@ -314,6 +340,25 @@ public:
     /// in the given string.
     static ElementPtr fromJSON(const std::string& in);
 
+    /// Creates an Element from the JSON formatted data in the given
+    /// buffer.
+    ///
+    /// The buffer is parsed directly, which is much faster than going
+    /// through an input stream, so this should be preferred for large
+    /// data already in memory. The accepted syntax and the errors
+    /// (including the reported positions) are the same as with the
+    /// other versions. As with \c fromJSON(const std::string&), the
+    /// buffer must contain a single element and nothing but whitespace
+    /// after it.
+    ///
+    /// \param data Pointer to the data
+    /// \param length The length of the data
+    /// \param file_name The name used in the error messages
+    /// \return An ElementPtr that contains the element(s) specified
+    /// in the given buffer.
+    static ElementPtr fromJSON(const char* data, size_t length,
+                               const std::string& file_name = "<string>");
+
     /// Creates an Element from the given input stream containing JSON
     /// formatted data.
     ///
@@ -378,6 +423,34 @@ public:
     /// \param s The input string
     /// \return ElementPtr with the data that is parsed.
     static ElementPtr fromWire(const std::string& s);
+
+    /// Creates an Element from the wire format in the given buffer,
+    /// without copying it into a stream first.
+    ///
+    /// \param data Pointer to the data
+    /// \param length The length of the data
+    /// \return ElementPtr with the data that is parsed.
+    static ElementPtr fromWire(const char* data, size_t length);
+
+    /// Creates an Element from the binary wire format (see
+    /// \c toBinaryWire()).
+    ///
+    /// The data is decoded in place, so it doesn't need to be copied
+    /// into a string or stream first. A JSONError is thrown if the data
+    /// is malformed.
+    ///
+    /// \param data Pointer to the data
+    /// \param length The length of the data
+    /// \return ElementPtr with the data that is decoded.
+    static ElementPtr fromBinaryWire(const void* data, size_t length);
+
+    /// Checks whether the data is in the binary wire format rather than
+    /// JSON.
+    ///
+    /// \param data Pointer to the data
+    /// \param length The length of the data
+    /// \return true if the data starts with \c BINARY_WIRE_MAGIC
+    static bool isBinaryWire(const void* data, size_t length);
     //@}
 };
 
@@ -32,6 +32,7 @@ const char* const CC_HEADER_INSTANCE = "instance";
 const char* const CC_HEADER_SEQ = "seq";
 const char* const CC_HEADER_WANT_ANSWER = "want_answer";
 const char* const CC_HEADER_REPLY = "reply";
+const char* const CC_HEADER_ENCODINGS = "encodings";
 // The commands in the "type" header
 const char* const CC_COMMAND_SEND = "send";
 const char* const CC_COMMAND_SUBSCRIBE = "subscribe";
@@ -43,6 +44,9 @@ const char* const CC_COMMAND_STOP = "stop";
 // The wildcards of some headers
 const char* const CC_TO_WILDCARD = "*";
 const char* const CC_INSTANCE_WILDCARD = "*";
+// The encodings of the message body (beside JSON, which is always
+// understood) in the "encodings" header
+const char* const CC_ENCODING_BINARY = "binary";
 // Prefixes for groups
 const char* const CC_GROUP_NOTIFICATION_PREFIX = "notifications/";
 // Reply codes
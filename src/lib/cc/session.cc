@@ -74,7 +74,7 @@ namespace cc {
 class SessionImpl {
 public:
     SessionImpl(io_service& io_service) :
-        sequence_(-1), queue_(Element::createList()),
+        sequence_(-1), queue_(Element::createList()), binary_wire_(false),
         io_service_(io_service), socket_(io_service_), data_length_(0),
         timeout_(MSGQ_DEFAULT_TIMEOUT)
     {}
@@ -93,6 +93,8 @@ public:
     long int sequence_; // the next sequence number to use
     std::string lname_;
     ElementPtr queue_;
+    // Whether the message bodies are sent in the binary wire format
+    bool binary_wire_;
 
 private:
     void internalRead(const asio::error_code& error,
@@ -323,16 +325,33 @@ Session::establish(const char* socket_file) {
     SessionHolder session_holder(impl_);
 
     //
-    // send a request for our local name, and wait for a response
+    // send a request for our local name, and wait for a response.
+    // We tell msgq we understand the binary wire format too; if it
+    // lists the format in the response, we use it for the bodies
+    // we send.
     //
     ElementPtr get_lname_msg(Element::createMap());
     get_lname_msg->set(CC_HEADER_TYPE, Element::create(CC_COMMAND_GET_LNAME));
+    ElementPtr encodings(Element::createList());
+    encodings->add(Element::create(CC_ENCODING_BINARY));
+    get_lname_msg->set(CC_HEADER_ENCODINGS, encodings);
     sendmsg(get_lname_msg);
 
     ConstElementPtr routing, msg;
     recvmsg(routing, msg, false);
 
     impl_->lname_ = msg->get(CC_PAYLOAD_LNAME)->stringValue();
+    impl_->binary_wire_ = false;
+    ConstElementPtr accepted = routing->get(CC_HEADER_ENCODINGS);
+    if (accepted && accepted->getType() == Element::list) {
+        for (size_t i = 0; i < accepted->size(); ++i) {
+            ConstElementPtr encoding = accepted->get(i);
+            if (encoding->getType() == Element::string &&
+                encoding->stringValue() == CC_ENCODING_BINARY) {
+                impl_->binary_wire_ = true;
+            }
+        }
+    }
     LOG_DEBUG(logger, DBG_TRACE_DETAILED, CC_LNAME_RECEIVED).arg(impl_->lname_);
 
     // At this point there's no risk of resource leak.
@@ -359,7 +378,9 @@ Session::sendmsg(ConstElementPtr header) {
 void
 Session::sendmsg(ConstElementPtr header, ConstElementPtr payload) {
     std::string header_wire = header->toWire();
-    std::string body_wire = payload->toWire();
+    // The header is always JSON, as msgq needs to route the message.
+    std::string body_wire = impl_->binary_wire_ ? payload->toBinaryWire() :
+        payload->toWire();
     unsigned int length = 2 + header_wire.length() + body_wire.length();
     unsigned int length_net = htonl(length);
     unsigned short header_length = header_wire.length();
@@ -416,18 +437,18 @@ Session::recvmsg(ConstElementPtr& env, ConstElementPtr& msg,
     std::vector<char> buffer(length);
     impl_->readData(&buffer[0], length);
 
-    std::string header_wire = std::string(&buffer[0], header_length);
-    std::string body_wire = std::string(&buffer[0] + header_length,
-                                        length - header_length);
-    std::stringstream header_wire_stream;
-    header_wire_stream << header_wire;
-    ConstElementPtr l_env =
-        Element::fromWire(header_wire_stream, header_length);
-    
-    std::stringstream body_wire_stream;
-    body_wire_stream << body_wire;
-    ConstElementPtr l_msg =
-        Element::fromWire(body_wire_stream, length - header_length);
+    // Both parts are decoded directly from the buffer.
+    ConstElementPtr l_env = Element::fromWire(&buffer[0], header_length);
+
+    // The body may be in either format.
+    const char* body_data = &buffer[0] + header_length;
+    const size_t body_length = length - header_length;
+    ConstElementPtr l_msg;
+    if (Element::isBinaryWire(body_data, body_length)) {
+        l_msg = Element::fromBinaryWire(body_data, body_length);
+    } else {
+        l_msg = Element::fromWire(body_data, body_length);
+    }
     if ((seq == -1 &&
          !l_env->contains(CC_HEADER_REPLY)
         ) || (
@@ -396,6 +396,74 @@ testGetValueMap() {
     EXPECT_EQ("{  }", el->str());
 }
 
+// Returns the message of the JSONError thrown by parsing the string from
+// a stream, followed by the message thrown by parsing it from a buffer.
+std::string
+parseErrors(const std::string& json) {
+    std::string errors;
+    try {
+        std::istringstream iss(json);
+        Element::fromJSON(iss, "<file>");
+    } catch (const JSONError& ex) {
+        errors += ex.what();
+    }
+    errors += " / ";
+    try {
+        Element::fromJSON(json.data(), json.size(), "<file>");
+    } catch (const JSONError& ex) {
+        errors += ex.what();
+    }
+    return (errors);
+}
+
+TEST(Element, from_json_buffer) {
+    const std::string json =
+        "{ \"a\": [ 1, -2.5e3, \"x\\ny\\\"z\\\\\", true, False, null ],\n"
+        "  \"b\": { \"c\": [], \"d\": {} }, \"e\": \"\" }  \n";
+    std::istringstream iss(json);
+    const ConstElementPtr expected = Element::fromJSON(iss);
+    EXPECT_EQ(*expected, *Element::fromJSON(json.data(), json.size()));
+    EXPECT_EQ(*expected, *Element::fromJSON(json));
+    EXPECT_EQ(*expected, *Element::fromWire(json.data(), json.size()));
+    EXPECT_EQ("x\ny\"z\\",
+              Element::fromJSON(json.data(), json.size())->get("a")->
+              get(2)->stringValue());
+
+    // Only the given length is parsed.
+    EXPECT_EQ(*Element::fromJSON("[ 1, 2 ]"),
+              *Element::fromJSON("[ 1, 2 ]garbage", 8));
+    // The wire format doesn't check for extra data.
+    EXPECT_EQ(*Element::fromJSON("[ 1, 2 ]"),
+              *Element::fromWire("[ 1, 2 ]garbage", 15));
+    EXPECT_THROW(Element::fromJSON("[ 1, 2 ]garbage", 15), JSONError);
+
+    // The errors are the same as when parsing from the stream, including
+    // the positions.
+    EXPECT_EQ("String expected in <file>:1:3 / "
+              "String expected in <file>:1:3", parseErrors("{1}"));
+    EXPECT_EQ("Bad boolean value: Tru in <file>:3:4 / "
+              "Bad boolean value: Tru in <file>:3:4", parseErrors("\n\nTru"));
+    EXPECT_EQ("'e' read, one of \":\" expected in <file>:2:12 / "
+              "'e' read, one of \":\" expected in <file>:2:12",
+              parseErrors("{ \n \"aaa\nbbb\"err:"));
+    EXPECT_EQ("Unterminated string in <file>:5:12 / "
+              "Unterminated string in <file>:5:12",
+              parseErrors("{ \t\n \"aaa\nbbb\"\t\n\n:\n True, \"\\\""));
+    EXPECT_EQ("Bad escape in <file>:1:3 / Bad escape in <file>:1:3",
+              parseErrors("\"\\x\""));
+    EXPECT_EQ("'2' read, one of \",]\" expected in <file>:2:3 / "
+              "'2' read, one of \",]\" expected in <file>:2:3",
+              parseErrors("[1\n 2]"));
+    EXPECT_EQ("nothing read / nothing read", parseErrors(" "));
+    EXPECT_EQ("Number overflow: 1-2 / Number overflow: 1-2",
+              parseErrors("1-2"));
+    EXPECT_EQ("Number overflow: 1e999 / Number overflow: 1e999",
+              parseErrors("1e999"));
+    EXPECT_EQ("Number overflow: 9223372036854775808 / "
+              "Number overflow: 9223372036854775808",
+              parseErrors("9223372036854775808"));
+}
+
 TEST(Element, create_and_value_throws) {
     // this test checks whether elements throw exceptions if the
     // incorrect type is requested
@@ -678,6 +746,76 @@ TEST(Element, to_and_from_wire) {
     EXPECT_THROW(Element::fromJSON("[ \"a\": \"b\" ]"), bundy::data::JSONError);
 }
 
+TEST(Element, to_and_from_binary_wire) {
+    // Every element type survives the round trip.
+    const char* const jsons[] = {
+        "null", "true", "false", "0", "-1", "9223372036854775807",
+        "-9223372036854775808", "1.1", "-2.5e-10", "\"\"",
+        "\"a string\"", "[]", "{}", "[ 1, \"a\", [ true, null ], {} ]",
+        "{ \"a\": 1, \"b\": [ \"c\", 2.5 ], \"d\": { \"e\": false } }",
+        NULL
+    };
+    for (size_t i = 0; jsons[i] != NULL; ++i) {
+        SCOPED_TRACE(jsons[i]);
+        ConstElementPtr el = Element::fromJSON(jsons[i]);
+        const std::string wire = el->toBinaryWire();
+        EXPECT_TRUE(Element::isBinaryWire(wire.data(), wire.size()));
+        ConstElementPtr decoded = Element::fromBinaryWire(wire.data(),
+                                                          wire.size());
+        EXPECT_EQ(*el, *decoded);
+        EXPECT_EQ(el->getType(), decoded->getType());
+    }
+
+    // The exact encoding of some simple elements
+    const uint8_t int_wire[] = { Element::BINARY_WIRE_MAGIC, 3,
+                                 0, 0, 0, 0, 0, 0, 1, 2 };
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(int_wire),
+                          sizeof(int_wire)),
+              Element::create(0x102)->toBinaryWire());
+    const uint8_t map_wire[] = { Element::BINARY_WIRE_MAGIC, 7, 0, 0, 0, 1,
+                                 0, 0, 0, 1, 'a', 5, 0, 0, 0, 1, 'b' };
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(map_wire),
+                          sizeof(map_wire)),
+              Element::fromJSON("{ \"a\": \"b\" }")->toBinaryWire());
+
+    // Appending to a string
+    std::string out("x");
+    Element::create(true)->toBinaryWire(out);
+    EXPECT_EQ(std::string("x\xb1\x02"), out);
+
+    // A NULL value in a map becomes null.
+    ElementPtr map = Element::createMap();
+    map->set("a", ConstElementPtr());
+    const std::string null_wire = map->toBinaryWire();
+    EXPECT_EQ(*Element::fromJSON("{ \"a\": null }"),
+              *Element::fromBinaryWire(null_wire.data(), null_wire.size()));
+
+    // JSON isn't binary wire format.
+    const std::string json = "{ \"a\": 1 }";
+    EXPECT_FALSE(Element::isBinaryWire(json.data(), json.size()));
+    EXPECT_FALSE(Element::isBinaryWire(json.data(), 0));
+    EXPECT_THROW(Element::fromBinaryWire(json.data(), json.size()),
+                 JSONError);
+
+    // Malformed data
+    const std::string wire = Element::fromJSON(
+        "{ \"a\": [ 1, \"b\", 2.5 ], \"c\": true }")->toBinaryWire();
+    for (size_t len = 0; len < wire.size(); ++len) {
+        EXPECT_THROW(Element::fromBinaryWire(wire.data(), len), JSONError);
+    }
+    const std::string extra = wire + '\0';
+    EXPECT_THROW(Element::fromBinaryWire(extra.data(), extra.size()),
+                 JSONError);
+    const uint8_t bad_type[] = { Element::BINARY_WIRE_MAGIC, 8 };
+    EXPECT_THROW(Element::fromBinaryWire(bad_type, sizeof(bad_type)),
+                 JSONError);
+    // A list claiming more elements than there can be in the data
+    const uint8_t bad_count[] = { Element::BINARY_WIRE_MAGIC, 6,
+                                  0xff, 0xff, 0xff, 0xff, 0 };
+    EXPECT_THROW(Element::fromBinaryWire(bad_count, sizeof(bad_count)),
+                 JSONError);
+}
+
 ConstElementPtr
 efs(const std::string& str) {
     return (Element::fromJSON(str));
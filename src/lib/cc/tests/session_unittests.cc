@@ -75,7 +75,8 @@ public:
         io_service_(io_service),
         ep_(file),
         acceptor_(io_service_, ep_),
-        socket_(io_service_)
+        socket_(io_service_),
+        binary_wire_(false)
     {
         acceptor_.async_accept(socket_,
                                boost::bind(&TestDomainSocket::acceptHandler,
@@ -92,7 +93,8 @@ public:
 
     void sendmsg(bundy::data::ElementPtr& env, bundy::data::ElementPtr& msg) {
         const std::string header_wire = env->toWire();
-        const std::string body_wire = msg->toWire();
+        const std::string body_wire = binary_wire_ ? msg->toBinaryWire() :
+            msg->toWire();
         const unsigned int length = 2 + header_wire.length() +
             body_wire.length();
         const unsigned int length_net = htonl(length);
@@ -114,6 +116,11 @@ public:
         sendmsg(lname_answer1, lname_answer2);
     }
 
+    // Send the message bodies in the binary wire format
+    void setBinaryWire() {
+        binary_wire_ = true;
+    }
+
     void setSendLname() {
         // ignore whatever data we get, send back an lname
         asio::async_read(socket_,  asio::buffer(data_buf, 0),
@@ -125,6 +132,7 @@ private:
     asio::local::stream_protocol::endpoint ep_;
     asio::local::stream_protocol::acceptor acceptor_;
     asio::local::stream_protocol::socket socket_;
+    bool binary_wire_;
     char data_buf[1024];
 };
 
@@ -309,6 +317,31 @@ TEST_F(SessionTest, get_socket_descr) {
     EXPECT_LT(0, socket);
 }
 
+// The session tells msgq it understands the binary wire format.
+TEST_F(SessionTest, establish_encodings) {
+    tds->setSendLname();
+    sess.establish(BUNDY_TEST_SOCKET_FILE);
+
+    const SentMessage& msg(sess.getSentMessage());
+    EXPECT_EQ(*Element::fromJSON("{ \"type\": \"getlname\","
+                                 "  \"encodings\": [ \"binary\" ] }"),
+              *msg.first);
+}
+
+// A message body in the binary wire format is decoded.
+TEST_F(SessionTest, recv_binary_wire) {
+    tds->setBinaryWire();
+    tds->setSendLname();
+    sess.establish(BUNDY_TEST_SOCKET_FILE);
+    sess.getSentMessage();
+
+    // The lname came in the binary body.
+    const ConstElementPtr msg(Element::fromJSON("{\"test\": 42}"));
+    sess.group_sendmsg(msg, "group");
+    EXPECT_EQ("foobar",
+              sess.getSentMessage().first->get("from")->stringValue());
+}
+
 // Test the group_sendmsg sends the correct data.
 TEST_F(SessionTest, group_sendmsg) {
     // Connect (to set the lname, so we can see it sets the from)
@@ -262,9 +262,13 @@ readLoggersConf(std::vector<bundy::log::LoggerSpecification>& specs,
     bool additive = getValueOrDefault(logger, "additive", config_data,
                                       "loggers/additive")->boolValue();
 
+    bool async = getValueOrDefault(logger, "async", config_data,
+                                   "loggers/async")->boolValue();
+
     bundy::log::LoggerSpecification logger_spec(
         lname, severity, dbg_level, additive
     );
+    logger_spec.setAsync(async);
 
     if (logger->contains("output_options")) {
         BOOST_FOREACH(ConstElementPtr output_option_el,
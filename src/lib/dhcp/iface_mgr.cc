@@ -28,16 +28,23 @@
 #include <exceptions/exceptions.h>
 #include <util/io/pktinfo_utilities.h>
 
+#include <algorithm>
 #include <cstring>
 #include <errno.h>
 #include <fstream>
+#include <limits>
 #include <sstream>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <string.h>
 #include <sys/select.h>
 
+#if defined(OS_LINUX)
+#include <sys/epoll.h>
+#endif
+
 using namespace std;
 using namespace bundy::asiolink;
 using namespace bundy::util::io::internal;
@@ -45,6 +52,9 @@ using namespace bundy::util::io::internal;
 namespace bundy {
 namespace dhcp {
 
+// No sockets have been added yet.
+uint32_t Iface::socket_changes_ = 0;
+
 IfaceMgr&
 IfaceMgr::instance() {
     static IfaceMgr iface_mgr;
@@ -96,6 +106,7 @@ Iface::closeSockets(const uint16_t family) {
                 close(sock->fallbackfd_);
             }
             sockets_.erase(sock++);
+            ++socket_changes_;
 
         } else {
             // Different type of socket. Let's move
@@ -160,6 +171,7 @@ bool Iface::delSocket(const uint16_t sockfd) {
                 close(sock->fallbackfd_);
             }
             sockets_.erase(sock);
+            ++socket_changes_;
             return (true); //socket found
         }
         ++sock;
@@ -262,6 +274,11 @@ IfaceMgr::addExternalSocket(int socketfd, SocketCallback callback) {
     x.socket_ = socketfd;
     x.callback_ = callback;
     callbacks_.push_back(x);
+
+    // The socket will be added to the sets of sockets by the next call
+    // to the receive functions.
+    receive_set4_.valid_ = false;
+    receive_set6_.valid_ = false;
 }
 
 void
@@ -270,6 +287,8 @@ IfaceMgr::deleteExternalSocket(int socketfd) {
          s != callbacks_.end(); ++s) {
         if (s->socket_ == socketfd) {
             callbacks_.erase(s);
+            receive_set4_.valid_ = false;
+            receive_set6_.valid_ = false;
             return;
         }
     }
@@ -612,6 +631,8 @@ IfaceMgr::getIface(const std::string& ifname) {
 void
 IfaceMgr::clearIfaces() {
     ifaces_.clear();
+    receive_set4_.valid_ = false;
+    receive_set6_.valid_ = false;
 }
 
 int IfaceMgr::openSocket(const std::string& ifname, const IOAddress& addr,
@@ -826,207 +847,314 @@ IfaceMgr::send(const Pkt4Ptr& pkt) {
 }
 
 
-boost::shared_ptr<Pkt4>
-IfaceMgr::receive4(uint32_t timeout_sec, uint32_t timeout_usec /* = 0 */) {
-    // Sanity check for microsecond timeout.
-    if (timeout_usec >= 1000000) {
-        bundy_throw(BadValue, "fractional timeout must be shorter than"
-                  " one million microseconds");
-    }
-    const SocketInfo* candidate = 0;
-    IfaceCollection::const_iterator iface;
-    fd_set sockets;
-    int maxfd = 0;
-
-    FD_ZERO(&sockets);
+IfaceMgr::ReceiveSet::ReceiveSet()
+    : socket_changes_(0), valid_(false), epoll_fd_(-1), max_fd_(-1) {
+    FD_ZERO(&fds_);
+}
 
-    /// @todo: marginal performance optimization. We could create the set once
-    /// and then use its copy for select(). Please note that select() modifies
-    /// provided set to indicated which sockets have something to read.
-    for (iface = ifaces_.begin(); iface != ifaces_.end(); ++iface) {
+IfaceMgr::ReceiveSet::~ReceiveSet() {
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
 
-        const Iface::SocketCollection& socket_collection = iface->getSockets();
-        for (Iface::SocketCollection::const_iterator s = socket_collection.begin();
-             s != socket_collection.end(); ++s) {
+void
+IfaceMgr::ReceiveSet::clear() {
+    valid_ = false;
+    sockets_.clear();
+#if defined(OS_LINUX)
+    // The descriptors closed since the set was built have been removed
+    // from the epoll set by the kernel, but their numbers may have been
+    // reused. It is simpler to start with a new epoll set.
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+    epoll_fd_ = epoll_create(1);
+    if (epoll_fd_ < 0) {
+        bundy_throw(SocketReadError, "failed to create the epoll set: "
+                    << strerror(errno));
+    }
+#else
+    FD_ZERO(&fds_);
+    max_fd_ = -1;
+#endif
+}
 
-            // Only deal with IPv4 addresses.
-            if (s->addr_.isV4()) {
+void
+IfaceMgr::ReceiveSet::add(const int fd, const ReceiveSocket& socket) {
+    if (!sockets_.insert(std::make_pair(fd, socket)).second) {
+        // Several sockets may share the descriptor, e.g. in the unit
+        // tests. The first one wins.
+        return;
+    }
+#if defined(OS_LINUX)
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        const int error = errno;
+        sockets_.erase(fd);
+        bundy_throw(SocketReadError, "failed to add the socket " << fd
+                    << " to the epoll set: " << strerror(error));
+    }
+#else
+    if (fd >= FD_SETSIZE) {
+        sockets_.erase(fd);
+        bundy_throw(SocketReadError, "the socket " << fd << " exceeds"
+                    " the maximum descriptor supported by select()");
+    }
+    FD_SET(fd, &fds_);
+    if (max_fd_ < fd) {
+        max_fd_ = fd;
+    }
+#endif
+}
 
-                // Add this socket to listening set
-                FD_SET(s->sockfd_, &sockets);
-                if (maxfd < s->sockfd_) {
-                    maxfd = s->sockfd_;
-                }
+void
+IfaceMgr::ReceiveSet::wait(const uint32_t timeout_sec,
+                           const uint32_t timeout_usec,
+                           const size_t max_ready,
+                           std::vector<ReceiveSocket>& ready) {
+    ready.clear();
+#if defined(OS_LINUX)
+    // Round the timeout up to the next millisecond, so as a short timeout
+    // doesn't become a poll.
+    const uint64_t timeout_ms = static_cast<uint64_t>(timeout_sec) * 1000 +
+        (timeout_usec + 999) / 1000;
+    std::vector<struct epoll_event> events(max_ready > 0 ? max_ready : 1);
+    const int result = epoll_wait(epoll_fd_, &events[0], events.size(),
+                                  std::min(timeout_ms, static_cast<uint64_t>
+                                           (std::numeric_limits<int>::max())));
+    if (result < 0) {
+        bundy_throw(SocketReadError, strerror(errno));
+    } else if (result == 0) {
+        // A descriptor closed behind our back is silently removed from the
+        // epoll set, whereas select() reports it. Check the descriptors when
+        // nothing has been received, so as such an error doesn't go unnoticed.
+        for (std::map<int, ReceiveSocket>::const_iterator socket =
+                 sockets_.begin(); socket != sockets_.end(); ++socket) {
+            if ((fcntl(socket->first, F_GETFD) < 0) && (errno == EBADF)) {
+                bundy_throw(SocketReadError, strerror(errno));
             }
         }
     }
-
-    // if there are any callbacks for external sockets registered...
-    if (!callbacks_.empty()) {
-        for (SocketCallbackInfoContainer::const_iterator s = callbacks_.begin();
-             s != callbacks_.end(); ++s) {
-            FD_SET(s->socket_, &sockets);
-            if (maxfd < s->socket_) {
-                maxfd = s->socket_;
-            }
+    for (int i = 0; i < result; ++i) {
+        std::map<int, ReceiveSocket>::const_iterator socket =
+            sockets_.find(events[i].data.fd);
+        if (socket != sockets_.end()) {
+            ready.push_back(socket->second);
         }
     }
-
+#else
+    // select() modifies the set to indicate which sockets have something
+    // to read, so it is given a copy.
+    fd_set fds = fds_;
     struct timeval select_timeout;
     select_timeout.tv_sec = timeout_sec;
     select_timeout.tv_usec = timeout_usec;
-
-    int result = select(maxfd + 1, &sockets, NULL, NULL, &select_timeout);
-
-    if (result == 0) {
-        // nothing received and timeout has been reached
-        return (Pkt4Ptr()); // NULL
-    } else if (result < 0) {
+    const int result = select(max_fd_ + 1, &fds, NULL, NULL, &select_timeout);
+    if (result < 0) {
         bundy_throw(SocketReadError, strerror(errno));
     }
-
-    // Let's find out which socket has the data
-    for (SocketCallbackInfoContainer::iterator s = callbacks_.begin();
-         s != callbacks_.end(); ++s) {
-        if (!FD_ISSET(s->socket_, &sockets)) {
-            continue;
+    for (std::map<int, ReceiveSocket>::const_iterator socket = sockets_.begin();
+         (result > 0) && (socket != sockets_.end()) &&
+             (ready.size() < max_ready); ++socket) {
+        if (FD_ISSET(socket->first, &fds)) {
+            ready.push_back(socket->second);
         }
+    }
+#endif
+}
 
-        // something received over external socket
-
-        // Calling the external socket's callback provides its service
-        // layer access without integrating any specific features
-        // in IfaceMgr
-        if (s->callback_) {
-            s->callback_();
-        }
+void
+IfaceMgr::updateReceiveSet(ReceiveSet& receive_set, const uint16_t family) {
+    if (receive_set.isCurrent()) {
+        return;
+    }
+    receive_set.clear();
 
-        return (Pkt4Ptr());
+    // The external sockets are added first, so as they take precedence
+    // if an interface socket has the same descriptor.
+    for (SocketCallbackInfoContainer::const_iterator s = callbacks_.begin();
+         s != callbacks_.end(); ++s) {
+        const ReceiveSocket socket = { s->socket_, NULL, NULL };
+        receive_set.add(s->socket_, socket);
     }
 
-    // Let's find out which interface/socket has the data
-    for (iface = ifaces_.begin(); iface != ifaces_.end(); ++iface) {
+    for (IfaceCollection::const_iterator iface = ifaces_.begin();
+         iface != ifaces_.end(); ++iface) {
         const Iface::SocketCollection& socket_collection = iface->getSockets();
         for (Iface::SocketCollection::const_iterator s = socket_collection.begin();
              s != socket_collection.end(); ++s) {
-            if (FD_ISSET(s->sockfd_, &sockets)) {
-                candidate = &(*s);
-                break;
+            // Only deal with the addresses of the requested family.
+            if ((family == AF_INET) ? s->addr_.isV4() : s->addr_.isV6()) {
+                const ReceiveSocket socket = { s->sockfd_, &(*iface), &(*s) };
+                receive_set.add(s->sockfd_, socket);
             }
         }
-        if (candidate) {
-            break;
-        }
     }
 
-    if (!candidate) {
-        bundy_throw(SocketReadError, "received data over unknown socket");
-    }
+    receive_set.socket_changes_ = Iface::getSocketChanges();
+    receive_set.valid_ = true;
+}
 
-    // Now we have a socket, let's get some data from it!
-    // Assuming that packet filter is not NULL, because its modifier checks it.
-    return (packet_filter_->receive(*iface, *candidate));
+void
+IfaceMgr::callExternalSocketCallback(const int socketfd) {
+    for (SocketCallbackInfoContainer::iterator s = callbacks_.begin();
+         s != callbacks_.end(); ++s) {
+        if (s->socket_ == socketfd) {
+            // Calling the external socket's callback provides its service
+            // layer access without integrating any specific features
+            // in IfaceMgr
+            if (s->callback_) {
+                s->callback_();
+            }
+            return;
+        }
+    }
 }
 
-Pkt6Ptr IfaceMgr::receive6(uint32_t timeout_sec, uint32_t timeout_usec /* = 0 */ ) {
+boost::shared_ptr<Pkt4>
+IfaceMgr::receive4(uint32_t timeout_sec, uint32_t timeout_usec /* = 0 */) {
     // Sanity check for microsecond timeout.
     if (timeout_usec >= 1000000) {
         bundy_throw(BadValue, "fractional timeout must be shorter than"
                   " one million microseconds");
     }
 
-    const SocketInfo* candidate = 0;
-    fd_set sockets;
-    int maxfd = 0;
+    updateReceiveSet(receive_set4_, AF_INET);
+    std::vector<ReceiveSocket> ready;
+    receive_set4_.wait(timeout_sec, timeout_usec, 1, ready);
 
-    FD_ZERO(&sockets);
+    if (ready.empty()) {
+        // nothing received and timeout has been reached
+        return (Pkt4Ptr()); // NULL
+    }
 
-    /// @todo: marginal performance optimization. We could create the set once
-    /// and then use its copy for select(). Please note that select() modifies
-    /// provided set to indicated which sockets have something to read.
-    IfaceCollection::const_iterator iface;
-    for (iface = ifaces_.begin(); iface != ifaces_.end(); ++iface) {
-        const Iface::SocketCollection& socket_collection = iface->getSockets();
-        for (Iface::SocketCollection::const_iterator s = socket_collection.begin();
-             s != socket_collection.end(); ++s) {
+    if (!ready[0].iface_) {
+        // something received over external socket
+        callExternalSocketCallback(ready[0].fd_);
+        return (Pkt4Ptr());
+    }
 
-            // Only deal with IPv6 addresses.
-            if (s->addr_.isV6()) {
+    // Now we have a socket, let's get some data from it!
+    // Assuming that packet filter is not NULL, because its modifier checks it.
+    return (packet_filter_->receive(*ready[0].iface_, *ready[0].socket_));
+}
 
-                // Add this socket to listening set
-                FD_SET(s->sockfd_, &sockets);
-                if (maxfd < s->sockfd_) {
-                    maxfd = s->sockfd_;
-                }
-            }
-        }
+size_t
+IfaceMgr::receiveBatch4(std::vector<Pkt4Ptr>& pkts, uint32_t timeout_sec,
+                        uint32_t timeout_usec /* = 0 */,
+                        IfaceMgrErrorMsgCallback error_handler /* = NULL */) {
+    // Sanity check for microsecond timeout.
+    if (timeout_usec >= 1000000) {
+        bundy_throw(BadValue, "fractional timeout must be shorter than"
+                  " one million microseconds");
     }
 
-    // if there are any callbacks for external sockets registered...
-    if (!callbacks_.empty()) {
-        for (SocketCallbackInfoContainer::const_iterator s = callbacks_.begin();
-             s != callbacks_.end(); ++s) {
-
-            // Add it to the set as well
-            FD_SET(s->socket_, &sockets);
-            if (maxfd < s->socket_) {
-                maxfd = s->socket_;
+    updateReceiveSet(receive_set4_, AF_INET);
+    std::vector<ReceiveSocket> ready;
+    receive_set4_.wait(timeout_sec, timeout_usec,
+                       receive_set4_.sockets_.size(), ready);
+
+    const size_t received = pkts.size();
+    for (std::vector<ReceiveSocket>::const_iterator socket = ready.begin();
+         socket != ready.end(); ++socket) {
+        if (!socket->iface_) {
+            callExternalSocketCallback(socket->fd_);
+            // The callback may have changed the sockets, e.g. when the
+            // server has been reconfigured. The remaining sockets will
+            // be reported again by the next call.
+            if (!receive_set4_.isCurrent()) {
+                break;
             }
+            continue;
+        }
+        // A failure on one socket must not lose the packets received
+        // (or still waiting) on the others.
+        try {
+            packet_filter_->receiveBatch(*socket->iface_, *socket->socket_,
+                                         pkts);
+        } catch (const Exception& ex) {
+            IFACEMGR_ERROR(SocketReadError, error_handler,
+                           "failed to receive a packet on interface "
+                           << socket->iface_->getName() << ", reason: "
+                           << ex.what());
         }
     }
+    return (pkts.size() - received);
+}
 
-    struct timeval select_timeout;
-    select_timeout.tv_sec = timeout_sec;
-    select_timeout.tv_usec = timeout_usec;
+Pkt6Ptr IfaceMgr::receive6(uint32_t timeout_sec, uint32_t timeout_usec /* = 0 */ ) {
+    // Sanity check for microsecond timeout.
+    if (timeout_usec >= 1000000) {
+        bundy_throw(BadValue, "fractional timeout must be shorter than"
+                  " one million microseconds");
+    }
 
-    int result = select(maxfd + 1, &sockets, NULL, NULL, &select_timeout);
+    updateReceiveSet(receive_set6_, AF_INET6);
+    std::vector<ReceiveSocket> ready;
+    receive_set6_.wait(timeout_sec, timeout_usec, 1, ready);
 
-    if (result == 0) {
+    if (ready.empty()) {
         // nothing received and timeout has been reached
         return (Pkt6Ptr()); // NULL
-    } else if (result < 0) {
-        bundy_throw(SocketReadError, strerror(errno));
     }
 
-    // Let's find out which socket has the data
-    for (SocketCallbackInfoContainer::iterator s = callbacks_.begin();
-         s != callbacks_.end(); ++s) {
-        if (!FD_ISSET(s->socket_, &sockets)) {
-            continue;
-        }
-
+    if (!ready[0].iface_) {
         // something received over external socket
+        callExternalSocketCallback(ready[0].fd_);
+        return (Pkt6Ptr());
+    }
 
-        // Calling the external socket's callback provides its service
-        // layer access without integrating any specific features
-        // in IfaceMgr
-        if (s->callback_) {
-            s->callback_();
-        }
+    // Assuming that packet filter is not NULL, because its modifier checks it.
+    return (packet_filter6_->receive(*ready[0].socket_));
+}
 
-        return (Pkt6Ptr());
+size_t
+IfaceMgr::receiveBatch6(std::vector<Pkt6Ptr>& pkts, uint32_t timeout_sec,
+                        uint32_t timeout_usec /* = 0 */,
+                        IfaceMgrErrorMsgCallback error_handler /* = NULL */) {
+    // Sanity check for microsecond timeout.
+    if (timeout_usec >= 1000000) {
+        bundy_throw(BadValue, "fractional timeout must be shorter than"
+                  " one million microseconds");
     }
 
-    // Let's find out which interface/socket has the data
-    for (iface = ifaces_.begin(); iface != ifaces_.end(); ++iface) {
-        const Iface::SocketCollection& socket_collection = iface->getSockets();
-        for (Iface::SocketCollection::const_iterator s = socket_collection.begin();
-             s != socket_collection.end(); ++s) {
-            if (FD_ISSET(s->sockfd_, &sockets)) {
-                candidate = &(*s);
+    updateReceiveSet(receive_set6_, AF_INET6);
+    std::vector<ReceiveSocket> ready;
+    receive_set6_.wait(timeout_sec, timeout_usec,
+                       receive_set6_.sockets_.size(), ready);
+
+    const size_t received = pkts.size();
+    for (std::vector<ReceiveSocket>::const_iterator socket = ready.begin();
+         socket != ready.end(); ++socket) {
+        if (!socket->iface_) {
+            callExternalSocketCallback(socket->fd_);
+            // The callback may have changed the sockets, e.g. when the
+            // server has been reconfigured. The remaining sockets will
+            // be reported again by the next call.
+            if (!receive_set6_.isCurrent()) {
                 break;
             }
+            continue;
         }
-        if (candidate) {
-            break;
+        // A failure on one socket must not lose the packets received
+        // (or still waiting) on the others.
+        try {
+            Pkt6Ptr pkt = packet_filter6_->receive(*socket->socket_);
+            if (pkt) {
+                pkts.push_back(pkt);
+            }
+        } catch (const Exception& ex) {
+            IFACEMGR_ERROR(SocketReadError, error_handler,
+                           "failed to receive a packet on interface "
+                           << socket->iface_->getName() << ", reason: "
+                           << ex.what());
         }
     }
-
-    if (!candidate) {
-        bundy_throw(SocketReadError, "received data over unknown socket");
-    }
-    // Assuming that packet filter is not NULL, because its modifier checks it.
-    return (packet_filter6_->receive(*candidate));
+    return (pkts.size() - received);
 }
 
 uint16_t IfaceMgr::getSocket(const bundy::dhcp::Pkt6& pkt) {
@@ -29,6 +29,10 @@
 #include <boost/shared_ptr.hpp>
 
 #include <list>
+#include <map>
+#include <vector>
+
+#include <sys/select.h>
 
 namespace bundy {
 
@@ -283,6 +287,7 @@ public:
     /// @param sock SocketInfo structure that describes socket.
     void addSocket(const SocketInfo& sock) {
         sockets_.push_back(sock);
+        ++socket_changes_;
     }
 
     /// @brief Closes socket.
@@ -309,6 +314,18 @@ public:
     /// @return collection of sockets added to interface
     const SocketCollection& getSockets() const { return sockets_; }
 
+    /// @brief Returns the number of changes of the sockets of all
+    /// interfaces.
+    ///
+    /// The value is incremented whenever a socket is added to or removed
+    /// from any interface. It is used by the @c IfaceMgr to find out
+    /// that the set of sockets it waits on is out of date.
+    ///
+    /// @return number of changes of the sockets of all interfaces.
+    static uint32_t getSocketChanges() {
+        return (socket_changes_);
+    }
+
     /// @brief Removes any unicast addresses
     ///
     /// Removes any unicast addresses that the server was configured to
@@ -388,6 +405,12 @@ public:
     /// Indicates that IPv6 sockets should (true) or should not (false)
     /// be opened on this interface.
     bool inactive6_;
+
+private:
+    /// @brief Number of changes of the sockets of all interfaces.
+    ///
+    /// Static value initialized in iface_mgr.cc.
+    static uint32_t socket_changes_;
 };
 
 /// @brief This type describes the callback function invoked when error occurs
@@ -585,6 +608,55 @@ public:
     /// @return Pkt4 object representing received packet (or NULL)
     Pkt4Ptr receive4(uint32_t timeout_sec, uint32_t timeout_usec = 0);
 
+    /// @brief Receives IPv6 packets from all sockets which have data.
+    ///
+    /// Waits until at least one of the open IPv6 sockets or external
+    /// sockets has data, or the timeout elapses. Then, a packet is read
+    /// from each IPv6 socket which has data and the callbacks of the ready
+    /// external sockets are called. Compared to @c IfaceMgr::receive6,
+    /// which returns after reading one packet, the number of waits is
+    /// reduced when the packets arrive over many interfaces at once.
+    ///
+    /// @param [out] pkts Received packets are appended to this vector.
+    /// The packets received before an error occurred are appended too.
+    /// @param timeout_sec specifies integral part of the timeout (in seconds)
+    /// @param timeout_usec specifies fractional part of the timeout
+    /// (in microseconds)
+    /// @param error_handler A pointer to an error handler function which is
+    /// called when receiving from a socket fails; the other sockets are
+    /// read nevertheless. It can be NULL to indicate that the exception
+    /// should be thrown instead.
+    ///
+    /// @throw bundy::BadValue if timeout_usec is greater than one million
+    /// @throw bundy::dhcp::SocketReadError if error occured when receiving
+    /// a packet and no error handler is installed.
+    /// @return Number of packets appended to the vector.
+    size_t receiveBatch6(std::vector<Pkt6Ptr>& pkts, uint32_t timeout_sec,
+                         uint32_t timeout_usec = 0,
+                         IfaceMgrErrorMsgCallback error_handler = NULL);
+
+    /// @brief Receives IPv4 packets from all sockets which have data.
+    ///
+    /// This is the IPv4 counterpart of @c IfaceMgr::receiveBatch6.
+    ///
+    /// @param [out] pkts Received packets are appended to this vector.
+    /// The packets received before an error occurred are appended too.
+    /// @param timeout_sec specifies integral part of the timeout (in seconds)
+    /// @param timeout_usec specifies fractional part of the timeout
+    /// (in microseconds)
+    /// @param error_handler A pointer to an error handler function which is
+    /// called when receiving from a socket fails; the other sockets are
+    /// read nevertheless. It can be NULL to indicate that the exception
+    /// should be thrown instead.
+    ///
+    /// @throw bundy::BadValue if timeout_usec is greater than one million
+    /// @throw bundy::dhcp::SocketReadError if error occured when receiving
+    /// a packet and no error handler is installed.
+    /// @return Number of packets appended to the vector.
+    size_t receiveBatch4(std::vector<Pkt4Ptr>& pkts, uint32_t timeout_sec,
+                         uint32_t timeout_usec = 0,
+                         IfaceMgrErrorMsgCallback error_handler = NULL);
+
     /// Opens UDP/IP socket and binds it to address, interface and port.
     ///
     /// Specific type of socket (UDP/IPv4 or UDP/IPv6) depends on passed addr
@@ -885,6 +957,8 @@ public:
     /// from unit tests.
     void addInterface(const Iface& iface) {
         ifaces_.push_back(iface);
+        receive_set4_.valid_ = false;
+        receive_set6_.valid_ = false;
     }
 
     /// @brief Checks if there is at least one socket of the specified family
@@ -1059,6 +1133,109 @@ private:
 
     /// @brief Contains list of callbacks for external sockets
     SocketCallbackInfoContainer callbacks_;
+
+    /// @brief Socket waited on by the receive functions.
+    struct ReceiveSocket {
+        /// @brief Socket descriptor.
+        int fd_;
+
+        /// @brief Interface of the socket, NULL for the external sockets.
+        const Iface* iface_;
+
+        /// @brief Socket of the interface, NULL for the external sockets.
+        const SocketInfo* socket_;
+    };
+
+    /// @brief Set of sockets waited on by the receive functions.
+    ///
+    /// The set is kept between the calls to the receive functions, so
+    /// as the sockets don't have to be collected from all interfaces on
+    /// each call. On Linux, the sockets are registered with an epoll
+    /// descriptor, which doesn't limit the socket descriptors to
+    /// FD_SETSIZE. On other systems, a prepared fd_set is copied for each
+    /// call to select().
+    ///
+    /// The set is rebuilt when the sockets of the interfaces have changed
+    /// (see @c Iface::getSocketChanges) or when it has been invalidated
+    /// by a change of the interfaces or the external sockets.
+    struct ReceiveSet : public boost::noncopyable {
+        /// @brief Constructor.
+        ReceiveSet();
+
+        /// @brief Destructor.
+        ///
+        /// Closes the epoll descriptor.
+        ~ReceiveSet();
+
+        /// @brief Checks if the set holds the current sockets.
+        bool isCurrent() const {
+            return (valid_ && (socket_changes_ == Iface::getSocketChanges()));
+        }
+
+        /// @brief Removes all sockets from the set.
+        void clear();
+
+        /// @brief Adds the socket to the set.
+        ///
+        /// If the socket descriptor is already in the set, the socket is
+        /// ignored.
+        ///
+        /// @param fd Socket descriptor.
+        /// @param socket Socket information.
+        ///
+        /// @throw bundy::dhcp::SocketReadError if the socket can't be
+        /// added.
+        void add(const int fd, const ReceiveSocket& socket);
+
+        /// @brief Waits until at least one of the sockets has data.
+        ///
+        /// @param timeout_sec Integral part of the timeout (in seconds).
+        /// @param timeout_usec Fractional part of the timeout (in
+        /// microseconds).
+        /// @param max_ready Maximum number of sockets to return.
+        /// @param [out] ready Sockets which have data. The vector is
+        /// cleared first.
+        ///
+        /// @throw bundy::dhcp::SocketReadError if the wait has failed.
+        void wait(const uint32_t timeout_sec, const uint32_t timeout_usec,
+                  const size_t max_ready, std::vector<ReceiveSocket>& ready);
+
+        /// @brief Sockets in the set by socket descriptor.
+        std::map<int, ReceiveSocket> sockets_;
+
+        /// @brief Value of @c Iface::getSocketChanges when the set was
+        /// built.
+        uint32_t socket_changes_;
+
+        /// @brief Indicates if the set has been built and not invalidated.
+        bool valid_;
+
+        /// @brief The epoll descriptor (Linux only), -1 if not open.
+        int epoll_fd_;
+
+        /// @brief Sockets in the set (other than Linux).
+        fd_set fds_;
+
+        /// @brief Highest socket descriptor in the set (other than Linux).
+        int max_fd_;
+    };
+
+    /// @brief Brings the set of sockets waited on up to date.
+    ///
+    /// @param receive_set The set of sockets.
+    /// @param family AF_INET or AF_INET6.
+    void updateReceiveSet(ReceiveSet& receive_set, const uint16_t family);
+
+    /// @brief Calls the callback of the external socket.
+    ///
+    /// @param socketfd External socket descriptor.
+    void callExternalSocketCallback(const int socketfd);
+
+    /// @brief Sockets waited on by the IPv4 receive functions.
+    ReceiveSet receive_set4_;
+
+    /// @brief Sockets waited on by the IPv6 receive functions.
+    ReceiveSet receive_set6_;
 };
 
 }; // namespace bundy::dhcp
@@ -35,7 +35,7 @@
 #include <dhcp/iface_mgr.h>
 #include <dhcp/iface_mgr_error_handler.h>
 #include <dhcp/pkt_filter_inet.h>
-#include <dhcp/pkt_filter_lpf.h>
+#include <dhcp/pkt_filter_lpf_ring.h>
 #include <exceptions/exceptions.h>
 #include <util/io/sockaddr_util.h>
 
@@ -516,7 +516,7 @@ void Iface::setFlags(uint64_t flags) {
 void
 IfaceMgr::setMatchingPacketFilter(const bool direct_response_desired) {
     if (direct_response_desired) {
-        setPacketFilter(PktFilterPtr(new PktFilterLPF()));
+        setPacketFilter(PktFilterPtr(new PktFilterLPFRing()));
 
     } else {
         setPacketFilter(PktFilterPtr(new PktFilterInet()));
@@ -49,7 +49,8 @@ Pkt4::Pkt4(uint8_t msg_type, uint32_t transid)
       ciaddr_(DEFAULT_ADDRESS),
       yiaddr_(DEFAULT_ADDRESS),
       siaddr_(DEFAULT_ADDRESS),
-      giaddr_(DEFAULT_ADDRESS)
+      giaddr_(DEFAULT_ADDRESS),
+      lazy_unpack_(false)
 {
     memset(sname_, 0, MAX_SNAME_LEN);
     memset(file_, 0, MAX_FILE_LEN);
@@ -74,7 +75,8 @@ Pkt4::Pkt4(const uint8_t* data, size_t len)
       ciaddr_(DEFAULT_ADDRESS),
       yiaddr_(DEFAULT_ADDRESS),
       siaddr_(DEFAULT_ADDRESS),
-      giaddr_(DEFAULT_ADDRESS)
+      giaddr_(DEFAULT_ADDRESS),
+      lazy_unpack_(false)
 {
     if (len < DHCPV4_PKT_HDR_LEN) {
         bundy_throw(OutOfRange, "Truncated DHCPv4 packet (len=" << len
@@ -93,6 +95,8 @@ size_t
 Pkt4::len() {
     size_t length = DHCPV4_PKT_HDR_LEN; // DHCPv4 header
 
+    unpackLazyOptions();
+
     // ... and sum of lengths of all options
     for (OptionCollection::const_iterator it = options_.begin();
          it != options_.end();
@@ -109,6 +113,9 @@ Pkt4::pack() {
         bundy_throw(InvalidOperation, "Can't build Pkt4 packet. HWAddr not set.");
     }
 
+    // The options which haven't been unpacked yet must be packed too.
+    unpackLazyOptions();
+
     // Clear the output buffer to make sure that consecutive calls to pack()
     // will not result in concatenation of multiple packet copies.
     buffer_out_.clear();
@@ -213,6 +220,14 @@ Pkt4::unpack() {
       bundy_throw(Unexpected, "Invalid or missing DHCP magic cookie");
     }
 
+    // The offsets of the options are recorded on 16 bits, which is more
+    // than enough for any DHCPv4 packet received over the network.
+    if (lazy_unpack_ && (data_.size() <= 0xFFFF)) {
+        indexOptions(buffer_in.getPosition());
+        check();
+        return;
+    }
+
     size_t opts_len = buffer_in.getLength() - buffer_in.getPosition();
     vector<uint8_t> opts_buffer;
 
@@ -234,6 +249,73 @@ Pkt4::unpack() {
     check();
 }
 
+void
+Pkt4::indexOptions(const size_t opts_offset) {
+    lazy_options_.clear();
+    // The checks below are the same as in LibDHCP::unpackOptions4, so as
+    // the malformed packets are rejected regardless of the lazy unpacking.
+    // The offsets in the error messages are relative to the first option.
+    const size_t opts_len = data_.size() - opts_offset;
+    size_t offset = 0;
+    while (offset < opts_len) {
+        const size_t opt_offset = offset;
+        uint8_t opt_type = data_[opts_offset + offset++];
+        if (opt_type == DHO_END) {
+            return;
+        }
+        // DHO_PAD is just a padding after DHO_END. Let's continue parsing
+        // in case we receive a message without DHO_END.
+        if (opt_type == DHO_PAD) {
+            continue;
+        }
+        if (offset + 1 >= opts_len) {
+            bundy_throw(OutOfRange, "Attempt to parse truncated option "
+                      << static_cast<int>(opt_type));
+        }
+        uint8_t opt_len = data_[opts_offset + offset++];
+        if (offset + opt_len > opts_len) {
+            bundy_throw(OutOfRange, "Option parse failed. Tried to parse "
+                      << offset + opt_len << " bytes from " << opts_len
+                      << "-byte long buffer.");
+        }
+        LazyOption lazy;
+        lazy.offset_ = static_cast<uint16_t>(opts_offset + opt_offset);
+        lazy.type_ = opt_type;
+        lazy.len_ = opt_len;
+        lazy_options_.push_back(lazy);
+        offset += opt_len;
+    }
+}
+
+void
+Pkt4::unpackLazyOption(const LazyOptionCollection::iterator& lazy) const {
+    // The option is parsed the same way as all options are parsed by the
+    // unpack(), but from the buffer holding this option only.
+    OptionBuffer opt_buffer(data_.begin() + lazy->offset_,
+                            data_.begin() + lazy->offset_ + 2 + lazy->len_);
+    // The option is terminated, as the option parser refuses the option
+    // with no data at the end of the buffer.
+    opt_buffer.push_back(DHO_END);
+    // The option is removed from the index even if it is malformed, so as
+    // the error is reported once.
+    lazy_options_.erase(lazy);
+
+    OptionCollection unpacked;
+    if (callback_.empty()) {
+        LibDHCP::unpackOptions4(opt_buffer, "dhcp4", unpacked);
+    } else {
+        callback_(opt_buffer, "dhcp4", unpacked, NULL, NULL);
+    }
+    options_.insert(unpacked.begin(), unpacked.end());
+}
+
+void
+Pkt4::unpackLazyOptions() const {
+    while (!lazy_options_.empty()) {
+        unpackLazyOption(lazy_options_.begin());
+    }
+}
+
 void Pkt4::check() {
     uint8_t msg_type = getType();
     if (msg_type > DHCPLEASEACTIVE) {
@@ -284,6 +366,7 @@ Pkt4::toText() {
         << ":" << remote_port_ << ", msgtype=" << static_cast<int>(getType())
         << ", transid=0x" << hex << transid_ << dec << endl;
 
+    unpackLazyOptions();
     for (bundy::dhcp::OptionCollection::iterator opt=options_.begin();
          opt != options_.end();
          ++opt) {
@@ -448,6 +531,19 @@ Pkt4::getOption(uint8_t type) const {
     if (x != options_.end()) {
         return (*x).second;
     }
+
+    // The option may not have been unpacked yet.
+    for (LazyOptionCollection::iterator lazy = lazy_options_.begin();
+         lazy != lazy_options_.end(); ++lazy) {
+        if (lazy->type_ == type) {
+            unpackLazyOption(lazy);
+            x = options_.find(type);
+            if (x != options_.end()) {
+                return (*x).second;
+            }
+            break;
+        }
+    }
     return boost::shared_ptr<bundy::dhcp::Option>(); // NULL
 }
 
@@ -458,6 +554,15 @@ Pkt4::delOption(uint8_t type) {
         options_.erase(x);
         return (true); // delete successful
     }
+
+    // The option which hasn't been unpacked yet is simply dropped.
+    for (LazyOptionCollection::iterator lazy = lazy_options_.begin();
+         lazy != lazy_options_.end(); ++lazy) {
+        if (lazy->type_ == type) {
+            lazy_options_.erase(lazy);
+            return (true);
+        }
+    }
     return (false); // can't find option to be deleted
 }
 
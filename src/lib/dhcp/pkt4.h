@@ -85,7 +85,10 @@ public:
     /// Parses received packet, stored in on-wire format in bufferIn_.
     ///
     /// Will create a collection of option objects that will
-    /// be stored in options_ container.
+    /// be stored in options_ container. If the lazy unpacking is enabled
+    /// (see @c Pkt4::setLazyUnpack), only the positions of the options
+    /// in the packet are recorded and the option objects are created
+    /// when they are first used.
     ///
     /// Method with throw exception if packet parsing fails.
     void unpack();
@@ -328,8 +331,13 @@ public:
 
     /// @brief Returns an option of specified type.
     ///
+    /// If the option hasn't been unpacked yet (see
+    /// @c Pkt4::setLazyUnpack), it is unpacked now.
+    ///
     /// @return returns option of requested type (or NULL)
     ///         if no such option is present
+    /// @throw bundy::Exception if the option is unpacked now and it is
+    /// malformed.
     boost::shared_ptr<Option>
     getOption(uint8_t opt_type) const;
 
@@ -512,6 +520,30 @@ public:
         callback_ = callback;
     }
 
+    /// @brief Enables or disables the lazy unpacking of the options.
+    ///
+    /// When enabled, @c Pkt4::unpack checks that the options are well
+    /// formed on the wire, but it doesn't create the option objects. Each
+    /// option is unpacked from the received data when it is first
+    /// returned by @c Pkt4::getOption, and all remaining options are
+    /// unpacked when the packet is packed or converted to text. Thus, the
+    /// options which are never used are not unpacked at all. However, the
+    /// errors in the option data are only reported when the option is
+    /// unpacked. The received data (data_) must not be modified after
+    /// the packet has been unpacked.
+    ///
+    /// @param lazy true if the options are to be unpacked lazily.
+    void setLazyUnpack(const bool lazy) {
+        lazy_unpack_ = lazy;
+    }
+
+    /// @brief Checks if the options are unpacked lazily.
+    ///
+    /// @return true if the options are unpacked lazily.
+    bool getLazyUnpack() const {
+        return (lazy_unpack_);
+    }
+
     /// @brief Update packet timestamp.
     ///
     /// Updates packet timestamp. This method is invoked
@@ -610,6 +642,39 @@ protected:
     uint8_t
     DHCPTypeToBootpType(uint8_t dhcpType);
 
+    /// @brief Position of the option which hasn't been unpacked yet.
+    struct LazyOption {
+        /// Offset of the option (its code) in the received data.
+        uint16_t offset_;
+        /// Option code.
+        uint8_t type_;
+        /// Length of the option data.
+        uint8_t len_;
+    };
+
+    /// @brief Collection of the options which haven't been unpacked yet.
+    typedef std::vector<LazyOption> LazyOptionCollection;
+
+    /// @brief Records the positions of the options in the received data.
+    ///
+    /// The options are checked the same way as by
+    /// @c LibDHCP::unpackOptions4, i.e. they must not be truncated.
+    ///
+    /// @param opts_offset Offset of the first option in the received data.
+    /// @throw bundy::OutOfRange if the option is truncated.
+    void indexOptions(const size_t opts_offset);
+
+    /// @brief Unpacks the option which hasn't been unpacked yet.
+    ///
+    /// The option is unpacked from the received data and moved to the
+    /// options_ container.
+    ///
+    /// @param lazy Option to be unpacked.
+    void unpackLazyOption(const LazyOptionCollection::iterator& lazy) const;
+
+    /// @brief Unpacks all options which haven't been unpacked yet.
+    void unpackLazyOptions() const;
+
     /// local HW address (dst if receiving packet, src if sending packet)
     HWAddrPtr local_hwaddr_;
 
@@ -693,7 +758,17 @@ protected:
     /// behavior must be taken into consideration before making
     /// changes to this member such as access scope restriction or
     /// data format change etc.
-    bundy::dhcp::OptionCollection options_;
+    ///
+    /// It is mutable, because the options which are unpacked lazily are
+    /// added to it by the @c Pkt4::getOption.
+    mutable bundy::dhcp::OptionCollection options_;
+
+    /// @brief Indicates whether the options are unpacked lazily.
+    bool lazy_unpack_;
+
+    /// @brief Options which haven't been unpacked yet, in the order
+    /// they appear in the received data.
+    mutable LazyOptionCollection lazy_options_;
 
     /// packet timestamp
     boost::posix_time::ptime timestamp_;
@@ -19,6 +19,8 @@
 #include <asiolink/io_address.h>
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
 namespace bundy {
 namespace dhcp {
 
@@ -101,6 +103,21 @@ public:
     virtual Pkt4Ptr receive(const Iface& iface,
                             const SocketInfo& socket_info) = 0;
 
+    /// @brief Receive all packets available on the specified socket.
+    ///
+    /// The derived classes which can read several packets at once should
+    /// override it. The default implementation receives a single packet
+    /// using @c PktFilter::receive.
+    ///
+    /// @param iface interface
+    /// @param socket_info structure holding socket information
+    /// @param [out] pkts Received packets are appended to this vector.
+    ///
+    /// @return Number of packets received.
+    virtual size_t receiveBatch(const Iface& iface,
+                                const SocketInfo& socket_info,
+                                std::vector<Pkt4Ptr>& pkts);
+
     /// @brief Send packet over specified socket.
     ///
     /// @param iface interface to be used to send packet
@@ -163,6 +163,26 @@ PktFilterLPF::openSocket(const Iface& iface,
 
 Pkt4Ptr
 PktFilterLPF::receive(const Iface& iface, const SocketInfo& socket_info) {
+    drainFallbackSocket(socket_info);
+
+    // Now that we finished getting data from the fallback socket, we
+    // have to get the data from the raw socket too.
+    uint8_t raw_buf[IfaceMgr::RCVBUFSIZE];
+    int data_len = read(socket_info.sockfd_, raw_buf, sizeof(raw_buf));
+    // If negative value is returned by read(), it indicates that an
+    // error occured. If returned value is 0, no data was read from the
+    // socket. In both cases something has gone wrong, because we expect
+    // that a chunk of data is there. We signal the lack of data by
+    // returing an empty packet.
+    if (data_len <= 0) {
+        return Pkt4Ptr();
+    }
+
+    return (decodePacket(iface, raw_buf, data_len));
+}
+
+void
+PktFilterLPF::drainFallbackSocket(const SocketInfo& socket_info) {
     uint8_t raw_buf[IfaceMgr::RCVBUFSIZE];
     // First let's get some data from the fallback socket. The data will be
     // discarded but we don't want the socket buffer to bloat. We get the
@@ -182,20 +202,12 @@ PktFilterLPF::receive(const Iface& iface, const SocketInfo& socket_info) {
     do {
         datalen = recv(socket_info.fallbackfd_, raw_buf, sizeof(raw_buf), 0);
     } while (datalen > 0);
+}
 
-    // Now that we finished getting data from the fallback socket, we
-    // have to get the data from the raw socket too.
-    int data_len = read(socket_info.sockfd_, raw_buf, sizeof(raw_buf));
-    // If negative value is returned by read(), it indicates that an
-    // error occured. If returned value is 0, no data was read from the
-    // socket. In both cases something has gone wrong, because we expect
-    // that a chunk of data is there. We signal the lack of data by
-    // returing an empty packet.
-    if (data_len <= 0) {
-        return Pkt4Ptr();
-    }
-
-    InputBuffer buf(raw_buf, data_len);
+Pkt4Ptr
+PktFilterLPF::decodePacket(const Iface& iface, const uint8_t* data,
+                           const size_t data_len) const {
+    InputBuffer buf(data, data_len);
 
     // @todo: This is awkward way to solve the chicken and egg problem
     // whereby we don't know the offset where DHCP data start in the
@@ -215,12 +227,11 @@ PktFilterLPF::receive(const Iface& iface, const SocketInfo& socket_info) {
     decodeEthernetHeader(buf, dummy_pkt);
     decodeIpUdpHeader(buf, dummy_pkt);
 
-    // Read the DHCP data.
-    std::vector<uint8_t> dhcp_buf;
-    buf.readVector(dhcp_buf, buf.getLength() - buf.getPosition());
-
-    // Decode DHCP data into the Pkt4 object.
-    Pkt4Ptr pkt = Pkt4Ptr(new Pkt4(&dhcp_buf[0], dhcp_buf.size()));
+    // Decode DHCP data into the Pkt4 object. The data are copied only
+    // once, by the Pkt4 constructor.
+    const size_t dhcp_offset = buf.getPosition();
+    Pkt4Ptr pkt = Pkt4Ptr(new Pkt4(data + dhcp_offset,
+                                   data_len - dhcp_offset));
 
     // Set the appropriate packet members using data collected from
     // the decoded headers.
@@ -75,6 +75,25 @@ public:
     virtual int send(const Iface& iface, uint16_t sockfd,
                      const Pkt4Ptr& pkt);
 
+protected:
+
+    /// @brief Discards the data received over the fallback socket.
+    ///
+    /// @param socket_info structure holding socket information
+    void drainFallbackSocket(const SocketInfo& socket_info);
+
+    /// @brief Creates the packet from the received Ethernet frame.
+    ///
+    /// The data of the frame are not modified, so they may be decoded
+    /// directly from the place where they have been received.
+    ///
+    /// @param iface interface the frame has been received over
+    /// @param data Ethernet frame
+    /// @param data_len length of the frame
+    ///
+    /// @return Received packet
+    Pkt4Ptr decodePacket(const Iface& iface, const uint8_t* data,
+                         const size_t data_len) const;
 };
 
 } // namespace bundy::dhcp
@@ -0,0 +1,313 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+#include <dhcp/iface_mgr.h>
+#include <dhcp/pkt4.h>
+#include <dhcp/pkt_filter_lpf_ring.h>
+#include <exceptions/exceptions.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/if_packet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace {
+
+/// Size of the frame slot requested from the kernel. The TPACKET_V3 frames
+/// are packed in the blocks, so it is only checked against the block size.
+const uint32_t RING_FRAME_SIZE = 2048;
+
+}
+
+namespace bundy {
+namespace dhcp {
+
+/// The ring consists of the blocks, each of which starts with the block
+/// descriptor. The kernel fills the blocks in turn and passes them to the
+/// process by setting the TP_STATUS_USER in the descriptor. The process
+/// reads the frames of the block and gives it back by setting the status
+/// to TP_STATUS_KERNEL.
+class PktFilterLPFRing::Ring : public boost::noncopyable {
+public:
+
+    /// @brief Constructor.
+    ///
+    /// Sets up the ring for the socket and maps it.
+    ///
+    /// @param sockfd socket descriptor
+    ///
+    /// @throw SocketConfigError if the ring can't be set up.
+    explicit Ring(const int sockfd)
+        : sockfd_(sockfd), map_(NULL), map_size_(0), block_(0),
+          reading_(false), frames_left_(0), frame_(NULL) {
+        struct stat st;
+        if (fstat(sockfd_, &st) != 0) {
+            bundy_throw(SocketConfigError, "failed to stat socket "
+                        << sockfd_ << ": " << strerror(errno));
+        }
+        dev_ = st.st_dev;
+        ino_ = st.st_ino;
+
+        int version = TPACKET_V3;
+        if (setsockopt(sockfd_, SOL_PACKET, PACKET_VERSION, &version,
+                       sizeof(version)) < 0) {
+            bundy_throw(SocketConfigError, "TPACKET_V3 is not supported"
+                        " on socket " << sockfd_ << ": " << strerror(errno));
+        }
+
+        struct tpacket_req3 req;
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = RING_BLOCK_SIZE;
+        req.tp_block_nr = RING_BLOCK_COUNT;
+        req.tp_frame_size = RING_FRAME_SIZE;
+        req.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) *
+            RING_BLOCK_COUNT;
+        req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT;
+        if (setsockopt(sockfd_, SOL_PACKET, PACKET_RX_RING, &req,
+                       sizeof(req)) < 0) {
+            bundy_throw(SocketConfigError, "failed to set up the receive"
+                        " ring on socket " << sockfd_ << ": "
+                        << strerror(errno));
+        }
+
+        map_size_ = static_cast<size_t>(RING_BLOCK_SIZE) * RING_BLOCK_COUNT;
+        void* map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         sockfd_, 0);
+        if (map == MAP_FAILED) {
+            const int error = errno;
+            // Remove the ring, so as the packets are received by read().
+            memset(&req, 0, sizeof(req));
+            setsockopt(sockfd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+            bundy_throw(SocketConfigError, "failed to map the receive ring"
+                        " of socket " << sockfd_ << ": " << strerror(error));
+        }
+        map_ = static_cast<uint8_t*>(map);
+    }
+
+    /// @brief Destructor.
+    ///
+    /// Unmaps the ring. If the socket is still open, the kernel removes
+    /// the ring when it is closed.
+    ~Ring() {
+        munmap(map_, map_size_);
+    }
+
+    /// @brief Checks if the descriptor still refers to the socket of the
+    /// ring.
+    ///
+    /// @param sockfd socket descriptor
+    bool isSocket(const int sockfd) const {
+        struct stat st;
+        return ((fstat(sockfd, &st) == 0) && (st.st_dev == dev_) &&
+                (st.st_ino == ino_));
+    }
+
+    /// @brief Returns the next frame.
+    ///
+    /// The frame remains valid until the next call to @c next() or
+    /// @c release(), which may give its block back to the kernel.
+    ///
+    /// @return Pointer to the frame or NULL if there is none.
+    const struct tpacket3_hdr* next() {
+        while (true) {
+            if (reading_) {
+                if (frames_left_ > 0) {
+                    const struct tpacket3_hdr* frame = frame_;
+                    --frames_left_;
+                    frame_ = reinterpret_cast<const struct tpacket3_hdr*>
+                        (reinterpret_cast<const uint8_t*>(frame_) +
+                         frame_->tp_next_offset);
+                    return (frame);
+                }
+                releaseBlock();
+            }
+
+            struct tpacket_block_desc* desc = getBlock();
+            if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+                return (NULL);
+            }
+            // Don't read the frames before the status.
+            __sync_synchronize();
+            reading_ = true;
+            frames_left_ = desc->hdr.bh1.num_pkts;
+            frame_ = reinterpret_cast<const struct tpacket3_hdr*>
+                (reinterpret_cast<const uint8_t*>(desc) +
+                 desc->hdr.bh1.offset_to_first_pkt);
+        }
+    }
+
+    /// @brief Gives the current block back to the kernel if all its
+    /// frames have been read.
+    void release() {
+        if (reading_ && (frames_left_ == 0)) {
+            releaseBlock();
+        }
+    }
+
+private:
+
+    /// @brief Returns the descriptor of the current block.
+    struct tpacket_block_desc* getBlock() const {
+        return (reinterpret_cast<struct tpacket_block_desc*>
+                (map_ + static_cast<size_t>(block_) * RING_BLOCK_SIZE));
+    }
+
+    /// @brief Gives the current block back to the kernel and moves to
+    /// the next one.
+    void releaseBlock() {
+        // Don't let the kernel have the block before the frames are read.
+        __sync_synchronize();
+        getBlock()->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        block_ = (block_ + 1) % RING_BLOCK_COUNT;
+        reading_ = false;
+        frames_left_ = 0;
+        frame_ = NULL;
+    }
+
+    /// @brief Socket descriptor.
+    int sockfd_;
+
+    /// @brief Device of the socket, to recognize the socket.
+    dev_t dev_;
+
+    /// @brief Inode of the socket, to recognize the socket.
+    ino_t ino_;
+
+    /// @brief Mapped ring.
+    uint8_t* map_;
+
+    /// @brief Size of the mapped ring.
+    size_t map_size_;
+
+    /// @brief Index of the current block.
+    uint32_t block_;
+
+    /// @brief Indicates whether the current block is being read.
+    bool reading_;
+
+    /// @brief Number of frames of the current block not read yet.
+    uint32_t frames_left_;
+
+    /// @brief Next frame of the current block.
+    const struct tpacket3_hdr* frame_;
+};
+
+SocketInfo
+PktFilterLPFRing::openSocket(const Iface& iface,
+                             const bundy::asiolink::IOAddress& addr,
+                             const uint16_t port, const bool receive_bcast,
+                             const bool send_bcast) {
+    removeClosedRings();
+
+    SocketInfo sock_info = PktFilterLPF::openSocket(iface, addr, port,
+                                                    receive_bcast,
+                                                    send_bcast);
+    rings_.erase(sock_info.sockfd_);
+    try {
+        RingPtr ring(new Ring(sock_info.sockfd_));
+        rings_[sock_info.sockfd_] = ring;
+    } catch (const SocketConfigError&) {
+        // The packets will be read from the socket.
+    }
+    return (sock_info);
+}
+
+Pkt4Ptr
+PktFilterLPFRing::receive(const Iface& iface, const SocketInfo& socket_info) {
+    RingPtr ring = getRing(socket_info.sockfd_);
+    if (!ring) {
+        return (PktFilterLPF::receive(iface, socket_info));
+    }
+    drainFallbackSocket(socket_info);
+
+    Pkt4Ptr pkt;
+    const struct tpacket3_hdr* frame;
+    while (!pkt && ((frame = ring->next()) != NULL)) {
+        // Frames which didn't fit in the ring have been truncated.
+        if (frame->tp_snaplen == frame->tp_len) {
+            pkt = decodePacket(iface, reinterpret_cast<const uint8_t*>(frame)
+                               + frame->tp_mac, frame->tp_snaplen);
+        }
+    }
+    ring->release();
+    return (pkt);
+}
+
+size_t
+PktFilterLPFRing::receiveBatch(const Iface& iface,
+                               const SocketInfo& socket_info,
+                               std::vector<Pkt4Ptr>& pkts) {
+    RingPtr ring = getRing(socket_info.sockfd_);
+    if (!ring) {
+        return (PktFilterLPF::receiveBatch(iface, socket_info, pkts));
+    }
+    drainFallbackSocket(socket_info);
+
+    // Don't read more than the ring holds, so as the frames which keep
+    // arriving don't stop the other sockets from being read.
+    const size_t max_frames = (RING_BLOCK_SIZE / RING_FRAME_SIZE) *
+        RING_BLOCK_COUNT;
+    size_t received = 0;
+    const struct tpacket3_hdr* frame;
+    for (size_t i = 0; (i < max_frames) && ((frame = ring->next()) != NULL);
+         ++i) {
+        if (frame->tp_snaplen != frame->tp_len) {
+            continue;
+        }
+        try {
+            pkts.push_back(decodePacket(iface,
+                                        reinterpret_cast<const uint8_t*>
+                                        (frame) + frame->tp_mac,
+                                        frame->tp_snaplen));
+            ++received;
+        } catch (const bundy::Exception&) {
+            // The malformed frame is dropped, as the remaining frames
+            // would otherwise be lost with it.
+        }
+    }
+    ring->release();
+    return (received);
+}
+
+bool
+PktFilterLPFRing::hasRing(const int sockfd) const {
+    return (static_cast<bool>(getRing(sockfd)));
+}
+
+PktFilterLPFRing::RingPtr
+PktFilterLPFRing::getRing(const int sockfd) const {
+    std::map<int, RingPtr>::const_iterator ring = rings_.find(sockfd);
+    return (ring != rings_.end() ? ring->second : RingPtr());
+}
+
+void
+PktFilterLPFRing::removeClosedRings() {
+    std::map<int, RingPtr>::iterator ring = rings_.begin();
+    while (ring != rings_.end()) {
+        if (!ring->second->isSocket(ring->first)) {
+            rings_.erase(ring++);
+        } else {
+            ++ring;
+        }
+    }
+}
+
+} // end of bundy::dhcp namespace
+} // end of bundy namespace
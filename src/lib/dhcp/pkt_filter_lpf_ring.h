@@ -0,0 +1,126 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef PKT_FILTER_LPF_RING_H
+#define PKT_FILTER_LPF_RING_H
+
+#include <dhcp/pkt_filter_lpf.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+
+namespace bundy {
+namespace dhcp {
+
+/// @brief Packet handling class using Linux Packet Filtering with the
+/// memory mapped receive ring.
+///
+/// This class differs from @c PktFilterLPF in the way the packets are
+/// received. The kernel places the frames passing the filter in a ring
+/// buffer (TPACKET_V3) shared with the process, so they are decoded in
+/// place, without a system call and a copy for each of them. The ring is
+/// divided into blocks, which the kernel passes to the process when they
+/// are full or after a short timeout, so all frames of a block are
+/// received by a single call to @c PktFilterLPFRing::receiveBatch.
+///
+/// If the ring can't be set up for the socket (e.g. the kernel doesn't
+/// support TPACKET_V3), the packets are read from the socket as they are
+/// by @c PktFilterLPF.
+class PktFilterLPFRing : public PktFilterLPF {
+public:
+
+    /// @brief Size of the block of the ring in bytes.
+    ///
+    /// It must be a multiple of the page size.
+    static const uint32_t RING_BLOCK_SIZE = 1 << 16;
+
+    /// @brief Number of blocks of the ring.
+    static const uint32_t RING_BLOCK_COUNT = 64;
+
+    /// @brief Time after which the kernel passes a block which is not full
+    /// to the process, in milliseconds.
+    static const uint32_t RING_BLOCK_TIMEOUT = 1;
+
+    /// @brief Open primary and fallback socket and set up the ring.
+    ///
+    /// @param iface Interface descriptor.
+    /// @param addr Address on the interface to be used to send packets.
+    /// @param port Port number.
+    /// @param receive_bcast Configure socket to receive broadcast messages
+    /// @param send_bcast Configure socket to send broadcast messages.
+    ///
+    /// @return A structure describing a primary and fallback socket.
+    virtual SocketInfo openSocket(const Iface& iface,
+                                  const bundy::asiolink::IOAddress& addr,
+                                  const uint16_t port,
+                                  const bool receive_bcast,
+                                  const bool send_bcast);
+
+    /// @brief Receive packet over specified socket.
+    ///
+    /// @param iface interface
+    /// @param socket_info structure holding socket information
+    ///
+    /// @return Received packet or NULL if there is none in the ring.
+    virtual Pkt4Ptr receive(const Iface& iface, const SocketInfo& socket_info);
+
+    /// @brief Receive all packets available in the ring.
+    ///
+    /// @param iface interface
+    /// @param socket_info structure holding socket information
+    /// @param [out] pkts Received packets are appended to this vector.
+    ///
+    /// @return Number of packets received.
+    virtual size_t receiveBatch(const Iface& iface,
+                                const SocketInfo& socket_info,
+                                std::vector<Pkt4Ptr>& pkts);
+
+    /// @brief Checks if the socket has the ring.
+    ///
+    /// @param sockfd socket descriptor
+    ///
+    /// @return true if the packets are received over the ring.
+    bool hasRing(const int sockfd) const;
+
+private:
+
+    /// @brief Receive ring of the socket.
+    class Ring;
+
+    /// @brief Pointer to the receive ring.
+    typedef boost::shared_ptr<Ring> RingPtr;
+
+    /// @brief Returns the ring of the socket.
+    ///
+    /// @param sockfd socket descriptor
+    ///
+    /// @return Pointer to the ring or NULL if the socket has none.
+    RingPtr getRing(const int sockfd) const;
+
+    /// @brief Removes the rings of the sockets which have been closed.
+    ///
+    /// The sockets are closed by @c Iface, which doesn't tell the packet
+    /// filter, so the rings left behind are removed when new sockets are
+    /// opened.
+    void removeClosedRings();
+
+    /// @brief Rings of the sockets, by socket descriptor.
+    std::map<int, RingPtr> rings_;
+};
+
+} // namespace bundy::dhcp
+} // namespace bundy
+
+#endif // PKT_FILTER_LPF_RING_H
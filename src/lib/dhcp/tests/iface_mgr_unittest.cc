@@ -19,6 +19,7 @@
 #include <dhcp/iface_mgr.h>
 #include <dhcp/pkt6.h>
 #include <dhcp/pkt_filter.h>
+#include <dhcp/pkt_filter_inet.h>
 #include <dhcp/tests/iface_mgr_test_config.h>
 #include <dhcp/tests/pkt_filter6_test_utils.h>
 
@@ -130,6 +131,30 @@ public:
     bool open_socket_called_;
 };
 
+/// Packet filter failing to receive packets over one of the sockets.
+///
+/// The other sockets receive the packets as @c PktFilterInet does.
+class FailingPktFilter : public PktFilterInet {
+public:
+
+    /// Constructor
+    FailingPktFilter()
+        : failing_sockfd_(-1) {
+    }
+
+    /// @brief Receive a packet, or fail if it is the failing socket.
+    virtual Pkt4Ptr receive(const Iface& iface,
+                            const SocketInfo& socket_info) {
+        if (socket_info.sockfd_ == failing_sockfd_) {
+            bundy_throw(SocketReadError, "test socket read error");
+        }
+        return (PktFilterInet::receive(iface, socket_info));
+    }
+
+    /// Descriptor of the socket on which receive fails.
+    int failing_sockfd_;
+};
+
 class NakedIfaceMgr: public IfaceMgr {
     // "Naked" Interface Manager, exposes internal fields
 public:
@@ -1265,7 +1290,7 @@ TEST_F(IfaceMgrTest, setMatchingPacketFilter) {
     EXPECT_FALSE(iface_mgr->isDirectResponseSupported());
 
     // There is working implementation of direct responses on Linux
-    // in PktFilterLPF. It uses Linux Packet Filtering as underlying
+    // in PktFilterLPFRing. It uses Linux Packet Filtering as underlying
     // mechanism. When direct responses are desired the object of
     // this class should be set.
     EXPECT_NO_THROW(iface_mgr->setMatchingPacketFilter(true));
@@ -2794,6 +2819,134 @@ TEST_F(IfaceMgrTest, DeleteExternalSockets4) {
 }
 
 
+// Tests that receiveBatch4() returns the packets received over the other
+// sockets when receiving over one of them fails.
+TEST_F(IfaceMgrTest, receiveBatch4Error) {
+    scoped_ptr<NakedIfaceMgr> ifacemgr(new NakedIfaceMgr());
+    boost::shared_ptr<FailingPktFilter> filter(new FailingPktFilter());
+    ASSERT_NO_THROW(ifacemgr->setPacketFilter(filter));
+
+    IOAddress lo_addr("127.0.0.1");
+    int socket1 = -1;
+    int socket2 = -1;
+    ASSERT_NO_THROW(socket1 = ifacemgr->openSocket(LOOPBACK, lo_addr,
+                                                   DHCP4_SERVER_PORT + 10000));
+    ASSERT_NO_THROW(socket2 = ifacemgr->openSocket(LOOPBACK, lo_addr,
+                                                   DHCP4_SERVER_PORT + 10002));
+    ASSERT_GE(socket2, 0);
+    filter->failing_sockfd_ = socket1;
+
+    // Send a packet to each of the sockets.
+    for (uint16_t port = DHCP4_SERVER_PORT + 10000;
+         port <= DHCP4_SERVER_PORT + 10002; port += 2) {
+        Pkt4Ptr pkt(new Pkt4(DHCPDISCOVER, 1234));
+        pkt->setLocalAddr(lo_addr);
+        pkt->setRemoteAddr(lo_addr);
+        pkt->setLocalPort(DHCP4_SERVER_PORT + 10001);
+        pkt->setRemotePort(port);
+        pkt->setIface(string(LOOPBACK));
+        ASSERT_NO_THROW(pkt->pack());
+        ASSERT_NO_THROW(ifacemgr->send(pkt));
+    }
+
+    // The error is reported and the packet received over the other socket
+    // is returned. The data on the failing socket stays there, so the error
+    // is reported by each call, which is repeated in case the packets
+    // haven't arrived together.
+    std::vector<Pkt4Ptr> pkts;
+    IfaceMgrErrorMsgCallback error_handler =
+        boost::bind(&IfaceMgrTest::ifaceMgrErrorHandler, this, _1);
+    for (int i = 0; (i < 10) && (pkts.empty() || errors_count_ == 0); ++i) {
+        ASSERT_NO_THROW(ifacemgr->receiveBatch4(pkts, 1, 0, error_handler));
+    }
+    ASSERT_EQ(1, pkts.size());
+    EXPECT_EQ(DHCP4_SERVER_PORT + 10002, pkts[0]->getLocalPort());
+    EXPECT_LT(0, errors_count_);
+
+    // Without the error handler, the error is thrown.
+    EXPECT_THROW(ifacemgr->receiveBatch4(pkts, 1), SocketReadError);
+
+    ifacemgr->closeSockets();
+}
+
+// Tests that receiveBatch4() handles all external sockets which are ready
+// in a single call.
+TEST_F(IfaceMgrTest, BatchExternalSockets4) {
+
+    callback_ok = false;
+    callback2_ok = false;
+
+    scoped_ptr<NakedIfaceMgr> ifacemgr(new NakedIfaceMgr());
+
+    // Create two pipes and register them as extra sockets
+    int pipefd[2];
+    EXPECT_TRUE(pipe(pipefd) == 0);
+    EXPECT_NO_THROW(ifacemgr->addExternalSocket(pipefd[0], my_callback));
+
+    int secondpipe[2];
+    EXPECT_TRUE(pipe(secondpipe) == 0);
+    EXPECT_NO_THROW(ifacemgr->addExternalSocket(secondpipe[0], my_callback2));
+
+    // Send some data over both pipes
+    EXPECT_EQ(38, write(pipefd[1], "Hi, this is a message sent over a pipe", 38));
+    EXPECT_EQ(38, write(secondpipe[1], "Hi, this is a message sent over a pipe", 38));
+
+    // Both callbacks should be called, and no packets returned.
+    std::vector<Pkt4Ptr> pkts;
+    size_t received = 1;
+    ASSERT_NO_THROW(received = ifacemgr->receiveBatch4(pkts, 1));
+    EXPECT_EQ(0, received);
+    EXPECT_TRUE(pkts.empty());
+    EXPECT_TRUE(callback_ok);
+    EXPECT_TRUE(callback2_ok);
+
+    // Test with invalid fractional timeout values.
+    EXPECT_THROW(ifacemgr->receiveBatch4(pkts, 0, 1000000), bundy::BadValue);
+
+    close(pipefd[1]);
+    close(pipefd[0]);
+
+    close(secondpipe[1]);
+    close(secondpipe[0]);
+}
+
+// Tests that the external socket added after the sockets have been waited
+// for is taken into account by the subsequent receive4() calls.
+TEST_F(IfaceMgrTest, AddExternalSocketAfterReceive4) {
+
+    callback_ok = false;
+    callback2_ok = false;
+
+    scoped_ptr<NakedIfaceMgr> ifacemgr(new NakedIfaceMgr());
+
+    int pipefd[2];
+    EXPECT_TRUE(pipe(pipefd) == 0);
+    EXPECT_NO_THROW(ifacemgr->addExternalSocket(pipefd[0], my_callback));
+
+    // Wait once, so as the set of sockets is in use.
+    Pkt4Ptr pkt4;
+    ASSERT_NO_THROW(pkt4 = ifacemgr->receive4(0, 1000));
+    EXPECT_FALSE(callback_ok);
+
+    // Register the second pipe and send some data over it.
+    int secondpipe[2];
+    EXPECT_TRUE(pipe(secondpipe) == 0);
+    EXPECT_NO_THROW(ifacemgr->addExternalSocket(secondpipe[0], my_callback2));
+    EXPECT_EQ(38, write(secondpipe[1], "Hi, this is a message sent over a pipe", 38));
+
+    ASSERT_NO_THROW(pkt4 = ifacemgr->receive4(1));
+    EXPECT_FALSE(pkt4);
+    EXPECT_FALSE(callback_ok);
+    EXPECT_TRUE(callback2_ok);
+
+    close(pipefd[1]);
+    close(pipefd[0]);
+
+    close(secondpipe[1]);
+    close(secondpipe[0]);
+}
+
+
 // Tests if a single external socket and its callback can be passed and
 // it is supported properly by receive6() method.
 TEST_F(IfaceMgrTest, SingleExternalSocket6) {
@@ -693,6 +693,134 @@ TEST_F(Pkt4Test, unpackOptionsWithCallback) {
 
 }
 
+// This test verifies that the options are unpacked when they are used if
+// the lazy unpacking is enabled.
+TEST_F(Pkt4Test, unpackOptionsLazy) {
+    vector<uint8_t> expectedFormat = generateTestPacket2();
+
+    expectedFormat.push_back(0x63);
+    expectedFormat.push_back(0x82);
+    expectedFormat.push_back(0x53);
+    expectedFormat.push_back(0x63);
+
+    for (int i = 0; i < sizeof(v4_opts); i++) {
+        expectedFormat.push_back(v4_opts[i]);
+    }
+
+    boost::shared_ptr<Pkt4> pkt(new Pkt4(&expectedFormat[0],
+                                expectedFormat.size()));
+
+    CustomUnpackCallback cb;
+    pkt->setCallback(boost::bind(&CustomUnpackCallback::execute, &cb,
+                                 _1, _2, _3));
+
+    EXPECT_FALSE(pkt->getLazyUnpack());
+    pkt->setLazyUnpack(true);
+    EXPECT_TRUE(pkt->getLazyUnpack());
+
+    EXPECT_NO_THROW(pkt->unpack());
+
+    // The Message Type option is unpacked to check the packet.
+    EXPECT_TRUE(cb.executed_);
+    EXPECT_EQ(2, pkt->getType());
+
+    // The other options are unpacked by the callback when they are used.
+    cb.executed_ = false;
+    verifyParsedOptions(pkt);
+    EXPECT_TRUE(cb.executed_);
+
+    // The packed packet must contain all options.
+    pkt->setHWAddr(dummyHtype, dummyHlen, vector<uint8_t>(dummyChaddr,
+                                                         dummyChaddr +
+                                                         dummyHlen));
+    ASSERT_NO_THROW(pkt->pack());
+    EXPECT_EQ(expectedFormat.size() - sizeof(DHCP_OPTIONS_COOKIE),
+              pkt->len());
+    EXPECT_EQ(expectedFormat.size() + 1,
+              pkt->getBuffer().getLength());
+}
+
+// This test verifies that the options which haven't been unpacked are
+// packed and can be deleted.
+TEST_F(Pkt4Test, unpackOptionsLazyPack) {
+    vector<uint8_t> expectedFormat = generateTestPacket2();
+
+    expectedFormat.push_back(0x63);
+    expectedFormat.push_back(0x82);
+    expectedFormat.push_back(0x53);
+    expectedFormat.push_back(0x63);
+
+    for (int i = 0; i < sizeof(v4_opts); i++) {
+        expectedFormat.push_back(v4_opts[i]);
+    }
+
+    boost::shared_ptr<Pkt4> pkt(new Pkt4(&expectedFormat[0],
+                                expectedFormat.size()));
+    pkt->setLazyUnpack(true);
+    ASSERT_NO_THROW(pkt->unpack());
+
+    // Delete the option which hasn't been unpacked.
+    EXPECT_TRUE(pkt->delOption(254));
+    EXPECT_FALSE(pkt->delOption(254));
+    EXPECT_FALSE(pkt->getOption(254));
+
+    // The remaining options are packed.
+    ASSERT_NO_THROW(pkt->pack());
+    const uint8_t* packed =
+        static_cast<const uint8_t*>(pkt->getBuffer().getData());
+    ASSERT_EQ(Pkt4::DHCPV4_PKT_HDR_LEN + sizeof(DHCP_OPTIONS_COOKIE) +
+              sizeof(v4_opts) - 5 + 1, pkt->getBuffer().getLength());
+    EXPECT_EQ(0, memcmp(packed + Pkt4::DHCPV4_PKT_HDR_LEN +
+                        sizeof(DHCP_OPTIONS_COOKIE), v4_opts,
+                        sizeof(v4_opts) - 5));
+    EXPECT_EQ(DHO_END, packed[pkt->getBuffer().getLength() - 1]);
+}
+
+// This test verifies that the malformed options are reported when they are
+// used if the lazy unpacking is enabled.
+TEST_F(Pkt4Test, unpackOptionsLazyMalformed) {
+    vector<uint8_t> expectedFormat = generateTestPacket2();
+
+    expectedFormat.push_back(0x63);
+    expectedFormat.push_back(0x82);
+    expectedFormat.push_back(0x53);
+    expectedFormat.push_back(0x63);
+
+    // Message Type option.
+    expectedFormat.push_back(53);
+    expectedFormat.push_back(1);
+    expectedFormat.push_back(DHCPDISCOVER);
+    // Option with no data.
+    expectedFormat.push_back(254);
+    expectedFormat.push_back(0);
+    // Subnet Mask option must hold 4 bytes.
+    expectedFormat.push_back(DHO_SUBNET_MASK);
+    expectedFormat.push_back(1);
+    expectedFormat.push_back(255);
+
+    boost::shared_ptr<Pkt4> pkt(new Pkt4(&expectedFormat[0],
+                                expectedFormat.size()));
+    // The malformed option is reported by the unpack().
+    EXPECT_THROW(pkt->unpack(), bundy::Exception);
+
+    pkt.reset(new Pkt4(&expectedFormat[0], expectedFormat.size()));
+    pkt->setLazyUnpack(true);
+    // The malformed option is reported when it is used.
+    ASSERT_NO_THROW(pkt->unpack());
+    EXPECT_EQ(DHCPDISCOVER, pkt->getType());
+    OptionPtr opt;
+    ASSERT_NO_THROW(opt = pkt->getOption(254));
+    ASSERT_TRUE(opt);
+    EXPECT_TRUE(opt->getData().empty());
+    EXPECT_THROW(pkt->getOption(DHO_SUBNET_MASK), bundy::Exception);
+
+    // The truncated option is reported by the unpack() anyway.
+    expectedFormat.pop_back();
+    pkt.reset(new Pkt4(&expectedFormat[0], expectedFormat.size()));
+    pkt->setLazyUnpack(true);
+    EXPECT_THROW(pkt->unpack(), bundy::OutOfRange);
+}
+
 // This test verifies methods that are used for manipulating meta fields
 // i.e. fields that are not part of DHCPv4 (e.g. interface name).
 TEST_F(Pkt4Test, metaFields) {
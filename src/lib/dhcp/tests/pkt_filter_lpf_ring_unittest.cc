@@ -0,0 +1,164 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+#include <asiolink/io_address.h>
+#include <dhcp/iface_mgr.h>
+#include <dhcp/pkt4.h>
+#include <dhcp/pkt_filter_lpf_ring.h>
+#include <dhcp/tests/pkt_filter_test_utils.h>
+
+#include <gtest/gtest.h>
+
+#include <linux/if_packet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+using namespace bundy::asiolink;
+using namespace bundy::dhcp;
+
+namespace {
+
+/// Port number used by tests.
+const uint16_t PORT = 10067;
+
+// Test fixture class inherits from the class common for all packet
+// filter tests.
+class PktFilterLPFRingTest : public bundy::dhcp::test::PktFilterTest {
+public:
+    PktFilterLPFRingTest() : PktFilterTest(PORT) {
+    }
+
+    /// @brief Waits until there is something to read from the socket.
+    ///
+    /// @return true if there is, false if the wait has timed out.
+    bool waitForData() const {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock_info_.sockfd_, &readfds);
+
+        struct timeval timeout;
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+        return (select(sock_info_.sockfd_ + 1, &readfds, NULL, NULL,
+                       &timeout) > 0);
+    }
+};
+
+// This test verifies that the PktFilterLPFRing class reports its capability
+// to send packets to the host having no IP address assigned.
+TEST_F(PktFilterLPFRingTest, isDirectResponseSupported) {
+    PktFilterLPFRing pkt_filter;
+    EXPECT_TRUE(pkt_filter.isDirectResponseSupported());
+}
+
+// All tests below require root privileges to execute successfully. See
+// the comment in pkt_filter_lpf_unittest.cc for how to run them.
+
+// This test verifies that the raw socket is opened with the receive ring.
+TEST_F(PktFilterLPFRingTest, DISABLED_openSocket) {
+    Iface iface(ifname_, ifindex_);
+    IOAddress addr("127.0.0.1");
+
+    PktFilterLPFRing pkt_filter;
+    sock_info_ = pkt_filter.openSocket(iface, addr, PORT, false, false);
+    ASSERT_GE(sock_info_.sockfd_, 0);
+    ASSERT_GE(sock_info_.fallbackfd_, 0);
+
+    // The socket should use the TPACKET_V3 ring.
+    EXPECT_TRUE(pkt_filter.hasRing(sock_info_.sockfd_));
+    int version = 0;
+    socklen_t version_len = sizeof(version);
+    ASSERT_EQ(0, getsockopt(sock_info_.sockfd_, SOL_PACKET, PACKET_VERSION,
+                            &version, &version_len));
+    EXPECT_EQ(TPACKET_V3, version);
+
+    // The fallback socket has no ring.
+    EXPECT_FALSE(pkt_filter.hasRing(sock_info_.fallbackfd_));
+}
+
+// This test verifies that the packet is received from the ring.
+TEST_F(PktFilterLPFRingTest, DISABLED_receive) {
+    Iface iface(ifname_, ifindex_);
+    IOAddress addr("127.0.0.1");
+
+    PktFilterLPFRing pkt_filter;
+    sock_info_ = pkt_filter.openSocket(iface, addr, PORT, false, false);
+    ASSERT_GE(sock_info_.sockfd_, 0);
+
+    // Send DHCPv4 message to the local loopback address and server's port.
+    sendMessage();
+    ASSERT_TRUE(waitForData());
+
+    Pkt4Ptr rcvd_pkt = pkt_filter.receive(iface, sock_info_);
+    ASSERT_TRUE(rcvd_pkt);
+    ASSERT_NO_THROW(rcvd_pkt->unpack());
+    testRcvdMessage(rcvd_pkt);
+}
+
+// This test verifies that all packets in the ring are received at once.
+TEST_F(PktFilterLPFRingTest, DISABLED_receiveBatch) {
+    Iface iface(ifname_, ifindex_);
+    IOAddress addr("127.0.0.1");
+
+    PktFilterLPFRing pkt_filter;
+    sock_info_ = pkt_filter.openSocket(iface, addr, PORT, false, false);
+    ASSERT_GE(sock_info_.sockfd_, 0);
+
+    const size_t count = 3;
+    for (size_t i = 0; i < count; ++i) {
+        sendMessage();
+    }
+
+    // The packets may be passed in more than one block.
+    std::vector<Pkt4Ptr> pkts;
+    while ((pkts.size() < count) && waitForData()) {
+        pkt_filter.receiveBatch(iface, sock_info_, pkts);
+    }
+    // Each packet sent over the loopback interface may be seen twice,
+    // outgoing and incoming.
+    ASSERT_GE(pkts.size(), count);
+    for (size_t i = 0; i < pkts.size(); ++i) {
+        ASSERT_NO_THROW(pkts[i]->unpack());
+        testRcvdMessage(pkts[i]);
+    }
+}
+
+// This test verifies that the ring of the closed socket is removed when
+// a new socket is opened.
+TEST_F(PktFilterLPFRingTest, DISABLED_closedSocket) {
+    Iface iface(ifname_, ifindex_);
+    IOAddress addr("127.0.0.1");
+
+    PktFilterLPFRing pkt_filter;
+    SocketInfo closed = pkt_filter.openSocket(iface, addr, PORT, false,
+                                              false);
+    ASSERT_TRUE(pkt_filter.hasRing(closed.sockfd_));
+    close(closed.sockfd_);
+    close(closed.fallbackfd_);
+
+    // Reuse the descriptors of the closed sockets, so as the new sockets
+    // get the different ones.
+    int pipefd[2];
+    ASSERT_EQ(0, pipe(pipefd));
+
+    sock_info_ = pkt_filter.openSocket(iface, addr, PORT, false, false);
+    EXPECT_TRUE(pkt_filter.hasRing(sock_info_.sockfd_));
+    EXPECT_FALSE(pkt_filter.hasRing(closed.sockfd_));
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+} // anonymous namespace
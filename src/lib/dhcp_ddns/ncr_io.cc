@@ -155,12 +155,36 @@ NameChangeListener::invokeRecvHandler(const Result result,
     }
 }
 
+void
+NameChangeListener::invokeRecvHandler(NameChangeRequestList& ncrs) {
+    // All but the last request are passed to the handler here; the last
+    // one takes the usual path, which initiates the next receive.  The
+    // receive is complete, whatever the handler does.
+    io_pending_ = false;
+    for (size_t i = 0; i + 1 < ncrs.size(); ++i) {
+        try {
+            recv_handler_(SUCCESS, ncrs[i]);
+        } catch (const std::exception& ex) {
+            LOG_ERROR(dhcp_ddns_logger,
+                      DHCP_DDNS_UNCAUGHT_NCR_RECV_HANDLER_ERROR)
+                      .arg(ex.what());
+        }
+
+        if (!amListening()) {
+            // The handler stopped us, there's no one to pass the rest to.
+            return;
+        }
+    }
+
+    invokeRecvHandler(SUCCESS, ncrs.back());
+}
+
 //************************* NameChangeSender ******************************
 
 NameChangeSender::NameChangeSender(RequestSendHandler& send_handler,
                                    size_t send_queue_max)
     : sending_(false), send_handler_(send_handler),
-      send_queue_max_(send_queue_max), io_service_(NULL) {
+      send_queue_max_(send_queue_max), send_count_(1), io_service_(NULL) {
 
     // Queue size must be big enough to hold at least 1 entry.
     setQueueMaxSize(send_queue_max);
@@ -260,6 +284,7 @@ NameChangeSender::sendNext() {
     // it on the front of the queue until we successfully send it.
     if (!send_queue_.empty()) {
         ncr_to_send_ = send_queue_.front();
+        send_count_ = 1;
 
        // @todo start defense timer
        // If a send were to hang and we timed it out, then timeout
@@ -270,12 +295,29 @@ NameChangeSender::sendNext() {
     }
 }
 
+void
+NameChangeSender::setSendCount(const size_t count) {
+    if (count == 0 || count > send_queue_.size()) {
+        bundy_throw(NcrSenderError, "NameChangeSender::setSendCount"
+                  " invalid count: " << count << " queue size: "
+                  << send_queue_.size());
+    }
+
+    send_count_ = count;
+}
+
 void
 NameChangeSender::invokeSendHandler(const NameChangeSender::Result result) {
     // @todo reset defense timer
+    // The entries which shipped with the one at the front, if any.
+    SendQueue shipped_with;
     if (result == SUCCESS) {
         // It shipped so pull it off the queue.
         send_queue_.pop_front();
+        for (size_t i = 1; i < send_count_ && !send_queue_.empty(); ++i) {
+            shipped_with.push_back(send_queue_.front());
+            send_queue_.pop_front();
+        }
     }
 
     // Invoke the completion handler passing in the result and a pointer
@@ -290,6 +332,17 @@ NameChangeSender::invokeSendHandler(const NameChangeSender::Result result) {
                   .arg(ex.what());
     }
 
+    for (SendQueue::iterator it = shipped_with.begin();
+         it != shipped_with.end(); ++it) {
+        try {
+            send_handler_(result, *it);
+        } catch (const std::exception& ex) {
+            LOG_ERROR(dhcp_ddns_logger,
+                      DHCP_DDNS_UNCAUGHT_NCR_SEND_HANDLER_ERROR)
+                      .arg(ex.what());
+        }
+    }
+
     // Clear the pending ncr pointer.
     ncr_to_send_.reset();
 
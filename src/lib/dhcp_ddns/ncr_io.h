@@ -273,6 +273,19 @@ protected:
     /// wise.
     void invokeRecvHandler(const Result result, NameChangeRequestPtr& ncr);
 
+    /// @brief Calls the NCR receive handler for several requests received
+    /// together.
+    ///
+    /// The handler is called with a success result for each of the
+    /// requests in order, and the next receive is initiated after the
+    /// last one, as invokeRecvHandler(const Result, NameChangeRequestPtr&)
+    /// does.  If the handler stops the listener, the remaining requests are
+    /// discarded.
+    ///
+    /// @param ncrs is the list of the received requests, it must not be
+    /// empty.
+    void invokeRecvHandler(NameChangeRequestList& ncrs);
+
     /// @brief Abstract method which opens the IO source for reception.
     ///
     /// The derivation uses this method to perform the steps needed to
@@ -600,6 +613,11 @@ protected:
     /// If not we leave it there so we can retry it.  After we invoke the
     /// handler we clear the pending ncr value and queue up the next send.
     ///
+    /// If the derivation sent several entries together (see setSendCount()),
+    /// on success they are all removed from the queue and the handler is
+    /// invoked for each of them in order.  On failure it is invoked once,
+    /// for the entry at the front of the queue.
+    ///
     /// NOTE:
     /// The handler invoked by this method MUST NOT THROW. The handler is
     /// application level logic and should trap and handle any errors at
@@ -650,6 +668,18 @@ protected:
     /// throw it as an bundy::Exception or derivative.
     virtual void doSend(NameChangeRequestPtr& ncr) = 0;
 
+    /// @brief Sets the number of queue entries carried by the send in
+    /// progress.
+    ///
+    /// A derivation which can send several requests at once may call it
+    /// from doSend(), having sent the entries from the front of the queue
+    /// (see peekAt()).  It is reset to one before each doSend() call.
+    ///
+    /// @param count the number of entries, from one to the queue size.
+    ///
+    /// @throw NcrSenderError if the count is out of this range.
+    void setSendCount(const size_t count);
+
 public:
     /// @brief Removes the request at the front of the send queue
     ///
@@ -774,6 +804,9 @@ private:
     /// @brief Pointer to the request which is in the process of being sent.
     NameChangeRequestPtr ncr_to_send_;
 
+    /// @brief Number of queue entries carried by the send in progress.
+    size_t send_count_;
+
     /// @brief Pointer to the IOService currently being used by the sender.
     /// @note We need to remember the io_service but we receive it by
     /// reference.  Use a raw pointer to store it.  This value should never be
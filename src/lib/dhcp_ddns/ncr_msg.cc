@@ -34,6 +34,10 @@ NameChangeFormat stringToNcrFormat(const std::string& fmt_str) {
         return FMT_JSON;
     }
 
+    if (boost::iequals(fmt_str, "BINARY")) {
+        return FMT_BINARY;
+    }
+
     bundy_throw(BadValue, "Invalid NameChangeRequest format:" << fmt_str);
 }
 
@@ -43,6 +47,10 @@ std::string ncrFormatToString(NameChangeFormat format) {
         return ("JSON");
     }
 
+    if (format == FMT_BINARY) {
+        return ("BINARY");
+    }
+
     std::ostringstream stream;
     stream  << "UNKNOWN(" << format << ")";
     return (stream.str());
@@ -263,6 +271,25 @@ NameChangeRequest::fromFormat(const NameChangeFormat format,
                       << ex.what());
         }
 
+        break;
+        }
+    case FMT_BINARY: {
+        try {
+            // Get the length of the record and read it into a buffer of
+            // its own, so that fields we don't know are skipped.
+            size_t len = buffer.readUint16();
+            std::vector<uint8_t> vec;
+            buffer.readVector(vec, len);
+
+            bundy::util::InputBuffer record(vec.empty() ? NULL : &vec[0],
+                                            vec.size());
+            ncr = NameChangeRequest::fromBinary(record);
+        } catch (bundy::util::InvalidBufferPosition& ex) {
+            // Read error accessing data in InputBuffer.
+            bundy_throw(NcrMessageError, "fromFormat: buffer read error: "
+                      << ex.what());
+        }
+
         break;
         }
     default:
@@ -291,6 +318,15 @@ NameChangeRequest::toFormat(const NameChangeFormat format,
         buffer.writeData(json.c_str(), length);
         break;
         }
+    case FMT_BINARY: {
+        // Leave room for the length, which is known only after the record
+        // is written.
+        const size_t start = buffer.getLength();
+        buffer.writeUint16(0);
+        toBinary(buffer);
+        buffer.writeUint16At(buffer.getLength() - start - 2, start);
+        break;
+        }
     default:
         // Programmatic error, shouldn't happen.
         bundy_throw(NcrMessageError, "toFormat - invalid format");
@@ -380,6 +416,83 @@ NameChangeRequest::toJSON() const  {
     return (stream.str());
 }
 
+NameChangeRequestPtr
+NameChangeRequest::fromBinary(bundy::util::InputBuffer& buffer) {
+    NameChangeRequestPtr ncr(new NameChangeRequest());
+    try {
+        const uint8_t version = buffer.readUint8();
+        if (version != BINARY_VERSION) {
+            bundy_throw(NcrMessageError, "Unsupported NameChangeRequest"
+                        " binary version: " << static_cast<int>(version));
+        }
+
+        const uint8_t change_type = buffer.readUint8();
+        if (change_type != CHG_ADD && change_type != CHG_REMOVE) {
+            bundy_throw(NcrMessageError, "Invalid NameChangeRequest change"
+                        " type: " << static_cast<int>(change_type));
+        }
+        ncr->setChangeType(static_cast<NameChangeType>(change_type));
+
+        const uint8_t flags = buffer.readUint8();
+        ncr->setForwardChange((flags & 0x01) != 0);
+        ncr->setReverseChange((flags & 0x02) != 0);
+
+        uint8_t address[16];
+        const uint8_t address_len = buffer.readUint8();
+        if (address_len != 4 && address_len != 16) {
+            bundy_throw(NcrMessageError, "Invalid NameChangeRequest address"
+                        " length: " << static_cast<int>(address_len));
+        }
+        buffer.readData(address, address_len);
+        ncr->ip_io_address_ = asiolink::IOAddress::fromBytes(
+            address_len == 4 ? AF_INET : AF_INET6, address);
+
+        uint64_t expires_on = buffer.readUint32();
+        expires_on = (expires_on << 32) | buffer.readUint32();
+        ncr->lease_expires_on_ = expires_on;
+        ncr->setLeaseLength(buffer.readUint32());
+
+        std::vector<uint8_t> data;
+        buffer.readVector(data, buffer.readUint16());
+        ncr->setFqdn(std::string(data.begin(), data.end()));
+
+        buffer.readVector(data, buffer.readUint16());
+        ncr->dhcid_.fromBytes(data);
+    } catch (bundy::util::InvalidBufferPosition& ex) {
+        bundy_throw(NcrMessageError,
+                    "Truncated NameChangeRequest binary record: " << ex.what());
+    }
+
+    // All the members were read, validate the content as fromJSON does.
+    ncr->validateContent();
+
+    return (ncr);
+}
+
+void
+NameChangeRequest::toBinary(bundy::util::OutputBuffer& buffer) const {
+    buffer.writeUint8(BINARY_VERSION);
+    buffer.writeUint8(change_type_);
+    buffer.writeUint8((forward_change_ ? 0x01 : 0) |
+                      (reverse_change_ ? 0x02 : 0));
+
+    const std::vector<uint8_t> address = ip_io_address_.toBytes();
+    buffer.writeUint8(address.size());
+    buffer.writeData(&address[0], address.size());
+
+    buffer.writeUint32(lease_expires_on_ >> 32);
+    buffer.writeUint32(lease_expires_on_ & 0xffffffff);
+    buffer.writeUint32(lease_length_);
+
+    buffer.writeUint16(fqdn_.size());
+    buffer.writeData(fqdn_.data(), fqdn_.size());
+
+    const std::vector<uint8_t>& dhcid = dhcid_.getBytes();
+    buffer.writeUint16(dhcid.size());
+    if (!dhcid.empty()) {
+        buffer.writeData(&dhcid[0], dhcid.size());
+    }
+}
 
 void
 NameChangeRequest::validateContent() {
@@ -31,6 +31,7 @@
 
 #include <time.h>
 #include <string>
+#include <vector>
 
 namespace bundy {
 namespace dhcp_ddns {
@@ -67,13 +68,14 @@ enum NameChangeStatus  {
 
 /// @brief Defines the list of data wire formats supported.
 enum NameChangeFormat {
-  FMT_JSON
+  FMT_JSON,
+  FMT_BINARY
 };
 
 /// @brief Function which converts labels to  NameChangeFormat enum values.
 ///
 /// @param fmt_str text to convert to an enum.
-/// Valid string values: "JSON"
+/// Valid string values: "JSON", "BINARY"
 ///
 /// @return NameChangeFormat value which maps to the given string.
 ///
@@ -172,6 +174,13 @@ public:
     void fromHWAddr(const bundy::dhcp::HWAddrPtr& hwaddr,
                     const std::vector<uint8_t>& wire_fqdn);
 
+    /// @brief Sets the DHCID value to the given bytes.
+    ///
+    /// @param data holds the raw bytes of the DHCID.
+    void fromBytes(const std::vector<uint8_t>& data) {
+        bytes_ = data;
+    }
+
     /// @brief Returns a reference to the DHCID byte vector.
     ///
     /// @return a reference to the vector.
@@ -222,6 +231,9 @@ class NameChangeRequest;
 /// @brief Defines a pointer to a NameChangeRequest.
 typedef boost::shared_ptr<NameChangeRequest> NameChangeRequestPtr;
 
+/// @brief Defines a list of NameChangeRequests.
+typedef std::vector<NameChangeRequestPtr> NameChangeRequestList;
+
 /// @brief Defines a map of Elements, keyed by their string name.
 typedef std::map<std::string, bundy::data::ConstElementPtr> ElementMap;
 
@@ -229,11 +241,13 @@ typedef std::map<std::string, bundy::data::ConstElementPtr> ElementMap;
 /// This class is used by DHCP-DDNS clients (e.g. DHCP4, DHCP6) to
 /// request DNS updates.  Each message contains a single DNS change (either an
 /// add/update or a remove) for a single FQDN.  It provides marshalling services
-/// for moving instances to and from the wire.  Currently, the only format
-/// supported is JSON, however the class provides an interface such that other
-/// formats can be readily supported.
+/// for moving instances to and from the wire, either as JSON text or in a
+/// compact binary form.
 class NameChangeRequest {
 public:
+    /// @brief Version of the binary format, the first byte of the record.
+    static const uint8_t BINARY_VERSION = 1;
+
     /// @brief Default Constructor.
     ///
     /// @todo Currently, fromWire makes use of the ability to create an empty
@@ -280,7 +294,13 @@ public:
     /// is than treated as JSON which is then parsed into the data needed
     /// to create a request instance.
     ///
-    /// (NOTE currently only JSON is supported.)
+    /// BINARY: The buffer is expected to contain a two byte unsigned integer
+    /// which specifies the length of the record, followed by the record
+    /// itself, as written by toFormat().  Data past the known fields of
+    /// the record is skipped, so fields can be appended by later versions.
+    ///
+    /// In both formats the buffer is left positioned after the request,
+    /// so several requests can be read from one buffer.
     ///
     /// @param format indicates the data format to use
     /// @param buffer is the input buffer containing the marshalled request
@@ -303,7 +323,26 @@ public:
     /// the request data needed to reassemble the request on the receiving
     /// end. The JSON text in the buffer is NOT null-terminated.
     ///
-    /// (NOTE currently only JSON is supported.)
+    /// BINARY: Upon completion, the buffer will contain a two byte unsigned
+    /// integer which specifies the length of the record, followed by the
+    /// record.  All integers are in network byte order:
+    ///
+    /// @code
+    ///    uint8   version (BINARY_VERSION)
+    ///    uint8   change type
+    ///    uint8   flags: 0x01 forward change, 0x02 reverse change
+    ///    uint8   length of the IP address: 4 or 16
+    ///    ...     IP address
+    ///    uint32  lease expiration, upper 32 bits
+    ///    uint32  lease expiration, lower 32 bits
+    ///    uint32  lease length
+    ///    uint16  length of the FQDN
+    ///    ...     FQDN in text form
+    ///    uint16  length of the DHCID
+    ///    ...     DHCID
+    /// @endcode
+    ///
+    /// It avoids producing and parsing the JSON text for each request.
     ///
     /// @param format indicates the data format to use
     /// @param buffer is the output buffer to which the request should be
@@ -321,6 +360,23 @@ public:
     /// @throw NcrMessageError if an error occurs creating new request.
     static NameChangeRequestPtr fromJSON(const std::string& json);
 
+    /// @brief Static method for creating a NameChangeRequest from a
+    /// buffer containing the binary form of a request, without its
+    /// length (see toFormat()).
+    ///
+    /// @param buffer is the input buffer containing the record
+    ///
+    /// @return a pointer to the new NameChangeRequest
+    ///
+    /// @throw NcrMessageError if an error occurs creating new request.
+    static NameChangeRequestPtr fromBinary(bundy::util::InputBuffer& buffer);
+
+    /// @brief Instance method for marshalling the contents of the request
+    /// into the given buffer in the binary form, without its length.
+    ///
+    /// @param buffer is the output buffer to which the request is written.
+    void toBinary(bundy::util::OutputBuffer& buffer) const;
+
     /// @brief Instance method for marshalling the contents of the request
     /// into a string of JSON text.
     ///
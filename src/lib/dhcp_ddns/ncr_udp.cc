@@ -19,6 +19,8 @@
 #include <asio/error_code.hpp>
 #include <boost/bind.hpp>
 
+#include <algorithm>
+
 namespace bundy {
 namespace dhcp_ddns {
 
@@ -166,17 +168,32 @@ NameChangeUDPListener::receiveCompletionHandler(const bool successful,
         bundy::util::InputBuffer input_buffer(callback->getData(),
                                             callback->getBytesTransferred());
 
+        // The datagram may carry several requests.  They're all taken out
+        // before any is passed on, as the next receive reuses the buffer.
+        NameChangeRequestList ncrs;
         try {
-            ncr = NameChangeRequest::fromFormat(format_, input_buffer);
+            do {
+                ncrs.push_back(NameChangeRequest::fromFormat(format_,
+                                                             input_buffer));
+            } while (input_buffer.getPosition() < input_buffer.getLength());
         } catch (const NcrMessageError& ex) {
-            // log it and go back to listening
+            // log it, the rest of the datagram can't be trusted
             LOG_ERROR(dhcp_ddns_logger, DHCP_DDNS_INVALID_NCR).arg(ex.what());
 
-            // Queue up the next recieve.
-            // NOTE: We must call the base class, NEVER doReceive
-            receiveNext();
+            if (ncrs.empty()) {
+                // Queue up the next recieve.
+                // NOTE: We must call the base class, NEVER doReceive
+                receiveNext();
+                return;
+            }
+        }
+
+        if (ncrs.size() > 1) {
+            invokeRecvHandler(ncrs);
             return;
         }
+
+        ncr = ncrs.front();
     } else {
         asio::error_code error_code = callback->getErrorCode();
         if (error_code.value() == asio::error::operation_aborted) {
@@ -203,11 +220,17 @@ NameChangeUDPSender(const bundy::asiolink::IOAddress& ip_address,
                     const bundy::asiolink::IOAddress& server_address,
                     const uint32_t server_port, const NameChangeFormat format,
                     RequestSendHandler& ncr_send_handler,
-                    const size_t send_que_max, const bool reuse_address)
+                    const size_t send_que_max, const bool reuse_address,
+                    const size_t max_batch)
     : NameChangeSender(ncr_send_handler, send_que_max),
       ip_address_(ip_address), port_(port), server_address_(server_address),
       server_port_(server_port), format_(format),
-      reuse_address_(reuse_address) {
+      reuse_address_(reuse_address), max_batch_(max_batch) {
+    if (max_batch_ == 0) {
+        bundy_throw(NcrUDPError, "NameChangeUDPSender: maximum batch size"
+                    " must be greater than zero");
+    }
+
     // Instantiate the send callback.  This gets passed into each send.
     // Note that the callback constructor is passed the an instance method
     // pointer to our completion handler, sendCompletionHandler.
@@ -293,6 +316,20 @@ NameChangeUDPSender::doSend(NameChangeRequestPtr& ncr) {
     bundy::util::OutputBuffer ncr_buffer(SEND_BUF_MAX);
     ncr->toFormat(format_, ncr_buffer);
 
+    // Add the requests queued behind it, as long as they fit in the
+    // datagram.
+    const size_t batch = std::min(max_batch_, getQueueSize());
+    size_t count = 1;
+    for (; count < batch; ++count) {
+        const size_t length = ncr_buffer.getLength();
+        peekAt(count)->toFormat(format_, ncr_buffer);
+        if (ncr_buffer.getLength() > SEND_BUF_MAX) {
+            ncr_buffer.trim(ncr_buffer.getLength() - length);
+            break;
+        }
+    }
+    setSendCount(count);
+
     // Copy the wire-ized request to callback.  This way we know after
     // send completes what we sent (or attempted to send).
     send_callback_->putData(static_cast<const uint8_t*>(ncr_buffer.getData()),
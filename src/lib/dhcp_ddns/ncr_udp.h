@@ -333,8 +333,8 @@ public:
     ///
     /// @param ip_address is the network address on which to listen
     /// @param port is the UDP port on which to listen
-    /// @param format is the wire format of the inbound requests. Currently
-    /// only JSON is supported
+    /// @param format is the wire format of the inbound requests.  A
+    /// datagram may carry several requests, one after the other.
     /// @param ncr_recv_handler the receive handler object to notify when
     /// a receive completes.
     /// @param reuse_address enables IP address sharing when true
@@ -385,14 +385,15 @@ public:
     /// passing in the boolean success indicator and pointer to itself.
     ///
     /// If the indicator denotes success, then the method will attempt to
-    /// to construct a NameChangeRequest from the received data.  If the
-    /// construction was successful, it will send the new NCR to the
+    /// to construct the NameChangeRequests from the received data.  If the
+    /// construction was successful, it will send the new NCRs to the
     /// application layer by calling invokeRecvHandler() with a success
-    /// status and a pointer to the new NCR.
+    /// status and pointers to the new NCRs.
     ///
     /// If the buffer contains invalid data such that construction fails,
-    /// the method will log the failure and then call doReceive() to start a
-    /// initiate the next receive.
+    /// the method will log the failure and pass the NCRs constructed before
+    /// it, if any; otherwise it calls doReceive() to initiate the next
+    /// receive.
     ///
     /// If the indicator denotes failure the method will log the failure and
     /// notify the application layer by calling invokeRecvHandler() with
@@ -465,13 +466,18 @@ public:
     /// It defaults to NameChangeSender::MAX_QUEUE_DEFAULT
     /// @param reuse_address enables IP address sharing when true
     /// It defaults to false.
+    /// @param max_batch the maximum number of requests sent in one
+    /// datagram, as many as fit in SEND_BUF_MAX.  It defaults to 1, as
+    /// listeners older than the batching read only one request from a
+    /// datagram.
     ///
+    /// @throw NcrUDPError if max_batch is zero.
     NameChangeUDPSender(const bundy::asiolink::IOAddress& ip_address,
         const uint32_t port, const bundy::asiolink::IOAddress& server_address,
         const uint32_t server_port, const NameChangeFormat format,
         RequestSendHandler& ncr_send_handler,
         const size_t send_que_max = NameChangeSender::MAX_QUEUE_DEFAULT,
-        const bool reuse_address = false);
+        const bool reuse_address = false, const size_t max_batch = 1);
 
     /// @brief Destructor
     virtual ~NameChangeUDPSender();
@@ -500,7 +506,8 @@ public:
     /// @brief Sends a given request asynchronously over the socket
     ///
     /// The given NameChangeRequest is converted to wire format and copied
-    /// into the send callback's transfer buffer.  Then the socket's
+    /// into the send callback's transfer buffer, with the requests queued
+    /// behind it up to the maximum batch size.  Then the socket's
     /// asyncSend() method is called, passing in send_callback_ member's
     /// transfer buffer as the send buffer and the send_callback_ itself
     /// as the callback object.
@@ -578,6 +585,9 @@ private:
     /// @brief Flag which enables the reuse address socket option if true.
     bool reuse_address_;
 
+    /// @brief Maximum number of requests sent in one datagram.
+    size_t max_batch_;
+
     /// @brief Pointer to WatchSocket instance supplying the "select-fd".
     WatchSocketPtr watch_socket_;
 };
@@ -294,6 +294,7 @@ public:
 /// 2. Given valid parameters, the sender constructor works
 /// 3. Default construction provides default max queue size
 /// 4. Construction with a custom max queue size works
+/// 5. Construction with a maximum batch size of zero is not allowed
 TEST(NameChangeUDPSenderBasicTest, constructionTests) {
     bundy::asiolink::IOAddress ip_address(TEST_ADDRESS);
     uint32_t port = SENDER_PORT;
@@ -320,6 +321,11 @@ TEST(NameChangeUDPSenderBasicTest, constructionTests) {
                                             FMT_JSON, ncr_handler, 100)));
 
     EXPECT_EQ(100, sender->getQueueMaxSize());
+
+    // Verify that a maximum batch size of zero is not allowed.
+    EXPECT_THROW(NameChangeUDPSender(ip_address, port, ip_address, port,
+                                     FMT_BINARY, ncr_handler, 100, false, 0),
+                 NcrUDPError);
 }
 
 /// @brief Tests NameChangeUDPSender basic send functionality
@@ -641,6 +647,18 @@ public:
                           TEST_TIMEOUT);
     }
 
+    /// @brief Replaces the listener and the sender with ones using the
+    /// given format, the sender sending up to max_batch requests at once.
+    void resetIO(const NameChangeFormat format, const size_t max_batch) {
+        bundy::asiolink::IOAddress addr(TEST_ADDRESS);
+        listener_.reset(
+            new NameChangeUDPListener(addr, LISTENER_PORT, format,
+                                      *this, true));
+        sender_.reset(
+            new NameChangeUDPSender(addr, SENDER_PORT, addr, LISTENER_PORT,
+                                    format, *this, 100, true, max_batch));
+    }
+
     void reset_results() {
         sent_ncrs_.clear();
         received_ncrs_.clear();
@@ -724,6 +742,47 @@ TEST_F (NameChangeUDPTest, roundTripTest) {
     EXPECT_FALSE(sender_->amSending());
 }
 
+/// @brief Uses a sender and listener to test delivery of NCRs batched in
+/// the binary format.
+/// The first request is sent alone, the ones queued behind it while it's
+/// in flight go together in the next datagram.  The test verifies that
+/// what was sent matches what was received, and that the listener got
+/// several requests out of one datagram.
+TEST_F (NameChangeUDPTest, batchedRoundTripTest) {
+    resetIO(FMT_BINARY, 10);
+    ASSERT_NO_THROW(listener_->startListening(io_service_));
+    ASSERT_NO_THROW(sender_->startSending(io_service_));
+
+    int num_msgs = sizeof(valid_msgs)/sizeof(char*);
+    for (int i = 0; i < num_msgs; i++) {
+        NameChangeRequestPtr ncr;
+        ASSERT_NO_THROW(ncr = NameChangeRequest::fromJSON(valid_msgs[i]));
+        sender_->sendRequest(ncr);
+    }
+
+    // Execute callbacks until we have sent and received all of messages,
+    // noting if one completion received more than one.
+    bool batched = false;
+    while (sender_->getQueueSize() > 0 || (received_ncrs_.size() < num_msgs)) {
+        const size_t received = received_ncrs_.size();
+        EXPECT_NO_THROW(io_service_.run_one());
+        if (received_ncrs_.size() > received + 1) {
+            batched = true;
+        }
+    }
+    EXPECT_TRUE(batched);
+
+    ASSERT_EQ(num_msgs, sent_ncrs_.size());
+    ASSERT_EQ(num_msgs, received_ncrs_.size());
+    for (int i = 0; i < num_msgs; i++) {
+        EXPECT_TRUE (checkSendVsReceived(sent_ncrs_[i], received_ncrs_[i]));
+    }
+
+    EXPECT_NO_THROW(listener_->stopListening());
+    EXPECT_NO_THROW(io_service_.run_one());
+    EXPECT_NO_THROW(sender_->stopSending());
+}
+
 // Tests error handling of a failure to mark the watch socket ready, when
 // sendRequestt() is called.
 TEST(NameChangeUDPSenderBasicTest, watchClosedBeforeSendRequest) {
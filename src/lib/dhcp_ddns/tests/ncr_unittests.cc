@@ -586,6 +586,84 @@ TEST(NameChangeRequestTest, toFromBufferTest) {
     ASSERT_EQ(final_str, msg_str);
 }
 
+/// @brief Tests converting to and from the binary format.
+/// This test verifies that:
+/// 1. Valid requests, IPv4 and IPv6, survive a round trip through the
+/// binary format.
+/// 2. Several requests can be written to and read from one buffer.
+/// 3. Truncated, unknown version or invalid records are rejected.
+TEST(NameChangeRequestTest, toFromBinaryTest) {
+    bundy::util::OutputBuffer output_buffer(1024);
+    NameChangeRequestList ncrs;
+    for (size_t i = 0; i < sizeof(valid_msgs)/sizeof(char*); ++i) {
+        NameChangeRequestPtr ncr;
+        ASSERT_NO_THROW(ncr = NameChangeRequest::fromJSON(valid_msgs[i]));
+        ASSERT_NO_THROW(ncr->toFormat(FMT_BINARY, output_buffer));
+        ncrs.push_back(ncr);
+    }
+
+    bundy::util::InputBuffer input_buffer(output_buffer.getData(),
+                                        output_buffer.getLength());
+    for (size_t i = 0; i < ncrs.size(); ++i) {
+        NameChangeRequestPtr ncr;
+        ASSERT_NO_THROW(ncr = NameChangeRequest::fromFormat(FMT_BINARY,
+                                                            input_buffer));
+        EXPECT_TRUE(*ncrs[i] == *ncr);
+        EXPECT_EQ(ncrs[i]->toJSON(), ncr->toJSON());
+    }
+    EXPECT_EQ(input_buffer.getLength(), input_buffer.getPosition());
+
+    // A record of the first request alone.
+    bundy::util::OutputBuffer record(1024);
+    ncrs[0]->toFormat(FMT_BINARY, record);
+    std::vector<uint8_t> data(static_cast<const uint8_t*>(record.getData()),
+                              static_cast<const uint8_t*>(record.getData()) +
+                              record.getLength());
+
+    // Bytes after the known fields are skipped.
+    std::vector<uint8_t> longer(data);
+    longer.push_back(0xff);
+    ++longer[1];
+    bundy::util::InputBuffer longer_buffer(&longer[0], longer.size());
+    NameChangeRequestPtr ncr;
+    ASSERT_NO_THROW(ncr = NameChangeRequest::fromFormat(FMT_BINARY,
+                                                        longer_buffer));
+    EXPECT_TRUE(*ncrs[0] == *ncr);
+
+    // Truncated record.
+    bundy::util::InputBuffer short_buffer(&data[0], data.size() - 1);
+    EXPECT_THROW(NameChangeRequest::fromFormat(FMT_BINARY, short_buffer),
+                 NcrMessageError);
+
+    // Unknown version.
+    std::vector<uint8_t> bad(data);
+    bad[2] = NameChangeRequest::BINARY_VERSION + 1;
+    bundy::util::InputBuffer version_buffer(&bad[0], bad.size());
+    EXPECT_THROW(NameChangeRequest::fromFormat(FMT_BINARY, version_buffer),
+                 NcrMessageError);
+
+    // Invalid change type.
+    bad = data;
+    bad[3] = 7;
+    bundy::util::InputBuffer type_buffer(&bad[0], bad.size());
+    EXPECT_THROW(NameChangeRequest::fromFormat(FMT_BINARY, type_buffer),
+                 NcrMessageError);
+
+    // Neither forward nor reverse change.
+    bad = data;
+    bad[4] = 0;
+    bundy::util::InputBuffer flags_buffer(&bad[0], bad.size());
+    EXPECT_THROW(NameChangeRequest::fromFormat(FMT_BINARY, flags_buffer),
+                 NcrMessageError);
+
+    // Invalid address length.
+    bad = data;
+    bad[5] = 5;
+    bundy::util::InputBuffer address_buffer(&bad[0], bad.size());
+    EXPECT_THROW(NameChangeRequest::fromFormat(FMT_BINARY, address_buffer),
+                 NcrMessageError);
+}
+
 /// @brief Tests ip address modification and validation
 TEST(NameChangeRequestTest, ipAddresses) {
     NameChangeRequest ncr;
@@ -614,7 +692,11 @@ TEST(NameChangeFormatTest, formatEnumConversion){
     ASSERT_EQ(stringToNcrFormat("jSoN"), dhcp_ddns::FMT_JSON);
     ASSERT_THROW(stringToNcrFormat("bogus"), bundy::BadValue);
 
+    ASSERT_EQ(stringToNcrFormat("BINARY"), dhcp_ddns::FMT_BINARY);
+    ASSERT_EQ(stringToNcrFormat("binary"), dhcp_ddns::FMT_BINARY);
+
     ASSERT_EQ(ncrFormatToString(dhcp_ddns::FMT_JSON), "JSON");
+    ASSERT_EQ(ncrFormatToString(dhcp_ddns::FMT_BINARY), "BINARY");
 }
 
 /// @brief Tests conversion of NameChangeProtocol between enum and strings.
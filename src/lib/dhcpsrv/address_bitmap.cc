@@ -0,0 +1,115 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <dhcpsrv/address_bitmap.h>
+#include <exceptions/exceptions.h>
+
+namespace {
+
+/// @brief Returns the index of the lowest bit which is not set in a word.
+///
+/// The word must not have all bits set.
+unsigned int
+lowestZeroBit(const uint64_t word) {
+#if defined(__GNUC__)
+    return (__builtin_ctzll(~word));
+#else
+    unsigned int bit = 0;
+    while ((word & (static_cast<uint64_t>(1) << bit)) != 0) {
+        ++bit;
+    }
+    return (bit);
+#endif
+}
+
+}
+
+namespace bundy {
+namespace dhcp {
+
+AddressBitmap::AddressBitmap(const uint64_t size)
+    : size_(size), free_count_(size), words_((size + 63) / 64, 0),
+      sync_time_(0), sync_offset_(0) {
+}
+
+bool
+AddressBitmap::isUsed(const uint64_t offset) const {
+    if (offset >= size_) {
+        bundy_throw(bundy::OutOfRange, "address offset " << offset
+                    << " is out of the bitmap range of " << size_);
+    }
+    return ((words_[offset / 64] & (static_cast<uint64_t>(1) << (offset % 64)))
+            != 0);
+}
+
+void
+AddressBitmap::setUsed(const uint64_t offset) {
+    if (!isUsed(offset)) {
+        words_[offset / 64] |= static_cast<uint64_t>(1) << (offset % 64);
+        --free_count_;
+    }
+}
+
+void
+AddressBitmap::setFree(const uint64_t offset) {
+    if (isUsed(offset)) {
+        words_[offset / 64] &= ~(static_cast<uint64_t>(1) << (offset % 64));
+        ++free_count_;
+    }
+}
+
+void
+AddressBitmap::clear() {
+    words_.assign(words_.size(), 0);
+    free_count_ = size_;
+}
+
+uint64_t
+AddressBitmap::findFree(const uint64_t start) const {
+    if (free_count_ == 0) {
+        return (size_);
+    }
+    const uint64_t begin = start % size_;
+    const uint64_t offset = findFree(begin, size_);
+    if (offset < size_) {
+        return (offset);
+    }
+    const uint64_t wrapped = findFree(0, begin);
+    return (wrapped < begin ? wrapped : size_);
+}
+
+uint64_t
+AddressBitmap::findFree(const uint64_t begin, uint64_t end) const {
+    if (end > size_) {
+        end = size_;
+    }
+    uint64_t offset = begin;
+    while (offset < end) {
+        // Treat the bits below the offset in the first word as used, so
+        // that only the addresses at or after the offset are considered.
+        const uint64_t word = words_[offset / 64] |
+            ((static_cast<uint64_t>(1) << (offset % 64)) - 1);
+        if (word != ~static_cast<uint64_t>(0)) {
+            const uint64_t found = (offset / 64) * 64 + lowestZeroBit(word);
+            // The unused bits of the last word are never set, so the found
+            // address may be beyond the end.
+            return (found < end ? found : end);
+        }
+        offset = (offset / 64 + 1) * 64;
+    }
+    return (end);
+}
+
+} // end of bundy::dhcp namespace
+} // end of bundy namespace
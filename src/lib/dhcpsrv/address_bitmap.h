@@ -0,0 +1,152 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef ADDRESS_BITMAP_H
+#define ADDRESS_BITMAP_H
+
+#include <boost/shared_ptr.hpp>
+
+#include <ctime>
+#include <vector>
+
+#include <stdint.h>
+
+namespace bundy {
+namespace dhcp {
+
+/// @brief Bitmap of used addresses in a contiguous address range.
+///
+/// Each bit of the bitmap represents one address of the range, identified
+/// by its offset from the first address. The bit is set when the address
+/// is in use. The number of free addresses is maintained as the bits are
+/// changed, so checking whether the range is exhausted doesn't require a
+/// scan, and a search for a free address skips 64 used addresses at a time.
+///
+/// The bitmap doesn't know anything about leases. It is up to the user
+/// (the allocation engine) to keep it in sync with the lease database and
+/// to record when it was last synchronized (see @c setSyncTime) and where
+/// a synchronization in progress should resume (see @c setSyncOffset).
+class AddressBitmap {
+public:
+    /// @brief Constructor.
+    ///
+    /// All addresses are initially free.
+    ///
+    /// @param size Number of addresses in the range.
+    AddressBitmap(const uint64_t size);
+
+    /// @brief Returns the number of addresses in the range.
+    uint64_t getSize() const {
+        return (size_);
+    }
+
+    /// @brief Returns the number of free addresses in the range.
+    uint64_t getFreeCount() const {
+        return (free_count_);
+    }
+
+    /// @brief Checks if the address at the given offset is in use.
+    ///
+    /// @param offset Offset of the address in the range.
+    /// @throw bundy::OutOfRange if the offset is not within the range.
+    bool isUsed(const uint64_t offset) const;
+
+    /// @brief Marks the address at the given offset as used.
+    ///
+    /// @param offset Offset of the address in the range.
+    /// @throw bundy::OutOfRange if the offset is not within the range.
+    void setUsed(const uint64_t offset);
+
+    /// @brief Marks the address at the given offset as free.
+    ///
+    /// @param offset Offset of the address in the range.
+    /// @throw bundy::OutOfRange if the offset is not within the range.
+    void setFree(const uint64_t offset);
+
+    /// @brief Marks all addresses as free.
+    void clear();
+
+    /// @brief Finds a free address.
+    ///
+    /// The search starts at the given offset and wraps around at the end
+    /// of the range, so each address is checked at most once.
+    ///
+    /// @param start Offset of the address to start the search at. It is
+    /// taken modulo the size of the range.
+    /// @return Offset of the first free address found or the size of the
+    /// range if all addresses are in use.
+    uint64_t findFree(const uint64_t start) const;
+
+    /// @brief Finds a free address between two offsets.
+    ///
+    /// Unlike the other variant, this doesn't wrap around.
+    ///
+    /// @param begin Offset of the first address to check.
+    /// @param end Offset following the last address to check. Values
+    /// greater than the size of the range are treated as the size.
+    /// @return Offset of the first free address found. If there is none,
+    /// @c end or the size of the range, whichever is lower.
+    uint64_t findFree(const uint64_t begin, const uint64_t end) const;
+
+    /// @brief Returns the time of the last synchronization with the leases.
+    time_t getSyncTime() const {
+        return (sync_time_);
+    }
+
+    /// @brief Records the time of the last synchronization with the leases.
+    ///
+    /// @param sync_time Time of the synchronization.
+    void setSyncTime(const time_t sync_time) {
+        sync_time_ = sync_time;
+    }
+
+    /// @brief Returns the offset a synchronization in progress resumes at.
+    ///
+    /// Zero means that no synchronization is in progress.
+    uint64_t getSyncOffset() const {
+        return (sync_offset_);
+    }
+
+    /// @brief Records the offset a synchronization in progress resumes at.
+    ///
+    /// @param sync_offset Offset of the first address not synchronized yet
+    /// or zero when the synchronization is complete.
+    void setSyncOffset(const uint64_t sync_offset) {
+        sync_offset_ = sync_offset;
+    }
+
+private:
+    /// @brief Number of addresses in the range.
+    uint64_t size_;
+
+    /// @brief Number of free addresses in the range.
+    uint64_t free_count_;
+
+    /// @brief The bits, 64 addresses per word.
+    std::vector<uint64_t> words_;
+
+    /// @brief Time of the last synchronization with the leases.
+    time_t sync_time_;
+
+    /// @brief Offset the synchronization in progress resumes at.
+    uint64_t sync_offset_;
+};
+
+/// @brief A pointer to the @c AddressBitmap object.
+typedef boost::shared_ptr<AddressBitmap> AddressBitmapPtr;
+
+} // end of bundy::dhcp namespace
+} // end of bundy namespace
+
+#endif // ADDRESS_BITMAP_H
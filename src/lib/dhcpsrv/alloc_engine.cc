@@ -19,12 +19,18 @@
 #include <hooks/server_hooks.h>
 #include <hooks/hooks_manager.h>
 
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <string.h>
+#include <sys/time.h>
 
 using namespace bundy::asiolink;
 using namespace bundy::hooks;
+using bundy::util::thread::Mutex;
 
 namespace {
 
@@ -53,6 +59,88 @@ AllocEngineHooks Hooks;
 namespace bundy {
 namespace dhcp {
 
+bool
+AllocEngine::Allocator::pickFreeAddress4(const SubnetPtr& subnet,
+                                         uint64_t start, IOAddress& addr) {
+    const PoolCollection& pools = subnet->getPools(Lease::TYPE_V4);
+    const uint64_t capacity = getCapacity4(subnet);
+    if (capacity == 0) {
+        return (false);
+    }
+
+    // Find the pool the start position is in, and the offset of the
+    // start position in that pool.
+    start %= capacity;
+    size_t first_pool = 0;
+    for (; first_pool < pools.size(); ++first_pool) {
+        Pool4Ptr pool = boost::dynamic_pointer_cast<Pool4>(pools[first_pool]);
+        if (!pool) {
+            continue;
+        }
+        if (start < pool->getCapacity()) {
+            break;
+        }
+        start -= pool->getCapacity();
+    }
+
+    // Search from the start position to the end of its pool, then the
+    // following pools, wrapping around, and finally the beginning of the
+    // first pool up to the start position.
+    for (size_t i = 0; i <= pools.size(); ++i) {
+        Pool4Ptr pool = boost::dynamic_pointer_cast<Pool4>(
+            pools[(first_pool + i) % pools.size()]);
+        if (!pool) {
+            continue;
+        }
+        AddressBitmapPtr bitmap = AllocEngine::getAddressBitmap(pool);
+        const uint64_t begin = (i == 0 ? start : 0);
+        const uint64_t end = (i == pools.size() ? start : bitmap->getSize());
+        const uint64_t offset = bitmap->findFree(begin, end);
+        if (offset < end) {
+            addr = IOAddress(static_cast<uint32_t>(
+                static_cast<uint32_t>(pool->getFirstAddress()) + offset));
+            return (true);
+        }
+    }
+    return (false);
+}
+
+bool
+AllocEngine::Allocator::getPosition4(const SubnetPtr& subnet,
+                                     const IOAddress& addr,
+                                     uint64_t& position) {
+    const PoolCollection& pools = subnet->getPools(Lease::TYPE_V4);
+    uint64_t base = 0;
+    for (PoolCollection::const_iterator it = pools.begin();
+         it != pools.end(); ++it) {
+        Pool4Ptr pool = boost::dynamic_pointer_cast<Pool4>(*it);
+        if (!pool) {
+            continue;
+        }
+        if (pool->inRange(addr)) {
+            position = base + static_cast<uint32_t>(addr) -
+                static_cast<uint32_t>(pool->getFirstAddress());
+            return (true);
+        }
+        base += pool->getCapacity();
+    }
+    return (false);
+}
+
+uint64_t
+AllocEngine::Allocator::getCapacity4(const SubnetPtr& subnet) {
+    const PoolCollection& pools = subnet->getPools(Lease::TYPE_V4);
+    uint64_t capacity = 0;
+    for (PoolCollection::const_iterator it = pools.begin();
+         it != pools.end(); ++it) {
+        Pool4Ptr pool = boost::dynamic_pointer_cast<Pool4>(*it);
+        if (pool) {
+            capacity += pool->getCapacity();
+        }
+    }
+    return (capacity);
+}
+
 AllocEngine::IterativeAllocator::IterativeAllocator(Lease::Type lease_type)
     :Allocator(lease_type) {
 }
@@ -146,6 +234,26 @@ bundy::asiolink::IOAddress
 AllocEngine::IterativeAllocator::pickAddress(const SubnetPtr& subnet,
                                              const DuidPtr&,
                                              const IOAddress&) {
+    IOAddress next = pickNextAddress(subnet);
+    if (pool_type_ != Lease::TYPE_V4) {
+        return (next);
+    }
+
+    // Skip the addresses which are known to be in use. If all of them
+    // are, return the next address anyway: the caller will check whether
+    // its lease has expired.
+    uint64_t position = 0;
+    IOAddress free_addr("0.0.0.0");
+    if (getPosition4(subnet, next, position) &&
+        pickFreeAddress4(subnet, position, free_addr)) {
+        subnet->setLastAllocated(pool_type_, free_addr);
+        return (free_addr);
+    }
+    return (next);
+}
+
+bundy::asiolink::IOAddress
+AllocEngine::IterativeAllocator::pickNextAddress(const SubnetPtr& subnet) {
 
     // Is this prefix allocation?
     bool prefix = pool_type_ == Lease::TYPE_PD;
@@ -218,35 +326,238 @@ AllocEngine::IterativeAllocator::pickAddress(const SubnetPtr& subnet,
 }
 
 AllocEngine::HashedAllocator::HashedAllocator(Lease::Type lease_type)
-    :Allocator(lease_type) {
-    bundy_throw(NotImplemented, "Hashed allocator is not implemented");
+    :IterativeAllocator(lease_type) {
+    if (lease_type != Lease::TYPE_V4) {
+        bundy_throw(NotImplemented, "Hashed allocator is not implemented for "
+                    << Lease::typeToText(lease_type));
+    }
 }
 
 
 bundy::asiolink::IOAddress
-AllocEngine::HashedAllocator::pickAddress(const SubnetPtr&,
-                                          const DuidPtr&,
-                                          const IOAddress&) {
-    bundy_throw(NotImplemented, "Hashed allocator is not implemented");
+AllocEngine::HashedAllocator::pickAddress(const SubnetPtr& subnet,
+                                          const DuidPtr& duid,
+                                          const IOAddress& hint) {
+    const std::vector<uint8_t> key = duid ? duid->getDuid() : hint.toBytes();
+    const uint64_t start = boost::hash_range(key.begin(), key.end());
+
+    IOAddress addr("0.0.0.0");
+    if (pickFreeAddress4(subnet, start, addr)) {
+        return (addr);
+    }
+    return (IterativeAllocator::pickAddress(subnet, duid, hint));
 }
 
 AllocEngine::RandomAllocator::RandomAllocator(Lease::Type lease_type)
-    :Allocator(lease_type) {
-    bundy_throw(NotImplemented, "Random allocator is not implemented");
+    :IterativeAllocator(lease_type) {
+    if (lease_type != Lease::TYPE_V4) {
+        bundy_throw(NotImplemented, "Random allocator is not implemented for "
+                    << Lease::typeToText(lease_type));
+    }
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    generator_.seed((tv.tv_sec * 1000000) + tv.tv_usec);
 }
 
 
 bundy::asiolink::IOAddress
-AllocEngine::RandomAllocator::pickAddress(const SubnetPtr&,
-                                          const DuidPtr&,
-                                          const IOAddress&) {
-    bundy_throw(NotImplemented, "Random allocator is not implemented");
+AllocEngine::RandomAllocator::pickAddress(const SubnetPtr& subnet,
+                                          const DuidPtr& duid,
+                                          const IOAddress& hint) {
+    IOAddress addr("0.0.0.0");
+    if (pickFreeAddress4(subnet, generator_(), addr)) {
+        return (addr);
+    }
+    return (IterativeAllocator::pickAddress(subnet, duid, hint));
+}
+
+const time_t AllocEngine::BITMAP_SYNC_INTERVAL;
+const size_t AllocEngine::ADDRESS_MUTEXES;
+Mutex AllocEngine::pool_mutex_;
+
+AddressBitmapPtr
+AllocEngine::getAddressBitmap(const Pool4Ptr& pool) {
+    AddressBitmapPtr bitmap = pool->getAddressBitmap();
+    const time_t now = time(NULL);
+    if (!bitmap) {
+        bitmap.reset(new AddressBitmap(pool->getCapacity()));
+        pool->setAddressBitmap(bitmap);
+        syncAddressBitmap(pool, *bitmap, 0, bitmap->getSize());
+        bitmap->setSyncTime(now);
+
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+                  DHCPSRV_ADDRESS4_BITMAP_SYNC).arg(pool->toText())
+            .arg(bitmap->getFreeCount());
+        return (bitmap);
+    }
+
+    // An exhausted bitmap is synchronized one batch at a time, so as a
+    // single packet doesn't pay for the whole pool. A new pass starts at
+    // most once per interval, a pass in progress goes on right away.
+    if ((bitmap->getFreeCount() > 0) ||
+        ((bitmap->getSyncOffset() == 0) &&
+         (now - bitmap->getSyncTime() < BITMAP_SYNC_INTERVAL))) {
+        return (bitmap);
+    }
+    const uint64_t begin = bitmap->getSyncOffset();
+    const uint64_t end = std::min(begin + BITMAP_SYNC_BATCH_SIZE,
+                                  bitmap->getSize());
+    syncAddressBitmap(pool, *bitmap, begin, end);
+    if (end < bitmap->getSize()) {
+        bitmap->setSyncOffset(end);
+    } else {
+        bitmap->setSyncOffset(0);
+        bitmap->setSyncTime(now);
+
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+                  DHCPSRV_ADDRESS4_BITMAP_SYNC).arg(pool->toText())
+            .arg(bitmap->getFreeCount());
+    }
+    return (bitmap);
+}
+
+void
+AllocEngine::syncAddressBitmap(const Pool4Ptr& pool, AddressBitmap& bitmap,
+                               const uint64_t begin, const uint64_t end) {
+    // Look up the leases in batches, so as the database backends don't
+    // need a query for each address of the pool.
+    LeaseMgr& lease_mgr = LeaseMgrFactory::instance();
+    const uint32_t first = pool->getFirstAddress();
+    std::vector<IOAddress> addrs;
+    addrs.reserve(BITMAP_SYNC_BATCH_SIZE);
+    for (uint64_t offset = begin; offset < end; ) {
+        addrs.clear();
+        for (; (offset < end) && (addrs.size() < BITMAP_SYNC_BATCH_SIZE);
+             ++offset) {
+            addrs.push_back(IOAddress(static_cast<uint32_t>(first + offset)));
+            bitmap.setFree(offset);
+        }
+        Lease4Collection leases = lease_mgr.getLeases4(addrs);
+        for (Lease4Collection::const_iterator lease = leases.begin();
+             lease != leases.end(); ++lease) {
+            if (!(*lease)->expired()) {
+                bitmap.setUsed(static_cast<uint32_t>((*lease)->addr_) -
+                               first);
+            }
+        }
+    }
 }
 
+void
+AllocEngine::updateAddressBitmap(const SubnetPtr& subnet,
+                                 const IOAddress& addr, const bool used) {
+    Mutex::Locker lock(pool_mutex_);
+    Pool4Ptr pool = boost::dynamic_pointer_cast<Pool4>(
+        subnet->getPool(Lease::TYPE_V4, addr, false));
+    if (!pool || !pool->inRange(addr) || !pool->getAddressBitmap()) {
+        return;
+    }
+    const uint64_t offset = static_cast<uint32_t>(addr) -
+        static_cast<uint32_t>(pool->getFirstAddress());
+    if (used) {
+        pool->getAddressBitmap()->setUsed(offset);
+    } else {
+        pool->getAddressBitmap()->setFree(offset);
+    }
+}
+
+IOAddress
+AllocEngine::pickAddress(const AllocatorPtr& allocator,
+                         const SubnetPtr& subnet, const DuidPtr& duid,
+                         const IOAddress& hint) {
+    Mutex::Locker lock(pool_mutex_);
+    return (allocator->pickAddress(subnet, duid, hint));
+}
+
+Mutex&
+AllocEngine::getAddressMutex(const IOAddress& addr) {
+    return (address_mutexes_[hash_value(addr) % ADDRESS_MUTEXES]);
+}
+
+Lease4Ptr
+AllocEngine::reloadLease4(const Lease4Ptr& lease) const {
+    LeaseMgr& lease_mgr = LeaseMgrFactory::instance();
+    // If the backend can't be used by several threads, the lease can't
+    // have changed since it was looked up.
+    if (!lease_mgr.isThreadSafe()) {
+        return (lease);
+    }
+    Lease4Ptr current = lease_mgr.getLease4(lease->addr_);
+    if (!current || (current->hwaddr_ != lease->hwaddr_) ||
+        (current->getClientIdVector() != lease->getClientIdVector())) {
+        return (Lease4Ptr());
+    }
+    return (current);
+}
+
+Lease4Ptr
+AllocEngine::reuseExpiredLeases4(const SubnetPtr& subnet,
+                                 const ClientIdPtr& clientid,
+                                 const HWAddrPtr& hwaddr,
+                                 const bool fwd_dns_update,
+                                 const bool rev_dns_update,
+                                 const std::string& hostname,
+                                 const bundy::hooks::CalloutHandlePtr& callout_handle,
+                                 bool fake_allocation,
+                                 Lease4Ptr& old_lease) {
+    LeaseMgr& lease_mgr = LeaseMgrFactory::instance();
+    // The leases which can't be reused (e.g. those outside of the pools)
+    // are not removed from the database, so a new batch may return them
+    // again. Don't retrieve more than one batch per call.
+    bool fetched = false;
+    while (true) {
+        Lease4Ptr candidate;
+        {
+            Mutex::Locker lock(expired_leases_mutex_);
+            Lease4Collection& expired = expired_leases4_[subnet->getID()];
+            if (expired.empty()) {
+                if (fetched) {
+                    return (Lease4Ptr());
+                }
+                fetched = true;
+                try {
+                    expired = lease_mgr.getExpiredLeases4(
+                        subnet->getID(), EXPIRED_LEASES_BATCH_SIZE);
+                } catch (const bundy::NotImplemented&) {
+                    // The allocator will go on picking the addresses.
+                    return (Lease4Ptr());
+                }
+                if (expired.empty()) {
+                    return (Lease4Ptr());
+                }
+                std::reverse(expired.begin(), expired.end());
+            }
+            candidate = expired.back();
+            expired.pop_back();
+        }
+
+        if (!subnet->inPool(Lease::TYPE_V4, candidate->addr_)) {
+            continue;
+        }
+
+        // The lease may have been reused or renewed since it was retrieved.
+        Mutex::Locker lock(getAddressMutex(candidate->addr_));
+        Lease4Ptr existing = lease_mgr.getLease4(candidate->addr_);
+        if (!existing) {
+            // The lease has been deleted since, so the address is free.
+            updateAddressBitmap(subnet, candidate->addr_, false);
+            continue;
+        }
+        if (existing->expired() &&
+            (existing->subnet_id_ == subnet->getID())) {
+            // Save the old lease, before reusing it.
+            old_lease.reset(new Lease4(*existing));
+            return (reuseExpiredLease(existing, subnet, clientid, hwaddr,
+                                      fwd_dns_update, rev_dns_update,
+                                      hostname, callout_handle,
+                                      fake_allocation));
+        }
+    }
+}
 
 AllocEngine::AllocEngine(AllocType engine_type, unsigned int attempts,
                          bool ipv6)
-    :attempts_(attempts) {
+    :attempts_(attempts), address_mutexes_(new Mutex[ADDRESS_MUTEXES]) {
 
     // Choose the basic (normal address) lease type
     Lease::Type basic_type = ipv6 ? Lease::TYPE_NA : Lease::TYPE_V4;
@@ -338,6 +649,8 @@ AllocEngine::allocateLeases6(const Subnet6Ptr& subnet, const DuidPtr& duid,
             Pool6>(subnet->getPool(type, hint, false));
 
         if (pool) {
+            Mutex::Locker lock(getAddressMutex(hint));
+
             /// @todo: We support only one hint for now
             Lease6Ptr lease = LeaseMgrFactory::instance().getLease6(type, hint);
             if (!lease) {
@@ -406,7 +719,8 @@ AllocEngine::allocateLeases6(const Subnet6Ptr& subnet, const DuidPtr& duid,
 
         unsigned int i = attempts_;
         do {
-            IOAddress candidate = allocator->pickAddress(subnet, duid, hint);
+            IOAddress candidate = pickAddress(allocator, subnet, duid, hint);
+            Mutex::Locker lock(getAddressMutex(candidate));
 
             /// @todo: check if the address is reserved once we have host support
             /// implemented
@@ -512,15 +826,19 @@ AllocEngine::allocateLease4(const SubnetPtr& subnet, const ClientIdPtr& clientid
         // Check if there's existing lease for that subnet/clientid/hwaddr combination.
         Lease4Ptr existing = LeaseMgrFactory::instance().getLease4(*hwaddr, subnet->getID());
         if (existing) {
-            // Save the old lease, before renewal.
-            old_lease.reset(new Lease4(*existing));
-            // We have a lease already. This is a returning client, probably after
-            // its reboot.
-            existing = renewLease4(subnet, clientid, hwaddr,
-                                   fwd_dns_update, rev_dns_update, hostname,
-                                   existing, callout_handle, fake_allocation);
+            Mutex::Locker lock(getAddressMutex(existing->addr_));
+            existing = reloadLease4(existing);
             if (existing) {
-                return (existing);
+                // Save the old lease, before renewal.
+                old_lease.reset(new Lease4(*existing));
+                // We have a lease already. This is a returning client, probably after
+                // its reboot.
+                existing = renewLease4(subnet, clientid, hwaddr,
+                                       fwd_dns_update, rev_dns_update, hostname,
+                                       existing, callout_handle, fake_allocation);
+                if (existing) {
+                    return (existing);
+                }
             }
 
             // If renewal failed (e.g. the lease no longer matches current configuration)
@@ -530,24 +848,29 @@ AllocEngine::allocateLease4(const SubnetPtr& subnet, const ClientIdPtr& clientid
         if (clientid) {
             existing = LeaseMgrFactory::instance().getLease4(*clientid, subnet->getID());
             if (existing) {
-                // Save the old lease before renewal.
-                old_lease.reset(new Lease4(*existing));
-                // we have a lease already. This is a returning client, probably after
-                // its reboot.
-                existing = renewLease4(subnet, clientid, hwaddr,
-                                       fwd_dns_update, rev_dns_update,
-                                       hostname, existing, callout_handle,
-                                       fake_allocation);
-                // @todo: produce a warning. We haven't found him using MAC address, but
-                // we found him using client-id
+                Mutex::Locker lock(getAddressMutex(existing->addr_));
+                existing = reloadLease4(existing);
                 if (existing) {
-                    return (existing);
+                    // Save the old lease before renewal.
+                    old_lease.reset(new Lease4(*existing));
+                    // we have a lease already. This is a returning client, probably after
+                    // its reboot.
+                    existing = renewLease4(subnet, clientid, hwaddr,
+                                           fwd_dns_update, rev_dns_update,
+                                           hostname, existing, callout_handle,
+                                           fake_allocation);
+                    // @todo: produce a warning. We haven't found him using MAC address, but
+                    // we found him using client-id
+                    if (existing) {
+                        return (existing);
+                    }
                 }
             }
         }
 
         // check if the hint is in pool and is available
         if (subnet->inPool(Lease::TYPE_V4, hint)) {
+            Mutex::Locker lock(getAddressMutex(hint));
             existing = LeaseMgrFactory::instance().getLease4(hint);
             if (!existing) {
                 /// @todo: Check if the hint is reserved once we have host support
@@ -595,8 +918,26 @@ AllocEngine::allocateLease4(const SubnetPtr& subnet, const ClientIdPtr& clientid
         // moment, but we currently do not control expiration time at all
 
         unsigned int i = attempts_;
+        bool reuse_expired = false;
         do {
-            IOAddress candidate = allocator->pickAddress(subnet, clientid, hint);
+            if (reuse_expired) {
+                // The previous candidate was in use, so the pool is probably
+                // running out of free addresses. Try the expired leases of
+                // the subnet first, once per allocation.
+                reuse_expired = false;
+                Lease4Ptr lease = reuseExpiredLeases4(subnet, clientid, hwaddr,
+                                                      fwd_dns_update,
+                                                      rev_dns_update, hostname,
+                                                      callout_handle,
+                                                      fake_allocation,
+                                                      old_lease);
+                if (lease) {
+                    return (lease);
+                }
+            }
+
+            IOAddress candidate = pickAddress(allocator, subnet, clientid, hint);
+            Mutex::Locker lock(getAddressMutex(candidate));
 
             /// @todo: check if the address is reserved once we have host support
             /// implemented
@@ -625,6 +966,11 @@ AllocEngine::allocateLease4(const SubnetPtr& subnet, const ClientIdPtr& clientid
                                               hostname, callout_handle,
                                               fake_allocation));
                 }
+
+                // The allocator believed the address to be free, so the
+                // lease must have been added behind the engine's back.
+                updateAddressBitmap(subnet, candidate, true);
+                reuse_expired = (i == attempts_);
             }
 
             // Continue trying allocation until we run out of attempts
@@ -676,7 +1022,8 @@ Lease4Ptr AllocEngine::renewLease4(const SubnetPtr& subnet,
 
     bool skip = false;
     // Execute all callouts registered for packet6_send
-    if (HooksManager::getHooksManager().calloutsPresent(Hooks.hook_index_lease4_renew_)) {
+    if (callout_handle &&
+        HooksManager::getHooksManager().calloutsPresent(Hooks.hook_index_lease4_renew_)) {
 
         // Delete all previous arguments
         callout_handle->deleteAllArguments();
@@ -874,6 +1221,7 @@ Lease4Ptr AllocEngine::reuseExpiredLease(Lease4Ptr& expired,
     if (!fake_allocation) {
         // for REQUEST we do update the lease
         LeaseMgrFactory::instance().updateLease4(expired);
+        updateAddressBitmap(subnet, expired->addr_, true);
     }
 
     // We do nothing for SOLICIT. We'll just update database when
@@ -1041,6 +1389,9 @@ Lease4Ptr AllocEngine::createLease4(const SubnetPtr& subnet,
     if (!fake_allocation) {
         // That is a real (REQUEST) allocation
         bool status = LeaseMgrFactory::instance().addLease(lease);
+        // If the lease couldn't be added, the address is most likely used
+        // by someone else, so it is used in both cases.
+        updateAddressBitmap(subnet, lease->addr_, true);
         if (status) {
             return (lease);
         } else {
@@ -21,9 +21,12 @@
 #include <dhcpsrv/subnet.h>
 #include <dhcpsrv/lease_mgr.h>
 #include <hooks/callout_handle.h>
+#include <util/threads/sync.h>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/random/mersenne_twister.hpp>
 
 #include <map>
 
@@ -50,6 +53,15 @@ public:
 /// for picking subnets, choosing and allocating a lease, extending,
 /// renewing, releasing and possibly expiring leases.
 ///
+/// The engine may be used by several threads at once, provided that the
+/// lease database backend is thread safe (see @c LeaseMgr::isThreadSafe).
+/// The engine holds a lock on the address while it checks whether the
+/// address is free and allocates it, so as two clients don't get the same
+/// address. The allocators and the bitmaps of the pools are protected by
+/// a single mutex, which is held only for the time of picking an address.
+/// Concurrent processing of the requests from the same client must be
+/// prevented by the caller.
+///
 /// @todo: Does not handle out of leases well
 /// @todo: Does not handle out of allocation attempts well
 class AllocEngine : public boost::noncopyable {
@@ -100,6 +112,37 @@ protected:
         }
     protected:
 
+        /// @brief Picks a free IPv4 address using the bitmaps of the pools.
+        ///
+        /// The search starts at the given position and continues through
+        /// the subnet's pools in order, wrapping around after the last one.
+        /// A position is the index of an address in all pools of the subnet
+        /// taken as one contiguous range (see @c getPosition4).
+        ///
+        /// @param subnet subnet the address will be picked from
+        /// @param start position of the first address to check (it is taken
+        ///        modulo the number of addresses in the pools)
+        /// @param [out] addr the free address found
+        /// @return true if a free address was found, false if the bitmaps
+        ///         say that all addresses are in use
+        static bool pickFreeAddress4(const SubnetPtr& subnet, uint64_t start,
+                                     bundy::asiolink::IOAddress& addr);
+
+        /// @brief Returns the position of an address in the IPv4 pools.
+        ///
+        /// @param subnet subnet holding the pools
+        /// @param addr address within one of the pools
+        /// @param [out] position position of the address
+        /// @return true if the address is in one of the pools
+        static bool getPosition4(const SubnetPtr& subnet,
+                                 const bundy::asiolink::IOAddress& addr,
+                                 uint64_t& position);
+
+        /// @brief Returns the total number of addresses in the IPv4 pools.
+        ///
+        /// @param subnet subnet holding the pools
+        static uint64_t getCapacity4(const SubnetPtr& subnet);
+
         /// @brief defines pool type allocation
         Lease::Type pool_type_;
     };
@@ -113,6 +156,13 @@ protected:
     /// a pool iteratively, one after another. Once the last address is reached,
     /// it starts allocating from the beginning of the first pool (i.e. it loops
     /// over).
+    ///
+    /// For IPv4 addresses, the addresses known to be in use are skipped
+    /// using the bitmaps of the pools (see @c AllocEngine::getAddressBitmap),
+    /// so the allocator returns the next free address rather than the next
+    /// address. If no address is free according to the bitmaps, the next
+    /// address is returned, so the engine still gets to see the addresses
+    /// which are used by expired leases.
     class IterativeAllocator : public Allocator {
     public:
 
@@ -134,6 +184,15 @@ protected:
                         const bundy::asiolink::IOAddress& hint);
     protected:
 
+        /// @brief returns the address following the last allocated one
+        ///
+        /// This is the iteration step, without checking whether the
+        /// address is in use.
+        ///
+        /// @param subnet next address will be returned from pool of that subnet
+        /// @return the next address
+        bundy::asiolink::IOAddress pickNextAddress(const SubnetPtr& subnet);
+
         /// @brief Returns an address increased by one
         ///
         /// This method works for both IPv4 and IPv6 addresses. For example,
@@ -159,23 +218,28 @@ protected:
                        const uint8_t prefix_len);
     };
 
-    /// @brief Address/prefix allocator that gets an address based on a hash
+    /// @brief Address allocator that gets an address based on a hash
+    ///
+    /// The allocator hashes the client identifier (or the hint, if there
+    /// is no identifier) to select a position in the subnet's pools, and
+    /// returns the first free address at or after that position. As long
+    /// as the address is free, the same client gets the same address.
     ///
-    /// @todo: This is a skeleton class for now and is missing implementation.
-    class HashedAllocator : public Allocator {
+    /// It is currently implemented for IPv4 addresses only. When all
+    /// addresses are in use, it falls back to the iterative algorithm.
+    class HashedAllocator : public IterativeAllocator {
     public:
 
-        /// @brief default constructor (does nothing)
+        /// @brief default constructor
         /// @param type - specifies allocation type
+        /// @throw NotImplemented if the type is not @c Lease::TYPE_V4
         HashedAllocator(Lease::Type type);
 
         /// @brief returns an address based on hash calculated from client's DUID.
         ///
-        /// @todo: Implement this method
-        ///
         /// @param subnet an address will be picked from pool of that subnet
-        /// @param duid Client's DUID
-        /// @param hint a hint (last address that was picked)
+        /// @param duid Client's DUID (or client identifier)
+        /// @param hint a hint, hashed if the DUID is not specified
         /// @return selected address
         virtual bundy::asiolink::IOAddress pickAddress(const SubnetPtr& subnet,
                                                      const DuidPtr& duid,
@@ -184,18 +248,24 @@ protected:
 
     /// @brief Random allocator that picks address randomly
     ///
-    /// @todo: This is a skeleton class for now and is missing implementation.
-    class RandomAllocator : public Allocator {
+    /// The allocator returns the first free address at or after a random
+    /// position in the subnet's pools.
+    ///
+    /// It is currently implemented for IPv4 addresses only. When all
+    /// addresses are in use, it falls back to the iterative algorithm.
+    class RandomAllocator : public IterativeAllocator {
     public:
 
-        /// @brief default constructor (does nothing)
+        /// @brief default constructor
+        ///
+        /// Seeds the random number generator with the current time.
+        ///
         /// @param type - specifies allocation type
+        /// @throw NotImplemented if the type is not @c Lease::TYPE_V4
         RandomAllocator(Lease::Type type);
 
         /// @brief returns an random address from pool of specified subnet
         ///
-        /// @todo: Implement this method
-        ///
         /// @param subnet an address will be picked from pool of that subnet
         /// @param duid Client's DUID (ignored)
         /// @param hint the last address that was picked (ignored)
@@ -203,6 +273,10 @@ protected:
         virtual bundy::asiolink::IOAddress
         pickAddress(const SubnetPtr& subnet, const DuidPtr& duid,
                     const bundy::asiolink::IOAddress& hint);
+
+    private:
+        /// @brief the random number generator
+        boost::mt19937 generator_;
     };
 
     public:
@@ -354,6 +428,68 @@ protected:
                     const bundy::hooks::CalloutHandlePtr& callout_handle,
                     Lease6Collection& old_leases);
 
+    /// @brief Returns the bitmap of used addresses in an IPv4 pool.
+    ///
+    /// The bitmap is created and synchronized with the lease database when
+    /// the pool doesn't have one yet. After that, it is updated as the
+    /// engine allocates addresses, and by the server through
+    /// @c updateAddressBitmap when leases are released. Leases expiring
+    /// are not tracked, so when the bitmap runs out of free addresses it
+    /// is synchronized again. Each call on an exhausted bitmap synchronizes
+    /// the next @c BITMAP_SYNC_BATCH_SIZE addresses only, so as the cost
+    /// of the synchronization is spread over the allocations instead of
+    /// being paid by a single packet. A new pass over the pool starts at
+    /// most once per @c BITMAP_SYNC_INTERVAL seconds. During the
+    /// synchronization, an address is considered used if there is a lease
+    /// for it which has not expired.
+    ///
+    /// This method must not be called concurrently with the allocations.
+    /// The allocators call it with the mutex protecting the pools held.
+    ///
+    /// @param pool pool the bitmap is returned for
+    /// @return bitmap of the used addresses in the pool
+    static AddressBitmapPtr getAddressBitmap(const Pool4Ptr& pool);
+
+    /// @brief Records in the bitmaps that an IPv4 address is used or free.
+    ///
+    /// This should be called when a lease is added or removed other than
+    /// by the allocation engine, e.g. when the client releases the lease.
+    /// It does nothing if the address doesn't belong to any pool of the
+    /// subnet or if the bitmap of the pool hasn't been created yet.
+    ///
+    /// @param subnet subnet the address belongs to
+    /// @param addr address whose state has changed
+    /// @param used true if the address is now used, false if it is free
+    static void updateAddressBitmap(const SubnetPtr& subnet,
+                                    const bundy::asiolink::IOAddress& addr,
+                                    const bool used);
+
+    /// @brief Minimal interval between synchronizations of an exhausted
+    /// bitmap with the lease database (in seconds).
+    static const time_t BITMAP_SYNC_INTERVAL = 10;
+
+    /// @brief Number of addresses looked up at once when a bitmap is
+    /// synchronized with the lease database.
+    static const size_t BITMAP_SYNC_BATCH_SIZE = 256;
+
+    /// @brief Maximum number of expired leases of a subnet retrieved at once
+    /// for reuse.
+    static const size_t EXPIRED_LEASES_BATCH_SIZE = 64;
+
+    /// @brief Returns the mutex to be held while the address is allocated.
+    ///
+    /// The addresses share a fixed number of mutexes, so an allocation may
+    /// occasionally wait for an unrelated one. At most one of these mutexes
+    /// is held at a time. The servers also hold it while they release a
+    /// lease, so as the lease isn't removed while it is being reused for
+    /// another client.
+    ///
+    /// @param addr address being allocated
+    ///
+    /// @return the mutex for the address
+    bundy::util::thread::Mutex&
+    getAddressMutex(const bundy::asiolink::IOAddress& addr);
+
     /// @brief returns allocator for a given pool type
     /// @param type type of pool (V4, IA, TA or PD)
     /// @throw BadValue if allocator for a given type is missing
@@ -518,6 +654,70 @@ private:
                                     const std::string& hostname,
                                     const bool fake_allocation);
 
+    /// @brief Picks an address with the allocator.
+    ///
+    /// @param allocator allocator to be used
+    /// @param subnet subnet the address is picked from
+    /// @param duid client's DUID
+    /// @param hint a hint that the client provided
+    ///
+    /// @return the address picked by the allocator
+    bundy::asiolink::IOAddress
+    pickAddress(const AllocatorPtr& allocator, const SubnetPtr& subnet,
+                const DuidPtr& duid, const bundy::asiolink::IOAddress& hint);
+
+    /// @brief Synchronizes a range of the bitmap of a pool with the leases.
+    ///
+    /// The addresses in the range are marked as used if they have a lease
+    /// which has not expired, as free otherwise. The leases are looked up
+    /// @c BITMAP_SYNC_BATCH_SIZE addresses at a time.
+    ///
+    /// @param pool pool the bitmap belongs to
+    /// @param bitmap bitmap of the pool
+    /// @param begin offset of the first address to synchronize
+    /// @param end offset following the last address to synchronize
+    static void syncAddressBitmap(const Pool4Ptr& pool, AddressBitmap& bitmap,
+                                  const uint64_t begin, const uint64_t end);
+
+    /// @brief Re-reads the lease found for the client.
+    ///
+    /// The lease of the client could have expired and been reused for
+    /// another client by a concurrent allocation after it was looked up.
+    /// This method must be called with the mutex for the address held.
+    ///
+    /// @param lease lease found for the client
+    ///
+    /// @return current state of the lease or NULL if it doesn't belong to
+    /// the same client anymore.
+    Lease4Ptr reloadLease4(const Lease4Ptr& lease) const;
+
+    /// @brief Reuses one of the expired IPv4 leases of the subnet.
+    ///
+    /// This is called when the address picked by the allocator is in use,
+    /// which happens when the pools are close to exhaustion, e.g. during
+    /// bursts of allocations. The expired leases of the subnet are retrieved
+    /// from the lease database @c EXPIRED_LEASES_BATCH_SIZE at a time and
+    /// kept by the engine, so as the subsequent allocations in the subnet
+    /// take the next of them instead of querying the database again. Each
+    /// lease is looked up again before it is reused, as it may have been
+    /// renewed or reused in the meantime. If it has been deleted, its
+    /// address is marked as free in the bitmap of the pool. At most one
+    /// batch is retrieved per call, as the leases which can't be reused
+    /// (e.g. those outside of the pools) stay in the database.
+    ///
+    /// The parameters are those of @c AllocEngine::allocateLease4.
+    ///
+    /// @return reused lease or NULL if there is no expired lease available
+    Lease4Ptr reuseExpiredLeases4(const SubnetPtr& subnet,
+                                  const ClientIdPtr& clientid,
+                                  const HWAddrPtr& hwaddr,
+                                  const bool fwd_dns_update,
+                                  const bool rev_dns_update,
+                                  const std::string& hostname,
+                                  const bundy::hooks::CalloutHandlePtr& callout_handle,
+                                  bool fake_allocation,
+                                  Lease4Ptr& old_lease);
+
     /// @brief a pointer to currently used allocator
     ///
     /// For IPv4, there will be only one allocator: TYPE_V4
@@ -527,6 +727,22 @@ private:
     /// @brief number of attempts before we give up lease allocation (0=unlimited)
     unsigned int attempts_;
 
+    /// @brief Number of mutexes protecting the allocations of addresses.
+    static const size_t ADDRESS_MUTEXES = 64;
+
+    /// @brief Mutexes protecting the allocations of addresses.
+    boost::scoped_array<bundy::util::thread::Mutex> address_mutexes_;
+
+    /// @brief Protects the allocators and the bitmaps of the pools.
+    static bundy::util::thread::Mutex pool_mutex_;
+
+    /// @brief Expired IPv4 leases retrieved for reuse, by subnet. The
+    /// leases expired longest ago are at the end.
+    std::map<SubnetID, Lease4Collection> expired_leases4_;
+
+    /// @brief Protects the expired leases retrieved for reuse.
+    bundy::util::thread::Mutex expired_leases_mutex_;
+
     // hook name indexes (used in hooks callouts)
     int hook_index_lease4_select_; ///< index for lease4_select hook
     int hook_index_lease6_select_; ///< index for lease6_select hook
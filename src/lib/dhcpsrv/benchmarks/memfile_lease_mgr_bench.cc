@@ -0,0 +1,379 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <asiolink/io_address.h>
+#include <dhcp/duid.h>
+#include <dhcp/hwaddr.h>
+#include <dhcpsrv/memfile_lease_mgr.h>
+#include <log/logger_support.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::asiolink;
+using namespace bundy::bench;
+using namespace bundy::dhcp;
+
+namespace {
+
+// All leases used by the benchmarks belong to this subnet.
+const SubnetID SUBNET_ID = 1;
+
+// Returns the byte of the given value at the given position, counting
+// from the least significant byte.
+uint8_t
+getByte(const uint32_t value, const int pos) {
+    return (static_cast<uint8_t>((value >> (8 * pos)) & 0xff));
+}
+
+// Returns the parameters of a non-persistent lease manager for the given
+// universe ("4" or "6").
+LeaseMgr::ParameterMap
+getParameters(const char* universe) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["type"] = "memfile";
+    pmap["universe"] = universe;
+    pmap["persist"] = "false";
+    return (pmap);
+}
+
+// Creates the given number of distinct IPv4 leases. The address, the
+// hardware address and the client identifier of each lease are derived
+// from its index.
+vector<Lease4Ptr>
+createLeases4(const size_t count) {
+    vector<Lease4Ptr> leases;
+    leases.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t n = static_cast<uint32_t>(i);
+        const uint8_t hwaddr[] = { 0x08, 0x00, getByte(n, 3), getByte(n, 2),
+                                   getByte(n, 1), getByte(n, 0) };
+        const uint8_t clientid[] = { 0x01, 0x08, 0x00, getByte(n, 3),
+                                     getByte(n, 2), getByte(n, 1),
+                                     getByte(n, 0) };
+        leases.push_back(Lease4Ptr(new Lease4(IOAddress(0x0a000000 + n),
+                                              hwaddr, sizeof(hwaddr),
+                                              clientid, sizeof(clientid),
+                                              3600, 900, 1800, time(NULL),
+                                              SUBNET_ID)));
+    }
+    return (leases);
+}
+
+// Creates the given number of distinct IPv6 leases. Each lease has its
+// own DUID and address.
+vector<Lease6Ptr>
+createLeases6(const size_t count) {
+    vector<Lease6Ptr> leases;
+    leases.reserve(count);
+    vector<uint8_t> addr = IOAddress("2001:db8::").toBytes();
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t n = static_cast<uint32_t>(i);
+        for (int j = 0; j < 4; ++j) {
+            addr[15 - j] = getByte(n, j);
+        }
+        const uint8_t duid[] = { 0x00, 0x03, 0x00, 0x01, 0x08, 0x00,
+                                 getByte(n, 3), getByte(n, 2),
+                                 getByte(n, 1), getByte(n, 0) };
+        DuidPtr duid_ptr(new DUID(duid, sizeof(duid)));
+        leases.push_back(Lease6Ptr(new Lease6(Lease::TYPE_NA,
+                                              IOAddress::fromBytes(AF_INET6,
+                                                                   &addr[0]),
+                                              duid_ptr, n, 1800, 3600, 900,
+                                              1800, SUBNET_ID)));
+    }
+    return (leases);
+}
+
+// Measures the time it takes to fill an empty lease manager with all
+// the leases.
+template <typename LeasePtr>
+class InsertBenchMark {
+public:
+    InsertBenchMark(const char* universe, const vector<LeasePtr>& leases) :
+        universe_(universe), leases_(leases)
+    {}
+    unsigned int run() {
+        Memfile_LeaseMgr lease_mgr(getParameters(universe_));
+        for (size_t i = 0; i < leases_.size(); ++i) {
+            const bool added = lease_mgr.addLease(leases_[i]);
+            assert(added);
+        }
+        return (leases_.size());
+    }
+private:
+    const char* const universe_;
+    const vector<LeasePtr>& leases_;
+};
+
+// Measures the rate at which the leases are committed to the lease file.
+// If the batch size is 0, each lease is appended and flushed individually,
+// which is the default mode of the lease manager. Otherwise, the group
+// commit is enabled and the leases are committed (flushed and synchronized
+// to the disk) in batches of the given size.
+class CommitBenchMark {
+public:
+    CommitBenchMark(const string& lease_file, const vector<Lease4Ptr>& leases,
+                    const size_t batch_size) :
+        lease_file_(lease_file), leases_(leases), batch_size_(batch_size)
+    {}
+    unsigned int run() {
+        static_cast<void>(remove(lease_file_.c_str()));
+        LeaseMgr::ParameterMap pmap = getParameters("4");
+        pmap["persist"] = "true";
+        pmap["name"] = lease_file_;
+        if (batch_size_ > 0) {
+            // Use the delay long enough so as the lease manager doesn't
+            // commit on its own.
+            pmap["group-commit-delay"] = "3600000";
+        }
+        Memfile_LeaseMgr lease_mgr(pmap);
+        for (size_t i = 0; i < leases_.size(); ++i) {
+            const bool added = lease_mgr.addLease(leases_[i]);
+            assert(added);
+            if ((batch_size_ > 0) && ((i + 1) % batch_size_ == 0)) {
+                lease_mgr.commit();
+            }
+        }
+        lease_mgr.commit();
+        return (leases_.size());
+    }
+private:
+    const string lease_file_;
+    const vector<Lease4Ptr>& leases_;
+    const size_t batch_size_;
+};
+
+// The lookups which can be measured by the LookupBenchMark.
+enum LookupType {
+    ADDRESS4,
+    HWADDR_SUBNET,
+    CLIENTID_SUBNET,
+    ADDRESS6,
+    DUID_IAID_SUBNET
+};
+
+// Measures the time it takes to look up each of the leases stored in the
+// lease manager using the given search key.
+class LookupBenchMark {
+public:
+    LookupBenchMark(const LeaseMgr& lease_mgr,
+                    const vector<Lease4Ptr>& leases4,
+                    const vector<Lease6Ptr>& leases6,
+                    const LookupType type) :
+        lease_mgr_(lease_mgr), leases4_(leases4), leases6_(leases6),
+        type_(type)
+    {}
+    unsigned int run() {
+        size_t found = 0;
+        switch (type_) {
+        case ADDRESS4:
+            for (size_t i = 0; i < leases4_.size(); ++i) {
+                found += lease_mgr_.getLease4(leases4_[i]->addr_) ? 1 : 0;
+            }
+            break;
+        case HWADDR_SUBNET:
+            for (size_t i = 0; i < leases4_.size(); ++i) {
+                const HWAddr hwaddr(leases4_[i]->hwaddr_, HTYPE_ETHER);
+                found += lease_mgr_.getLease4(hwaddr, SUBNET_ID) ? 1 : 0;
+            }
+            break;
+        case CLIENTID_SUBNET:
+            for (size_t i = 0; i < leases4_.size(); ++i) {
+                found += lease_mgr_.getLease4(*leases4_[i]->client_id_,
+                                              SUBNET_ID) ? 1 : 0;
+            }
+            break;
+        case ADDRESS6:
+            for (size_t i = 0; i < leases6_.size(); ++i) {
+                found += lease_mgr_.getLease6(Lease::TYPE_NA,
+                                              leases6_[i]->addr_) ? 1 : 0;
+            }
+            break;
+        case DUID_IAID_SUBNET:
+            for (size_t i = 0; i < leases6_.size(); ++i) {
+                found += lease_mgr_.getLeases6(Lease::TYPE_NA,
+                                               *leases6_[i]->duid_,
+                                               leases6_[i]->iaid_,
+                                               SUBNET_ID).size();
+            }
+            break;
+        }
+        const size_t expected = (type_ == ADDRESS6 ||
+                                 type_ == DUID_IAID_SUBNET) ?
+            leases6_.size() : leases4_.size();
+        assert(found == expected);
+        return (expected);
+    }
+private:
+    const LeaseMgr& lease_mgr_;
+    const vector<Lease4Ptr>& leases4_;
+    const vector<Lease6Ptr>& leases6_;
+    const LookupType type_;
+};
+
+void
+usage() {
+    cerr << "Usage: memfile_lease_mgr_bench [-n iterations] [-l leases] "
+         << "[-f lease_file [-c commits] [-b batch_size]]" << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 1;
+    size_t lease_count = 1000000;
+    string lease_file;
+    size_t commit_count = 10000;
+    size_t batch_size = 64;
+    while ((ch = getopt(argc, argv, "n:l:f:c:b:")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case 'l':
+            lease_count = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            lease_file = optarg;
+            break;
+        case 'c':
+            commit_count = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            batch_size = strtoul(optarg, NULL, 10);
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0 || iteration <= 0 || lease_count == 0 ||
+        commit_count == 0 || batch_size == 0) {
+        usage();
+    }
+
+    // Disable logging to avoid unwanted noise.
+    bundy::log::initLogger("memfile-lease-mgr-bench", bundy::log::NONE,
+                           bundy::log::MAX_DEBUG_LEVEL, NULL);
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+    cout << "  Leases: " << lease_count << endl;
+    if (!lease_file.empty()) {
+        cout << "  Lease file: " << lease_file << endl;
+        cout << "  Commits: " << commit_count << endl;
+        cout << "  Batch size: " << batch_size << endl;
+    }
+
+    // The leases are created (and therefore stored) in the order of
+    // their addresses. They are shuffled so that the lookups don't
+    // benefit from walking the container in the order of insertion.
+    vector<Lease4Ptr> leases4 = createLeases4(lease_count);
+    vector<Lease6Ptr> leases6 = createLeases6(lease_count);
+    random_shuffle(leases4.begin(), leases4.end());
+    random_shuffle(leases6.begin(), leases6.end());
+    const vector<Lease6Ptr> no_leases6;
+    const vector<Lease4Ptr> no_leases4;
+
+    cout << "Benchmark for inserting DHCPv4 leases" << endl;
+    BenchMark<InsertBenchMark<Lease4Ptr> >(
+        iteration, InsertBenchMark<Lease4Ptr>("4", leases4));
+
+    cout << "Benchmark for inserting DHCPv6 leases" << endl;
+    BenchMark<InsertBenchMark<Lease6Ptr> >(
+        iteration, InsertBenchMark<Lease6Ptr>("6", leases6));
+
+    {
+        Memfile_LeaseMgr lease_mgr(getParameters("4"));
+        for (size_t i = 0; i < leases4.size(); ++i) {
+            lease_mgr.addLease(leases4[i]);
+        }
+
+        cout << "Benchmark for DHCPv4 lookups by address" << endl;
+        BenchMark<LookupBenchMark>(iteration,
+                                   LookupBenchMark(lease_mgr, leases4,
+                                                   no_leases6, ADDRESS4));
+        cout << "Benchmark for DHCPv4 lookups by HW address and subnet"
+             << endl;
+        BenchMark<LookupBenchMark>(iteration,
+                                   LookupBenchMark(lease_mgr, leases4,
+                                                   no_leases6,
+                                                   HWADDR_SUBNET));
+        cout << "Benchmark for DHCPv4 lookups by client id and subnet"
+             << endl;
+        BenchMark<LookupBenchMark>(iteration,
+                                   LookupBenchMark(lease_mgr, leases4,
+                                                   no_leases6,
+                                                   CLIENTID_SUBNET));
+    }
+
+    {
+        Memfile_LeaseMgr lease_mgr(getParameters("6"));
+        for (size_t i = 0; i < leases6.size(); ++i) {
+            lease_mgr.addLease(leases6[i]);
+        }
+
+        cout << "Benchmark for DHCPv6 lookups by address" << endl;
+        BenchMark<LookupBenchMark>(iteration,
+                                   LookupBenchMark(lease_mgr, no_leases4,
+                                                   leases6, ADDRESS6));
+        cout << "Benchmark for DHCPv6 lookups by DUID, IAID and subnet"
+             << endl;
+        BenchMark<LookupBenchMark>(iteration,
+                                   LookupBenchMark(lease_mgr, no_leases4,
+                                                   leases6,
+                                                   DUID_IAID_SUBNET));
+    }
+
+    // The commit benchmarks write to the disk, so they are only run if
+    // the lease file has been specified.
+    if (!lease_file.empty()) {
+        const vector<Lease4Ptr> commit_leases =
+            createLeases4(commit_count);
+
+        cout << "Benchmark for appending DHCPv4 leases without group commit"
+             << endl;
+        BenchMark<CommitBenchMark>(iteration,
+                                   CommitBenchMark(lease_file,
+                                                   commit_leases, 0));
+        cout << "Benchmark for committing each DHCPv4 lease to the disk"
+             << endl;
+        BenchMark<CommitBenchMark>(iteration,
+                                   CommitBenchMark(lease_file,
+                                                   commit_leases, 1));
+        cout << "Benchmark for committing DHCPv4 leases in groups of "
+             << batch_size << endl;
+        BenchMark<CommitBenchMark>(iteration,
+                                   CommitBenchMark(lease_file,
+                                                   commit_leases,
+                                                   batch_size));
+        static_cast<void>(remove(lease_file.c_str()));
+    }
+
+    return (0);
+}
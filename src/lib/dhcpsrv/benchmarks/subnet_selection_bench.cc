@@ -0,0 +1,232 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <asiolink/io_address.h>
+#include <dhcp/classify.h>
+#include <dhcpsrv/cfgmgr.h>
+#include <log/logger_support.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::asiolink;
+using namespace bundy::bench;
+using namespace bundy::dhcp;
+
+namespace {
+
+// Creates the given number of /24 subnets, 10.0.0.0/24, 10.0.1.0/24 etc.
+// The subnets are relayed, and the relay address is the first address
+// of the subnet, as it would be for the relay agent using its address
+// on the link as giaddr.
+vector<Subnet4Ptr>
+createSubnets4(const size_t count) {
+    vector<Subnet4Ptr> subnets;
+    subnets.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t prefix = 0x0a000000 + (static_cast<uint32_t>(i) << 8);
+        subnets.push_back(Subnet4Ptr(new Subnet4(IOAddress(prefix), 24,
+                                                 1000, 2000, 3000)));
+    }
+    return (subnets);
+}
+
+// Creates the given number of /64 subnets, 2001:db8:0:0::/64,
+// 2001:db8:0:1::/64 etc.
+vector<Subnet6Ptr>
+createSubnets6(const size_t count) {
+    vector<Subnet6Ptr> subnets;
+    subnets.reserve(count);
+    vector<uint8_t> prefix = IOAddress("2001:db8::").toBytes();
+    for (size_t i = 0; i < count; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            prefix[7 - j] = static_cast<uint8_t>((i >> (8 * j)) & 0xff);
+        }
+        subnets.push_back(Subnet6Ptr(new Subnet6(
+            IOAddress::fromBytes(AF_INET6, &prefix[0]), 64,
+            1000, 2000, 3000, 4000)));
+    }
+    return (subnets);
+}
+
+// Returns an address within each of the subnets (giaddr or link address),
+// in random order.
+template <typename SubnetPtr>
+vector<IOAddress>
+createHints(const vector<SubnetPtr>& subnets) {
+    vector<IOAddress> hints;
+    hints.reserve(subnets.size());
+    for (size_t i = 0; i < subnets.size(); ++i) {
+        vector<uint8_t> addr = subnets[i]->get().first.toBytes();
+        addr.back() = 1;
+        hints.push_back(IOAddress::fromBytes(addr.size() == 4 ? AF_INET :
+                                             AF_INET6, &addr[0]));
+    }
+    random_shuffle(hints.begin(), hints.end());
+    return (hints);
+}
+
+// Measures the time it takes to select the subnet for each of the hints
+// by the configuration manager.
+class SelectBenchMark4 {
+public:
+    SelectBenchMark4(const vector<IOAddress>& hints) :
+        hints_(hints)
+    {}
+    unsigned int run() {
+        const ClientClasses classes;
+        CfgMgr& cfg_mgr = CfgMgr::instance();
+        for (size_t i = 0; i < hints_.size(); ++i) {
+            const bool found = cfg_mgr.getSubnet4(hints_[i], classes, true) !=
+                Subnet4Ptr();
+            assert(found);
+        }
+        return (hints_.size());
+    }
+private:
+    const vector<IOAddress>& hints_;
+};
+
+// Same as SelectBenchMark4, for the IPv6 subnets.
+class SelectBenchMark6 {
+public:
+    SelectBenchMark6(const vector<IOAddress>& hints) :
+        hints_(hints)
+    {}
+    unsigned int run() {
+        const ClientClasses classes;
+        CfgMgr& cfg_mgr = CfgMgr::instance();
+        for (size_t i = 0; i < hints_.size(); ++i) {
+            const bool found = cfg_mgr.getSubnet6(hints_[i], classes, true) !=
+                Subnet6Ptr();
+            assert(found);
+        }
+        return (hints_.size());
+    }
+private:
+    const vector<IOAddress>& hints_;
+};
+
+// Measures the time it takes to select the subnet for each of the hints
+// by checking each of the subnets in turn, as the configuration manager
+// did before the subnets were indexed. This is the baseline for the
+// SelectBenchMark4.
+class LinearBenchMark4 {
+public:
+    LinearBenchMark4(const vector<Subnet4Ptr>& subnets,
+                     const vector<IOAddress>& hints) :
+        subnets_(subnets), hints_(hints)
+    {}
+    unsigned int run() {
+        const ClientClasses classes;
+        for (size_t i = 0; i < hints_.size(); ++i) {
+            bool found = false;
+            for (size_t j = 0; j < subnets_.size() && !found; ++j) {
+                if (!subnets_[j]->clientSupported(classes)) {
+                    continue;
+                }
+                found = (subnets_[j]->getRelayInfo().addr_ == hints_[i]) ||
+                    subnets_[j]->inRange(hints_[i]);
+            }
+            assert(found);
+        }
+        return (hints_.size());
+    }
+private:
+    const vector<Subnet4Ptr>& subnets_;
+    const vector<IOAddress>& hints_;
+};
+
+void
+usage() {
+    cerr << "Usage: subnet_selection_bench [-n iterations] [-s subnets] "
+         << "[-l]" << endl;
+    cerr << "  -l: also measure the selection by checking each subnet"
+         << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 1;
+    size_t subnet_count = 10000;
+    bool linear = false;
+    while ((ch = getopt(argc, argv, "n:s:l")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case 's':
+            subnet_count = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            linear = true;
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0 || iteration <= 0 || subnet_count == 0 ||
+        subnet_count > 65536) {
+        usage();
+    }
+
+    // Disable logging to avoid unwanted noise.
+    bundy::log::initLogger("subnet-selection-bench", bundy::log::NONE,
+                           bundy::log::MAX_DEBUG_LEVEL, NULL);
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+    cout << "  Subnets: " << subnet_count << endl;
+
+    CfgMgr& cfg_mgr = CfgMgr::instance();
+    const vector<Subnet4Ptr> subnets4 = createSubnets4(subnet_count);
+    const vector<Subnet6Ptr> subnets6 = createSubnets6(subnet_count);
+    for (size_t i = 0; i < subnet_count; ++i) {
+        cfg_mgr.addSubnet4(subnets4[i]);
+        cfg_mgr.addSubnet6(subnets6[i]);
+    }
+    const vector<IOAddress> hints4 = createHints(subnets4);
+    const vector<IOAddress> hints6 = createHints(subnets6);
+
+    cout << "Benchmark for selecting IPv4 subnets" << endl;
+    BenchMark<SelectBenchMark4>(iteration, SelectBenchMark4(hints4));
+
+    cout << "Benchmark for selecting IPv6 subnets" << endl;
+    BenchMark<SelectBenchMark6>(iteration, SelectBenchMark6(hints6));
+
+    if (linear) {
+        cout << "Benchmark for selecting IPv4 subnets by checking each subnet"
+             << endl;
+        BenchMark<LinearBenchMark4>(iteration,
+                                    LinearBenchMark4(subnets4, hints4));
+    }
+
+    cfg_mgr.deleteSubnets4();
+    cfg_mgr.deleteSubnets6();
+
+    return (0);
+}
@@ -157,29 +157,22 @@ CfgMgr::getSubnet6(const bundy::asiolink::IOAddress& hint,
                    const bundy::dhcp::ClientClasses& classes,
                    const bool relay) {
 
-    // If there is more than one, we need to choose the proper one
-    for (Subnet6Collection::iterator subnet = subnets6_.begin();
-         subnet != subnets6_.end(); ++subnet) {
-
-        // If client is rejected because of not meeting client class criteria...
-        if (!(*subnet)->clientSupported(classes)) {
-            continue;
-        }
-
-        // If the hint is a relay address, and there is relay info specified
-        // for this subnet and those two match, then use this subnet.
-        if (relay && ((*subnet)->getRelayInfo().addr_ == hint) ) {
-            LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
-                      DHCPSRV_CFGMGR_SUBNET6_RELAY)
-                .arg((*subnet)->toText()).arg(hint.toText());
-            return (*subnet);
-        }
-
-        if ((*subnet)->inRange(hint)) {
-            LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_SUBNET6)
-                      .arg((*subnet)->toText()).arg(hint.toText());
-            return (*subnet);
-        }
+    // If there is more than one, the index selects the one which has been
+    // configured first and supports the client classes. If the hint is a
+    // relay address, and there is relay info specified for this subnet and
+    // those two match, then this subnet may be selected as well.
+    bool relay_match = false;
+    Subnet6Ptr subnet = subnet_index6_.find(hint, classes, relay, relay_match);
+    if (subnet && relay_match) {
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
+                  DHCPSRV_CFGMGR_SUBNET6_RELAY)
+            .arg(subnet->toText()).arg(hint.toText());
+        return (subnet);
+
+    } else if (subnet) {
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_SUBNET6)
+                  .arg(subnet->toText()).arg(hint.toText());
+        return (subnet);
     }
 
     // sorry, we don't support that subnet
@@ -226,38 +219,28 @@ void CfgMgr::addSubnet6(const Subnet6Ptr& subnet) {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_ADD_SUBNET6)
               .arg(subnet->toText());
     subnets6_.push_back(subnet);
+    subnet_index6_.add(subnet);
 }
 
 Subnet4Ptr
 CfgMgr::getSubnet4(const bundy::asiolink::IOAddress& hint,
                    const bundy::dhcp::ClientClasses& classes,
                    bool relay) const {
-    // Iterate over existing subnets to find a suitable one for the
-    // given address.
-    for (Subnet4Collection::const_iterator subnet = subnets4_.begin();
-         subnet != subnets4_.end(); ++subnet) {
-
-        // If client is rejected because of not meeting client class criteria...
-        if (!(*subnet)->clientSupported(classes)) {
-            continue;
-        }
-
-        // If the hint is a relay address, and there is relay info specified
-        // for this subnet and those two match, then use this subnet.
-        if (relay && ((*subnet)->getRelayInfo().addr_ == hint) ) {
-            LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
-                      DHCPSRV_CFGMGR_SUBNET4_RELAY)
-                .arg((*subnet)->toText()).arg(hint.toText());
-            return (*subnet);
-        }
-
-        // Let's check if the client belongs to the given subnet
-        if ((*subnet)->inRange(hint)) {
-            LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
-                      DHCPSRV_CFGMGR_SUBNET4)
-                      .arg((*subnet)->toText()).arg(hint.toText());
-            return (*subnet);
-        }
+    // Use the index to find a suitable subnet for the given address. As
+    // for IPv6, the subnet configured first wins.
+    bool relay_match = false;
+    Subnet4Ptr subnet = subnet_index4_.find(hint, classes, relay, relay_match);
+    if (subnet && relay_match) {
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
+                  DHCPSRV_CFGMGR_SUBNET4_RELAY)
+            .arg(subnet->toText()).arg(hint.toText());
+        return (subnet);
+
+    } else if (subnet) {
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE,
+                  DHCPSRV_CFGMGR_SUBNET4)
+                  .arg(subnet->toText()).arg(hint.toText());
+        return (subnet);
     }
 
     // sorry, we don't support that subnet
@@ -293,6 +276,7 @@ void CfgMgr::addSubnet4(const Subnet4Ptr& subnet) {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_ADD_SUBNET4)
               .arg(subnet->toText());
     subnets4_.push_back(subnet);
+    subnet_index4_.add(subnet);
 }
 
 void CfgMgr::deleteOptionDefs() {
@@ -302,11 +286,13 @@ void CfgMgr::deleteOptionDefs() {
 void CfgMgr::deleteSubnets4() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_DELETE_SUBNET4);
     subnets4_.clear();
+    subnet_index4_.clear();
 }
 
 void CfgMgr::deleteSubnets6() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE, DHCPSRV_CFGMGR_DELETE_SUBNET6);
     subnets6_.clear();
+    subnet_index6_.clear();
 }
 
 
@@ -24,6 +24,7 @@
 #include <dhcpsrv/option_space_container.h>
 #include <dhcpsrv/pool.h>
 #include <dhcpsrv/subnet.h>
+#include <dhcpsrv/subnet_index.h>
 #include <util/buffer.h>
 
 #include <boost/shared_ptr.hpp>
@@ -435,20 +436,28 @@ protected:
 
     /// @brief a container for IPv6 subnets.
     ///
-    /// That is a simple vector of pointers. It does not make much sense to
-    /// optimize access time (e.g. using a map), because typical search
-    /// pattern will use calling inRange() method on each subnet until
-    /// a match is found.
+    /// That is a simple vector of pointers, in the order in which the
+    /// subnets have been configured. The subnets are selected by address
+    /// using @c CfgMgr::subnet_index6_.
     Subnet6Collection subnets6_;
 
     /// @brief a container for IPv4 subnets.
     ///
-    /// That is a simple vector of pointers. It does not make much sense to
-    /// optimize access time (e.g. using a map), because typical search
-    /// pattern will use calling inRange() method on each subnet until
-    /// a match is found.
+    /// That is a simple vector of pointers, in the order in which the
+    /// subnets have been configured. The subnets are selected by address
+    /// using @c CfgMgr::subnet_index4_.
     Subnet4Collection subnets4_;
 
+    /// @brief Index of the IPv6 subnets by prefix and relay address.
+    ///
+    /// It is updated together with @c CfgMgr::subnets6_.
+    SubnetIndex<Subnet6Ptr> subnet_index6_;
+
+    /// @brief Index of the IPv4 subnets by prefix and relay address.
+    ///
+    /// It is updated together with @c CfgMgr::subnets4_.
+    SubnetIndex<Subnet4Ptr> subnet_index4_;
+
 private:
 
     /// @brief Checks if the specified interface is listed as active.
@@ -26,7 +26,7 @@ CSVLeaseFile4::CSVLeaseFile4(const std::string& filename)
 }
 
 void
-CSVLeaseFile4::append(const Lease4& lease) const {
+CSVLeaseFile4::append(const Lease4& lease, const bool flush) const {
     CSVRow row(getColumnCount());
     row.writeAt(getColumnIndex("address"), lease.addr_.toText());
     HWAddr hwaddr(lease.hwaddr_, HTYPE_ETHER);
@@ -41,7 +41,7 @@ CSVLeaseFile4::append(const Lease4& lease) const {
     row.writeAt(getColumnIndex("fqdn_fwd"), lease.fqdn_fwd_);
     row.writeAt(getColumnIndex("fqdn_rev"), lease.fqdn_rev_);
     row.writeAt(getColumnIndex("hostname"), lease.hostname_);
-    CSVFile::append(row);
+    CSVFile::append(row, flush);
 }
 
 bool
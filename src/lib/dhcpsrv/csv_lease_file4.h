@@ -56,7 +56,11 @@ public:
     /// error.
     ///
     /// @param lease Structure representing a DHCPv4 lease.
-    void append(const Lease4& lease) const;
+    /// @param flush Indicates whether the file should be flushed after the
+    /// lease record has been written. The caller which doesn't flush the
+    /// file is responsible for calling @c CSVFile::flush or
+    /// @c CSVFile::sync afterwards.
+    void append(const Lease4& lease, const bool flush = true) const;
 
     /// @brief Reads next lease from the CSV file.
     ///
@@ -79,7 +79,6 @@ public:
     /// @param ncr_protocol Socket protocol to use with bundy-dhcp-ddns
     /// Currently only UDP is supported.
     /// @param ncr_format Format of the bundy-dhcp-ddns requests.
-    /// Currently only JSON format is supported.
     /// @param always_include_fqdn Enables always including the FQDN option in
     /// DHCP responses.
     /// @param override_no_update Enables updates, even if clients request no
@@ -91,7 +90,7 @@ public:
     /// @param generated_prefix Prefix to use when generating domain-names.
     /// @param  qualifying_suffix Suffix to use to qualify partial domain-names.
     ///
-    /// @throw D2ClientError if given an invalid protocol or format.
+    /// @throw D2ClientError if given an invalid protocol.
     D2ClientConfig(const bool enable_updates,
                    const bundy::asiolink::IOAddress& server_ip,
                    const size_t server_port,
@@ -189,7 +188,7 @@ protected:
     ///
     /// Method is used by the constructor to validate member contents.
     ///
-    /// @throw D2ClientError if given an invalid protocol or format.
+    /// @throw D2ClientError if given an invalid protocol.
     virtual void validateContents();
 
 private:
@@ -207,7 +206,6 @@ private:
     dhcp_ddns::NameChangeProtocol ncr_protocol_;
 
     /// @brief Format of the bundy-dhcp-ddns requests.
-    /// Currently only JSON format is supported.
     dhcp_ddns::NameChangeFormat ncr_format_;
 
     /// @brief Should Kea always include the FQDN option in its response.
@@ -76,13 +76,22 @@ D2ClientMgr::setD2ClientConfig(D2ClientConfigPtr& new_config) {
                 uint32_t any_port = 0;
                 uint32_t queue_max = 1024;
 
+                // The binary format came with the listeners reading several
+                // requests from a datagram, so the requests are batched
+                // with it.  JSON ones are sent one by one, for the older
+                // listeners.
+                size_t max_batch =
+                    (new_config->getNcrFormat() == dhcp_ddns::FMT_BINARY ?
+                     64 : 1);
+
                 // Instantiate a new sender.
                 new_sender.reset(new dhcp_ddns::NameChangeUDPSender(
                                                 any_addr, any_port,
                                                 new_config->getServerIp(),
                                                 new_config->getServerPort(),
                                                 new_config->getNcrFormat(),
-                                                *this, queue_max));
+                                                *this, queue_max, false,
+                                                max_batch));
                 break;
                 }
             default:
@@ -268,6 +277,7 @@ D2ClientMgr::stopSender() {
 
 void
 D2ClientMgr::sendRequest(dhcp_ddns::NameChangeRequestPtr& ncr) {
+    bundy::util::thread::Mutex::Locker lock(sender_mutex_);
     if (!amSending()) {
         // This is programmatic error so bust them for it.
         bundy_throw(D2ClientError, "D2ClientMgr::sendRequest not in send mode");
@@ -367,6 +377,7 @@ D2ClientMgr::runReadyIO() {
                   " name_change_sender is null");
     }
 
+    bundy::util::thread::Mutex::Locker lock(sender_mutex_);
     name_change_sender_->runReadyIO();
 }
 
@@ -23,6 +23,7 @@
 #include <dhcp_ddns/ncr_io.h>
 #include <dhcpsrv/d2_client_cfg.h>
 #include <exceptions/exceptions.h>
+#include <util/threads/sync.h>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
@@ -310,6 +311,9 @@ public:
     /// handler will be invoked.  The most likely cause for rejection is
     /// the senders' queue has reached maximum capacity.
     ///
+    /// The requests may be sent by several threads at once. The sender
+    /// is not used concurrently with @c D2ClientMgr::runReadyIO.
+    ///
     /// @param ncr NameChangeRequest to send
     ///
     /// @throw D2ClientError if sender instance is null or not in send
@@ -425,6 +429,10 @@ private:
 
     /// @brief Remembers the select-fd registered with IfaceMgr.
     int registered_select_fd_;
+
+    /// @brief Serializes the use of the sender by the threads sending
+    /// the requests and the thread running the IO.
+    bundy::util::thread::Mutex sender_mutex_;
 };
 
 template <class T>
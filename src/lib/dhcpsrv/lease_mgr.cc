@@ -17,6 +17,7 @@
 
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <algorithm>
 #include <iostream>
@@ -40,6 +41,22 @@ std::string LeaseMgr::getParameter(const std::string& name) const {
     return (param->second);
 }
 
+uint32_t
+LeaseMgr::getGroupCommitDelayParameter() const {
+    ParameterMap::const_iterator param = parameters_.find("group-commit-delay");
+    if (param == parameters_.end()) {
+        // The group commit is disabled by default.
+        return (0);
+    }
+
+    try {
+        return (boost::lexical_cast<uint32_t>(param->second));
+    } catch (const boost::bad_lexical_cast&) {
+        bundy_throw(bundy::BadValue, "invalid value 'group-commit-delay="
+                    << param->second << "'");
+    }
+}
+
 Lease6Ptr
 LeaseMgr::getLease6(Lease::Type type, const DUID& duid,
                     uint32_t iaid, SubnetID subnet_id) const {
@@ -57,5 +74,64 @@ LeaseMgr::getLease6(Lease::Type type, const DUID& duid,
     return (*col.begin());
 }
 
+Lease4Collection
+LeaseMgr::getLeases4(const std::vector<bundy::asiolink::IOAddress>& addrs) const {
+    Lease4Collection leases;
+    for (std::vector<bundy::asiolink::IOAddress>::const_iterator addr =
+             addrs.begin(); addr != addrs.end(); ++addr) {
+        Lease4Ptr lease = getLease4(*addr);
+        if (lease) {
+            leases.push_back(lease);
+        }
+    }
+    return (leases);
+}
+
+Lease6Collection
+LeaseMgr::getLeases6(Lease::Type type,
+                     const std::vector<bundy::asiolink::IOAddress>& addrs) const {
+    Lease6Collection leases;
+    for (std::vector<bundy::asiolink::IOAddress>::const_iterator addr =
+             addrs.begin(); addr != addrs.end(); ++addr) {
+        Lease6Ptr lease = getLease6(type, *addr);
+        if (lease) {
+            leases.push_back(lease);
+        }
+    }
+    return (leases);
+}
+
+void
+LeaseMgr::upsertLeases4(const Lease4Collection& leases) {
+    for (Lease4Collection::const_iterator lease = leases.begin();
+         lease != leases.end(); ++lease) {
+        if (!addLease(*lease)) {
+            updateLease4(*lease);
+        }
+    }
+}
+
+void
+LeaseMgr::upsertLeases6(const Lease6Collection& leases) {
+    for (Lease6Collection::const_iterator lease = leases.begin();
+         lease != leases.end(); ++lease) {
+        if (!addLease(*lease)) {
+            updateLease6(*lease);
+        }
+    }
+}
+
+Lease4Collection
+LeaseMgr::getExpiredLeases4(SubnetID, size_t) const {
+    bundy_throw(NotImplemented, "retrieving expired IPv4 leases is not"
+                " supported by the " << getType() << " backend");
+}
+
+Lease6Collection
+LeaseMgr::getExpiredLeases6(Lease::Type, SubnetID, size_t) const {
+    bundy_throw(NotImplemented, "retrieving expired IPv6 leases is not"
+                " supported by the " << getType() << " backend");
+}
+
 } // namespace bundy::dhcp
 } // namespace bundy
@@ -318,6 +318,81 @@ public:
     /// @return true if deletion was successful, false if no such lease exists
     virtual bool deleteLease(const bundy::asiolink::IOAddress& addr) = 0;
 
+    /// @brief Returns IPv4 leases for the specified addresses.
+    ///
+    /// This is the bulk form of @c LeaseMgr::getLease4(addr). The database
+    /// backends retrieve the leases with as few queries as possible, so it
+    /// should be used when many addresses are looked up at once. The
+    /// default implementation looks up the addresses one by one.
+    ///
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found, in no particular order (may
+    ///         be empty if no lease is found)
+    virtual Lease4Collection
+    getLeases4(const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Returns IPv6 leases of the specified type for the specified
+    /// addresses.
+    ///
+    /// This is the bulk form of @c LeaseMgr::getLease6(type, addr). The
+    /// default implementation looks up the addresses one by one.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found, in no particular order (may
+    ///         be empty if no lease is found)
+    virtual Lease6Collection
+    getLeases6(Lease::Type type,
+               const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Adds or updates IPv4 leases.
+    ///
+    /// Each lease is added if there is no lease for its address, otherwise
+    /// the existing lease is replaced. The database backends store the
+    /// leases with as few statements as possible. The default
+    /// implementation adds or updates the leases one by one.
+    ///
+    /// @param leases leases to be stored. Each address must appear only
+    ///        once.
+    virtual void upsertLeases4(const Lease4Collection& leases);
+
+    /// @brief Adds or updates IPv6 leases.
+    ///
+    /// @param leases leases to be stored. Each address must appear only
+    ///        once.
+    virtual void upsertLeases6(const Lease6Collection& leases);
+
+    /// @brief Returns IPv4 leases which have expired in a subnet.
+    ///
+    /// The leases which have expired longest ago are returned first.
+    ///
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases (may be empty if none has
+    ///         expired)
+    /// @throw bundy::NotImplemented if the backend doesn't support it.
+    virtual Lease4Collection getExpiredLeases4(SubnetID subnet_id,
+                                               size_t max_leases) const;
+
+    /// @brief Returns IPv6 leases of the specified type which have expired
+    /// in a subnet.
+    ///
+    /// The leases which have expired longest ago are returned first.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases (may be empty if none has
+    ///         expired)
+    /// @throw bundy::NotImplemented if the backend doesn't support it.
+    virtual Lease6Collection getExpiredLeases6(Lease::Type type,
+                                               SubnetID subnet_id,
+                                               size_t max_leases) const;
+
     /// @brief Return backend type
     ///
     /// Returns the type of the backend (e.g. "mysql", "memfile" etc.)
@@ -368,6 +443,31 @@ public:
     /// support transactions, this is a no-op.
     virtual void rollback() = 0;
 
+    /// @brief Returns the maximum time by which commits may be delayed.
+    ///
+    /// Backends which coalesce the updates from many packets and commit
+    /// them to the persistent storage at once (group commit) return the
+    /// maximum time for which the server may hold the responses to the
+    /// clients before calling @c LeaseMgr::commit. The responses must not
+    /// be sent before the leases they carry have been committed. Backends
+    /// committing each update individually return 0.
+    ///
+    /// @return Maximum commit delay in milliseconds.
+    virtual uint32_t getMaxCommitDelay() const {
+        return (0);
+    }
+
+    /// @brief Checks if the backend may be used by many threads at once.
+    ///
+    /// The servers process the packets in several threads only if the
+    /// backend serializes the access to the lease database itself.
+    ///
+    /// @return true if the methods of the backend may be called
+    /// concurrently, false otherwise.
+    virtual bool isThreadSafe() const {
+        return (false);
+    }
+
     /// @todo: Add host management here
     /// As host reservation is outside of scope for 2012, support for hosts
     /// is currently postponed.
@@ -375,6 +475,15 @@ public:
     /// @brief returns value of the parameter
     virtual std::string getParameter(const std::string& name) const;
 
+protected:
+    /// @brief Returns the value of the "group-commit-delay" parameter.
+    ///
+    /// @return Maximum commit delay in milliseconds or 0 if the parameter
+    /// has not been specified, i.e. the group commit is disabled.
+    ///
+    /// @throw bundy::BadValue if the parameter is not a number.
+    uint32_t getGroupCommitDelayParameter() const;
+
 private:
     /// @brief list of parameters passed in dbconfig
     ///
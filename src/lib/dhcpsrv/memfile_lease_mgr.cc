@@ -16,13 +16,221 @@
 #include <dhcpsrv/dhcpsrv_log.h>
 #include <dhcpsrv/memfile_lease_mgr.h>
 #include <exceptions/exceptions.h>
-
+#include <util/threads/sync.h>
+#include <util/threads/thread.h>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace bundy::dhcp;
+using namespace bundy::util::thread;
+
+namespace {
+
+/// @brief Writes the snapshot of the leases to a new lease file.
+///
+/// This function is run by the compaction thread, so it must not access
+/// anything else than its arguments.
+///
+/// @param filename Name of the new lease file.
+/// @param leases Leases to be written.
+/// @tparam LeaseFileType Type of the lease file: CSVLeaseFile4 or
+/// CSVLeaseFile6.
+/// @tparam LeaseType Type of the lease: Lease4 or Lease6.
+template<typename LeaseFileType, typename LeaseType>
+void
+writeSnapshot(const std::string& filename,
+              const boost::shared_ptr<std::vector<LeaseType> >& leases) {
+    LeaseFileType lease_file(filename);
+    lease_file.recreate();
+    for (typename std::vector<LeaseType>::const_iterator lease =
+             leases->begin(); lease != leases->end(); ++lease) {
+        lease_file.append(*lease, false);
+    }
+    lease_file.sync();
+    lease_file.close();
+}
+
+}
+
+namespace bundy {
+namespace dhcp {
+
+/// @brief Compaction of the lease file.
+///
+/// The snapshot of the leases is written to a temporary file by a separate
+/// thread, created by the constructor. The lease manager finishes the
+/// compaction in its own thread by calling @c finish, which appends the
+/// records written to the lease file since the snapshot was taken to the
+/// temporary file and renames the temporary file over the lease file.
+class LeaseFileCompaction : public boost::noncopyable {
+public:
+
+    /// @brief Function writing the snapshot to the file of the given name.
+    typedef boost::function<void(const std::string&)> Writer;
+
+    /// @brief Constructor.
+    ///
+    /// @param lease_file Name of the lease file.
+    /// @param offset Size of the lease file when the snapshot was taken.
+    /// @param lease_count Number of leases in the snapshot.
+    /// @param writer Function writing the snapshot, run by the thread.
+    LeaseFileCompaction(const std::string& lease_file,
+                        const std::streampos& offset,
+                        const size_t lease_count, const Writer& writer)
+        : lease_file_(lease_file), output_file_(lease_file + ".compact"),
+          offset_(offset), lease_count_(lease_count), writer_(writer),
+          done_(false), error_() {
+        // Start the thread when all members it uses are initialized.
+        thread_.reset(new Thread(boost::bind(&LeaseFileCompaction::run,
+                                             this)));
+    }
+
+    /// @brief Destructor.
+    ///
+    /// Waits for the thread and removes the temporary file if the
+    /// compaction hasn't been finished.
+    ~LeaseFileCompaction() {
+        if (thread_) {
+            try {
+                thread_->wait();
+            } catch (...) {
+                // Nothing to do, the snapshot is discarded anyway.
+            }
+        }
+        static_cast<void>(std::remove(output_file_.c_str()));
+    }
+
+    /// @brief Checks if the snapshot has been written.
+    bool done() {
+        Mutex::Locker lock(mutex_);
+        return (done_);
+    }
+
+    /// @brief Replaces the lease file with the snapshot.
+    ///
+    /// The caller must make sure that all records appended to the lease
+    /// file have been flushed.
+    ///
+    /// @throw DbOperationError if writing the snapshot or replacing the
+    /// lease file failed.
+    void finish() {
+        thread_->wait();
+        thread_.reset();
+        if (!error_.empty()) {
+            bundy_throw(DbOperationError, "failed to write the snapshot of"
+                      " the leases to '" << output_file_ << "': " << error_);
+        }
+
+        // Copy the records appended while the snapshot was being written.
+        std::ifstream in(lease_file_.c_str(), std::ios::binary);
+        std::ofstream out(output_file_.c_str(),
+                          std::ios::binary | std::ios::app);
+        if (!in.is_open() || !out.is_open()) {
+            bundy_throw(DbOperationError, "failed to open the lease files to"
+                      " copy the records appended since the compaction of '"
+                      << lease_file_ << "' started");
+        }
+        in.seekg(offset_);
+        std::vector<char> buf(65536);
+        while (in.read(&buf[0], buf.size()) || in.gcount() > 0) {
+            out.write(&buf[0], in.gcount());
+        }
+        out.flush();
+        if (in.bad() || !out.good()) {
+            bundy_throw(DbOperationError, "failed to copy the records appended"
+                      " since the compaction of '" << lease_file_
+                      << "' started");
+        }
+        out.close();
+
+        // The new file must be on the disk before it replaces the old one.
+        int fd = ::open(output_file_.c_str(), O_WRONLY);
+        if ((fd < 0) || (::fsync(fd) != 0)) {
+            const int sync_errno = errno;
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            bundy_throw(DbOperationError, "failed to synchronize the file '"
+                      << output_file_ << "' to the disk: "
+                      << strerror(sync_errno));
+        }
+        ::close(fd);
+
+        if (::rename(output_file_.c_str(), lease_file_.c_str()) != 0) {
+            bundy_throw(DbOperationError, "failed to rename '" << output_file_
+                      << "' to '" << lease_file_ << "': " << strerror(errno));
+        }
+    }
+
+    /// @brief Returns the number of leases in the snapshot.
+    size_t getLeaseCount() const {
+        return (lease_count_);
+    }
+
+private:
+
+    /// @brief Body of the thread writing the snapshot.
+    void run() {
+        try {
+            writer_(output_file_);
+        } catch (const std::exception& ex) {
+            // The error is only read after the thread is joined.
+            error_ = ex.what();
+        }
+        Mutex::Locker lock(mutex_);
+        done_ = true;
+    }
+
+    /// @brief Name of the lease file.
+    std::string lease_file_;
+
+    /// @brief Name of the temporary file holding the snapshot.
+    std::string output_file_;
+
+    /// @brief Size of the lease file when the snapshot was taken.
+    std::streampos offset_;
+
+    /// @brief Number of leases in the snapshot.
+    size_t lease_count_;
+
+    /// @brief Function writing the snapshot.
+    Writer writer_;
+
+    /// @brief Protects the done_ flag.
+    Mutex mutex_;
+
+    /// @brief Indicates if the thread has finished.
+    bool done_;
+
+    /// @brief Error which occurred while writing the snapshot.
+    std::string error_;
+
+    /// @brief Thread writing the snapshot.
+    boost::scoped_ptr<Thread> thread_;
+};
+
+} // end of bundy::dhcp namespace
+} // end of bundy namespace
 
 Memfile_LeaseMgr::Memfile_LeaseMgr(const ParameterMap& parameters)
-    : LeaseMgr(parameters) {
+    : LeaseMgr(parameters), group_commit_delay_(0), pending_commits_(0),
+      batch_start_(), lfc_interval_(0),
+      lfc_start_(boost::posix_time::second_clock::universal_time()) {
     // Check the universe and use v4 file or v6 file.
     std::string universe = getParameter("universe");
     if (universe == "4") {
@@ -47,10 +255,28 @@ Memfile_LeaseMgr::Memfile_LeaseMgr(const ParameterMap& parameters)
     // operation.
     if (!persistLeases(V4) && !persistLeases(V6)) {
         LOG_WARN(dhcpsrv_logger, DHCPSRV_MEMFILE_NO_STORAGE);
+    } else {
+        initGroupCommitDelay();
+        initLfcInterval();
     }
 }
 
 Memfile_LeaseMgr::~Memfile_LeaseMgr() {
+    // Make sure that the records not committed by the server get to the
+    // disk. The destructor must not throw, so the error is only logged.
+    try {
+        commit();
+    } catch (const std::exception& ex) {
+        LOG_ERROR(dhcpsrv_logger, DHCPSRV_MEMFILE_GROUP_COMMIT_FAILED)
+            .arg(ex.what());
+    }
+    // Replace the lease file with the snapshot being written, so as the
+    // leases are loaded faster when the server starts again.
+    try {
+        finishLeaseFileCompaction(true);
+    } catch (const std::exception& ex) {
+        LOG_ERROR(dhcpsrv_logger, DHCPSRV_MEMFILE_LFC_FAILED).arg(ex.what());
+    }
     if (lease_file4_) {
         lease_file4_->close();
         lease_file4_.reset();
@@ -63,48 +289,69 @@ Memfile_LeaseMgr::~Memfile_LeaseMgr() {
 
 bool
 Memfile_LeaseMgr::addLease(const Lease4Ptr& lease) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_ADD_ADDR4).arg(lease->addr_.toText());
 
-    if (getLease4(lease->addr_)) {
+    if (storage4_.find(lease->addr_) != storage4_.end()) {
         // there is a lease with specified address already
         return (false);
     }
 
+    // As in updateLease4(), the lease must not take the hardware address and subnet of
+    // another lease.
+    Lease4Ptr other = getConflictingLease(*lease);
+    if (other) {
+        bundy_throw(DbOperationError, "failed to add the lease with address "
+                  << lease->addr_ << " - the lease with address "
+                  << other->addr_ << " has the same hardware address and subnet");
+    }
+
     // Try to write a lease to disk first. If this fails, the lease will
     // not be inserted to the memory and the disk and in-memory data will
     // remain consistent.
     if (persistLeases(V4)) {
-        lease_file4_->append(*lease);
+        appendLease(*lease);
     }
 
-    storage4_.insert(lease);
+    storage4_.insert(*lease);
     return (true);
 }
 
 bool
 Memfile_LeaseMgr::addLease(const Lease6Ptr& lease) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_ADD_ADDR6).arg(lease->addr_.toText());
 
-    if (getLease6(lease->type_, lease->addr_)) {
+    if (storage6_.find(lease->addr_) != storage6_.end()) {
         // there is a lease with specified address already
         return (false);
     }
 
+    // As in updateLease6(), the lease must not take the DUID, IAID and subnet of
+    // another lease.
+    Lease6Ptr other = getConflictingLease(*lease);
+    if (other) {
+        bundy_throw(DbOperationError, "failed to add the lease with address "
+                  << lease->addr_ << " - the lease with address "
+                  << other->addr_ << " has the same DUID, IAID and subnet");
+    }
+
     // Try to write a lease to disk first. If this fails, the lease will
     // not be inserted to the memory and the disk and in-memory data will
     // remain consistent.
     if (persistLeases(V6)) {
-        lease_file6_->append(*lease);
+        appendLease(*lease);
     }
 
-    storage6_.insert(lease);
+    storage6_.insert(*lease);
     return (true);
 }
 
 Lease4Ptr
 Memfile_LeaseMgr::getLease4(const bundy::asiolink::IOAddress& addr) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_ADDR4).arg(addr.toText());
 
@@ -114,12 +361,13 @@ Memfile_LeaseMgr::getLease4(const bundy::asiolink::IOAddress& addr) const {
     if (l == storage4_.end()) {
         return (Lease4Ptr());
     } else {
-        return (Lease4Ptr(new Lease4(**l)));
+        return (Lease4Ptr(new Lease4(*l)));
     }
 }
 
 Lease4Collection
 Memfile_LeaseMgr::getLease4(const HWAddr& hwaddr) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_HWADDR).arg(hwaddr.toText());
     typedef Lease4Storage::nth_index<0>::type SearchIndex;
@@ -129,8 +377,8 @@ Memfile_LeaseMgr::getLease4(const HWAddr& hwaddr) const {
         lease != idx.end(); ++lease) {
 
         // Every Lease4 has a hardware address, so we can compare it
-        if ((*lease)->hwaddr_ == hwaddr.hwaddr_) {
-            collection.push_back((*lease));
+        if (lease->hwaddr_ == hwaddr.hwaddr_) {
+            collection.push_back(Lease4Ptr(new Lease4(*lease)));
         }
     }
 
@@ -139,6 +387,7 @@ Memfile_LeaseMgr::getLease4(const HWAddr& hwaddr) const {
 
 Lease4Ptr
 Memfile_LeaseMgr::getLease4(const HWAddr& hwaddr, SubnetID subnet_id) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_SUBID_HWADDR).arg(subnet_id)
         .arg(hwaddr.toText());
@@ -158,11 +407,12 @@ Memfile_LeaseMgr::getLease4(const HWAddr& hwaddr, SubnetID subnet_id) const {
     }
 
     // Lease was found. Return it to the caller.
-    return (Lease4Ptr(new Lease4(**lease)));
+    return (Lease4Ptr(new Lease4(*lease)));
 }
 
 Lease4Collection
 Memfile_LeaseMgr::getLease4(const ClientId& client_id) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_CLIENTID).arg(client_id.toText());
     typedef Memfile_LeaseMgr::Lease4Storage::nth_index<0>::type SearchIndex;
@@ -173,8 +423,8 @@ Memfile_LeaseMgr::getLease4(const ClientId& client_id) const {
 
         // client-id is not mandatory in DHCPv4. There can be a lease that does
         // not have a client-id. Dereferencing null pointer would be a bad thing
-        if((*lease)->client_id_ && *(*lease)->client_id_ == client_id) {
-            collection.push_back((*lease));
+        if(lease->client_id_ && *lease->client_id_ == client_id) {
+            collection.push_back(Lease4Ptr(new Lease4(*lease)));
         }
     }
 
@@ -185,6 +435,7 @@ Lease4Ptr
 Memfile_LeaseMgr::getLease4(const ClientId& client_id,
                             const HWAddr& hwaddr,
                             SubnetID subnet_id) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_CLIENTID_HWADDR_SUBID).arg(client_id.toText())
                                                         .arg(hwaddr.toText())
@@ -207,12 +458,13 @@ Memfile_LeaseMgr::getLease4(const ClientId& client_id,
     }
 
     // Lease was found. Return it to the caller.
-    return (*lease);
+    return (Lease4Ptr(new Lease4(*lease)));
 }
 
 Lease4Ptr
 Memfile_LeaseMgr::getLease4(const ClientId& client_id,
                             SubnetID subnet_id) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_SUBID_CLIENTID).arg(subnet_id)
               .arg(client_id.toText());
@@ -231,12 +483,13 @@ Memfile_LeaseMgr::getLease4(const ClientId& client_id,
         return (Lease4Ptr());
     }
     // Lease was found. Return it to the caller.
-    return (Lease4Ptr(new Lease4(**lease)));
+    return (Lease4Ptr(new Lease4(*lease)));
 }
 
 Lease6Ptr
 Memfile_LeaseMgr::getLease6(Lease::Type /* not used yet */,
                             const bundy::asiolink::IOAddress& addr) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_ADDR6).arg(addr.toText());
 
@@ -244,7 +497,7 @@ Memfile_LeaseMgr::getLease6(Lease::Type /* not used yet */,
     if (l == storage6_.end()) {
         return (Lease6Ptr());
     } else {
-        return (Lease6Ptr(new Lease6(**l)));
+        return (Lease6Ptr(new Lease6(*l)));
     }
 }
 
@@ -263,6 +516,7 @@ Lease6Collection
 Memfile_LeaseMgr::getLeases6(Lease::Type /* not used yet */,
                              const DUID& duid, uint32_t iaid,
                              SubnetID subnet_id) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_GET_IAID_SUBID_DUID)
               .arg(iaid).arg(subnet_id).arg(duid.toText());
@@ -284,12 +538,107 @@ Memfile_LeaseMgr::getLeases6(Lease::Type /* not used yet */,
     // Lease was found, return it to the caller.
     /// @todo: allow multiple leases for a single duid+iaid+subnet_id tuple
     Lease6Collection collection;
-    collection.push_back(Lease6Ptr(new Lease6(**lease)));
+    collection.push_back(Lease6Ptr(new Lease6(*lease)));
     return (collection);
 }
 
+namespace {
+
+/// @brief Orders the leases by their expiration time.
+///
+/// @param first first lease
+/// @param second second lease
+///
+/// @return true if the first lease expires before the second one.
+template<typename LeasePtrType>
+bool
+expiresBefore(const LeasePtrType& first, const LeasePtrType& second) {
+    return (static_cast<int64_t>(first->cltt_) + first->valid_lft_ <
+            static_cast<int64_t>(second->cltt_) + second->valid_lft_);
+}
+
+/// @brief Keeps the leases which have expired longest ago.
+///
+/// @param leases expired leases. On return, it holds at most max_leases
+///        of them.
+/// @param max_leases maximum number of leases to be kept
+template<typename LeaseCollection>
+void
+keepLongestExpired(LeaseCollection& leases, const size_t max_leases) {
+    const size_t count = std::min(leases.size(), max_leases);
+    std::partial_sort(leases.begin(), leases.begin() + count, leases.end(),
+                      expiresBefore<typename LeaseCollection::value_type>);
+    leases.resize(count);
+}
+
+}
+
+Lease4Collection
+Memfile_LeaseMgr::getExpiredLeases4(SubnetID subnet_id,
+                                    size_t max_leases) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MEMFILE_GET_EXPIRED4).arg(max_leases).arg(subnet_id);
+
+    Lease4Collection collection;
+    for (Lease4Storage::const_iterator lease = storage4_.begin();
+         lease != storage4_.end(); ++lease) {
+        if ((lease->subnet_id_ == subnet_id) && lease->expired()) {
+            collection.push_back(Lease4Ptr(new Lease4(*lease)));
+        }
+    }
+    keepLongestExpired(collection, max_leases);
+    return (collection);
+}
+
+Lease6Collection
+Memfile_LeaseMgr::getExpiredLeases6(Lease::Type type, SubnetID subnet_id,
+                                    size_t max_leases) const {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MEMFILE_GET_EXPIRED6).arg(max_leases).arg(subnet_id)
+        .arg(Lease::typeToText(type));
+
+    Lease6Collection collection;
+    for (Lease6Storage::const_iterator lease = storage6_.begin();
+         lease != storage6_.end(); ++lease) {
+        if ((lease->type_ == type) && (lease->subnet_id_ == subnet_id) &&
+            lease->expired()) {
+            collection.push_back(Lease6Ptr(new Lease6(*lease)));
+        }
+    }
+    keepLongestExpired(collection, max_leases);
+    return (collection);
+}
+
+Lease4Ptr
+Memfile_LeaseMgr::getConflictingLease(const Lease4& lease) const {
+    typedef Lease4Storage::nth_index<1>::type SearchIndex;
+    const SearchIndex& idx = storage4_.get<1>();
+    SearchIndex::const_iterator other =
+        idx.find(boost::make_tuple(lease.hwaddr_, lease.subnet_id_));
+    if (other == idx.end() || other->addr_ == lease.addr_) {
+        return (Lease4Ptr());
+    }
+    return (Lease4Ptr(new Lease4(*other)));
+}
+
+Lease6Ptr
+Memfile_LeaseMgr::getConflictingLease(const Lease6& lease) const {
+    typedef Lease6Storage::nth_index<1>::type SearchIndex;
+    const SearchIndex& idx = storage6_.get<1>();
+    SearchIndex::const_iterator other =
+        idx.find(boost::make_tuple(lease.getDuidVector(), lease.iaid_,
+                                   lease.subnet_id_));
+    if (other == idx.end() || other->addr_ == lease.addr_) {
+        return (Lease6Ptr());
+    }
+    return (Lease6Ptr(new Lease6(*other)));
+}
+
 void
 Memfile_LeaseMgr::updateLease4(const Lease4Ptr& lease) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_UPDATE_ADDR4).arg(lease->addr_.toText());
 
@@ -299,18 +648,31 @@ Memfile_LeaseMgr::updateLease4(const Lease4Ptr& lease) {
                   << lease->addr_ << " - no such lease");
     }
 
+    // The container wouldn't take the lease if it has the hardware address and subnet
+    // of another one, so this is checked before anything is written.
+    Lease4Ptr other = getConflictingLease(*lease);
+    if (other) {
+        bundy_throw(DbOperationError, "failed to update the lease with address "
+                  << lease->addr_ << " - the lease with address "
+                  << other->addr_ << " has the same hardware address and subnet");
+    }
+
     // Try to write a lease to disk first. If this fails, the lease will
     // not be inserted to the memory and the disk and in-memory data will
     // remain consistent.
     if (persistLeases(V4)) {
-        lease_file4_->append(*lease);
+        appendLease(*lease);
     }
 
-    **lease_it = *lease;
+    if (!storage4_.replace(lease_it, *lease)) {
+        bundy_throw(DbOperationError, "failed to update the lease with address "
+                  << lease->addr_);
+    }
 }
 
 void
 Memfile_LeaseMgr::updateLease6(const Lease6Ptr& lease) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_UPDATE_ADDR6).arg(lease->addr_.toText());
 
@@ -320,18 +682,31 @@ Memfile_LeaseMgr::updateLease6(const Lease6Ptr& lease) {
                   << lease->addr_ << " - no such lease");
     }
 
+    // The container wouldn't take the lease if it has the DUID, IAID and subnet
+    // of another one, so this is checked before anything is written.
+    Lease6Ptr other = getConflictingLease(*lease);
+    if (other) {
+        bundy_throw(DbOperationError, "failed to update the lease with address "
+                  << lease->addr_ << " - the lease with address "
+                  << other->addr_ << " has the same DUID, IAID and subnet");
+    }
+
     // Try to write a lease to disk first. If this fails, the lease will
     // not be inserted to the memory and the disk and in-memory data will
     // remain consistent.
     if (persistLeases(V6)) {
-        lease_file6_->append(*lease);
+        appendLease(*lease);
     }
 
-    **lease_it = *lease;
+    if (!storage6_.replace(lease_it, *lease)) {
+        bundy_throw(DbOperationError, "failed to update the lease with address "
+                  << lease->addr_);
+    }
 }
 
 bool
 Memfile_LeaseMgr::deleteLease(const bundy::asiolink::IOAddress& addr) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
               DHCPSRV_MEMFILE_DELETE_ADDR).arg(addr.toText());
     if (addr.isV4()) {
@@ -344,11 +719,11 @@ Memfile_LeaseMgr::deleteLease(const bundy::asiolink::IOAddress& addr) {
             if (persistLeases(V4)) {
                 // Copy the lease. The valid lifetime needs to be modified and
                 // we don't modify the original lease.
-                Lease4 lease_copy = **l;
+                Lease4 lease_copy = *l;
                 // Setting valid lifetime to 0 means that lease is being
                 // removed.
                 lease_copy.valid_lft_ = 0;
-                lease_file4_->append(lease_copy);
+                appendLease(lease_copy);
             }
             storage4_.erase(l);
             return (true);
@@ -364,11 +739,11 @@ Memfile_LeaseMgr::deleteLease(const bundy::asiolink::IOAddress& addr) {
             if (persistLeases(V6)) {
                 // Copy the lease. The lifetimes need to be modified and we
                 // don't modify the original lease.
-                Lease6 lease_copy = **l;
+                Lease6 lease_copy = *l;
                 // Setting lifetimes to 0 means that lease is being removed.
                 lease_copy.valid_lft_ = 0;
                 lease_copy.preferred_lft_ = 0;
-                lease_file6_->append(lease_copy);
+                appendLease(lease_copy);
             }
 
             storage6_.erase(l);
@@ -386,7 +761,30 @@ Memfile_LeaseMgr::getDescription() const {
 
 void
 Memfile_LeaseMgr::commit() {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
+    commitInternal();
+}
+
+void
+Memfile_LeaseMgr::commitInternal() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL, DHCPSRV_MEMFILE_COMMIT);
+
+    if (pending_commits_ == 0) {
+        return;
+    }
+
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MEMFILE_GROUP_COMMIT).arg(pending_commits_);
+
+    // Reset the counter first. If the commit fails, there is no point in
+    // retrying it for the same records over and over again.
+    pending_commits_ = 0;
+    if (lease_file4_) {
+        lease_file4_->sync();
+    }
+    if (lease_file6_) {
+        lease_file6_->sync();
+    }
 }
 
 void
@@ -454,6 +852,176 @@ Memfile_LeaseMgr::initLeaseFilePath(Universe u) {
     return (lease_file);
 }
 
+void
+Memfile_LeaseMgr::initGroupCommitDelay() {
+    group_commit_delay_ = getGroupCommitDelayParameter();
+}
+
+void
+Memfile_LeaseMgr::initLfcInterval() {
+    std::string interval_val;
+    try {
+        interval_val = getParameter("lfc-interval");
+    } catch (const Exception& ex) {
+        // The periodic compaction is disabled by default.
+        return;
+    }
+
+    try {
+        lfc_interval_ = boost::lexical_cast<uint32_t>(interval_val);
+    } catch (const boost::bad_lexical_cast&) {
+        bundy_throw(bundy::BadValue, "invalid value 'lfc-interval="
+                  << interval_val << "'");
+    }
+}
+
+void
+Memfile_LeaseMgr::appendLease(const Lease4& lease) {
+    if (group_commit_delay_ == 0) {
+        lease_file4_->append(lease);
+    } else {
+        lease_file4_->append(lease, false);
+        recordPendingCommit();
+    }
+    checkLeaseFileCompaction();
+}
+
+void
+Memfile_LeaseMgr::appendLease(const Lease6& lease) {
+    if (group_commit_delay_ == 0) {
+        lease_file6_->append(lease);
+    } else {
+        lease_file6_->append(lease, false);
+        recordPendingCommit();
+    }
+    checkLeaseFileCompaction();
+}
+
+void
+Memfile_LeaseMgr::recordPendingCommit() {
+    using namespace boost::posix_time;
+
+    ptime now = microsec_clock::universal_time();
+    if (pending_commits_++ == 0) {
+        batch_start_ = now;
+
+    } else if (now - batch_start_ > milliseconds(group_commit_delay_)) {
+        // The server hasn't committed within the maximum delay. Don't let
+        // the records pile up in the buffers.
+        commitInternal();
+    }
+}
+
+void
+Memfile_LeaseMgr::checkLeaseFileCompaction() {
+    using namespace boost::posix_time;
+
+    if (!compaction_ && (lfc_interval_ == 0)) {
+        return;
+    }
+
+    try {
+        if (compaction_) {
+            finishLeaseFileCompactionInternal(false);
+
+        } else if (second_clock::universal_time() - lfc_start_ >=
+                   seconds(lfc_interval_)) {
+            startLeaseFileCompactionInternal();
+        }
+    } catch (const std::exception& ex) {
+        LOG_ERROR(dhcpsrv_logger, DHCPSRV_MEMFILE_LFC_FAILED).arg(ex.what());
+    }
+}
+
+void
+Memfile_LeaseMgr::startLeaseFileCompaction() {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
+    startLeaseFileCompactionInternal();
+}
+
+void
+Memfile_LeaseMgr::startLeaseFileCompactionInternal() {
+    if (compaction_ || (!persistLeases(V4) && !persistLeases(V6))) {
+        return;
+    }
+
+    // Restart the interval even if the compaction fails to start, so as
+    // it is not retried for every lease record.
+    lfc_start_ = boost::posix_time::second_clock::universal_time();
+
+    // The leases are copied here, because the container is modified by
+    // this thread while the snapshot is being written. The copy is much
+    // cheaper than writing the leases to the file. The records appended
+    // from now on will be copied from the end of the lease file.
+    if (persistLeases(V4)) {
+        LOG_INFO(dhcpsrv_logger, DHCPSRV_MEMFILE_LFC_START)
+            .arg(lease_file4_->getFilename());
+        lease_file4_->flush();
+        boost::shared_ptr<std::vector<Lease4> >
+            leases(new std::vector<Lease4>(storage4_.begin(), storage4_.end()));
+        compaction_.reset(new LeaseFileCompaction(
+            lease_file4_->getFilename(), lease_file4_->size(), leases->size(),
+            boost::bind(&writeSnapshot<CSVLeaseFile4, Lease4>, _1, leases)));
+
+    } else {
+        LOG_INFO(dhcpsrv_logger, DHCPSRV_MEMFILE_LFC_START)
+            .arg(lease_file6_->getFilename());
+        lease_file6_->flush();
+        boost::shared_ptr<std::vector<Lease6> >
+            leases(new std::vector<Lease6>(storage6_.begin(), storage6_.end()));
+        compaction_.reset(new LeaseFileCompaction(
+            lease_file6_->getFilename(), lease_file6_->size(), leases->size(),
+            boost::bind(&writeSnapshot<CSVLeaseFile6, Lease6>, _1, leases)));
+    }
+}
+
+bool
+Memfile_LeaseMgr::finishLeaseFileCompaction(const bool wait) {
+    bundy::util::thread::Mutex::Locker lock(mutex_);
+    return (finishLeaseFileCompactionInternal(wait));
+}
+
+bool
+Memfile_LeaseMgr::finishLeaseFileCompactionInternal(const bool wait) {
+    if (!compaction_ || (!wait && !compaction_->done())) {
+        return (false);
+    }
+
+    // Whatever the outcome, this compaction is over.
+    boost::scoped_ptr<LeaseFileCompaction> compaction;
+    compaction.swap(compaction_);
+
+    // The records appended in the group commit mode may be still
+    // buffered. They have to be copied to the new lease file too.
+    if (lease_file4_) {
+        lease_file4_->flush();
+    } else {
+        lease_file6_->flush();
+    }
+
+    compaction->finish();
+
+    // The lease file has been replaced. Reopen it, so as the new records
+    // are appended to the new file.
+    if (lease_file4_) {
+        std::string filename = lease_file4_->getFilename();
+        lease_file4_->close();
+        lease_file4_.reset(new CSVLeaseFile4(filename));
+        lease_file4_->open();
+
+    } else {
+        std::string filename = lease_file6_->getFilename();
+        lease_file6_->close();
+        lease_file6_.reset(new CSVLeaseFile6(filename));
+        lease_file6_->open();
+    }
+
+    LOG_INFO(dhcpsrv_logger, DHCPSRV_MEMFILE_LFC_COMPLETE)
+        .arg(getLeaseFilePath(lease_file4_ ? V4 : V6))
+        .arg(compaction->getLeaseCount());
+    return (true);
+}
+
 void
 Memfile_LeaseMgr::load4() {
     // If lease file hasn't been opened, we are working in non-persistent mode.
@@ -492,6 +1060,17 @@ Memfile_LeaseMgr::load4() {
 
 void
 Memfile_LeaseMgr::loadLease4(Lease4Ptr& lease) {
+    // A lease with the hardware address and subnet of another lease couldn't be
+    // stored when it was written, so it is skipped here too.
+    if (lease->valid_lft_ > 0) {
+        Lease4Ptr other = getConflictingLease(*lease);
+        if (other) {
+            LOG_WARN(dhcpsrv_logger, DHCPSRV_MEMFILE_LEASE_CONFLICT4)
+                .arg(lease->addr_.toText()).arg(other->addr_.toText());
+            return;
+        }
+    }
+
     // Check if the lease already exists.
     Lease4Storage::iterator lease_it = storage4_.find(lease->addr_);
     // Lease doesn't exist.
@@ -500,8 +1079,8 @@ Memfile_LeaseMgr::loadLease4(Lease4Ptr& lease) {
         // We use valid lifetime of 0 to indicate that lease should
         // be removed.
         if (lease->valid_lft_ > 0) {
-           storage4_.insert(lease);
-       }
+            storage4_.insert(*lease);
+        }
     } else {
         // We use valid lifetime of 0 to indicate that the lease is
         // to be removed. In such case, erase the lease.
@@ -510,7 +1089,7 @@ Memfile_LeaseMgr::loadLease4(Lease4Ptr& lease) {
 
         } else {
             // Update existing lease.
-            **lease_it = *lease;
+            storage4_.replace(lease_it, *lease);
         }
     }
 }
@@ -554,6 +1133,17 @@ Memfile_LeaseMgr::load6() {
 
 void
 Memfile_LeaseMgr::loadLease6(Lease6Ptr& lease) {
+    // A lease with the DUID, IAID and subnet of another lease couldn't be
+    // stored when it was written, so it is skipped here too.
+    if (lease->valid_lft_ > 0) {
+        Lease6Ptr other = getConflictingLease(*lease);
+        if (other) {
+            LOG_WARN(dhcpsrv_logger, DHCPSRV_MEMFILE_LEASE_CONFLICT6)
+                .arg(lease->addr_.toText()).arg(other->addr_.toText());
+            return;
+        }
+    }
+
     // Check if the lease already exists.
     Lease6Storage::iterator lease_it = storage6_.find(lease->addr_);
     // Lease doesn't exist.
@@ -562,8 +1152,8 @@ Memfile_LeaseMgr::loadLease6(Lease6Ptr& lease) {
         // We use valid lifetime of 0 to indicate that lease should
         // be removed.
         if (lease->valid_lft_ > 0) {
-            storage6_.insert(lease);
-       }
+            storage6_.insert(*lease);
+        }
     } else {
         // We use valid lifetime of 0 to indicate that the lease is
         // to be removed. In such case, erase the lease.
@@ -572,7 +1162,7 @@ Memfile_LeaseMgr::loadLease6(Lease6Ptr& lease) {
 
         } else {
             // Update existing lease.
-            **lease_it = *lease;
+            storage6_.replace(lease_it, *lease);
         }
     }
 
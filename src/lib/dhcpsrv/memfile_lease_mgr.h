@@ -19,16 +19,23 @@
 #include <dhcpsrv/csv_lease_file4.h>
 #include <dhcpsrv/csv_lease_file6.h>
 #include <dhcpsrv/lease_mgr.h>
+#include <util/threads/sync.h>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/indexed_by.hpp>
+#include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/member.hpp>
-#include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/composite_key.hpp>
+#include <boost/scoped_ptr.hpp>
 
 namespace bundy {
 namespace dhcp {
 
+class LeaseFileCompaction;
+
 /// @brief Concrete implementation of a lease database backend using flat file.
 ///
 /// This class implements a lease database backend using CSV files to store
@@ -55,6 +62,35 @@ namespace dhcp {
 /// removal or addition of the lease is appended to the lease file
 /// synchronously.
 ///
+/// Alternatively, the backend may operate in the group commit mode, enabled
+/// with the "group-commit-delay=[milliseconds]" parameter in the database
+/// access string. In this mode the lease records are appended to the lease
+/// file without flushing it. The records are flushed and committed to the
+/// disk (fsync) together when @c Memfile_LeaseMgr::commit is called. The
+/// server is expected to call it once for the burst of packets it has
+/// processed, before sending the responses. The value of the parameter is
+/// the maximum time the server may delay the commit. If the server doesn't
+/// commit within this time, the backend commits pending records itself when
+/// the next lease record is appended.
+///
+/// Since every update of the lease appends a new record, the lease file
+/// grows over time and so does the time to load it when the server starts
+/// up. The "lfc-interval=[seconds]" parameter in the database access string
+/// enables periodic compaction of the lease file (lease file cleanup). When
+/// the interval elapses, the current leases are copied from the in-memory
+/// container and written to a new lease file by a background thread. The
+/// lease records appended in the meantime are copied to the end of the new
+/// file when the snapshot is complete and the new file is atomically
+/// renamed over the existing lease file. Until then, the existing lease
+/// file is not modified other than by appending new records, so the lease
+/// information is not lost if the server crashes during the compaction.
+/// The compaction is started and finished when the lease records are
+/// appended, so it takes place only when the leases are being updated.
+///
+/// The backend may be used by many threads at once. The access to the
+/// in-memory containers and the lease files is serialized by a mutex held
+/// by each public method for its duration.
+///
 /// Originally, the Memfile backend didn't write leases to disk. This was
 /// particularly useful for testing server performance in non-disk bound
 /// conditions. In order to preserve this capability, the new parameter
@@ -216,6 +252,30 @@ public:
     virtual Lease6Collection getLeases6(Lease::Type type, const DUID& duid,
                                         uint32_t iaid, SubnetID subnet_id) const;
 
+    /// @brief Returns IPv4 leases which have expired in a subnet.
+    ///
+    /// The leases are found by examining all leases held in memory.
+    ///
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    virtual Lease4Collection getExpiredLeases4(SubnetID subnet_id,
+                                               size_t max_leases) const;
+
+    /// @brief Returns IPv6 leases which have expired in a subnet.
+    ///
+    /// The leases are found by examining all leases held in memory.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    virtual Lease6Collection getExpiredLeases6(Lease::Type type,
+                                               SubnetID subnet_id,
+                                               size_t max_leases) const;
+
     /// @brief Updates IPv4 lease.
     ///
     /// @warning This function does not validate the pointer to the lease.
@@ -279,8 +339,11 @@ public:
 
     /// @brief Commit Transactions
     ///
-    /// Commits all pending database operations.  On databases that don't
-    /// support transactions, this is a no-op.
+    /// In the group commit mode, flushes all lease records appended since
+    /// the last commit and commits them to the disk. Otherwise, all records
+    /// are committed when they are appended and this is a no-op.
+    ///
+    /// @throw bundy::util::CSVFileError if committing records failed.
     virtual void commit();
 
     /// @brief Rollback Transactions
@@ -289,6 +352,64 @@ public:
     /// support transactions, this is a no-op.
     virtual void rollback();
 
+    /// @brief Returns the maximum time by which commits may be delayed.
+    ///
+    /// @return Value of the "group-commit-delay" parameter or 0 if the
+    /// group commit is disabled.
+    virtual uint32_t getMaxCommitDelay() const {
+        return (group_commit_delay_);
+    }
+
+    /// @brief Checks if the backend may be used by many threads at once.
+    ///
+    /// @return Always true.
+    virtual bool isThreadSafe() const {
+        return (true);
+    }
+
+    /// @brief Returns the number of lease records awaiting a commit.
+    size_t getPendingCommits() const {
+        bundy::util::thread::Mutex::Locker lock(mutex_);
+        return (pending_commits_);
+    }
+
+    /// @brief Returns the lease file compaction interval in seconds.
+    ///
+    /// @return Value of the "lfc-interval" parameter or 0 if the periodic
+    /// compaction is disabled.
+    uint32_t getLfcInterval() const {
+        return (lfc_interval_);
+    }
+
+    /// @brief Starts the compaction of the lease file.
+    ///
+    /// This method copies the current leases from the in-memory container
+    /// and starts a thread writing them to a new lease file. The new file
+    /// is swapped in by @c Memfile_LeaseMgr::finishLeaseFileCompaction.
+    /// The method is no-op if leases are not written to disk or the
+    /// compaction is already in progress.
+    void startLeaseFileCompaction();
+
+    /// @brief Finishes the compaction of the lease file.
+    ///
+    /// If the snapshot of the leases has been written, this method copies
+    /// the lease records appended since the compaction started to the new
+    /// lease file and renames it over the existing lease file.
+    ///
+    /// @param wait Indicates whether the method should wait for the snapshot
+    /// to be written or return immediately if it is still being written.
+    ///
+    /// @return true if the lease file has been replaced, false otherwise.
+    /// @throw DbOperationError if the compaction failed. The existing lease
+    /// file is then left intact.
+    bool finishLeaseFileCompaction(const bool wait);
+
+    /// @brief Checks if the compaction of the lease file is in progress.
+    bool isLeaseFileCompactionInProgress() const {
+        bundy::util::thread::Mutex::Locker lock(mutex_);
+        return (compaction_.get() != NULL);
+    }
+
     /// @brief Returns default path to the lease file.
     ///
     /// @param u Universe (V4 or V6).
@@ -380,21 +501,112 @@ protected:
     /// argument to this function.
     std::string initLeaseFilePath(Universe u);
 
+    /// @brief Initializes the group commit delay.
+    ///
+    /// @throw bundy::BadValue if the "group-commit-delay" parameter is not
+    /// a number.
+    void initGroupCommitDelay();
+
+    /// @brief Initializes the lease file compaction interval.
+    ///
+    /// @throw bundy::BadValue if the "lfc-interval" parameter is not
+    /// a number.
+    void initLfcInterval();
+
+    /// @brief Returns the lease with the same client as the given one.
+    ///
+    /// The (hardware address, subnet id) of the DHCPv4 leases and the
+    /// (DUID, IAID, subnet id) of the DHCPv6 leases are unique keys of the
+    /// lease containers, which reject a lease taking the key of another
+    /// one. Must be called with the mutex held.
+    ///
+    /// @param lease The lease to be stored.
+    ///
+    /// @return Copy of the stored lease with another address and the same
+    /// key, or null pointer if there is none.
+    Lease4Ptr getConflictingLease(const Lease4& lease) const;
+
+    /// @brief Returns the lease with the same client as the given one.
+    ///
+    /// @param lease The lease to be stored.
+    ///
+    /// @return Copy of the stored lease with another address and the same
+    /// DUID, IAID and subnet id, or null pointer if there is none.
+    Lease6Ptr getConflictingLease(const Lease6& lease) const;
+
+    /// @brief Appends the DHCPv4 lease record to the lease file.
+    ///
+    /// In the group commit mode the record is not flushed and it is
+    /// accounted as pending commit.
+    ///
+    /// @param lease Lease to be written.
+    void appendLease(const Lease4& lease);
+
+    /// @brief Appends the DHCPv6 lease record to the lease file.
+    ///
+    /// @param lease Lease to be written.
+    void appendLease(const Lease6& lease);
+
+    /// @brief Accounts a lease record appended in the group commit mode.
+    ///
+    /// It commits pending records if the first of them has been waiting
+    /// longer than the maximum commit delay.
+    void recordPendingCommit();
+
+    /// @brief Runs the periodic compaction of the lease file.
+    ///
+    /// It finishes the compaction in progress if the snapshot has been
+    /// written, or starts a new compaction if the compaction interval has
+    /// elapsed. Errors are logged and not propagated, because the lease
+    /// records have been written to the existing lease file.
+    void checkLeaseFileCompaction();
+
+    /// @brief Commits the pending lease records.
+    ///
+    /// This is the implementation of @c Memfile_LeaseMgr::commit called
+    /// with the mutex held.
+    void commitInternal();
+
+    /// @brief Starts the compaction of the lease file.
+    ///
+    /// This is the implementation of
+    /// @c Memfile_LeaseMgr::startLeaseFileCompaction called with the mutex
+    /// held.
+    void startLeaseFileCompactionInternal();
+
+    /// @brief Finishes the compaction of the lease file.
+    ///
+    /// This is the implementation of
+    /// @c Memfile_LeaseMgr::finishLeaseFileCompaction called with the mutex
+    /// held.
+    ///
+    /// @param wait Indicates whether the method should wait for the snapshot
+    /// to be written.
+    ///
+    /// @return true if the lease file has been replaced, false otherwise.
+    bool finishLeaseFileCompactionInternal(const bool wait);
+
     // This is a multi-index container, which holds elements that can
-    // be accessed using different search indexes.
+    // be accessed using different search indexes. The leases are held by
+    // value so that each lease lives in the container node itself rather
+    // than in a separately allocated object referenced through a pointer.
+    // All indexes are hashed, which keeps the lookups at constant cost
+    // regardless of the number of leases in the container. The stored
+    // leases must never be modified in place; use replace() so that the
+    // indexes are updated.
     typedef boost::multi_index_container<
-        // It holds pointers to Lease6 objects.
-        Lease6Ptr,
+        // It holds Lease6 objects.
+        Lease6,
         boost::multi_index::indexed_by<
             // Specification of the first index starts here.
-            // This index sorts leases by IPv6 addresses represented as
+            // This index hashes leases by IPv6 addresses represented as
             // IOAddress objects.
-            boost::multi_index::ordered_unique<
+            boost::multi_index::hashed_unique<
                 boost::multi_index::member<Lease, bundy::asiolink::IOAddress, &Lease::addr_>
             >,
 
             // Specification of the second index starts here.
-            boost::multi_index::ordered_unique<
+            boost::multi_index::hashed_unique<
                 // This is a composite index that will be used to search for
                 // the lease using three attributes: DUID, IAID, Subnet Id.
                 boost::multi_index::composite_key<
@@ -413,23 +625,24 @@ protected:
      > Lease6Storage; // Specify the type name of this container.
 
     // This is a multi-index container, which holds elements that can
-    // be accessed using different search indexes.
+    // be accessed using different search indexes. As for the IPv6 leases,
+    // the Lease4 objects are held by value in hashed indexes.
     typedef boost::multi_index_container<
-        // It holds pointers to Lease4 objects.
-        Lease4Ptr,
+        // It holds Lease4 objects.
+        Lease4,
         // Specification of search indexes starts here.
         boost::multi_index::indexed_by<
             // Specification of the first index starts here.
-            // This index sorts leases by IPv4 addresses represented as
+            // This index hashes leases by IPv4 addresses represented as
             // IOAddress objects.
-            boost::multi_index::ordered_unique<
+            boost::multi_index::hashed_unique<
                 // The IPv4 address are held in addr_ members that belong to
                 // Lease class.
                 boost::multi_index::member<Lease, bundy::asiolink::IOAddress, &Lease::addr_>
             >,
 
             // Specification of the second index starts here.
-            boost::multi_index::ordered_unique<
+            boost::multi_index::hashed_unique<
                 // This is a composite index that combines two attributes of the
                 // Lease4 object: hardware address and subnet id.
                 boost::multi_index::composite_key<
@@ -447,7 +660,7 @@ protected:
             >,
 
             // Specification of the third index starts here.
-            boost::multi_index::ordered_non_unique<
+            boost::multi_index::hashed_non_unique<
                 // This is a composite index that uses two values to search for a
                 // lease: client id and subnet id.
                 boost::multi_index::composite_key<
@@ -462,9 +675,9 @@ protected:
             >,
 
             // Specification of the fourth index starts here.
-            boost::multi_index::ordered_non_unique<
-                // This is a composite index that uses two values to search for a
-                // lease: client id and subnet id.
+            boost::multi_index::hashed_non_unique<
+                // This is a composite index that uses three values to search
+                // for a lease: client id, hardware address and subnet id.
                 boost::multi_index::composite_key<
                     Lease4,
                     // The client id can be retrieved from the Lease4 object by
@@ -494,6 +707,28 @@ protected:
     /// @brief Holds the pointer to the DHCPv6 lease file IO.
     boost::shared_ptr<CSVLeaseFile6> lease_file6_;
 
+    /// @brief Maximum commit delay in milliseconds (0 if group commit
+    /// is disabled).
+    uint32_t group_commit_delay_;
+
+    /// @brief Number of lease records appended since the last commit.
+    size_t pending_commits_;
+
+    /// @brief Time when the first of the pending records was appended.
+    boost::posix_time::ptime batch_start_;
+
+    /// @brief Lease file compaction interval in seconds (0 if the periodic
+    /// compaction is disabled).
+    uint32_t lfc_interval_;
+
+    /// @brief Time when the last compaction of the lease file started.
+    boost::posix_time::ptime lfc_start_;
+
+    /// @brief Compaction of the lease file in progress (if any).
+    boost::scoped_ptr<LeaseFileCompaction> compaction_;
+
+    /// @brief Serializes the access to the leases and the lease files.
+    mutable bundy::util::thread::Mutex mutex_;
 };
 
 }; // end of bundy::dhcp namespace
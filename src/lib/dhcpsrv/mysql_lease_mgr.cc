@@ -20,9 +20,11 @@
 #include <dhcpsrv/dhcpsrv_log.h>
 #include <dhcpsrv/mysql_lease_mgr.h>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/static_assert.hpp>
 #include <mysqld_error.h>
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -145,6 +147,13 @@ TaggedStatement tagged_statements[] = {
                         "fqdn_fwd, fqdn_rev, hostname "
                             "FROM lease4 "
                             "WHERE client_id = ? AND subnet_id = ?"},
+    {MySqlLeaseMgr::GET_LEASE4_EXPIRED,
+                    "SELECT address, hwaddr, client_id, "
+                        "valid_lifetime, expire, subnet_id, "
+                        "fqdn_fwd, fqdn_rev, hostname "
+                            "FROM lease4 "
+                            "WHERE subnet_id = ? AND expire < NOW() "
+                            "ORDER BY expire LIMIT ?"},
     {MySqlLeaseMgr::GET_LEASE4_HWADDR,
                     "SELECT address, hwaddr, client_id, "
                         "valid_lifetime, expire, subnet_id, "
@@ -179,6 +188,15 @@ TaggedStatement tagged_statements[] = {
                             "FROM lease6 "
                             "WHERE duid = ? AND iaid = ? AND subnet_id = ? "
                             "AND lease_type = ?"},
+    {MySqlLeaseMgr::GET_LEASE6_EXPIRED,
+                    "SELECT address, duid, valid_lifetime, "
+                        "expire, subnet_id, pref_lifetime, "
+                        "lease_type, iaid, prefix_len, "
+                        "fqdn_fwd, fqdn_rev, hostname "
+                            "FROM lease6 "
+                            "WHERE lease_type = ? AND subnet_id = ? "
+                            "AND expire < NOW() "
+                            "ORDER BY expire LIMIT ?"},
     {MySqlLeaseMgr::GET_VERSION,
                     "SELECT version, minor FROM schema_version"},
     {MySqlLeaseMgr::INSERT_LEASE4,
@@ -209,6 +227,95 @@ TaggedStatement tagged_statements[] = {
     {MySqlLeaseMgr::NUM_STATEMENTS, NULL}
 };
 
+/// @brief MySQL Multi-Row Statements
+///
+/// The text of these statements depends on the number of addresses or
+/// leases they take, so it is built from the parts below when the
+/// statements are prepared.
+
+const char* GET_LEASE4_ADDRS_PREFIX =
+                    "SELECT address, hwaddr, client_id, "
+                        "valid_lifetime, expire, subnet_id, "
+                        "fqdn_fwd, fqdn_rev, hostname "
+                            "FROM lease4 "
+                            "WHERE address IN (";
+const char* GET_LEASE4_ADDRS_SUFFIX = ")";
+
+const char* GET_LEASE6_ADDRS_PREFIX =
+                    "SELECT address, duid, valid_lifetime, "
+                        "expire, subnet_id, pref_lifetime, "
+                        "lease_type, iaid, prefix_len, "
+                        "fqdn_fwd, fqdn_rev, hostname "
+                            "FROM lease6 "
+                            "WHERE address IN (";
+const char* GET_LEASE6_ADDRS_SUFFIX = ") AND lease_type = ?";
+
+const char* UPSERT_LEASE4_PREFIX =
+                    "INSERT INTO lease4(address, hwaddr, client_id, "
+                        "valid_lifetime, expire, subnet_id, "
+                        "fqdn_fwd, fqdn_rev, hostname) "
+                            "VALUES ";
+const char* UPSERT_LEASE4_SUFFIX =
+                    " ON DUPLICATE KEY UPDATE hwaddr = VALUES(hwaddr), "
+                        "client_id = VALUES(client_id), "
+                        "valid_lifetime = VALUES(valid_lifetime), "
+                        "expire = VALUES(expire), "
+                        "subnet_id = VALUES(subnet_id), "
+                        "fqdn_fwd = VALUES(fqdn_fwd), "
+                        "fqdn_rev = VALUES(fqdn_rev), "
+                        "hostname = VALUES(hostname)";
+const size_t UPSERT_LEASE4_COLUMNS = 9;
+
+const char* UPSERT_LEASE6_PREFIX =
+                    "INSERT INTO lease6(address, duid, valid_lifetime, "
+                        "expire, subnet_id, pref_lifetime, "
+                        "lease_type, iaid, prefix_len, "
+                        "fqdn_fwd, fqdn_rev, hostname) "
+                            "VALUES ";
+const char* UPSERT_LEASE6_SUFFIX =
+                    " ON DUPLICATE KEY UPDATE duid = VALUES(duid), "
+                        "valid_lifetime = VALUES(valid_lifetime), "
+                        "expire = VALUES(expire), "
+                        "subnet_id = VALUES(subnet_id), "
+                        "pref_lifetime = VALUES(pref_lifetime), "
+                        "lease_type = VALUES(lease_type), "
+                        "iaid = VALUES(iaid), "
+                        "prefix_len = VALUES(prefix_len), "
+                        "fqdn_fwd = VALUES(fqdn_fwd), "
+                        "fqdn_rev = VALUES(fqdn_rev), "
+                        "hostname = VALUES(hostname)";
+const size_t UPSERT_LEASE6_COLUMNS = 12;
+
+/// @brief Builds the text of a multi-row statement.
+///
+/// @param prefix Text preceding the rows.
+/// @param rows Number of rows.
+/// @param columns Number of placeholders in a row. If it is 0, the
+///        placeholders are not grouped in rows, e.g. for the IN clause.
+/// @param suffix Text following the rows.
+///
+/// @return Text of the statement.
+std::string
+buildStatement(const char* prefix, size_t rows, size_t columns,
+               const char* suffix) {
+    std::string text(prefix);
+    for (size_t row = 0; row < rows; ++row) {
+        if (row > 0) {
+            text += ", ";
+        }
+        if (columns == 0) {
+            text += "?";
+            continue;
+        }
+        text += "(?";
+        for (size_t column = 1; column < columns; ++column) {
+            text += ", ?";
+        }
+        text += ")";
+    }
+    return (text + suffix);
+}
+
 };  // Anonymous namespace
 
 
@@ -1102,17 +1209,21 @@ private:
 // MySqlLeaseMgr Constructor and Destructor
 
 MySqlLeaseMgr::MySqlLeaseMgr(const LeaseMgr::ParameterMap& parameters)
-    : LeaseMgr(parameters) {
+    : LeaseMgr(parameters),
+      group_commit_delay_(getGroupCommitDelayParameter()),
+      pending_commits_(0) {
 
     // Open the database.
     openDatabase();
 
-    // Enable autocommit.  To avoid a flush to disk on every commit, the global
-    // parameter innodb_flush_log_at_trx_commit should be set to 2.  This will
-    // cause the changes to be written to the log, but flushed to disk in the
-    // background every second.  Setting the parameter to that value will speed
-    // up the system, but at the risk of losing data if the system crashes.
-    my_bool result = mysql_autocommit(mysql_, 1);
+    // Enable autocommit unless the group commit is enabled.  To avoid a
+    // flush to disk on every commit, either the group commit should be
+    // enabled, or the global parameter innodb_flush_log_at_trx_commit should
+    // be set to 2.  The latter will cause the changes to be written to the
+    // log, but flushed to disk in the background every second.  Setting the
+    // parameter to that value will speed up the system, but at the risk of
+    // losing data if the system crashes.
+    my_bool result = mysql_autocommit(mysql_, group_commit_delay_ == 0);
     if (result != 0) {
         bundy_throw(DbOperationError, mysql_error(mysql_));
     }
@@ -1124,10 +1235,27 @@ MySqlLeaseMgr::MySqlLeaseMgr(const LeaseMgr::ParameterMap& parameters)
     // program and the database.
     exchange4_.reset(new MySqlLease4Exchange());
     exchange6_.reset(new MySqlLease6Exchange());
+    for (size_t i = 0; i < UPSERT_BATCH_SIZE; ++i) {
+        batch_exchange4_.push_back(boost::shared_ptr<MySqlLease4Exchange>
+                                   (new MySqlLease4Exchange()));
+        batch_exchange6_.push_back(boost::shared_ptr<MySqlLease6Exchange>
+                                   (new MySqlLease6Exchange()));
+    }
 }
 
 
 MySqlLeaseMgr::~MySqlLeaseMgr() {
+    // Commit the changes not committed by the server. The destructor must
+    // not throw, so the error is only logged.
+    if (pending_commits_ > 0) {
+        try {
+            commit();
+        } catch (const std::exception& ex) {
+            LOG_ERROR(dhcpsrv_logger, DHCPSRV_MYSQL_GROUP_COMMIT_FAILED)
+                .arg(ex.what());
+        }
+    }
+
     // Free up the prepared statements, ignoring errors. (What would we do
     // about them? We're destroying this object and are not really concerned
     // with errors on a database connection that is about to go away.)
@@ -1329,6 +1457,30 @@ MySqlLeaseMgr::prepareStatements() {
         prepareStatement(tagged_statements[i].index,
                          tagged_statements[i].text);
     }
+
+    // ... and the multi-row statements.
+    prepareStatement(GET_LEASE4_ADDRS,
+                     buildStatement(GET_LEASE4_ADDRS_PREFIX, GET_BATCH_SIZE,
+                                    0, GET_LEASE4_ADDRS_SUFFIX).c_str());
+    prepareStatement(GET_LEASE6_ADDRS,
+                     buildStatement(GET_LEASE6_ADDRS_PREFIX, GET_BATCH_SIZE,
+                                    0, GET_LEASE6_ADDRS_SUFFIX).c_str());
+    prepareStatement(UPSERT_LEASE4,
+                     buildStatement(UPSERT_LEASE4_PREFIX, 1,
+                                    UPSERT_LEASE4_COLUMNS,
+                                    UPSERT_LEASE4_SUFFIX).c_str());
+    prepareStatement(UPSERT_LEASE4_BATCH,
+                     buildStatement(UPSERT_LEASE4_PREFIX, UPSERT_BATCH_SIZE,
+                                    UPSERT_LEASE4_COLUMNS,
+                                    UPSERT_LEASE4_SUFFIX).c_str());
+    prepareStatement(UPSERT_LEASE6,
+                     buildStatement(UPSERT_LEASE6_PREFIX, 1,
+                                    UPSERT_LEASE6_COLUMNS,
+                                    UPSERT_LEASE6_SUFFIX).c_str());
+    prepareStatement(UPSERT_LEASE6_BATCH,
+                     buildStatement(UPSERT_LEASE6_PREFIX, UPSERT_BATCH_SIZE,
+                                    UPSERT_LEASE6_COLUMNS,
+                                    UPSERT_LEASE6_SUFFIX).c_str());
 }
 
 // Add leases to the database.  The two public methods accept a lease object
@@ -1357,6 +1509,7 @@ MySqlLeaseMgr::addLeaseCommon(StatementIndex stindex,
     }
 
     // Insert succeeded
+    recordPendingCommit();
     return (true);
 }
 
@@ -1816,6 +1969,7 @@ MySqlLeaseMgr::updateLeaseCommon(StatementIndex stindex, MYSQL_BIND* bind,
         bundy_throw(DbOperationError, "apparently updated more than one lease "
                   "that had the address " << lease->addr_);
     }
+    recordPendingCommit();
 }
 
 
@@ -1892,7 +2046,11 @@ MySqlLeaseMgr::deleteLeaseCommon(StatementIndex stindex, MYSQL_BIND* bind) {
 
     // See how many rows were affected.  Note that the statement may delete
     // multiple rows.
-    return (mysql_stmt_affected_rows(statements_[stindex]) > 0);
+    if (mysql_stmt_affected_rows(statements_[stindex]) > 0) {
+        recordPendingCommit();
+        return (true);
+    }
+    return (false);
 }
 
 
@@ -1929,6 +2087,197 @@ MySqlLeaseMgr::deleteLease(const bundy::asiolink::IOAddress& addr) {
     }
 }
 
+// Bulk lease methods.  The addresses are looked up by the statements taking
+// a fixed number of them (the last chunk is padded by repeating the last
+// address) and the leases are stored by the multi-row statements.
+
+Lease4Collection
+MySqlLeaseMgr::getLeases4(const vector<bundy::asiolink::IOAddress>& addrs) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_GET_ADDRS4).arg(addrs.size());
+
+    // Set up the WHERE clause values
+    MYSQL_BIND inbind[GET_BATCH_SIZE];
+    memset(inbind, 0, sizeof(inbind));
+
+    uint32_t addr4[GET_BATCH_SIZE];
+    for (size_t i = 0; i < GET_BATCH_SIZE; ++i) {
+        inbind[i].buffer_type = MYSQL_TYPE_LONG;
+        inbind[i].buffer = reinterpret_cast<char*>(&addr4[i]);
+        inbind[i].is_unsigned = MLM_TRUE;
+    }
+
+    // Get the data, chunk by chunk
+    Lease4Collection result;
+    for (size_t first = 0; first < addrs.size(); first += GET_BATCH_SIZE) {
+        for (size_t i = 0; i < GET_BATCH_SIZE; ++i) {
+            const size_t index = std::min(first + i, addrs.size() - 1);
+            addr4[i] = static_cast<uint32_t>(addrs[index]);
+        }
+        getLeaseCollection(GET_LEASE4_ADDRS, inbind, result);
+    }
+
+    return (result);
+}
+
+Lease6Collection
+MySqlLeaseMgr::getLeases6(Lease::Type lease_type,
+                          const vector<bundy::asiolink::IOAddress>& addrs) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_GET_ADDRS6).arg(addrs.size()).arg(lease_type);
+
+    // Set up the WHERE clause values
+    MYSQL_BIND inbind[GET_BATCH_SIZE + 1];
+    memset(inbind, 0, sizeof(inbind));
+
+    // ADDRESS: see the earlier description of the use of "const_cast" when
+    // accessing the address for an explanation of the reason.
+    std::string addr6[GET_BATCH_SIZE];
+    unsigned long addr6_length[GET_BATCH_SIZE];
+    for (size_t i = 0; i < GET_BATCH_SIZE; ++i) {
+        inbind[i].buffer_type = MYSQL_TYPE_STRING;
+        inbind[i].length = &addr6_length[i];
+    }
+
+    // LEASE_TYPE
+    inbind[GET_BATCH_SIZE].buffer_type = MYSQL_TYPE_TINY;
+    inbind[GET_BATCH_SIZE].buffer = reinterpret_cast<char*>(&lease_type);
+    inbind[GET_BATCH_SIZE].is_unsigned = MLM_TRUE;
+
+    // ... and get the data, chunk by chunk
+    Lease6Collection result;
+    for (size_t first = 0; first < addrs.size(); first += GET_BATCH_SIZE) {
+        for (size_t i = 0; i < GET_BATCH_SIZE; ++i) {
+            const size_t index = std::min(first + i, addrs.size() - 1);
+            addr6[i] = addrs[index].toText();
+            addr6_length[i] = addr6[i].size();
+            inbind[i].buffer = const_cast<char*>(addr6[i].c_str());
+            inbind[i].buffer_length = addr6_length[i];
+        }
+        getLeaseCollection(GET_LEASE6_ADDRS, inbind, result);
+    }
+
+    return (result);
+}
+
+void
+MySqlLeaseMgr::executeStatement(StatementIndex stindex, MYSQL_BIND* bind) {
+    // Bind the parameters to the statement
+    int status = mysql_stmt_bind_param(statements_[stindex], bind);
+    checkError(status, stindex, "unable to bind parameters");
+
+    // Execute
+    status = mysql_stmt_execute(statements_[stindex]);
+    checkError(status, stindex, "unable to execute");
+}
+
+template <typename Exchange, typename LeaseCollection>
+void
+MySqlLeaseMgr::upsertLeasesCommon(StatementIndex batch_index,
+                                  StatementIndex single_index,
+                                  const LeaseCollection& leases,
+                                  boost::scoped_ptr<Exchange>& exchange,
+                                  std::vector<boost::shared_ptr<Exchange> >&
+                                  batch_exchanges) {
+    // Store the full batches with the multi-row statement.
+    size_t i = 0;
+    std::vector<MYSQL_BIND> bind;
+    for (; i + UPSERT_BATCH_SIZE <= leases.size(); i += UPSERT_BATCH_SIZE) {
+        bind.clear();
+        for (size_t j = 0; j < UPSERT_BATCH_SIZE; ++j) {
+            std::vector<MYSQL_BIND> lease_bind =
+                batch_exchanges[j]->createBindForSend(leases[i + j]);
+            bind.insert(bind.end(), lease_bind.begin(), lease_bind.end());
+        }
+        executeStatement(batch_index, &bind[0]);
+        recordPendingCommit(UPSERT_BATCH_SIZE);
+    }
+
+    // The rest is stored lease by lease, rather than by the statement
+    // padded with the repeated leases.
+    for (; i < leases.size(); ++i) {
+        bind = exchange->createBindForSend(leases[i]);
+        executeStatement(single_index, &bind[0]);
+        recordPendingCommit();
+    }
+}
+
+void
+MySqlLeaseMgr::upsertLeases4(const Lease4Collection& leases) {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_UPSERT_ADDRS4).arg(leases.size());
+
+    upsertLeasesCommon(UPSERT_LEASE4_BATCH, UPSERT_LEASE4, leases,
+                       exchange4_, batch_exchange4_);
+}
+
+void
+MySqlLeaseMgr::upsertLeases6(const Lease6Collection& leases) {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_UPSERT_ADDRS6).arg(leases.size());
+
+    upsertLeasesCommon(UPSERT_LEASE6_BATCH, UPSERT_LEASE6, leases,
+                       exchange6_, batch_exchange6_);
+}
+
+Lease4Collection
+MySqlLeaseMgr::getExpiredLeases4(SubnetID subnet_id, size_t max_leases) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_GET_EXPIRED4).arg(max_leases).arg(subnet_id);
+
+    // Set up the WHERE clause and LIMIT values
+    MYSQL_BIND inbind[2];
+    memset(inbind, 0, sizeof(inbind));
+
+    inbind[0].buffer_type = MYSQL_TYPE_LONG;
+    inbind[0].buffer = reinterpret_cast<char*>(&subnet_id);
+    inbind[0].is_unsigned = MLM_TRUE;
+
+    uint32_t limit = static_cast<uint32_t>(max_leases);
+    inbind[1].buffer_type = MYSQL_TYPE_LONG;
+    inbind[1].buffer = reinterpret_cast<char*>(&limit);
+    inbind[1].is_unsigned = MLM_TRUE;
+
+    // Get the data
+    Lease4Collection result;
+    getLeaseCollection(GET_LEASE4_EXPIRED, inbind, result);
+
+    return (result);
+}
+
+Lease6Collection
+MySqlLeaseMgr::getExpiredLeases6(Lease::Type lease_type, SubnetID subnet_id,
+                                 size_t max_leases) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_MYSQL_GET_EXPIRED6)
+        .arg(max_leases).arg(subnet_id).arg(lease_type);
+
+    // Set up the WHERE clause and LIMIT values
+    MYSQL_BIND inbind[3];
+    memset(inbind, 0, sizeof(inbind));
+
+    // LEASE_TYPE
+    inbind[0].buffer_type = MYSQL_TYPE_TINY;
+    inbind[0].buffer = reinterpret_cast<char*>(&lease_type);
+    inbind[0].is_unsigned = MLM_TRUE;
+
+    // Subnet ID
+    inbind[1].buffer_type = MYSQL_TYPE_LONG;
+    inbind[1].buffer = reinterpret_cast<char*>(&subnet_id);
+    inbind[1].is_unsigned = MLM_TRUE;
+
+    uint32_t limit = static_cast<uint32_t>(max_leases);
+    inbind[2].buffer_type = MYSQL_TYPE_LONG;
+    inbind[2].buffer = reinterpret_cast<char*>(&limit);
+    inbind[2].is_unsigned = MLM_TRUE;
+
+    // ... and get the data
+    Lease6Collection result;
+    getLeaseCollection(GET_LEASE6_EXPIRED, inbind, result);
+
+    return (result);
+}
+
 // Miscellaneous database methods.
 
 std::string
@@ -2003,6 +2352,15 @@ MySqlLeaseMgr::getVersion() const {
 void
 MySqlLeaseMgr::commit() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL, DHCPSRV_MYSQL_COMMIT);
+    if (group_commit_delay_ > 0) {
+        if (pending_commits_ == 0) {
+            return;
+        }
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+                  DHCPSRV_MYSQL_GROUP_COMMIT).arg(pending_commits_);
+        pending_commits_ = 0;
+    }
+
     if (mysql_commit(mysql_) != 0) {
         bundy_throw(DbOperationError, "commit failed: " << mysql_error(mysql_));
     }
@@ -2012,10 +2370,32 @@ MySqlLeaseMgr::commit() {
 void
 MySqlLeaseMgr::rollback() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL, DHCPSRV_MYSQL_ROLLBACK);
+    pending_commits_ = 0;
     if (mysql_rollback(mysql_) != 0) {
         bundy_throw(DbOperationError, "rollback failed: " << mysql_error(mysql_));
     }
 }
 
+void
+MySqlLeaseMgr::recordPendingCommit(const size_t changes) {
+    using namespace boost::posix_time;
+
+    if (group_commit_delay_ == 0) {
+        return;
+    }
+
+    ptime now = microsec_clock::universal_time();
+    const bool first = (pending_commits_ == 0);
+    pending_commits_ += changes;
+    if (first) {
+        batch_start_ = now;
+
+    } else if (now - batch_start_ > milliseconds(group_commit_delay_)) {
+        // The server hasn't committed within the maximum delay. Don't hold
+        // the changes in the transaction any longer.
+        commit();
+    }
+}
+
 }; // end of bundy::dhcp namespace
 }; // end of bundy namespace
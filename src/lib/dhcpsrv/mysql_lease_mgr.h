@@ -18,7 +18,9 @@
 #include <dhcp/hwaddr.h>
 #include <dhcpsrv/lease_mgr.h>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <mysql.h>
 
@@ -78,7 +80,7 @@ private:
 // Define the current database schema values
 
 const uint32_t CURRENT_VERSION_VERSION = 1;
-const uint32_t CURRENT_VERSION_MINOR = 0;
+const uint32_t CURRENT_VERSION_MINOR = 1;
 
 
 // Forward declaration of the Lease exchange objects.  These classes are defined
@@ -103,6 +105,10 @@ public:
     /// - host - Host to which to connect (optional, defaults to "localhost")
     /// - user - Username under which to connect (optional)
     /// - password - Password for "user" on the database (optional)
+    /// - group-commit-delay - Maximum time in milliseconds by which commits
+    ///   may be delayed (optional, defaults to 0). If it is not 0, the
+    ///   autocommit is disabled and the lease changes are committed by
+    ///   @c MySqlLeaseMgr::commit, rather than after each change.
     ///
     /// If the database is successfully opened, the version number in the
     /// schema_version table will be checked against hard-coded value in
@@ -351,6 +357,91 @@ public:
     ///        failed.
     virtual bool deleteLease(const bundy::asiolink::IOAddress& addr);
 
+    /// @brief Returns IPv4 leases for the specified addresses.
+    ///
+    /// The leases are retrieved by the queries taking @c GET_BATCH_SIZE
+    /// addresses each.
+    ///
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found
+    ///
+    /// @throw bundy::dhcp::DataTruncation Data was truncated on retrieval to
+    ///        fit into the space allocated for the result.  This indicates a
+    ///        programming error.
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease4Collection
+    getLeases4(const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Returns IPv6 leases of the specified type for the specified
+    /// addresses.
+    ///
+    /// The leases are retrieved by the queries taking @c GET_BATCH_SIZE
+    /// addresses each.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found
+    ///
+    /// @throw bundy::dhcp::DataTruncation Data was truncated on retrieval to
+    ///        fit into the space allocated for the result.  This indicates a
+    ///        programming error.
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease6Collection
+    getLeases6(Lease::Type type,
+               const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Adds or updates IPv4 leases.
+    ///
+    /// The leases are stored by the multi-row statements, each of them
+    /// holding @c UPSERT_BATCH_SIZE leases. The remaining leases are stored
+    /// one by one.
+    ///
+    /// @param leases leases to be stored
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual void upsertLeases4(const Lease4Collection& leases);
+
+    /// @brief Adds or updates IPv6 leases.
+    ///
+    /// See @c MySqlLeaseMgr::upsertLeases4 for details.
+    ///
+    /// @param leases leases to be stored
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual void upsertLeases6(const Lease6Collection& leases);
+
+    /// @brief Returns IPv4 leases which have expired in a subnet.
+    ///
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease4Collection getExpiredLeases4(SubnetID subnet_id,
+                                               size_t max_leases) const;
+
+    /// @brief Returns IPv6 leases which have expired in a subnet.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease6Collection getExpiredLeases6(Lease::Type type,
+                                               SubnetID subnet_id,
+                                               size_t max_leases) const;
+
     /// @brief Return backend type
     ///
     /// Returns the type of the backend (e.g. "mysql", "memfile" etc.)
@@ -399,6 +490,20 @@ public:
     /// @throw DbOperationError If the rollback failed.
     virtual void rollback();
 
+    /// @brief Returns the maximum time by which commits may be delayed.
+    ///
+    /// @return The value of the "group-commit-delay" parameter in
+    ///         milliseconds.
+    virtual uint32_t getMaxCommitDelay() const {
+        return (group_commit_delay_);
+    }
+
+    /// @brief Number of addresses taken by a multi-address query.
+    static const size_t GET_BATCH_SIZE = 64;
+
+    /// @brief Number of leases stored by a multi-row statement.
+    static const size_t UPSERT_BATCH_SIZE = 16;
+
     ///@{
     /// The following methods are used to convert between times and time
     /// intervals stored in the Lease object, and the times stored in the
@@ -456,18 +561,26 @@ public:
         DELETE_LEASE4,              // Delete from lease4 by address
         DELETE_LEASE6,              // Delete from lease6 by address
         GET_LEASE4_ADDR,            // Get lease4 by address
+        GET_LEASE4_ADDRS,           // Get lease4 by batch of addresses
         GET_LEASE4_CLIENTID,        // Get lease4 by client ID
         GET_LEASE4_CLIENTID_SUBID,  // Get lease4 by client ID & subnet ID
+        GET_LEASE4_EXPIRED,         // Get expired lease4 by subnet ID
         GET_LEASE4_HWADDR,          // Get lease4 by HW address
         GET_LEASE4_HWADDR_SUBID,    // Get lease4 by HW address & subnet ID
         GET_LEASE6_ADDR,            // Get lease6 by address
+        GET_LEASE6_ADDRS,           // Get lease6 by batch of addresses
         GET_LEASE6_DUID_IAID,       // Get lease6 by DUID and IAID
         GET_LEASE6_DUID_IAID_SUBID, // Get lease6 by DUID, IAID and subnet ID
+        GET_LEASE6_EXPIRED,         // Get expired lease6 by subnet ID
         GET_VERSION,                // Obtain version number
         INSERT_LEASE4,              // Add entry to lease4 table
         INSERT_LEASE6,              // Add entry to lease6 table
         UPDATE_LEASE4,              // Update a Lease4 entry
         UPDATE_LEASE6,              // Update a Lease6 entry
+        UPSERT_LEASE4,              // Add or update a Lease4 entry
+        UPSERT_LEASE4_BATCH,        // Add or update a batch of Lease4 entries
+        UPSERT_LEASE6,              // Add or update a Lease6 entry
+        UPSERT_LEASE6_BATCH,        // Add or update a batch of Lease6 entries
         NUM_STATEMENTS              // Number of statements
     };
 
@@ -652,6 +765,49 @@ private:
     ///        failed.
     bool deleteLeaseCommon(StatementIndex stindex, MYSQL_BIND* bind);
 
+    /// @brief Upsert Leases Common Code
+    ///
+    /// This method performs the common actions for both flavours (V4 and V6)
+    /// of the upsertLeases method.
+    ///
+    /// @param batch_index Index of the statement storing
+    ///        @c UPSERT_BATCH_SIZE leases
+    /// @param single_index Index of the statement storing a single lease
+    /// @param leases Leases to be stored
+    /// @param exchange Exchange object used for a single lease
+    /// @param batch_exchanges Exchange objects used for the batch of leases,
+    ///        one for each lease as the MYSQL_BIND arrays point to their data.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    template <typename Exchange, typename LeaseCollection>
+    void upsertLeasesCommon(StatementIndex batch_index,
+                            StatementIndex single_index,
+                            const LeaseCollection& leases,
+                            boost::scoped_ptr<Exchange>& exchange,
+                            std::vector<boost::shared_ptr<Exchange> >&
+                            batch_exchanges);
+
+    /// @brief Execute a statement
+    ///
+    /// Binds the parameters to the statement which returns no data and
+    /// executes it.
+    ///
+    /// @param stindex Index of prepared statement to be executed
+    /// @param bind Array of MYSQL_BIND objects representing the parameters.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    void executeStatement(StatementIndex stindex, MYSQL_BIND* bind);
+
+    /// @brief Accounts a lease change made in the group commit mode.
+    ///
+    /// It commits the pending changes if the first of them has been waiting
+    /// longer than the maximum commit delay.
+    ///
+    /// @param changes Number of leases changed.
+    void recordPendingCommit(const size_t changes = 1);
+
     /// @brief Check Error and Throw Exception
     ///
     /// Virtually all MySQL functions return a status which, if non-zero,
@@ -682,9 +838,23 @@ private:
     /// declare them as "mutable".)
     boost::scoped_ptr<MySqlLease4Exchange> exchange4_; ///< Exchange object
     boost::scoped_ptr<MySqlLease6Exchange> exchange6_; ///< Exchange object
+
+    /// Exchange objects used for the multi-row statements
+    std::vector<boost::shared_ptr<MySqlLease4Exchange> > batch_exchange4_;
+    std::vector<boost::shared_ptr<MySqlLease6Exchange> > batch_exchange6_;
+
     MySqlHolder mysql_;
     std::vector<MYSQL_STMT*> statements_;       ///< Prepared statements
     std::vector<std::string> text_statements_;  ///< Raw text of statements
+
+    /// Maximum commit delay in milliseconds (0 if group commit is disabled)
+    uint32_t group_commit_delay_;
+
+    /// Number of lease changes made since the last commit
+    size_t pending_commits_;
+
+    /// Time when the first of the pending changes was made
+    boost::posix_time::ptime batch_start_;
 };
 
 }; // end of bundy::dhcp namespace
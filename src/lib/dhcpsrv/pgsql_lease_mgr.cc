@@ -20,8 +20,10 @@
 #include <dhcpsrv/dhcpsrv_log.h>
 #include <dhcpsrv/pgsql_lease_mgr.h>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/static_assert.hpp>
 
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -78,6 +80,13 @@ TaggedStatement tagged_statements[] = {
      "valid_lifetime, extract(epoch from expire), subnet_id, fqdn_fwd, fqdn_rev, hostname "
      "FROM lease4 "
      "WHERE address = $1"},
+    {PgSqlLeaseMgr::GET_LEASE4_ADDRS, 1,
+        { 1016 },
+        "get_lease4_addrs",
+     "SELECT address, hwaddr, client_id, "
+     "valid_lifetime, extract(epoch from expire)::bigint, subnet_id, fqdn_fwd, fqdn_rev, hostname "
+     "FROM lease4 "
+     "WHERE address = ANY($1)"},
     {PgSqlLeaseMgr::GET_LEASE4_CLIENTID, 1,
         { 17 },
         "get_lease4_clientid",
@@ -92,6 +101,14 @@ TaggedStatement tagged_statements[] = {
      "valid_lifetime, extract(epoch from expire)::bigint, subnet_id, fqdn_fwd, fqdn_rev, hostname "
      "FROM lease4 "
      "WHERE client_id = $1 AND subnet_id = $2"},
+    {PgSqlLeaseMgr::GET_LEASE4_EXPIRED, 2,
+        { 20, 20 },
+        "get_lease4_expired",
+     "SELECT address, hwaddr, client_id, "
+     "valid_lifetime, extract(epoch from expire)::bigint, subnet_id, fqdn_fwd, fqdn_rev, hostname "
+     "FROM lease4 "
+     "WHERE subnet_id = $1 AND expire < now() "
+     "ORDER BY expire LIMIT $2"},
     {PgSqlLeaseMgr::GET_LEASE4_HWADDR, 1,
          { 17 },
          "get_lease4_hwaddr",
@@ -114,6 +131,14 @@ TaggedStatement tagged_statements[] = {
      "lease_type, iaid, prefix_len, fqdn_fwd, fqdn_rev, hostname "
      "FROM lease6 "
      "WHERE address = $1 AND lease_type = $2"},
+    {PgSqlLeaseMgr::GET_LEASE6_ADDRS, 2,
+        { 1015, 21 },
+        "get_lease6_addrs",
+     "SELECT address, duid, valid_lifetime, "
+     "extract(epoch from expire)::bigint, subnet_id, pref_lifetime, "
+     "lease_type, iaid, prefix_len, fqdn_fwd, fqdn_rev, hostname "
+     "FROM lease6 "
+     "WHERE address = ANY($1) AND lease_type = $2"},
     {PgSqlLeaseMgr::GET_LEASE6_DUID_IAID, 3,
         { 17, 20, 21 },
         "get_lease6_duid_iaid",
@@ -130,6 +155,15 @@ TaggedStatement tagged_statements[] = {
      "lease_type, iaid, prefix_len, fqdn_fwd, fqdn_rev, hostname "
      "FROM lease6 "
      "WHERE lease_type = $1 AND duid = $2 AND iaid = $3 AND subnet_id = $4"},
+    {PgSqlLeaseMgr::GET_LEASE6_EXPIRED, 3,
+        { 21, 20, 20 },
+        "get_lease6_expired",
+     "SELECT address, duid, valid_lifetime, "
+     "extract(epoch from expire)::bigint, subnet_id, pref_lifetime, "
+     "lease_type, iaid, prefix_len, fqdn_fwd, fqdn_rev, hostname "
+     "FROM lease6 "
+     "WHERE lease_type = $1 AND subnet_id = $2 AND expire < now() "
+     "ORDER BY expire LIMIT $3"},
     {PgSqlLeaseMgr::GET_VERSION, 0,
         { 0 },
      "get_version",
@@ -139,14 +173,16 @@ TaggedStatement tagged_statements[] = {
          "insert_lease4",
      "INSERT INTO lease4(address, hwaddr, client_id, "
      "valid_lifetime, expire, subnet_id, fqdn_fwd, fqdn_rev, hostname) "
-     "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9)"},
+     "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9) "
+     "ON CONFLICT (address) DO NOTHING"},
     {PgSqlLeaseMgr::INSERT_LEASE6, 12,
         { 1043, 17, 20, 1114, 20, 20, 21, 20, 21, 16, 16, 1043 },
         "insert_lease6",
      "INSERT INTO lease6(address, duid, valid_lifetime, "
      "expire, subnet_id, pref_lifetime, "
      "lease_type, iaid, prefix_len, fqdn_fwd, fqdn_rev, hostname) "
-     "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12)"},
+     "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12) "
+     "ON CONFLICT (address) DO NOTHING"},
     {PgSqlLeaseMgr::UPDATE_LEASE4, 10,
         { 20, 17, 17, 20, 1114, 20, 16, 16, 1043, 20 },
         "update_lease4",
@@ -167,6 +203,25 @@ TaggedStatement tagged_statements[] = {
     {PgSqlLeaseMgr::NUM_STATEMENTS, 0,  { 0 }, NULL, NULL}
 };
 
+// The statements adding or updating leases are built from the insert
+// statements above, with as many rows of values as leases they store,
+// followed by these clauses.
+const char* UPSERT_LEASE4_CONFLICT =
+    "ON CONFLICT (address) DO UPDATE SET hwaddr = EXCLUDED.hwaddr, "
+    "client_id = EXCLUDED.client_id, "
+    "valid_lifetime = EXCLUDED.valid_lifetime, expire = EXCLUDED.expire, "
+    "subnet_id = EXCLUDED.subnet_id, fqdn_fwd = EXCLUDED.fqdn_fwd, "
+    "fqdn_rev = EXCLUDED.fqdn_rev, hostname = EXCLUDED.hostname";
+
+const char* UPSERT_LEASE6_CONFLICT =
+    "ON CONFLICT (address) DO UPDATE SET duid = EXCLUDED.duid, "
+    "valid_lifetime = EXCLUDED.valid_lifetime, expire = EXCLUDED.expire, "
+    "subnet_id = EXCLUDED.subnet_id, "
+    "pref_lifetime = EXCLUDED.pref_lifetime, "
+    "lease_type = EXCLUDED.lease_type, iaid = EXCLUDED.iaid, "
+    "prefix_len = EXCLUDED.prefix_len, fqdn_fwd = EXCLUDED.fqdn_fwd, "
+    "fqdn_rev = EXCLUDED.fqdn_rev, hostname = EXCLUDED.hostname";
+
 };
 
 namespace bundy {
@@ -571,13 +626,26 @@ private:
 
 PgSqlLeaseMgr::PgSqlLeaseMgr(const LeaseMgr::ParameterMap& parameters)
     : LeaseMgr(parameters), exchange4_(new PgSqlLease4Exchange()),
-    exchange6_(new PgSqlLease6Exchange()), conn_(NULL) {
+    exchange6_(new PgSqlLease6Exchange()), conn_(NULL),
+    group_commit_delay_(getGroupCommitDelayParameter()), pending_commits_(0) {
     openDatabase();
     prepareStatements();
+    beginTransaction();
 }
 
 PgSqlLeaseMgr::~PgSqlLeaseMgr() {
     if (conn_) {
+        // Commit the changes not committed by the server. The destructor
+        // must not throw, so the error is only logged.
+        if (pending_commits_ > 0) {
+            try {
+                commit();
+            } catch (const std::exception& ex) {
+                LOG_ERROR(dhcpsrv_logger, DHCPSRV_PGSQL_GROUP_COMMIT_FAILED)
+                    .arg(ex.what());
+            }
+        }
+
         // Deallocate the prepared queries.
         PGresult* r = PQexec(conn_, "DEALLOCATE all");
         if(PQresultStatus(r) != PGRES_COMMAND_OK) {
@@ -615,6 +683,58 @@ void PgSqlLeaseMgr::prepareStatements() {
         statements_[i].stmt_nbparams = tagged_statements[i].nbparams;
         PQclear(r);
     }
+
+    prepareUpsertStatement(UPSERT_LEASE4, INSERT_LEASE4, "upsert_lease4", 1,
+                           UPSERT_LEASE4_CONFLICT);
+    prepareUpsertStatement(UPSERT_LEASE4_BATCH, INSERT_LEASE4,
+                           "upsert_lease4_batch", UPSERT_BATCH_SIZE,
+                           UPSERT_LEASE4_CONFLICT);
+    prepareUpsertStatement(UPSERT_LEASE6, INSERT_LEASE6, "upsert_lease6", 1,
+                           UPSERT_LEASE6_CONFLICT);
+    prepareUpsertStatement(UPSERT_LEASE6_BATCH, INSERT_LEASE6,
+                           "upsert_lease6_batch", UPSERT_BATCH_SIZE,
+                           UPSERT_LEASE6_CONFLICT);
+}
+
+void
+PgSqlLeaseMgr::prepareUpsertStatement(StatementIndex stindex,
+                                      StatementIndex insert_index,
+                                      const char* name, size_t rows,
+                                      const char* conflict) {
+    const TaggedStatement& insert = tagged_statements[insert_index];
+    const char* values = strstr(insert.text, "VALUES ");
+    if ((insert.index != insert_index) || (values == NULL)) {
+        bundy_throw(DbOperationError, "unable to build PostgreSQL statement "
+                    << name << " from statement " << insert.name);
+    }
+
+    // INSERT INTO leaseX(columns) VALUES ($1, ...), ($n+1, ...), ...
+    ostringstream text;
+    text << string(insert.text, values) << "VALUES ";
+    vector<Oid> types;
+    int param = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        text << (row == 0 ? "(" : ", (");
+        for (int i = 0; i < insert.nbparams; ++i) {
+            text << (i == 0 ? "$" : ", $") << ++param;
+            types.push_back(insert.types[i]);
+        }
+        text << ")";
+    }
+    text << " " << conflict;
+
+    PGresult* r = PQprepare(conn_, name, text.str().c_str(), param,
+                            &types[0]);
+    if (PQresultStatus(r) != PGRES_COMMAND_OK) {
+        PQclear(r);
+        bundy_throw(DbOperationError,
+                  "unable to prepare PostgreSQL statement: "
+                  << text.str() << ", reason: " << PQerrorMessage(conn_));
+    }
+
+    statements_[stindex].stmt_name = name;
+    statements_[stindex].stmt_nbparams = param;
+    PQclear(r);
 }
 
 void
@@ -667,6 +787,18 @@ PgSqlLeaseMgr::openDatabase() {
         conn_ = NULL;
         bundy_throw(DbOpenError, error_message);
     }
+
+    // Checked here, rather than left to the preparation of the statements
+    // failing with a syntax error.
+    const int server_version = PQserverVersion(conn_);
+    if (server_version < PG_MIN_SERVER_VERSION) {
+        PQfinish(conn_);
+        conn_ = NULL;
+        bundy_throw(DbOpenError, "PostgreSQL server version "
+                    << server_version / 10000 << "."
+                    << (server_version / 100) % 100
+                    << " is not supported, version 9.5 or later is required");
+    }
 }
 
 bool
@@ -681,27 +813,17 @@ PgSqlLeaseMgr::addLeaseCommon(StatementIndex stindex,
                                   statements_[stindex].stmt_nbparams,
                                   &out_values[0], &out_lengths[0],
                                   &out_formats[0], 0);
+    checkStatementError(r, stindex);
 
-    int s = PQresultStatus(r);
-    if (s != PGRES_COMMAND_OK) {
-        const char * errorMsg = PQerrorMessage(conn_);
-        PQclear(r);
-
-        /// @todo - ok, do we have to rely on error message text??
-        /// and why is failing on duplicate key NOT an error?
-        /// should be looking at global sqlca struct
-        if(!strncmp(errorMsg, "ERROR:  duplicate key",
-           sizeof("ERROR:  duplicate key") - 1)) {
-            return (false);
-        }
-
-        bundy_throw(DbOperationError, "unable to INSERT for " <<
-                  statements_[stindex].stmt_name << ", reason: " <<
-                  errorMsg);
-    }
-
+    // The insert statements do nothing if the lease exists, rather than
+    // fail, so as the transaction is not aborted in the group commit mode.
+    int affected_rows = boost::lexical_cast<int>(PQcmdTuples(r));
     PQclear(r);
 
+    if (affected_rows == 0) {
+        return (false);
+    }
+    recordPendingCommit();
     return (true);
 }
 
@@ -1029,7 +1151,8 @@ PgSqlLeaseMgr::updateLeaseCommon(StatementIndex stindex, BindParams & params,
 
     // Check success case first as it is the most likely outcome.
     if (affected_rows == 1) {
-      return;
+        recordPendingCommit();
+        return;
     }
 
     // If no rows affected, lease doesn't exist.
@@ -1094,7 +1217,11 @@ PgSqlLeaseMgr::deleteLeaseCommon(StatementIndex stindex, BindParams & params) {
     int affected_rows = boost::lexical_cast<int>(PQcmdTuples(r));
     PQclear(r);
 
-    return (affected_rows > 0);
+    if (affected_rows > 0) {
+        recordPendingCommit();
+        return (true);
+    }
+    return (false);
 }
 
 bool
@@ -1116,6 +1243,186 @@ PgSqlLeaseMgr::deleteLease(const bundy::asiolink::IOAddress& addr) {
     return (deleteLeaseCommon(DELETE_LEASE6, inparams));
 }
 
+Lease4Collection
+PgSqlLeaseMgr::getLeases4(const vector<bundy::asiolink::IOAddress>& addrs) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_GET_ADDRS4).arg(addrs.size());
+
+    Lease4Collection result;
+    if (addrs.empty()) {
+        return (result);
+    }
+
+    // Set up the WHERE clause value: array of addresses, e.g. {1,2,3}
+    BindParams inparams;
+    ostringstream tmp;
+    tmp << "{";
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        tmp << (i == 0 ? "" : ",") << static_cast<uint32_t>(addrs[i]);
+    }
+    tmp << "}";
+    inparams.push_back(PgSqlParam(tmp.str()));
+
+    // Get the data
+    getLeaseCollection(GET_LEASE4_ADDRS, inparams, result);
+
+    return (result);
+}
+
+Lease6Collection
+PgSqlLeaseMgr::getLeases6(Lease::Type lease_type,
+                          const vector<bundy::asiolink::IOAddress>& addrs) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_GET_ADDRS6).arg(addrs.size()).arg(lease_type);
+
+    Lease6Collection result;
+    if (addrs.empty()) {
+        return (result);
+    }
+
+    // Set up the WHERE clause values
+    BindParams inparams;
+    ostringstream tmp;
+
+    // ADDRESS
+    tmp << "{";
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        tmp << (i == 0 ? "" : ",") << addrs[i].toText();
+    }
+    tmp << "}";
+    inparams.push_back(PgSqlParam(tmp.str()));
+    tmp.str("");
+    tmp.clear();
+
+    // LEASE_TYPE
+    tmp << static_cast<uint16_t>(lease_type);
+    inparams.push_back(PgSqlParam(tmp.str()));
+
+    // ... and get the data
+    getLeaseCollection(GET_LEASE6_ADDRS, inparams, result);
+
+    return (result);
+}
+
+void
+PgSqlLeaseMgr::executeStatement(StatementIndex stindex, BindParams& params) {
+    vector<const char *> params_;
+    vector<int> lengths_;
+    vector<int> formats_;
+    convertToQuery(params, params_, lengths_, formats_);
+
+    PGresult * r = PQexecPrepared(conn_, statements_[stindex].stmt_name,
+                                  statements_[stindex].stmt_nbparams,
+                                  &params_[0], &lengths_[0], &formats_[0], 0);
+    checkStatementError(r, stindex);
+    PQclear(r);
+}
+
+template <typename Exchange, typename LeaseCollection>
+void
+PgSqlLeaseMgr::upsertLeasesCommon(StatementIndex batch_index,
+                                  StatementIndex single_index,
+                                  const LeaseCollection& leases,
+                                  Exchange& exchange) {
+    // Store the full batches with the multi-row statement.
+    size_t i = 0;
+    BindParams params;
+    for (; i + UPSERT_BATCH_SIZE <= leases.size(); i += UPSERT_BATCH_SIZE) {
+        params.clear();
+        for (size_t j = i; j < i + UPSERT_BATCH_SIZE; ++j) {
+            BindParams lease_params = exchange->createBindForSend(leases[j]);
+            params.insert(params.end(), lease_params.begin(),
+                          lease_params.end());
+        }
+        executeStatement(batch_index, params);
+        recordPendingCommit(UPSERT_BATCH_SIZE);
+    }
+
+    // The rest is stored lease by lease, rather than by the statement
+    // padded with the repeated leases, because a single statement must
+    // not update the same row twice.
+    for (; i < leases.size(); ++i) {
+        params = exchange->createBindForSend(leases[i]);
+        executeStatement(single_index, params);
+        recordPendingCommit();
+    }
+}
+
+void
+PgSqlLeaseMgr::upsertLeases4(const Lease4Collection& leases) {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_UPSERT_ADDRS4).arg(leases.size());
+
+    upsertLeasesCommon(UPSERT_LEASE4_BATCH, UPSERT_LEASE4, leases,
+                       exchange4_);
+}
+
+void
+PgSqlLeaseMgr::upsertLeases6(const Lease6Collection& leases) {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_UPSERT_ADDRS6).arg(leases.size());
+
+    upsertLeasesCommon(UPSERT_LEASE6_BATCH, UPSERT_LEASE6, leases,
+                       exchange6_);
+}
+
+Lease4Collection
+PgSqlLeaseMgr::getExpiredLeases4(SubnetID subnet_id, size_t max_leases) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_GET_EXPIRED4).arg(max_leases).arg(subnet_id);
+
+    // Set up the WHERE clause and LIMIT values
+    BindParams inparams;
+    ostringstream tmp;
+
+    tmp << static_cast<unsigned long>(subnet_id);
+    inparams.push_back(PgSqlParam(tmp.str()));
+    tmp.str("");
+    tmp.clear();
+
+    tmp << static_cast<unsigned long>(max_leases);
+    inparams.push_back(PgSqlParam(tmp.str()));
+
+    // Get the data
+    Lease4Collection result;
+    getLeaseCollection(GET_LEASE4_EXPIRED, inparams, result);
+
+    return (result);
+}
+
+Lease6Collection
+PgSqlLeaseMgr::getExpiredLeases6(Lease::Type lease_type, SubnetID subnet_id,
+                                 size_t max_leases) const {
+    LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+              DHCPSRV_PGSQL_GET_EXPIRED6)
+        .arg(max_leases).arg(subnet_id).arg(lease_type);
+
+    // Set up the WHERE clause and LIMIT values
+    BindParams inparams;
+    ostringstream tmp;
+
+    // LEASE_TYPE
+    tmp << static_cast<uint16_t>(lease_type);
+    inparams.push_back(PgSqlParam(tmp.str()));
+    tmp.str("");
+    tmp.clear();
+
+    // Subnet ID
+    tmp << static_cast<unsigned long>(subnet_id);
+    inparams.push_back(PgSqlParam(tmp.str()));
+    tmp.str("");
+    tmp.clear();
+
+    tmp << static_cast<unsigned long>(max_leases);
+    inparams.push_back(PgSqlParam(tmp.str()));
+
+    // ... and get the data
+    Lease6Collection result;
+    getLeaseCollection(GET_LEASE6_EXPIRED, inparams, result);
+
+    return (result);
+}
+
 string
 PgSqlLeaseMgr::getName() const {
     string name = "";
@@ -1188,12 +1495,22 @@ PgSqlLeaseMgr::getVersion() const {
 void
 PgSqlLeaseMgr::commit() {
     LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL, DHCPSRV_PGSQL_COMMIT);
+    if (group_commit_delay_ > 0) {
+        if (pending_commits_ == 0) {
+            return;
+        }
+        LOG_DEBUG(dhcpsrv_logger, DHCPSRV_DBG_TRACE_DETAIL,
+                  DHCPSRV_PGSQL_GROUP_COMMIT).arg(pending_commits_);
+        pending_commits_ = 0;
+    }
+
     PGresult * r = PQexec(conn_, "COMMIT");
     if (PQresultStatus(r) != PGRES_COMMAND_OK) {
         bundy_throw(DbOperationError, "commit failed: " << PQerrorMessage(conn_));
     }
 
     PQclear(r);
+    beginTransaction();
 }
 
 void
@@ -1206,6 +1523,45 @@ PgSqlLeaseMgr::rollback() {
     }
 
     PQclear(r);
+    pending_commits_ = 0;
+    beginTransaction();
+}
+
+void
+PgSqlLeaseMgr::beginTransaction() {
+    if (group_commit_delay_ == 0) {
+        return;
+    }
+
+    PGresult * r = PQexec(conn_, "BEGIN");
+    if (PQresultStatus(r) != PGRES_COMMAND_OK) {
+        PQclear(r);
+        bundy_throw(DbOperationError, "unable to start transaction: "
+                    << PQerrorMessage(conn_));
+    }
+
+    PQclear(r);
+}
+
+void
+PgSqlLeaseMgr::recordPendingCommit(const size_t changes) {
+    using namespace boost::posix_time;
+
+    if (group_commit_delay_ == 0) {
+        return;
+    }
+
+    ptime now = microsec_clock::universal_time();
+    const bool first = (pending_commits_ == 0);
+    pending_commits_ += changes;
+    if (first) {
+        batch_start_ = now;
+
+    } else if (now - batch_start_ > milliseconds(group_commit_delay_)) {
+        // The server hasn't committed within the maximum delay. Don't hold
+        // the changes in the transaction any longer.
+        commit();
+    }
 }
 
 }; // end of bundy::dhcp namespace
@@ -18,6 +18,7 @@
 #include <dhcp/hwaddr.h>
 #include <dhcpsrv/lease_mgr.h>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/utility.hpp>
 #include <libpq-fe.h>
@@ -71,9 +72,14 @@ struct PgSqlStatementBind {
 class PgSqlLease4Exchange;
 class PgSqlLease6Exchange;
 
-/// Defines PostgreSQL backend version: 1.0
+/// Defines PostgreSQL backend version: 1.1
 const uint32_t PG_CURRENT_VERSION = 1;
-const uint32_t PG_CURRENT_MINOR = 0;
+const uint32_t PG_CURRENT_MINOR = 1;
+
+/// Oldest PostgreSQL server version supported (as returned by
+/// PQserverVersion()): 9.5, the statements adding leases use
+/// INSERT ... ON CONFLICT.
+const int PG_MIN_SERVER_VERSION = 90500;
 
 /// @brief PostgreSQL Lease Manager
 ///
@@ -91,6 +97,10 @@ public:
     /// - host - Host to which to connect (optional, defaults to "localhost")
     /// - user - Username under which to connect (optional)
     /// - password - Password for "user" on the database (optional)
+    /// - group-commit-delay - Maximum time in milliseconds by which commits
+    ///   may be delayed (optional, defaults to 0). If it is not 0, the lease
+    ///   changes are made in a transaction which is committed by
+    ///   @c PgSqlLeaseMgr::commit, rather than after each change.
     ///
     /// If the database is successfully opened, the version number in the
     /// schema_version table will be checked against hard-coded value in
@@ -102,7 +112,8 @@ public:
     ///        concerned with the database.
     ///
     /// @throw bundy::dhcp::NoDatabaseName Mandatory database name not given
-    /// @throw bundy::dhcp::DbOpenError Error opening the database
+    /// @throw bundy::dhcp::DbOpenError Error opening the database, or the
+    ///        server is older than @c PG_MIN_SERVER_VERSION
     /// @throw bundy::dhcp::DbOperationError An operation on the open database has
     ///        failed.
     PgSqlLeaseMgr(const ParameterMap& parameters);
@@ -327,6 +338,86 @@ public:
     ///        failed.
     virtual bool deleteLease(const bundy::asiolink::IOAddress& addr);
 
+    /// @brief Returns IPv4 leases for the specified addresses.
+    ///
+    /// The leases are retrieved with a single query, which takes the
+    /// addresses as an array.
+    ///
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease4Collection
+    getLeases4(const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Returns IPv6 leases of the specified type for the specified
+    /// addresses.
+    ///
+    /// The leases are retrieved with a single query, which takes the
+    /// addresses as an array.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param addrs addresses of the searched leases
+    ///
+    /// @return Collection of the leases found
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease6Collection
+    getLeases6(Lease::Type type,
+               const std::vector<bundy::asiolink::IOAddress>& addrs) const;
+
+    /// @brief Adds or updates IPv4 leases.
+    ///
+    /// The leases are stored by the multi-row statements, each of them
+    /// holding @c UPSERT_BATCH_SIZE leases. The remaining leases are stored
+    /// one by one. The statements use the "INSERT ... ON CONFLICT" clause,
+    /// which requires PostgreSQL 9.5 or later.
+    ///
+    /// @param leases leases to be stored
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual void upsertLeases4(const Lease4Collection& leases);
+
+    /// @brief Adds or updates IPv6 leases.
+    ///
+    /// See @c PgSqlLeaseMgr::upsertLeases4 for details.
+    ///
+    /// @param leases leases to be stored
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual void upsertLeases6(const Lease6Collection& leases);
+
+    /// @brief Returns IPv4 leases which have expired in a subnet.
+    ///
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease4Collection getExpiredLeases4(SubnetID subnet_id,
+                                               size_t max_leases) const;
+
+    /// @brief Returns IPv6 leases which have expired in a subnet.
+    ///
+    /// @param type specifies lease type: (NA, TA or PD)
+    /// @param subnet_id identifier of the subnet the leases belong to
+    /// @param max_leases maximum number of leases to be returned
+    ///
+    /// @return Collection of the expired leases, longest expired first.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    virtual Lease6Collection getExpiredLeases6(Lease::Type type,
+                                               SubnetID subnet_id,
+                                               size_t max_leases) const;
+
     /// @brief Return backend type
     ///
     /// Returns the type of the backend (e.g. "mysql", "memfile" etc.)
@@ -373,6 +464,17 @@ public:
     /// @throw DbOperationError If the rollback failed.
     virtual void rollback();
 
+    /// @brief Returns the maximum time by which commits may be delayed.
+    ///
+    /// @return The value of the "group-commit-delay" parameter in
+    ///         milliseconds.
+    virtual uint32_t getMaxCommitDelay() const {
+        return (group_commit_delay_);
+    }
+
+    /// @brief Number of leases stored by a multi-row statement.
+    static const size_t UPSERT_BATCH_SIZE = 16;
+
     /// @brief Statement Tags
     ///
     /// The contents of the enum are indexes into the list of compiled SQL statements
@@ -380,18 +482,26 @@ public:
         DELETE_LEASE4,              // Delete from lease4 by address
         DELETE_LEASE6,              // Delete from lease6 by address
         GET_LEASE4_ADDR,            // Get lease4 by address
+        GET_LEASE4_ADDRS,           // Get lease4 by array of addresses
         GET_LEASE4_CLIENTID,        // Get lease4 by client ID
         GET_LEASE4_CLIENTID_SUBID,  // Get lease4 by client ID & subnet ID
+        GET_LEASE4_EXPIRED,         // Get expired lease4 by subnet ID
         GET_LEASE4_HWADDR,          // Get lease4 by HW address
         GET_LEASE4_HWADDR_SUBID,    // Get lease4 by HW address & subnet ID
         GET_LEASE6_ADDR,            // Get lease6 by address
+        GET_LEASE6_ADDRS,           // Get lease6 by array of addresses
         GET_LEASE6_DUID_IAID,       // Get lease6 by DUID and IAID
         GET_LEASE6_DUID_IAID_SUBID, // Get lease6 by DUID, IAID and subnet ID
+        GET_LEASE6_EXPIRED,         // Get expired lease6 by subnet ID
         GET_VERSION,                // Obtain version number
         INSERT_LEASE4,              // Add entry to lease4 table
         INSERT_LEASE6,              // Add entry to lease6 table
         UPDATE_LEASE4,              // Update a Lease4 entry
         UPDATE_LEASE6,              // Update a Lease6 entry
+        UPSERT_LEASE4,              // Add or update a Lease4 entry
+        UPSERT_LEASE4_BATCH,        // Add or update a batch of Lease4 entries
+        UPSERT_LEASE6,              // Add or update a Lease6 entry
+        UPSERT_LEASE6_BATCH,        // Add or update a batch of Lease6 entries
         NUM_STATEMENTS              // Number of statements
     };
 
@@ -417,6 +527,69 @@ private:
     /// @throw DbOpenError Error opening the database
     void openDatabase();
 
+    /// @brief Prepare the statements adding or updating leases
+    ///
+    /// The text of these statements is built from the corresponding
+    /// insert statements, because the number of their parameters depends
+    /// on the number of leases they store.
+    ///
+    /// @param stindex Index of the statement being prepared
+    /// @param insert_index Index of the statement adding a single lease
+    /// @param name Name of the statement
+    /// @param rows Number of leases stored by the statement
+    /// @param conflict "ON CONFLICT" clause of the statement
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    void prepareUpsertStatement(StatementIndex stindex,
+                                StatementIndex insert_index,
+                                const char* name, size_t rows,
+                                const char* conflict);
+
+    /// @brief Execute a statement
+    ///
+    /// Executes the statement which returns no data.
+    ///
+    /// @param stindex Index of statement being executed
+    /// @param params PostgreSQL parameters for the statement
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    void executeStatement(StatementIndex stindex, BindParams& params);
+
+    /// @brief Upsert Leases Common Code
+    ///
+    /// This method performs the common actions for both flavours (V4 and V6)
+    /// of the upsertLeases method.
+    ///
+    /// @param batch_index Index of the statement storing
+    ///        @c UPSERT_BATCH_SIZE leases
+    /// @param single_index Index of the statement storing a single lease
+    /// @param leases Leases to be stored
+    /// @param exchange Exchange object to use
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    template <typename Exchange, typename LeaseCollection>
+    void upsertLeasesCommon(StatementIndex batch_index,
+                            StatementIndex single_index,
+                            const LeaseCollection& leases,
+                            Exchange& exchange);
+
+    /// @brief Begins the transaction in the group commit mode.
+    ///
+    /// @throw bundy::dhcp::DbOperationError An operation on the open database has
+    ///        failed.
+    void beginTransaction();
+
+    /// @brief Accounts a lease change made in the group commit mode.
+    ///
+    /// It commits the pending changes if the first of them has been waiting
+    /// longer than the maximum commit delay.
+    ///
+    /// @param changes Number of leases changed.
+    void recordPendingCommit(const size_t changes = 1);
+
     /// @brief Add Lease Common Code
     ///
     /// This method performs the common actions for both flavours (V4 and V6)
@@ -599,6 +772,15 @@ private:
 
     /// PostgreSQL connection handle
     PGconn* conn_;
+
+    /// Maximum commit delay in milliseconds (0 if group commit is disabled)
+    uint32_t group_commit_delay_;
+
+    /// Number of lease changes made since the last commit
+    size_t pending_commits_;
+
+    /// Time when the first of the pending changes was made
+    boost::posix_time::ptime batch_start_;
 };
 
 }; // end of bundy::dhcp namespace
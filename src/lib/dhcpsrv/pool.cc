@@ -69,6 +69,12 @@ Pool4::Pool4( const bundy::asiolink::IOAddress& prefix, uint8_t prefix_len)
     last_ = lastAddrInPrefix(prefix, prefix_len);
 }
 
+uint64_t
+Pool4::getCapacity() const {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(last_)) -
+            static_cast<uint32_t>(first_) + 1);
+}
+
 
 Pool6::Pool6(Lease::Type type, const bundy::asiolink::IOAddress& first,
              const bundy::asiolink::IOAddress& last)
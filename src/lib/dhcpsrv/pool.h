@@ -17,6 +17,7 @@
 
 #include <asiolink/io_address.h>
 #include <boost/shared_ptr.hpp>
+#include <dhcpsrv/address_bitmap.h>
 #include <dhcpsrv/lease.h>
 
 #include <vector>
@@ -141,6 +142,32 @@ public:
     /// @param prefix_len specifies length of the prefix of the pool
     Pool4(const bundy::asiolink::IOAddress& prefix,
           uint8_t prefix_len);
+
+    /// @brief Returns the number of addresses in the pool.
+    uint64_t getCapacity() const;
+
+    /// @brief Returns the bitmap of the addresses in use in the pool.
+    ///
+    /// The bitmap is used by the allocation engine to find free addresses
+    /// without querying the lease database. It is created by the engine
+    /// when it first allocates from the pool, so this returns NULL until
+    /// then.
+    ///
+    /// @return Pointer to the bitmap (may be NULL).
+    const AddressBitmapPtr& getAddressBitmap() const {
+        return (bitmap_);
+    }
+
+    /// @brief Sets the bitmap of the addresses in use in the pool.
+    ///
+    /// @param bitmap Bitmap covering all addresses of the pool.
+    void setAddressBitmap(const AddressBitmapPtr& bitmap) {
+        bitmap_ = bitmap;
+    }
+
+private:
+    /// @brief Bitmap of the addresses in use in the pool.
+    AddressBitmapPtr bitmap_;
 };
 
 /// @brief a pointer an IPv4 Pool
@@ -27,6 +27,9 @@ namespace dhcp {
 // This is an initial value of subnet-id. See comments in subnet.h for details.
 SubnetID Subnet::static_id_ = 1;
 
+// The relay information has not been changed yet.
+uint32_t Subnet::relay_info_changes_ = 0;
+
 Subnet::Subnet(const bundy::asiolink::IOAddress& prefix, uint8_t len,
                const Triplet<uint32_t>& t1,
                const Triplet<uint32_t>& t2,
@@ -75,6 +78,7 @@ Subnet::addOption(const OptionPtr& option, bool persistent,
 void
 Subnet::setRelayInfo(const bundy::dhcp::Subnet::RelayInfo& relay) {
     relay_ = relay;
+    ++relay_info_changes_;
 }
 
 bool
@@ -428,6 +428,17 @@ public:
         return (relay_);
     }
 
+    /// @brief Returns the number of changes of the relay information.
+    ///
+    /// The value is increased every time the relay information of any
+    /// subnet is changed. It is used by the @c SubnetIndex to detect that
+    /// the relay addresses it holds are out of date.
+    ///
+    /// @return number of calls to @c Subnet::setRelayInfo for all subnets.
+    static uint32_t getRelayInfoChanges() {
+        return (relay_info_changes_);
+    }
+
     /// @brief checks whether this subnet supports client that belongs to
     ///        specified classes.
     ///
@@ -504,6 +515,11 @@ protected:
     /// Static value initialized in subnet.cc.
     static SubnetID static_id_;
 
+    /// @brief Number of changes of the relay information of all subnets.
+    ///
+    /// Static value initialized in subnet.cc.
+    static uint32_t relay_info_changes_;
+
     /// @brief returns the next unique Subnet-ID
     ///
     /// This method generates and returns the next unique subnet-id.
@@ -0,0 +1,327 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef SUBNET_INDEX_H
+#define SUBNET_INDEX_H
+
+#include <asiolink/io_address.h>
+#include <dhcp/classify.h>
+#include <dhcpsrv/subnet.h>
+#include <util/threads/sync.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace bundy {
+namespace dhcp {
+
+/// @brief Index of the subnets by prefix and relay address.
+///
+/// The index finds the subnet for an address without checking each subnet
+/// in turn. The subnet prefixes are held in a binary trie, so all subnets
+/// which include the address are found by walking the trie along the bits
+/// of the address, i.e. at most 32 (IPv4) or 128 (IPv6) steps regardless
+/// of the number of subnets. The relay addresses of the subnets are held
+/// in another trie and matched in full. Since the relay information of
+/// the subnet may be changed after the subnet has been added, the relay
+/// trie is rebuilt when the relay information of any subnet has changed
+/// (see @c Subnet::getRelayInfoChanges). The lookups may be done by several
+/// threads at once, so the relay trie is protected by a mutex.
+///
+/// The index remembers the order in which the subnets have been added.
+/// If more than one subnet matches the address (overlapping subnets, or
+/// the subnet matching by relay address and another one by prefix), the
+/// one added first wins, as it would if the subnets were checked in turn.
+/// The client classes are checked for the matching subnets only.
+///
+/// @tparam SubnetPtrType Type of the pointer to the subnet: Subnet4Ptr
+/// or Subnet6Ptr.
+template<typename SubnetPtrType>
+class SubnetIndex {
+public:
+
+    /// @brief Constructor.
+    ///
+    /// Creates an empty index.
+    SubnetIndex() : relay_info_changes_(0) {
+    }
+
+    /// @brief Adds the subnet to the index.
+    ///
+    /// @param subnet Subnet to be added. It takes precedence over the
+    /// subnets added after it.
+    void add(const SubnetPtrType& subnet) {
+        const uint32_t position = static_cast<uint32_t>(subnets_.size());
+        subnets_.push_back(subnet);
+        const std::pair<bundy::asiolink::IOAddress, uint8_t> prefix =
+            subnet->get();
+        prefixes_.insert(prefix.first.toBytes(), prefix.second, position);
+        if (relay_info_changes_ == Subnet::getRelayInfoChanges()) {
+            addRelay(position);
+        }
+    }
+
+    /// @brief Removes all subnets from the index.
+    void clear() {
+        subnets_.clear();
+        prefixes_.clear();
+        relays_.clear();
+    }
+
+    /// @brief Returns the number of subnets in the index.
+    size_t size() const {
+        return (subnets_.size());
+    }
+
+    /// @brief Finds the subnet for the address.
+    ///
+    /// @param addr Address which belongs to the subnet or, if relay is
+    /// true, the address of the relay configured for the subnet.
+    /// @param classes Classes the client belongs to.
+    /// @param relay true if the address may be the address of the relay.
+    /// @param [out] relay_match Set to true if the subnet has been selected
+    /// by the relay address, false otherwise.
+    ///
+    /// @return Pointer to the subnet or NULL if no subnet has been found.
+    SubnetPtrType find(const bundy::asiolink::IOAddress& addr,
+                       const ClientClasses& classes, const bool relay,
+                       bool& relay_match) const {
+        relay_match = false;
+        const std::vector<uint8_t> bytes = addr.toBytes();
+
+        Selector by_prefix(subnets_, classes);
+        prefixes_.match(bytes, false, by_prefix);
+
+        if (relay) {
+            bundy::util::thread::Mutex::Locker lock(relays_mutex_);
+            if (relay_info_changes_ != Subnet::getRelayInfoChanges()) {
+                updateRelays();
+            }
+            // The relay address is checked before the prefix of the
+            // same subnet, so the relay wins the tie.
+            Selector by_relay(subnets_, classes);
+            relays_.match(bytes, true, by_relay);
+            if (by_relay.found() &&
+                (by_relay.getPosition() <= by_prefix.getPosition())) {
+                relay_match = true;
+                return (subnets_[by_relay.getPosition()]);
+            }
+        }
+
+        return (by_prefix.found() ? subnets_[by_prefix.getPosition()] :
+                SubnetPtrType());
+    }
+
+private:
+
+    /// @brief Adds the relay address of the subnet to the relay trie.
+    ///
+    /// @param position Position of the subnet.
+    void addRelay(const uint32_t position) const {
+        const std::vector<uint8_t> relay =
+            subnets_[position]->getRelayInfo().addr_.toBytes();
+        relays_.insert(relay, relay.size() * 8, position);
+    }
+
+    /// @brief Rebuilds the relay trie from the current relay information.
+    void updateRelays() const {
+        relays_.clear();
+        relay_info_changes_ = Subnet::getRelayInfoChanges();
+        for (uint32_t position = 0; position < subnets_.size(); ++position) {
+            addRelay(position);
+        }
+    }
+
+    /// @brief Selects the subnet added first among the matching ones.
+    class Selector {
+    public:
+        /// @brief Constructor.
+        ///
+        /// @param subnets Subnets in the order of addition.
+        /// @param classes Classes the client belongs to.
+        Selector(const std::vector<SubnetPtrType>& subnets,
+                 const ClientClasses& classes)
+            : subnets_(subnets), classes_(classes),
+              position_(NOT_FOUND) {
+        }
+
+        /// @brief Considers the subnets matching the address.
+        ///
+        /// @param positions Positions of the matching subnets in the
+        /// order of addition.
+        void operator()(const std::vector<uint32_t>& positions) {
+            for (std::vector<uint32_t>::const_iterator pos =
+                     positions.begin();
+                 (pos != positions.end()) && (*pos < position_); ++pos) {
+                if (subnets_[*pos]->clientSupported(classes_)) {
+                    position_ = *pos;
+                    return;
+                }
+            }
+        }
+
+        /// @brief Checks if any subnet has been selected.
+        bool found() const {
+            return (position_ != NOT_FOUND);
+        }
+
+        /// @brief Returns the position of the selected subnet.
+        uint32_t getPosition() const {
+            return (position_);
+        }
+
+    private:
+        /// @brief Position indicating that no subnet has been selected.
+        static const uint32_t NOT_FOUND = 0xffffffff;
+
+        /// @brief Subnets in the order of addition.
+        const std::vector<SubnetPtrType>& subnets_;
+
+        /// @brief Classes the client belongs to.
+        const ClientClasses& classes_;
+
+        /// @brief Position of the selected subnet.
+        uint32_t position_;
+    };
+
+    /// @brief Binary trie of prefixes.
+    ///
+    /// Each node stores the positions of the subnets which have the prefix
+    /// leading to the node. The IPv4 and IPv6 prefixes have separate roots,
+    /// which are the first two nodes.
+    class Trie {
+    public:
+        /// @brief Constructor.
+        Trie() {
+            clear();
+        }
+
+        /// @brief Removes all prefixes.
+        void clear() {
+            nodes_.assign(2, Node());
+            positions_.clear();
+        }
+
+        /// @brief Inserts the prefix.
+        ///
+        /// @param bytes Address in the network byte order.
+        /// @param len Prefix length.
+        /// @param position Position of the subnet having the prefix.
+        void insert(const std::vector<uint8_t>& bytes, const size_t len,
+                    const uint32_t position) {
+            uint32_t node = getRoot(bytes);
+            for (size_t i = 0; i < len; ++i) {
+                const int bit = getBit(bytes, i);
+                if (nodes_[node].children_[bit] == 0) {
+                    nodes_[node].children_[bit] =
+                        static_cast<uint32_t>(nodes_.size());
+                    nodes_.push_back(Node());
+                }
+                node = nodes_[node].children_[bit];
+            }
+            // Only the nodes ending prefixes have the positions, so they
+            // are kept aside to keep the nodes small.
+            if (nodes_[node].positions_ == 0) {
+                positions_.push_back(std::vector<uint32_t>());
+                nodes_[node].positions_ =
+                    static_cast<uint32_t>(positions_.size());
+            }
+            positions_[nodes_[node].positions_ - 1].push_back(position);
+        }
+
+        /// @brief Passes the positions of the matching prefixes to the
+        /// selector.
+        ///
+        /// @param bytes Address in the network byte order.
+        /// @param exact If true, only the prefix covering the whole address
+        /// matches. Otherwise, all prefixes which include the address match.
+        /// @param selector Selector receiving the positions.
+        void match(const std::vector<uint8_t>& bytes, const bool exact,
+                   Selector& selector) const {
+            const size_t len = bytes.size() * 8;
+            uint32_t node = getRoot(bytes);
+            for (size_t i = 0; ; ++i) {
+                if ((nodes_[node].positions_ != 0) && (!exact || i == len)) {
+                    selector(positions_[nodes_[node].positions_ - 1]);
+                }
+                if (i == len) {
+                    return;
+                }
+                node = nodes_[node].children_[getBit(bytes, i)];
+                if (node == 0) {
+                    return;
+                }
+            }
+        }
+
+    private:
+        /// @brief Node of the trie.
+        struct Node {
+            /// @brief Constructor.
+            Node() : positions_(0) {
+                children_[0] = children_[1] = 0;
+            }
+
+            /// @brief Indexes of the child nodes, 0 if there is no child
+            /// (the root is never a child).
+            uint32_t children_[2];
+
+            /// @brief One-based index of the positions of the subnets in
+            /// the positions_ vector, 0 if there are none.
+            uint32_t positions_;
+        };
+
+        /// @brief Returns the root node for the address family.
+        static uint32_t getRoot(const std::vector<uint8_t>& bytes) {
+            return (bytes.size() == 4 ? 0 : 1);
+        }
+
+        /// @brief Returns the bit of the address, counting from the most
+        /// significant one.
+        static int getBit(const std::vector<uint8_t>& bytes, const size_t i) {
+            return ((bytes[i / 8] >> (7 - (i % 8))) & 1);
+        }
+
+        /// @brief Nodes of the trie.
+        std::vector<Node> nodes_;
+
+        /// @brief Positions of the subnets for the nodes ending prefixes.
+        std::vector<std::vector<uint32_t> > positions_;
+    };
+
+    /// @brief Subnets in the order of addition.
+    std::vector<SubnetPtrType> subnets_;
+
+    /// @brief Trie of the subnet prefixes.
+    Trie prefixes_;
+
+    /// @brief Trie of the relay addresses.
+    ///
+    /// It is mutable, because it is rebuilt by the lookup when the relay
+    /// information has changed.
+    mutable Trie relays_;
+
+    /// @brief Value of @c Subnet::getRelayInfoChanges when the relay trie
+    /// was built.
+    mutable uint32_t relay_info_changes_;
+
+    /// @brief Protects the relay trie.
+    mutable bundy::util::thread::Mutex relays_mutex_;
+};
+
+} // namespace bundy::dhcp
+} // namespace bundy
+
+#endif // SUBNET_INDEX_H
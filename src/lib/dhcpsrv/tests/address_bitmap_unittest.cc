@@ -0,0 +1,133 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <dhcpsrv/address_bitmap.h>
+#include <exceptions/exceptions.h>
+
+#include <gtest/gtest.h>
+
+using namespace bundy;
+using namespace bundy::dhcp;
+
+namespace {
+
+// Checks that a new bitmap has all addresses free.
+TEST(AddressBitmapTest, constructor) {
+    AddressBitmap bitmap(100);
+    EXPECT_EQ(100, bitmap.getSize());
+    EXPECT_EQ(100, bitmap.getFreeCount());
+    for (uint64_t i = 0; i < bitmap.getSize(); ++i) {
+        EXPECT_FALSE(bitmap.isUsed(i));
+    }
+    EXPECT_EQ(0, bitmap.getSyncTime());
+}
+
+// Checks that addresses can be marked used and free, and that the number
+// of free addresses follows.
+TEST(AddressBitmapTest, setUsedFree) {
+    AddressBitmap bitmap(130);
+
+    bitmap.setUsed(0);
+    bitmap.setUsed(64);
+    bitmap.setUsed(129);
+    EXPECT_TRUE(bitmap.isUsed(0));
+    EXPECT_TRUE(bitmap.isUsed(64));
+    EXPECT_TRUE(bitmap.isUsed(129));
+    EXPECT_FALSE(bitmap.isUsed(1));
+    EXPECT_FALSE(bitmap.isUsed(63));
+    EXPECT_EQ(127, bitmap.getFreeCount());
+
+    // Marking an address twice doesn't change the count.
+    bitmap.setUsed(64);
+    EXPECT_EQ(127, bitmap.getFreeCount());
+
+    bitmap.setFree(64);
+    EXPECT_FALSE(bitmap.isUsed(64));
+    EXPECT_EQ(128, bitmap.getFreeCount());
+    bitmap.setFree(64);
+    EXPECT_EQ(128, bitmap.getFreeCount());
+
+    bitmap.clear();
+    EXPECT_FALSE(bitmap.isUsed(0));
+    EXPECT_FALSE(bitmap.isUsed(129));
+    EXPECT_EQ(130, bitmap.getFreeCount());
+
+    // Offsets beyond the range are rejected.
+    EXPECT_THROW(bitmap.isUsed(130), bundy::OutOfRange);
+    EXPECT_THROW(bitmap.setUsed(130), bundy::OutOfRange);
+    EXPECT_THROW(bitmap.setFree(130), bundy::OutOfRange);
+}
+
+// Checks that the free addresses are found at or after the start offset,
+// wrapping around at the end of the range.
+TEST(AddressBitmapTest, findFree) {
+    AddressBitmap bitmap(200);
+    for (uint64_t i = 0; i < bitmap.getSize(); ++i) {
+        if (i != 10 && i != 150) {
+            bitmap.setUsed(i);
+        }
+    }
+
+    EXPECT_EQ(10, bitmap.findFree(0));
+    EXPECT_EQ(10, bitmap.findFree(10));
+    EXPECT_EQ(150, bitmap.findFree(11));
+    EXPECT_EQ(150, bitmap.findFree(150));
+    EXPECT_EQ(10, bitmap.findFree(151));
+    // The start offset is taken modulo the size.
+    EXPECT_EQ(10, bitmap.findFree(400));
+
+    // The variant with the end offset doesn't wrap.
+    EXPECT_EQ(150, bitmap.findFree(11, 200));
+    EXPECT_EQ(100, bitmap.findFree(11, 100));
+    EXPECT_EQ(200, bitmap.findFree(151, 200));
+    EXPECT_EQ(200, bitmap.findFree(151, 1000));
+
+    // When all addresses are used, the size is returned.
+    bitmap.setUsed(10);
+    bitmap.setUsed(150);
+    EXPECT_EQ(0, bitmap.getFreeCount());
+    EXPECT_EQ(200, bitmap.findFree(0));
+    EXPECT_EQ(200, bitmap.findFree(123));
+}
+
+// Checks that the unused bits of the last word are never reported as free.
+TEST(AddressBitmapTest, findFreeLastWord) {
+    AddressBitmap bitmap(70);
+    for (uint64_t i = 0; i < bitmap.getSize(); ++i) {
+        if (i != 3) {
+            bitmap.setUsed(i);
+        }
+    }
+    EXPECT_EQ(3, bitmap.findFree(65));
+    EXPECT_EQ(70, bitmap.findFree(65, 70));
+}
+
+// Checks that the synchronization time is recorded.
+TEST(AddressBitmapTest, syncTime) {
+    AddressBitmap bitmap(1);
+    bitmap.setSyncTime(1234);
+    EXPECT_EQ(1234, bitmap.getSyncTime());
+}
+
+// Checks that the offset of the synchronization in progress is recorded.
+TEST(AddressBitmapTest, syncOffset) {
+    AddressBitmap bitmap(100);
+    EXPECT_EQ(0, bitmap.getSyncOffset());
+    bitmap.setSyncOffset(64);
+    EXPECT_EQ(64, bitmap.getSyncOffset());
+}
+
+} // end of anonymous namespace
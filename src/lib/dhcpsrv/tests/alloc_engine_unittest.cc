@@ -64,6 +64,8 @@ public:
     // Expose internal classes for testing purposes
     using AllocEngine::Allocator;
     using AllocEngine::IterativeAllocator;
+    using AllocEngine::HashedAllocator;
+    using AllocEngine::RandomAllocator;
     using AllocEngine::getAllocator;
 
     /// @brief IterativeAllocator with internal methods exposed
@@ -453,6 +455,31 @@ public:
         /// @todo: check cltt
      }
 
+    /// @brief Adds leases for the addresses of the pool_ to the database
+    ///
+    /// @param except address which should be left free (a lease is added
+    ///        for every other address of the pool)
+    /// @param expired should the leases be expired
+    void fillPool4(const IOAddress& except, bool expired = false) {
+        uint8_t hwaddr2[] = { 0, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe };
+        const uint32_t first = pool_->getFirstAddress();
+        for (uint32_t addr = first; addr <= pool_->getLastAddress(); ++addr) {
+            if (IOAddress(addr) == except) {
+                continue;
+            }
+            // Use different client identifiers for different leases.
+            uint8_t clientid2[] = { 8, 7, 6, 5, 4, 3, 2,
+                                    static_cast<uint8_t>(addr & 0xff) };
+            hwaddr2[5] = addr & 0xff;
+            Lease4Ptr lease(new Lease4(IOAddress(addr), hwaddr2,
+                                       sizeof(hwaddr2), clientid2,
+                                       sizeof(clientid2), 500, 100, 200,
+                                       time(NULL) - (expired ? 1000 : 10),
+                                       subnet_->getID()));
+            ASSERT_TRUE(LeaseMgrFactory::instance().addLease(lease));
+        }
+    }
+
     virtual ~AllocEngine4Test() {
         factory_.destroy();
     }
@@ -992,11 +1019,13 @@ TEST_F(AllocEngine6Test, requestReuseExpiredLease6) {
 TEST_F(AllocEngine4Test, constructor) {
     boost::scoped_ptr<AllocEngine> x;
 
-    // Hashed and random allocators are not supported yet
-    ASSERT_THROW(x.reset(new AllocEngine(AllocEngine::ALLOC_HASHED, 5, false)),
-                 NotImplemented);
-    ASSERT_THROW(x.reset(new AllocEngine(AllocEngine::ALLOC_RANDOM, 5, false)),
-                 NotImplemented);
+    // Hashed and random allocators are supported for IPv4
+    ASSERT_NO_THROW(x.reset(new AllocEngine(AllocEngine::ALLOC_HASHED, 5,
+                                            false)));
+    ASSERT_TRUE(x->getAllocator(Lease::TYPE_V4));
+    ASSERT_NO_THROW(x.reset(new AllocEngine(AllocEngine::ALLOC_RANDOM, 5,
+                                            false)));
+    ASSERT_TRUE(x->getAllocator(Lease::TYPE_V4));
 
     // Create V4 (ipv6=false) Allocation Engine that will try at most
     // 100 attempts to pick up a lease
@@ -1310,6 +1339,245 @@ TEST_F(AllocEngine4Test, IterativeAllocator_manyPools4) {
 }
 
 
+// This test verifies that the iterative allocator skips the addresses
+// which are known to be used.
+TEST_F(AllocEngine4Test, IterativeAllocatorSkipUsed4) {
+    NakedAllocEngine::IterativeAllocator alloc(Lease::TYPE_V4);
+
+    // All addresses but 192.0.2.105 are used.
+    fillPool4(IOAddress("192.0.2.105"));
+
+    // The allocator should return the free address only.
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ("192.0.2.105",
+                  alloc.pickAddress(subnet_, clientid_,
+                                    IOAddress("0.0.0.0")).toText());
+    }
+
+    // The bitmap should have been created for the pool.
+    AddressBitmapPtr bitmap = pool_->getAddressBitmap();
+    ASSERT_TRUE(bitmap);
+    EXPECT_EQ(10, bitmap->getSize());
+    EXPECT_EQ(1, bitmap->getFreeCount());
+}
+
+// This test verifies that the iterative allocator still returns the
+// addresses in sequence when the pool is full, so as the expired leases
+// can be found.
+TEST_F(AllocEngine4Test, IterativeAllocatorFullPool4) {
+    NakedAllocEngine::IterativeAllocator alloc(Lease::TYPE_V4);
+
+    fillPool4(IOAddress("0.0.0.0"));
+
+    std::set<IOAddress> generated_addrs;
+    for (int i = 0; i < 10; ++i) {
+        IOAddress candidate = alloc.pickAddress(subnet_, clientid_,
+                                                IOAddress("0.0.0.0"));
+        EXPECT_TRUE(subnet_->inPool(Lease::TYPE_V4, candidate));
+        generated_addrs.insert(candidate);
+    }
+    EXPECT_EQ(10, generated_addrs.size());
+}
+
+// This test verifies that the hashed allocator returns the same free
+// address for the same client and different addresses for different
+// clients.
+TEST_F(AllocEngine4Test, HashedAllocator4) {
+    NakedAllocEngine::HashedAllocator alloc(Lease::TYPE_V4);
+
+    const IOAddress addr = alloc.pickAddress(subnet_, clientid_,
+                                             IOAddress("0.0.0.0"));
+    EXPECT_TRUE(subnet_->inPool(Lease::TYPE_V4, addr));
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(addr, alloc.pickAddress(subnet_, clientid_,
+                                          IOAddress("0.0.0.0")));
+    }
+
+    // Clients with different identifiers should not all get the same
+    // address.
+    std::set<IOAddress> generated_addrs;
+    for (uint8_t i = 0; i < 10; ++i) {
+        ClientIdPtr clientid(new ClientId(vector<uint8_t>(8, i)));
+        IOAddress candidate = alloc.pickAddress(subnet_, clientid,
+                                                IOAddress("0.0.0.0"));
+        EXPECT_TRUE(subnet_->inPool(Lease::TYPE_V4, candidate));
+        generated_addrs.insert(candidate);
+    }
+    EXPECT_LT(1, generated_addrs.size());
+
+    // Once the address is used, the client should get a different one.
+    AllocEngine::updateAddressBitmap(subnet_, addr, true);
+    const IOAddress other = alloc.pickAddress(subnet_, clientid_,
+                                              IOAddress("0.0.0.0"));
+    EXPECT_NE(addr, other);
+    EXPECT_TRUE(subnet_->inPool(Lease::TYPE_V4, other));
+
+    // Only IPv4 addresses are supported.
+    EXPECT_THROW(NakedAllocEngine::HashedAllocator(Lease::TYPE_NA),
+                 NotImplemented);
+}
+
+// This test verifies that the random allocator returns addresses from
+// the pool and skips the used ones.
+TEST_F(AllocEngine4Test, RandomAllocator4) {
+    NakedAllocEngine::RandomAllocator alloc(Lease::TYPE_V4);
+
+    for (int i = 0; i < 100; ++i) {
+        IOAddress candidate = alloc.pickAddress(subnet_, clientid_,
+                                                IOAddress("0.0.0.0"));
+        EXPECT_TRUE(subnet_->inPool(Lease::TYPE_V4, candidate));
+    }
+
+    // Make the whole pool used but a single address.
+    fillPool4(IOAddress("192.0.2.103"));
+    for (uint32_t addr = pool_->getFirstAddress();
+         addr <= pool_->getLastAddress(); ++addr) {
+        AllocEngine::updateAddressBitmap(subnet_, IOAddress(addr),
+                                         addr != IOAddress("192.0.2.103"));
+    }
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ("192.0.2.103",
+                  alloc.pickAddress(subnet_, clientid_,
+                                    IOAddress("0.0.0.0")).toText());
+    }
+
+    // Only IPv4 addresses are supported.
+    EXPECT_THROW(NakedAllocEngine::RandomAllocator(Lease::TYPE_PD),
+                 NotImplemented);
+}
+
+// This test checks that the allocation engine finds the last free address
+// of a pool at the first attempt and records allocated and released
+// addresses in the bitmap of the pool.
+TEST_F(AllocEngine4Test, addressBitmap4) {
+    boost::scoped_ptr<AllocEngine> engine;
+    ASSERT_NO_THROW(engine.reset(new AllocEngine(AllocEngine::ALLOC_ITERATIVE,
+                                                 1, false)));
+
+    fillPool4(IOAddress("192.0.2.107"));
+
+    // Fake allocation doesn't mark the address as used.
+    Lease4Ptr lease = engine->allocateLease4(subnet_, clientid_, hwaddr_,
+                                             IOAddress("0.0.0.0"),
+                                             false, false, "",
+                                             true, CalloutHandlePtr(),
+                                             old_lease_);
+    ASSERT_TRUE(lease);
+    EXPECT_EQ("192.0.2.107", lease->addr_.toText());
+    AddressBitmapPtr bitmap = pool_->getAddressBitmap();
+    ASSERT_TRUE(bitmap);
+    EXPECT_EQ(1, bitmap->getFreeCount());
+
+    // Real allocation does.
+    lease = engine->allocateLease4(subnet_, clientid_, hwaddr_,
+                                   IOAddress("0.0.0.0"), false, false, "",
+                                   false, CalloutHandlePtr(), old_lease_);
+    ASSERT_TRUE(lease);
+    EXPECT_EQ("192.0.2.107", lease->addr_.toText());
+    EXPECT_EQ(0, bitmap->getFreeCount());
+    EXPECT_TRUE(bitmap->isUsed(7));
+
+    // Release the address.
+    ASSERT_TRUE(LeaseMgrFactory::instance().deleteLease(lease->addr_));
+    AllocEngine::updateAddressBitmap(subnet_, lease->addr_, false);
+    EXPECT_EQ(1, bitmap->getFreeCount());
+    EXPECT_FALSE(bitmap->isUsed(7));
+
+    // Addresses outside of the pools are ignored.
+    EXPECT_NO_THROW(AllocEngine::updateAddressBitmap(subnet_,
+                                                     IOAddress("192.0.2.1"),
+                                                     true));
+    EXPECT_EQ(1, bitmap->getFreeCount());
+}
+
+// This test checks that the exhausted bitmap is synchronized with the
+// lease database again, so as the expired leases are found.
+TEST_F(AllocEngine4Test, addressBitmapSync4) {
+    fillPool4(IOAddress("0.0.0.0"), true);
+
+    // The leases are expired, so the addresses are free.
+    AddressBitmapPtr bitmap = AllocEngine::getAddressBitmap(pool_);
+    ASSERT_TRUE(bitmap);
+    EXPECT_EQ(10, bitmap->getFreeCount());
+
+    // Pretend the engine has allocated all addresses.
+    for (uint64_t i = 0; i < bitmap->getSize(); ++i) {
+        bitmap->setUsed(i);
+    }
+
+    // The bitmap has just been synchronized, so it is not synchronized
+    // again.
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool_));
+    EXPECT_EQ(0, bitmap->getFreeCount());
+
+    // After the interval, the addresses should be found free again.
+    bitmap->setSyncTime(time(NULL) - AllocEngine::BITMAP_SYNC_INTERVAL);
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool_));
+    EXPECT_EQ(10, bitmap->getFreeCount());
+}
+
+// This test checks that the exhausted bitmap of a large pool is
+// synchronized one batch of addresses at a time.
+TEST_F(AllocEngine4Test, addressBitmapSyncBatches4) {
+    const size_t batch = AllocEngine::BITMAP_SYNC_BATCH_SIZE;
+    Pool4Ptr pool(new Pool4(IOAddress("10.0.0.0"),
+                            IOAddress(static_cast<uint32_t>(
+                                IOAddress("10.0.0.0")) + 2 * batch + 9)));
+
+    // There are no leases, so all addresses are free.
+    AddressBitmapPtr bitmap = AllocEngine::getAddressBitmap(pool);
+    ASSERT_TRUE(bitmap);
+    ASSERT_EQ(2 * batch + 10, bitmap->getSize());
+    EXPECT_EQ(bitmap->getSize(), bitmap->getFreeCount());
+
+    // Pretend the engine has allocated all addresses a while ago.
+    for (uint64_t i = 0; i < bitmap->getSize(); ++i) {
+        bitmap->setUsed(i);
+    }
+    const time_t sync_time = time(NULL) - AllocEngine::BITMAP_SYNC_INTERVAL;
+    bitmap->setSyncTime(sync_time);
+
+    // Only the first batch is synchronized.
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool));
+    EXPECT_EQ(batch, bitmap->getFreeCount());
+    EXPECT_FALSE(bitmap->isUsed(batch - 1));
+    EXPECT_TRUE(bitmap->isUsed(batch));
+    EXPECT_EQ(batch, bitmap->getSyncOffset());
+    EXPECT_EQ(sync_time, bitmap->getSyncTime());
+
+    // As long as there are free addresses, nothing more is done.
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool));
+    EXPECT_EQ(batch, bitmap->getFreeCount());
+
+    // Once they are allocated, the pass goes on with the next batch, even
+    // though the interval has not elapsed since the pass started.
+    for (uint64_t i = 0; i < batch; ++i) {
+        bitmap->setUsed(i);
+    }
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool));
+    EXPECT_EQ(batch, bitmap->getFreeCount());
+    EXPECT_TRUE(bitmap->isUsed(batch - 1));
+    EXPECT_FALSE(bitmap->isUsed(batch));
+    EXPECT_EQ(2 * batch, bitmap->getSyncOffset());
+
+    // The last, partial batch completes the pass.
+    for (uint64_t i = batch; i < 2 * batch; ++i) {
+        bitmap->setUsed(i);
+    }
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool));
+    EXPECT_EQ(10, bitmap->getFreeCount());
+    EXPECT_EQ(0, bitmap->getSyncOffset());
+    EXPECT_LT(sync_time, bitmap->getSyncTime());
+
+    // The next pass waits for the interval.
+    for (uint64_t i = 2 * batch; i < bitmap->getSize(); ++i) {
+        bitmap->setUsed(i);
+    }
+    EXPECT_EQ(bitmap, AllocEngine::getAddressBitmap(pool));
+    EXPECT_EQ(0, bitmap->getFreeCount());
+    EXPECT_EQ(0, bitmap->getSyncOffset());
+}
+
 // This test checks if really small pools are working
 TEST_F(AllocEngine4Test, smallPool4) {
     boost::scoped_ptr<AllocEngine> engine;
@@ -1460,6 +1728,54 @@ TEST_F(AllocEngine4Test, discoverReuseExpiredLease4) {
     EXPECT_TRUE(*old_lease_ == original_lease);
 }
 
+// This test checks that the allocation returns when the only expired lease
+// of the subnet is outside of its pools (e.g. after the pool has shrunk).
+TEST_F(AllocEngine4Test, expiredLeaseOutOfPool4) {
+    boost::scoped_ptr<AllocEngine> engine;
+    ASSERT_NO_THROW(engine.reset(new AllocEngine(AllocEngine::ALLOC_ITERATIVE,
+                                                 100, false)));
+    ASSERT_TRUE(engine);
+
+    IOAddress addr("192.0.2.15");
+    CfgMgr& cfg_mgr = CfgMgr::instance();
+    cfg_mgr.deleteSubnets4(); // Get rid of the default test configuration
+
+    // Create configuration similar to other tests, but with a single address pool
+    subnet_ = Subnet4Ptr(new Subnet4(IOAddress("192.0.2.0"), 24, 1, 2, 3));
+    pool_ = Pool4Ptr(new Pool4(addr, addr)); // just a single address
+    subnet_->addPool(pool_);
+    cfg_mgr.addSubnet4(subnet_);
+
+    // The only address of the pool is in use by another client
+    uint8_t hwaddr2[] = { 0, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe};
+    uint8_t clientid2[] = { 8, 7, 6, 5, 4, 3, 2, 1 };
+    Lease4Ptr lease(new Lease4(addr, clientid2, sizeof(clientid2),
+                               hwaddr2, sizeof(hwaddr2),
+                               495, 100, 200, time(NULL), subnet_->getID()));
+    ASSERT_FALSE(lease->expired());
+    ASSERT_TRUE(LeaseMgrFactory::instance().addLease(lease));
+
+    // And an expired lease of the subnet is outside of the pool
+    uint8_t hwaddr3[] = { 0, 0xfd, 0xfd, 0xfd, 0xfd, 0xfd};
+    uint8_t clientid3[] = { 9, 8, 7, 6, 5, 4, 3, 2 };
+    lease.reset(new Lease4(IOAddress("192.0.2.100"), clientid3,
+                           sizeof(clientid3), hwaddr3, sizeof(hwaddr3),
+                           495, 100, 200, time(NULL) - 500,
+                           subnet_->getID()));
+    ASSERT_TRUE(lease->expired());
+    ASSERT_TRUE(LeaseMgrFactory::instance().addLease(lease));
+
+    // Nothing can be allocated, but the allocation must give up.
+    for (int i = 0; i < 2; ++i) {
+        lease = engine->allocateLease4(subnet_, clientid_, hwaddr_,
+                                       IOAddress("0.0.0.0"),
+                                       false, false, "",
+                                       true, CalloutHandlePtr(),
+                                       old_lease_);
+        EXPECT_FALSE(lease);
+    }
+}
+
 // This test checks if an expired lease can be reused in REQUEST (actual allocation)
 TEST_F(AllocEngine4Test, requestReuseExpiredLease4) {
     boost::scoped_ptr<AllocEngine> engine;
@@ -87,10 +87,11 @@ public:
             }
 
             // Add the keyword and value - make sure that they are quoted.
-            // The only parameter which is not quoted is persist as it
-            // is a boolean value.
+            // The only parameters which are not quoted are persist as it
+            // is a boolean value and group-commit-delay as it is an integer.
             result += quote + keyval[i] + quote + colon + space;
-            if (std::string(keyval[i]) != "persist") {
+            if ((std::string(keyval[i]) != "persist") &&
+                (std::string(keyval[i]) != "group-commit-delay")) {
                 result += quote + keyval[i + 1] + quote;
             } else {
                 result += keyval[i + 1];
@@ -281,6 +282,26 @@ TEST_F(DbAccessParserTest, persistV6Memfile) {
                       config, Option::V6);
 }
 
+// Check that the parser converts the integer group commit delay to the
+// parameter of the database access string.
+TEST_F(DbAccessParserTest, groupCommitDelayMemfile) {
+    const char* config[] = {"type", "memfile",
+                            "persist", "true",
+                            "name", "/opt/bundy/var/kea-leases4.csv",
+                            "group-commit-delay", "10",
+                            NULL};
+
+    string json_config = toJson(config);
+    ConstElementPtr json_elements = Element::fromJSON(json_config);
+    EXPECT_TRUE(json_elements);
+
+    TestDbAccessParser parser("lease-database", ParserContext(Option::V4));
+    EXPECT_NO_THROW(parser.build(json_elements));
+
+    checkAccessString("Valid memfile", parser.getDbAccessParameters(),
+                      config);
+}
+
 // Check that the parser works with a valid MySQL configuration
 TEST_F(DbAccessParserTest, validTypeMysql) {
     const char* config[] = {"type",     "mysql",
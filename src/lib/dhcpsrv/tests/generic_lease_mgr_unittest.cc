@@ -16,6 +16,8 @@
 #include <dhcpsrv/tests/test_utils.h>
 #include <asiolink/io_address.h>
 #include <gtest/gtest.h>
+#include <ctime>
+#include <map>
 #include <sstream>
 
 using namespace std;
@@ -1507,6 +1509,259 @@ GenericLeaseMgrTest::testRecreateLease6() {
 }
 
 
+namespace {
+
+/// Number of leases used by the bulk tests. It exceeds the number of leases
+/// the database backends handle in a single statement.
+const int BULK_LEASES = 150;
+
+/// @brief Returns the IPv4 address used by the bulk tests.
+IOAddress
+bulkAddress4(const int index) {
+    ostringstream s;
+    s << "192.0.3." << index;
+    return (IOAddress(s.str()));
+}
+
+/// @brief Returns the copy of the IPv4 lease for the bulk tests.
+///
+/// The hardware address is made unique, as some backends don't hold two
+/// leases for the same client in the subnet.
+Lease4Ptr
+bulkLease4(const Lease4Ptr& tmpl, const int index) {
+    Lease4Ptr lease(new Lease4(*tmpl));
+    lease->addr_ = bulkAddress4(index);
+    lease->hwaddr_ = vector<uint8_t>(6, 0x10);
+    lease->hwaddr_[5] = static_cast<uint8_t>(index);
+    return (lease);
+}
+
+/// @brief Returns the IPv6 address used by the bulk tests.
+IOAddress
+bulkAddress6(const int index) {
+    ostringstream s;
+    s << "2001:db8:3::" << hex << index;
+    return (IOAddress(s.str()));
+}
+
+/// @brief Returns the copy of the IPv6 lease for the bulk tests.
+///
+/// The IAID is made unique, as some backends don't hold two leases for
+/// the same IA in the subnet.
+Lease6Ptr
+bulkLease6(const Lease6Ptr& tmpl, const int index) {
+    Lease6Ptr lease(new Lease6(*tmpl));
+    lease->addr_ = bulkAddress6(index);
+    lease->iaid_ = index;
+    return (lease);
+}
+
+}
+
+void
+GenericLeaseMgrTest::testGetLeases4Multiple() {
+    // Add a lease for every other address.
+    Lease4Ptr tmpl = initializeLease4(straddress4_[1]);
+    vector<IOAddress> addrs;
+    map<string, Lease4Ptr> added;
+    for (int i = 1; i <= BULK_LEASES; ++i) {
+        addrs.push_back(bulkAddress4(i));
+        if (i % 2 == 0) {
+            Lease4Ptr lease = bulkLease4(tmpl, i);
+            ASSERT_TRUE(lmptr_->addLease(lease));
+            added[lease->addr_.toText()] = lease;
+        }
+    }
+    lmptr_->commit();
+
+    Lease4Collection returned = lmptr_->getLeases4(addrs);
+    ASSERT_EQ(added.size(), returned.size());
+    for (Lease4Collection::const_iterator it = returned.begin();
+         it != returned.end(); ++it) {
+        map<string, Lease4Ptr>::iterator lease =
+            added.find((*it)->addr_.toText());
+        ASSERT_TRUE(lease != added.end()) << (*it)->addr_.toText();
+        detailCompareLease(lease->second, *it);
+        added.erase(lease);
+    }
+
+    // No addresses, no leases.
+    EXPECT_TRUE(lmptr_->getLeases4(vector<IOAddress>()).empty());
+}
+
+void
+GenericLeaseMgrTest::testGetLeases6Multiple() {
+    // Add a lease for every other address.
+    Lease6Ptr tmpl = initializeLease6(straddress6_[0]);
+    ASSERT_EQ(Lease::TYPE_NA, tmpl->type_);
+    vector<IOAddress> addrs;
+    map<string, Lease6Ptr> added;
+    for (int i = 1; i <= BULK_LEASES; ++i) {
+        addrs.push_back(bulkAddress6(i));
+        if (i % 2 == 0) {
+            Lease6Ptr lease = bulkLease6(tmpl, i);
+            ASSERT_TRUE(lmptr_->addLease(lease));
+            added[lease->addr_.toText()] = lease;
+        }
+    }
+    lmptr_->commit();
+
+    Lease6Collection returned = lmptr_->getLeases6(Lease::TYPE_NA, addrs);
+    ASSERT_EQ(added.size(), returned.size());
+    for (Lease6Collection::const_iterator it = returned.begin();
+         it != returned.end(); ++it) {
+        map<string, Lease6Ptr>::iterator lease =
+            added.find((*it)->addr_.toText());
+        ASSERT_TRUE(lease != added.end()) << (*it)->addr_.toText();
+        detailCompareLease(lease->second, *it);
+        added.erase(lease);
+    }
+}
+
+void
+GenericLeaseMgrTest::testUpsertLeases4() {
+    // Add some of the leases upfront.
+    Lease4Ptr tmpl = initializeLease4(straddress4_[1]);
+    Lease4Collection leases;
+    for (int i = 1; i <= BULK_LEASES; ++i) {
+        Lease4Ptr lease = bulkLease4(tmpl, i);
+        if (i % 3 == 0) {
+            ASSERT_TRUE(lmptr_->addLease(lease));
+            // Make a copy, so as the stored lease is not modified.
+            lease.reset(new Lease4(*lease));
+            ++lease->valid_lft_;
+            lease->hostname_ = "updated.example.com.";
+        }
+        leases.push_back(lease);
+    }
+    lmptr_->commit();
+
+    ASSERT_NO_THROW(lmptr_->upsertLeases4(leases));
+    lmptr_->commit();
+
+    for (Lease4Collection::const_iterator it = leases.begin();
+         it != leases.end(); ++it) {
+        Lease4Ptr returned = lmptr_->getLease4((*it)->addr_);
+        ASSERT_TRUE(returned) << (*it)->addr_.toText();
+        detailCompareLease(*it, returned);
+    }
+
+    // Storing no leases is fine.
+    EXPECT_NO_THROW(lmptr_->upsertLeases4(Lease4Collection()));
+}
+
+void
+GenericLeaseMgrTest::testUpsertLeases6() {
+    // Add some of the leases upfront.
+    Lease6Ptr tmpl = initializeLease6(straddress6_[0]);
+    Lease6Collection leases;
+    for (int i = 1; i <= BULK_LEASES; ++i) {
+        Lease6Ptr lease = bulkLease6(tmpl, i);
+        if (i % 3 == 0) {
+            ASSERT_TRUE(lmptr_->addLease(lease));
+            // Make a copy, so as the stored lease is not modified.
+            lease.reset(new Lease6(*lease));
+            ++lease->valid_lft_;
+            ++lease->preferred_lft_;
+            lease->hostname_ = "updated.example.com.";
+        }
+        leases.push_back(lease);
+    }
+    lmptr_->commit();
+
+    ASSERT_NO_THROW(lmptr_->upsertLeases6(leases));
+    lmptr_->commit();
+
+    for (Lease6Collection::const_iterator it = leases.begin();
+         it != leases.end(); ++it) {
+        Lease6Ptr returned = lmptr_->getLease6(Lease::TYPE_NA, (*it)->addr_);
+        ASSERT_TRUE(returned) << (*it)->addr_.toText();
+        detailCompareLease(*it, returned);
+    }
+}
+
+void
+GenericLeaseMgrTest::testGetExpiredLeases4() {
+    const SubnetID subnet_id = 1234;
+    const time_t now = time(NULL);
+    Lease4Ptr tmpl = initializeLease4(straddress4_[1]);
+    tmpl->subnet_id_ = subnet_id;
+    tmpl->valid_lft_ = 1000;
+
+    // Leases with the even index have expired, the one with the highest
+    // index the longest ago. The others are still valid.
+    for (int i = 1; i <= 10; ++i) {
+        Lease4Ptr lease = bulkLease4(tmpl, i);
+        lease->cltt_ = (i % 2 == 0 ? now - 1000 - i * 10 : now);
+        ASSERT_TRUE(lmptr_->addLease(lease));
+    }
+    // Expired lease in another subnet.
+    Lease4Ptr other = bulkLease4(tmpl, 100);
+    other->subnet_id_ = subnet_id + 1;
+    other->cltt_ = now - 5000;
+    ASSERT_TRUE(lmptr_->addLease(other));
+    lmptr_->commit();
+
+    Lease4Collection expired = lmptr_->getExpiredLeases4(subnet_id, 100);
+    ASSERT_EQ(5, expired.size());
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(bulkAddress4(10 - 2 * i).toText(),
+                  expired[i]->addr_.toText());
+        EXPECT_EQ(subnet_id, expired[i]->subnet_id_);
+    }
+
+    // The number of leases is limited.
+    expired = lmptr_->getExpiredLeases4(subnet_id, 2);
+    ASSERT_EQ(2, expired.size());
+    EXPECT_EQ(bulkAddress4(10).toText(), expired[0]->addr_.toText());
+    EXPECT_EQ(bulkAddress4(8).toText(), expired[1]->addr_.toText());
+
+    // Nothing has expired in the unknown subnet.
+    EXPECT_TRUE(lmptr_->getExpiredLeases4(subnet_id + 2, 100).empty());
+}
+
+void
+GenericLeaseMgrTest::testGetExpiredLeases6() {
+    const SubnetID subnet_id = 1234;
+    const time_t now = time(NULL);
+    Lease6Ptr tmpl = initializeLease6(straddress6_[0]);
+    tmpl->subnet_id_ = subnet_id;
+    tmpl->valid_lft_ = 1000;
+    tmpl->preferred_lft_ = 500;
+
+    // Leases with the even index have expired, the one with the highest
+    // index the longest ago. The others are still valid.
+    for (int i = 1; i <= 10; ++i) {
+        Lease6Ptr lease = bulkLease6(tmpl, i);
+        lease->cltt_ = (i % 2 == 0 ? now - 1000 - i * 10 : now);
+        ASSERT_TRUE(lmptr_->addLease(lease));
+    }
+    // Expired lease of another type.
+    Lease6Ptr other = bulkLease6(tmpl, 100);
+    other->type_ = Lease::TYPE_TA;
+    other->cltt_ = now - 5000;
+    ASSERT_TRUE(lmptr_->addLease(other));
+    lmptr_->commit();
+
+    Lease6Collection expired =
+        lmptr_->getExpiredLeases6(Lease::TYPE_NA, subnet_id, 100);
+    ASSERT_EQ(5, expired.size());
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(bulkAddress6(10 - 2 * i).toText(),
+                  expired[i]->addr_.toText());
+    }
+
+    // The number of leases is limited.
+    expired = lmptr_->getExpiredLeases6(Lease::TYPE_NA, subnet_id, 1);
+    ASSERT_EQ(1, expired.size());
+    EXPECT_EQ(bulkAddress6(10).toText(), expired[0]->addr_.toText());
+
+    expired = lmptr_->getExpiredLeases6(Lease::TYPE_TA, subnet_id, 100);
+    ASSERT_EQ(1, expired.size());
+    EXPECT_EQ(bulkAddress6(100).toText(), expired[0]->addr_.toText());
+}
+
+
 }; // namespace test
 }; // namespace dhcp
 }; // namespace bundy
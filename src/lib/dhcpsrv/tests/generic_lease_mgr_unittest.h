@@ -245,6 +245,33 @@ public:
     /// persistent storage has been updated as expected.
     void testRecreateLease6();
 
+    /// @brief Checks that the IPv4 leases are retrieved for many addresses.
+    ///
+    /// Looks up more addresses than a single database query takes, some of
+    /// which have no lease, and checks that all existing leases are returned.
+    void testGetLeases4Multiple();
+
+    /// @brief Checks that the IPv6 leases are retrieved for many addresses.
+    void testGetLeases6Multiple();
+
+    /// @brief Checks that the IPv4 leases are added or updated in bulk.
+    ///
+    /// Stores more leases than a single database statement takes, some of
+    /// which already exist, and checks that all leases have been stored.
+    void testUpsertLeases4();
+
+    /// @brief Checks that the IPv6 leases are added or updated in bulk.
+    void testUpsertLeases6();
+
+    /// @brief Checks that the expired IPv4 leases of the subnet are returned.
+    ///
+    /// Checks that only the expired leases of the subnet are returned, the
+    /// longest expired first, and that their number is limited.
+    void testGetExpiredLeases4();
+
+    /// @brief Checks that the expired IPv6 leases of the subnet are returned.
+    void testGetExpiredLeases6();
+
     /// @brief String forms of IPv4 addresses
     std::vector<std::string>  straddress4_;
 
@@ -23,11 +23,17 @@
 #include <dhcpsrv/tests/lease_file_io.h>
 #include <dhcpsrv/tests/test_utils.h>
 #include <dhcpsrv/tests/generic_lease_mgr_unittest.h>
+#include <util/threads/thread.h>
 #include <gtest/gtest.h>
 
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
+#include <unistd.h>
+
 using namespace std;
 using namespace bundy;
 using namespace bundy::asiolink;
@@ -404,6 +410,486 @@ TEST_F(MemfileLeaseMgrTest, testRecreateLease6) {
     testRecreateLease6();
 }
 
+// Checks that the IPv4 leases are retrieved for many addresses at once.
+TEST_F(MemfileLeaseMgrTest, getLeases4Multiple) {
+    startBackend(V4);
+    testGetLeases4Multiple();
+}
+
+// Checks that the IPv6 leases are retrieved for many addresses at once.
+TEST_F(MemfileLeaseMgrTest, getLeases6Multiple) {
+    startBackend(V6);
+    testGetLeases6Multiple();
+}
+
+// Checks that the IPv4 leases are added or updated in bulk.
+TEST_F(MemfileLeaseMgrTest, upsertLeases4) {
+    startBackend(V4);
+    testUpsertLeases4();
+}
+
+// Checks that the IPv6 leases are added or updated in bulk.
+TEST_F(MemfileLeaseMgrTest, upsertLeases6) {
+    startBackend(V6);
+    testUpsertLeases6();
+}
+
+// Checks that the expired IPv4 leases of the subnet are returned.
+TEST_F(MemfileLeaseMgrTest, getExpiredLeases4) {
+    startBackend(V4);
+    testGetExpiredLeases4();
+}
+
+// Checks that the expired IPv6 leases of the subnet are returned.
+TEST_F(MemfileLeaseMgrTest, getExpiredLeases6) {
+    startBackend(V6);
+    testGetExpiredLeases6();
+}
+
+// Checks that the secondary indexes of the lease container follow the
+// updates of the lease. Leases are held by value in hashed indexes, so
+// an update which modifies the hardware address or the client identifier
+// must make the lease available under the new values only.
+TEST_F(MemfileLeaseMgrTest, updateLease4Indexes) {
+    startBackend(V4);
+    Lease4Ptr lease = initializeLease4(straddress4_[1]);
+    ASSERT_TRUE(lease);
+    ASSERT_TRUE(lmptr_->addLease(lease));
+
+    HWAddr old_hwaddr(lease->hwaddr_, HTYPE_ETHER);
+    ClientId old_client_id(lease->client_id_->getClientId());
+
+    // Modify the hardware address and the client identifier.
+    Lease4Ptr updated(new Lease4(*lease));
+    updated->hwaddr_[0] ^= 0xFF;
+    std::vector<uint8_t> client_id = lease->client_id_->getClientId();
+    client_id[0] ^= 0xFF;
+    updated->client_id_.reset(new ClientId(client_id));
+    ASSERT_NO_THROW(lmptr_->updateLease4(updated));
+
+    HWAddr new_hwaddr(updated->hwaddr_, HTYPE_ETHER);
+    ClientId new_client_id(client_id);
+
+    // The lease should not be found using the old values.
+    EXPECT_FALSE(lmptr_->getLease4(old_hwaddr, lease->subnet_id_));
+    EXPECT_FALSE(lmptr_->getLease4(old_client_id, lease->subnet_id_));
+    EXPECT_FALSE(lmptr_->getLease4(old_client_id, old_hwaddr,
+                                   lease->subnet_id_));
+
+    // The lease should be found using the new values.
+    Lease4Ptr returned = lmptr_->getLease4(new_hwaddr, lease->subnet_id_);
+    ASSERT_TRUE(returned);
+    detailCompareLease(updated, returned);
+    returned = lmptr_->getLease4(new_client_id, lease->subnet_id_);
+    ASSERT_TRUE(returned);
+    detailCompareLease(updated, returned);
+    returned = lmptr_->getLease4(new_client_id, new_hwaddr,
+                                 lease->subnet_id_);
+    ASSERT_TRUE(returned);
+    detailCompareLease(updated, returned);
+}
+
+// Checks that a lease can't be updated to, or added with, the hardware
+// address and subnet of another lease, and that neither the stored leases
+// nor the lease file are modified then.
+TEST_F(MemfileLeaseMgrTest, updateLease4Conflict) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+
+    Lease4Ptr lease1 = initializeLease4(straddress4_[1]);
+    Lease4Ptr lease2 = initializeLease4(straddress4_[2]);
+    lease2->subnet_id_ = lease1->subnet_id_;
+    lease2->hwaddr_ = lease1->hwaddr_;
+    lease2->hwaddr_[0] ^= 0xFF;
+    ASSERT_TRUE(lease_mgr->addLease(lease1));
+    ASSERT_TRUE(lease_mgr->addLease(lease2));
+    const std::string contents = io4_.readFile();
+
+    Lease4Ptr updated(new Lease4(*lease2));
+    updated->hwaddr_ = lease1->hwaddr_;
+    EXPECT_THROW(lease_mgr->updateLease4(updated), DbOperationError);
+    Lease4Ptr added = initializeLease4(straddress4_[3]);
+    added->subnet_id_ = lease1->subnet_id_;
+    added->hwaddr_ = lease1->hwaddr_;
+    EXPECT_THROW(lease_mgr->addLease(added), DbOperationError);
+    EXPECT_EQ(contents, io4_.readFile());
+
+    // Nothing has changed, in the memory or in the lease file.
+    for (int i = 0; i < 2; ++i) {
+        Lease4Ptr returned = lease_mgr->getLease4(lease2->addr_);
+        ASSERT_TRUE(returned);
+        detailCompareLease(lease2, returned);
+        returned = lease_mgr->getLease4(HWAddr(lease1->hwaddr_, HTYPE_ETHER),
+                                        lease1->subnet_id_);
+        ASSERT_TRUE(returned);
+        detailCompareLease(lease1, returned);
+        EXPECT_FALSE(lease_mgr->getLease4(added->addr_));
+        lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    }
+}
+
+// Checks that a lease can't be updated to the DUID, IAID and subnet of
+// another lease.
+TEST_F(MemfileLeaseMgrTest, updateLease6Conflict) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "6";
+    pmap["name"] = getLeaseFilePath("leasefile6_0.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+
+    Lease6Ptr lease1 = initializeLease6(straddress6_[1]);
+    Lease6Ptr lease2 = initializeLease6(straddress6_[2]);
+    lease2->type_ = lease1->type_;
+    lease2->subnet_id_ = lease1->subnet_id_;
+    lease2->iaid_ = lease1->iaid_ + 1;
+    ASSERT_TRUE(lease_mgr->addLease(lease1));
+    ASSERT_TRUE(lease_mgr->addLease(lease2));
+    const std::string contents = io6_.readFile();
+
+    Lease6Ptr updated(new Lease6(*lease2));
+    updated->duid_ = lease1->duid_;
+    updated->iaid_ = lease1->iaid_;
+    EXPECT_THROW(lease_mgr->updateLease6(updated), DbOperationError);
+    EXPECT_EQ(contents, io6_.readFile());
+
+    Lease6Ptr returned = lease_mgr->getLease6(lease2->type_, lease2->addr_);
+    ASSERT_TRUE(returned);
+    detailCompareLease(lease2, returned);
+}
+
+// Checks that the lease returned by the backend is a copy of the stored
+// lease, i.e. modifying it doesn't affect the lease held by the backend.
+TEST_F(MemfileLeaseMgrTest, getLease4Copy) {
+    startBackend(V4);
+    Lease4Ptr lease = initializeLease4(straddress4_[1]);
+    ASSERT_TRUE(lease);
+    ASSERT_TRUE(lmptr_->addLease(lease));
+
+    HWAddr hwaddr(lease->hwaddr_, HTYPE_ETHER);
+    Lease4Ptr returned = lmptr_->getLease4(*lease->client_id_, hwaddr,
+                                           lease->subnet_id_);
+    ASSERT_TRUE(returned);
+    returned->valid_lft_ = lease->valid_lft_ + 100;
+
+    returned = lmptr_->getLease4(lease->addr_);
+    ASSERT_TRUE(returned);
+    EXPECT_EQ(lease->valid_lft_, returned->valid_lft_);
+}
+
+// Checks that the group commit delay is initialized correctly.
+TEST_F(MemfileLeaseMgrTest, groupCommitDelay) {
+    LeaseFileIO io4(getLeaseFilePath("leasefile4_1.csv"));
+
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_1.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    // The group commit is disabled by default.
+    EXPECT_EQ(0, lease_mgr->getMaxCommitDelay());
+
+    pmap["group-commit-delay"] = "5";
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_EQ(5, lease_mgr->getMaxCommitDelay());
+
+    // There is nothing to commit when leases are not written to disk.
+    pmap["persist"] = "false";
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_EQ(0, lease_mgr->getMaxCommitDelay());
+
+    pmap["persist"] = "true";
+    pmap["group-commit-delay"] = "bogus";
+    EXPECT_THROW(lease_mgr.reset(new Memfile_LeaseMgr(pmap)), bundy::BadValue);
+}
+
+// Checks that in the group commit mode the lease records are written to
+// the lease file when the backend commits them.
+TEST_F(MemfileLeaseMgrTest, groupCommit4) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    // Use the long delay so as the backend doesn't commit on its own.
+    pmap["group-commit-delay"] = "100000";
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    const std::string header = io4_.readFile();
+
+    Lease4Ptr lease = initializeLease4(straddress4_[1]);
+    ASSERT_TRUE(lease_mgr->addLease(lease));
+    lease->valid_lft_ += 100;
+    ASSERT_NO_THROW(lease_mgr->updateLease4(lease));
+    ASSERT_TRUE(lease_mgr->deleteLease(lease->addr_));
+
+    // None of the records should have been written yet.
+    EXPECT_EQ(3, lease_mgr->getPendingCommits());
+    EXPECT_EQ(header, io4_.readFile());
+
+    ASSERT_NO_THROW(lease_mgr->commit());
+    EXPECT_EQ(0, lease_mgr->getPendingCommits());
+    std::string contents = io4_.readFile();
+    EXPECT_EQ(3, std::count(contents.begin(), contents.end(), '\n') -
+              std::count(header.begin(), header.end(), '\n'));
+
+    // The lease has been deleted, so it should not be present after the
+    // lease file has been reloaded.
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_FALSE(lease_mgr->getLease4(lease->addr_));
+}
+
+// Checks that in the group commit mode the DHCPv6 lease records are written
+// to the lease file when the backend commits them.
+TEST_F(MemfileLeaseMgrTest, groupCommit6) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "6";
+    pmap["name"] = getLeaseFilePath("leasefile6_0.csv");
+    pmap["group-commit-delay"] = "100000";
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    const std::string header = io6_.readFile();
+
+    Lease6Ptr lease = initializeLease6(straddress6_[1]);
+    ASSERT_TRUE(lease_mgr->addLease(lease));
+    EXPECT_EQ(1, lease_mgr->getPendingCommits());
+    EXPECT_EQ(header, io6_.readFile());
+
+    ASSERT_NO_THROW(lease_mgr->commit());
+    EXPECT_EQ(0, lease_mgr->getPendingCommits());
+    EXPECT_NE(header, io6_.readFile());
+
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_TRUE(lease_mgr->getLease6(lease->type_, lease->addr_));
+}
+
+// Checks that the backend commits pending records on its own when the
+// server doesn't commit them within the maximum delay.
+TEST_F(MemfileLeaseMgrTest, groupCommitDelayExceeded) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    pmap["group-commit-delay"] = "1";
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+
+    ASSERT_TRUE(lease_mgr->addLease(initializeLease4(straddress4_[1])));
+    EXPECT_EQ(1, lease_mgr->getPendingCommits());
+
+    // Wait longer than the maximum delay. Appending the next record should
+    // trigger the commit.
+    usleep(5000);
+    ASSERT_TRUE(lease_mgr->addLease(initializeLease4(straddress4_[2])));
+    EXPECT_EQ(0, lease_mgr->getPendingCommits());
+}
+
+// Checks that the lease file compaction interval is initialized correctly.
+TEST_F(MemfileLeaseMgrTest, lfcInterval) {
+    LeaseFileIO io4(getLeaseFilePath("leasefile4_1.csv"));
+
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_1.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    // The periodic compaction is disabled by default.
+    EXPECT_EQ(0, lease_mgr->getLfcInterval());
+
+    pmap["lfc-interval"] = "3600";
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_EQ(3600, lease_mgr->getLfcInterval());
+
+    // There is nothing to compact when leases are not written to disk.
+    pmap["persist"] = "false";
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_EQ(0, lease_mgr->getLfcInterval());
+    lease_mgr->startLeaseFileCompaction();
+    EXPECT_FALSE(lease_mgr->isLeaseFileCompactionInProgress());
+
+    pmap["persist"] = "true";
+    pmap["lfc-interval"] = "bogus";
+    EXPECT_THROW(lease_mgr.reset(new Memfile_LeaseMgr(pmap)), bundy::BadValue);
+}
+
+// Checks that the compacted DHCPv4 lease file holds only the current leases
+// and the records appended while the compaction was in progress.
+TEST_F(MemfileLeaseMgrTest, leaseFileCompaction4) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    const std::string header = io4_.readFile();
+
+    // Renew each lease several times, so as the lease file holds many
+    // records for each of them.
+    std::vector<Lease4Ptr> leases;
+    for (int i = 1; i < 4; ++i) {
+        leases.push_back(initializeLease4(straddress4_[i]));
+        ASSERT_TRUE(lease_mgr->addLease(leases.back()));
+        for (int j = 0; j < 5; ++j) {
+            leases.back()->valid_lft_ += 10;
+            ASSERT_NO_THROW(lease_mgr->updateLease4(leases.back()));
+        }
+    }
+    ASSERT_TRUE(lease_mgr->deleteLease(leases[0]->addr_));
+
+    lease_mgr->startLeaseFileCompaction();
+    ASSERT_TRUE(lease_mgr->isLeaseFileCompactionInProgress());
+
+    // This record is not included in the snapshot. It must be copied to
+    // the new lease file.
+    leases[1]->valid_lft_ += 10;
+    ASSERT_NO_THROW(lease_mgr->updateLease4(leases[1]));
+
+    ASSERT_TRUE(lease_mgr->finishLeaseFileCompaction(true));
+    EXPECT_FALSE(lease_mgr->isLeaseFileCompactionInProgress());
+    EXPECT_FALSE(LeaseFileIO(getLeaseFilePath("leasefile4_0.csv.compact"))
+                 .exists());
+
+    // Two leases in the snapshot and one record appended afterwards.
+    std::string contents = io4_.readFile();
+    EXPECT_EQ(3, std::count(contents.begin(), contents.end(), '\n') -
+              std::count(header.begin(), header.end(), '\n'));
+
+    // The records should be appended to the new lease file.
+    leases[2]->valid_lft_ += 10;
+    ASSERT_NO_THROW(lease_mgr->updateLease4(leases[2]));
+
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    EXPECT_FALSE(lease_mgr->getLease4(leases[0]->addr_));
+    for (int i = 1; i < 3; ++i) {
+        Lease4Ptr lease = lease_mgr->getLease4(leases[i]->addr_);
+        ASSERT_TRUE(lease);
+        EXPECT_EQ(leases[i]->valid_lft_, lease->valid_lft_);
+    }
+}
+
+// Checks that the compacted DHCPv6 lease file holds only the current leases.
+TEST_F(MemfileLeaseMgrTest, leaseFileCompaction6) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "6";
+    pmap["name"] = getLeaseFilePath("leasefile6_0.csv");
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    const std::string header = io6_.readFile();
+
+    Lease6Ptr lease = initializeLease6(straddress6_[1]);
+    ASSERT_TRUE(lease_mgr->addLease(lease));
+    for (int i = 0; i < 5; ++i) {
+        lease->valid_lft_ += 10;
+        ASSERT_NO_THROW(lease_mgr->updateLease6(lease));
+    }
+
+    lease_mgr->startLeaseFileCompaction();
+    ASSERT_TRUE(lease_mgr->finishLeaseFileCompaction(true));
+
+    std::string contents = io6_.readFile();
+    EXPECT_EQ(1, std::count(contents.begin(), contents.end(), '\n') -
+              std::count(header.begin(), header.end(), '\n'));
+
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    Lease6Ptr loaded = lease_mgr->getLease6(lease->type_, lease->addr_);
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(lease->valid_lft_, loaded->valid_lft_);
+}
+
+// Checks that the backend compacts the lease file when the compaction
+// interval elapses.
+TEST_F(MemfileLeaseMgrTest, leaseFileCompactionInterval) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    pmap["lfc-interval"] = "1";
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+
+    Lease4Ptr lease = initializeLease4(straddress4_[1]);
+    ASSERT_TRUE(lease_mgr->addLease(lease));
+    EXPECT_FALSE(lease_mgr->isLeaseFileCompactionInProgress());
+
+    // Appending the record after the interval should start the compaction.
+    sleep(1);
+    lease->valid_lft_ += 10;
+    ASSERT_NO_THROW(lease_mgr->updateLease4(lease));
+    EXPECT_TRUE(lease_mgr->isLeaseFileCompactionInProgress());
+
+    // One of the next records should finish it.
+    for (int i = 0; i < 1000 && lease_mgr->isLeaseFileCompactionInProgress();
+         ++i) {
+        usleep(1000);
+        lease->valid_lft_ += 10;
+        ASSERT_NO_THROW(lease_mgr->updateLease4(lease));
+    }
+    EXPECT_FALSE(lease_mgr->isLeaseFileCompactionInProgress());
+
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    Lease4Ptr loaded = lease_mgr->getLease4(lease->addr_);
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(lease->valid_lft_, loaded->valid_lft_);
+}
+
+/// @brief Adds, updates and deletes the leases for a range of addresses.
+///
+/// @param lease_mgr Lease database.
+/// @param first First address of the range.
+/// @param count Number of addresses.
+/// @param [out] errors Incremented for each unexpected result.
+void
+useLeases4(Memfile_LeaseMgr* lease_mgr, const uint32_t first,
+           const size_t count, size_t* errors) {
+    for (uint32_t addr = first; addr < first + count; ++addr) {
+        // The hardware address must be unique in the subnet too.
+        std::vector<uint8_t> hwaddr = IOAddress(addr).toBytes();
+        hwaddr.resize(6);
+        Lease4Ptr lease(new Lease4(IOAddress(addr), &hwaddr[0], hwaddr.size(),
+                                   NULL, 0, 100, 50, 75, time(NULL), 1));
+        if (!lease_mgr->addLease(lease)) {
+            ++*errors;
+            continue;
+        }
+        lease->valid_lft_ += 10;
+        lease_mgr->updateLease4(lease);
+        Lease4Ptr returned = lease_mgr->getLease4(lease->addr_);
+        if (!returned || (returned->valid_lft_ != lease->valid_lft_)) {
+            ++*errors;
+        }
+    }
+    for (uint32_t addr = first; addr < first + count; addr += 2) {
+        if (!lease_mgr->deleteLease(IOAddress(addr))) {
+            ++*errors;
+        }
+    }
+}
+
+// Checks that the backend may be used by several threads at once.
+TEST_F(MemfileLeaseMgrTest, concurrentAccess) {
+    LeaseMgr::ParameterMap pmap;
+    pmap["universe"] = "4";
+    pmap["name"] = getLeaseFilePath("leasefile4_0.csv");
+    pmap["group-commit-delay"] = "100000";
+    boost::scoped_ptr<Memfile_LeaseMgr> lease_mgr(new Memfile_LeaseMgr(pmap));
+    EXPECT_TRUE(lease_mgr->isThreadSafe());
+
+    const size_t threads = 4;
+    const size_t count = 500;
+    const uint32_t first = static_cast<uint32_t>(IOAddress("192.0.2.0"));
+    std::vector<size_t> errors(threads, 0);
+    std::vector<boost::shared_ptr<bundy::util::thread::Thread> > workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(boost::shared_ptr<bundy::util::thread::Thread>(
+            new bundy::util::thread::Thread(
+                boost::bind(&useLeases4, lease_mgr.get(), first + i * count,
+                            count, &errors[i]))));
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i]->wait();
+        EXPECT_EQ(0, errors[i]);
+    }
+
+    // Each thread has added, updated and deleted the leases.
+    EXPECT_EQ(threads * (count * 2 + count / 2),
+              lease_mgr->getPendingCommits());
+    ASSERT_NO_THROW(lease_mgr->commit());
+
+    // Half of the leases should be left after reloading the lease file.
+    lease_mgr.reset(new Memfile_LeaseMgr(pmap));
+    for (uint32_t addr = first; addr < first + threads * count; ++addr) {
+        EXPECT_EQ((addr - first) % 2 == 1,
+                  static_cast<bool>(lease_mgr->getLease4(IOAddress(addr))));
+    }
+}
+
 // The following tests are not applicable for memfile. When adding
 // new tests to the list here, make sure to provide brief explanation
 // why they are not applicable:
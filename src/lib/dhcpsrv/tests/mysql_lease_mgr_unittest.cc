@@ -506,4 +506,34 @@ TEST_F(MySqlLeaseMgrTest, testRecreateLease6) {
     testRecreateLease6();
 }
 
+// Checks that the IPv4 leases are retrieved for many addresses at once.
+TEST_F(MySqlLeaseMgrTest, getLeases4Multiple) {
+    testGetLeases4Multiple();
+}
+
+// Checks that the IPv6 leases are retrieved for many addresses at once.
+TEST_F(MySqlLeaseMgrTest, getLeases6Multiple) {
+    testGetLeases6Multiple();
+}
+
+// Checks that the IPv4 leases are added or updated in bulk.
+TEST_F(MySqlLeaseMgrTest, upsertLeases4) {
+    testUpsertLeases4();
+}
+
+// Checks that the IPv6 leases are added or updated in bulk.
+TEST_F(MySqlLeaseMgrTest, upsertLeases6) {
+    testUpsertLeases6();
+}
+
+// Checks that the expired IPv4 leases of the subnet are returned.
+TEST_F(MySqlLeaseMgrTest, getExpiredLeases4) {
+    testGetExpiredLeases4();
+}
+
+// Checks that the expired IPv6 leases of the subnet are returned.
+TEST_F(MySqlLeaseMgrTest, getExpiredLeases6) {
+    testGetExpiredLeases6();
+}
+
 }; // Of anonymous namespace
@@ -456,4 +456,34 @@ TEST_F(PgSqlLeaseMgrTest, updateLease6) {
     testUpdateLease6();
 }
 
+// Checks that the IPv4 leases are retrieved for many addresses at once.
+TEST_F(PgSqlLeaseMgrTest, getLeases4Multiple) {
+    testGetLeases4Multiple();
+}
+
+// Checks that the IPv6 leases are retrieved for many addresses at once.
+TEST_F(PgSqlLeaseMgrTest, getLeases6Multiple) {
+    testGetLeases6Multiple();
+}
+
+// Checks that the IPv4 leases are added or updated in bulk.
+TEST_F(PgSqlLeaseMgrTest, upsertLeases4) {
+    testUpsertLeases4();
+}
+
+// Checks that the IPv6 leases are added or updated in bulk.
+TEST_F(PgSqlLeaseMgrTest, upsertLeases6) {
+    testUpsertLeases6();
+}
+
+// Checks that the expired IPv4 leases of the subnet are returned.
+TEST_F(PgSqlLeaseMgrTest, getExpiredLeases4) {
+    testGetExpiredLeases4();
+}
+
+// Checks that the expired IPv6 leases of the subnet are returned.
+TEST_F(PgSqlLeaseMgrTest, getExpiredLeases6) {
+    testGetExpiredLeases6();
+}
+
 };
@@ -101,6 +101,25 @@ TEST(Pool4Test, unique_id) {
     }
 }
 
+// Checks that the number of addresses in the pool is calculated
+// correctly, and that the pool has no bitmap of used addresses
+// until one is set.
+TEST(Pool4Test, capacity) {
+    Pool4 pool1(IOAddress("192.0.2.10"), IOAddress("192.0.2.20"));
+    EXPECT_EQ(11, pool1.getCapacity());
+
+    Pool4 pool2(IOAddress("10.0.0.0"), 8);
+    EXPECT_EQ(16777216, pool2.getCapacity());
+
+    Pool4 pool3(IOAddress("0.0.0.0"), IOAddress("255.255.255.255"));
+    EXPECT_EQ(0x100000000ULL, pool3.getCapacity());
+
+    EXPECT_FALSE(pool1.getAddressBitmap());
+    AddressBitmapPtr bitmap(new AddressBitmap(pool1.getCapacity()));
+    pool1.setAddressBitmap(bitmap);
+    EXPECT_EQ(bitmap, pool1.getAddressBitmap());
+}
+
 // Simple check if toText returns reasonable values
 TEST(Poo4Test,toText) {
     Pool4 pool1(IOAddress("192.0.2.7"), IOAddress("192.0.2.17"));
@@ -55,6 +55,12 @@ const char* create_statement[] = {
     "hostname VARCHAR(255)"
     ")",
 
+    "CREATE INDEX lease4_by_hwaddr_subnet_id ON lease4 (hwaddr, subnet_id)",
+
+    "CREATE INDEX lease4_by_client_id_subnet_id ON lease4 (client_id, subnet_id)",
+
+    "CREATE INDEX lease4_by_subnet_id_expire ON lease4 (subnet_id, expire)",
+
     "CREATE TABLE lease6 ("
     "address VARCHAR(39) PRIMARY KEY NOT NULL,"
     "duid BYTEA,"
@@ -70,6 +76,10 @@ const char* create_statement[] = {
     "hostname VARCHAR(255)"
     ")",
 
+    "CREATE INDEX lease6_by_iaid_subnet_id_duid ON lease6 (iaid, subnet_id, duid)",
+
+    "CREATE INDEX lease6_by_subnet_id_lease_type_expire ON lease6 (subnet_id, lease_type, expire)",
+
     "CREATE TABLE lease6_types ("
     "lease_type SMALLINT PRIMARY KEY NOT NULL,"
     "name VARCHAR(5)"
@@ -84,7 +94,7 @@ const char* create_statement[] = {
         "minor INT"
         ")",
 
-    "INSERT INTO schema_version VALUES (1, 0)",
+    "INSERT INTO schema_version VALUES (1, 1)",
     "COMMIT",
 
     NULL
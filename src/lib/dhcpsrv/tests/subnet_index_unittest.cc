@@ -0,0 +1,161 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <config.h>
+
+#include <asiolink/io_address.h>
+#include <dhcp/classify.h>
+#include <dhcpsrv/subnet.h>
+#include <dhcpsrv/subnet_index.h>
+
+#include <gtest/gtest.h>
+
+using namespace bundy;
+using namespace bundy::asiolink;
+using namespace bundy::dhcp;
+
+namespace {
+
+// Checks that the subnet is found by any of its addresses.
+TEST(SubnetIndexTest, findByPrefix4) {
+    SubnetIndex<Subnet4Ptr> index;
+    ClientClasses classes;
+    bool relay_match = true;
+
+    // Nothing can be found in the empty index.
+    EXPECT_FALSE(index.find(IOAddress("192.0.2.1"), classes, false,
+                            relay_match));
+    EXPECT_FALSE(relay_match);
+
+    // Add 256 subnets 10.0.X.0/24.
+    std::vector<Subnet4Ptr> subnets;
+    for (int i = 0; i < 256; ++i) {
+        subnets.push_back(Subnet4Ptr(new Subnet4(IOAddress(0x0a000000 +
+                                                           (i << 8)),
+                                                 24, 1, 2, 3)));
+        index.add(subnets.back());
+    }
+    EXPECT_EQ(256, index.size());
+
+    for (int i = 0; i < 256; ++i) {
+        EXPECT_EQ(subnets[i], index.find(IOAddress(0x0a000000 + (i << 8)),
+                                         classes, false, relay_match));
+        EXPECT_EQ(subnets[i], index.find(IOAddress(0x0a0000ff + (i << 8)),
+                                         classes, false, relay_match));
+        EXPECT_FALSE(relay_match);
+    }
+    EXPECT_FALSE(index.find(IOAddress("10.1.0.1"), classes, false,
+                            relay_match));
+    // The IPv6 address doesn't belong to any IPv4 subnet.
+    EXPECT_FALSE(index.find(IOAddress("::a00:1"), classes, false,
+                            relay_match));
+
+    index.clear();
+    EXPECT_EQ(0, index.size());
+    EXPECT_FALSE(index.find(IOAddress("10.0.0.1"), classes, false,
+                            relay_match));
+}
+
+// Checks that the IPv6 subnets are found by any of their addresses.
+TEST(SubnetIndexTest, findByPrefix6) {
+    SubnetIndex<Subnet6Ptr> index;
+    ClientClasses classes;
+    bool relay_match = false;
+
+    Subnet6Ptr subnet1(new Subnet6(IOAddress("2001:db8:1::"), 48, 1, 2, 3, 4));
+    Subnet6Ptr subnet2(new Subnet6(IOAddress("2001:db8:2::"), 64, 1, 2, 3, 4));
+    index.add(subnet1);
+    index.add(subnet2);
+
+    EXPECT_EQ(subnet1, index.find(IOAddress("2001:db8:1:ffff::1"), classes,
+                                  false, relay_match));
+    EXPECT_EQ(subnet2, index.find(IOAddress("2001:db8:2::ffff"), classes,
+                                  false, relay_match));
+    EXPECT_FALSE(index.find(IOAddress("2001:db8:2:1::"), classes, false,
+                            relay_match));
+    EXPECT_FALSE(index.find(IOAddress("192.0.2.1"), classes, false,
+                            relay_match));
+}
+
+// Checks that the subnet added first wins when the subnets overlap, and
+// that the subnets not supporting the client classes are skipped.
+TEST(SubnetIndexTest, order) {
+    SubnetIndex<Subnet4Ptr> index;
+    ClientClasses classes;
+    bool relay_match = false;
+
+    Subnet4Ptr wide(new Subnet4(IOAddress("192.0.0.0"), 16, 1, 2, 3));
+    Subnet4Ptr narrow(new Subnet4(IOAddress("192.0.2.0"), 24, 1, 2, 3));
+    wide->allowClientClass("foo");
+    index.add(wide);
+    index.add(narrow);
+
+    // The client doesn't belong to the class, so the wide subnet can't
+    // be used.
+    EXPECT_EQ(narrow, index.find(IOAddress("192.0.2.1"), classes, false,
+                                 relay_match));
+    EXPECT_FALSE(index.find(IOAddress("192.0.3.1"), classes, false,
+                            relay_match));
+
+    // Now it can, and it has been added first.
+    classes.insert("foo");
+    EXPECT_EQ(wide, index.find(IOAddress("192.0.2.1"), classes, false,
+                               relay_match));
+    EXPECT_EQ(wide, index.find(IOAddress("192.0.3.1"), classes, false,
+                               relay_match));
+}
+
+// Checks that the subnet is found by the relay address, including the
+// relay address specified after the subnet has been added.
+TEST(SubnetIndexTest, findByRelay) {
+    SubnetIndex<Subnet4Ptr> index;
+    ClientClasses classes;
+    bool relay_match = false;
+
+    Subnet4Ptr subnet1(new Subnet4(IOAddress("192.0.2.0"), 26, 1, 2, 3));
+    Subnet4Ptr subnet2(new Subnet4(IOAddress("192.0.2.64"), 26, 1, 2, 3));
+    subnet1->setRelayInfo(IOAddress("10.0.0.1"));
+    index.add(subnet1);
+    index.add(subnet2);
+
+    EXPECT_EQ(subnet1, index.find(IOAddress("10.0.0.1"), classes, true,
+                                  relay_match));
+    EXPECT_TRUE(relay_match);
+    // The relay address is only used if the address is the relay address.
+    EXPECT_FALSE(index.find(IOAddress("10.0.0.1"), classes, false,
+                            relay_match));
+    EXPECT_FALSE(relay_match);
+    // The relay address may belong to the subnet too.
+    EXPECT_EQ(subnet2, index.find(IOAddress("192.0.2.65"), classes, true,
+                                  relay_match));
+    EXPECT_FALSE(relay_match);
+
+    subnet1->setRelayInfo(IOAddress("10.0.0.3"));
+    subnet2->setRelayInfo(IOAddress("10.0.0.2"));
+    EXPECT_FALSE(index.find(IOAddress("10.0.0.1"), classes, true,
+                            relay_match));
+    EXPECT_EQ(subnet1, index.find(IOAddress("10.0.0.3"), classes, true,
+                                  relay_match));
+    EXPECT_EQ(subnet2, index.find(IOAddress("10.0.0.2"), classes, true,
+                                  relay_match));
+    EXPECT_TRUE(relay_match);
+
+    // The subnet matching by prefix wins if it has been added first.
+    subnet2->setRelayInfo(IOAddress("192.0.2.1"));
+    EXPECT_EQ(subnet1, index.find(IOAddress("192.0.2.1"), classes, true,
+                                  relay_match));
+    EXPECT_FALSE(relay_match);
+}
+
+} // end of anonymous namespace
@@ -0,0 +1,250 @@
+// Copyright (C) 2012  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <log/async_output.h>
+#include <log/logger.h>
+#include <log/logger_impl.h>
+#include <log/logger_manager.h>
+#include <log/log_messages.h>
+#include <log/macros.h>
+#include <log/interprocess/interprocess_sync_file.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <boost/bind.hpp>
+
+#include <cstddef>
+
+#include <unistd.h>
+
+using namespace bundy::util::thread;
+
+namespace bundy {
+namespace log {
+namespace internal {
+
+namespace {
+
+// Logger for the messages about the asynchronous output itself.
+bundy::log::Logger logger("log");
+
+}
+
+const size_t AsyncOutput::CAPACITY;
+
+AsyncOutput* volatile AsyncOutput::active_ = NULL;
+
+AsyncOutput::AsyncOutput() :
+    slots_(CAPACITY), mask_(CAPACITY - 1), enqueue_pos_(0), dequeue_pos_(0),
+    written_pos_(0), dropped_(0), dropped_reported_(0), idle_(false),
+    stopping_(false), sync_(new interprocess::InterprocessSyncFile("logger"))
+{
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        slots_[i].sequence_ = i;
+        slots_[i].severity_ = NONE;
+    }
+    thread_.reset(new Thread(boost::bind(&AsyncOutput::run, this)));
+}
+
+AsyncOutput::~AsyncOutput() {
+    active_ = NULL;
+    {
+        Mutex::Locker locker(mutex_);
+        stopping_ = true;
+        cond_.signal();
+    }
+    thread_->wait();
+}
+
+AsyncOutput&
+AsyncOutput::getOutput() {
+    static AsyncOutput output;
+    return (output);
+}
+
+void
+AsyncOutput::enable() {
+    active_ = &getOutput();
+}
+
+void
+AsyncOutput::disable() {
+    AsyncOutput* output = active_;
+    active_ = NULL;
+    if (output != NULL) {
+        output->flush();
+    }
+}
+
+bool
+AsyncOutput::push(const std::string& logger_name, const Severity& severity,
+                  const std::string& message, const MessageArguments& args)
+{
+    // Reserve the slot at the enqueue position, unless it hasn't been
+    // read yet since the last round.
+    size_t pos = enqueue_pos_;
+    Slot* slot;
+    while (true) {
+        slot = &slots_[pos & mask_];
+        const size_t sequence = slot->sequence_;
+        // Don't read the slot before the sequence.
+        __sync_synchronize();
+        const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&enqueue_pos_, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __sync_fetch_and_add(&dropped_, 1);
+            return (false);
+        }
+        pos = enqueue_pos_;
+    }
+
+    bool pushed = true;
+    try {
+        slot->severity_ = severity;
+        slot->logger_name_ = logger_name;
+        slot->message_ = message;
+        slot->args_ = args;
+    } catch (...) {
+        // The slot is reserved, so it must be published anyway; it's
+        // skipped by the background thread.
+        slot->severity_ = NONE;
+        __sync_fetch_and_add(&dropped_, 1);
+        pushed = false;
+    }
+    // Don't publish the slot before it's written.
+    __sync_synchronize();
+    slot->sequence_ = pos + 1;
+
+    // Wake up the background thread if it's waiting. It sets idle_ before
+    // checking for the messages, so either it sees the slot or we see it
+    // idle.
+    __sync_synchronize();
+    if (idle_) {
+        Mutex::Locker locker(mutex_);
+        cond_.signal();
+    }
+    return (pushed);
+}
+
+void
+AsyncOutput::flush() {
+    const size_t target = enqueue_pos_;
+    while (static_cast<ptrdiff_t>(written_pos_ - target) < 0) {
+        usleep(100);
+    }
+}
+
+bool
+AsyncOutput::hasPending() const {
+    const size_t pos = dequeue_pos_;
+    return (slots_[pos & mask_].sequence_ == pos + 1);
+}
+
+void
+AsyncOutput::run() {
+    while (true) {
+        while (writeBatch() > 0) {
+        }
+
+        // Report the dropped messages, which is logged through the
+        // buffer again if the output is still asynchronous.
+        const uint64_t dropped = dropped_;
+        if (dropped != dropped_reported_) {
+            LOG_WARN(logger, LOG_ASYNC_MESSAGES_DROPPED).
+                arg(dropped - dropped_reported_);
+            dropped_reported_ = dropped;
+            continue;
+        }
+
+        Mutex::Locker locker(mutex_);
+        idle_ = true;
+        __sync_synchronize();
+        if (!hasPending()) {
+            if (stopping_) {
+                break;
+            }
+            cond_.wait(mutex_);
+        }
+        idle_ = false;
+    }
+}
+
+size_t
+AsyncOutput::writeBatch() {
+    if (!hasPending()) {
+        return (0);
+    }
+
+    // Take the locks once for the whole batch, as the synchronous output
+    // does for each message.
+    Mutex::Locker mutex_locker(LoggerManager::getMutex());
+    interprocess::InterprocessSyncLocker locker(*sync_);
+    const bool locked = locker.lock();
+
+    size_t count = 0;
+    std::string logger_name;
+    std::string message;
+    MessageArguments args;
+    std::string text;
+    log4cplus::Logger slot_logger = log4cplus::Logger::getRoot();
+    std::string slot_logger_name;
+    while (count < CAPACITY && hasPending()) {
+        Slot& slot = slots_[dequeue_pos_ & mask_];
+        // Don't read the slot before its sequence.
+        __sync_synchronize();
+        const Severity severity = slot.severity_;
+        logger_name.swap(slot.logger_name_);
+        message.swap(slot.message_);
+        args.swap(slot.args_);
+        // Don't give the slot back before it's read.
+        __sync_synchronize();
+        slot.sequence_ = dequeue_pos_ + CAPACITY;
+        ++dequeue_pos_;
+
+        // The consecutive messages are usually logged by the same logger.
+        if (logger_name != slot_logger_name) {
+            slot_logger = log4cplus::Logger::getInstance(logger_name);
+            slot_logger_name = logger_name;
+        }
+        if (!locked && count == 0) {
+            LOG4CPLUS_ERROR(slot_logger, "Unable to lock logger lockfile");
+        }
+        if (severity != NONE) {
+            try {
+                text.clear();
+                formatMessage(text, message, args);
+                LoggerImpl::write(slot_logger, severity, text);
+            } catch (...) {
+                // The message is lost, as it would be if the logging thread
+                // had failed to format it.
+            }
+        }
+        written_pos_ = dequeue_pos_;
+        ++count;
+    }
+
+    if (locked && !locker.unlock()) {
+        LOG4CPLUS_ERROR(slot_logger, "Unable to unlock logger lockfile");
+    }
+    return (count);
+}
+
+} // namespace internal
+} // namespace log
+} // namespace bundy
@@ -0,0 +1,175 @@
+// Copyright (C) 2012  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef LOG_ASYNC_OUTPUT_H
+#define LOG_ASYNC_OUTPUT_H
+
+#include <log/log_formatter.h>
+#include <log/logger_level.h>
+#include <log/interprocess/interprocess_sync.h>
+#include <util/threads/sync.h>
+#include <util/threads/thread.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace bundy {
+namespace log {
+namespace internal {
+
+/// \brief Asynchronous output of log messages
+///
+/// Writing a log message synchronously takes the process-wide logging
+/// mutex and the interprocess lock of the lockfile, and then writes the
+/// message through the log4cplus appenders, so the logging thread may
+/// block on file I/O. When the asynchronous output is enabled, the
+/// messages are instead put in a ring buffer with their arguments, and
+/// formatted and written by a background thread, which takes the locks
+/// once for each batch of messages.
+///
+/// The ring buffer is a bounded lock-free queue: the logging threads
+/// reserve a slot with a compare-and-swap on the enqueue position and
+/// publish it by the sequence number of the slot, so they neither take
+/// a lock nor wait for each other, except for waking up the background
+/// thread if it's idle. If the buffer is full, the message is dropped
+/// and counted; the number of the dropped messages is logged once
+/// there's space again.
+///
+/// There's a single instance, which is created on the first call to
+/// \c enable() and lives until the program exits, so as the threads
+/// still logging through it when it's disabled don't need to be
+/// synchronized with it. Its destructor writes the messages left in
+/// the buffer.
+class AsyncOutput : public boost::noncopyable {
+public:
+    /// \brief Number of the messages the ring buffer holds.
+    static const size_t CAPACITY = 8192;
+
+    /// \brief Destructor
+    ///
+    /// Writes the messages left in the buffer and stops the thread.
+    ~AsyncOutput();
+
+    /// \brief Enable the asynchronous output.
+    ///
+    /// The instance and its thread are created on the first call.
+    static void enable();
+
+    /// \brief Disable the asynchronous output.
+    ///
+    /// The messages already in the buffer are written before returning,
+    /// so as they aren't reordered with the ones logged synchronously.
+    static void disable();
+
+    /// \brief Return the instance if the asynchronous output is enabled.
+    ///
+    /// \return the instance, or NULL if the messages are to be written
+    ///         synchronously.
+    static AsyncOutput* getInstance() {
+        return (active_);
+    }
+
+    /// \brief Put the message in the buffer to be written.
+    ///
+    /// This method takes no lock unless the background thread is idle.
+    ///
+    /// \param logger_name name of the log4cplus logger to write the
+    ///        message to
+    /// \param severity severity of the message
+    /// \param message the message with the placeholders
+    /// \param args the arguments to put in the placeholders
+    /// \return true if the message was put in the buffer, false if it was
+    ///         dropped as the buffer is full.
+    bool push(const std::string& logger_name, const Severity& severity,
+              const std::string& message, const MessageArguments& args);
+
+    /// \brief Wait until the messages put so far have been written.
+    void flush();
+
+    /// \brief Return the number of the messages dropped so far.
+    uint64_t getDropped() const {
+        return (dropped_);
+    }
+
+private:
+    /// \brief A slot of the ring buffer.
+    struct Slot {
+        /// \brief Sequence number of the slot.
+        ///
+        /// It's equal to the position of the slot if the slot is free to
+        /// be written at the position, and to the position plus one if
+        /// it's written and ready to be output.
+        volatile size_t sequence_;
+        Severity severity_;
+        std::string logger_name_;
+        std::string message_;
+        MessageArguments args_;
+    };
+
+    /// \brief Constructor
+    ///
+    /// Creates the buffer and starts the background thread.
+    AsyncOutput();
+
+    /// \brief Return the instance, creating it on the first call.
+    static AsyncOutput& getOutput();
+
+    /// \brief Return whether the slot at the dequeue position is ready.
+    bool hasPending() const;
+
+    /// \brief Main function of the background thread.
+    void run();
+
+    /// \brief Write the ready messages.
+    ///
+    /// \return number of the messages written
+    size_t writeBatch();
+
+    /// \brief The instance if enabled, otherwise NULL.
+    static AsyncOutput* volatile active_;
+
+    std::vector<Slot> slots_;
+    const size_t mask_;
+    // position of the next slot to be written by the logging threads
+    volatile size_t enqueue_pos_;
+    // position of the next slot to be read by the background thread;
+    // only modified by the background thread
+    volatile size_t dequeue_pos_;
+    // position up to which the messages have been written
+    volatile size_t written_pos_;
+    // number of the dropped messages
+    volatile uint64_t dropped_;
+    // number of the dropped messages already reported
+    uint64_t dropped_reported_;
+    // whether the background thread is waiting for messages
+    volatile bool idle_;
+    // whether the background thread is to stop
+    volatile bool stopping_;
+    bundy::util::thread::Mutex mutex_;
+    bundy::util::thread::CondVar cond_;
+    boost::scoped_ptr<bundy::log::interprocess::InterprocessSync> sync_;
+    boost::scoped_ptr<bundy::util::thread::Thread> thread_;
+};
+
+} // namespace internal
+} // namespace log
+} // namespace bundy
+
+#endif // LOG_ASYNC_OUTPUT_H
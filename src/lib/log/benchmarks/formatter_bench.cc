@@ -0,0 +1,155 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <log/log_formatter.h>
+#include <log/logger.h>
+#include <log/logger_support.h>
+#include <log/log_messages.h>
+#include <log/macros.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::bench;
+using namespace bundy::log;
+using boost::lexical_cast;
+
+namespace {
+
+// A message with three arguments, like the debug messages of the servers.
+const char* const MESSAGE =
+    "AUTH_PACKET_RECEIVED message received: %1 from %2, size %3";
+const string ARGUMENT("example.com/IN/A");
+
+// Logs a debug message at a debug level which isn't enabled.
+class DisabledBenchMark {
+public:
+    DisabledBenchMark(Logger& logger) : logger_(logger) {}
+    unsigned int run() {
+        LOG_DEBUG(logger_, DBGLVL_TRACE_DETAIL, LOG_INVALID_MESSAGE_ID).
+            arg(ARGUMENT).arg(42);
+        return (1);
+    }
+private:
+    Logger& logger_;
+};
+
+// Formats the messages and discards them, in place of the logger.
+class DiscardingLogger {
+public:
+    DiscardingLogger() : size_(0) {}
+    void output(const Severity&, const string& message,
+                const MessageArguments& args)
+    {
+        text_.clear();
+        formatMessage(text_, message, args);
+        size_ += text_.size();
+    }
+    size_t size_;
+private:
+    string text_;
+};
+
+// Formats the message through the Formatter.
+class FormatterBenchMark {
+public:
+    FormatterBenchMark(DiscardingLogger& logger) : logger_(logger), count_(0)
+    {}
+    unsigned int run() {
+        Formatter<DiscardingLogger>(DEBUG, new string(MESSAGE), &logger_).
+            arg(ARGUMENT).arg("192.0.2.1").arg(count_++);
+        return (1);
+    }
+private:
+    DiscardingLogger& logger_;
+    size_t count_;
+};
+
+// Formats the message as the Formatter used to: each argument is converted
+// by lexical_cast and replaced in the message in turn.
+class ReplaceBenchMark {
+public:
+    ReplaceBenchMark() : size_(0), count_(0) {}
+    unsigned int run() {
+        string message(MESSAGE);
+        replacePlaceholder(&message, lexical_cast<string>(ARGUMENT), 1);
+        replacePlaceholder(&message, lexical_cast<string>("192.0.2.1"), 2);
+        replacePlaceholder(&message, lexical_cast<string>(count_++), 3);
+        checkExcessPlaceholders(&message, 4);
+        size_ += message.size();
+        return (1);
+    }
+    size_t size_;
+private:
+    size_t count_;
+};
+
+void
+usage() {
+    cerr << "Usage: formatter_bench [-n iterations]" << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 1000000;
+    while ((ch = getopt(argc, argv, "n:")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0) {
+        usage();
+    }
+
+    initLogger("formatter_bench", DEBUG, DBGLVL_TRACE_BASIC, NULL);
+    Logger logger("bench");
+    assert(!logger.isDebugEnabled(DBGLVL_TRACE_DETAIL));
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+
+    cout << "Benchmark for the disabled debug logging" << endl;
+    BenchMark<DisabledBenchMark>(iteration, DisabledBenchMark(logger));
+
+    DiscardingLogger discarding_logger;
+    cout << "Benchmark for formatting through the Formatter" << endl;
+    BenchMark<FormatterBenchMark>(iteration,
+                                  FormatterBenchMark(discarding_logger));
+
+    ReplaceBenchMark replace;
+    cout << "Benchmark for formatting by replacing the placeholders in turn"
+         << endl;
+    BenchMark<ReplaceBenchMark>(iteration, replace, true);
+    assert(discarding_logger.size_ == replace.size_);
+
+    return (0);
+}
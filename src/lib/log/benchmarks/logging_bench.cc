@@ -0,0 +1,166 @@
+// Copyright (C) 2014 Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <bench/benchmark.h>
+
+#include <log/async_output.h>
+#include <log/logger.h>
+#include <log/logger_manager.h>
+#include <log/logger_specification.h>
+#include <log/logger_support.h>
+#include <log/log_messages.h>
+#include <log/macros.h>
+#include <log/output_option.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace bundy::bench;
+using namespace bundy::log;
+
+namespace {
+
+// Logs a message with two arguments on each iteration and records how long
+// the caller was held up by it.
+class LoggingBenchMark {
+public:
+    LoggingBenchMark(Logger& logger, const size_t iterations) :
+        logger_(logger), count_(0)
+    {
+        latencies_.reserve(iterations);
+    }
+    unsigned int run() {
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        LOG_INFO(logger_, LOG_INVALID_MESSAGE_ID).arg(count_++).
+            arg("benchmark");
+        gettimeofday(&end, NULL);
+        latencies_.push_back((end.tv_sec - start.tv_sec) * 1000000 +
+                             (end.tv_usec - start.tv_usec));
+        return (1);
+    }
+    // Prints the percentiles of the latency of the calls in microseconds.
+    void printLatencies() {
+        if (latencies_.empty()) {
+            return;
+        }
+        sort(latencies_.begin(), latencies_.end());
+        const size_t size = latencies_.size();
+        cout << "Caller latency: median " << latencies_[size / 2]
+             << "us, 99% " << latencies_[size * 99 / 100]
+             << "us, 99.99% " << latencies_[size * 9999 / 10000]
+             << "us, max " << latencies_[size - 1] << "us" << endl;
+    }
+private:
+    Logger& logger_;
+    size_t count_;
+    vector<long> latencies_;
+};
+
+double
+getTime() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec + static_cast<double>(now.tv_usec) / 1000000);
+}
+
+void
+runBenchMark(const string& file_name, const bool async,
+             const int iteration)
+{
+    OutputOption option;
+    option.destination = OutputOption::DEST_FILE;
+    option.filename = file_name;
+    LoggerSpecification spec("logging_bench", INFO);
+    spec.addOutputOption(option);
+    spec.setAsync(async);
+
+    LoggerManager manager;
+    manager.process(spec);
+    const uint64_t dropped = async ?
+        internal::AsyncOutput::getInstance()->getDropped() : 0;
+
+    Logger logger("bench");
+    LoggingBenchMark target(logger, iteration);
+    const double start = getTime();
+    BenchMark<LoggingBenchMark>(iteration, target, true);
+    // Processing the configuration again waits until the file is written.
+    manager.process(spec);
+    const double duration = getTime() - start;
+
+    target.printLatencies();
+    uint64_t written = iteration;
+    if (async) {
+        const uint64_t lost =
+            internal::AsyncOutput::getInstance()->getDropped() - dropped;
+        cout << "Dropped messages: " << lost << endl;
+        written -= lost;
+    }
+    cout.precision(2);
+    cout << "Written " << written << " messages to the file in " << fixed
+         << duration << "s (" << written / duration
+         << " messages per second)" << endl;
+}
+
+void
+usage() {
+    cerr << "Usage: logging_bench [-n iterations] [-f log_file]" << endl;
+    exit (1);
+}
+}
+
+int
+main(int argc, char* argv[]) {
+    int ch;
+    int iteration = 100000;
+    string file_name = "logging_bench.log";
+    while ((ch = getopt(argc, argv, "n:f:")) != -1) {
+        switch (ch) {
+        case 'n':
+            iteration = atoi(optarg);
+            break;
+        case 'f':
+            file_name = optarg;
+            break;
+        case '?':
+        default:
+            usage();
+        }
+    }
+    argc -= optind;
+    if (argc != 0) {
+        usage();
+    }
+
+    initLogger("logging_bench", INFO, 0, NULL);
+
+    cout << "Parameters:" << endl;
+    cout << "  Iterations: " << iteration << endl;
+    cout << "  Log file: " << file_name << endl;
+
+    cout << "Benchmark for logging synchronously" << endl;
+    runBenchMark(file_name, false, iteration);
+    cout << "Benchmark for logging asynchronously" << endl;
+    runBenchMark(file_name, true, iteration);
+
+    unlink(file_name.c_str());
+    return (0);
+}
@@ -73,5 +73,107 @@ checkExcessPlaceholders(string* message, unsigned int placeholder) {
     }
 }
 
+void
+checkPlaceholder(const string& message, const unsigned placeholder) {
+    const string mark("%" + lexical_cast<string>(placeholder));
+    if (message.find(mark) == string::npos) {
+        bundy_throw(MismatchedPlaceholders,
+                  "Missing logger placeholder in message: " << message);
+    }
+}
+
+namespace {
+
+// Append the decimal digits of the number.
+void
+appendNumber(string& output, uint64_t value) {
+    char buffer[24];
+    char* const end = buffer + sizeof(buffer);
+    char* digit = end;
+    do {
+        *--digit = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    output.append(digit, end);
+}
+
+}
+
+void
+MessageArgument::appendTo(string& output) const {
+    switch (type_) {
+    case SIGNED:
+        if (value_.signed_ < 0) {
+            output.push_back('-');
+            appendNumber(output, 0 - static_cast<uint64_t>(value_.signed_));
+        } else {
+            appendNumber(output, value_.signed_);
+        }
+        break;
+    case UNSIGNED:
+        appendNumber(output, value_.unsigned_);
+        break;
+    case TEXT:
+        output.append(text_);
+        break;
+    }
+}
+
+void
+formatMessage(string& output, const string& message,
+              const MessageArguments& args)
+{
+    output.reserve(output.size() + message.size() + args.size() * 16);
+
+    // Which of the arguments have been used; the ones past the mask are
+    // taken as used.
+    uint64_t used = 0;
+    bool excess = false;
+    size_t pos = 0;
+    size_t mark;
+    while ((mark = message.find('%', pos)) != string::npos) {
+        output.append(message, pos, mark - pos);
+        size_t end = mark + 1;
+        size_t placeholder = 0;
+        while (end < message.size() && message[end] >= '0' &&
+               message[end] <= '9' && placeholder <= args.size()) {
+            placeholder = placeholder * 10 + (message[end] - '0');
+            ++end;
+        }
+        if (placeholder >= 1 && placeholder <= args.size()) {
+            args[placeholder - 1].appendTo(output);
+            if (placeholder <= 64) {
+                used |= static_cast<uint64_t>(1) << (placeholder - 1);
+            }
+        } else {
+            if (placeholder == args.size() + 1) {
+                excess = true;
+            }
+            output.append(message, mark, end - mark);
+        }
+        pos = end;
+    }
+    output.append(message, pos, string::npos);
+
+    for (size_t i = 0; i < args.size() && i < 64; ++i) {
+        if ((used & (static_cast<uint64_t>(1) << i)) == 0) {
+            // The logger checks have already thrown in the Formatter.
+            output.append(" @@Missing placeholder %");
+            appendNumber(output, i + 1);
+            output.append(" for '");
+            args[i].appendTo(output);
+            output.append("'@@");
+        }
+    }
+    if (excess) {
+#ifdef ENABLE_LOGGER_CHECKS
+        cerr << "Message " << output << endl;
+        assert("Excess logger placeholders still exist in message" == NULL);
+#else
+        output.append(" @@Excess logger placeholders still exist@@");
+#endif /* ENABLE_LOGGER_CHECKS */
+    }
+}
+
 }
 }
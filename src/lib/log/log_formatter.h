@@ -18,6 +18,9 @@
 #include <cstddef>
 #include <string>
 #include <iostream>
+#include <vector>
+
+#include <stdint.h>
 
 #include <exceptions/exceptions.h>
 #include <boost/lexical_cast.hpp>
@@ -70,6 +73,85 @@ void
 replacePlaceholder(std::string* message, const std::string& replacement,
                    const unsigned placeholder);
 
+///
+/// \brief Internal missing placeholder checker
+///
+/// This is used internally by the Formatter when the logger checks are
+/// enabled. Throws MismatchedPlaceholders if the message has no such
+/// placeholder.
+void
+checkPlaceholder(const std::string& message, const unsigned placeholder);
+
+///
+/// \brief An argument of a log message
+///
+/// The Formatter keeps the arguments of the message until the message is
+/// output. The integers and the strings are kept as they are and converted
+/// to the text only then, so as nothing is converted for the messages which
+/// are dropped. The arguments of the other types are converted by the
+/// Formatter when they are given.
+class MessageArgument {
+public:
+    /// \brief Constructor of a signed integer argument
+    explicit MessageArgument(const int64_t value) : type_(SIGNED) {
+        value_.signed_ = value;
+    }
+
+    /// \brief Constructor of an unsigned integer argument
+    explicit MessageArgument(const uint64_t value) : type_(UNSIGNED) {
+        value_.unsigned_ = value;
+    }
+
+    /// \brief Constructor of a text argument
+    explicit MessageArgument(const std::string& text) :
+        type_(TEXT), text_(text)
+    {}
+
+    /// \brief Constructor of a text argument
+    explicit MessageArgument(const char* text) :
+        type_(TEXT), text_(text)
+    {}
+
+    /// \brief Append the text of the argument.
+    ///
+    /// \param output The string to which the text is appended.
+    void appendTo(std::string& output) const;
+
+private:
+    enum Type {
+        SIGNED,
+        UNSIGNED,
+        TEXT
+    };
+
+    Type type_;
+    union {
+        int64_t signed_;
+        uint64_t unsigned_;
+    } value_;
+    std::string text_;
+};
+
+/// \brief The arguments of a log message, in the order of the placeholders
+typedef std::vector<MessageArgument> MessageArguments;
+
+///
+/// \brief Format a log message
+///
+/// Replaces the placeholders %1, %2... of the message by the corresponding
+/// arguments in a single pass. The text of the arguments is not searched
+/// for the placeholders. If an argument has no placeholder, or there are
+/// more placeholders than the arguments, a complaint is added at the end
+/// (or, if the logger checks are enabled, the program is aborted in the
+/// latter case; the former is found by the Formatter already).
+///
+/// \param output The string to which the formatted message is appended.
+/// \param message The message with the placeholders.
+/// \param args The arguments to put in the placeholders.
+void
+formatMessage(std::string& output, const std::string& message,
+              const MessageArguments& args);
+
 ///
 /// \brief The log message formatter
 ///
@@ -89,6 +171,11 @@ replacePlaceholder(std::string* message, const std::string& replacement,
 /// .arg can be called on it. After the last .arg call is done, the object is
 /// destroyed and, again, we can produce the output.
 ///
+/// The arguments are only collected by the .arg calls. The message and the
+/// arguments are passed to the logger on the destruction and the logger
+/// formats the message with \c formatMessage() when it's written, which
+/// may be done later by another thread.
+///
 /// Of course, if the logging is turned off, we don't bother with any replacing
 /// and just return.
 ///
@@ -120,9 +207,10 @@ private:
     /// \brief The messages with %1, %2... placeholders
     std::string* message_;
 
-    /// \brief Which will be the next placeholder to replace
-    unsigned nextPlaceholder_;
-
+    /// \brief The arguments collected so far
+    ///
+    /// They move with the logger_ on copying.
+    mutable MessageArguments args_;
 
 public:
     /// \brief Constructor of "active" formatter
@@ -135,14 +223,13 @@ public:
     ///
     /// \param severity The severity of the message (DEBUG, ERROR etc.)
     /// \param message The message with placeholders. We take ownership of
-    ///     it and we will modify the string. Must not be NULL unless
-    ///     logger is also NULL, but it's not checked.
+    ///     it. Must not be NULL unless logger is also NULL, but it's not
+    ///     checked.
     /// \param logger The logger where the final output will go, or NULL
     ///     if no output is wanted.
     Formatter(const Severity& severity = NONE, std::string* message = NULL,
               Logger* logger = NULL) :
-        logger_(logger), severity_(severity), message_(message),
-        nextPlaceholder_(0)
+        logger_(logger), severity_(severity), message_(message)
     {
     }
 
@@ -153,8 +240,9 @@ public:
     /// object being copied relinquishes that responsibility.
     Formatter(const Formatter& other) :
         logger_(other.logger_), severity_(other.severity_),
-        message_(other.message_), nextPlaceholder_(other.nextPlaceholder_)
+        message_(other.message_)
     {
+        args_.swap(other.args_);
         other.logger_ = NULL;
     }
 
@@ -164,8 +252,7 @@ public:
     ~ Formatter() {
         if (logger_) {
             try {
-                checkExcessPlaceholders(message_, ++nextPlaceholder_);
-                logger_->output(severity_, *message_);
+                logger_->output(severity_, *message_, args_);
             } catch (...) {
                 // Catch and ignore all exceptions here.
             }
@@ -182,7 +269,8 @@ public:
             logger_ = other.logger_;
             severity_ = other.severity_;
             message_ = other.message_;
-            nextPlaceholder_ = other.nextPlaceholder_;
+            args_.clear();
+            args_.swap(other.args_);
             other.logger_ = NULL;
         }
 
@@ -222,33 +310,47 @@ public:
 
     /// \brief String version of arg.
     ///
+    /// Note that the placeholders are replaced in a single pass when the
+    /// message is output, so a placeholder in the text of an argument is
+    /// not replaced (e.g. .arg("%2").arg(42) on the message "%1 %2" gives
+    /// "%2 42").
+    ///
     /// \param arg The text to place into the placeholder.
     Formatter& arg(const std::string& arg) {
-        if (logger_) {
-            // Note that this method does a replacement and returns the
-            // modified string. If there are multiple invocations of arg() (e.g.
-            // logger.info(msgid).arg(xxx).arg(yyy)...), each invocation
-            // operates on the string returned by the previous one. This
-            // sequential operation means that if we had a message like "%1 %2",
-            // and called .arg("%2").arg(42), we would get "42 42"; the first
-            // call replaces the %1" with "%2" and the second replaces all
-            // occurrences of "%2" with 42. (Conversely, the sequence
-            // .arg(42).arg("%1") would return "42 %1" - there are no recursive
-            // replacements).
-            try {
-                replacePlaceholder(message_, arg, ++nextPlaceholder_ );
-            }
-            catch (...) {
-                // Something went wrong here, the log message is broken, so
-                // we don't want to output it, nor we want to check all the
-                // placeholders were used (because they won't be).
-                deactivate();
-                throw;
-            }
-        }
-        return (*this);
+        return (addArgument(arg));
+    }
+
+    /// \brief C string version of arg.
+    ///
+    /// \param arg The text to place into the placeholder.
+    Formatter& arg(const char* arg) {
+        return (addArgument(arg));
     }
 
+    /// \brief Integer versions of arg.
+    ///
+    /// The integer is converted to the text only when the message is
+    /// output.
+    ///
+    /// \param arg The number to place into the placeholder.
+    //@{
+    Formatter& arg(const int arg) {
+        return (addArgument(static_cast<int64_t>(arg)));
+    }
+
+    Formatter& arg(const unsigned int arg) {
+        return (addArgument(static_cast<uint64_t>(arg)));
+    }
+
+    Formatter& arg(const long arg) {
+        return (addArgument(static_cast<int64_t>(arg)));
+    }
+
+    Formatter& arg(const unsigned long arg) {
+        return (addArgument(static_cast<uint64_t>(arg)));
+    }
+    //@}
+
     /// \brief Turn off the output of this logger.
     ///
     /// If the logger would output anything at the end, now it won't.
@@ -262,7 +364,35 @@ public:
             delete message_;
             message_ = NULL;
             logger_ = NULL;
+            args_.clear();
+        }
+    }
+
+private:
+    /// \brief Add the argument for the next placeholder.
+    ///
+    /// \param value The value from which the argument is created.
+    template<class Value> Formatter& addArgument(const Value& value) {
+        if (logger_) {
+            try {
+#ifdef ENABLE_LOGGER_CHECKS
+                checkPlaceholder(*message_, args_.size() + 1);
+#endif
+                if (args_.capacity() == 0) {
+                    // Most messages have a few arguments.
+                    args_.reserve(4);
+                }
+                args_.push_back(MessageArgument(value));
+            }
+            catch (...) {
+                // Something went wrong here, the log message is broken, so
+                // we don't want to output it, nor we want to check all the
+                // placeholders were used (because they won't be).
+                deactivate();
+                throw;
+            }
         }
+        return (*this);
     }
 };
 
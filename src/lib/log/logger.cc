@@ -130,8 +130,10 @@ Logger::isFatalEnabled() {
 // Output methods
 
 void
-Logger::output(const Severity& severity, const std::string& message) {
-    getLoggerPtr()->outputRaw(severity, message);
+Logger::output(const Severity& severity, const std::string& message,
+               const MessageArguments& args)
+{
+    getLoggerPtr()->outputRaw(severity, message, args);
 }
 
 Logger::Formatter
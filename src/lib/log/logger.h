@@ -280,11 +280,14 @@ private:
 
     /// \brief Raw output function
     ///
-    /// This is used by the formatter to output formatted output.
+    /// This is used by the formatter to output the message.  The message
+    /// is formatted when it's written.
     ///
     /// \param severity Severity of the message being output.
-    /// \param message Text of the message to be output.
-    void output(const Severity& severity, const std::string& message);
+    /// \param message Text of the message, with the placeholders.
+    /// \param args Arguments to put in the placeholders.
+    void output(const Severity& severity, const std::string& message,
+                const MessageArguments& args);
 
     /// \brief Copy Constructor
     ///
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <set>
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -24,6 +25,7 @@
 #include <log4cplus/configurator.h>
 #include <log4cplus/loggingmacros.h>
 
+#include <log/async_output.h>
 #include <log/logger.h>
 #include <log/logger_impl.h>
 #include <log/logger_level.h>
@@ -42,6 +44,24 @@
 
 using namespace std;
 
+namespace {
+
+// All existing logger implementations, for updating their cached levels.
+struct LoggerRegistry {
+    bundy::util::thread::Mutex mutex_;
+    set<bundy::log::LoggerImpl*> loggers_;
+};
+
+// The registry is never destroyed, as the static loggers may outlive
+// any static object.
+LoggerRegistry&
+getRegistry() {
+    static LoggerRegistry* registry = new LoggerRegistry;
+    return (*registry);
+}
+
+}
+
 namespace bundy {
 namespace log {
 
@@ -53,13 +73,22 @@ namespace log {
 LoggerImpl::LoggerImpl(const string& name) :
     name_(expandLoggerName(name)),
     logger_(log4cplus::Logger::getInstance(name_)),
-    sync_(new interprocess::InterprocessSyncFile("logger"))
+    sync_(new interprocess::InterprocessSyncFile("logger")),
+    effective_level_(logger_.getChainedLogLevel())
 {
+    LoggerRegistry& registry = getRegistry();
+    bundy::util::thread::Mutex::Locker locker(registry.mutex_);
+    registry.loggers_.insert(this);
 }
 
 // Destructor. (Here because of virtual declaration.)
 
 LoggerImpl::~LoggerImpl() {
+    {
+        LoggerRegistry& registry = getRegistry();
+        bundy::util::thread::Mutex::Locker locker(registry.mutex_);
+        registry.loggers_.erase(this);
+    }
     delete sync_;
 }
 
@@ -68,6 +97,20 @@ void
 LoggerImpl::setSeverity(bundy::log::Severity severity, int dbglevel) {
     Level level(severity, dbglevel);
     logger_.setLogLevel(LoggerLevelImpl::convertFromBindLevel(level));
+
+    // The children of the logger may inherit the level.
+    updateEffectiveLevels();
+}
+
+// Refresh the cached effective level of each logger.
+void
+LoggerImpl::updateEffectiveLevels() {
+    LoggerRegistry& registry = getRegistry();
+    bundy::util::thread::Mutex::Locker locker(registry.mutex_);
+    for (set<LoggerImpl*>::const_iterator logger = registry.loggers_.begin();
+         logger != registry.loggers_.end(); ++logger) {
+        (*logger)->effective_level_ = (*logger)->logger_.getChainedLogLevel();
+    }
 }
 
 // Return severity level
@@ -123,7 +166,20 @@ LoggerImpl::setInterprocessSync(bundy::log::interprocess::InterprocessSync* sync
 }
 
 void
-LoggerImpl::outputRaw(const Severity& severity, const string& message) {
+LoggerImpl::outputRaw(const Severity& severity, const string& message,
+                      const MessageArguments& args)
+{
+    // If the output is asynchronous, the message is formatted and written
+    // by the background thread, which takes the locks itself.
+    internal::AsyncOutput* async_output = internal::AsyncOutput::getInstance();
+    if (async_output != NULL) {
+        async_output->push(name_, severity, message, args);
+        return;
+    }
+
+    string text;
+    formatMessage(text, message, args);
+
     // Use a mutex locker for mutual exclusion from other threads in
     // this process.
     bundy::util::thread::Mutex::Locker mutex_locker(LoggerManager::getMutex());
@@ -136,39 +192,46 @@ LoggerImpl::outputRaw(const Severity& severity, const string& message) {
         LOG4CPLUS_ERROR(logger_, "Unable to lock logger lockfile");
     }
 
+    write(logger_, severity, text);
+
+    if (!locker.unlock()) {
+        LOG4CPLUS_ERROR(logger_, "Unable to unlock logger lockfile");
+    }
+}
+
+void
+LoggerImpl::write(log4cplus::Logger& logger, const Severity& severity,
+                  const string& message)
+{
     switch (severity) {
         case DEBUG:
-            LOG4CPLUS_DEBUG(logger_, message);
+            LOG4CPLUS_DEBUG(logger, message);
             break;
 
         case INFO:
-            LOG4CPLUS_INFO(logger_, message);
+            LOG4CPLUS_INFO(logger, message);
             break;
 
         case WARN:
-            LOG4CPLUS_WARN(logger_, message);
+            LOG4CPLUS_WARN(logger, message);
             break;
 
         case ERROR:
-            LOG4CPLUS_ERROR(logger_, message);
+            LOG4CPLUS_ERROR(logger, message);
             break;
 
         case FATAL:
-            LOG4CPLUS_FATAL(logger_, message);
+            LOG4CPLUS_FATAL(logger, message);
             break;
 
         case NONE:
              break;
 
         default:
-            LOG4CPLUS_ERROR(logger_,
+            LOG4CPLUS_ERROR(logger,
                             "Unsupported severity in LoggerImpl::outputRaw(): "
                             << severity);
     }
-
-    if (!locker.unlock()) {
-        LOG4CPLUS_ERROR(logger_, "Unable to unlock logger lockfile");
-    }
 }
 
 } // namespace log
@@ -30,6 +30,7 @@
 #include <log4cplus/logger.h>
 
 // BIND-10 logger files
+#include <log/log_formatter.h>
 #include <log/logger_level_impl.h>
 #include <log/message_types.h>
 #include <log/interprocess/interprocess_sync.h>
@@ -131,38 +132,66 @@ public:
     /// checked is less than or equal to the debug level set for the logger.
     virtual bool isDebugEnabled(int dbglevel = MIN_DEBUG_LEVEL) {
         Level level(DEBUG, dbglevel);
-        return logger_.isEnabledFor(LoggerLevelImpl::convertFromBindLevel(level));
+        return (LoggerLevelImpl::convertFromBindLevel(level) >=
+                effective_level_);
     }
 
     /// \brief Is INFO Enabled?
     virtual bool isInfoEnabled() {
-        return (logger_.isEnabledFor(log4cplus::INFO_LOG_LEVEL));
+        return (log4cplus::INFO_LOG_LEVEL >= effective_level_);
     }
 
     /// \brief Is WARNING Enabled?
     virtual bool isWarnEnabled() {
-        return (logger_.isEnabledFor(log4cplus::WARN_LOG_LEVEL));
+        return (log4cplus::WARN_LOG_LEVEL >= effective_level_);
     }
 
     /// \brief Is ERROR Enabled?
     virtual bool isErrorEnabled() {
-        return (logger_.isEnabledFor(log4cplus::ERROR_LOG_LEVEL));
+        return (log4cplus::ERROR_LOG_LEVEL >= effective_level_);
     }
 
     /// \brief Is FATAL Enabled?
     virtual bool isFatalEnabled() {
-        return (logger_.isEnabledFor(log4cplus::FATAL_LOG_LEVEL));
+        return (log4cplus::FATAL_LOG_LEVEL >= effective_level_);
     }
 
+    /// \brief Update the cached effective levels of all loggers
+    ///
+    /// The checks above compare against the effective level of the logger
+    /// cached when the logger is created, instead of asking log4cplus,
+    /// which walks up the hierarchy of loggers on each call.  As the level
+    /// of a logger is inherited by its children, this must be called
+    /// whenever the level of any logger is changed.  It's done by
+    /// \c setSeverity() and by the logger manager once it has processed
+    /// the logging specifications.
+    static void updateEffectiveLevels();
+
     /// \brief Raw output
     ///
-    /// Writes the message with time into the log. Used by the Formatter
-    /// to produce output.
+    /// Formats the message and writes it with time into the log. Used by
+    /// the Formatter to produce output. If the asynchronous output is
+    /// enabled, the message and its arguments are only put in its buffer,
+    /// to be formatted and written by its thread.
     ///
     /// \param severity Severity of the message. (This controls the prefix
     ///        label output with the message text.)
+    /// \param message Text of the message, with the placeholders.
+    /// \param args Arguments to put in the placeholders.
+    void outputRaw(const Severity& severity, const std::string& message,
+                   const MessageArguments& args);
+
+    /// \brief Write the message through the log4cplus logger
+    ///
+    /// Passes the message to the appenders of the logger with the level
+    /// corresponding to the severity. The caller is expected to hold the
+    /// locks which serialize the output.
+    ///
+    /// \param logger The log4cplus logger to write the message to.
+    /// \param severity Severity of the message.
     /// \param message Text of the message.
-    void outputRaw(const Severity& severity, const std::string& message);
+    static void write(log4cplus::Logger& logger, const Severity& severity,
+                      const std::string& message);
 
     /// \brief Look up message text in dictionary
     ///
@@ -194,6 +223,8 @@ private:
     std::string                  name_;   ///< Full name of this logger
     log4cplus::Logger            logger_; ///< Underlying log4cplus logger
     bundy::log::interprocess::InterprocessSync* sync_;
+    /// Cached effective level of the log4cplus logger
+    volatile log4cplus::LogLevel effective_level_;
 };
 
 } // namespace log
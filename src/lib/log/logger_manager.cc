@@ -77,12 +77,24 @@ LoggerManager::processInit() {
     impl_->processInit();
 }
 
+// Reset the loggers
+void
+LoggerManager::processReset() {
+    impl_->processReset();
+}
+
 // Process logging specification
 void
 LoggerManager::processSpecification(const LoggerSpecification& spec) {
     impl_->processSpecification(spec);
 }
 
+// Update the loggers
+void
+LoggerManager::processUpdate() {
+    impl_->processUpdate();
+}
+
 // End Processing
 void
 LoggerManager::processEnd() {
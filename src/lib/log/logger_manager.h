@@ -62,8 +62,15 @@ public:
     template <typename T>
     void process(T start, T finish) {
         processInit();
-        for (T i = start; i != finish; ++i) {
-            processSpecification(*i);
+        {
+            // Other threads don't write through the loggers while they
+            // are reconfigured.
+            bundy::util::thread::Mutex::Locker locker(getMutex());
+            processReset();
+            for (T i = start; i != finish; ++i) {
+                processSpecification(*i);
+            }
+            processUpdate();
         }
         processEnd();
     }
@@ -75,7 +82,12 @@ public:
     /// \param spec Specification to process
     void process(const LoggerSpecification& spec) {
         processInit();
-        processSpecification(spec);
+        {
+            bundy::util::thread::Mutex::Locker locker(getMutex());
+            processReset();
+            processSpecification(spec);
+            processUpdate();
+        }
         processEnd();
     }
 
@@ -91,6 +103,11 @@ public:
     /// handle.
     void process() {
         processInit();
+        {
+            bundy::util::thread::Mutex::Locker locker(getMutex());
+            processReset();
+            processUpdate();
+        }
         processEnd();
     }
 
@@ -143,11 +160,19 @@ public:
 private:
     /// \brief Initialize Processing
     ///
+    /// Switches the output back to synchronous, so as the background thread
+    /// of the asynchronous output doesn't write while the loggers are
+    /// reconfigured.  The messages it still holds are written first.
+    void processInit();
+
+    /// \brief Reset the Loggers
+    ///
     /// Initializes the processing of a list of specifications by resetting all
     /// loggers to their defaults, which is to pass the message to their
     /// parent logger.  (Except for the root logger, where the default action is
-    /// to output the message.)
-    void processInit();
+    /// to output the message.)  This and the following steps up to
+    /// processUpdate() are called with the logging mutex held.
+    void processReset();
 
     /// \brief Process Logging Specification
     ///
@@ -155,9 +180,15 @@ private:
     /// either the logger does not exist or has been made inactive.
     void processSpecification(const LoggerSpecification& spec);
 
+    /// \brief Update the Loggers
+    ///
+    /// Makes the loggers use the levels set by the specifications and
+    /// writes the messages buffered until the logging was configured.
+    void processUpdate();
+
     /// \brief End Processing
     ///
-    /// Place holder for finish processing.
+    /// Switches the output to asynchronous if requested.
     /// TODO: Check that the root logger has something enabled
     void processEnd();
 
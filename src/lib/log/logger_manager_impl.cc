@@ -25,7 +25,9 @@
 #include <log4cplus/syslogappender.h>
 #include <log4cplus/helpers/loglog.h>
 
+#include <log/async_output.h>
 #include <log/logger.h>
+#include <log/logger_impl.h>
 #include <log/logger_support.h>
 #include <log/logger_level_impl.h>
 #include <log/logger_manager.h>
@@ -43,25 +45,44 @@ using boost::lexical_cast;
 namespace bundy {
 namespace log {
 
+// Switch the output back to synchronous.  Any messages waiting to be written
+// asynchronously are written first, so they go where they were meant to, and
+// the background thread doesn't write while the loggers are reconfigured.
+void
+LoggerManagerImpl::processInit() {
+    internal::AsyncOutput::disable();
+    async_ = false;
+}
+
 // Reset hierarchy of loggers back to default settings.  This removes all
 // appenders from loggers, sets their severity to NOT_SET (so that events are
 // passed back to the parent) and resets the root logger to logging
 // informational messages.  (This last is not a log4cplus default, so we have to
 // explicitly reset the logging severity.)
 void
-LoggerManagerImpl::processInit() {
+LoggerManagerImpl::processReset() {
     storeBufferAppenders();
 
     log4cplus::Logger::getDefaultHierarchy().resetConfiguration();
     initRootLogger();
 }
 
-// Flush the BufferAppenders at the end of processing a new specification
+// Update the levels cached by the loggers and flush the BufferAppenders at the
+// end of processing a new specification
 void
-LoggerManagerImpl::processEnd() {
+LoggerManagerImpl::processUpdate() {
+    LoggerImpl::updateEffectiveLevels();
     flushBufferAppenders();
 }
 
+// Switch the output to asynchronous if requested
+void
+LoggerManagerImpl::processEnd() {
+    if (async_) {
+        internal::AsyncOutput::enable();
+    }
+}
+
 // Process logging specification.  Set up the common states then dispatch to
 // add output specifications.
 void
@@ -76,6 +97,11 @@ LoggerManagerImpl::processSpecification(const LoggerSpecification& spec) {
     // Set the additive flag.
     logger.setAdditivity(spec.getAdditive());
 
+    // The output is asynchronous for the whole process if any logger asks.
+    if (spec.getAsync()) {
+        async_ = true;
+    }
+
     // Output options given?
     if (spec.optionCount() > 0) {
         // Replace all appenders for this logger.
@@ -204,7 +230,11 @@ LoggerManagerImpl::init(bundy::log::Severity severity, int dbglevel,
 void
 LoggerManagerImpl::reset(bundy::log::Severity severity, int dbglevel)
 {
-    // Initialize the root logger
+    internal::AsyncOutput::disable();
+
+    // Initialize the root logger, while other threads don't write through
+    // the loggers
+    bundy::util::thread::Mutex::Locker locker(LoggerManager::getMutex());
     initRootLogger(severity, dbglevel);
 }
 
@@ -238,6 +268,8 @@ void LoggerManagerImpl::initRootLogger(bundy::log::Severity severity,
         OutputOption opt;
         createConsoleAppender(b10root, opt);
     }
+
+    LoggerImpl::updateEffectiveLevels();
 }
 
 void LoggerManagerImpl::setConsoleAppenderLayout(
@@ -51,25 +51,41 @@ class LoggerManagerImpl {
 public:
 
     /// \brief Constructor
-    LoggerManagerImpl() {}
+    LoggerManagerImpl() : async_(false) {}
 
     /// \brief Initialize Processing
     ///
+    /// This switches the output back to synchronous.  The messages still in
+    /// the buffer of the asynchronous output are written with the old
+    /// configuration first.
+    void processInit();
+
+    /// \brief Reset the Loggers
+    ///
     /// This resets the hierarchy of loggers back to their defaults.  This means
     /// that all non-root loggers (if they exist) are set to NOT_SET, and the
     /// root logger reset to logging informational messages.
-    void processInit();
+    void processReset();
 
     /// \brief Process Specification
     ///
     /// Processes the specification for a single logger.
     ///
     /// \param spec Logging specification for this logger
-    static void processSpecification(const LoggerSpecification& spec);
+    void processSpecification(const LoggerSpecification& spec);
+
+    /// \brief Update the Loggers
+    ///
+    /// Updates the levels cached by the loggers and writes the messages
+    /// buffered until the logging was configured.
+    void processUpdate();
 
     /// \brief End Processing
     ///
-    /// Terminates the processing of the logging specifications.
+    /// Terminates the processing of the logging specifications.  The
+    /// asynchronous output is enabled if any of the specifications asked
+    /// for it, as the output of all loggers of the process goes the same
+    /// way.
     void processEnd();
 
     /// \brief Implementation-specific initialization
@@ -94,7 +110,7 @@ public:
     /// \brief Reset logging
     ///
     /// Resets to default configuration (root logger logging to the console
-    /// with INFO severity).
+    /// with INFO severity, synchronously).
     ///
     /// \param severity Severity to be associated with this logger
     /// \param dbglevel Debug level associated with the root logger
@@ -193,6 +209,10 @@ private:
     /// store the buffer appenders in order to flush them after
     /// processSpecification() calls have been completed
     std::vector<log4cplus::SharedAppenderPtr> buffer_appender_store_;
+
+    /// Set between processInit() and processEnd() if any of the processed
+    /// specifications asks for the asynchronous output
+    bool async_;
 };
 
 } // namespace log
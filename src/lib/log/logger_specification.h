@@ -50,7 +50,7 @@ public:
                         bundy::log::Severity severity = bundy::log::INFO,
                         int dbglevel = 0, bool additive = false) :
         name_(name), severity_(severity), dbglevel_(dbglevel),
-        additive_(additive)
+        additive_(additive), async_(false)
     {}
 
     /// \brief Set the name of the logger.
@@ -101,6 +101,21 @@ public:
         return additive_;
     }
 
+    /// \brief Set the asynchronous output flag.
+    ///
+    /// The messages are written by a background thread if any of the
+    /// processed specifications has the flag set.
+    ///
+    /// \param async New value of the asynchronous output flag.
+    void setAsync(bool async) {
+        async_ = async;
+    }
+
+    /// \return Return asynchronous output flag.
+    bool getAsync() const {
+        return async_;
+    }
+
     /// \brief Add output option.
     ///
     /// \param option Option to add to the list.
@@ -139,6 +154,7 @@ public:
         severity_ = bundy::log::INFO;
         dbglevel_ = 0;
         additive_ = false;
+        async_ = false;
         options_.clear();
     }
 
@@ -147,6 +163,7 @@ private:
     bundy::log::Severity          severity_;      ///< Severity for this logger
     int                         dbglevel_;      ///< Debug level
     bool                        additive_;      ///< Chaining output
+    bool                        async_;         ///< Asynchronous output
     std::vector<OutputOption>   options_;       ///< Logger options
 };
 
@@ -0,0 +1,80 @@
+// Copyright (C) 2012  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <log/async_output.h>
+#include <log/logger_manager.h>
+#include <util/threads/sync.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace bundy::log;
+using namespace bundy::log::internal;
+using namespace bundy::util::thread;
+
+namespace {
+
+class AsyncOutputTest : public ::testing::Test {
+protected:
+    AsyncOutputTest() {
+        AsyncOutput::enable();
+        output_ = AsyncOutput::getInstance();
+    }
+
+    ~AsyncOutputTest() {
+        LoggerManager::reset();
+    }
+
+    AsyncOutput* output_;
+};
+
+// Enabling and disabling switches the instance returned.
+TEST_F(AsyncOutputTest, enable) {
+    ASSERT_TRUE(output_ != NULL);
+    AsyncOutput::disable();
+    EXPECT_TRUE(AsyncOutput::getInstance() == NULL);
+    AsyncOutput::enable();
+    EXPECT_EQ(output_, AsyncOutput::getInstance());
+}
+
+// The messages which don't fit in the buffer are dropped and counted.
+TEST_F(AsyncOutputTest, dropped) {
+    ASSERT_TRUE(output_ != NULL);
+    output_->flush();
+    const uint64_t dropped = output_->getDropped();
+    const MessageArguments no_args;
+
+    {
+        // The background thread can't write anything while the logging
+        // mutex is held, so the buffer fills up. The messages have no
+        // severity, so nothing is output.
+        Mutex::Locker locker(LoggerManager::getMutex());
+        for (size_t i = 0; i < AsyncOutput::CAPACITY; ++i) {
+            EXPECT_TRUE(output_->push("bundy.test", NONE, "message", no_args));
+        }
+        for (size_t i = 0; i < 10; ++i) {
+            EXPECT_FALSE(output_->push("bundy.test", NONE, "message", no_args));
+        }
+        EXPECT_EQ(dropped + 10, output_->getDropped());
+    }
+
+    // Once the buffer is written, there's space again.
+    output_->flush();
+    EXPECT_TRUE(output_->push("bundy.test", NONE, "message", no_args));
+    output_->flush();
+    EXPECT_EQ(dropped + 10, output_->getDropped());
+}
+
+}
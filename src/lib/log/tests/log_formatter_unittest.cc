@@ -21,6 +21,7 @@
 #include <log/log_formatter.h>
 #include <log/logger_level.h>
 
+#include <limits>
 #include <vector>
 #include <string>
 
@@ -34,8 +35,12 @@ protected:
     typedef bundy::log::Formatter<FormatterTest> Formatter;
     vector<Output> outputs;
 public:
-    void output(const bundy::log::Severity& prefix, const string& message) {
-        outputs.push_back(Output(prefix, message));
+    void output(const bundy::log::Severity& prefix, const string& message,
+                const bundy::log::MessageArguments& args)
+    {
+        string text;
+        bundy::log::formatMessage(text, message, args);
+        outputs.push_back(Output(prefix, text));
     }
     // Just shortcut for new string
     string* s(const char* text) {
@@ -98,6 +103,24 @@ TEST_F(FormatterTest, intArg) {
     EXPECT_EQ("The answer is 42", outputs[0].second);
 }
 
+// The integers are kept as they are and converted on output
+TEST_F(FormatterTest, integerArgs) {
+    Formatter(bundy::log::INFO, s("%1 %2 %3 %4 %5 %6"), this).arg(0).arg(-42).
+        arg(4294967295u).arg(numeric_limits<int64_t>::min()).
+        arg(numeric_limits<uint64_t>::max()).arg(static_cast<uint16_t>(53));
+    ASSERT_EQ(1, outputs.size());
+    EXPECT_EQ("0 -42 4294967295 -9223372036854775808 18446744073709551615 53",
+              outputs[0].second);
+}
+
+// The placeholders are replaced in a single pass, so the text of an argument
+// is left as it is
+TEST_F(FormatterTest, singlePass) {
+    Formatter(bundy::log::INFO, s("%1 %2 %"), this).arg("%2").arg(42);
+    ASSERT_EQ(1, outputs.size());
+    EXPECT_EQ("%2 42 %", outputs[0].second);
+}
+
 // Can use multiple arguments at different places
 TEST_F(FormatterTest, multiArg) {
     Formatter(bundy::log::INFO, s("The %2 are %1"), this).arg("switched").
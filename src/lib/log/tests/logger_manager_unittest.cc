@@ -21,11 +21,13 @@
 
 #include <gtest/gtest.h>
 
+#include <boost/bind.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <exceptions/exceptions.h>
 
+#include <log/async_output.h>
 #include <log/macros.h>
 #include <log/log_messages.h>
 #include <log/logger.h>
@@ -34,6 +36,8 @@
 #include <log/logger_specification.h>
 #include <log/output_option.h>
 
+#include <util/threads/thread.h>
+
 #include "tempdir.h"
 
 #include <sys/types.h>
@@ -246,6 +250,69 @@ TEST_F(LoggerManagerTest, FileLogger) {
     checkFileContents(file_spec.getFileName(), ids.begin(), ids.end());
 }
 
+// Check that the messages are written to the file when the output is
+// asynchronous, in the order they were logged.
+TEST_F(LoggerManagerTest, AsyncFileLogger) {
+    SpecificationForFileLogger file_spec;
+    file_spec.getSpecification().setAsync(true);
+
+    LoggerManager manager;
+    manager.process(file_spec.getSpecification());
+    EXPECT_TRUE(internal::AsyncOutput::getInstance() != NULL);
+
+    vector<MessageID> ids;
+    Logger logger(file_spec.getLoggerName().c_str());
+    for (int i = 0; i < 100; ++i) {
+        LOG_FATAL(logger, LOG_DUPLICATE_MESSAGE_ID).arg(i);
+        ids.push_back(LOG_DUPLICATE_MESSAGE_ID);
+        LOG_FATAL(logger, LOG_NO_MESSAGE_ID).arg(i);
+        ids.push_back(LOG_NO_MESSAGE_ID);
+    }
+
+    // Reset writes the messages left in the buffer and makes the output
+    // synchronous again.
+    LoggerManager::reset();
+    EXPECT_TRUE(internal::AsyncOutput::getInstance() == NULL);
+    checkFileContents(file_spec.getFileName(), ids.begin(), ids.end());
+
+    // Without the flag, the output is synchronous.
+    file_spec.getSpecification().setAsync(false);
+    manager.process(file_spec.getSpecification());
+    EXPECT_TRUE(internal::AsyncOutput::getInstance() == NULL);
+}
+
+namespace {
+
+// Log the given number of messages.
+void
+logMessages(const string& logger_name, const int count) {
+    Logger logger(logger_name.c_str());
+    for (int i = 0; i < count; ++i) {
+        LOG_FATAL(logger, LOG_NO_MESSAGE_ID).arg(i);
+    }
+}
+
+}
+
+// Check that the logging can be reconfigured while another thread logs
+// asynchronously, and that the output is asynchronous again afterwards.
+TEST_F(LoggerManagerTest, AsyncReconfigure) {
+    SpecificationForFileLogger file_spec;
+    file_spec.getSpecification().setAsync(true);
+
+    LoggerManager manager;
+    manager.process(file_spec.getSpecification());
+
+    bundy::util::thread::Thread thread(boost::bind(&logMessages,
+                                                   file_spec.getLoggerName(),
+                                                   10000));
+    for (int i = 0; i < 20; ++i) {
+        manager.process(file_spec.getSpecification());
+        EXPECT_TRUE(internal::AsyncOutput::getInstance() != NULL);
+    }
+    thread.wait();
+}
+
 // Check if the file rolls over when it gets above a certain size.
 TEST_F(LoggerManagerTest, FileSizeRollover) {
     // Set to a suitable minimum that log4cplus can copy with
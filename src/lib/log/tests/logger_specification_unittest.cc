@@ -30,6 +30,7 @@ TEST(LoggerSpecificationTest, DefaultInitialization) {
     EXPECT_EQ(bundy::log::INFO, spec.getSeverity());
     EXPECT_EQ(0, spec.getDbglevel());
     EXPECT_FALSE(spec.getAdditive());
+    EXPECT_FALSE(spec.getAsync());
     EXPECT_EQ(0, spec.optionCount());
 }
 
@@ -60,6 +61,11 @@ TEST(LoggerSpecificationTest, SetGet) {
     spec.setAdditive(true);
     EXPECT_TRUE(spec.getAdditive());
 
+    spec.setAsync(true);
+    EXPECT_TRUE(spec.getAsync());
+    spec.reset();
+    EXPECT_FALSE(spec.getAsync());
+
     // Should not affect option count
     EXPECT_EQ(0, spec.optionCount());
 }
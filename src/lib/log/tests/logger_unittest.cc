@@ -19,6 +19,7 @@
 #include <log/logger.h>
 #include <log/logger_manager.h>
 #include <log/logger_name.h>
+#include <log/logger_specification.h>
 #include <log/log_messages.h>
 #include <log/interprocess/interprocess_sync_file.h>
 #include "log/tests/log_test_messages.h"
@@ -321,6 +322,27 @@ TEST_F(LoggerTest, IsXxxEnabled) {
     EXPECT_TRUE(child.isFatalEnabled());
 }
 
+// The loggers cache their effective level.  Check the cached levels follow
+// the processing of a logging specification.
+
+TEST_F(LoggerTest, IsXxxEnabledAfterProcess) {
+
+    // The level of the child is cached when it's first used.
+    Logger child("test9.child");
+    EXPECT_TRUE(child.isFatalEnabled());
+
+    LoggerManager manager;
+    manager.process(LoggerSpecification("test9", bundy::log::DEBUG, 10));
+    EXPECT_TRUE(child.isDebugEnabled(10));
+    EXPECT_FALSE(child.isDebugEnabled(11));
+    EXPECT_TRUE(child.isInfoEnabled());
+
+    manager.process(LoggerSpecification("test9", bundy::log::ERROR));
+    EXPECT_FALSE(child.isDebugEnabled());
+    EXPECT_FALSE(child.isWarnEnabled());
+    EXPECT_TRUE(child.isErrorEnabled());
+}
+
 // Within the Debug level there are 100 debug levels.  Test that we know
 // when to issue a debug message.
 
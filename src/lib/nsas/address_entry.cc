@@ -29,6 +29,8 @@
 /// The easiest solution is the one presented here: declare the value as a
 /// static class constant, and define it in this source file.  As we can control
 /// the order of include files, this ensures that the value is defined.
+///
+/// The file also holds the round-trip time smoothing and backoff code.
 
 #define __STDC_LIMIT_MACROS
 #include <stdint.h>
@@ -37,8 +39,85 @@
 
 #include "address_entry.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace bundy {
 namespace nsas {
 const uint32_t AddressEntry::UNREACHABLE = UINT32_MAX;
+const uint32_t AddressEntry::MIN_RTO = 50;
+const uint32_t AddressEntry::MAX_BACKOFF_RTT = 60000;
+const unsigned int AddressEntry::MAX_TIMEOUTS = 5;
+const time_t AddressEntry::DECAY_INTERVAL = 10;
+const double AddressEntry::DECAY_FACTOR = 0.9;
+
+namespace {
+// Gain of the smoothed RTT and of its variance once there are enough
+// samples (RFC 6298 alpha and beta)
+const unsigned int SRTT_GAIN_SAMPLES = 8;
+const unsigned int RTTVAR_GAIN_SAMPLES = 4;
+}
+
+uint32_t
+AddressEntry::decayedRTT(time_t now) const {
+    if (rtt_ == UNREACHABLE || updated_ == 0 || now < updated_ + DECAY_INTERVAL) {
+        return (rtt_);
+    }
+    const double steps = (now - updated_) / DECAY_INTERVAL;
+    const uint32_t rtt = static_cast<uint32_t>(rtt_ * pow(DECAY_FACTOR, steps));
+    return (rtt == 0 ? 1 : rtt);
+}
+
+void
+AddressEntry::addSample(uint32_t rtt, time_t now) {
+    if (rtt == 0) {
+        rtt = 1;
+    }
+    const uint32_t srtt = decayedRTT(now);
+    const double delta = static_cast<double>(rtt) - srtt;
+
+    // Before we have enough samples, use the running average (gain 1/2,
+    // 1/3, ...) instead of the fixed gain, so the initial RTT (which is
+    // not a measured value) is forgotten quickly.
+    ++samples_;
+    const unsigned int srtt_gain = std::min(samples_ + 1, SRTT_GAIN_SAMPLES);
+    if (samples_ == 1) {
+        rttvar_ = rtt / 2;
+    } else {
+        rttvar_ = static_cast<uint32_t>(rttvar_ + (fabs(delta) - rttvar_) /
+                                        RTTVAR_GAIN_SAMPLES);
+    }
+    rtt_ = static_cast<uint32_t>(srtt + delta / srtt_gain);
+    if (rtt_ == 0) {
+        rtt_ = 1;
+    }
+    timeouts_ = 0;
+    updated_ = now;
+}
+
+void
+AddressEntry::addTimeout(time_t now) {
+    if (++timeouts_ >= MAX_TIMEOUTS) {
+        setUnreachable();
+        return;
+    }
+    const uint32_t srtt = std::max(decayedRTT(now), static_cast<uint32_t>(1));
+    rtt_ = std::min(srtt * 2, MAX_BACKOFF_RTT);
+    updated_ = now;
+}
+
+uint32_t
+AddressEntry::getRetransmitTimeout(uint32_t max_timeout) const {
+    if (samples_ == 0 || rtt_ == UNREACHABLE) {
+        return (max_timeout);
+    }
+    // The RTT has been doubled by every consecutive timeout, so this
+    // backs off exponentially as well.
+    const uint64_t rto = static_cast<uint64_t>(rtt_) +
+        std::max(MIN_RTO, 4 * rttvar_);
+    return (static_cast<uint32_t>(std::min(rto,
+                                           static_cast<uint64_t>(max_timeout))));
+}
+
 }
 }
@@ -21,6 +21,7 @@
 /// convenience methods for accessing and updating the information.
 
 #include <stdint.h>
+#include <time.h>
 #include <asiolink/io_address.h>
 
 namespace bundy {
@@ -35,7 +36,8 @@ public:
     /// \param address Address object representing this address
     /// \param rtt Initial round-trip time
     AddressEntry(const asiolink::IOAddress& address, uint32_t rtt = 0) :
-        address_(address), rtt_(rtt), dead_until_(0)
+        address_(address), rtt_(rtt), rttvar_(0), samples_(0), timeouts_(0),
+        updated_(0), dead_until_(0)
     {}
 
     /// \return Address object
@@ -43,18 +45,30 @@ public:
         return address_;
     }
 
+    /// \brief Return the current (smoothed) round-trip time
+    ///
+    /// If the RTT has not been updated by addSample() or addTimeout() for a
+    /// while, the returned value is decayed, so that addresses that are not
+    /// used because they once looked slow get a chance to be tried again.
+    ///
     /// \return Current round-trip time
     uint32_t getRTT() {
         if(dead_until_ != 0 && time(NULL) >= dead_until_){
             dead_until_ = 0;
             rtt_ = 1; //reset the rtt to a small value so it has an opportunity to be updated
+            timeouts_ = 0;
+            updated_ = 0;
         }
 
-        return rtt_;
+        return (decayedRTT(time(NULL)));
     }
 
     /// Set current RTT
     ///
+    /// This sets the RTT to the given value, discarding any smoothing
+    /// state.  Measured round-trip times should be passed to addSample()
+    /// instead.
+    ///
     /// \param rtt New RTT to be associated with this address
     void setRTT(uint32_t rtt) {
         if(rtt == UNREACHABLE){
@@ -62,6 +76,48 @@ public:
         }
 
         rtt_ = rtt;
+        rttvar_ = 0;
+        samples_ = 0;
+        timeouts_ = 0;
+        updated_ = 0;
+    }
+
+    /// \brief Add a measured round-trip time
+    ///
+    /// Updates the smoothed RTT and the RTT variance the same way TCP
+    /// does (RFC 6298), except that the first few samples are averaged
+    /// with a larger gain, so the (random) initial RTT is quickly
+    /// replaced by measured values.  Resets the timeout backoff.
+    ///
+    /// \param rtt Measured round-trip time in milliseconds.  Zero is
+    ///     treated as one.
+    /// \param now Current time (exposed for testing)
+    void addSample(uint32_t rtt, time_t now = time(NULL));
+
+    /// \brief Record that a query to the address timed out
+    ///
+    /// Doubles the smoothed RTT (up to \c MAX_BACKOFF_RTT) and the
+    /// retransmit timeout for every consecutive timeout.  After
+    /// \c MAX_TIMEOUTS consecutive timeouts, the address is marked
+    /// unreachable.
+    ///
+    /// \param now Current time (exposed for testing)
+    void addTimeout(time_t now = time(NULL));
+
+    /// \brief Return the retransmit timeout for the address
+    ///
+    /// This is the smoothed RTT plus four times its variance (but at
+    /// least \c MIN_RTO).  As addTimeout() doubles the RTT, it backs off
+    /// exponentially with consecutive timeouts.  If no RTT has been
+    /// measured yet, the maximum is returned.
+    ///
+    /// \param max_timeout The upper bound of the result, in milliseconds
+    /// \return Timeout to use for the next query to this address
+    uint32_t getRetransmitTimeout(uint32_t max_timeout) const;
+
+    /// \return Number of consecutive timeouts of queries to the address
+    unsigned int getTimeoutCount() const {
+        return (timeouts_);
     }
 
     /// Mark address as unreachable.
@@ -86,12 +142,24 @@ public:
         return (address_.getFamily() == AF_INET6);
     }
 
-    // Next element is defined public for testing
+    // Next elements are defined public for testing
     static const uint32_t UNREACHABLE;  ///< RTT indicating unreachable address
+    static const uint32_t MIN_RTO;      ///< Lower bound of retransmit timeout
+    static const uint32_t MAX_BACKOFF_RTT; ///< Upper bound of backed off RTT
+    static const unsigned int MAX_TIMEOUTS; ///< Timeouts before unreachable
+    static const time_t DECAY_INTERVAL; ///< Seconds between decay steps
+    static const double DECAY_FACTOR;   ///< RTT multiplier per decay step
 
 private:
+    /// \brief Return the RTT decayed for the time since the last update
+    uint32_t decayedRTT(time_t now) const;
+
     asiolink::IOAddress address_;       ///< Address
-    uint32_t        rtt_;               ///< Round-trip time
+    uint32_t        rtt_;               ///< (Smoothed) round-trip time
+    uint32_t        rttvar_;            ///< Round-trip time variance
+    unsigned int    samples_;           ///< Number of RTT samples so far
+    unsigned int    timeouts_;          ///< Consecutive timeouts
+    time_t  updated_;                   ///< Time of last sample or timeout
     time_t  dead_until_;                ///< Dead time for unreachable server
 };
 
@@ -85,7 +85,8 @@ public:
     /// \brief Update Round-trip Time
     ///
     /// When the user get one request back from the name server, it should
-    /// update the address's RTT.
+    /// update the address's RTT.  If the query timed out, it should pass
+    /// AddressEntry::UNREACHABLE, which backs the address off.
     /// \param rtt The new Round-Trip Time
     void updateRTT(uint32_t rtt) const;
 
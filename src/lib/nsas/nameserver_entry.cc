@@ -158,7 +158,6 @@ NameserverEntry::setAddressRTT(const IOAddress& address, uint32_t rtt) {
 }
 
 // Update the address's rtt
-#define UPDATE_RTT_ALPHA 0.7
 void
 NameserverEntry::updateAddressRTTAtIndex(uint32_t rtt, size_t index,
     AddressFamily family)
@@ -168,20 +167,22 @@ NameserverEntry::updateAddressRTTAtIndex(uint32_t rtt, size_t index,
     //make sure it is a valid index
     if(index >= addresses_[family].size()) return;
 
-    // Smoothly update the rtt
-    // The algorithm is as the same as bind8/bind9:
-    //    new_rtt = old_rtt * alpha + new_rtt * (1 - alpha), where alpha is a float number in [0, 1.0]
-    // The default value for alpha is 0.7
-    uint32_t old_rtt = addresses_[family][index].getRTT();
-    uint32_t new_rtt = (uint32_t)(old_rtt * UPDATE_RTT_ALPHA + rtt *
-        (1 - UPDATE_RTT_ALPHA));
-    if (new_rtt == 0) {
-        new_rtt = 1;
+    // Smoothly update the rtt (see AddressEntry::addSample()).  An
+    // UNREACHABLE "sample" means the query timed out; it backs the address
+    // off instead of being averaged in.
+    AddressEntry& entry(addresses_[family][index]);
+    uint32_t old_rtt = entry.getRTT();
+    if (rtt == AddressEntry::UNREACHABLE) {
+        entry.addTimeout();
+        LOG_DEBUG(nsas_logger, NSAS_DBG_RTT, NSAS_UPDATE_RTT_TIMEOUT)
+                  .arg(entry.getAddress().toText())
+                  .arg(entry.getTimeoutCount()).arg(entry.getRTT());
+    } else {
+        entry.addSample(rtt);
+        LOG_DEBUG(nsas_logger, NSAS_DBG_RTT, NSAS_UPDATE_RTT)
+                  .arg(entry.getAddress().toText())
+                  .arg(old_rtt).arg(entry.getRTT());
     }
-    addresses_[family][index].setRTT(new_rtt);
-    LOG_DEBUG(nsas_logger, NSAS_DBG_RTT, NSAS_UPDATE_RTT)
-              .arg(addresses_[family][index].getAddress().toText())
-              .arg(old_rtt).arg(new_rtt);
 }
 
 void
@@ -158,7 +158,8 @@ public:
     ///
     /// Shouldn't probably be used directly. Use corresponding
     /// NameserverAddress.
-    /// \param rtt Round-Trip Time
+    /// \param rtt Round-Trip Time, or AddressEntry::UNREACHABLE if the
+    ///     query timed out (see AddressEntry::addTimeout())
     /// \param index The address's index in address vector
     /// \param family The address family, V4_ONLY or V6_ONLY
     void updateAddressRTTAtIndex(uint32_t rtt, size_t index,
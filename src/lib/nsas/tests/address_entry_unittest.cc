@@ -103,6 +103,77 @@ TEST_F(AddressEntryTest, RTT) {
     EXPECT_EQ(AddressEntry::UNREACHABLE, alpha.getRTT());
 }
 
+/// Smoothing of measured RTTs
+TEST_F(AddressEntryTest, Sample) {
+    AddressEntry alpha(v4a_, 5);
+
+    // No measurement yet, the maximum timeout is used
+    EXPECT_EQ(2000, alpha.getRetransmitTimeout(2000));
+
+    // The initial value is forgotten quickly ...
+    alpha.addSample(100);
+    EXPECT_GT(alpha.getRTT(), 50);
+    for (int i = 0; i < 20; ++i) {
+        alpha.addSample(100);
+    }
+    EXPECT_GT(alpha.getRTT(), 90);
+    EXPECT_LE(alpha.getRTT(), 100);
+
+    // ... but a single outlier does not move it much
+    alpha.addSample(1000);
+    EXPECT_LT(alpha.getRTT(), 250);
+
+    // The timeout is now based on the RTT
+    EXPECT_LT(alpha.getRetransmitTimeout(2000), 2000);
+    EXPECT_GT(alpha.getRetransmitTimeout(2000), alpha.getRTT());
+    EXPECT_GE(alpha.getRetransmitTimeout(2000),
+              alpha.getRTT() + AddressEntry::MIN_RTO);
+
+    // Zero is not a valid RTT
+    AddressEntry beta(v4b_, 5);
+    beta.addSample(0);
+    EXPECT_NE(0, beta.getRTT());
+}
+
+/// Timeouts back the address off, and eventually make it unreachable
+TEST_F(AddressEntryTest, Timeout) {
+    AddressEntry alpha(v4a_);
+    for (int i = 0; i < 10; ++i) {
+        alpha.addSample(20);
+    }
+    const uint32_t rtt = alpha.getRTT();
+    const uint32_t rto = alpha.getRetransmitTimeout(2000);
+
+    alpha.addTimeout();
+    EXPECT_EQ(1, alpha.getTimeoutCount());
+    EXPECT_EQ(rtt * 2, alpha.getRTT());
+    EXPECT_GT(alpha.getRetransmitTimeout(2000), rto);
+    EXPECT_FALSE(alpha.isUnreachable());
+
+    // A good answer resets the backoff
+    alpha.addSample(20);
+    EXPECT_EQ(0, alpha.getTimeoutCount());
+    EXPECT_LT(alpha.getRTT(), rtt * 2);
+
+    for (unsigned int i = 0; i < AddressEntry::MAX_TIMEOUTS - 1; ++i) {
+        alpha.addTimeout();
+        EXPECT_FALSE(alpha.isUnreachable());
+    }
+    alpha.addTimeout();
+    EXPECT_TRUE(alpha.isUnreachable());
+}
+
+/// The RTT of an address that was not used for a while decays
+TEST_F(AddressEntryTest, Decay) {
+    AddressEntry alpha(v4a_);
+    AddressEntry beta(v4b_);
+    const time_t long_ago = time(NULL) - 10 * AddressEntry::DECAY_INTERVAL;
+    alpha.addSample(1000, long_ago);
+    beta.addSample(1000);
+    EXPECT_LT(alpha.getRTT(), beta.getRTT());
+    EXPECT_NE(0, alpha.getRTT());
+}
+
 /// Checking the address type.
 TEST_F(AddressEntryTest, AddressType) {
 
@@ -15,7 +15,9 @@
 
 #
 # Functions for reading and parsing cc messages
-# Currently these are only abstraction functions for JSON conversion.
+# Currently these are only abstraction functions for JSON conversion,
+# and for the binary wire format (see Element::toBinaryWire() in the C++
+# library for its description).
 #
 
 import sys
@@ -23,18 +25,159 @@ import struct
 
 import json
 
+# The first byte of the data in the binary wire format. It can't start
+# a JSON text.
+BINARY_WIRE_MAGIC = b'\xb1'
+
+# Type bytes of the binary wire format
+_BINARY_NULL = 0
+_BINARY_FALSE = 1
+_BINARY_TRUE = 2
+_BINARY_INT = 3
+_BINARY_REAL = 4
+_BINARY_STRING = 5
+_BINARY_LIST = 6
+_BINARY_MAP = 7
+
+_UINT32 = struct.Struct('>I')
+_INT64 = struct.Struct('>q')
+_REAL = struct.Struct('>d')
+
 def to_wire(items):
     '''Encodes the given python structure in JSON, and converts the
        result to bytes. Raises a TypeError if the given structure is
        not serializable with JSON.'''
     return json.dumps(items).encode('utf8')
 
+def _encode_binary(out, item):
+    if item is None:
+        out.append(_BINARY_NULL)
+    elif item is True:
+        out.append(_BINARY_TRUE)
+    elif item is False:
+        out.append(_BINARY_FALSE)
+    elif isinstance(item, int):
+        out.append(_BINARY_INT)
+        try:
+            out += _INT64.pack(item)
+        except struct.error:
+            raise TypeError('integer out of range: ' + str(item))
+    elif isinstance(item, float):
+        out.append(_BINARY_REAL)
+        out += _REAL.pack(item)
+    elif isinstance(item, str):
+        out.append(_BINARY_STRING)
+        _encode_string(out, item)
+    elif isinstance(item, (list, tuple)):
+        out.append(_BINARY_LIST)
+        out += _UINT32.pack(len(item))
+        for child in item:
+            _encode_binary(out, child)
+    elif isinstance(item, dict):
+        out.append(_BINARY_MAP)
+        out += _UINT32.pack(len(item))
+        for key, value in item.items():
+            if not isinstance(key, str):
+                raise TypeError('map key is not a string: ' + repr(key))
+            _encode_string(out, key)
+            _encode_binary(out, value)
+    else:
+        raise TypeError(repr(item) + ' is not serializable')
+
+def _encode_string(out, value):
+    data = value.encode('utf8')
+    out += _UINT32.pack(len(data))
+    out += data
+
+def to_wire_binary(items):
+    '''Encodes the given python structure in the binary wire format.
+       Raises a TypeError if the given structure contains anything but
+       None, booleans, integers (fitting in 64 bits), floats, strings,
+       lists, tuples and dicts with string keys.'''
+    out = bytearray(BINARY_WIRE_MAGIC)
+    _encode_binary(out, items)
+    return bytes(out)
+
+class _BinaryReader:
+    '''Decodes the binary wire format in place.'''
+    def __init__(self, data):
+        self.__data = data
+        self.__pos = 0
+
+    def at_end(self):
+        return self.__pos == len(self.__data)
+
+    def __need(self, length):
+        start = self.__pos
+        if len(self.__data) - start < length:
+            raise ValueError('binary wire format: truncated data')
+        self.__pos += length
+        return start
+
+    def __read_uint32(self):
+        return _UINT32.unpack_from(self.__data, self.__need(4))[0]
+
+    def __read_count(self):
+        # Each child takes at least a byte, so a bogus count is caught
+        # before it's used.
+        count = self.__read_uint32()
+        if count > len(self.__data) - self.__pos:
+            raise ValueError('binary wire format: truncated data')
+        return count
+
+    def __read_string(self):
+        length = self.__read_uint32()
+        start = self.__need(length)
+        try:
+            return bytes(self.__data[start:start + length]).decode('utf8')
+        except UnicodeDecodeError as ude:
+            raise ValueError('binary wire format: ' + str(ude))
+
+    def read(self):
+        item_type = self.__data[self.__need(1)]
+        if item_type == _BINARY_NULL:
+            return None
+        elif item_type == _BINARY_FALSE:
+            return False
+        elif item_type == _BINARY_TRUE:
+            return True
+        elif item_type == _BINARY_INT:
+            return _INT64.unpack_from(self.__data, self.__need(8))[0]
+        elif item_type == _BINARY_REAL:
+            return _REAL.unpack_from(self.__data, self.__need(8))[0]
+        elif item_type == _BINARY_STRING:
+            return self.__read_string()
+        elif item_type == _BINARY_LIST:
+            return [self.read() for i in range(self.__read_count())]
+        elif item_type == _BINARY_MAP:
+            result = {}
+            for i in range(self.__read_count()):
+                key = self.__read_string()
+                result[key] = self.read()
+            return result
+        else:
+            raise ValueError('binary wire format: unknown type ' +
+                             str(item_type))
+
+def is_binary_wire(data):
+    '''Checks whether the given bytes are in the binary wire format
+       rather than JSON.'''
+    return isinstance(data, (bytes, bytearray, memoryview)) and \
+        data[:1] == BINARY_WIRE_MAGIC
+
 def from_wire(data):
     '''Decodes the given bytes and parses it with the builtin JSON
-       parser. Raises a ValueError if the data is not valid JSON.
+       parser, or with the binary wire format decoder if it starts with
+       BINARY_WIRE_MAGIC. Raises a ValueError if the data is not valid.
        Raises an AttributeError if the given object has no decode()
        method (which should return a string).
        '''
+    if is_binary_wire(data):
+        reader = _BinaryReader(memoryview(data)[1:])
+        result = reader.read()
+        if not reader.at_end():
+            raise ValueError('binary wire format: extra data')
+        return result
     return json.loads(data.decode('utf8'), strict=False)
 
 if __name__ == "__main__":
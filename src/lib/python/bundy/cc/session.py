@@ -57,7 +57,10 @@ class Session:
         try:
             self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
             self._socket.connect(self.socket_file)
-            self.sendmsg({ CC_HEADER_TYPE: CC_COMMAND_GET_LNAME })
+            # We decode the binary wire format, so msgq can pass such
+            # bodies as they are. We keep sending JSON ourselves.
+            self.sendmsg({ CC_HEADER_TYPE: CC_COMMAND_GET_LNAME,
+                           CC_HEADER_ENCODINGS: [ CC_ENCODING_BINARY ] })
             env, msg = self.recvmsg(False)
             if not env:
                 raise ProtocolError("Could not get local name")
@@ -60,6 +60,50 @@ class MessageTest(unittest.TestCase):
         self.assertRaises(ValueError, bundy.cc.message.from_wire, b'[ 1 ')
         self.assertRaises(ValueError, bundy.cc.message.from_wire, b']')
 
+    def test_binary_wire(self):
+        for msg in [ self.msg1, self.msg2, self.msg3, self.msg_float, None,
+                     True, False, 0, -1, 2**63 - 1, -2**63, "", [], {},
+                     { "a": { "b": [ "c", 2.5, None ] } } ]:
+            wire = bundy.cc.message.to_wire_binary(msg)
+            self.assertEqual(b'\xb1', wire[:1])
+            self.assertTrue(bundy.cc.message.is_binary_wire(wire))
+            self.assertEqual(msg, bundy.cc.message.from_wire(wire))
+
+        # The same encoding as the C++ library
+        self.assertEqual(b'\xb1\x03\x00\x00\x00\x00\x00\x00\x01\x02',
+                         bundy.cc.message.to_wire_binary(0x102))
+        self.assertEqual(b'\xb1\x07\x00\x00\x00\x01\x00\x00\x00\x01a'
+                         b'\x05\x00\x00\x00\x01b',
+                         bundy.cc.message.to_wire_binary({ "a": "b" }))
+        # Tuples are encoded as lists
+        self.assertEqual([1, 2], bundy.cc.message.from_wire(
+            bundy.cc.message.to_wire_binary((1, 2))))
+
+        self.assertFalse(bundy.cc.message.is_binary_wire(self.msg1_wire))
+        self.assertFalse(bundy.cc.message.is_binary_wire(b''))
+        self.assertFalse(bundy.cc.message.is_binary_wire(1))
+
+        self.assertRaises(TypeError, bundy.cc.message.to_wire_binary,
+                          NotImplemented)
+        self.assertRaises(TypeError, bundy.cc.message.to_wire_binary, 2**63)
+        self.assertRaises(TypeError, bundy.cc.message.to_wire_binary,
+                          { 1: "a" })
+
+    def test_decode_binary_malformed(self):
+        wire = bundy.cc.message.to_wire_binary({ "a": [ 1, "b", 2.5 ],
+                                                 "c": True })
+        for length in range(1, len(wire)):
+            self.assertRaises(ValueError, bundy.cc.message.from_wire,
+                              wire[:length])
+        self.assertRaises(ValueError, bundy.cc.message.from_wire,
+                          wire + b'\x00')
+        self.assertRaises(ValueError, bundy.cc.message.from_wire,
+                          b'\xb1\x08')
+        self.assertRaises(ValueError, bundy.cc.message.from_wire,
+                          b'\xb1\x06\xff\xff\xff\xff\x00')
+        self.assertRaises(ValueError, bundy.cc.message.from_wire,
+                          b'\xb1\x05\x00\x00\x00\x01\xff')
+
 if __name__ == '__main__':
     unittest.main()
 
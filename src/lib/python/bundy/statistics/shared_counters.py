@@ -0,0 +1,137 @@
+# Copyright (C) 2014  Internet Systems Consortium.
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND INTERNET SYSTEMS CONSORTIUM
+# DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL
+# INTERNET SYSTEMS CONSORTIUM BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING
+# FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+# WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""Reader of the statistics counters exported in shared memory
+
+The C++ modules can export their statistics counters in a file mapped
+in memory (see bundy::statistics::SharedCounters), which is read here
+without asking the module over the message bus:
+
+  from bundy.statistics.shared_counters import SharedCountersReader
+  reader = SharedCountersReader("/path/to/auth.seg")
+  values = reader.read()
+
+read() returns a dict of the values by the item names, the paths of the
+statistics items separated by '/', e.g. 'zones/_SERVER_/request/v4'.
+When the module replaces the segment with a new layout, the old one
+is marked stale; the reader should be created again then."""
+
+import mmap
+import os
+import struct
+import time
+
+# The header: magic, version, sequence, stale, item_count, names_offset,
+# names_size, values_offset.  It matches SharedCountersHeader.
+_HEADER = struct.Struct('=8I')
+_SEQUENCE_OFFSET = 8
+_STALE_OFFSET = 12
+_MAGIC = 0x42535443
+_VERSION = 1
+
+# Number of attempts to read the values before sleeping a while to let
+# the writer finish the update.
+_READ_SPINS = 100
+
+# Time in seconds to wait for the writer to finish an update before giving
+# up.  An update takes microseconds, so a sequence that stays odd this long
+# means the writer died in the middle of it.
+_READ_TIMEOUT = 1.0
+
+class SharedCountersError(Exception):
+    """The segment can't be opened, is malformed or can't be read."""
+    pass
+
+class SharedCountersReader:
+    """Reader of a shared counters segment."""
+
+    def __init__(self, file_name):
+        """Map the segment and read the names of the items.
+
+        Raises SharedCountersError if the segment can't be opened or is
+        malformed."""
+        try:
+            with open(file_name, 'rb') as f:
+                self.__map = mmap.mmap(f.fileno(), 0,
+                                       access=mmap.ACCESS_READ)
+        except (OSError, ValueError) as ex:
+            raise SharedCountersError('failed to map the shared counters ' +
+                                      'segment ' + file_name + ': ' +
+                                      str(ex))
+        size = len(self.__map)
+        if size < _HEADER.size:
+            raise SharedCountersError('malformed shared counters segment ' +
+                                      file_name + ': too short')
+        (magic, version, _, _, item_count, names_offset, names_size,
+         values_offset) = _HEADER.unpack_from(self.__map)
+        if magic != _MAGIC or version != _VERSION or \
+                names_offset < _HEADER.size or \
+                names_offset + names_size > size or \
+                values_offset < names_offset + names_size or \
+                values_offset + item_count * 8 > size:
+            raise SharedCountersError('malformed shared counters segment ' +
+                                      file_name + ': bad header')
+        names = self.__map[names_offset:names_offset + names_size]
+        self.__names = [name.decode() for name in names.split(b'\0')[:-1]]
+        if len(self.__names) != item_count or \
+                (names_size > 0 and names[-1:] != b'\0'):
+            raise SharedCountersError('malformed shared counters segment ' +
+                                      file_name + ': bad item names')
+        self.__values = struct.Struct('=%dQ' % item_count)
+        self.__values_offset = values_offset
+
+    def get_item_names(self):
+        """Return the list of the names of the items."""
+        return self.__names
+
+    def is_stale(self):
+        """Return True if the segment has been replaced or its writer
+        has gone away."""
+        return struct.unpack_from('=I', self.__map, _STALE_OFFSET)[0] != 0
+
+    def read(self):
+        """Return the dict of the values of the items by the names.
+
+        The values are consistent, i.e. written by the same update.
+        Raises SharedCountersError if the writer doesn't finish an update
+        in time, e.g. because it died in the middle of it."""
+        attempt = 0
+        deadline = None
+        while True:
+            attempt += 1
+            (before,) = struct.unpack_from('=I', self.__map,
+                                           _SEQUENCE_OFFSET)
+            # An odd sequence means the writer is in the middle of an
+            # update.
+            if before & 1 == 0:
+                values = self.__values.unpack_from(self.__map,
+                                                   self.__values_offset)
+                (after,) = struct.unpack_from('=I', self.__map,
+                                              _SEQUENCE_OFFSET)
+                if after == before:
+                    return dict(zip(self.__names, values))
+            if attempt == _READ_SPINS:
+                deadline = time.time() + _READ_TIMEOUT
+            elif attempt > _READ_SPINS:
+                if time.time() >= deadline:
+                    raise SharedCountersError('the writer of the shared ' +
+                                              'counters didn\'t finish an ' +
+                                              'update in %g second(s)' %
+                                              _READ_TIMEOUT)
+                time.sleep(0)
+
+    def close(self):
+        """Unmap the segment."""
+        self.__map.close()
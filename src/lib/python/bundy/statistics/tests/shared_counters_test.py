@@ -0,0 +1,91 @@
+# Copyright (C) 2014  Internet Systems Consortium.
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND INTERNET SYSTEMS CONSORTIUM
+# DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL
+# INTERNET SYSTEMS CONSORTIUM BE LIABLE FOR ANY SPECIAL, DIRECT,
+# INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING
+# FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+# WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+'''Tests for bundy.statistics.shared_counters'''
+
+import unittest
+import os
+import struct
+
+from bundy.statistics.shared_counters import SharedCountersReader, \
+    SharedCountersError
+
+SEGMENT_FILE = 'shared_counters_test.seg'
+
+def write_segment(names, values, sequence=2, stale=0, magic=0x42535443):
+    '''Write a segment in the layout of bundy::statistics::SharedCounters.'''
+    names_data = b''.join([name.encode() + b'\0' for name in names])
+    names_offset = 32
+    values_offset = (names_offset + len(names_data) + 63) // 64 * 64
+    data = struct.pack('=8I', magic, 1, sequence, stale, len(names),
+                       names_offset, len(names_data), values_offset)
+    data += names_data
+    data += b'\0' * (values_offset - len(data))
+    data += struct.pack('=%dQ' % len(values), *values)
+    with open(SEGMENT_FILE, 'wb') as f:
+        f.write(data)
+
+class SharedCountersReaderTest(unittest.TestCase):
+    def tearDown(self):
+        if os.path.exists(SEGMENT_FILE):
+            os.unlink(SEGMENT_FILE)
+
+    def test_read(self):
+        names = ['zones/_SERVER_/request/v4', 'latency/total/count']
+        write_segment(names, [3, 2**40])
+        reader = SharedCountersReader(SEGMENT_FILE)
+        self.assertEqual(names, reader.get_item_names())
+        self.assertFalse(reader.is_stale())
+        self.assertEqual({'zones/_SERVER_/request/v4': 3,
+                          'latency/total/count': 2**40}, reader.read())
+        reader.close()
+
+    def test_empty(self):
+        write_segment([], [])
+        reader = SharedCountersReader(SEGMENT_FILE)
+        self.assertEqual([], reader.get_item_names())
+        self.assertEqual({}, reader.read())
+        reader.close()
+
+    def test_stale(self):
+        write_segment(['a'], [1], stale=1)
+        reader = SharedCountersReader(SEGMENT_FILE)
+        self.assertTrue(reader.is_stale())
+        reader.close()
+
+    def test_unfinished_update(self):
+        # The sequence stays odd when the writer dies during an update.
+        write_segment(['a'], [1], sequence=3)
+        reader = SharedCountersReader(SEGMENT_FILE)
+        self.assertRaises(SharedCountersError, reader.read)
+        reader.close()
+
+    def test_malformed(self):
+        self.assertRaises(SharedCountersError, SharedCountersReader,
+                          'no_such_file.seg')
+        write_segment(['a'], [1], magic=0)
+        self.assertRaises(SharedCountersError, SharedCountersReader,
+                          SEGMENT_FILE)
+        with open(SEGMENT_FILE, 'wb') as f:
+            f.write(b'short')
+        self.assertRaises(SharedCountersError, SharedCountersReader,
+                          SEGMENT_FILE)
+        # The values beyond the end of the file.
+        write_segment(['a', 'b'], [1])
+        self.assertRaises(SharedCountersError, SharedCountersReader,
+                          SEGMENT_FILE)
+
+if __name__== "__main__":
+    unittest.main()
@@ -18,10 +18,17 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>             // for some IPC/network system calls
+#include <pthread.h>
+#include <algorithm>
 #include <string>
+#include <map>
+#include <set>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 
 #include <dns/question.h>
 #include <dns/message.h>
@@ -123,6 +130,154 @@ deepestDelegation(Name name, RRClass rrclass,
     return (".");
 }
 
+namespace {
+class RunningQuery;
+}
+
+/// \brief Table of outstanding recursive queries
+///
+/// Maps the question being resolved (together with the DO bit of the
+/// client query) to the RunningQuery resolving it.  A RunningQuery adds
+/// itself when it is created and removes itself as soon as it has called
+/// back, so that any later query for the same question starts over (and
+/// will most likely be answered from the cache).
+///
+/// The table is shared by the RecursiveQuery and its RunningQuery objects,
+/// as the latter may outlive the former.
+class InflightQueryTable {
+public:
+    /// \brief Key of the table
+    struct Key {
+        Key(const Question& question, bool dnssec_ok) :
+            name_(question.getName()), type_(question.getType()),
+            class_(question.getClass()), dnssec_ok_(dnssec_ok)
+        {}
+
+        bool operator<(const Key& other) const {
+            if (type_ != other.type_) {
+                return (type_ < other.type_);
+            }
+            if (class_ != other.class_) {
+                return (class_ < other.class_);
+            }
+            if (dnssec_ok_ != other.dnssec_ok_) {
+                return (dnssec_ok_ < other.dnssec_ok_);
+            }
+            return (name_ < other.name_);
+        }
+
+        Name name_;
+        RRType type_;
+        RRClass class_;
+        bool dnssec_ok_;
+    };
+
+    InflightQueryTable() : coalesced_(0) {}
+
+    /// \brief Return the outstanding query for the key, or NULL
+    RunningQuery* find(const Key& key) const {
+        const QueryMap::const_iterator it = queries_.find(key);
+        return (it == queries_.end() ? NULL : it->second);
+    }
+
+    /// \brief Register a new outstanding query
+    ///
+    /// If there is already one for the key (which can only happen if the
+    /// caller decided not to coalesce), the existing one is kept.
+    void add(const Key& key, RunningQuery* query) {
+        queries_.insert(QueryMap::value_type(key, query));
+    }
+
+    /// \brief Unregister the query, if it is the one stored for the key
+    void remove(const Key& key, const RunningQuery* query) {
+        const QueryMap::iterator it = queries_.find(key);
+        if (it != queries_.end() && it->second == query) {
+            queries_.erase(it);
+        }
+    }
+
+    /// \brief Record that a query was attached to an outstanding one
+    void addCoalesced() {
+        ++coalesced_;
+    }
+
+    uint64_t getCoalescedCount() const {
+        return (coalesced_);
+    }
+
+    size_t size() const {
+        return (queries_.size());
+    }
+
+private:
+    typedef std::map<Key, RunningQuery*> QueryMap;
+    QueryMap queries_;
+    uint64_t coalesced_;
+};
+
+/// \brief The queries a RecursiveQuery has started and that still exist
+///
+/// The queries add themselves when they are created and remove themselves
+/// when they are deleted, so they can be abandoned when the IOService they
+/// run in goes away (see RecursiveQuery::abandonQueries()).
+///
+/// Like the InflightQueryTable, the list is shared by the RecursiveQuery
+/// and the queries, as the latter may outlive the former.
+class PendingQueryList {
+public:
+    /// \brief Interface of the queries in the list
+    class Query {
+    public:
+        virtual ~Query() {}
+
+        /// \brief Answer SERVFAIL (if not answered yet) and stop
+        ///
+        /// The query may be deleted before this returns.
+        virtual void abandon() = 0;
+    };
+
+    PendingQueryList() : abandoned_(false) {}
+
+    void add(Query* query) {
+        queries_.insert(query);
+    }
+
+    void remove(Query* query) {
+        queries_.erase(query);
+    }
+
+    /// \brief Abandon all the queries
+    ///
+    /// The list stays abandoned, so queries should not be started any
+    /// more (see isAbandoned()).
+    ///
+    /// \return The number of queries abandoned.
+    size_t abandonAll() {
+        abandoned_ = true;
+        // Abandoning one query may complete (and delete) another one,
+        // for instance through the NSAS, so each one is checked to be
+        // still there before it is abandoned.
+        const std::vector<Query*> queries(queries_.begin(), queries_.end());
+        size_t count = 0;
+        for (std::vector<Query*>::const_iterator it = queries.begin();
+             it != queries.end(); ++it) {
+            if (queries_.count(*it) > 0) {
+                (*it)->abandon();
+                ++count;
+            }
+        }
+        return (count);
+    }
+
+    bool isAbandoned() const {
+        return (abandoned_);
+    }
+
+private:
+    std::set<Query*> queries_;
+    bool abandoned_;
+};
+
 // Here we do not use the typedef above, as the SunStudio compiler
 // mishandles this in its name mangling, and wouldn't compile.
 // We can probably use a typedef, but need to move it to a central
@@ -141,7 +296,11 @@ RecursiveQuery::RecursiveQuery(DNSServiceBase& dns_service,
     upstream_root_(new AddressVector(upstream_root)),
     test_server_("", 0),
     query_timeout_(query_timeout), client_timeout_(client_timeout),
-    lookup_timeout_(lookup_timeout), retries_(retries), rtt_recorder_()
+    lookup_timeout_(lookup_timeout), retries_(retries), rtt_recorder_(),
+    inflight_(new InflightQueryTable),
+    pending_(new PendingQueryList),
+    socket_pool_(new UDPSocketPool(dns_service.getIOService())),
+    connection_pool_(new TCPConnectionPool(dns_service.getIOService()))
 {
 }
 
@@ -159,6 +318,34 @@ RecursiveQuery::setRttRecorder(boost::shared_ptr<RttRecorder>& recorder) {
     rtt_recorder_ = recorder;
 }
 
+uint64_t
+RecursiveQuery::getCoalescedQueryCount() const {
+    return (inflight_->getCoalescedCount());
+}
+
+size_t
+RecursiveQuery::getInflightQueryCount() const {
+    return (inflight_->size());
+}
+
+size_t
+RecursiveQuery::abandonQueries() {
+    const size_t count = pending_->abandonAll();
+    LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE,
+              RESLIB_QUERIES_ABANDONED).arg(count);
+    return (count);
+}
+
+const UDPSocketPool&
+RecursiveQuery::getSocketPool() const {
+    return (*socket_pool_);
+}
+
+const TCPConnectionPool&
+RecursiveQuery::getConnectionPool() const {
+    return (*connection_pool_);
+}
+
 namespace {
 typedef std::pair<std::string, uint16_t> addr_t;
 
@@ -169,13 +356,54 @@ typedef std::pair<std::string, uint16_t> addr_t;
  *
  * Used by RecursiveQuery::sendQuery.
  */
-class RunningQuery : public IOFetch::Callback, public AbstractRunningQuery {
+class RunningQuery : public IOFetch::Callback, public AbstractRunningQuery,
+    public PendingQueryList::Query {
 
-class ResolverNSASCallback : public bundy::nsas::AddressRequestCallback {
+/// \brief Receives the results of NSAS lookups for a RunningQuery
+///
+/// The NSAS may be shared between several threads, each running its own
+/// IOService, and it calls the callback from whichever thread completed
+/// the lookup.  The RunningQuery is not thread safe, so when called from
+/// a foreign thread, the result is posted to the IOService of the query
+/// and delivered from there.  The query cancels the callback when it
+/// stops, so a delivery that comes too late is dropped.
+class ResolverNSASCallback : public bundy::nsas::AddressRequestCallback,
+    public boost::enable_shared_from_this<ResolverNSASCallback> {
 public:
-    ResolverNSASCallback(RunningQuery* rq) : rq_(rq) {}
+    ResolverNSASCallback(RunningQuery* rq, IOService& io) :
+        rq_(rq), io_(io), owner_(pthread_self())
+    {}
 
     void success(const bundy::nsas::NameserverAddress& address) {
+        if (pthread_equal(pthread_self(), owner_)) {
+            deliverSuccess(address);
+        } else {
+            io_.get_io_service().post(
+                boost::bind(&ResolverNSASCallback::deliverSuccess,
+                            shared_from_this(), address));
+        }
+    }
+
+    void unreachable() {
+        if (pthread_equal(pthread_self(), owner_)) {
+            deliverUnreachable();
+        } else {
+            io_.get_io_service().post(
+                boost::bind(&ResolverNSASCallback::deliverUnreachable,
+                            shared_from_this()));
+        }
+    }
+
+    // Called by the query when it stops, from its own thread.
+    void cancel() {
+        rq_ = NULL;
+    }
+
+private:
+    void deliverSuccess(const bundy::nsas::NameserverAddress& address) {
+        if (rq_ == NULL) {
+            return;
+        }
         // Success callback, send query to found namesever
         LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_CB, RESLIB_RUNQ_SUCCESS)
                   .arg(address.getAddress().toText());
@@ -183,7 +411,10 @@ public:
         rq_->sendTo(address);
     }
 
-    void unreachable() {
+    void deliverUnreachable() {
+        if (rq_ == NULL) {
+            return;
+        }
         // Nameservers unreachable: drop query or send servfail?
         LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_CB, RESLIB_RUNQ_FAIL);
         rq_->nsasCallbackCalled();
@@ -192,8 +423,9 @@ public:
         rq_->stop();
     }
 
-private:
     RunningQuery* rq_;
+    IOService& io_;
+    const pthread_t owner_;
 };
 
 
@@ -236,14 +468,22 @@ private:
     // from lib/resolve/response_classifier.h)
     unsigned cname_count_;
 
-    /*
-     * TODO Do something more clever with timeouts. In the long term, some
-     *     computation of average RTT, increase with each retry, etc.
-     */
-    // Timeout information for outgoing queries
+    // Timeout information for outgoing queries.  The query timeout is the
+    // upper bound, the actual timeout of a query depends on the RTT of
+    // the server it is sent to (see sendTo()).
     int query_timeout_;
     unsigned retries_;
 
+    // The RTT based timeouts can be much shorter than the query timeout.
+    // The queries timing out before it are resent within what is left of
+    // the query timeout (in ms) without using up a retry, so as slow
+    // servers get as much time as they would have with the query timeout
+    // alone.  Zero when the next query starts a new query timeout.
+    int timeout_budget_;
+
+    // Timeout of the query in progress (in ms)
+    int current_timeout_;
+
     // normal query state
 
     // TODO: replace by our wrapper
@@ -305,6 +545,41 @@ private:
     // sent to this object as well as being used to update the NSAS.
     boost::shared_ptr<RttRecorder> rtt_recorder_;
 
+    // The table of outstanding queries we are registered in, and the key
+    // we are registered with.  The key is taken from the original question,
+    // as question_ changes when following a CNAME chain.
+    boost::shared_ptr<InflightQueryTable> inflight_;
+    const InflightQueryTable::Key inflight_key_;
+
+    // Upstream UDP queries are sent from sockets taken from here, TCP
+    // ones through the connections kept here
+    boost::shared_ptr<UDPSocketPool> socket_pool_;
+    boost::shared_ptr<TCPConnectionPool> connection_pool_;
+
+    // The list of queries we are in, and the upstream query in progress
+    // (if any), kept so it can be cancelled when we are abandoned
+    boost::shared_ptr<PendingQueryList> pending_;
+    boost::scoped_ptr<IOFetch> fetch_;
+
+    // Client timeout (in ms) of the clients attached to us
+    const int client_timeout_;
+
+    // Other clients asking the same question while we were resolving it.
+    // They are answered with a copy of our answer when we are done, or
+    // with SERVFAIL when their own client timeout expires first.
+    struct Follower : boost::noncopyable {
+        Follower(IOService& io, MessagePtr answer_message,
+                 bundy::resolve::ResolverInterface::CallbackPtr callback) :
+            answer_message_(answer_message), callback_(callback),
+            client_timer_(io.get_io_service())
+        {}
+        MessagePtr answer_message_;
+        bundy::resolve::ResolverInterface::CallbackPtr callback_;
+        asio::deadline_timer client_timer_;
+    };
+    typedef boost::shared_ptr<Follower> FollowerPtr;
+    std::vector<FollowerPtr> followers_;
+
     // perform a single lookup; first we check the cache to see
     // if we have a response for our query stored already. if
     // so, call handlerecursiveresponse(), if not, we call send()
@@ -349,16 +624,40 @@ private:
                 test_server_.first,
                 test_server_.second, buffer_, this,
                 query_timeout_, edns_);
-            io_.get_io_service().post(query);
+            query.setSocketPool(socket_pool_);
+            query.setConnectionPool(connection_pool_);
+            startFetch(query);
         } else {
+            // Don't wait for the full query timeout if we know the server
+            // usually answers much faster.  (A negative timeout means
+            // no timeout at all.)
+            int timeout = query_timeout_;
+            if (query_timeout_ >= 0) {
+                if (timeout_budget_ <= 0) {
+                    timeout_budget_ = query_timeout_;
+                }
+                timeout = std::min(static_cast<int>(
+                                       current_ns_address.getAddressEntry().
+                                       getRetransmitTimeout(query_timeout_)),
+                                   timeout_budget_);
+                current_timeout_ = timeout;
+            }
             IOFetch query(protocol_, io_, question_,
                 current_ns_address.getAddress(),
                 53, buffer_, this,
-                query_timeout_, edns_);
-            io_.get_io_service().post(query);
+                timeout, edns_);
+            query.setSocketPool(socket_pool_);
+            query.setConnectionPool(connection_pool_);
+            startFetch(query);
         }
     }
 
+    // Start the upstream query, keeping a copy of it so it can be stopped
+    void startFetch(const IOFetch& query) {
+        fetch_.reset(new IOFetch(query));
+        io_.get_io_service().post(query);
+    }
+
     // 'general' send, ask the NSAS to give us an address.
     void send(IOFetch::Protocol protocol = IOFetch::UDP, bool edns = true) {
         protocol_ = protocol;   // Store protocol being used for this
@@ -374,7 +673,9 @@ private:
                 test_server_.first,
                 test_server_.second, buffer_, this,
                 query_timeout_, edns_);
-            io_.get_io_service().post(query);
+            query.setSocketPool(socket_pool_);
+            query.setConnectionPool(connection_pool_);
+            startFetch(query);
 
         } else {
             // Ask the NSAS for an address for the current zone,
@@ -676,7 +977,12 @@ public:
         unsigned retries,
         bundy::nsas::NameserverAddressStore& nsas,
         bundy::cache::ResolverCache& cache,
-        boost::shared_ptr<RttRecorder>& recorder)
+        boost::shared_ptr<RttRecorder>& recorder,
+        boost::shared_ptr<InflightQueryTable> inflight,
+        boost::shared_ptr<UDPSocketPool> socket_pool,
+        boost::shared_ptr<TCPConnectionPool> connection_pool,
+        boost::shared_ptr<PendingQueryList> pending,
+        bool dnssec_ok)
         :
         io_(io),
         question_(question),
@@ -689,6 +995,8 @@ public:
         cname_count_(0),
         query_timeout_(query_timeout),
         retries_(retries),
+        timeout_budget_(0),
+        current_timeout_(0),
         client_timer(io.get_io_service()),
         lookup_timer(io.get_io_service()),
         done_(false),
@@ -699,10 +1007,21 @@ public:
         nsas_callback_(),
         nsas_callback_out_(false),
         outstanding_events_(0),
-        rtt_recorder_(recorder)
+        rtt_recorder_(recorder),
+        inflight_(inflight),
+        inflight_key_(question, dnssec_ok),
+        socket_pool_(socket_pool),
+        connection_pool_(connection_pool),
+        pending_(pending),
+        client_timeout_(client_timeout)
     {
         // Set here to avoid using "this" in initializer list.
-        nsas_callback_.reset(new ResolverNSASCallback(this));
+        nsas_callback_.reset(new ResolverNSASCallback(this, io_));
+
+        // Register before starting, doLookup() may already complete
+        // the query.
+        inflight_->add(inflight_key_, this);
+        pending_->add(this);
 
         // Setup the timer to stop trying (lookup_timeout)
         if (lookup_timeout >= 0) {
@@ -723,12 +1042,56 @@ public:
         doLookup();
     }
 
-    virtual ~RunningQuery() {};
+    virtual ~RunningQuery() {
+        // Normally done in callCallback(), but we may be deleted before
+        // (in some unit tests).
+        inflight_->remove(inflight_key_, this);
+        pending_->remove(this);
+    }
+
+    virtual void abandon() {
+        done_ = true;
+        if (isAwaited()) {
+            makeSERVFAIL();
+            callCallback(true);
+        }
+        if (fetch_) {
+            // The fetch calls us back with STOPPED and we stop there
+            // (so we may be gone once it returns).
+            IOFetch fetch(*fetch_);
+            fetch.stop(IOFetch::STOPPED);
+        } else {
+            stop();
+        }
+    }
+
+    // Attach another client asking the same question; it will be called
+    // back when we are done, or when its client timeout expires.
+    void attach(MessagePtr answer_message,
+                bundy::resolve::ResolverInterface::CallbackPtr callback)
+    {
+        const FollowerPtr follower(new Follower(io_, answer_message,
+                                                callback));
+        followers_.push_back(follower);
+        if (client_timeout_ >= 0) {
+            follower->client_timer_.expires_from_now(
+                boost::posix_time::milliseconds(client_timeout_));
+            ++outstanding_events_;
+            follower->client_timer_.async_wait(
+                boost::bind(&RunningQuery::followerTimeout, this, follower));
+        }
+    }
+
+    // Whether our client or any of the attached ones still waits for
+    // an answer
+    bool isAwaited() const {
+        return (!callback_called_ || !followers_.empty());
+    }
 
     // called if we have a lookup timeout; if our callback has
     // not been called, call it now. Then stop.
     void lookupTimeout() {
-        if (!callback_called_) {
+        if (isAwaited()) {
             makeSERVFAIL();
             callCallback(true);
         }
@@ -741,8 +1104,24 @@ public:
     // not been called, call it now. But do not stop.
     void clientTimeout() {
         if (!callback_called_) {
-            makeSERVFAIL();
-            callCallback(true);
+            if (followers_.empty() || !answer_message_) {
+                makeSERVFAIL();
+                callCallback(true);
+            } else {
+                // The attached clients have client timeouts of their own
+                // and go on waiting.  Only our client is answered, the
+                // answer for them is built in a message of our own from
+                // now on (starting with the CNAMEs followed so far).
+                const MessagePtr answer(answer_message_);
+                answer_message_.reset(new Message(Message::RENDER));
+                bundy::resolve::initResponseMessage(*answer,
+                                                    *answer_message_);
+                answer_message_->appendSection(Message::SECTION_ANSWER,
+                                               *answer);
+                bundy::resolve::makeErrorMessage(answer, Rcode::SERVFAIL());
+                callback_called_ = true;
+                resolvercallback_->success(answer);
+            }
         }
         assert(outstanding_events_ > 0);
         --outstanding_events_;
@@ -751,10 +1130,37 @@ public:
         }
     }
 
-    // If the callback has not been called yet, call it now
+    // called if the client timeout of an attached client expires before
+    // we are done; it gets SERVFAIL, the others go on waiting.
+    void followerTimeout(FollowerPtr follower) {
+        const std::vector<FollowerPtr>::iterator it =
+            std::find(followers_.begin(), followers_.end(), follower);
+        // Not there any more if it was answered (and the timer cancelled)
+        if (it != followers_.end()) {
+            followers_.erase(it);
+            if (follower->answer_message_) {
+                bundy::resolve::makeErrorMessage(follower->answer_message_,
+                                                 Rcode::SERVFAIL());
+            }
+            follower->callback_->success(follower->answer_message_);
+        }
+        assert(outstanding_events_ > 0);
+        --outstanding_events_;
+        if (outstanding_events_ == 0) {
+            stop();
+        }
+    }
+
+    // If the callbacks (ours or those of the attached clients) have not
+    // been called yet, call them now
     // If success is true, we call 'success' with our answer_message
     // If it is false, we call failure()
     void callCallback(bool success) {
+        // Whatever the outcome, new queries for this question must not
+        // be attached to us any more.
+        inflight_->remove(inflight_key_, this);
+        callFollowers(success);
+
         if (!callback_called_) {
             callback_called_ = true;
 
@@ -783,10 +1189,28 @@ public:
         }
     }
 
+    // Pass our result to the clients that were attached to us.
+    void callFollowers(bool success) {
+        std::vector<FollowerPtr> followers;
+        followers.swap(followers_);
+        for (std::vector<FollowerPtr>::const_iterator it = followers.begin();
+             it != followers.end(); ++it) {
+            (*it)->client_timer_.cancel();
+            if (success) {
+                bundy::resolve::copyResponseMessage(*answer_message_,
+                                                    (*it)->answer_message_);
+                (*it)->callback_->success((*it)->answer_message_);
+            } else {
+                (*it)->callback_->failure();
+            }
+        }
+    }
+
     // We are done. If there are no more outstanding events, we delete
     // ourselves. If there are any, we do not.
     void stop() {
         done_ = true;
+        nsas_callback_->cancel();
         if (nsas_callback_out_) {
             nsas_.cancel(cur_zone_, question_.getClass(), nsas_callback_);
             nsas_callback_out_ = false;
@@ -805,9 +1229,16 @@ public:
         // XXX is this the place for TCP retry?
         assert(outstanding_events_ > 0);
         --outstanding_events_;
+        fetch_.reset();
+
+        if (!done_ && result == IOFetch::TIME_OUT) {
+            timeout_budget_ -= current_timeout_;
+            current_timeout_ = 0;
+        }
 
         if (!done_ && result != IOFetch::TIME_OUT) {
             // we got an answer
+            timeout_budget_ = 0;
 
             // Update the NSAS with the time it took
             struct timeval cur_time;
@@ -856,13 +1287,23 @@ public:
                     LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_RESULTS,
                               RESLIB_PROTOCOL)
                               .arg(questionText(question_)).arg(dpe.what());
-                    if (!callback_called_) {
+                    if (isAwaited()) {
                         makeSERVFAIL();
                         callCallback(true);
                     }
                     stop();
                 }
             }
+        } else if (!done_ && timeout_budget_ > 0) {
+            // Query timed out before the query timeout, send again within
+            // what is left of it
+            LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_RESULTS,
+                      RESLIB_TIMEOUT_RESEND)
+                      .arg(questionText(question_))
+                      .arg(current_ns_address.getAddress().toText())
+                      .arg(timeout_budget_);
+            current_ns_address.updateRTT(bundy::nsas::AddressEntry::UNREACHABLE);
+            send();
         } else if (!done_ && retries_--) {
             // Query timed out, but we have some retries, so send again
             LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_RESULTS, RESLIB_TIMEOUT_RETRY)
@@ -878,7 +1319,7 @@ public:
                           .arg(current_ns_address.getAddress().toText());
                 current_ns_address.updateRTT(bundy::nsas::AddressEntry::UNREACHABLE);
             }
-            if (!callback_called_) {
+            if (isAwaited()) {
                 makeSERVFAIL();
                 callCallback(true);
             }
@@ -895,7 +1336,8 @@ public:
     }
 };
 
-class ForwardQuery : public IOFetch::Callback, public AbstractRunningQuery {
+class ForwardQuery : public IOFetch::Callback, public AbstractRunningQuery,
+    public PendingQueryList::Query {
 private:
     // The io service to handle async calls
     IOService& io_;
@@ -935,8 +1377,22 @@ private:
     // don't call back a second time later
     bool callback_called_;
 
+    // The query is sent from a socket taken from here, or through one of
+    // the connections kept here
+    boost::shared_ptr<UDPSocketPool> socket_pool_;
+    boost::shared_ptr<TCPConnectionPool> connection_pool_;
+
+    // Protocol used for the last query sent
+    IOFetch::Protocol protocol_;
+
+    // The list of queries we are in, and the upstream query in progress
+    // (if any)
+    boost::shared_ptr<PendingQueryList> pending_;
+    boost::scoped_ptr<IOFetch> fetch_;
+
     // send the query to the server.
     void send(IOFetch::Protocol protocol = IOFetch::UDP) {
+        protocol_ = protocol;
         const int uc = upstream_->size();
         buffer_->clear();
         int serverIndex = rand() % uc;
@@ -953,7 +1409,10 @@ private:
             upstream_->at(serverIndex).first,
             upstream_->at(serverIndex).second,
             buffer_, this, query_timeout_);
+        query.setSocketPool(socket_pool_);
+        query.setConnectionPool(connection_pool_);
 
+        fetch_.reset(new IOFetch(query));
         io_.get_io_service().post(query);
     }
 
@@ -964,7 +1423,10 @@ public:
         boost::shared_ptr<AddressVector> upstream,
         OutputBufferPtr buffer,
         bundy::resolve::ResolverInterface::CallbackPtr cb,
-        int query_timeout, int client_timeout, int lookup_timeout) :
+        int query_timeout, int client_timeout, int lookup_timeout,
+        boost::shared_ptr<UDPSocketPool> socket_pool,
+        boost::shared_ptr<TCPConnectionPool> connection_pool,
+        boost::shared_ptr<PendingQueryList> pending) :
         io_(io),
         query_message_(query_message),
         answer_message_(answer_message),
@@ -975,8 +1437,14 @@ public:
         client_timer(io.get_io_service()),
         lookup_timer(io.get_io_service()),
         outstanding_events_(0),
-        callback_called_(false)
+        callback_called_(false),
+        socket_pool_(socket_pool),
+        connection_pool_(connection_pool),
+        protocol_(IOFetch::UDP),
+        pending_(pending)
     {
+        pending_->add(this);
+
         // Setup the timer to stop trying (lookup_timeout)
         if (lookup_timeout >= 0) {
             lookup_timer.expires_from_now(
@@ -996,7 +1464,23 @@ public:
         send();
     }
 
-    virtual ~ForwardQuery() {};
+    virtual ~ForwardQuery() {
+        pending_->remove(this);
+    }
+
+    virtual void abandon() {
+        if (!callback_called_) {
+            makeSERVFAIL();
+            callCallback(true);
+        }
+        if (fetch_) {
+            // As in RunningQuery::abandon()
+            IOFetch fetch(*fetch_);
+            fetch.stop(IOFetch::STOPPED);
+        } else {
+            stop();
+        }
+    }
 
     virtual void lookupTimeout() {
         if (!callback_called_) {
@@ -1054,11 +1538,21 @@ public:
         // XXX is this the place for TCP retry?
         assert(outstanding_events_ > 0);
         --outstanding_events_;
-        if (result != IOFetch::TIME_OUT) {
+        fetch_.reset();
+        if (result == IOFetch::SUCCESS) {
             // we got an answer
             Message incoming(Message::PARSE);
             InputBuffer ibuf(buffer_->getData(), buffer_->getLength());
             incoming.fromWire(ibuf);
+            if (protocol_ == IOFetch::UDP && !callback_called_ &&
+                incoming.getHeaderFlag(Message::HEADERFLAG_TC)) {
+                // Truncated, ask again over TCP
+                LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_RESULTS,
+                          RESLIB_TRUNCATED).
+                    arg(questionText(**query_message_->beginQuestion()));
+                send(IOFetch::TCP);
+                return;
+            }
             bundy::resolve::copyResponseMessage(incoming, answer_message_);
             callCallback(true);
         }
@@ -1113,16 +1607,31 @@ RecursiveQuery::resolve(const QuestionPtr& question,
                                      cached_rrset);
             answer_message->setRcode(Rcode::NOERROR());
             callback->success(answer_message);
+        } else if (RunningQuery* running = inflight_->find(
+                       InflightQueryTable::Key(*question, false))) {
+            // Somebody is already asking the same, wait for its answer.
+            LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE, RESLIB_RECQ_COALESCED)
+                      .arg(questionText(*question)).arg(1);
+            inflight_->addCoalesced();
+            running->attach(answer_message, callback);
         } else {
             // Message not found in cache, start recursive query.  It will
             // delete itself when it is done
             LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE, RESLIB_RECQ_CACHE_NO_FIND)
                       .arg(questionText(*question)).arg(1);
+            if (pending_->isAbandoned()) {
+                LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE,
+                          RESLIB_RECQ_ABANDONED).arg(questionText(*question));
+                callback->failure();
+                return (NULL);
+            }
             return (new RunningQuery(io, *question, answer_message,
                                      test_server_, buffer, callback,
                                      query_timeout_, client_timeout_,
                                      lookup_timeout_, retries_, nsas_,
-                                     cache_, rtt_recorder_));
+                                     cache_, rtt_recorder_, inflight_,
+                                     socket_pool_, connection_pool_,
+                                     pending_, false));
         }
     }
     return (NULL);
@@ -1132,7 +1641,7 @@ AbstractRunningQuery*
 RecursiveQuery::resolve(const Question& question,
                         MessagePtr answer_message,
                         OutputBufferPtr buffer,
-                        DNSServer* server)
+                        DNSServer* server, bool dnssec_ok)
 {
     // XXX: eventually we will need to be able to determine whether
     // the message should be sent via TCP or UDP, or sent initially via
@@ -1176,15 +1685,31 @@ RecursiveQuery::resolve(const Question& question,
             answer_message->setRcode(Rcode::NOERROR());
             crs->success(answer_message);
 
+        } else if (RunningQuery* running = inflight_->find(
+                       InflightQueryTable::Key(question, dnssec_ok))) {
+            // Somebody is already asking the same, wait for its answer.
+            LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE, RESLIB_RECQ_COALESCED)
+                      .arg(questionText(question)).arg(2);
+            inflight_->addCoalesced();
+            running->attach(answer_message, crs);
         } else {
             // Message not found in cache, start recursive query.  It will
             // delete itself when it is done
             LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE, RESLIB_RECQ_CACHE_NO_FIND)
                       .arg(questionText(question)).arg(2);
+            if (pending_->isAbandoned()) {
+                LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE,
+                          RESLIB_RECQ_ABANDONED).arg(questionText(question));
+                bundy::resolve::makeErrorMessage(answer_message, Rcode::SERVFAIL());
+                crs->success(answer_message);
+                return (NULL);
+            }
             return (new RunningQuery(io, question, answer_message,
                                      test_server_, buffer, crs, query_timeout_,
                                      client_timeout_, lookup_timeout_, retries_,
-                                     nsas_, cache_, rtt_recorder_));
+                                     nsas_, cache_, rtt_recorder_, inflight_,
+                                     socket_pool_, connection_pool_, pending_,
+                                     dnssec_ok));
         }
     }
     return (NULL);
@@ -1212,13 +1737,22 @@ RecursiveQuery::forward(ConstMessagePtr query_message,
     ConstQuestionPtr question = *query_message->beginQuestion();
     answer_message->addQuestion(*question);
 
+    if (pending_->isAbandoned()) {
+        LOG_DEBUG(bundy::resolve::logger, RESLIB_DBG_TRACE,
+                  RESLIB_RECQ_ABANDONED).arg(questionText(*question));
+        bundy::resolve::makeErrorMessage(answer_message, Rcode::SERVFAIL());
+        callback->success(answer_message);
+        return (NULL);
+    }
+
     // implement the simplest forwarder, which will pass
     // everything throught without interpretation, except
     // QID, port number. The response will not be cached.
     // It will delete itself when it is done
     return (new ForwardQuery(io, query_message, answer_message,
                              upstream_, buffer, callback, query_timeout_,
-                             client_timeout_, lookup_timeout_));
+                             client_timeout_, lookup_timeout_,
+                             socket_pool_, connection_pool_, pending_));
 }
 
 } // namespace asiodns
@@ -18,6 +18,8 @@
 #include <util/buffer.h>
 #include <asiodns/dns_service.h>
 #include <asiodns/dns_server.h>
+#include <asiodns/udp_socket_pool.h>
+#include <asiodns/tcp_connection_pool.h>
 #include <nsas/nameserver_address_store.h>
 #include <cache/resolver_cache.h>
 
@@ -73,6 +75,19 @@ public:
     virtual ~AbstractRunningQuery() {};
 };
 
+/// \brief Table of outstanding recursive queries
+///
+/// Defined in the implementation; RecursiveQuery and the running queries
+/// it creates share it so that identical questions asked while one of them
+/// is still being resolved are answered by a single upstream resolution.
+class InflightQueryTable;
+
+/// \brief List of the queries a RecursiveQuery has started
+///
+/// Defined in the implementation; used to abandon the queries that are
+/// still in progress (see \c RecursiveQuery::abandonQueries()).
+class PendingQueryList;
+
 /// \brief Recursive Query
 ///
 /// The \c RecursiveQuery class provides a layer of abstraction around
@@ -143,6 +158,13 @@ public:
     /// CallbackPtr object shall be called (with either success() or
     /// failure(). See ResolverInterface::Callback for more information.
     ///
+    /// If a RunningQuery for the same <qname, qtype, qclass> is already
+    /// in progress, no new one is started; the callback is attached to the
+    /// outstanding query and called with a copy of its answer when it
+    /// completes.  Its client timeout runs from the time it was attached,
+    /// independently of that of the outstanding query.  NULL is returned
+    /// in that case.
+    ///
     /// \param question The question being answered <qname/qclass/qtype>
     /// \param callback Callback object. See
     ///        \c ResolverInterface::Callback for more information
@@ -162,17 +184,20 @@ public:
     /// \param buffer An output buffer into which the intermediate responses will
     ///        be copied.
     /// \param server A pointer to the \c DNSServer object handling the client
+    /// \param dnssec_ok The DO bit of the client query.  Queries are only
+    ///        coalesced with outstanding queries that have the same value.
     /// \return A pointer to the active AbstractRunningQuery object
     ///         created by this call (if any); this object should delete
     ///         itself in normal circumstances, and can normally be ignored
     ///         by the caller, but a pointer is returned for use-cases
     ///         such as unit tests.
-    ///         Returns NULL if the data was found internally and no actual
-    ///         query was sent.
+    ///         Returns NULL if the data was found internally or the
+    ///         question was attached to an outstanding query, i.e. no
+    ///         actual query was sent.
     AbstractRunningQuery* resolve(const bundy::dns::Question& question,
                           bundy::dns::MessagePtr answer_message,
                           bundy::util::OutputBufferPtr buffer,
-                          DNSServer* server);
+                          DNSServer* server, bool dnssec_ok = false);
 
     /// \brief Initiates forwarding for the given query.
     ///
@@ -208,6 +233,49 @@ public:
     /// \param port Port number of the test server
     void setTestServer(const std::string& address, uint16_t port);
 
+    /// \brief Return the number of coalesced queries
+    ///
+    /// Returns the number of resolve() calls (since construction) that did
+    /// not start a RunningQuery of their own because an identical query was
+    /// already outstanding.
+    uint64_t getCoalescedQueryCount() const;
+
+    /// \brief Return the number of outstanding queries
+    ///
+    /// Returns the number of distinct questions currently being resolved,
+    /// i.e. the number of RunningQuery objects that can still be joined.
+    size_t getInflightQueryCount() const;
+
+    /// \brief Give up on the queries in progress
+    ///
+    /// Every query started by this object that is still in progress (both
+    /// resolved and forwarded ones) answers its client with SERVFAIL at
+    /// once, unless it has done so already, and its upstream query and
+    /// timers are cancelled.  Queries started afterwards are answered with
+    /// SERVFAIL without resolving them.
+    ///
+    /// This is for when the IOService the queries run in is about to be
+    /// destroyed, the clients would not get any answer otherwise.  The
+    /// answers and the cancelled operations are delivered through the
+    /// IOService, so it must be polled before it is destroyed.
+    ///
+    /// \return The number of queries abandoned.
+    size_t abandonQueries();
+
+    /// \brief Return the pool of upstream UDP sockets
+    ///
+    /// All upstream UDP queries sent by this object (both resolved and
+    /// forwarded ones) use sockets from this pool.  It is exposed so the
+    /// socket statistics can be examined.
+    const UDPSocketPool& getSocketPool() const;
+
+    /// \brief Return the pool of upstream TCP connections
+    ///
+    /// Queries that have to be sent over TCP (usually because the UDP
+    /// answer was truncated) go through the connections kept open in this
+    /// pool.  It is exposed so the connection statistics can be examined.
+    const TCPConnectionPool& getConnectionPool() const;
+
 private:
     DNSServiceBase& dns_service_;
     bundy::nsas::NameserverAddressStore& nsas_;
@@ -222,6 +290,11 @@ private:
     int lookup_timeout_;
     unsigned retries_;
     boost::shared_ptr<RttRecorder>  rtt_recorder_;  ///< Round-trip time recorder
+    boost::shared_ptr<InflightQueryTable> inflight_; ///< Outstanding queries
+    boost::shared_ptr<PendingQueryList> pending_;   ///< All running queries
+    boost::shared_ptr<UDPSocketPool> socket_pool_; ///< Upstream UDP sockets
+    boost::shared_ptr<TCPConnectionPool> connection_pool_;
+                                         ///< Upstream TCP connections
 };
 
 }      // namespace asiodns
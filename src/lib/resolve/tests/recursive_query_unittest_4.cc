@@ -0,0 +1,592 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+
+#include <asio.hpp>
+
+#include <util/buffer.h>
+
+#include <dns/question.h>
+#include <dns/message.h>
+#include <dns/messagerenderer.h>
+#include <dns/opcode.h>
+#include <dns/name.h>
+#include <dns/rcode.h>
+#include <dns/rrtype.h>
+#include <dns/rrset.h>
+#include <dns/rrttl.h>
+#include <dns/rdata.h>
+
+#include <asiodns/dns_service.h>
+#include <asiolink/io_service.h>
+#include <resolve/recursive_query.h>
+#include <resolve/resolve.h>
+#include <resolve/resolver_interface.h>
+
+using namespace asio;
+using namespace asio::ip;
+using namespace bundy::asiolink;
+using namespace bundy::dns;
+using namespace bundy::dns::rdata;
+using namespace bundy::util;
+using namespace bundy::resolve;
+using namespace std;
+
+/// RecursiveQuery Test - 4
+///
+/// Checks that identical questions asked while one of them is still being
+/// resolved are coalesced: only one query is sent to the (fake) upstream
+/// server and every client gets the answer.
+///
+/// It also checks that truncated answers to forwarded queries are asked
+/// for again over TCP, reusing the connection to the upstream server.
+///
+/// As in the other tests, the "test_server_" element of RecursiveQuery is
+/// used to direct all queries to the UDP "server" in the test fixture.
+
+namespace {
+const char* const TEST_ADDRESS4 = "127.0.0.1"; ///< Server is on this address
+const uint16_t TEST_PORT4 = 5304;              ///< ... and this port
+const size_t BUFFER_SIZE = 1024;               ///< For all buffers
+} // end anonymous namespace
+
+namespace bundy {
+namespace asiodns {
+
+class MockResolver4 : public bundy::resolve::ResolverInterface {
+public:
+    virtual void resolve(const QuestionPtr&,
+                         const ResolverInterface::CallbackPtr&)
+    {}
+
+    virtual ~MockResolver4() {}
+};
+
+/// \brief Resolver Callback Object
+///
+/// Counts the answers and stops the service when all expected answers
+/// have been received.
+class ResolverCallback4 : public bundy::resolve::ResolverInterface::Callback {
+public:
+    ResolverCallback4(IOService& service, size_t& answered, size_t expected) :
+        service_(service), answered_(answered), expected_(expected),
+        status_(false)
+    {}
+
+    virtual void success(const bundy::dns::MessagePtr response) {
+        EXPECT_EQ(Rcode::NOERROR(), response->getRcode());
+        EXPECT_EQ(1, response->getRRCount(Message::SECTION_QUESTION));
+        EXPECT_EQ(1, response->getRRCount(Message::SECTION_ANSWER));
+        status_ = true;
+        done();
+    }
+
+    virtual void failure() {
+        ADD_FAILURE() << "Resolver reported completion failure";
+        done();
+    }
+
+    bool getStatus() const {
+        return (status_);
+    }
+
+private:
+    void done() {
+        if (++answered_ == expected_) {
+            service_.stop();
+        }
+    }
+
+    IOService& service_;
+    size_t& answered_;
+    const size_t expected_;
+    bool status_;
+};
+
+/// \brief Resolver Callback Object recording the RCODE of the answer
+class RcodeCallback4 : public bundy::resolve::ResolverInterface::Callback {
+public:
+    RcodeCallback4(IOService& service, size_t& answered, size_t expected) :
+        service_(service), answered_(answered), expected_(expected),
+        rcode_(Rcode::NOERROR()), answer_count_(0), called_(false)
+    {}
+
+    virtual void success(const bundy::dns::MessagePtr response) {
+        rcode_ = response->getRcode();
+        answer_count_ = response->getRRCount(Message::SECTION_ANSWER);
+        done();
+    }
+
+    virtual void failure() {
+        ADD_FAILURE() << "Resolver reported completion failure";
+        done();
+    }
+
+    bool isCalled() const {
+        return (called_);
+    }
+
+    const Rcode& getRcode() const {
+        return (rcode_);
+    }
+
+    unsigned int getAnswerCount() const {
+        return (answer_count_);
+    }
+
+private:
+    void done() {
+        EXPECT_FALSE(called_) << "Called back twice";
+        called_ = true;
+        if (++answered_ == expected_) {
+            service_.stop();
+        }
+    }
+
+    IOService& service_;
+    size_t& answered_;
+    const size_t expected_;
+    Rcode rcode_;
+    unsigned int answer_count_;
+    bool called_;
+};
+
+class RecursiveQueryTest4 : public ::testing::Test {
+protected:
+    RecursiveQueryTest4() :
+        dns_service_(service_, NULL, NULL),
+        resolver_(new MockResolver4()),
+        nsas_(new bundy::nsas::NameserverAddressStore(resolver_)),
+        udp_socket_(service_.get_io_service(), udp::v4()),
+        tcp_acceptor_(service_.get_io_service()),
+        tcp_socket_(service_.get_io_service()),
+        delay_timer_(service_.get_io_service()),
+        upstream_queries_(0),
+        answered_(0),
+        truncate_(false),
+        silent_(false),
+        delay_(0),
+        tcp_accepted_(0),
+        tcp_queries_(0)
+    {
+        udp_socket_.set_option(socket_base::reuse_address(true));
+        udp_socket_.bind(udp::endpoint(address::from_string(TEST_ADDRESS4),
+                                       TEST_PORT4));
+        receive();
+
+        const tcp::endpoint endpoint(address::from_string(TEST_ADDRESS4),
+                                     TEST_PORT4);
+        tcp_acceptor_.open(endpoint.protocol());
+        tcp_acceptor_.set_option(tcp::acceptor::reuse_address(true));
+        tcp_acceptor_.bind(endpoint);
+        tcp_acceptor_.listen();
+        tcp_acceptor_.async_accept(tcp_socket_,
+                                   boost::bind(&RecursiveQueryTest4::accepted,
+                                               this, _1));
+    }
+
+    ~RecursiveQueryTest4() {
+        delete nsas_;
+        resolver_.reset();
+    }
+
+    // Wait for the next upstream query
+    void receive() {
+        udp_socket_.async_receive_from(
+            asio::buffer(udp_receive_buffer_, sizeof(udp_receive_buffer_)),
+            udp_remote_,
+            boost::bind(&RecursiveQueryTest4::udpReceiveHandler, this, _1,
+                        _2));
+    }
+
+    // Answer any query with a single RR of the asked type (or with an
+    // empty truncated answer, if truncate_ is set, or not at all if
+    // silent_ is set).  The answer is sent delay_ ms later if it is set.
+    void udpReceiveHandler(asio::error_code ec, size_t length) {
+        if (ec) {
+            return;
+        }
+        ++upstream_queries_;
+        if (silent_) {
+            service_.stop();
+            receive();
+            return;
+        }
+
+        MessageRenderer renderer;
+        answer(udp_receive_buffer_, length, truncate_, renderer);
+        if (delay_ > 0) {
+            const uint8_t* data =
+                static_cast<const uint8_t*>(renderer.getData());
+            delayed_answer_.assign(data, data + renderer.getLength());
+            delay_timer_.expires_from_now(
+                boost::posix_time::milliseconds(delay_));
+            delay_timer_.async_wait(
+                boost::bind(&RecursiveQueryTest4::sendDelayed, this, _1));
+        } else {
+            udp_socket_.send_to(asio::buffer(renderer.getData(),
+                                             renderer.getLength()),
+                                udp_remote_);
+        }
+        receive();
+    }
+
+    void sendDelayed(asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        udp_socket_.send_to(asio::buffer(delayed_answer_), udp_remote_);
+    }
+
+    // Only one connection is accepted, the client is supposed to reuse it
+    void accepted(asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        ++tcp_accepted_;
+        tcp_socket_.set_option(tcp::no_delay(true));
+        readLength();
+    }
+
+    void readLength() {
+        asio::async_read(tcp_socket_, asio::buffer(tcp_receive_buffer_, 2),
+                         boost::bind(&RecursiveQueryTest4::lengthRead, this,
+                                     _1));
+    }
+
+    void lengthRead(asio::error_code ec) {
+        if (ec) {
+            return;
+        }
+        const size_t length = (tcp_receive_buffer_[0] << 8) |
+            tcp_receive_buffer_[1];
+        asio::async_read(tcp_socket_,
+                         asio::buffer(tcp_receive_buffer_, length),
+                         boost::bind(&RecursiveQueryTest4::tcpReceiveHandler,
+                                     this, _1, _2));
+    }
+
+    // Answer the query in full
+    void tcpReceiveHandler(asio::error_code ec, size_t length) {
+        if (ec) {
+            return;
+        }
+        ++tcp_queries_;
+
+        MessageRenderer renderer;
+        answer(tcp_receive_buffer_, length, false, renderer);
+        const uint8_t prefix[2] = {
+            static_cast<uint8_t>(renderer.getLength() >> 8),
+            static_cast<uint8_t>(renderer.getLength() & 0xff) };
+        asio::write(tcp_socket_, asio::buffer(prefix, 2));
+        asio::write(tcp_socket_, asio::buffer(renderer.getData(),
+                                              renderer.getLength()));
+        readLength();
+    }
+
+    // Ask the question (for the timers delaying a client)
+    static void ask(RecursiveQuery* query, const QuestionPtr& question,
+                    const ResolverInterface::CallbackPtr& callback)
+    {
+        query->resolve(question, callback);
+    }
+
+    // Render the answer to the query in data
+    void answer(const uint8_t* data, size_t length, bool truncated,
+                MessageRenderer& renderer)
+    {
+        Message query(Message::PARSE);
+        InputBuffer ibuffer(data, length);
+        query.fromWire(ibuffer);
+        const Question question = **query.beginQuestion();
+
+        Message response(Message::RENDER);
+        response.setQid(query.getQid());
+        response.setHeaderFlag(Message::HEADERFLAG_QR);
+        response.setHeaderFlag(Message::HEADERFLAG_AA);
+        response.setOpcode(Opcode::QUERY());
+        response.setRcode(Rcode::NOERROR());
+        response.addQuestion(question);
+        if (truncated) {
+            response.setHeaderFlag(Message::HEADERFLAG_TC);
+        } else {
+            RRsetPtr rrset(new RRset(question.getName(), question.getClass(),
+                                     question.getType(), RRTTL(300)));
+            rrset->addRdata(createRdata(question.getType(),
+                                        question.getClass(),
+                                        question.getType() == RRType::AAAA() ?
+                                        "2001:db8::1" : "192.0.2.1"));
+            response.addRRset(Message::SECTION_ANSWER, rrset);
+        }
+        response.toWire(renderer);
+    }
+
+    IOService service_;
+    DNSService dns_service_;
+    boost::shared_ptr<MockResolver4> resolver_;
+    bundy::nsas::NameserverAddressStore* nsas_;
+    bundy::cache::ResolverCache cache_;
+    udp::endpoint udp_remote_;
+    uint8_t udp_receive_buffer_[BUFFER_SIZE];
+    udp::socket udp_socket_;
+    tcp::acceptor tcp_acceptor_;
+    tcp::socket tcp_socket_;
+    uint8_t tcp_receive_buffer_[BUFFER_SIZE];
+    asio::deadline_timer delay_timer_;
+    std::vector<uint8_t> delayed_answer_;
+    size_t upstream_queries_;
+    size_t answered_;
+    bool truncate_;
+    bool silent_;
+    int delay_;
+    size_t tcp_accepted_;
+    size_t tcp_queries_;
+};
+
+// Several clients ask the same question at once; one upstream query
+// answers them all.
+TEST_F(RecursiveQueryTest4, coalesceIdentical) {
+    const size_t client_count = 5;
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root);
+    query.setTestServer(TEST_ADDRESS4, TEST_PORT4);
+
+    const QuestionPtr question(new Question(Name("coalesce.example.org"),
+                                            RRClass::IN(), RRType::A()));
+    std::vector<boost::shared_ptr<ResolverCallback4> > callbacks;
+    for (size_t i = 0; i < client_count; ++i) {
+        callbacks.push_back(boost::shared_ptr<ResolverCallback4>(
+            new ResolverCallback4(service_, answered_, client_count)));
+        AbstractRunningQuery* running = query.resolve(question,
+                                                      callbacks.back());
+        // Only the first one actually starts a query
+        if (i == 0) {
+            EXPECT_NE(static_cast<AbstractRunningQuery*>(NULL), running);
+        } else {
+            EXPECT_EQ(static_cast<AbstractRunningQuery*>(NULL), running);
+        }
+    }
+    EXPECT_EQ(1, query.getInflightQueryCount());
+    EXPECT_EQ(client_count - 1, query.getCoalescedQueryCount());
+
+    service_.run();
+
+    EXPECT_EQ(1, upstream_queries_);
+    EXPECT_EQ(client_count, answered_);
+    for (size_t i = 0; i < client_count; ++i) {
+        EXPECT_TRUE(callbacks[i]->getStatus());
+    }
+    // The query is finished, so nothing can be joined any more.
+    EXPECT_EQ(0, query.getInflightQueryCount());
+}
+
+// A client attached to an outstanding query has a client timeout of its
+// own: it still gets the answer after the client timeout of the first
+// client expired, as long as its own one didn't.
+TEST_F(RecursiveQueryTest4, coalesceClientTimeout) {
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    // The client timeout is 300ms, the upstream answers after 400ms
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root, 2000, 300, 2000, 0);
+    query.setTestServer(TEST_ADDRESS4, TEST_PORT4);
+    delay_ = 400;
+
+    const QuestionPtr question(new Question(Name("coalesce.example.org"),
+                                            RRClass::IN(), RRType::A()));
+    boost::shared_ptr<RcodeCallback4> first(
+        new RcodeCallback4(service_, answered_, 2));
+    boost::shared_ptr<RcodeCallback4> second(
+        new RcodeCallback4(service_, answered_, 2));
+    query.resolve(question, first);
+
+    // The second client comes 200ms later, it times out at 500ms
+    asio::deadline_timer timer(service_.get_io_service());
+    timer.expires_from_now(boost::posix_time::milliseconds(200));
+    timer.async_wait(boost::bind(&RecursiveQueryTest4::ask, &query,
+                                 question, second));
+    service_.run();
+
+    EXPECT_EQ(1, upstream_queries_);
+    EXPECT_EQ(1, query.getCoalescedQueryCount());
+    ASSERT_TRUE(first->isCalled());
+    EXPECT_EQ(Rcode::SERVFAIL(), first->getRcode());
+    ASSERT_TRUE(second->isCalled());
+    EXPECT_EQ(Rcode::NOERROR(), second->getRcode());
+    EXPECT_EQ(1, second->getAnswerCount());
+}
+
+// An attached client gets SERVFAIL when its own client timeout expires,
+// the others go on waiting for the answer.
+TEST_F(RecursiveQueryTest4, coalesceFollowerTimeout) {
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root, 2000, 300, 2000, 0);
+    query.setTestServer(TEST_ADDRESS4, TEST_PORT4);
+    delay_ = 500;
+
+    const QuestionPtr question(new Question(Name("coalesce.example.org"),
+                                            RRClass::IN(), RRType::A()));
+    boost::shared_ptr<RcodeCallback4> first(
+        new RcodeCallback4(service_, answered_, 3));
+    boost::shared_ptr<RcodeCallback4> second(
+        new RcodeCallback4(service_, answered_, 3));
+    boost::shared_ptr<RcodeCallback4> third(
+        new RcodeCallback4(service_, answered_, 3));
+    query.resolve(question, first);
+    // Times out at 300ms
+    query.resolve(question, second);
+
+    // Times out at 550ms, after the answer
+    asio::deadline_timer timer(service_.get_io_service());
+    timer.expires_from_now(boost::posix_time::milliseconds(250));
+    timer.async_wait(boost::bind(&RecursiveQueryTest4::ask, &query,
+                                 question, third));
+    service_.run();
+
+    EXPECT_EQ(1, upstream_queries_);
+    EXPECT_EQ(Rcode::SERVFAIL(), first->getRcode());
+    EXPECT_EQ(Rcode::SERVFAIL(), second->getRcode());
+    ASSERT_TRUE(third->isCalled());
+    EXPECT_EQ(Rcode::NOERROR(), third->getRcode());
+    EXPECT_EQ(1, third->getAnswerCount());
+}
+
+// Questions that differ in type are not coalesced.
+TEST_F(RecursiveQueryTest4, noCoalesceDifferent) {
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root);
+    query.setTestServer(TEST_ADDRESS4, TEST_PORT4);
+
+    const QuestionPtr question_a(new Question(Name("coalesce.example.org"),
+                                              RRClass::IN(), RRType::A()));
+    const QuestionPtr question_aaaa(new Question(Name("coalesce.example.org"),
+                                                 RRClass::IN(),
+                                                 RRType::AAAA()));
+    boost::shared_ptr<ResolverCallback4> callback_a(
+        new ResolverCallback4(service_, answered_, 2));
+    boost::shared_ptr<ResolverCallback4> callback_aaaa(
+        new ResolverCallback4(service_, answered_, 2));
+    query.resolve(question_a, callback_a);
+    query.resolve(question_aaaa, callback_aaaa);
+    EXPECT_EQ(2, query.getInflightQueryCount());
+    EXPECT_EQ(0, query.getCoalescedQueryCount());
+
+    service_.run();
+
+    EXPECT_EQ(2, upstream_queries_);
+    EXPECT_TRUE(callback_a->getStatus());
+    EXPECT_TRUE(callback_aaaa->getStatus());
+}
+
+// Truncated answers to forwarded queries are asked for again over TCP,
+// and the connection is kept for the next one.
+TEST_F(RecursiveQueryTest4, forwardTruncated) {
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    upstream.push_back(std::make_pair(std::string(TEST_ADDRESS4),
+                                      TEST_PORT4));
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root);
+    truncate_ = true;
+
+    const char* const names[] = { "tc1.example.org", "tc2.example.org" };
+    for (size_t i = 0; i < 2; ++i) {
+        MessagePtr query_message(new Message(Message::RENDER));
+        bundy::resolve::initResponseMessage(Question(Name(names[i]),
+                                                     RRClass::IN(),
+                                                     RRType::A()),
+                                            *query_message);
+        boost::shared_ptr<ResolverCallback4> callback(
+            new ResolverCallback4(service_, answered_, i + 1));
+        query.forward(query_message, MessagePtr(new Message(Message::RENDER)),
+                      OutputBufferPtr(new OutputBuffer(0)), NULL, callback);
+        service_.run();
+        service_.get_io_service().reset();
+        EXPECT_TRUE(callback->getStatus());
+    }
+
+    EXPECT_EQ(2, upstream_queries_);
+    EXPECT_EQ(2, tcp_queries_);
+    EXPECT_EQ(1, tcp_accepted_);
+    EXPECT_EQ(1, query.getConnectionPool().getConnectCount());
+    EXPECT_EQ(2, query.getConnectionPool().getQueryCount());
+}
+
+/// \brief Callback expecting a SERVFAIL answer
+class ServfailCallback4 : public bundy::resolve::ResolverInterface::Callback {
+public:
+    ServfailCallback4() : answered_(0) {}
+
+    virtual void success(const bundy::dns::MessagePtr response) {
+        EXPECT_EQ(Rcode::SERVFAIL(), response->getRcode());
+        ++answered_;
+    }
+
+    virtual void failure() {
+        ++answered_;
+    }
+
+    size_t answered_;
+};
+
+// Abandoned queries are answered at once and stop waiting for the
+// upstream server, and later queries aren't even started.
+TEST_F(RecursiveQueryTest4, abandonQueries) {
+    std::vector<std::pair<std::string, uint16_t> > upstream;
+    std::vector<std::pair<std::string, uint16_t> > upstream_root;
+    RecursiveQuery query(dns_service_, *nsas_, cache_, upstream,
+                         upstream_root);
+    query.setTestServer(TEST_ADDRESS4, TEST_PORT4);
+    silent_ = true;
+
+    const QuestionPtr question(new Question(Name("abandon.example.org"),
+                                            RRClass::IN(), RRType::A()));
+    boost::shared_ptr<ServfailCallback4> callback(new ServfailCallback4);
+    EXPECT_NE(static_cast<AbstractRunningQuery*>(NULL),
+              query.resolve(question, callback));
+    // Run until the server got the query (and ignored it)
+    service_.run();
+    EXPECT_EQ(1, upstream_queries_);
+    EXPECT_EQ(0, callback->answered_);
+
+    EXPECT_EQ(1, query.abandonQueries());
+    EXPECT_EQ(1, callback->answered_);
+    EXPECT_EQ(0, query.getInflightQueryCount());
+
+    // The cancelled fetch and timers finish without any retry
+    service_.get_io_service().reset();
+    service_.get_io_service().poll();
+    EXPECT_EQ(1, upstream_queries_);
+    EXPECT_EQ(0, query.abandonQueries());
+
+    boost::shared_ptr<ServfailCallback4> callback2(new ServfailCallback4);
+    EXPECT_EQ(static_cast<AbstractRunningQuery*>(NULL),
+              query.resolve(question, callback2));
+    EXPECT_EQ(1, callback2->answered_);
+    EXPECT_EQ(0, query.getInflightQueryCount());
+}
+
+} // namespace asiodns
+} // namespace bundy
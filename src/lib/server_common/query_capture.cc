@@ -0,0 +1,620 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <server_common/query_capture.h>
+#include <server_common/logger.h>
+
+#include <dns/labelsequence.h>
+#include <util/threads/thread.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace bundy::asiolink;
+using namespace bundy::data;
+using namespace bundy::dns;
+using namespace bundy::util;
+using namespace bundy::util::thread;
+
+namespace bundy {
+namespace server_common {
+
+namespace {
+
+// The types of the control frames of Frame Streams.
+const uint32_t CONTROL_START = 2;
+const uint32_t CONTROL_STOP = 3;
+// The type of the content type field of a control frame.
+const uint32_t CONTROL_FIELD_CONTENT_TYPE = 1;
+
+// The largest message length a record can hold.
+const size_t MAX_MESSAGE_LENGTH = 0xffff;
+
+void
+setUint16(uint8_t* data, const uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value;
+}
+
+void
+setUint32(uint8_t* data, const uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+void
+setUint64(uint8_t* data, const uint64_t value) {
+    setUint32(data, value >> 32);
+    setUint32(data + 4, value);
+}
+
+}
+
+const char* const QueryCapture::CONTENT_TYPE = "bundy:query-capture";
+const uint8_t QueryCapture::RECORD_VERSION;
+const size_t QueryCapture::HEADER_SIZE;
+const size_t QueryCapture::DEFAULT_BUFFER_SIZE;
+
+void
+CaptureSink::writeStart(const int fd) {
+    const size_t type_length = std::strlen(QueryCapture::CONTENT_TYPE);
+    std::vector<uint8_t> frame(20 + type_length);
+    // The escape (a zero length) and the length of the control frame.
+    setUint32(&frame[0], 0);
+    setUint32(&frame[4], frame.size() - 8);
+    setUint32(&frame[8], CONTROL_START);
+    setUint32(&frame[12], CONTROL_FIELD_CONTENT_TYPE);
+    setUint32(&frame[16], type_length);
+    std::memcpy(&frame[20], QueryCapture::CONTENT_TYPE, type_length);
+    writeAll(fd, &frame[0], frame.size());
+}
+
+void
+CaptureSink::writeStop(const int fd) {
+    uint8_t frame[12];
+    setUint32(frame, 0);
+    setUint32(frame + 4, 4);
+    setUint32(frame + 8, CONTROL_STOP);
+    writeAll(fd, frame, sizeof(frame));
+}
+
+void
+CaptureSink::writeAll(const int fd, const void* data, size_t length) {
+    const uint8_t* pos = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+        const ssize_t written = ::write(fd, pos, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            bundy_throw(QueryCaptureError, "Failed to write the captured "
+                        "messages: " << std::strerror(errno));
+        }
+        pos += written;
+        length -= written;
+    }
+}
+
+FileCaptureSink::FileCaptureSink(const std::string& file_name) :
+    file_name_(file_name),
+    fd_(open(file_name.c_str(), O_WRONLY | O_CREAT, 0640)), started_(false)
+{
+    if (fd_ < 0) {
+        bundy_throw(QueryCaptureError, "Failed to open " << file_name <<
+                    ": " << std::strerror(errno));
+    }
+}
+
+FileCaptureSink::~FileCaptureSink() {
+    // If the stream hasn't started, the file may still be written by the
+    // capture this one was to replace, so it's left alone.
+    if (started_) {
+        try {
+            writeStop(fd_);
+        } catch (const QueryCaptureError&) {
+            // Nothing more can be done about it.
+        }
+    }
+    close(fd_);
+}
+
+void
+FileCaptureSink::start() {
+    if (started_) {
+        return;
+    }
+    if (ftruncate(fd_, 0) < 0 || lseek(fd_, 0, SEEK_SET) < 0) {
+        bundy_throw(QueryCaptureError, "Failed to truncate " << file_name_ <<
+                    ": " << std::strerror(errno));
+    }
+    writeStart(fd_);
+    started_ = true;
+}
+
+void
+FileCaptureSink::write(const void* data, const size_t length) {
+    start();
+    writeAll(fd_, data, length);
+}
+
+std::string
+FileCaptureSink::getName() const {
+    return (file_name_);
+}
+
+UnixSocketCaptureSink::UnixSocketCaptureSink(const std::string& path) :
+    path_(path), fd_(-1)
+{
+    // Writing to a closed connection must not kill the server, see
+    // SocketSessionForwarder.
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+        bundy_throw(QueryCaptureError, "Failed to filter SIGPIPE: " <<
+                    std::strerror(errno));
+    }
+    connect();
+}
+
+UnixSocketCaptureSink::~UnixSocketCaptureSink() {
+    if (fd_ >= 0) {
+        try {
+            writeStop(fd_);
+        } catch (const QueryCaptureError&) {
+            // The collector is gone, there's no one to tell.
+        }
+        close(fd_);
+    }
+}
+
+void
+UnixSocketCaptureSink::connect() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path_.size() >= sizeof(address.sun_path)) {
+        bundy_throw(QueryCaptureError, "Socket path too long: " << path_);
+    }
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path_.c_str());
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+        bundy_throw(QueryCaptureError, "Failed to create a socket: " <<
+                    std::strerror(errno));
+    }
+    if (::connect(fd_, reinterpret_cast<const sockaddr*>(&address),
+                  sizeof(address)) < 0) {
+        const int error = errno;
+        close(fd_);
+        fd_ = -1;
+        bundy_throw(QueryCaptureError, "Failed to connect to " << path_ <<
+                    ": " << std::strerror(error));
+    }
+    try {
+        writeStart(fd_);
+    } catch (...) {
+        close(fd_);
+        fd_ = -1;
+        throw;
+    }
+}
+
+void
+UnixSocketCaptureSink::write(const void* data, const size_t length) {
+    if (fd_ < 0) {
+        connect();
+    }
+    try {
+        writeAll(fd_, data, length);
+    } catch (...) {
+        // A part of a frame may have been sent, so the stream can't go on.
+        close(fd_);
+        fd_ = -1;
+        throw;
+    }
+}
+
+std::string
+UnixSocketCaptureSink::getName() const {
+    return ("unix:" + path_);
+}
+
+/// \brief The buffer of the records of a thread
+///
+/// It's a ring of bytes. The owning thread writes the records at \c tail_
+/// and moves it on, the background thread writes out the data from
+/// \c head_ to \c tail_ and moves \c head_ on. The positions are
+/// unbounded, the size is a power of two, so as the wrap-around of the
+/// positions does no harm.
+class QueryCapture::ThreadBuffer {
+public:
+    ThreadBuffer(const size_t size) :
+        data_(size), mask_(size - 1), head_(0), tail_(0), dropped_(0)
+    {}
+
+    // Copy the data into the ring at the position.
+    void put(const size_t pos, const void* data, const size_t length) {
+        const size_t start = pos & mask_;
+        const size_t first = std::min(length, data_.size() - start);
+        std::memcpy(&data_[start], data, first);
+        if (first < length) {
+            std::memcpy(&data_[0], static_cast<const uint8_t*>(data) + first,
+                        length - first);
+        }
+    }
+
+    std::vector<uint8_t> data_;
+    const size_t mask_;
+    // Written by the background thread
+    volatile size_t head_;
+    // Keep the positions written by different threads in different cache
+    // lines.
+    char padding_[64];
+    // Written by the owning thread
+    volatile size_t tail_;
+    volatile uint64_t dropped_;
+};
+
+QueryCapture::QueryCapture(CaptureSink* sink, const size_t sample_rate,
+                           const DropPolicy policy, const size_t buffer_size) :
+    sink_(sink), sample_rate_(std::max<size_t>(sample_rate, 1)),
+    policy_(policy), buffer_size_(1), failed_(false), idle_(false),
+    stopping_(false)
+{
+    while (buffer_size_ < buffer_size) {
+        buffer_size_ <<= 1;
+    }
+    const int result = pthread_key_create(&thread_key_, NULL);
+    if (result != 0) {
+        bundy_throw(bundy::Unexpected, "Failed to create the key of the"
+                    " capture buffers: " << std::strerror(result));
+    }
+    try {
+        thread_.reset(new Thread(boost::bind(&QueryCapture::run, this)));
+    } catch (...) {
+        pthread_key_delete(thread_key_);
+        throw;
+    }
+}
+
+QueryCapture::~QueryCapture() {
+    {
+        Mutex::Locker locker(mutex_);
+        stopping_ = true;
+        cond_.signal();
+    }
+    thread_->wait();
+    pthread_key_delete(thread_key_);
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        delete buffers_[i];
+    }
+}
+
+QueryCapture::ThreadBuffer&
+QueryCapture::getThreadBuffer() {
+    void* value = pthread_getspecific(thread_key_);
+    if (value != NULL) {
+        return (*static_cast<ThreadBuffer*>(value));
+    }
+
+    // The buffer is kept after the thread exits, until the capture stops,
+    // so as the records in it are written.
+    std::auto_ptr<ThreadBuffer> buffer(new ThreadBuffer(buffer_size_));
+    {
+        Mutex::Locker locker(mutex_);
+        buffers_.push_back(buffer.get());
+    }
+    ThreadBuffer* thread_buffer = buffer.release();
+    pthread_setspecific(thread_key_, thread_buffer);
+    return (*thread_buffer);
+}
+
+QueryCapture::Timestamp
+QueryCapture::getTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    Timestamp timestamp;
+    timestamp.sec = now.tv_sec;
+    timestamp.nsec = now.tv_nsec;
+    return (timestamp);
+}
+
+bool
+QueryCapture::capture(const MessageType type, const IOMessage& query,
+                      const OutputBuffer* response, const Name* zone,
+                      const Timestamp* query_time)
+{
+    const Timestamp now = getTime();
+    size_t zone_length = 0;
+    const uint8_t* zone_data = NULL;
+    if (zone != NULL) {
+        zone_data = LabelSequence(*zone).getData(&zone_length);
+    }
+    const size_t query_length = std::min(query.getDataSize(),
+                                         MAX_MESSAGE_LENGTH);
+    const size_t response_length = (response == NULL ? 0 :
+                                    std::min(response->getLength(),
+                                             MAX_MESSAGE_LENGTH));
+    const size_t record_length = HEADER_SIZE + zone_length + query_length +
+        response_length;
+    const size_t frame_length = 4 + record_length;
+
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (frame_length > buffer.data_.size()) {
+        buffer.dropped_ = buffer.dropped_ + 1;
+        return (false);
+    }
+    const size_t tail = buffer.tail_;
+    while (buffer.data_.size() - (tail - buffer.head_) < frame_length) {
+        if (policy_ == DROP) {
+            buffer.dropped_ = buffer.dropped_ + 1;
+            return (false);
+        }
+        __sync_synchronize();
+        if (idle_) {
+            Mutex::Locker locker(mutex_);
+            cond_.signal();
+        }
+        usleep(100);
+    }
+    // Don't overwrite the space before it's given back.
+    __sync_synchronize();
+
+    uint8_t header[4 + HEADER_SIZE];
+    std::memset(header, 0, sizeof(header));
+    setUint32(header, record_length);
+    uint8_t* record = header + 4;
+    record[0] = RECORD_VERSION;
+    record[1] = type;
+    record[3] = query.getRemoteEndpoint().getProtocol();
+    const sockaddr& address = query.getRemoteEndpoint().getSockAddr();
+    if (address.sa_family == AF_INET6) {
+        const sockaddr_in6& address6 =
+            reinterpret_cast<const sockaddr_in6&>(address);
+        record[2] = 6;
+        std::memcpy(record + 4, &address6.sin6_addr, 16);
+        std::memcpy(record + 20, &address6.sin6_port, 2);
+    } else {
+        const sockaddr_in& address4 =
+            reinterpret_cast<const sockaddr_in&>(address);
+        record[2] = 4;
+        std::memcpy(record + 4, &address4.sin_addr, 4);
+        std::memcpy(record + 20, &address4.sin_port, 2);
+    }
+    setUint16(record + 22, zone_length);
+    setUint16(record + 24, query_length);
+    setUint16(record + 26, response_length);
+    const bool is_query = (type == AUTH_QUERY || type == CLIENT_QUERY);
+    if (is_query || query_time != NULL) {
+        const Timestamp& received = is_query ? now : *query_time;
+        setUint64(record + 28, received.sec);
+        setUint32(record + 36, received.nsec);
+    }
+    if (!is_query) {
+        setUint64(record + 40, now.sec);
+        setUint32(record + 48, now.nsec);
+    }
+
+    size_t pos = tail;
+    buffer.put(pos, header, sizeof(header));
+    pos += sizeof(header);
+    if (zone_length > 0) {
+        buffer.put(pos, zone_data, zone_length);
+        pos += zone_length;
+    }
+    buffer.put(pos, query.getData(), query_length);
+    pos += query_length;
+    if (response_length > 0) {
+        buffer.put(pos, response->getData(), response_length);
+    }
+
+    // Don't publish the record before it's written.
+    __sync_synchronize();
+    buffer.tail_ = tail + frame_length;
+
+    // Wake up the background thread if it's waiting. It sets idle_ before
+    // checking for the records, so either it sees the record or we see it
+    // idle.
+    __sync_synchronize();
+    if (idle_) {
+        Mutex::Locker locker(mutex_);
+        cond_.signal();
+    }
+    return (true);
+}
+
+void
+QueryCapture::start() {
+    Mutex::Locker write_locker(write_mutex_);
+    try {
+        sink_->start();
+    } catch (const QueryCaptureError& ex) {
+        if (!failed_) {
+            LOG_ERROR(logger, SRVCOMM_CAPTURE_WRITE_FAILED).
+                arg(sink_->getName()).arg(ex.what());
+            failed_ = true;
+        }
+    }
+}
+
+void
+QueryCapture::flush() {
+    // The background thread finishes the buffers it has taken before we
+    // get the lock, so the rest is written here.
+    writeBuffers();
+}
+
+uint64_t
+QueryCapture::getDropped() const {
+    Mutex::Locker locker(mutex_);
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        dropped += buffers_[i]->dropped_;
+    }
+    return (dropped);
+}
+
+bool
+QueryCapture::hasPending() const {
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+        if (buffers_[i]->head_ != buffers_[i]->tail_) {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+size_t
+QueryCapture::writeBuffers() {
+    Mutex::Locker write_locker(write_mutex_);
+    {
+        Mutex::Locker locker(mutex_);
+        write_buffers_ = buffers_;
+    }
+
+    size_t written = 0;
+    for (size_t i = 0; i < write_buffers_.size(); ++i) {
+        ThreadBuffer& buffer = *write_buffers_[i];
+        const size_t tail = buffer.tail_;
+        // Don't read the records before the tail.
+        __sync_synchronize();
+        const size_t head = buffer.head_;
+        if (head == tail) {
+            continue;
+        }
+
+        // All the records of the buffer are written at once; if the ring
+        // wraps around, in two parts.
+        const size_t start = head & buffer.mask_;
+        const size_t length = tail - head;
+        const size_t first = std::min(length, buffer.data_.size() - start);
+        try {
+            sink_->write(&buffer.data_[start], first);
+            if (first < length) {
+                sink_->write(&buffer.data_[0], length - first);
+            }
+            if (failed_) {
+                LOG_INFO(logger, SRVCOMM_CAPTURE_WRITE_RESUMED).
+                    arg(sink_->getName());
+                failed_ = false;
+            }
+        } catch (const QueryCaptureError& ex) {
+            // The records are lost. Report it once until the writes
+            // succeed again.
+            if (!failed_) {
+                LOG_ERROR(logger, SRVCOMM_CAPTURE_WRITE_FAILED).
+                    arg(sink_->getName()).arg(ex.what());
+                failed_ = true;
+            }
+        }
+
+        // Don't give the space back before it's read.
+        __sync_synchronize();
+        buffer.head_ = tail;
+        written += length;
+    }
+    return (written);
+}
+
+void
+QueryCapture::run() {
+    while (true) {
+        while (writeBuffers() > 0) {
+        }
+
+        Mutex::Locker locker(mutex_);
+        idle_ = true;
+        __sync_synchronize();
+        if (!hasPending()) {
+            if (stopping_) {
+                break;
+            }
+            cond_.wait(mutex_);
+        }
+        idle_ = false;
+    }
+}
+
+QueryCapture*
+createQueryCapture(ConstElementPtr config) {
+    if (!config) {
+        return (NULL);
+    }
+    const ConstElementPtr output = config->get("output");
+    if (!output || output->stringValue().empty()) {
+        return (NULL);
+    }
+
+    std::string output_type = "file";
+    if (config->contains("output_type")) {
+        output_type = config->get("output_type")->stringValue();
+    }
+    size_t sample_rate = 1;
+    if (config->contains("sample_rate")) {
+        const long value = config->get("sample_rate")->intValue();
+        if (value < 1) {
+            bundy_throw(QueryCaptureError, "Capture sample rate must be "
+                        "positive: " << value);
+        }
+        sample_rate = value;
+    }
+    QueryCapture::DropPolicy policy = QueryCapture::DROP;
+    if (config->contains("drop_policy")) {
+        const std::string value = config->get("drop_policy")->stringValue();
+        if (value == "block") {
+            policy = QueryCapture::BLOCK;
+        } else if (value != "drop") {
+            bundy_throw(QueryCaptureError, "Unknown capture drop policy: " <<
+                        value);
+        }
+    }
+    size_t buffer_size = QueryCapture::DEFAULT_BUFFER_SIZE;
+    if (config->contains("buffer_size")) {
+        const long value = config->get("buffer_size")->intValue();
+        if (value < 1) {
+            bundy_throw(QueryCaptureError, "Capture buffer size must be "
+                        "positive: " << value);
+        }
+        buffer_size = value;
+    }
+
+    std::auto_ptr<CaptureSink> sink;
+    if (output_type == "file") {
+        sink.reset(new FileCaptureSink(output->stringValue()));
+    } else if (output_type == "unix") {
+        sink.reset(new UnixSocketCaptureSink(output->stringValue()));
+    } else {
+        bundy_throw(QueryCaptureError, "Unknown capture output type: " <<
+                    output_type);
+    }
+    LOG_INFO(logger, SRVCOMM_CAPTURE_STARTED).arg(sink->getName()).
+        arg(sample_rate);
+    return (new QueryCapture(sink.release(), sample_rate, policy,
+                             buffer_size));
+}
+
+}
+}
@@ -0,0 +1,344 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef SERVER_COMMON_QUERY_CAPTURE_H
+#define SERVER_COMMON_QUERY_CAPTURE_H
+
+#include <exceptions/exceptions.h>
+#include <asiolink/io_message.h>
+#include <cc/data.h>
+#include <dns/name.h>
+#include <util/buffer.h>
+#include <util/threads/sync.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace bundy {
+namespace util {
+namespace thread {
+class Thread;
+}
+}
+
+namespace server_common {
+
+/// \brief An error of capturing the queries
+///
+/// It's thrown when the capture is misconfigured or its output can't be
+/// opened or written.
+class QueryCaptureError : public bundy::Exception {
+public:
+    QueryCaptureError(const char* file, size_t line, const char* what) :
+        bundy::Exception(file, line, what)
+    {}
+};
+
+/// \brief The output of the captured messages
+///
+/// The sink receives a stream of frames in the format of Frame Streams,
+/// as used by dnstap: each data frame is a 32-bit length in network byte
+/// order followed by the record. The stream starts with a START control
+/// frame naming the content type \c QueryCapture::CONTENT_TYPE and ends
+/// with a STOP control frame; the sinks write these themselves.
+class CaptureSink : boost::noncopyable {
+public:
+    /// \brief The destructor
+    virtual ~CaptureSink() {}
+
+    /// \brief Start the stream
+    ///
+    /// The sinks which can't start their stream when they are created,
+    /// as a capture being replaced may still write to the same output,
+    /// start it here or on the first write, whichever comes first.
+    /// Calling it again does nothing.
+    ///
+    /// \throw QueryCaptureError the stream can't be started
+    virtual void start() {}
+
+    /// \brief Write a part of the stream
+    ///
+    /// After a failure, the data of the next call starts with a new frame.
+    ///
+    /// \throw QueryCaptureError the data can't be written; it's discarded
+    virtual void write(const void* data, size_t length) = 0;
+
+    /// \brief Return the description of the sink, for the logs
+    virtual std::string getName() const = 0;
+
+protected:
+    /// \brief Write the START control frame to the file descriptor
+    static void writeStart(int fd);
+
+    /// \brief Write the STOP control frame to the file descriptor
+    static void writeStop(int fd);
+
+    /// \brief Write all of the data to the file descriptor
+    ///
+    /// \throw QueryCaptureError writing failed
+    static void writeAll(int fd, const void* data, size_t length);
+};
+
+/// \brief Sink writing the captured messages in a file
+///
+/// The file is truncated when the stream starts, not when it's opened, so
+/// as the file can be opened while another capture still writes to it.
+class FileCaptureSink : public CaptureSink {
+public:
+    /// \brief Open the file
+    ///
+    /// \throw QueryCaptureError the file can't be opened
+    FileCaptureSink(const std::string& file_name);
+
+    /// \brief Finish the stream, if started, and close the file
+    virtual ~FileCaptureSink();
+
+    virtual void start();
+    virtual void write(const void* data, size_t length);
+    virtual std::string getName() const;
+
+private:
+    const std::string file_name_;
+    int fd_;
+    bool started_;
+};
+
+/// \brief Sink sending the captured messages to a UNIX domain socket
+///
+/// The collector listens on a stream socket. If the connection breaks, the
+/// data is discarded until the sink manages to connect again, which it
+/// tries on each write; a new stream is started on each connection.
+class UnixSocketCaptureSink : public CaptureSink {
+public:
+    /// \brief Connect to the socket
+    ///
+    /// \throw QueryCaptureError the connection failed
+    UnixSocketCaptureSink(const std::string& path);
+
+    /// \brief Finish the stream and close the connection
+    virtual ~UnixSocketCaptureSink();
+
+    virtual void write(const void* data, size_t length);
+    virtual std::string getName() const;
+
+private:
+    void connect();
+
+    const std::string path_;
+    int fd_;
+};
+
+/// \brief Capture of the DNS messages of a server
+///
+/// The server passes the queries it receives and the responses it sends
+/// to \c capture(), which writes a record of them in a buffer of the
+/// calling thread. A background thread writes the buffers to the sink.
+/// Each thread only writes its own buffer and only the background thread
+/// reads it, so capturing takes no lock; the background thread is only
+/// woken up when it has run out of work.
+///
+/// Each record is written as a data frame of Frame Streams (see
+/// \c CaptureSink). Its fields are in network byte order:
+/// \verbatim
+///  0  uint8   version of the record format (RECORD_VERSION)
+///  1  uint8   message type (MessageType)
+///  2  uint8   address family of the client (4 or 6)
+///  3  uint8   transport protocol (IPPROTO_UDP or IPPROTO_TCP)
+///  4  16      address of the client; an IPv4 one in the first 4 bytes
+/// 20  uint16  port of the client
+/// 22  uint16  length of the zone name
+/// 24  uint16  length of the query
+/// 26  uint16  length of the response
+/// 28  uint64  time the query was received, seconds since the epoch
+/// 36  uint32  nanoseconds of the time of the query
+/// 40  uint64  time the response was sent, seconds since the epoch
+/// 48  uint32  nanoseconds of the time of the response
+/// 52          zone name in wire format, query and response in wire format
+/// \endverbatim
+/// The unknown times are zero, as are the lengths of the missing parts.
+///
+/// Only one in \c sample_rate queries is captured. The choice depends on
+/// the query ID and the port of the client only, so the query and the
+/// response are captured both or neither.
+///
+/// When the buffer of a thread is full, the record is dropped and counted
+/// or, with the \c BLOCK policy, the thread waits for the background
+/// thread to make space.
+class QueryCapture : boost::noncopyable {
+public:
+    /// \brief Type of the captured message
+    ///
+    /// The values are those of the corresponding dnstap message types.
+    enum MessageType {
+        AUTH_QUERY = 1,       ///< Query received by an authoritative server
+        AUTH_RESPONSE = 2,    ///< Response sent by an authoritative server
+        CLIENT_QUERY = 5,     ///< Query received by a resolver
+        CLIENT_RESPONSE = 6   ///< Response sent by a resolver
+    };
+
+    /// \brief What to do with a record not fitting in the buffer
+    enum DropPolicy {
+        DROP,                 ///< Drop the record and count it
+        BLOCK                 ///< Wait until it fits
+    };
+
+    /// \brief The version of the record format
+    static const uint8_t RECORD_VERSION = 1;
+
+    /// \brief The size of the fixed part of the record
+    static const size_t HEADER_SIZE = 52;
+
+    /// \brief The content type in the START frame of the stream
+    static const char* const CONTENT_TYPE;
+
+    /// \brief The default size of the buffer of each thread, in bytes
+    static const size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    /// \brief The time of a message
+    struct Timestamp {
+        Timestamp() : sec(0), nsec(0) {}
+        uint64_t sec;
+        uint32_t nsec;
+    };
+
+    /// \brief Start the capture
+    ///
+    /// \param sink the output; the capture takes its ownership
+    /// \param sample_rate capture one of this many queries; 0 is taken
+    ///        as 1
+    /// \param policy what to do with a record not fitting in the buffer
+    /// \param buffer_size size of the buffer of each thread, rounded up to
+    ///        a power of two
+    QueryCapture(CaptureSink* sink, size_t sample_rate = 1,
+                 DropPolicy policy = DROP,
+                 size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    /// \brief Write all of the captured messages and stop the capture
+    ~QueryCapture();
+
+    /// \brief Start the stream of the sink
+    ///
+    /// The server calls this when it installs the capture, after the
+    /// capture it replaces has been destroyed (see \c CaptureSink::start).
+    /// A failure is reported like those of the writes, which try again.
+    void start();
+
+    /// \brief Return whether the exchange of the query is to be captured
+    bool isSampled(const bundy::asiolink::IOMessage& query) const {
+        if (sample_rate_ == 1) {
+            return (true);
+        }
+        if (query.getDataSize() < 2) {
+            return (false);
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(query.getData());
+        const uint16_t port = query.getRemoteEndpoint().getPort();
+        const uint32_t key = (data[0] << 8 | data[1]) |
+            (static_cast<uint32_t>(port) << 16);
+        return (((key * 2654435761U) >> 16) % sample_rate_ == 0);
+    }
+
+    /// \brief Capture a message
+    ///
+    /// The query is captured regardless of \c isSampled(); the caller is
+    /// expected to check it first. The time of the query (for a query)
+    /// or of the response (for a response) is now.
+    ///
+    /// \param type type of the message
+    /// \param query the query as received
+    /// \param response the response as sent, NULL if there's none
+    /// \param zone the zone which answered the query, NULL if unknown
+    /// \param query_time when the query was received, for a response, NULL
+    ///        if unknown
+    /// \return true if the record was written in the buffer, false if it
+    ///         was dropped
+    bool capture(MessageType type, const bundy::asiolink::IOMessage& query,
+                 const bundy::util::OutputBuffer* response = NULL,
+                 const bundy::dns::Name* zone = NULL,
+                 const Timestamp* query_time = NULL);
+
+    /// \brief Wait until the messages captured so far are written
+    void flush();
+
+    /// \brief Return the number of the records dropped so far
+    uint64_t getDropped() const;
+
+    /// \brief Return the sink
+    const CaptureSink& getSink() const {
+        return (*sink_);
+    }
+
+    /// \brief Return the current time
+    static Timestamp getTime();
+
+private:
+    class ThreadBuffer;
+
+    ThreadBuffer& getThreadBuffer();
+    bool hasPending() const;
+    size_t writeBuffers();
+    void run();
+
+    boost::scoped_ptr<CaptureSink> sink_;
+    const size_t sample_rate_;
+    const DropPolicy policy_;
+    size_t buffer_size_;
+
+    // key of the buffer of the calling thread
+    pthread_key_t thread_key_;
+    // buffers of all threads which have captured a message
+    std::vector<ThreadBuffer*> buffers_;
+    // serializes writing the buffers; it protects the members below
+    bundy::util::thread::Mutex write_mutex_;
+    // copy of buffers_ taken for writing them
+    std::vector<ThreadBuffer*> write_buffers_;
+    // whether the sink failed on the last write
+    bool failed_;
+
+    // protects buffers_, and with cond_ the waking of the thread
+    mutable bundy::util::thread::Mutex mutex_;
+    bundy::util::thread::CondVar cond_;
+    volatile bool idle_;
+    bool stopping_;
+    boost::scoped_ptr<bundy::util::thread::Thread> thread_;
+};
+
+/// \brief Start the capture of the queries as configured
+///
+/// The configuration is a map with these items, all optional:
+/// - "output": name of the file or the socket; if empty, the queries are
+///   not captured
+/// - "output_type": "file" (the default) or "unix" for a UNIX domain
+///   stream socket
+/// - "sample_rate": capture one of this many queries, 1 by default
+/// - "drop_policy": "drop" (the default) or "block"
+/// - "buffer_size": size of the buffer of each thread in bytes
+///
+/// \param config the configuration
+/// \return the new capture, NULL if no output is configured
+/// \throw QueryCaptureError the configuration is invalid or the output
+///        can't be opened
+/// \throw bundy::data::TypeError an item is of a wrong type
+QueryCapture* createQueryCapture(bundy::data::ConstElementPtr config);
+
+}
+}
+
+#endif // SERVER_COMMON_QUERY_CAPTURE_H
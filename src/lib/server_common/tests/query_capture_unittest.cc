@@ -0,0 +1,359 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <server_common/query_capture.h>
+
+#include <asiolink/io_address.h>
+#include <asiolink/io_endpoint.h>
+#include <asiolink/io_socket.h>
+#include <cc/data.h>
+#include <dns/name.h>
+#include <util/buffer.h>
+
+#include <gtest/gtest.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace bundy::asiolink;
+using namespace bundy::data;
+using namespace bundy::dns;
+using namespace bundy::server_common;
+using namespace bundy::util;
+using boost::scoped_ptr;
+
+namespace {
+
+const char* const CAPTURE_FILE = "query_capture_test.cap";
+const char* const CAPTURE_SOCKET = "query_capture_test.sock";
+
+uint32_t
+getUint32(const std::vector<uint8_t>& data, const size_t pos) {
+    return (data[pos] << 24 | data[pos + 1] << 16 | data[pos + 2] << 8 |
+            data[pos + 3]);
+}
+
+uint16_t
+getUint16(const std::vector<uint8_t>& data, const size_t pos) {
+    return (data[pos] << 8 | data[pos + 1]);
+}
+
+// A record read back from the stream.
+struct Record {
+    std::vector<uint8_t> data;
+    size_t getZoneLength() const { return (getUint16(data, 22)); }
+    size_t getQueryLength() const { return (getUint16(data, 24)); }
+    size_t getResponseLength() const { return (getUint16(data, 26)); }
+    uint32_t getQuerySec() const { return (getUint32(data, 32)); }
+    uint32_t getResponseSec() const { return (getUint32(data, 44)); }
+};
+
+// Check the control frames of the stream and return the records.
+std::vector<Record>
+parseStream(const std::vector<uint8_t>& stream) {
+    std::vector<Record> records;
+    const size_t type_length = std::strlen(QueryCapture::CONTENT_TYPE);
+    EXPECT_LE(20 + type_length + 12, stream.size());
+    if (stream.size() < 20 + type_length + 12) {
+        return (records);
+    }
+    EXPECT_EQ(0, getUint32(stream, 0));
+    EXPECT_EQ(12 + type_length, getUint32(stream, 4));
+    EXPECT_EQ(2, getUint32(stream, 8));             // START
+    EXPECT_EQ(1, getUint32(stream, 12));            // content type
+    EXPECT_EQ(type_length, getUint32(stream, 16));
+    EXPECT_EQ(QueryCapture::CONTENT_TYPE,
+              std::string(stream.begin() + 20,
+                          stream.begin() + 20 + type_length));
+
+    size_t pos = 20 + type_length;
+    while (pos + 4 <= stream.size() && getUint32(stream, pos) != 0) {
+        const size_t length = getUint32(stream, pos);
+        EXPECT_GE(stream.size(), pos + 4 + length);
+        if (stream.size() < pos + 4 + length) {
+            return (records);
+        }
+        Record record;
+        record.data.assign(stream.begin() + pos + 4,
+                           stream.begin() + pos + 4 + length);
+        records.push_back(record);
+        pos += 4 + length;
+    }
+    EXPECT_EQ(pos + 12, stream.size());
+    if (pos + 12 == stream.size()) {
+        EXPECT_EQ(0, getUint32(stream, pos));
+        EXPECT_EQ(4, getUint32(stream, pos + 4));
+        EXPECT_EQ(3, getUint32(stream, pos + 8));  // STOP
+    }
+    return (records);
+}
+
+std::vector<uint8_t>
+readFile(const char* file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    return (std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                                 std::istreambuf_iterator<char>()));
+}
+
+class QueryCaptureTest : public ::testing::Test {
+protected:
+    QueryCaptureTest() :
+        endpoint4(IOEndpoint::create(IPPROTO_UDP, IOAddress("192.0.2.1"),
+                                     53214)),
+        endpoint6(IOEndpoint::create(IPPROTO_TCP, IOAddress("2001:db8::1"),
+                                     53216)),
+        response(0)
+    {
+        // A query with the ID 0x1035, the rest is irrelevant here.
+        const uint8_t query_data[] = { 0x10, 0x35, 0x01, 0x00, 0x00, 0x01,
+                                       0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+        query.assign(query_data, query_data + sizeof(query_data));
+        query4.reset(new IOMessage(&query[0], query.size(),
+                                   IOSocket::getDummyUDPSocket(),
+                                   *endpoint4));
+        query6.reset(new IOMessage(&query[0], query.size(),
+                                   IOSocket::getDummyTCPSocket(),
+                                   *endpoint6));
+        response.writeData(&query[0], query.size());
+        response.writeUint16(0xabcd);
+        unlink(CAPTURE_FILE);
+    }
+
+    ~QueryCaptureTest() {
+        unlink(CAPTURE_FILE);
+        unlink(CAPTURE_SOCKET);
+    }
+
+    std::vector<uint8_t> query;
+    scoped_ptr<const IOEndpoint> endpoint4;
+    scoped_ptr<const IOEndpoint> endpoint6;
+    scoped_ptr<const IOMessage> query4;
+    scoped_ptr<const IOMessage> query6;
+    OutputBuffer response;
+};
+
+// The messages are written in records of the stream in the file.
+TEST_F(QueryCaptureTest, captureToFile) {
+    const Name zone("example.org");
+    QueryCapture::Timestamp query_time;
+    query_time.sec = 1234;
+    query_time.nsec = 5678;
+    {
+        QueryCapture capture(new FileCaptureSink(CAPTURE_FILE));
+        EXPECT_EQ(CAPTURE_FILE, capture.getSink().getName());
+        EXPECT_TRUE(capture.isSampled(*query4));
+        EXPECT_TRUE(capture.capture(QueryCapture::CLIENT_QUERY, *query4));
+        EXPECT_TRUE(capture.capture(QueryCapture::AUTH_RESPONSE, *query6,
+                                    &response, &zone, &query_time));
+        capture.flush();
+        EXPECT_EQ(0, capture.getDropped());
+    }
+
+    const std::vector<Record> records = parseStream(readFile(CAPTURE_FILE));
+    ASSERT_EQ(2, records.size());
+
+    // The query over IPv4, with the time of the query only.
+    const Record& record4 = records[0];
+    ASSERT_EQ(QueryCapture::HEADER_SIZE + query.size(), record4.data.size());
+    EXPECT_EQ(QueryCapture::RECORD_VERSION, record4.data[0]);
+    EXPECT_EQ(QueryCapture::CLIENT_QUERY, record4.data[1]);
+    EXPECT_EQ(4, record4.data[2]);
+    EXPECT_EQ(IPPROTO_UDP, record4.data[3]);
+    const uint8_t address4[] = { 192, 0, 2, 1 };
+    EXPECT_EQ(0, std::memcmp(address4, &record4.data[4], 4));
+    EXPECT_EQ(53214, getUint16(record4.data, 20));
+    EXPECT_EQ(0, record4.getZoneLength());
+    EXPECT_EQ(query.size(), record4.getQueryLength());
+    EXPECT_EQ(0, record4.getResponseLength());
+    EXPECT_NE(0, record4.getQuerySec());
+    EXPECT_EQ(0, record4.getResponseSec());
+    EXPECT_TRUE(std::equal(query.begin(), query.end(),
+                           record4.data.begin() + QueryCapture::HEADER_SIZE));
+
+    // The response over IPv6, with the zone and both times.
+    const Record& record6 = records[1];
+    ASSERT_EQ(QueryCapture::HEADER_SIZE + zone.getLength() + query.size() +
+              response.getLength(), record6.data.size());
+    EXPECT_EQ(QueryCapture::AUTH_RESPONSE, record6.data[1]);
+    EXPECT_EQ(6, record6.data[2]);
+    EXPECT_EQ(IPPROTO_TCP, record6.data[3]);
+    EXPECT_EQ(0x20, record6.data[4]);
+    EXPECT_EQ(0x01, record6.data[19]);
+    EXPECT_EQ(53216, getUint16(record6.data, 20));
+    EXPECT_EQ(zone.getLength(), record6.getZoneLength());
+    EXPECT_EQ(query.size(), record6.getQueryLength());
+    EXPECT_EQ(response.getLength(), record6.getResponseLength());
+    EXPECT_EQ(1234, record6.getQuerySec());
+    EXPECT_EQ(5678, getUint32(record6.data, 36));
+    EXPECT_NE(0, record6.getResponseSec());
+    size_t pos = QueryCapture::HEADER_SIZE;
+    EXPECT_EQ(7, record6.data[pos]);    // the length of "example"
+    pos += zone.getLength();
+    EXPECT_TRUE(std::equal(query.begin(), query.end(),
+                           record6.data.begin() + pos));
+    pos += query.size();
+    EXPECT_EQ(0xab, record6.data[pos + query.size()]);
+}
+
+// A capture can be created for the file another one still writes to; the
+// file is only truncated when the new capture starts.
+TEST_F(QueryCaptureTest, replaceFile) {
+    scoped_ptr<QueryCapture> capture(
+        new QueryCapture(new FileCaptureSink(CAPTURE_FILE)));
+    capture->start();
+    EXPECT_TRUE(capture->capture(QueryCapture::CLIENT_QUERY, *query4));
+    capture->flush();
+    {
+        // A capture which doesn't start leaves the file alone.
+        QueryCapture unused(new FileCaptureSink(CAPTURE_FILE));
+    }
+    scoped_ptr<QueryCapture> replacement(
+        new QueryCapture(new FileCaptureSink(CAPTURE_FILE)));
+    EXPECT_TRUE(capture->capture(QueryCapture::CLIENT_QUERY, *query4));
+    capture.reset();
+    EXPECT_EQ(2, parseStream(readFile(CAPTURE_FILE)).size());
+
+    replacement->start();
+    EXPECT_TRUE(replacement->capture(QueryCapture::CLIENT_QUERY, *query4));
+    replacement.reset();
+    EXPECT_EQ(1, parseStream(readFile(CAPTURE_FILE)).size());
+}
+
+// The records not fitting in the buffer are dropped.
+TEST_F(QueryCaptureTest, dropped) {
+    const std::vector<uint8_t> large_data(100);
+    OutputBuffer large_response(0);
+    large_response.writeData(&large_data[0], large_data.size());
+    {
+        QueryCapture capture(new FileCaptureSink(CAPTURE_FILE), 1,
+                             QueryCapture::DROP, 128);
+        EXPECT_TRUE(capture.capture(QueryCapture::CLIENT_QUERY, *query4));
+        EXPECT_FALSE(capture.capture(QueryCapture::CLIENT_RESPONSE, *query4,
+                                     &large_response));
+        EXPECT_EQ(1, capture.getDropped());
+    }
+    EXPECT_EQ(1, parseStream(readFile(CAPTURE_FILE)).size());
+}
+
+// With the blocking policy, the records wait for the space to be made.
+TEST_F(QueryCaptureTest, block) {
+    {
+        QueryCapture capture(new FileCaptureSink(CAPTURE_FILE), 1,
+                             QueryCapture::BLOCK, 128);
+        for (size_t i = 0; i < 100; ++i) {
+            EXPECT_TRUE(capture.capture(QueryCapture::CLIENT_QUERY,
+                                        *query4));
+        }
+        EXPECT_EQ(0, capture.getDropped());
+    }
+    EXPECT_EQ(100, parseStream(readFile(CAPTURE_FILE)).size());
+}
+
+// Only some of the queries are sampled, depending on the query ID and the
+// port.
+TEST_F(QueryCaptureTest, sampled) {
+    QueryCapture capture(new FileCaptureSink(CAPTURE_FILE), 4);
+    size_t sampled = 0;
+    for (uint16_t id = 0; id < 1000; ++id) {
+        query[0] = id >> 8;
+        query[1] = id;
+        if (capture.isSampled(*query4)) {
+            ++sampled;
+            // The decision doesn't change.
+            EXPECT_TRUE(capture.isSampled(*query4));
+        }
+    }
+    EXPECT_LT(150, sampled);
+    EXPECT_GT(350, sampled);
+}
+
+// The records can be sent to a UNIX domain socket.
+TEST_F(QueryCaptureTest, captureToSocket) {
+    EXPECT_THROW(UnixSocketCaptureSink sink(CAPTURE_SOCKET),
+                 QueryCaptureError);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_NE(-1, listener);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, CAPTURE_SOCKET);
+    unlink(CAPTURE_SOCKET);
+    ASSERT_EQ(0, bind(listener, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)));
+    ASSERT_EQ(0, listen(listener, 1));
+
+    {
+        QueryCapture capture(new UnixSocketCaptureSink(CAPTURE_SOCKET));
+        EXPECT_EQ(std::string("unix:") + CAPTURE_SOCKET,
+                  capture.getSink().getName());
+        EXPECT_TRUE(capture.capture(QueryCapture::CLIENT_QUERY, *query4));
+    }
+
+    const int fd = accept(listener, NULL, NULL);
+    ASSERT_NE(-1, fd);
+    std::vector<uint8_t> stream;
+    uint8_t data[1024];
+    ssize_t length;
+    while ((length = read(fd, data, sizeof(data))) > 0) {
+        stream.insert(stream.end(), data, data + length);
+    }
+    close(fd);
+    close(listener);
+    EXPECT_EQ(1, parseStream(stream).size());
+}
+
+// The capture is created from the configuration.
+TEST_F(QueryCaptureTest, createQueryCapture) {
+    EXPECT_TRUE(createQueryCapture(ConstElementPtr()) == NULL);
+    EXPECT_TRUE(createQueryCapture(Element::fromJSON("{}")) == NULL);
+    EXPECT_TRUE(createQueryCapture(Element::fromJSON(
+                                       "{\"output\": \"\"}")) == NULL);
+
+    scoped_ptr<QueryCapture> capture(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"query_capture_test.cap\", \"output_type\": \"file\","
+        " \"sample_rate\": 10, \"drop_policy\": \"block\","
+        " \"buffer_size\": 4096}")));
+    ASSERT_TRUE(capture);
+    EXPECT_EQ(CAPTURE_FILE, capture->getSink().getName());
+    capture.reset();
+
+    EXPECT_THROW(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"query_capture_test.cap\", \"sample_rate\": 0}")),
+                 QueryCaptureError);
+    EXPECT_THROW(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"query_capture_test.cap\", \"drop_policy\": \"x\"}")),
+                 QueryCaptureError);
+    EXPECT_THROW(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"query_capture_test.cap\", \"buffer_size\": 0}")),
+                 QueryCaptureError);
+    EXPECT_THROW(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"query_capture_test.cap\", \"output_type\": \"x\"}")),
+                 QueryCaptureError);
+    EXPECT_THROW(createQueryCapture(Element::fromJSON(
+        "{\"output\": \"/no/such/directory/capture\"}")),
+                 QueryCaptureError);
+}
+
+}
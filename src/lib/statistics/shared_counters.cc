@@ -0,0 +1,286 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <statistics/shared_counters.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+namespace bundy {
+namespace statistics {
+
+namespace {
+
+/// \brief Size of the cache line the values are aligned to.
+const size_t CACHE_LINE_SIZE = 64;
+
+/// \brief Number of attempts to read the values before the reader starts
+/// yielding the processor to the writer.
+const unsigned int READ_SPINS = 100;
+
+/// \brief Time in milliseconds the reader waits for the writer to finish
+/// an update before giving up.
+///
+/// An update takes microseconds, so a sequence that stays odd this long
+/// means the writer died in the middle of it.
+const uint64_t READ_TIMEOUT = 1000;
+
+uint64_t
+currentMilliseconds() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000);
+}
+
+size_t
+alignUp(const size_t value, const size_t alignment) {
+    return ((value + alignment - 1) / alignment * alignment);
+}
+
+/// \brief Check the header of the mapped segment.
+///
+/// \return the description of the problem, or NULL if the header is fine.
+const char*
+checkHeader(const SharedCountersHeader* header, const size_t size) {
+    if (size < sizeof(SharedCountersHeader)) {
+        return ("too short");
+    }
+    if (header->magic != SHARED_COUNTERS_MAGIC) {
+        return ("bad magic");
+    }
+    if (header->version != SHARED_COUNTERS_VERSION) {
+        return ("unsupported version");
+    }
+    // The values are compared as 64-bit, so the sums don't overflow.
+    const uint64_t names_end = static_cast<uint64_t>(header->names_offset) +
+        header->names_size;
+    const uint64_t values_end = static_cast<uint64_t>(header->values_offset) +
+        static_cast<uint64_t>(header->item_count) * sizeof(Counter::Value);
+    if (header->names_offset < sizeof(SharedCountersHeader) ||
+        names_end > size || header->values_offset < names_end ||
+        header->values_offset % sizeof(Counter::Value) != 0 ||
+        values_end > size) {
+        return ("bad layout");
+    }
+    return (NULL);
+}
+
+} // end of unnamed namespace
+
+SharedCounters::SharedCounters(const std::string& file_name,
+                               const std::vector<std::string>& item_names) :
+    file_name_(file_name), item_count_(item_names.size()), fd_(-1),
+    map_(NULL), map_size_(0), header_(NULL), values_(NULL)
+{
+    size_t names_size = 0;
+    for (size_t i = 0; i < item_count_; ++i) {
+        names_size += item_names[i].size() + 1;
+    }
+    const size_t names_offset = sizeof(SharedCountersHeader);
+    const size_t values_offset = alignUp(names_offset + names_size,
+                                         CACHE_LINE_SIZE);
+    map_size_ = values_offset + item_count_ * sizeof(Counter::Value);
+    if (map_size_ > 0xffffffff) {
+        bundy_throw(SharedCountersError, "too many statistics items for "
+                    "the shared counters segment " << file_name_);
+    }
+
+    // Build the segment under the temporary name, so the readers don't
+    // see it before it's complete.
+    std::ostringstream tmp_name_stream;
+    tmp_name_stream << file_name_ << "." << getpid() << ".tmp";
+    const std::string tmp_name = tmp_name_stream.str();
+    fd_ = open(tmp_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        bundy_throw(SharedCountersError, "failed to create the shared "
+                    "counters segment " << tmp_name << ": "
+                    << strerror(errno));
+    }
+    // The file is filled with zeros, which are also the initial values.
+    if (ftruncate(fd_, map_size_) != 0 ||
+        (map_ = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd_, 0)) == MAP_FAILED) {
+        const int error = errno;
+        map_ = NULL;
+        close(fd_);
+        unlink(tmp_name.c_str());
+        bundy_throw(SharedCountersError, "failed to map the shared "
+                    "counters segment " << tmp_name << ": "
+                    << strerror(error));
+    }
+
+    header_ = static_cast<SharedCountersHeader*>(map_);
+    header_->magic = SHARED_COUNTERS_MAGIC;
+    header_->version = SHARED_COUNTERS_VERSION;
+    header_->sequence = 0;
+    header_->stale = 0;
+    header_->item_count = item_count_;
+    header_->names_offset = names_offset;
+    header_->names_size = names_size;
+    header_->values_offset = values_offset;
+    char* names = static_cast<char*>(map_) + names_offset;
+    for (size_t i = 0; i < item_count_; ++i) {
+        std::memcpy(names, item_names[i].c_str(), item_names[i].size() + 1);
+        names += item_names[i].size() + 1;
+    }
+    values_ = reinterpret_cast<volatile Counter::Value*>(
+        static_cast<char*>(map_) + values_offset);
+
+    if (rename(tmp_name.c_str(), file_name_.c_str()) != 0) {
+        const int error = errno;
+        munmap(map_, map_size_);
+        close(fd_);
+        unlink(tmp_name.c_str());
+        bundy_throw(SharedCountersError, "failed to rename the shared "
+                    "counters segment to " << file_name_ << ": "
+                    << strerror(error));
+    }
+}
+
+SharedCounters::~SharedCounters() {
+    *static_cast<volatile uint32_t*>(&header_->stale) = 1;
+    __sync_synchronize();
+
+    // Don't remove the segment which has replaced ours.
+    struct stat ours, current;
+    if (fstat(fd_, &ours) == 0 && stat(file_name_.c_str(), &current) == 0 &&
+        ours.st_dev == current.st_dev && ours.st_ino == current.st_ino) {
+        unlink(file_name_.c_str());
+    }
+    munmap(map_, map_size_);
+    close(fd_);
+}
+
+void
+SharedCounters::update(const Counter::Value* values) {
+    volatile uint32_t* sequence = &header_->sequence;
+    const uint32_t current = *sequence;
+    *sequence = current + 1;
+    // Don't let the values be written before the sequence is odd.
+    __sync_synchronize();
+    for (size_t i = 0; i < item_count_; ++i) {
+        values_[i] = values[i];
+    }
+    // Don't let the sequence be even before the values are written.
+    __sync_synchronize();
+    *sequence = current + 2;
+}
+
+SharedCountersReader::SharedCountersReader(const std::string& file_name) :
+    map_(NULL), map_size_(0), header_(NULL), values_(NULL)
+{
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        bundy_throw(SharedCountersError, "failed to open the shared "
+                    "counters segment " << file_name << ": "
+                    << strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size > 0 &&
+         (map_ = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+         MAP_FAILED)) {
+        const int error = errno;
+        close(fd);
+        bundy_throw(SharedCountersError, "failed to map the shared "
+                    "counters segment " << file_name << ": "
+                    << strerror(error));
+    }
+    // The mapping stays valid without the descriptor.
+    close(fd);
+    map_size_ = st.st_size;
+    header_ = static_cast<const SharedCountersHeader*>(map_);
+
+    const char* error = checkHeader(header_, map_size_);
+    if (error == NULL) {
+        const char* names = static_cast<const char*>(map_) +
+            header_->names_offset;
+        const char* const names_end = names + header_->names_size;
+        while (names != names_end) {
+            const void* name_end = std::memchr(names, '\0',
+                                               names_end - names);
+            if (name_end == NULL) {
+                break;
+            }
+            item_names_.push_back(std::string(
+                names, static_cast<const char*>(name_end)));
+            names = static_cast<const char*>(name_end) + 1;
+        }
+        if (names != names_end || item_names_.size() != header_->item_count) {
+            error = "bad item names";
+        }
+    }
+    if (error != NULL) {
+        if (map_ != NULL) {
+            munmap(map_, map_size_);
+        }
+        bundy_throw(SharedCountersError, "malformed shared counters "
+                    "segment " << file_name << ": " << error);
+    }
+    values_ = reinterpret_cast<const volatile Counter::Value*>(
+        static_cast<const char*>(map_) + header_->values_offset);
+}
+
+SharedCountersReader::~SharedCountersReader() {
+    munmap(map_, map_size_);
+}
+
+bool
+SharedCountersReader::isStale() const {
+    return (*static_cast<const volatile uint32_t*>(&header_->stale) != 0);
+}
+
+void
+SharedCountersReader::read(std::vector<Counter::Value>& values) const {
+    values.resize(item_names_.size());
+    const volatile uint32_t* sequence = &header_->sequence;
+    uint64_t deadline = 0;
+    for (unsigned int attempt = 1; ; ++attempt) {
+        const uint32_t before = *sequence;
+        // An odd sequence means the writer is in the middle of an update.
+        if ((before & 1) == 0) {
+            __sync_synchronize();
+            for (size_t i = 0; i < values.size(); ++i) {
+                values[i] = values_[i];
+            }
+            __sync_synchronize();
+            if (*sequence == before) {
+                return;
+            }
+        }
+        // The writer may have been preempted in the update.
+        if (attempt == READ_SPINS) {
+            deadline = currentMilliseconds() + READ_TIMEOUT;
+        } else if (attempt > READ_SPINS) {
+            if (currentMilliseconds() >= deadline) {
+                bundy_throw(SharedCountersError, "the writer of the shared "
+                            "counters didn't finish an update in " <<
+                            READ_TIMEOUT << " ms");
+            }
+            sched_yield();
+        }
+    }
+}
+
+}   // namespace statistics
+}   // namespace bundy
@@ -0,0 +1,191 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef SHARED_COUNTERS_H
+#define SHARED_COUNTERS_H 1
+
+#include <statistics/counter.h>
+#include <exceptions/exceptions.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace bundy {
+namespace statistics {
+
+/// \brief A shared counters segment can't be created or read.
+class SharedCountersError : public bundy::Exception {
+public:
+    SharedCountersError(const char* file, size_t line, const char* what) :
+        bundy::Exception(file, line, what)
+    {}
+};
+
+/// \brief Header of the shared counters segment.
+///
+/// The segment is a file, normally on a memory backed file system, which
+/// is mapped by the module exporting its counters and by any number of
+/// readers. It starts with this header, which is followed by the names of
+/// the items (each terminated by a NUL character) and the values of the
+/// items (in the same order as the names, as 64-bit integers aligned to
+/// a cache line). All fields are in the byte order of the host.
+///
+/// The values are protected by a sequence lock: the writer makes
+/// \c sequence odd while it updates them and even again when done, so a
+/// reader copies the values and checks \c sequence was the same even
+/// number before and after. The writer is never blocked by the readers.
+///
+/// The set of the items (the layout) of a segment never changes. When it
+/// does, the writer creates a new segment, renames it over the old file
+/// and sets \c stale in the old one, so the readers know to open the file
+/// again.
+struct SharedCountersHeader {
+    /// \brief \c SHARED_COUNTERS_MAGIC
+    uint32_t magic;
+    /// \brief \c SHARED_COUNTERS_VERSION, the version of this format
+    uint32_t version;
+    /// \brief The sequence lock
+    uint32_t sequence;
+    /// \brief Non-zero if the segment has been replaced or removed
+    uint32_t stale;
+    /// \brief Number of the items
+    uint32_t item_count;
+    /// \brief Offset of the item names from the start of the segment
+    uint32_t names_offset;
+    /// \brief Size of the item names, including the NUL characters
+    uint32_t names_size;
+    /// \brief Offset of the item values from the start of the segment
+    uint32_t values_offset;
+};
+
+/// \brief The first 4 bytes of a shared counters segment ("BSTC").
+const uint32_t SHARED_COUNTERS_MAGIC = 0x42535443;
+
+/// \brief The version of the format of the shared counters segment.
+const uint32_t SHARED_COUNTERS_VERSION = 1;
+
+/// \brief Counters exported in a shared memory segment.
+///
+/// This is the writing side of the segment described in
+/// \c SharedCountersHeader. The module creates it with the names of its
+/// items, and calls \c update() with their current values as often as it
+/// wants them to be seen. The readers (see \c SharedCountersReader) can
+/// read the segment at any time without communicating with the module.
+///
+/// There must be only one writer of a segment, \c update() isn't
+/// thread safe.
+class SharedCounters : boost::noncopyable {
+public:
+    /// \brief Constructor.
+    ///
+    /// Creates the segment with the given items, all of them set to 0.
+    /// The segment is created under a temporary name and renamed to
+    /// \c file_name, so the readers never see it half initialized. If
+    /// there's a segment of the same name, it's replaced.
+    ///
+    /// \param file_name name of the segment file
+    /// \param item_names names of the items
+    /// \throw SharedCountersError the segment can't be created
+    SharedCounters(const std::string& file_name,
+                   const std::vector<std::string>& item_names);
+
+    /// \brief Destructor.
+    ///
+    /// Marks the segment stale and removes its file, unless the file has
+    /// been replaced by another segment in the meantime.
+    ~SharedCounters();
+
+    /// \brief Update the values of the items.
+    ///
+    /// \param values the values, in the order of the item names given to
+    ///        the constructor
+    void update(const Counter::Value* values);
+
+    /// \brief Return the number of the items.
+    size_t getItemCount() const {
+        return (item_count_);
+    }
+
+    /// \brief Return the name of the segment file.
+    const std::string& getFileName() const {
+        return (file_name_);
+    }
+
+private:
+    const std::string file_name_;
+    const size_t item_count_;
+    int fd_;
+    void* map_;
+    size_t map_size_;
+    SharedCountersHeader* header_;
+    volatile Counter::Value* values_;
+};
+
+/// \brief Reader of a shared counters segment.
+///
+/// It maps the segment created by \c SharedCounters read only and takes
+/// consistent snapshots of the values.
+class SharedCountersReader : boost::noncopyable {
+public:
+    /// \brief Constructor.
+    ///
+    /// Maps the segment and reads the names of its items.
+    ///
+    /// \param file_name name of the segment file
+    /// \throw SharedCountersError the segment can't be opened or it's
+    ///        malformed
+    explicit SharedCountersReader(const std::string& file_name);
+
+    /// \brief Destructor.
+    ~SharedCountersReader();
+
+    /// \brief Return the names of the items.
+    const std::vector<std::string>& getItemNames() const {
+        return (item_names_);
+    }
+
+    /// \brief Check if the segment has been replaced or removed.
+    ///
+    /// If it has, the values don't change any more, and the reader should
+    /// be created again to read the current segment (if any).
+    bool isStale() const;
+
+    /// \brief Read the values of the items.
+    ///
+    /// The values are a consistent snapshot of one \c update() of the
+    /// writer. This may wait for the writer to finish an update, but it
+    /// never blocks it.
+    ///
+    /// \throw SharedCountersError the writer didn't finish an update in
+    /// time, e.g. it died in the middle of it
+    /// \param values set to the values, in the order of the item names
+    void read(std::vector<Counter::Value>& values) const;
+
+private:
+    std::vector<std::string> item_names_;
+    void* map_;
+    size_t map_size_;
+    const SharedCountersHeader* header_;
+    const volatile Counter::Value* values_;
+};
+
+}   // namespace statistics
+}   // namespace bundy
+
+#endif // SHARED_COUNTERS_H
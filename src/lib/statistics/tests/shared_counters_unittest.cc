@@ -0,0 +1,147 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <config.h>
+#include <gtest/gtest.h>
+
+#include <statistics/shared_counters.h>
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace bundy::statistics;
+
+namespace {
+
+const char* const SEGMENT_FILE = "shared_counters_test.seg";
+
+class SharedCountersTest : public ::testing::Test {
+protected:
+    SharedCountersTest() {
+        names_.push_back("zones/_SERVER_/request.v4");
+        names_.push_back("zones/_SERVER_/request.v6");
+        names_.push_back("latency/total/count");
+        unlink(SEGMENT_FILE);
+    }
+    ~SharedCountersTest() {
+        unlink(SEGMENT_FILE);
+    }
+    std::vector<std::string> names_;
+};
+
+// The reader sees the names and the last values written.
+TEST_F(SharedCountersTest, update) {
+    SharedCounters counters(SEGMENT_FILE, names_);
+    EXPECT_EQ(names_.size(), counters.getItemCount());
+    EXPECT_EQ(SEGMENT_FILE, counters.getFileName());
+
+    SharedCountersReader reader(SEGMENT_FILE);
+    EXPECT_TRUE(names_ == reader.getItemNames());
+    EXPECT_FALSE(reader.isStale());
+
+    // The values are zero before the first update.
+    std::vector<Counter::Value> values;
+    reader.read(values);
+    EXPECT_EQ(std::vector<Counter::Value>(names_.size(), 0), values);
+
+    const Counter::Value update1[] = {1, 2, 3};
+    counters.update(update1);
+    reader.read(values);
+    EXPECT_EQ(std::vector<Counter::Value>(update1, update1 + 3), values);
+
+    const Counter::Value update2[] = {10, 20, 0xffffffffffffULL};
+    counters.update(update2);
+    reader.read(values);
+    EXPECT_EQ(std::vector<Counter::Value>(update2, update2 + 3), values);
+}
+
+// The reader gives up when the writer never finishes an update, e.g. when
+// it died in the middle of it.
+TEST_F(SharedCountersTest, unfinishedUpdate) {
+    SharedCounters counters(SEGMENT_FILE, names_);
+    SharedCountersReader reader(SEGMENT_FILE);
+
+    // Leave the sequence odd as the writer does during an update.
+    const int fd = open(SEGMENT_FILE, O_RDWR);
+    ASSERT_NE(-1, fd);
+    const uint32_t sequence = 1;
+    EXPECT_EQ(sizeof(sequence),
+              pwrite(fd, &sequence, sizeof(sequence),
+                     offsetof(SharedCountersHeader, sequence)));
+    close(fd);
+
+    std::vector<Counter::Value> values;
+    EXPECT_THROW(reader.read(values), SharedCountersError);
+}
+
+// The segment is marked stale and removed when the writer is destroyed,
+// but not if it has been replaced by a new one.
+TEST_F(SharedCountersTest, stale) {
+    SharedCounters* counters = new SharedCounters(SEGMENT_FILE, names_);
+    SharedCountersReader reader(SEGMENT_FILE);
+
+    // A new writer replaces the segment (e.g. when the items change).
+    names_.push_back("latency/total/sum");
+    SharedCounters new_counters(SEGMENT_FILE, names_);
+    delete counters;
+    EXPECT_TRUE(reader.isStale());
+
+    SharedCountersReader new_reader(SEGMENT_FILE);
+    EXPECT_EQ(4, new_reader.getItemNames().size());
+    EXPECT_FALSE(new_reader.isStale());
+}
+
+// A segment without the writer is removed.
+TEST_F(SharedCountersTest, remove) {
+    {
+        SharedCounters counters(SEGMENT_FILE, names_);
+        EXPECT_EQ(0, access(SEGMENT_FILE, F_OK));
+    }
+    EXPECT_NE(0, access(SEGMENT_FILE, F_OK));
+    EXPECT_THROW(SharedCountersReader reader(SEGMENT_FILE),
+                 SharedCountersError);
+}
+
+// Malformed segments are rejected.
+TEST_F(SharedCountersTest, malformed) {
+    {
+        std::ofstream file(SEGMENT_FILE);
+        file << "not a shared counters segment";
+    }
+    EXPECT_THROW(SharedCountersReader reader(SEGMENT_FILE),
+                 SharedCountersError);
+
+    // An empty file.
+    {
+        std::ofstream file(SEGMENT_FILE);
+    }
+    EXPECT_THROW(SharedCountersReader reader(SEGMENT_FILE),
+                 SharedCountersError);
+
+    // A truncated segment.
+    {
+        SharedCounters counters(SEGMENT_FILE, names_);
+        ASSERT_EQ(0, truncate(SEGMENT_FILE, sizeof(SharedCountersHeader) + 8));
+        EXPECT_THROW(SharedCountersReader reader(SEGMENT_FILE),
+                     SharedCountersError);
+    }
+}
+
+}
@@ -16,9 +16,14 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/constants.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace bundy {
 namespace util {
 
@@ -80,7 +85,7 @@ CSVRow::checkIndex(const size_t at) const {
 }
 
 CSVFile::CSVFile(const std::string& filename)
-    : filename_(filename), fs_(), cols_(0), read_msg_() {
+    : filename_(filename), fs_(), cols_(0), read_msg_(), appending_(false) {
 }
 
 CSVFile::~CSVFile() {
@@ -95,6 +100,7 @@ CSVFile::close() {
         fs_->close();
         fs_.reset();
     }
+    appending_ = false;
 }
 
 void
@@ -103,6 +109,33 @@ CSVFile::flush() const {
     fs_->flush();
 }
 
+void
+CSVFile::sync() const {
+    flush();
+    if (!fs_->good()) {
+        fs_->clear();
+        bundy_throw(CSVFileError, "failed to flush the file '"
+                  << filename_ << "'");
+    }
+
+    // The standard streams don't expose the underlying file descriptor.
+    // The fsync commits all dirty pages of the file, regardless of the
+    // descriptor used to write them, so it is fine to open a new one.
+    int fd = ::open(filename_.c_str(), O_WRONLY);
+    if (fd < 0) {
+        bundy_throw(CSVFileError, "failed to open the file '" << filename_
+                  << "' for synchronization: " << strerror(errno));
+    }
+    int status = ::fsync(fd);
+    int fsync_errno = errno;
+    ::close(fd);
+    if (status != 0) {
+        bundy_throw(CSVFileError, "failed to synchronize the file '"
+                  << filename_ << "' to the disk: "
+                  << strerror(fsync_errno));
+    }
+}
+
 void
 CSVFile::addColumn(const std::string& col_name) {
     // It is not allowed to add a new column when file is open.
@@ -124,7 +157,7 @@ CSVFile::addColumnInternal(const std::string& col_name) {
 }
 
 void
-CSVFile::append(const CSVRow& row) const {
+CSVFile::append(const CSVRow& row, const bool flush) const {
     checkStreamStatusAndReset("append");
 
     if (row.getValuesCount() != getColumnCount()) {
@@ -141,12 +174,21 @@ CSVFile::append(const CSVRow& row) const {
     /// needed at the same time, we may revisit this: perhaps remember the
     /// old pointer. Also, for safety, we call both functions so as we are
     /// sure that both pointers are moved.
-    fs_->seekp(0, std::ios_base::end);
-    fs_->seekg(0, std::ios_base::end);
+    ///
+    /// Seeking flushes the stream, so it is skipped if the previous
+    /// operation was append and the pointers are already at the end.
+    if (!appending_) {
+        fs_->seekp(0, std::ios_base::end);
+        fs_->seekg(0, std::ios_base::end);
+        appending_ = true;
+    }
     fs_->clear();
 
     std::string text = row.render();
-    *fs_ << text << std::endl;
+    *fs_ << text << '\n';
+    if (flush) {
+        fs_->flush();
+    }
     if (!fs_->good()) {
         fs_->clear();
         bundy_throw(CSVFileError, "failed to write CSV row '"
@@ -231,6 +273,7 @@ CSVFile::next(CSVRow& row, const bool skip_validation) {
 
     // Get exactly one line of the file.
     std::string line;
+    appending_ = false;
     std::getline(*fs_, line);
     // If we got empty line because we reached the end of file
     // return an empty row.
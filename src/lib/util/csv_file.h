@@ -297,11 +297,17 @@ public:
 
     /// @brief Writes the CSV row into the file.
     ///
-    /// @param Object representing a CSV file row.
+    /// By default, the stream is flushed after the row has been written.
+    /// Callers which write rows in batches may skip the flush and call
+    /// @c CSVFile::flush or @c CSVFile::sync once for the whole batch.
+    ///
+    /// @param row Object representing a CSV file row.
+    /// @param flush Indicates whether the stream should be flushed after
+    /// the row has been written.
     ///
     /// @throw CSVFileError When error occured during IO operation or if the
     /// size of the row doesn't match the number of columns.
-    void append(const CSVRow& row) const;
+    void append(const CSVRow& row, const bool flush = true) const;
 
     /// @brief Closes the CSV file.
     void close();
@@ -309,6 +315,25 @@ public:
     /// @brief Flushes a file.
     void flush() const;
 
+    /// @brief Flushes a file and commits its contents to the disk.
+    ///
+    /// In addition to flushing the stream, this function calls fsync(2)
+    /// so as the data written so far survive a crash of the system. It
+    /// is considerably more expensive than @c CSVFile::flush and should
+    /// be called for batches of rows rather than for each row.
+    ///
+    /// @throw CSVFileError if the file is not open or if the data could
+    /// not be committed to the disk.
+    void sync() const;
+
+    /// @brief Returns size of the CSV file.
+    ///
+    /// The size is read from the file system, so the rows which haven't
+    /// been flushed yet are not included.
+    ///
+    /// @return Size of the file in bytes or 0 if the file doesn't exist.
+    std::streampos size() const;
+
     /// @brief Returns the number of columns in the file.
     size_t getColumnCount() const {
         return (cols_.size());
@@ -455,9 +480,6 @@ private:
     /// @throw CSVFileError if stream is closed or pointer to it is NULL.
     void checkStreamStatusAndReset(const std::string& operation) const;
 
-    /// @brief Returns size of the CSV file.
-    std::streampos size() const;
-
     /// @brief CSV file name.
     std::string filename_;
 
@@ -469,6 +491,10 @@ private:
 
     /// @brief Holds last error during row reading or validation.
     std::string read_msg_;
+
+    /// @brief Indicates whether the last operation on the file was append,
+    /// i.e. the stream pointers are at the end of the file.
+    mutable bool appending_;
 };
 
 } // namespace bundy::util
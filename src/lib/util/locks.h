@@ -12,50 +12,158 @@
 // OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
-/// This file (right now) provides dummy locks
-/// It also contains code to use boost/threads locks:
+/// This file provides the minimal set of locks used by the NSAS and the
+/// LRU list.  They are thin wrappers around the POSIX threads primitives,
+/// so the data structures using them can be shared between threads (for
+/// example, by the worker threads of the resolver).
 ///
+/// Only the very minimal set of methods that we actually use is defined.
+/// The interface mimics the one of boost::interprocess locks, which these
+/// used to be placeholders for.
 ///
-/// All locks are dummy classes that don't actually do anything. At this moment,
-/// only the very minimal set of methods that we actually use is defined.
-///
-/// Note that we need to include <config.h> in our .cc files for that
-/// to be set. we might want to enfore this at compile time with a check
-/// (TODO)
+/// Errors of the underlying system calls are considered programming errors
+/// (like unlocking a mutex that is not locked), the program is aborted in
+/// such case, as there's no safe way to recover.
 
 #ifndef LOCKS
 #define LOCKS
 
+#include <boost/noncopyable.hpp>
+
+#include <pthread.h>
+#include <cstdlib>
+
 namespace bundy {
 namespace util {
 namespace locks {
 
-class mutex {
+namespace detail {
+
+// Abort if a pthread call fails.  This is used for operations which can
+// only fail on misuse.
+inline void
+checkedCall(int result) {
+    if (result != 0) {
+        std::abort();
+    }
+}
+
+} // namespace detail
+
+/// \brief Plain (non-recursive) mutex
+class mutex : boost::noncopyable {
+public:
+    mutex() {
+        detail::checkedCall(pthread_mutex_init(&mutex_, NULL));
+    }
+    ~mutex() {
+        pthread_mutex_destroy(&mutex_);
+    }
+    void lock() {
+        detail::checkedCall(pthread_mutex_lock(&mutex_));
+    }
+    void unlock() {
+        detail::checkedCall(pthread_mutex_unlock(&mutex_));
+    }
+private:
+    pthread_mutex_t mutex_;
 };
 
-class recursive_mutex {
+/// \brief Mutex that can be locked multiple times by the same thread
+class recursive_mutex : boost::noncopyable {
+public:
+    recursive_mutex() {
+        pthread_mutexattr_t attr;
+        detail::checkedCall(pthread_mutexattr_init(&attr));
+        detail::checkedCall(pthread_mutexattr_settype(&attr,
+                                                      PTHREAD_MUTEX_RECURSIVE));
+        detail::checkedCall(pthread_mutex_init(&mutex_, &attr));
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~recursive_mutex() {
+        pthread_mutex_destroy(&mutex_);
+    }
+    void lock() {
+        detail::checkedCall(pthread_mutex_lock(&mutex_));
+    }
+    void unlock() {
+        detail::checkedCall(pthread_mutex_unlock(&mutex_));
+    }
+private:
+    pthread_mutex_t mutex_;
 };
 
-class upgradable_mutex {
+/// \brief Mutex that can be held by many readers or one writer
+///
+/// The sharable_lock takes it for reading, the scoped_lock for writing.
+class upgradable_mutex : boost::noncopyable {
+public:
+    upgradable_mutex() {
+        detail::checkedCall(pthread_rwlock_init(&rwlock_, NULL));
+    }
+    ~upgradable_mutex() {
+        pthread_rwlock_destroy(&rwlock_);
+    }
+    void lock() {
+        detail::checkedCall(pthread_rwlock_wrlock(&rwlock_));
+    }
+    void unlock() {
+        detail::checkedCall(pthread_rwlock_unlock(&rwlock_));
+    }
+    void lock_sharable() {
+        detail::checkedCall(pthread_rwlock_rdlock(&rwlock_));
+    }
+    void unlock_sharable() {
+        detail::checkedCall(pthread_rwlock_unlock(&rwlock_));
+    }
+private:
+    pthread_rwlock_t rwlock_;
 };
 
+/// \brief Holds a shared (read) lock on an upgradable_mutex for its lifetime
 template <typename T>
-class sharable_lock {
+class sharable_lock : boost::noncopyable {
 public:
-    sharable_lock(T) {}
+    sharable_lock(T& mtx) : mutex_(mtx) {
+        mutex_.lock_sharable();
+    }
+    ~sharable_lock() {
+        mutex_.unlock_sharable();
+    }
+private:
+    T& mutex_;
 };
 
+/// \brief Holds an exclusive lock on a mutex
+///
+/// The lock is acquired on construction and released on destruction, unless
+/// it was already released explicitly by unlock().
 template <typename T>
-class scoped_lock {
+class scoped_lock : boost::noncopyable {
 public:
-    scoped_lock(T) {}
+    scoped_lock(T& mtx) : mutex_(mtx), locked_(false) {
+        lock();
+    }
 
     // We need to define this explicitly.  Some versions of clang++ would
     // complain about this otherwise.  See Trac ticket #2340
-    ~scoped_lock() {}
+    ~scoped_lock() {
+        if (locked_) {
+            mutex_.unlock();
+        }
+    }
 
-    void lock() {}
-    void unlock() {}
+    void lock() {
+        mutex_.lock();
+        locked_ = true;
+    }
+    void unlock() {
+        mutex_.unlock();
+        locked_ = false;
+    }
+private:
+    T& mutex_;
+    bool locked_;
 };
 
 } // namespace locks
@@ -181,7 +181,10 @@ void LruList<T>::add(boost::shared_ptr<T>& element) {
                 (*dropped_)(lru_.begin()->get());
             }
 
-            // ... and get rid of it from the list
+            // ... and get rid of it from the list.  The element may still
+            // be referenced elsewhere, so make sure a later remove() or
+            // touch() does not use the stale iterator.
+            lru_.front()->invalidateIterator();
             lru_.pop_front();
             --count_;
         }
@@ -199,16 +202,17 @@ void LruList<T>::add(boost::shared_ptr<T>& element) {
 template <typename T>
 void LruList<T>::remove(boost::shared_ptr<T>& element) {
 
+    // Protect list against concurrent access.  The validity of the internal
+    // pointer must be checked under the lock too, as another thread might
+    // be removing the same element.
+    locks::scoped_lock<locks::mutex> lock(mutex_);
+
     // An element can only be removed it its internal pointer is valid.
     // If it is, the pointer can be used to access the list because no matter
     // what other elements are added or removed, the pointer remains valid.
     //
     // If the pointer is not valid, this is a no-op.
     if (element->iteratorValid()) {
-
-        // Is valid, so protect list against concurrent access
-        locks::scoped_lock<locks::mutex> lock(mutex_);
-
         lru_.erase(element->getLruIterator());  // Remove element from list
         element->invalidateIterator();          // Invalidate pointer
         --count_;                               // One less element
@@ -219,12 +223,12 @@ void LruList<T>::remove(boost::shared_ptr<T>& element) {
 template <typename T>
 void LruList<T>::touch(boost::shared_ptr<T>& element) {
 
+    // Protect list against concurrent access
+    locks::scoped_lock<locks::mutex> lock(mutex_);
+
     // As before, if the pointer is not valid, this is a no-op.
     if (element->iteratorValid()) {
 
-        // Protect list against concurrent access
-        locks::scoped_lock<locks::mutex> lock(mutex_);
-
         // Move the element to the end of the list.
         lru_.splice(lru_.end(), lru_, element->getLruIterator());
 
@@ -244,11 +248,12 @@ void LruList<T>::clear() {
     // ... and update the count while we have the mutex.
     count_ = 0;
     typename std::list<boost::shared_ptr<T> >::iterator iter;
-    if (dropped_) {
-        for (iter = lru_.begin(); iter != lru_.end(); ++iter) {
-            // Call the drop handler.
+    for (iter = lru_.begin(); iter != lru_.end(); ++iter) {
+        // Call the drop handler.
+        if (dropped_) {
             (*dropped_)(iter->get());
         }
+        (*iter)->invalidateIterator();
     }
 
     lru_.clear();
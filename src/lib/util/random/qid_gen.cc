@@ -43,11 +43,13 @@ void
 QidGenerator::seed() {
     struct timeval tv;
     gettimeofday(&tv, 0);
+    locks::scoped_lock<locks::mutex> lock(mutex_);
     generator_.seed((tv.tv_sec * 1000000) + tv.tv_usec);
 }
 
 uint16_t
 QidGenerator::generateQid() {
+    locks::scoped_lock<locks::mutex> lock(mutex_);
     return (vgen_());
 }
 
@@ -25,6 +25,8 @@
 #include <boost/random/uniform_int.hpp>
 #include <boost/random/variate_generator.hpp>
 
+#include <util/locks.h>
+
 #include <stdint.h>
 
 namespace bundy {
@@ -79,6 +81,8 @@ private:
     boost::uniform_int<> dist_;
 
     boost::variate_generator<boost::mt19937&, boost::uniform_int<> > vgen_;
+    // The instance is shared by all the threads sending queries
+    bundy::util::locks::mutex mutex_;
 };
 
 
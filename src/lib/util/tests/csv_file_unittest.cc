@@ -367,6 +367,36 @@ TEST_F(CSVFileTest, recreate) {
               readFile());
 }
 
+// This test checks that the rows appended without flushing the stream are
+// written to the file when the file is synchronized.
+TEST_F(CSVFileTest, appendNoFlushSync) {
+    boost::scoped_ptr<CSVFile> csv(new CSVFile(testfile_));
+    csv->addColumn("animal");
+    csv->addColumn("color");
+    // The file is not open, so it can't be synchronized.
+    EXPECT_THROW(csv->sync(), CSVFileError);
+    ASSERT_NO_THROW(csv->recreate());
+
+    CSVRow row0(2);
+    row0.writeAt(0, "dog");
+    row0.writeAt(1, "grey");
+    ASSERT_NO_THROW(csv->append(row0, false));
+
+    CSVRow row1(2);
+    row1.writeAt(0, "cat");
+    row1.writeAt(1, "black");
+    ASSERT_NO_THROW(csv->append(row1, false));
+
+    ASSERT_NO_THROW(csv->sync());
+    // Read the file while it is still open to make sure that the data
+    // haven't been written as a result of closing the file.
+    EXPECT_EQ("animal,color\n"
+              "dog,grey\n"
+              "cat,black\n",
+              readFile());
+    csv->close();
+}
+
 // This test checks that the error is reported when the size of the row being
 // read doesn't match the number of columns of the CSV file.
 TEST_F(CSVFileTest, validate) {
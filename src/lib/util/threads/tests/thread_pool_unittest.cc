@@ -0,0 +1,108 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <util/threads/thread_pool.h>
+#include <util/threads/sync.h>
+#include <util/unittests/check_valgrind.h>
+
+#include <boost/bind.hpp>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+using namespace bundy::util::thread;
+
+namespace {
+const size_t iterations = 200;
+
+// Increments the counter, protected by the mutex.
+void
+increment(Mutex* mutex, size_t* counter) {
+    Mutex::Locker locker(*mutex);
+    ++*counter;
+}
+
+// Increments the counter after a while, so as the tasks are still running
+// when the pool is waited for.
+void
+incrementSlowly(Mutex* mutex, size_t* counter) {
+    usleep(1000);
+    increment(mutex, counter);
+}
+
+void
+throwSomething() {
+    throw 42;
+}
+
+// The pool can't be created without threads.
+TEST(ThreadPoolTest, noThreads) {
+    EXPECT_THROW(ThreadPool(0), bundy::InvalidParameter);
+}
+
+// All tasks have been run when wait() returns.
+TEST(ThreadPoolTest, wait) {
+    if (!bundy::util::unittests::runningOnValgrind()) {
+        ThreadPool pool(4);
+        EXPECT_EQ(4, pool.size());
+        Mutex mutex;
+        size_t counter = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            pool.add(boost::bind(&incrementSlowly, &mutex, &counter));
+        }
+        pool.wait();
+        EXPECT_EQ(iterations, counter);
+
+        // The pool can be used again.
+        for (size_t i = 0; i < iterations; ++i) {
+            pool.add(boost::bind(&increment, &mutex, &counter));
+        }
+        pool.wait();
+        EXPECT_EQ(2 * iterations, counter);
+
+        // Nothing to wait for.
+        pool.wait();
+    }
+}
+
+// The destructor runs the remaining tasks.
+TEST(ThreadPoolTest, destroy) {
+    if (!bundy::util::unittests::runningOnValgrind()) {
+        Mutex mutex;
+        size_t counter = 0;
+        {
+            ThreadPool pool(2);
+            for (size_t i = 0; i < iterations; ++i) {
+                pool.add(boost::bind(&increment, &mutex, &counter));
+            }
+        }
+        EXPECT_EQ(iterations, counter);
+    }
+}
+
+// An exception thrown by a task doesn't stop the thread.
+TEST(ThreadPoolTest, exception) {
+    if (!bundy::util::unittests::runningOnValgrind()) {
+        ThreadPool pool(1);
+        Mutex mutex;
+        size_t counter = 0;
+        pool.add(&throwSomething);
+        pool.add(boost::bind(&increment, &mutex, &counter));
+        pool.wait();
+        EXPECT_EQ(1, counter);
+    }
+}
+
+}
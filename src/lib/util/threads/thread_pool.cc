@@ -0,0 +1,120 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include "thread_pool.h"
+
+#include <boost/bind.hpp>
+
+namespace bundy {
+namespace util {
+namespace thread {
+
+ThreadPool::ThreadPool(size_t threads) :
+    running_(0), stopping_(false)
+{
+    if (threads == 0) {
+        bundy_throw(bundy::InvalidParameter,
+                    "thread pool must have at least one thread");
+    }
+    try {
+        start(threads);
+    } catch (...) {
+        // Don't leave the threads started so far behind.
+        stop();
+        throw;
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void
+ThreadPool::start(size_t threads) {
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.push_back(boost::shared_ptr<Thread>(
+            new Thread(boost::bind(&ThreadPool::run, this))));
+    }
+}
+
+void
+ThreadPool::stop() {
+    {
+        Mutex::Locker locker(mutex_);
+        stopping_ = true;
+        // Only one of the threads is woken up. It wakes up the next one
+        // when it terminates.
+        task_cond_.signal();
+    }
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i]->wait();
+    }
+    threads_.clear();
+}
+
+void
+ThreadPool::add(const Task& task) {
+    Mutex::Locker locker(mutex_);
+    tasks_.push_back(task);
+    task_cond_.signal();
+}
+
+void
+ThreadPool::wait() {
+    Mutex::Locker locker(mutex_);
+    while (!tasks_.empty() || (running_ > 0)) {
+        idle_cond_.wait(mutex_);
+    }
+    // Another thread may be waiting too.
+    idle_cond_.signal();
+}
+
+void
+ThreadPool::run() {
+    while (true) {
+        Task task;
+        {
+            Mutex::Locker locker(mutex_);
+            while (tasks_.empty() && !stopping_) {
+                task_cond_.wait(mutex_);
+            }
+            if (tasks_.empty()) {
+                // Stopping, and there is nothing left to do. Pass the stop
+                // request on to the next thread.
+                task_cond_.signal();
+                return;
+            }
+            task.swap(tasks_.front());
+            tasks_.pop_front();
+            ++running_;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            // The task is supposed to handle its errors. There is
+            // nobody to report them to here.
+        }
+
+        Mutex::Locker locker(mutex_);
+        if ((--running_ == 0) && tasks_.empty()) {
+            idle_cond_.signal();
+        }
+    }
+}
+
+} // namespace thread
+} // namespace util
+} // namespace bundy
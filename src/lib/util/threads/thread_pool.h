@@ -0,0 +1,112 @@
+// Copyright (C) 2014  Internet Systems Consortium, Inc. ("ISC")
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+// OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef BUNDY_THREAD_POOL_H
+#define BUNDY_THREAD_POOL_H
+
+#include <util/threads/sync.h>
+#include <util/threads/thread.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace bundy {
+namespace util {
+namespace thread {
+
+/// \brief A fixed set of threads running queued tasks.
+///
+/// The tasks are picked up by the threads in the order they were added,
+/// but as there are several threads, the tasks may run concurrently and
+/// complete in any order. The tasks must handle their own errors: an
+/// exception thrown by a task is ignored, so as the thread can go on
+/// with the next one.
+class ThreadPool : boost::noncopyable {
+public:
+    /// \brief The task run by the pool.
+    typedef boost::function<void()> Task;
+
+    /// \brief Constructor.
+    ///
+    /// Starts the threads, which wait for the tasks to be added.
+    ///
+    /// \param threads Number of threads.
+    ///
+    /// \throw bundy::InvalidParameter if the number of threads is 0.
+    /// \throw std::bad_alloc or bundy::InvalidOperation if a thread
+    /// can't be started.
+    explicit ThreadPool(size_t threads);
+
+    /// \brief Destructor.
+    ///
+    /// Runs the tasks remaining in the queue and stops the threads.
+    ~ThreadPool();
+
+    /// \brief Queues the task to be run by one of the threads.
+    ///
+    /// \param task The task.
+    void add(const Task& task);
+
+    /// \brief Waits until all tasks added so far have completed.
+    ///
+    /// The tasks added by other threads while waiting are waited for too.
+    void wait();
+
+    /// \brief Returns the number of threads.
+    size_t size() const {
+        return (threads_.size());
+    }
+
+private:
+    /// \brief The main function of the threads.
+    void run();
+
+    /// \brief Starts the threads.
+    void start(size_t threads);
+
+    /// \brief Stops the threads, after the queued tasks have completed.
+    void stop();
+
+    /// \brief Tasks waiting to be picked up.
+    std::deque<Task> tasks_;
+
+    /// \brief Number of tasks being run.
+    size_t running_;
+
+    /// \brief Set when the threads should terminate.
+    bool stopping_;
+
+    /// \brief Protects the members above.
+    Mutex mutex_;
+
+    /// \brief Signalled when a task is added or the pool is stopping.
+    CondVar task_cond_;
+
+    /// \brief Signalled when the last running task has completed and
+    /// the queue is empty.
+    CondVar idle_cond_;
+
+    /// \brief The threads.
+    std::vector<boost::shared_ptr<Thread> > threads_;
+};
+
+} // namespace thread
+} // namespace util
+} // namespace bundy
+
+#endif // BUNDY_THREAD_POOL_H